@@ -7,6 +7,7 @@ include(XmlRpcEpi)
 
 set(LLMESSAGE_INCLUDE_DIRS
     ${LIBS_OPEN_DIR}/llmessage
+    ${CMAKE_BINARY_DIR}/${LIBS_OPEN_PREFIX}llmessage
     ${CARES_INCLUDE_DIRS}
     ${CURL_INCLUDE_DIRS}
     ${OPENSSL_INCLUDE_DIRS}
@@ -51,7 +51,9 @@ static const S32 WAV_HEADER_SIZE = 44;
 //////////////////////////////////////////////////////////////////////////////
 
 
-class LLVorbisDecodeState : public LLRefCount
+// Thread safe ref count: the LFS WriteResponder holds a reference and is
+// released on the LFS thread.
+class LLVorbisDecodeState : public LLThreadSafeRefCount
 {
 public:
 	class WriteResponder : public LLLFSThread::Responder
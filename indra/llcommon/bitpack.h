@@ -29,6 +29,10 @@
 
 #include "llerror.h"
 
+#if LL_MSVC
+#include <intrin.h>
+#endif
+
 const U32 MAX_DATA_BITS = 8;
 
 
@@ -205,4 +209,42 @@ public:
 	U32		mMaxSize;
 };
 
+// Index of the highest set bit of value, which must not be 0
+inline S32 ll_highest_bit(U32 value)
+{
+#if LL_MSVC
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return (S32)index;
+#elif LL_GNUC
+	return 31 - __builtin_clz(value);
+#else
+	S32 index = 31;
+	while (!(value & (1U << index)))
+	{
+		--index;
+	}
+	return index;
+#endif
+}
+
+// Index of the lowest set bit of value, which must not be 0
+inline S32 ll_lowest_bit(U32 value)
+{
+#if LL_MSVC
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (S32)index;
+#elif LL_GNUC
+	return __builtin_ctz(value);
+#else
+	S32 index = 0;
+	while (!(value & (1U << index)))
+	{
+		++index;
+	}
+	return index;
+#endif
+}
+
 #endif
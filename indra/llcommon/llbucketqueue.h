@@ -0,0 +1,292 @@
+/**
+ * @file llbucketqueue.h
+ * @brief Bucketed priority queue with O(1) erase and top, and cheap reprioritization.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLBUCKETQUEUE_H
+#define LL_LLBUCKETQUEUE_H
+
+#include "bitpack.h"
+
+//============================================================================
+// LLBucketQueue
+//
+// Priority queue for 31 bit priorities (0 .. 0x7FFFFFFF, higher first) that
+// files entries into NUM_BUCKETS buckets by the top bits of their priority.
+// A two level bitmap finds the highest non-empty bucket, so erase() and top()
+// are O(1) and reprioritizing is just erase() + insert().
+//
+// Each bucket is a list kept sorted by T::higherPriority(), so entries come
+// out in exactly the order a std::set with that comparison would give, low
+// priority bits included. That makes insert() walk the bucket from its tail:
+// O(1) for the common case of a new entry that sorts last, such as a request
+// with a newer handle at a priority already queued, and O(n) in the size of
+// the bucket at worst. Only entries within 2^19 priority of each other share
+// a bucket.
+//
+// Entries are intrusive: T must derive from LLBucketQueueEntry<T> and provide
+// U32 getPriority() const and bool higherPriority(const T&) const, which must
+// agree with getPriority() on entries of different priority. The priority of
+// a queued entry must not change until it has been erased. Not thread safe,
+// lock around it.
+
+template <class T> class LLBucketQueue;
+
+template <class T>
+class LLBucketQueueEntry
+{
+	friend class LLBucketQueue<T>;
+public:
+	LLBucketQueueEntry() :
+		mBucketNext(NULL),
+		mBucketPrev(NULL),
+		mBucket(-1)
+	{
+	}
+	bool isBucketQueued() const { return mBucket >= 0; }
+
+private:
+	T* mBucketNext;
+	T* mBucketPrev;
+	S32 mBucket;
+};
+
+template <class T>
+class LLBucketQueue
+{
+public:
+	enum
+	{
+		BUCKET_BITS = 12,
+		NUM_BUCKETS = 1 << BUCKET_BITS,
+		BUCKET_SHIFT = 31 - BUCKET_BITS,
+		NUM_WORDS = NUM_BUCKETS / 32,
+		NUM_SUMMARY_WORDS = (NUM_WORDS + 31) / 32
+	};
+
+	// Walks entries in pop() order. Invalidated by any change to the queue.
+	class iterator
+	{
+	public:
+		iterator(const LLBucketQueue<T>* queue = NULL, T* entry = NULL) : mQueue(queue), mEntry(entry) {}
+		T* operator*() const { return mEntry; }
+		iterator& operator++() { mEntry = mQueue->getNext(mEntry); return *this; }
+		bool operator==(const iterator& rhs) const { return mEntry == rhs.mEntry; }
+		bool operator!=(const iterator& rhs) const { return mEntry != rhs.mEntry; }
+	private:
+		const LLBucketQueue<T>* mQueue;
+		T* mEntry;
+	};
+	typedef iterator const_iterator;
+
+public:
+	LLBucketQueue() :
+		mSize(0)
+	{
+		memset(mHead, 0, sizeof(mHead));
+		memset(mTail, 0, sizeof(mTail));
+		memset(mBits, 0, sizeof(mBits));
+		memset(mSummary, 0, sizeof(mSummary));
+	}
+
+	static S32 getBucket(U32 priority)
+	{
+		return (S32)((priority & 0x7FFFFFFF) >> BUCKET_SHIFT);
+	}
+
+	bool empty() const { return mSize == 0; }
+	size_t size() const { return mSize; }
+
+	void insert(T* entry)
+	{
+		LLBucketQueueEntry<T>* link = entry;
+		llassert(!link->isBucketQueued());
+		S32 bucket = getBucket(entry->getPriority());
+		// Find the last entry that stays in front of this one
+		T* prev = mTail[bucket];
+		while (prev && entry->higherPriority(*prev))
+		{
+			prev = getLink(prev)->mBucketPrev;
+		}
+		T* next = prev ? getLink(prev)->mBucketNext : mHead[bucket];
+		link->mBucket = bucket;
+		link->mBucketPrev = prev;
+		link->mBucketNext = next;
+		if (prev)
+		{
+			getLink(prev)->mBucketNext = entry;
+		}
+		else
+		{
+			if (!mHead[bucket])
+			{
+				setBit(bucket);
+			}
+			mHead[bucket] = entry;
+		}
+		if (next)
+		{
+			getLink(next)->mBucketPrev = entry;
+		}
+		else
+		{
+			mTail[bucket] = entry;
+		}
+		++mSize;
+	}
+
+	// Returns the number of entries removed (0 or 1), like std::set::erase()
+	size_t erase(T* entry)
+	{
+		LLBucketQueueEntry<T>* link = entry;
+		S32 bucket = link->mBucket;
+		if (bucket < 0)
+		{
+			return 0;
+		}
+		if (link->mBucketPrev)
+		{
+			getLink(link->mBucketPrev)->mBucketNext = link->mBucketNext;
+		}
+		else
+		{
+			mHead[bucket] = link->mBucketNext;
+		}
+		if (link->mBucketNext)
+		{
+			getLink(link->mBucketNext)->mBucketPrev = link->mBucketPrev;
+		}
+		else
+		{
+			mTail[bucket] = link->mBucketPrev;
+		}
+		if (!mHead[bucket])
+		{
+			clearBit(bucket);
+		}
+		link->mBucketNext = NULL;
+		link->mBucketPrev = NULL;
+		link->mBucket = -1;
+		--mSize;
+		return 1;
+	}
+
+	// Highest priority entry, NULL if empty
+	T* top() const
+	{
+		S32 bucket = getHighestBucket(NUM_BUCKETS);
+		return bucket >= 0 ? mHead[bucket] : NULL;
+	}
+
+	T* pop()
+	{
+		T* entry = top();
+		if (entry)
+		{
+			erase(entry);
+		}
+		return entry;
+	}
+
+	// Next entry in pop() order, NULL at the end
+	T* getNext(T* entry) const
+	{
+		const LLBucketQueueEntry<T>* link = entry;
+		if (link->mBucketNext)
+		{
+			return link->mBucketNext;
+		}
+		S32 bucket = getHighestBucket(link->mBucket);
+		return bucket >= 0 ? mHead[bucket] : NULL;
+	}
+
+	iterator begin() const { return iterator(this, top()); }
+	iterator end() const { return iterator(this, NULL); }
+
+private:
+	static LLBucketQueueEntry<T>* getLink(T* entry) { return entry; }
+
+	void setBit(S32 bucket)
+	{
+		S32 word = bucket >> 5;
+		mBits[word] |= 1U << (bucket & 31);
+		mSummary[word >> 5] |= 1U << (word & 31);
+	}
+
+	void clearBit(S32 bucket)
+	{
+		S32 word = bucket >> 5;
+		mBits[word] &= ~(1U << (bucket & 31));
+		if (!mBits[word])
+		{
+			mSummary[word >> 5] &= ~(1U << (word & 31));
+		}
+	}
+
+	// Highest non-empty bucket strictly below 'below', -1 if none
+	S32 getHighestBucket(S32 below) const
+	{
+		if (below <= 0)
+		{
+			return -1;
+		}
+		S32 bucket = below - 1;
+		S32 word = bucket >> 5;
+		// Rest of the word holding 'bucket'
+		U32 bits = mBits[word] & (0xFFFFFFFFU >> (31 - (bucket & 31)));
+		if (bits)
+		{
+			return (word << 5) + ll_highest_bit(bits);
+		}
+		// Lower words, found through the summary
+		if (word == 0)
+		{
+			return -1;
+		}
+		S32 below_word = word - 1;
+		for (S32 sword = below_word >> 5; sword >= 0; --sword)
+		{
+			U32 summary = mSummary[sword];
+			if (sword == (below_word >> 5))
+			{
+				summary &= 0xFFFFFFFFU >> (31 - (below_word & 31));
+			}
+			if (summary)
+			{
+				S32 found = (sword << 5) + ll_highest_bit(summary);
+				return (found << 5) + ll_highest_bit(mBits[found]);
+			}
+		}
+		return -1;
+	}
+
+private:
+	T* mHead[NUM_BUCKETS];
+	T* mTail[NUM_BUCKETS];
+	U32 mBits[NUM_WORDS];
+	U32 mSummary[NUM_SUMMARY_WORDS];
+	size_t mSize;
+};
+
+#endif // LL_LLBUCKETQUEUE_H
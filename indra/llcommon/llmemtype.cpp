@@ -181,6 +181,8 @@ LLMemType::DeclareMemType LLMemType::MTYPE_IO_SD_SERVER("IoSDServer");
 LLMemType::DeclareMemType LLMemType::MTYPE_IO_SD_CLIENT("IoSDClient");
 LLMemType::DeclareMemType LLMemType::MTYPE_IO_URL_REQUEST("IOUrlRequest");
 
+LLMemType::DeclareMemType LLMemType::MTYPE_LLSD("LLSD");
+
 LLMemType::DeclareMemType LLMemType::MTYPE_DIRECTX_INIT("DirectXInit");
 
 LLMemType::DeclareMemType LLMemType::MTYPE_TEMP1("Temp1");
@@ -219,6 +219,8 @@ public:
 	static DeclareMemType MTYPE_IO_SD_CLIENT;
 	static DeclareMemType MTYPE_IO_URL_REQUEST;
 
+	static DeclareMemType MTYPE_LLSD;
+
 	static DeclareMemType MTYPE_DIRECTX_INIT;
 
 	static DeclareMemType MTYPE_TEMP1;
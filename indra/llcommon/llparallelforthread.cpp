@@ -0,0 +1,132 @@
+/**
+ * @file llparallelforthread.cpp
+ * @brief Runs a batch of independent items on the shared thread pool and the calling thread
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "llparallelforthread.h"
+
+#include "llthreadpool.h"
+
+LLParallelForThread::LLParallelForThread(const std::string& name)
+	: LLQueuedThread(name, true),
+	  mCount(0),
+	  mNextItem(0),
+	  mRemaining(0)
+{
+	mBatchCondition = new LLCondition(NULL);
+	if (isPooled())
+	{
+		setMaxConcurrency(getSharedPool()->getWorkerCount());
+	}
+}
+
+LLParallelForThread::~LLParallelForThread()
+{
+	// Requests left over from the last batch mustn't find the condition gone
+	shutdown();
+	delete mBatchCondition;
+	mBatchCondition = NULL;
+}
+
+S32 LLParallelForThread::getWorkerCount()
+{
+	return isPooled() ? (S32) getSharedPool()->getWorkerCount() : 1;
+}
+
+void LLParallelForThread::runBatch(S32 count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	mBatchCondition->lock();
+	mCount = count;
+	mNextItem = 0;
+	mRemaining = count;
+	mBatchCondition->unlock();
+
+	// One request per worker that could help, less the ones still queued
+	// from an earlier batch (they take from this one when they get to run)
+	S32 wanted = llmin(getWorkerCount(), count - 1) - getPending();
+	for (S32 i = 0; i < wanted; ++i)
+	{
+		if (!addRequest(new ItemsRequest(generateHandle(), this)))
+		{
+			llerrs << "LLParallelForThread " << mName << " batch run after shutdown" << llendl;
+		}
+	}
+	update(0); // unpauses
+
+	processItems();
+
+	mBatchCondition->lock();
+	while (mRemaining > 0)
+	{
+		mBatchCondition->wait();
+	}
+	mCount = 0;
+	mNextItem = 0;
+	mBatchCondition->unlock();
+}
+
+void LLParallelForThread::processItems()
+{
+	mBatchCondition->lock();
+	while (mNextItem < mCount)
+	{
+		S32 index = mNextItem++;
+		mBatchCondition->unlock();
+
+		processItem(index);
+
+		mBatchCondition->lock();
+		if (--mRemaining == 0)
+		{
+			mBatchCondition->signal();
+		}
+	}
+	mBatchCondition->unlock();
+}
+
+//============================================================================
+
+LLParallelForThread::ItemsRequest::ItemsRequest(handle_t handle, LLParallelForThread* thread)
+	: LLQueuedThread::QueuedRequest(handle, LLQueuedThread::PRIORITY_HIGH, FLAG_AUTO_COMPLETE),
+	  mThread(thread)
+{
+}
+
+LLParallelForThread::ItemsRequest::~ItemsRequest()
+{
+}
+
+// virtual, called from own thread
+bool LLParallelForThread::ItemsRequest::processRequest()
+{
+	// Finds nothing to do if the batch was already taken
+	mThread->processItems();
+	return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file llparallelforthread.h
+ * @brief Runs a batch of independent items on the shared thread pool and the calling thread
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLPARALLELFORTHREAD_H
+#define LL_LLPARALLELFORTHREAD_H
+
+#include "llqueuedthread.h"
+
+// Calls processItem() for every item of a batch on the workers of the shared
+// LLThreadPool.  The calling thread takes items from the same batch instead
+// of waiting idle, so a batch never takes longer than it would on that
+// thread alone, even when the workers are busy with something else.  Once
+// it runs out of items it sleeps until the last one taken elsewhere is done.
+class LL_COMMON_API LLParallelForThread : public LLQueuedThread
+{
+public:
+	class ItemsRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		virtual ~ItemsRequest(); // use deleteRequest()
+
+	public:
+		ItemsRequest(handle_t handle, LLParallelForThread* thread);
+
+		/*virtual*/ bool processRequest();
+
+	private:
+		LLParallelForThread* mThread;
+	};
+
+	LLParallelForThread(const std::string& name);
+	virtual ~LLParallelForThread();
+
+	// Worker threads a batch can use besides the calling thread
+	S32 getWorkerCount();
+
+protected:
+	// One thread at a time. Calls processItem(0) to processItem(count - 1)
+	// and returns once all of them are done.
+	void runBatch(S32 count);
+
+	// Any thread, items of a batch run concurrently
+	virtual void processItem(S32 index) = 0;
+
+private:
+	// Any thread. Runs items until there are none left to take.
+	void processItems();
+
+	LLCondition* mBatchCondition;	// signaled when the last item is done
+	S32 mCount;						// items in the batch, guarded by mBatchCondition
+	S32 mNextItem;					// guarded by mBatchCondition
+	S32 mRemaining;					// items not done yet, guarded by mBatchCondition
+};
+
+#endif // LL_LLPARALLELFORTHREAD_H
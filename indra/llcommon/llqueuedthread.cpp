@@ -27,21 +27,39 @@
 #include "llqueuedthread.h"
 
 #include "llstl.h"
+#include "llthreadpool.h"
 #include "lltimer.h"	// ms_sleep()
 
 //============================================================================
 
+// static
+LLThreadPool* LLQueuedThread::sSharedPool = NULL;
+
+// How long a pooled queue waits before polling requests that aren't ready
+const U32 POOLED_POLL_DELAY_MS = 1;
+
 // MAIN THREAD
 LLQueuedThread::LLQueuedThread(const std::string& name, bool threaded) :
 	LLThread(name),
 	mThreaded(threaded),
 	mIdleThread(TRUE),
 	mNextHandle(0),
-	mStarted(FALSE)
+	mStarted(FALSE),
+	mPool(threaded ? sSharedPool : NULL),
+	mScheduled(0),
+	mMaxConcurrency(1)
 {
 	if (mThreaded)
 	{
-		start();
+		if (mPool)
+		{
+			// No thread of our own, the pool's workers run us
+			mStatus = RUNNING;
+		}
+		else
+		{
+			start();
+		}
 	}
 }
 
@@ -63,6 +81,23 @@ void LLQueuedThread::shutdown()
 	unpause(); // MAIN THREAD
 	if (mThreaded)
 	{
+		if (mPool)
+		{
+			if (mPool->isRunning())
+			{
+				// The pool worker servicing this slot calls endThread() and stops us
+				schedulePooled();
+			}
+			else if (!isStopped())
+			{
+				// No worker left that could be running us
+				if (mStarted)
+				{
+					endThread();
+				}
+				mStatus = STOPPED;
+			}
+		}
 		S32 timeout = 100;
 		for ( ; timeout>0; timeout--)
 		{
@@ -77,6 +112,12 @@ void LLQueuedThread::shutdown()
 		{
 			llwarns << "~LLQueuedThread (" << mName << ") timed out!" << llendl;
 		}
+		if (mPool)
+		{
+			// The worker that stopped us may still be on its way out of
+			// servicePooled()
+			mPool->drain(this);
+		}
 	}
 	else
 	{
@@ -129,8 +170,12 @@ S32 LLQueuedThread::updateQueue(U32 max_time_ms)
 		pending = getPending();
 		if(pending > 0)
 		{
-		unpause();
-	}
+			unpause();
+			if (mPool)
+			{
+				schedulePooled();
+			}
+		}
 	}
 	else
 	{
@@ -149,7 +194,11 @@ void LLQueuedThread::incQueue()
 	// Something has been added to the queue
 	if (!isPaused())
 	{
-		if (mThreaded)
+		if (mPool)
+		{
+			schedulePooled();
+		}
+		else if (mThreaded)
 		{
 			wake(); // Wake the thread up if necessary.
 		}
@@ -192,7 +241,7 @@ void LLQueuedThread::printQueueStats()
 	lockData();
 	if (!mRequestQueue.empty())
 	{
-		QueuedRequest *req = *mRequestQueue.begin();
+		QueuedRequest *req = mRequestQueue.top();
 		llinfos << llformat("Pending Requests:%d Current status:%d", mRequestQueue.size(), req->getStatus()) << llendl;
 	}
 	else
@@ -340,7 +389,7 @@ void LLQueuedThread::setPriority(handle_t handle, U32 priority)
 		}
 		else if(req->getStatus() == STATUS_QUEUED)
 		{
-			// remove from list then re-insert
+			// remove from list then re-insert, only walks the new bucket
 			llverify(mRequestQueue.erase(req) == 1);
 			req->setPriority(priority);
 			mRequestQueue.insert(req);
@@ -393,8 +442,13 @@ bool LLQueuedThread::check()
 //============================================================================
 // Runs on its OWN thread
 
-S32 LLQueuedThread::processNextRequest()
+// progressed, if given, is set when a request left the queue for good
+S32 LLQueuedThread::processNextRequest(bool* progressed)
 {
+	if (progressed)
+	{
+		*progressed = false;
+	}
 	QueuedRequest *req;
 	// Get next request from pool
 	lockData();
@@ -405,8 +459,7 @@ S32 LLQueuedThread::processNextRequest()
 		{
 			break;
 		}
-		req = *mRequestQueue.begin();
-		mRequestQueue.erase(mRequestQueue.begin());
+		req = mRequestQueue.pop();
 		if ((req->getFlags() & FLAG_ABORT) || (mStatus == QUITTING))
 		{
 			req->setStatus(STATUS_ABORTED);
@@ -417,6 +470,10 @@ S32 LLQueuedThread::processNextRequest()
 				req->deleteRequest();
 // 				check();
 			}
+			if (progressed)
+			{
+				*progressed = true;
+			}
 			continue;
 		}
 		llassert_always(req->getStatus() == STATUS_QUEUED);
@@ -440,6 +497,10 @@ S32 LLQueuedThread::processNextRequest()
 
 		if (complete)
 		{
+			if (progressed)
+			{
+				*progressed = true;
+			}
 			lockData();
 			req->setStatus(STATUS_COMPLETE);
 			req->finishRequest(true);
@@ -457,7 +518,8 @@ S32 LLQueuedThread::processNextRequest()
 			req->setStatus(STATUS_QUEUED);
 			mRequestQueue.insert(req);
 			unlockData();
-			if (mThreaded && start_priority < PRIORITY_NORMAL)
+			// Pool workers are shared, servicePooled() backs off instead
+			if (mThreaded && !mPool && start_priority < PRIORITY_NORMAL)
 			{
 				ms_sleep(1); // sleep the thread a little
 			}
@@ -513,6 +575,97 @@ void LLQueuedThread::run()
 	llinfos << "LLQueuedThread " << mName << " EXITING." << llendl;
 }
 
+//============================================================================
+// Pooled mode, see llthreadpool.h
+
+// Any thread
+void LLQueuedThread::schedulePooled(U32 delay_ms)
+{
+	lockData();
+	if (isStopped() || mScheduled >= mMaxConcurrency ||
+		(mRequestQueue.empty() && !isQuitting()))
+	{
+		unlockData();
+		return;
+	}
+	++mScheduled;
+	LLThreadPool::lane_t lane = LLThreadPool::LANE_HIGH;
+	if (!mRequestQueue.empty())
+	{
+		lane = LLThreadPool::laneForPriority(mRequestQueue.top()->getPriority());
+	}
+	unlockData();
+
+	if (delay_ms)
+	{
+		mPool->scheduleDeferred(this, lane, delay_ms);
+	}
+	else
+	{
+		mPool->schedule(this, lane);
+	}
+}
+
+// POOL WORKER THREAD
+// Does what one pass of run() does, then gives the slot back.
+void LLQueuedThread::servicePooled()
+{
+	if (isQuitting())
+	{
+		// The last slot out stops us. This has to happen with the data locked
+		// so no new slot can sneak in, endThread() must not call lockData().
+		lockData();
+		if (--mScheduled == 0)
+		{
+			if (mStarted)
+			{
+				endThread();
+			}
+			mIdleThread = TRUE;
+			mStatus = STOPPED;
+		}
+		unlockData();
+		return;
+	}
+
+	lockData();
+	bool start = !mStarted;
+	mStarted = TRUE;
+	unlockData();
+	if (start)
+	{
+		startThread();
+	}
+
+	mIdleThread = FALSE;
+
+	threadedUpdate();
+
+	bool progressed = false;
+	S32 pending = processNextRequest(&progressed);
+
+	lockData();
+	--mScheduled;
+	unlockData();
+
+	if (pending == 0)
+	{
+		mIdleThread = TRUE;
+	}
+	if (isQuitting())
+	{
+		// One more pass to stop us
+		schedulePooled();
+	}
+	else if (pending > 0 && !isPaused())
+	{
+		// A request that is still waiting on something (processRequest()
+		// returned false) is polled again after a short wait, the way run()
+		// sleeps, but without holding on to the worker meanwhile.
+		schedulePooled(progressed ? 0 : POOLED_POLL_DELAY_MS);
+	}
+}
+
 // virtual
 void LLQueuedThread::startThread()
 {
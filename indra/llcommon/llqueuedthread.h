@@ -36,13 +36,22 @@
 
 #include "llthread.h"
 #include "llsimplehash.h"
+#include "llbucketqueue.h"
+
+class LLThreadPool;
 
 //============================================================================
 // Note: ~LLQueuedThread is O(N) N=# of queued threads, assumed to be small
 //   It is assumed that LLQueuedThreads are rarely created/destroyed.
+//
+// Note: A threaded LLQueuedThread created while a shared LLThreadPool is set
+//   does not start a thread of its own, its requests are processed by the
+//   pool's workers instead (see llthreadpool.h). Nothing else changes for
+//   callers, pause() still holds back processing until the next update().
 
 class LL_COMMON_API LLQueuedThread : public LLThread
 {
+	friend class LLThreadPool;
 	//------------------------------------------------------------------------
 public:
 	enum priority_t {
@@ -74,7 +83,7 @@ public:
 	//------------------------------------------------------------------------
 public:
 
-	class LL_COMMON_API QueuedRequest : public LLSimpleHashEntry<handle_t>
+	class LL_COMMON_API QueuedRequest : public LLSimpleHashEntry<handle_t>, public LLBucketQueueEntry<QueuedRequest>
 	{
 		friend class LLQueuedThread;
 		
@@ -133,20 +142,15 @@ public:
 		U32 mFlags;
 	};
 
-protected:
-	struct queued_request_less
-	{
-		bool operator()(const QueuedRequest* lhs, const QueuedRequest* rhs) const
-		{
-			return lhs->higherPriority(*rhs); // higher priority in front of queue (set)
-		}
-	};
-
-
 	//------------------------------------------------------------------------
 	
 public:
 	static handle_t nullHandle() { return handle_t(0); }
+
+	// Pool used by threaded LLQueuedThreads constructed from now on, NULL for
+	// a dedicated thread each. Must outlive every queued thread using it.
+	static void setSharedPool(LLThreadPool* pool) { sSharedPool = pool; }
+	static LLThreadPool* getSharedPool() { return sSharedPool; }
 	
 public:
 	LLQueuedThread(const std::string& name, bool threaded = true);
@@ -164,12 +168,23 @@ private:
 	virtual void endThread(void);
 	virtual void threadedUpdate(void);
 
+	// Pooled mode
+	// Hands a service slot to mPool, if needed, that can't be taken for
+	// delay_ms
+	void schedulePooled(U32 delay_ms = 0);
+	void servicePooled(); // POOL WORKER THREAD
+
 protected:
 	handle_t generateHandle();
 	bool addRequest(QueuedRequest* req);
-	S32  processNextRequest(void);
+	S32  processNextRequest(bool* progressed = NULL);
 	void incQueue();
 
+	// Number of pool workers allowed to process requests at once. Only raise
+	// this if processRequest() is safe to run concurrently.
+	void setMaxConcurrency(S32 count) { mMaxConcurrency = llmax(count, 1); }
+	bool isPooled() const { return mPool != NULL; }
+
 public:
 	bool waitForResult(handle_t handle, bool auto_complete = true);
 
@@ -181,6 +196,7 @@ public:
 
 	S32 getPending();
 	bool getThreaded() { return mThreaded ? true : false; }
+	S32 getMaxConcurrency() const { return mMaxConcurrency; }
 
 	// Request accessors
 	status_t getRequestStatus(handle_t handle);
@@ -200,7 +216,10 @@ protected:
 	BOOL mStarted;  // required when mThreaded is false to call startThread() from update()
 	LLAtomic32<BOOL> mIdleThread; // request queue is empty (or we are quitting) and the thread is idle
 	
-	typedef std::set<QueuedRequest*, queued_request_less> request_queue_t;
+	// Bucketed by priority so setPriority() only touches the request's
+	// bucket, see llbucketqueue.h. Same order as higherPriority(), handles
+	// break ties.
+	typedef LLBucketQueue<QueuedRequest> request_queue_t;
 	request_queue_t mRequestQueue;
 
 	enum { REQUEST_HASH_SIZE = 512 }; // must be power of 2
@@ -208,6 +227,12 @@ protected:
 	request_hash_t mRequestHash;
 
 	handle_t mNextHandle;
+
+	LLThreadPool* mPool; // NULL unless threaded and pooled
+	S32 mScheduled; // service slots in mPool, guarded by lockData()
+	S32 mMaxConcurrency;
+
+	static LLThreadPool* sSharedPool;
 };
 
 #endif // LL_LLQUEUEDTHREAD_H
@@ -44,6 +44,22 @@ namespace
 {
 	class ImplMap;
 	class ImplArray;
+
+	// Booleans are kept in the Impl pointer itself, as one of two values
+	// with a low bit set, so they take no allocation and no use count.
+	// Heap Impls are always at least 4 byte aligned.
+	const intptr_t INLINE_FALSE = 2;
+	const intptr_t INLINE_TRUE = 6;
+	const intptr_t INLINE_MASK = 3;
+
+	inline bool isInline(const LLSD::Impl* impl)
+		{ return ((intptr_t)impl & INLINE_MASK) != 0; }
+
+	inline bool inlineBoolean(const LLSD::Impl* impl)
+		{ return (intptr_t)impl == INLINE_TRUE; }
+
+	inline LLSD::Impl* makeInline(LLSD::Boolean v)
+		{ return (LLSD::Impl*)(v ? INLINE_TRUE : INLINE_FALSE); }
 }
 
 #ifdef NAME_UNNAMED_NAMESPACE
@@ -124,7 +140,7 @@ public:
 	virtual const LLSD& ref(Integer) const		{ return undef(); }
 
 	virtual LLSD::map_const_iterator beginMap() const { return endMap(); }
-	virtual LLSD::map_const_iterator endMap() const { static const std::map<String, LLSD> empty; return empty.end(); }
+	virtual LLSD::map_const_iterator endMap() const { return LLSD::map_const_iterator(); }
 	virtual LLSD::array_const_iterator beginArray() const { return endArray(); }
 	virtual LLSD::array_const_iterator endArray() const { static const std::vector<LLSD> empty; return empty.end(); }
 
@@ -169,27 +185,6 @@ namespace
 		}
 	};
 
-	
-	class ImplBoolean
-		: public ImplBase<LLSD::TypeBoolean, LLSD::Boolean>
-	{
-	public:
-		ImplBoolean(LLSD::Boolean v) : Base(v) { }
-		
-		virtual LLSD::Boolean	asBoolean() const	{ return mValue; }
-		virtual LLSD::Integer	asInteger() const	{ return mValue ? 1 : 0; }
-		virtual LLSD::Real		asReal() const		{ return mValue ? 1 : 0; }
-		virtual LLSD::String	asString() const;
-	};
-
-	LLSD::String ImplBoolean::asString() const
-		// *NOTE: The reason that false is not converted to "false" is
-		// because that would break roundtripping,
-		// e.g. LLSD(false).asString().asBoolean().  There are many
-		// reasons for wanting LLSD("false").asBoolean() == true, such
-		// as "everything else seems to work that way".
-		{ return mValue ? "true" : ""; }
-
 
 	class ImplInteger
 		: public ImplBase<LLSD::TypeInteger, LLSD::Integer>
@@ -327,21 +322,55 @@ namespace
 	class ImplMap : public LLSD::Impl
 	{
 	private:
-		typedef std::map<LLSD::String, LLSD>	DataMap;
-		
-		DataMap mData;
+		typedef LLSD::MapNode			Entry;
+		typedef std::vector<Entry*>		Index;
+
+		struct KeyPtrLess
+		{
+			bool operator()(const LLSD::String* a, const LLSD::String* b) const
+				{ return *a < *b; }
+		};
+		typedef std::map<const LLSD::String*, Entry*, KeyPtrLess> Tree;
+
+		// Maps with more keys than this are indexed by a tree instead,
+		// inserting into the sorted index is linear in its size
+		enum { TREE_THRESHOLD = 64 };
+
+		// Entries are built in place in blocks that are never moved or
+		// resized, so a value's address is fixed for as long as its key is
+		// in the map.  The entries are linked in key order through mHead
+		// so iterators only depend on their own entry.  Small maps find
+		// keys in mIndex, a sorted vector, large ones in mTree, keyed by
+		// the entries' own keys.  Erased slots are reused before a new
+		// block is allocated.  A map of a few keys costs two allocations
+		// rather than one per key.
+		union Block
+		{
+			Block* mNext;
+			F64 mAlign;		// keeps the entries after it aligned
+		};
+
+		LLSD::MapLink mHead;	// mNext is the first entry, mPrev the last
+		S32 mSize;
+		Index mIndex;			// empty once mTree is in use
+		Tree* mTree;
+		Index mFree;
+		Block* mBlocks;
+		Entry* mNextSlot;
+		Entry* mSlotsEnd;
 		
 	protected:
-		ImplMap(const DataMap& data) : mData(data) { }
+		ImplMap(const ImplMap& other);
 		
 	public:
-		ImplMap() { }
+		ImplMap();
+		virtual ~ImplMap();
 		
 		virtual ImplMap& makeMap(LLSD::Impl*&);
 
 		virtual LLSD::Type type() const { return LLSD::TypeMap; }
 
-		virtual LLSD::Boolean asBoolean() const { return !mData.empty(); }
+		virtual LLSD::Boolean asBoolean() const { return mSize != 0; }
 
 		virtual bool has(const LLSD::String&) const; 
 
@@ -354,19 +383,88 @@ namespace
 		              LLSD& ref(const LLSD::String&);
 		virtual const LLSD& ref(const LLSD::String&) const;
 
-		virtual int size() const { return mData.size(); }
+		virtual int size() const { return mSize; }
+
+		LLSD::map_iterator beginMap() { return LLSD::map_iterator(mHead.mNext); }
+		LLSD::map_iterator endMap() { return LLSD::map_iterator(&mHead); }
+		virtual LLSD::map_const_iterator beginMap() const { return LLSD::map_const_iterator(mHead.mNext); }
+		virtual LLSD::map_const_iterator endMap() const { return LLSD::map_const_iterator(const_cast<LLSD::MapLink*>(&mHead)); }
 
-		LLSD::map_iterator beginMap() { return mData.begin(); }
-		LLSD::map_iterator endMap() { return mData.end(); }
-		virtual LLSD::map_const_iterator beginMap() const { return mData.begin(); }
-		virtual LLSD::map_const_iterator endMap() const { return mData.end(); }
+	private:
+		Entry* find(const LLSD::String& k) const;
+		// The entry for k, added with v if there is none
+		Entry* findOrAdd(const LLSD::String& k, const LLSD& v);
+		Entry* newEntry(const LLSD::String& k, const LLSD& v);
+		// Links entry in front of next
+		Entry* link(Entry* entry, LLSD::MapLink* next);
+		void addBlock(size_t slots);
+		void buildTree();
+
+		struct KeyLess
+		{
+			bool operator()(const Entry* entry, const LLSD::String& k) const
+				{ return entry->mValue.first < k; }
+		};
 	};
+
+	ImplMap::ImplMap()
+	:	mSize(0),
+		mTree(NULL),
+		mBlocks(NULL),
+		mNextSlot(NULL),
+		mSlotsEnd(NULL)
+	{
+		mHead.mNext = mHead.mPrev = &mHead;
+	}
+
+	ImplMap::ImplMap(const ImplMap& other)
+	:	mSize(0),
+		mTree(NULL),
+		mBlocks(NULL),
+		mNextSlot(NULL),
+		mSlotsEnd(NULL)
+	{
+		mHead.mNext = mHead.mPrev = &mHead;
+		// Only the entries are copied, the values they hold are shared
+		// until one side changes them.
+		if (other.mSize)
+		{
+			addBlock(other.mSize);
+			mIndex.reserve(other.mSize);
+			for (LLSD::MapLink* l = other.mHead.mNext; l != &other.mHead; l = l->mNext)
+			{
+				const Entry* entry = static_cast<const Entry*>(l);
+				mIndex.push_back(link(newEntry(entry->mValue.first, entry->mValue.second), &mHead));
+			}
+			if (mSize > TREE_THRESHOLD)
+			{
+				buildTree();
+			}
+		}
+	}
+
+	ImplMap::~ImplMap()
+	{
+		for (LLSD::MapLink* l = mHead.mNext; l != &mHead; )
+		{
+			Entry* entry = static_cast<Entry*>(l);
+			l = l->mNext;
+			entry->~Entry();
+		}
+		delete mTree;
+		while (mBlocks)
+		{
+			Block* next = mBlocks->mNext;
+			::operator delete(mBlocks);
+			mBlocks = next;
+		}
+	}
 	
 	ImplMap& ImplMap::makeMap(LLSD::Impl*& var)
 	{
 		if (shared())
 		{
-			ImplMap* i = new ImplMap(mData);
+			ImplMap* i = new ImplMap(*this);
 			Impl::assign(var, i);
 			return *i;
 		}
@@ -375,43 +473,154 @@ namespace
 			return *this;
 		}
 	}
+
+	void ImplMap::addBlock(size_t slots)
+	{
+		Block* block = (Block*)::operator new(sizeof(Block) + slots * sizeof(Entry));
+		block->mNext = mBlocks;
+		mBlocks = block;
+		mNextSlot = (Entry*)(block + 1);
+		mSlotsEnd = mNextSlot + slots;
+	}
+
+	ImplMap::Entry* ImplMap::newEntry(const LLSD::String& k, const LLSD& v)
+	{
+		Entry* slot;
+		if (!mFree.empty())
+		{
+			slot = mFree.back();
+			mFree.pop_back();
+		}
+		else
+		{
+			if (mNextSlot == mSlotsEnd)
+			{
+				// Double the space each time, starting small since most
+				// maps only ever hold a handful of keys.
+				addBlock(llmax((size_t)4, (size_t)mSize));
+			}
+			slot = mNextSlot++;
+		}
+		return new (slot) Entry(k, v);
+	}
+
+	ImplMap::Entry* ImplMap::link(Entry* entry, LLSD::MapLink* next)
+	{
+		entry->mNext = next;
+		entry->mPrev = next->mPrev;
+		next->mPrev->mNext = entry;
+		next->mPrev = entry;
+		++mSize;
+		return entry;
+	}
+
+	void ImplMap::buildTree()
+	{
+		mTree = new Tree;
+		for (Index::iterator i = mIndex.begin(); i != mIndex.end(); ++i)
+		{
+			mTree->insert(mTree->end(), std::make_pair(&(*i)->mValue.first, *i));
+		}
+		Index().swap(mIndex);
+	}
+
+	ImplMap::Entry* ImplMap::find(const LLSD::String& k) const
+	{
+		if (mTree)
+		{
+			Tree::const_iterator i = mTree->find(&k);
+			return (i != mTree->end()) ? i->second : NULL;
+		}
+		Index::const_iterator i = std::lower_bound(mIndex.begin(), mIndex.end(), k, KeyLess());
+		return (i != mIndex.end() && (*i)->mValue.first == k) ? *i : NULL;
+	}
+
+	ImplMap::Entry* ImplMap::findOrAdd(const LLSD::String& k, const LLSD& v)
+	{
+		if (mTree)
+		{
+			Tree::iterator i = mTree->lower_bound(&k);
+			if (i != mTree->end() && *i->first == k)
+			{
+				return i->second;
+			}
+			LLSD::MapLink* next = (i == mTree->end()) ? &mHead : i->second;
+			Entry* entry = link(newEntry(k, v), next);
+			mTree->insert(i, std::make_pair(&entry->mValue.first, entry));
+			return entry;
+		}
+
+		Index::iterator i = std::lower_bound(mIndex.begin(), mIndex.end(), k, KeyLess());
+		if (i != mIndex.end() && (*i)->mValue.first == k)
+		{
+			return *i;
+		}
+		LLSD::MapLink* next = (i == mIndex.end()) ? &mHead : *i;
+		Entry* entry = link(newEntry(k, v), next);
+		mIndex.insert(i, entry);
+		if (mSize > TREE_THRESHOLD)
+		{
+			buildTree();
+		}
+		return entry;
+	}
 	
 	bool ImplMap::has(const LLSD::String& k) const
 	{
-		DataMap::const_iterator i = mData.find(k);
-		return i != mData.end();
+		return find(k) != NULL;
 	}
 	
 	LLSD ImplMap::get(const LLSD::String& k) const
 	{
-		DataMap::const_iterator i = mData.find(k);
-		return (i != mData.end()) ? i->second : LLSD();
+		Entry* entry = find(k);
+		return entry ? entry->mValue.second : LLSD();
 	}
 	
 	void ImplMap::insert(const LLSD::String& k, const LLSD& v)
 	{
-		mData.insert(DataMap::value_type(k, v));
+		findOrAdd(k, v);
 	}
 	
 	void ImplMap::erase(const LLSD::String& k)
 	{
-		mData.erase(k);
+		Entry* entry = NULL;
+		if (mTree)
+		{
+			Tree::iterator i = mTree->find(&k);
+			if (i != mTree->end())
+			{
+				entry = i->second;
+				mTree->erase(i);
+			}
+		}
+		else
+		{
+			Index::iterator i = std::lower_bound(mIndex.begin(), mIndex.end(), k, KeyLess());
+			if (i != mIndex.end() && (*i)->mValue.first == k)
+			{
+				entry = *i;
+				mIndex.erase(i);
+			}
+		}
+		if (entry)
+		{
+			entry->mPrev->mNext = entry->mNext;
+			entry->mNext->mPrev = entry->mPrev;
+			--mSize;
+			entry->~Entry();
+			mFree.push_back(entry);
+		}
 	}
 	
 	LLSD& ImplMap::ref(const LLSD::String& k)
 	{
-		return mData[k];
+		return findOrAdd(k, LLSD())->mValue.second;
 	}
 	
 	const LLSD& ImplMap::ref(const LLSD::String& k) const
 	{
-		DataMap::const_iterator i = mData.lower_bound(k);
-		if (i == mData.end()  ||  mData.key_comp()(k, i->first))
-		{
-			return undef();
-		}
-		
-		return i->second;
+		Entry* entry = find(k);
+		return entry ? entry->mValue.second : undef();
 	}
 
 	class ImplArray : public LLSD::Impl
@@ -564,24 +773,26 @@ LLSD::Impl::~Impl()
 
 void LLSD::Impl::reset(Impl*& var, Impl* impl)
 {
-	if (impl) ++impl->mUseCount;
-	if (var  &&  --var->mUseCount == 0)
+	if (impl  &&  !isInline(impl)) ++impl->mUseCount;
+	if (var  &&  !isInline(var)  &&  --var->mUseCount == 0)
 	{
 		delete var;
 	}
 	var = impl;
 }
 
+// Inline booleans answer everything but their own accessors the way
+// Undefined does, so they get the undefined Impl here too.
 LLSD::Impl& LLSD::Impl::safe(Impl* impl)
 {
 	static Impl theUndefined(STATIC);
-	return impl ? *impl : theUndefined;
+	return (impl  &&  !isInline(impl)) ? *impl : theUndefined;
 }
 
 const LLSD::Impl& LLSD::Impl::safe(const Impl* impl)
 {
 	static Impl theUndefined(STATIC);
-	return impl ? *impl : theUndefined;
+	return (impl  &&  !isInline(impl)) ? *impl : theUndefined;
 }
 
 ImplMap& LLSD::Impl::makeMap(Impl*& var)
@@ -611,7 +822,7 @@ void LLSD::Impl::assignUndefined(Impl*& var)
 
 void LLSD::Impl::assign(Impl*& var, LLSD::Boolean v)
 {
-	reset(var, new ImplBoolean(v));
+	reset(var, makeInline(v));
 }
 
 void LLSD::Impl::assign(Impl*& var, LLSD::Integer v)
@@ -690,7 +901,10 @@ void LLSD::assign(const LLSD& other)	{ Impl::assign(impl, other.impl); }
 
 void LLSD::clear()						{ Impl::assignUndefined(impl); }
 
-LLSD::Type LLSD::type() const			{ return safe(impl).type(); }
+LLSD::Type LLSD::type() const
+{
+	return isInline(impl) ? TypeBoolean : safe(impl).type();
+}
 
 // Scaler Constructors
 LLSD::LLSD(Boolean v)					: impl(0) { assign(v); }
@@ -706,7 +920,7 @@ LLSD::LLSD(const Binary& v)				: impl(0) { assign(v); }
 LLSD::LLSD(F32 v)						: impl(0) { assign((Real)v); }
 
 // Scalar Assignment
-void LLSD::assign(Boolean v)			{ safe(impl).assign(impl, v); }
+void LLSD::assign(Boolean v)			{ Impl::reset(impl, makeInline(v)); }
 void LLSD::assign(Integer v)			{ safe(impl).assign(impl, v); }
 void LLSD::assign(Real v)				{ safe(impl).assign(impl, v); }
 void LLSD::assign(const String& v)		{ safe(impl).assign(impl, v); }
@@ -716,10 +930,35 @@ void LLSD::assign(const URI& v)			{ safe(impl).assign(impl, v); }
 void LLSD::assign(const Binary& v)		{ safe(impl).assign(impl, v); }
 
 // Scalar Accessors
-LLSD::Boolean	LLSD::asBoolean() const	{ return safe(impl).asBoolean(); }
-LLSD::Integer	LLSD::asInteger() const	{ return safe(impl).asInteger(); }
-LLSD::Real		LLSD::asReal() const	{ return safe(impl).asReal(); }
-LLSD::String	LLSD::asString() const	{ return safe(impl).asString(); }
+LLSD::Boolean LLSD::asBoolean() const
+{
+	return isInline(impl) ? inlineBoolean(impl) : safe(impl).asBoolean();
+}
+
+LLSD::Integer LLSD::asInteger() const
+{
+	return isInline(impl) ? (Integer)inlineBoolean(impl) : safe(impl).asInteger();
+}
+
+LLSD::Real LLSD::asReal() const
+{
+	return isInline(impl) ? (inlineBoolean(impl) ? 1.0 : 0.0) : safe(impl).asReal();
+}
+
+LLSD::String LLSD::asString() const
+{
+	if (isInline(impl))
+	{
+		// *NOTE: The reason that false is not converted to "false" is
+		// because that would break roundtripping,
+		// e.g. LLSD(false).asString().asBoolean().  There are many
+		// reasons for wanting LLSD("false").asBoolean() == true, such
+		// as "everything else seems to work that way".
+		return inlineBoolean(impl) ? "true" : "";
+	}
+	return safe(impl).asString();
+}
+
 LLSD::UUID		LLSD::asUUID() const	{ return safe(impl).asUUID(); }
 LLSD::Date		LLSD::asDate() const	{ return safe(impl).asDate(); }
 LLSD::URI		LLSD::asURI() const		{ return safe(impl).asURI(); }
@@ -27,6 +27,8 @@
 #ifndef LL_LLSD_NEW_H
 #define LL_LLSD_NEW_H
 
+#include <cstddef>
+#include <iterator>
 #include <map>
 #include <string>
 #include <vector>
@@ -246,8 +248,66 @@ public:
 	//@{
 		int size() const;
 
-		typedef std::map<String, LLSD>::iterator		map_iterator;
-		typedef std::map<String, LLSD>::const_iterator	map_const_iterator;
+		typedef std::pair<const String, LLSD>	map_value_type;
+
+		/// Map entries are linked in key order, the map owns the links.
+		struct MapLink
+		{
+			MapLink* mNext;
+			MapLink* mPrev;
+		};
+		struct MapNode;
+
+		/**
+			Map iterators visit the entries in key order and keep the
+			guarantees of std::map<String, LLSD> iterators: adding or erasing
+			other keys leaves them, and references to values, valid.  Only
+			iterators to an erased key are invalidated.
+		*/
+		class map_const_iterator
+		{
+		public:
+			typedef std::bidirectional_iterator_tag	iterator_category;
+			typedef map_value_type					value_type;
+			typedef std::ptrdiff_t					difference_type;
+			typedef const map_value_type*			pointer;
+			typedef const map_value_type&			reference;
+
+			map_const_iterator() : mLink(NULL) { }
+			explicit map_const_iterator(MapLink* link) : mLink(link) { }
+
+			const map_value_type& operator*() const;
+			const map_value_type* operator->() const	{ return &**this; }
+
+			map_const_iterator& operator++()	{ mLink = mLink->mNext; return *this; }
+			map_const_iterator& operator--()	{ mLink = mLink->mPrev; return *this; }
+			map_const_iterator operator++(int)	{ map_const_iterator i(*this); mLink = mLink->mNext; return i; }
+			map_const_iterator operator--(int)	{ map_const_iterator i(*this); mLink = mLink->mPrev; return i; }
+
+			bool operator==(const map_const_iterator& other) const	{ return mLink == other.mLink; }
+			bool operator!=(const map_const_iterator& other) const	{ return mLink != other.mLink; }
+
+		protected:
+			MapLink* mLink;
+		};
+
+		class map_iterator : public map_const_iterator
+		{
+		public:
+			typedef map_value_type*			pointer;
+			typedef map_value_type&			reference;
+
+			map_iterator() { }
+			explicit map_iterator(MapLink* link) : map_const_iterator(link) { }
+
+			map_value_type& operator*() const;
+			map_value_type* operator->() const	{ return &**this; }
+
+			map_iterator& operator++()		{ mLink = mLink->mNext; return *this; }
+			map_iterator& operator--()		{ mLink = mLink->mPrev; return *this; }
+			map_iterator operator++(int)	{ map_iterator i(*this); mLink = mLink->mNext; return i; }
+			map_iterator operator--(int)	{ map_iterator i(*this); mLink = mLink->mPrev; return i; }
+		};
 		
 		map_iterator		beginMap();
 		map_iterator		endMap();
@@ -319,7 +379,7 @@ public:
 public:
 		class Impl;
 private:
-		Impl* impl;
+		Impl* impl;		///< NULL when Undefined, booleans are tagged in place
 	//@}
 	
 	/** @name Unit Testing Interface */
@@ -340,6 +400,23 @@ private:
 	//@}
 };
 
+/// A map entry, kept in place from insert to erase
+struct LLSD::MapNode : public LLSD::MapLink
+{
+	MapNode(const String& k, const LLSD& v) : mValue(k, v) { }
+	map_value_type mValue;
+};
+
+inline const LLSD::map_value_type& LLSD::map_const_iterator::operator*() const
+{
+	return static_cast<MapNode*>(mLink)->mValue;
+}
+
+inline LLSD::map_value_type& LLSD::map_iterator::operator*() const
+{
+	return static_cast<MapNode*>(mLink)->mValue;
+}
+
 struct llsd_select_bool : public std::unary_function<LLSD, LLSD::Boolean>
 {
 	LLSD::Boolean operator()(const LLSD& sd) const
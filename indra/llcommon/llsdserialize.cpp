@@ -32,6 +32,7 @@
 #include "llstreamtools.h" // for fullread
 
 #include <iostream>
+#include <sstream>
 #include "apr_base64.h"
 
 #if !LL_WINDOWS
@@ -39,6 +40,7 @@
 #endif
 
 #include "lldate.h"
+#include "llmemtype.h"
 #include "llsd.h"
 #include "llstring.h"
 #include "lluri.h"
@@ -309,6 +311,7 @@ LLSDParser::~LLSDParser()
 
 S32 LLSDParser::parse(std::istream& istr, LLSD& data, S32 max_bytes)
 {
+	LLMemType mt_llsd(LLMemType::MTYPE_LLSD);
 	mCheckLimits = (LLSDSerialize::SIZE_UNLIMITED == max_bytes) ? false : true;
 	mMaxBytesLeft = max_bytes;
 	return doParse(istr, data);
@@ -318,6 +321,7 @@ S32 LLSDParser::parse(std::istream& istr, LLSD& data, S32 max_bytes)
 // Parse using routine to get() lines, faster than parse()
 S32 LLSDParser::parseLines(std::istream& istr, LLSD& data)
 {
+	LLMemType mt_llsd(LLMemType::MTYPE_LLSD);
 	mCheckLimits = false;
 	mParseLines = true;
 	return doParse(istr, data);
@@ -1185,17 +1189,15 @@ bool LLSDBinaryParser::parseString(
 	std::istream& istr,
 	std::string& value) const
 {
-	// *FIX: This is memory inefficient.
 	U32 value_nbo = 0;
 	read(istr, (char*)&value_nbo, sizeof(U32));		 /*Flawfinder: ignore*/
 	S32 size = (S32)ntohl(value_nbo);
 	if(mCheckLimits && (size > mMaxBytesLeft)) return false;
-	std::vector<char> buf;
 	if(size)
 	{
-		buf.resize(size);
-		account(fullread(istr, &buf[0], size));
-		value.assign(buf.begin(), buf.end());
+		// Read straight into the string
+		value.resize(size);
+		account(fullread(istr, &value[0], size));
 	}
 	return true;
 }
@@ -1491,6 +1493,768 @@ void LLSDBinaryFormatter::formatString(
 	ostr.write(string.c_str(), string.size());
 }
 
+/**
+ * Binary in memory
+ */
+
+// Deeper than this is taken to be malformed, or malicious
+static const S32 BINARY_MAX_DEPTH = 256;
+
+// Parses binary LLSD out of a buffer, with the stream parser's results
+class LLSDBinaryBufferParser
+{
+public:
+	LLSDBinaryBufferParser(const U8* buf, S32 len) : mPos(buf), mEnd(buf + len) {}
+
+	S32 parse(LLSD& data, S32 depth = 0);
+
+private:
+	S32 parseMap(LLSD& map, S32 depth);
+	S32 parseArray(LLSD& array, S32 depth);
+
+	bool readU32(U32& value)
+	{
+		if (mEnd - mPos < (S32)sizeof(U32))
+		{
+			return false;
+		}
+		U32 value_nbo;
+		memcpy(&value_nbo, mPos, sizeof(U32));	/* Flawfinder: ignore */
+		mPos += sizeof(U32);
+		value = ntohl(value_nbo);
+		return true;
+	}
+
+	bool readBytes(void* dest, S32 len)
+	{
+		if (mEnd - mPos < len)
+		{
+			return false;
+		}
+		memcpy(dest, mPos, len);	/* Flawfinder: ignore */
+		mPos += len;
+		return true;
+	}
+
+	// A count or length, which can't be more than the bytes left
+	bool readSize(S32& size)
+	{
+		U32 value;
+		if (!readU32(value) || value > (U32)(mEnd - mPos))
+		{
+			return false;
+		}
+		size = (S32)value;
+		return true;
+	}
+
+	bool readString(std::string& value)
+	{
+		S32 size;
+		if (!readSize(size))
+		{
+			return false;
+		}
+		value.assign((const char*)mPos, size);
+		mPos += size;
+		return true;
+	}
+
+	bool readDelimitedString(char delim, std::string& value);
+
+	const U8* mPos;
+	const U8* mEnd;
+};
+
+// One past the closing delimiter of a notation style string starting
+// after its opening one, NULL if it isn't closed
+static const U8* find_string_delim(const U8* pos, const U8* end, char delim)
+{
+	for (; pos < end; ++pos)
+	{
+		if (*pos == '\\')
+		{
+			++pos;
+		}
+		else if (*pos == delim)
+		{
+			return pos + 1;
+		}
+	}
+	return NULL;
+}
+
+bool LLSDBinaryBufferParser::readDelimitedString(char delim, std::string& value)
+{
+	// Rare enough that the stream unescaper can do the work
+	const U8* close = find_string_delim(mPos, mEnd, delim);
+	if (!close)
+	{
+		return false;
+	}
+	std::istringstream istr(std::string((const char*)mPos, close - mPos));
+	if (LLSDParser::PARSE_FAILURE == deserialize_string_delim(istr, value, delim))
+	{
+		return false;
+	}
+	mPos = close;
+	return true;
+}
+
+S32 LLSDBinaryBufferParser::parse(LLSD& data, S32 depth)
+{
+	if (mPos >= mEnd)
+	{
+		return 0;
+	}
+	char c = (char)*mPos++;
+	S32 parse_count = 1;
+	bool ok = true;
+	switch(c)
+	{
+	case '{':
+	{
+		S32 child_count = depth < BINARY_MAX_DEPTH ? parseMap(data, depth + 1) : LLSDParser::PARSE_FAILURE;
+		ok = (child_count != LLSDParser::PARSE_FAILURE);
+		parse_count += child_count;
+		break;
+	}
+
+	case '[':
+	{
+		S32 child_count = depth < BINARY_MAX_DEPTH ? parseArray(data, depth + 1) : LLSDParser::PARSE_FAILURE;
+		ok = (child_count != LLSDParser::PARSE_FAILURE);
+		parse_count += child_count;
+		break;
+	}
+
+	case '!':
+		data.clear();
+		break;
+
+	case '0':
+		data = false;
+		break;
+
+	case '1':
+		data = true;
+		break;
+
+	case 'i':
+	{
+		U32 value = 0;
+		ok = readU32(value);
+		data = (S32)value;
+		break;
+	}
+
+	case 'r':
+	{
+		F64 real_nbo = 0.0;
+		ok = readBytes(&real_nbo, sizeof(F64));
+		data = ll_ntohd(real_nbo);
+		break;
+	}
+
+	case 'u':
+	{
+		LLUUID id;
+		ok = readBytes(id.mData, UUID_BYTES);
+		data = id;
+		break;
+	}
+
+	case '\'':
+	case '"':
+	{
+		std::string value;
+		ok = readDelimitedString(c, value);
+		data = value;
+		break;
+	}
+
+	case 's':
+	{
+		std::string value;
+		ok = readString(value);
+		data = value;
+		break;
+	}
+
+	case 'l':
+	{
+		std::string value;
+		ok = readString(value);
+		data = LLURI(value);
+		break;
+	}
+
+	case 'd':
+	{
+		// Dates go out in host order, see LLSDBinaryFormatter::format()
+		F64 real = 0.0;
+		ok = readBytes(&real, sizeof(F64));
+		data = LLDate(real);
+		break;
+	}
+
+	case 'b':
+	{
+		S32 size;
+		ok = readSize(size);
+		if (ok)
+		{
+			// LLSD only takes a Binary by const reference, so the bytes
+			// are copied into the temporary and again into the value.
+			data = LLSD::Binary(mPos, mPos + size);
+			mPos += size;
+		}
+		break;
+	}
+
+	default:
+		ok = false;
+		llinfos << "Unrecognized character while parsing: int(" << (int)c
+			<< ")" << llendl;
+		break;
+	}
+	if (!ok)
+	{
+		parse_count = LLSDParser::PARSE_FAILURE;
+		data.clear();
+	}
+	return parse_count;
+}
+
+S32 LLSDBinaryBufferParser::parseMap(LLSD& map, S32 depth)
+{
+	map = LLSD::emptyMap();
+	S32 size;
+	if (!readSize(size))
+	{
+		return LLSDParser::PARSE_FAILURE;
+	}
+	S32 parse_count = 0;
+	std::string name;
+	for (S32 count = 0; count < size; ++count)
+	{
+		if (mPos >= mEnd)
+		{
+			return LLSDParser::PARSE_FAILURE;
+		}
+		char c = (char)*mPos++;
+		bool ok = false;
+		switch(c)
+		{
+		case 'k':
+			ok = readString(name);
+			break;
+		case '\'':
+		case '"':
+			ok = readDelimitedString(c, name);
+			break;
+		}
+		if (!ok)
+		{
+			return LLSDParser::PARSE_FAILURE;
+		}
+
+		// Parse straight into the map. A repeated key keeps its first
+		// value, as LLSD::insert() would.
+		LLSD repeat;
+		S32 child_count = parse(map.has(name) ? repeat : map[name], depth);
+		if (child_count <= 0)
+		{
+			// There must be a value for every key
+			return LLSDParser::PARSE_FAILURE;
+		}
+		parse_count += child_count;
+	}
+	if (mPos >= mEnd || *mPos++ != '}')
+	{
+		return LLSDParser::PARSE_FAILURE;
+	}
+	return parse_count;
+}
+
+S32 LLSDBinaryBufferParser::parseArray(LLSD& array, S32 depth)
+{
+	array = LLSD::emptyArray();
+	S32 size;
+	if (!readSize(size))
+	{
+		return LLSDParser::PARSE_FAILURE;
+	}
+	S32 parse_count = 0;
+	for (S32 count = 0; count < size; ++count)
+	{
+		if (mPos < mEnd && *mPos == ']')
+		{
+			// Fewer than were said to be there
+			return LLSDParser::PARSE_FAILURE;
+		}
+		array.append(LLSD());
+		S32 child_count = parse(array[count], depth);
+		if (child_count <= 0)
+		{
+			return LLSDParser::PARSE_FAILURE;
+		}
+		parse_count += child_count;
+	}
+	if (mPos >= mEnd || *mPos++ != ']')
+	{
+		return LLSDParser::PARSE_FAILURE;
+	}
+	return parse_count;
+}
+
+static void append_binary_size(std::vector<U8>& buf, U32 size)
+{
+	U32 size_nbo = htonl(size);
+	const U8* bytes = (const U8*)&size_nbo;
+	buf.insert(buf.end(), bytes, bytes + sizeof(U32));
+}
+
+static void append_binary_string(std::vector<U8>& buf, char type, const std::string& value)
+{
+	buf.push_back(type);
+	append_binary_size(buf, value.size());
+	buf.insert(buf.end(), value.begin(), value.end());
+}
+
+static S32 format_binary_buffer(const LLSD& data, std::vector<U8>& buf)
+{
+	S32 format_count = 1;
+	switch(data.type())
+	{
+	case LLSD::TypeMap:
+	{
+		buf.push_back('{');
+		append_binary_size(buf, data.size());
+		LLSD::map_const_iterator iter = data.beginMap();
+		LLSD::map_const_iterator end = data.endMap();
+		for(; iter != end; ++iter)
+		{
+			append_binary_string(buf, 'k', (*iter).first);
+			format_count += format_binary_buffer((*iter).second, buf);
+		}
+		buf.push_back('}');
+		break;
+	}
+
+	case LLSD::TypeArray:
+	{
+		buf.push_back('[');
+		append_binary_size(buf, data.size());
+		LLSD::array_const_iterator iter = data.beginArray();
+		LLSD::array_const_iterator end = data.endArray();
+		for(; iter != end; ++iter)
+		{
+			format_count += format_binary_buffer(*iter, buf);
+		}
+		buf.push_back(']');
+		break;
+	}
+
+	case LLSD::TypeBoolean:
+		buf.push_back(data.asBoolean() ? BINARY_TRUE_SERIAL : BINARY_FALSE_SERIAL);
+		break;
+
+	case LLSD::TypeInteger:
+		buf.push_back('i');
+		append_binary_size(buf, (U32)data.asInteger());
+		break;
+
+	case LLSD::TypeReal:
+	{
+		buf.push_back('r');
+		F64 value_nbo = ll_htond(data.asReal());
+		const U8* bytes = (const U8*)&value_nbo;
+		buf.insert(buf.end(), bytes, bytes + sizeof(F64));
+		break;
+	}
+
+	case LLSD::TypeUUID:
+	{
+		buf.push_back('u');
+		LLUUID id = data.asUUID();
+		buf.insert(buf.end(), id.mData, id.mData + UUID_BYTES);
+		break;
+	}
+
+	case LLSD::TypeString:
+		append_binary_string(buf, 's', data.asString());
+		break;
+
+	case LLSD::TypeDate:
+	{
+		buf.push_back('d');
+		F64 value = data.asReal();
+		const U8* bytes = (const U8*)&value;
+		buf.insert(buf.end(), bytes, bytes + sizeof(F64));
+		break;
+	}
+
+	case LLSD::TypeURI:
+		append_binary_string(buf, 'l', data.asString());
+		break;
+
+	case LLSD::TypeBinary:
+	{
+		buf.push_back('b');
+		LLSD::Binary value = data.asBinary();
+		append_binary_size(buf, value.size());
+		buf.insert(buf.end(), value.begin(), value.end());
+		break;
+	}
+
+	case LLSD::TypeUndefined:
+	default:
+		buf.push_back('!');
+		break;
+	}
+	return format_count;
+}
+
+// static
+S32 LLSDSerialize::toBinary(const LLSD& sd, std::vector<U8>& buf)
+{
+	return format_binary_buffer(sd, buf);
+}
+
+// static
+S32 LLSDSerialize::fromBinary(LLSD& sd, const U8* buf, S32 len)
+{
+	LLMemType mt_llsd(LLMemType::MTYPE_LLSD);
+	LLSDBinaryBufferParser parser(buf, len);
+	return parser.parse(sd);
+}
+
+/**
+ * LLSDBinaryView
+ */
+LLSDBinaryView::LLSDBinaryView()
+:	mValue(NULL),
+	mEnd(NULL)
+{
+}
+
+LLSDBinaryView::LLSDBinaryView(const U8* buf, S32 len)
+:	mValue(len > 0 ? buf : NULL),
+	mEnd(buf + len)
+{
+}
+
+LLSD::Type LLSDBinaryView::type() const
+{
+	if (!mValue)
+	{
+		return LLSD::TypeUndefined;
+	}
+	switch(*mValue)
+	{
+	case '{':	return LLSD::TypeMap;
+	case '[':	return LLSD::TypeArray;
+	case '0':
+	case '1':	return LLSD::TypeBoolean;
+	case 'i':	return LLSD::TypeInteger;
+	case 'r':	return LLSD::TypeReal;
+	case 'u':	return LLSD::TypeUUID;
+	case 's':
+	case 'k':
+	case '\'':
+	case '"':	return LLSD::TypeString;
+	case 'd':	return LLSD::TypeDate;
+	case 'l':	return LLSD::TypeURI;
+	case 'b':	return LLSD::TypeBinary;
+	default:	return LLSD::TypeUndefined;
+	}
+}
+
+bool LLSDBinaryView::readSize(const U8* p, S32& size) const
+{
+	if (mEnd - p < (S32)sizeof(U32))
+	{
+		return false;
+	}
+	U32 value_nbo;
+	memcpy(&value_nbo, p, sizeof(U32));	/* Flawfinder: ignore */
+	U32 value = ntohl(value_nbo);
+	if (value > (U32)(mEnd - p - sizeof(U32)))
+	{
+		return false;
+	}
+	size = (S32)value;
+	return true;
+}
+
+const U8* LLSDBinaryView::skip(const U8* p, S32 depth) const
+{
+	if (!p || p >= mEnd || depth > BINARY_MAX_DEPTH)
+	{
+		return NULL;
+	}
+	S32 size;
+	switch(*p)
+	{
+	case '!':
+	case '0':
+	case '1':
+		return p + 1;
+
+	case 'i':
+		p += 1 + sizeof(U32);
+		break;
+
+	case 'r':
+	case 'd':
+		p += 1 + sizeof(F64);
+		break;
+
+	case 'u':
+		p += 1 + UUID_BYTES;
+		break;
+
+	case 's':
+	case 'k':
+	case 'l':
+	case 'b':
+		if (!readSize(p + 1, size))
+		{
+			return NULL;
+		}
+		return p + 1 + sizeof(U32) + size;
+
+	case '\'':
+	case '"':
+		return find_string_delim(p + 1, mEnd, *p);
+
+	case '{':
+	case '[':
+	{
+		bool is_map = (*p == '{');
+		if (!readSize(p + 1, size))
+		{
+			return NULL;
+		}
+		p += 1 + sizeof(U32);
+		for (S32 i = 0; p && i < size; ++i)
+		{
+			if (is_map)
+			{
+				p = skip(p, depth + 1);
+			}
+			p = skip(p, depth + 1);
+		}
+		if (!p || p >= mEnd || *p != (is_map ? '}' : ']'))
+		{
+			return NULL;
+		}
+		return p + 1;
+	}
+
+	default:
+		return NULL;
+	}
+	return p <= mEnd ? p : NULL;
+}
+
+S32 LLSDBinaryView::size() const
+{
+	S32 size = 0;
+	if ((isMap() || isArray()) && readSize(mValue + 1, size))
+	{
+		return size;
+	}
+	return 0;
+}
+
+LLSD::Boolean LLSDBinaryView::asBoolean() const
+{
+	return mValue && *mValue == BINARY_TRUE_SERIAL;
+}
+
+LLSD::Integer LLSDBinaryView::asInteger() const
+{
+	U32 value_nbo = 0;
+	if (type() == LLSD::TypeInteger && mEnd - mValue >= 1 + (S32)sizeof(U32))
+	{
+		memcpy(&value_nbo, mValue + 1, sizeof(U32));	/* Flawfinder: ignore */
+	}
+	return (S32)ntohl(value_nbo);
+}
+
+LLSD::Real LLSDBinaryView::asReal() const
+{
+	F64 value = 0.0;
+	LLSD::Type value_type = type();
+	if ((value_type == LLSD::TypeReal || value_type == LLSD::TypeDate)
+		&& mEnd - mValue >= 1 + (S32)sizeof(F64))
+	{
+		memcpy(&value, mValue + 1, sizeof(F64));	/* Flawfinder: ignore */
+		if (value_type == LLSD::TypeReal)
+		{
+			value = ll_ntohd(value);
+		}
+	}
+	return value;
+}
+
+LLUUID LLSDBinaryView::asUUID() const
+{
+	LLUUID id;
+	if (type() == LLSD::TypeUUID && mEnd - mValue >= 1 + UUID_BYTES)
+	{
+		memcpy(id.mData, mValue + 1, UUID_BYTES);	/* Flawfinder: ignore */
+	}
+	return id;
+}
+
+LLDate LLSDBinaryView::asDate() const
+{
+	return type() == LLSD::TypeDate ? LLDate(asReal()) : LLDate();
+}
+
+const char* LLSDBinaryView::data() const
+{
+	S32 size;
+	if (mValue && (*mValue == 's' || *mValue == 'k' || *mValue == 'l' || *mValue == 'b')
+		&& readSize(mValue + 1, size))
+	{
+		return (const char*)mValue + 1 + sizeof(U32);
+	}
+	// Notation style strings have escapes, they aren't there as is
+	return NULL;
+}
+
+S32 LLSDBinaryView::dataSize() const
+{
+	S32 size;
+	if (data() && readSize(mValue + 1, size))
+	{
+		return size;
+	}
+	return 0;
+}
+
+LLSD::String LLSDBinaryView::asString() const
+{
+	const char* bytes = data();
+	if (bytes && *mValue != 'b')
+	{
+		return LLSD::String(bytes, dataSize());
+	}
+	if (type() == LLSD::TypeString)
+	{
+		// Notation style
+		return asLLSD().asString();
+	}
+	return LLSD::String();
+}
+
+LLSD::Binary LLSDBinaryView::asBinary() const
+{
+	const U8* bytes = (const U8*)data();
+	if (bytes && *mValue == 'b')
+	{
+		return LLSD::Binary(bytes, bytes + dataSize());
+	}
+	return LLSD::Binary();
+}
+
+LLSDBinaryView LLSDBinaryView::get(const std::string& key) const
+{
+	S32 count = 0;
+	if (!isMap() || !readSize(mValue + 1, count))
+	{
+		return LLSDBinaryView();
+	}
+	const U8* p = mValue + 1 + sizeof(U32);
+	for (S32 i = 0; p && i < count; ++i)
+	{
+		LLSDBinaryView key_view(p, mEnd - p);
+		const U8* value = skip(p, 1);
+		if (!value)
+		{
+			break;
+		}
+		const char* key_bytes = key_view.data();
+		if (key_bytes
+			? (key_view.dataSize() == (S32)key.size() && !memcmp(key_bytes, key.data(), key.size()))
+			: key_view.asString() == key)
+		{
+			return LLSDBinaryView(value, mEnd - value);
+		}
+		p = skip(value, 1);
+	}
+	return LLSDBinaryView();
+}
+
+LLSDBinaryView LLSDBinaryView::get(S32 index) const
+{
+	S32 count = 0;
+	if (!isArray() || !readSize(mValue + 1, count) || index < 0 || index >= count)
+	{
+		return LLSDBinaryView();
+	}
+	const U8* p = mValue + 1 + sizeof(U32);
+	for (S32 i = 0; p && i < index; ++i)
+	{
+		p = skip(p, 1);
+	}
+	if (!p || p >= mEnd)
+	{
+		return LLSDBinaryView();
+	}
+	return LLSDBinaryView(p, mEnd - p);
+}
+
+bool LLSDBinaryView::getChildren(std::vector<LLSDBinaryView>& values, std::vector<LLSDBinaryView>* keys) const
+{
+	S32 count = 0;
+	bool is_map = isMap();
+	if (!(is_map || isArray()) || !readSize(mValue + 1, count))
+	{
+		return false;
+	}
+	const U8* p = mValue + 1 + sizeof(U32);
+	for (S32 i = 0; i < count; ++i)
+	{
+		if (is_map)
+		{
+			const U8* key = p;
+			p = skip(p, 1);
+			if (!p)
+			{
+				return false;
+			}
+			if (keys)
+			{
+				keys->push_back(LLSDBinaryView(key, mEnd - key));
+			}
+		}
+		const U8* value = p;
+		p = skip(p, 1);
+		if (!p)
+		{
+			return false;
+		}
+		values.push_back(LLSDBinaryView(value, mEnd - value));
+	}
+	return true;
+}
+
+LLSD LLSDBinaryView::asLLSD() const
+{
+	LLSD sd;
+	if (mValue)
+	{
+		LLSDBinaryBufferParser parser(mValue, mEnd - mValue);
+		parser.parse(sd);
+	}
+	return sd;
+}
+
 /**
  * local functions
  */
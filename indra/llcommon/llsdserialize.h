@@ -618,6 +618,101 @@ protected:
 };
 
 
+/** 
+ * @class LLSDBinaryView
+ * @brief Read only view of a value in binary formatted LLSD.
+ *
+ * The view walks the binary format where it lies in memory, so pulling
+ * a few fields out of a large payload builds no LLSD tree and copies
+ * nothing. Strings, uris, binary and map keys are handed back as
+ * pointers into the buffer, valid as long as the buffer is. Looking up
+ * a key or index that is not there, or running into malformed data,
+ * gives an undefined view.
+ */
+class LL_COMMON_API LLSDBinaryView
+{
+public:
+	/** 
+	 * @brief Constructor for an undefined view
+	 */
+	LLSDBinaryView();
+
+	/** 
+	 * @brief Constructor for the value at the start of buf.
+	 *
+	 * @param buf The binary formatted data, without the LLSD/Binary
+	 * header.
+	 * @param len The number of bytes in buf.
+	 */
+	LLSDBinaryView(const U8* buf, S32 len);
+
+	LLSD::Type type() const;
+	bool isUndefined() const		{ return type() == LLSD::TypeUndefined; }
+	bool isMap() const				{ return type() == LLSD::TypeMap; }
+	bool isArray() const			{ return type() == LLSD::TypeArray; }
+
+	/** 
+	 * @brief Number of children of a map or array, 0 for anything else.
+	 */
+	S32 size() const;
+
+	LLSD::Boolean asBoolean() const;
+	LLSD::Integer asInteger() const;
+	LLSD::Real asReal() const;
+	LLUUID asUUID() const;
+	LLDate asDate() const;
+
+	/** 
+	 * @brief The bytes of a string, uri, binary or map key in place.
+	 *
+	 * @return Returns NULL, with size 0, for other types.
+	 */
+	const char* data() const;
+	S32 dataSize() const;
+
+	/** 
+	 * @brief Copies of a string or uri, or of binary data.
+	 */
+	LLSD::String asString() const;
+	LLSD::Binary asBinary() const;
+
+	/** 
+	 * @brief Looks up a key in a map, or an index in an array.
+	 *
+	 * Both walk the container from the front, use getChildren() to
+	 * visit all of one.
+	 */
+	LLSDBinaryView get(const std::string& key) const;
+	LLSDBinaryView get(S32 index) const;
+	LLSDBinaryView operator[](const std::string& key) const	{ return get(key); }
+	LLSDBinaryView operator[](const char* key) const		{ return get(std::string(key)); }
+	LLSDBinaryView operator[](S32 index) const				{ return get(index); }
+
+	/** 
+	 * @brief Appends views of every child of a map or array, in order.
+	 *
+	 * @param values[out] The children.
+	 * @param keys[out] The map keys, viewable with data() and
+	 * asString(). May be NULL.
+	 * @return Returns false if the container is malformed.
+	 */
+	bool getChildren(std::vector<LLSDBinaryView>& values, std::vector<LLSDBinaryView>* keys = NULL) const;
+
+	/** 
+	 * @brief Builds the LLSD for this value.
+	 */
+	LLSD asLLSD() const;
+
+private:
+	// One past the end of the value at p, NULL if it is malformed
+	const U8* skip(const U8* p, S32 depth) const;
+	bool readSize(const U8* p, S32& size) const;
+
+	const U8* mValue;	// NULL for an undefined view
+	const U8* mEnd;		// end of the buffer
+};
+
+
 /** 
  * @class LLSDNotationStreamFormatter
  * @brief Formatter which is specialized for use on streams which
@@ -788,6 +883,14 @@ public:
 		(void)p->parse(str, sd, max_bytes);
 		return sd;
 	}
+
+	/*
+	 * Binary in memory. These read and write whole buffers at once
+	 * rather than going through a stream a character at a time, for
+	 * large payloads. Same format as the stream methods.
+	 */
+	static S32 toBinary(const LLSD& sd, std::vector<U8>& buf);
+	static S32 fromBinary(LLSD& sd, const U8* buf, S32 len);
 };
 
 #endif // LL_LLSDSERIALIZE_H
@@ -46,6 +46,7 @@
 #	include <sys/sysctl.h>
 #	include <sys/utsname.h>
 #	include <stdint.h>
+#	include <unistd.h>
 #elif LL_LINUX
 #	include <errno.h>
 #	include <sys/utsname.h>
@@ -548,6 +549,20 @@ std::string LLCPUInfo::getCPUString() const
 	return mCPUString;
 }
 
+// static
+U32 LLCPUInfo::getCoreCount()
+{
+	S32 count = 0;
+#if LL_WINDOWS
+	SYSTEM_INFO sys_info;
+	GetSystemInfo(&sys_info);
+	count = (S32)sys_info.dwNumberOfProcessors;
+#else
+	count = (S32)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (count > 0) ? (U32)count : 1;
+}
+
 void LLCPUInfo::stream(std::ostream& s) const
 {
 	// gather machine information.
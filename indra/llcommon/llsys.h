@@ -77,6 +77,9 @@ public:
 	bool hasSSE2() const;
 	F64 getMHz() const;
 
+	// Number of logical processors currently online, at least 1.
+	static U32 getCoreCount();
+
 	// Family is "AMD Duron" or "Intel Pentium Pro"
 	const std::string& getFamily() const { return mFamily; }
 
@@ -374,6 +374,11 @@ void LLCondition::wait()
 	apr_thread_cond_wait(mAPRCondp, mAPRMutexp);
 }
 
+void LLCondition::waitFor(U32 ms)
+{
+	apr_thread_cond_timedwait(mAPRCondp, mAPRMutexp, (apr_interval_time_t)ms * 1000);
+}
+
 void LLCondition::signal()
 {
 	apr_thread_cond_signal(mAPRCondp);
@@ -152,6 +152,7 @@ public:
 	~LLCondition();
 	
 	void wait();		// blocks
+	void waitFor(U32 ms);	// blocks for at most ms
 	void signal();
 	void broadcast();
 	
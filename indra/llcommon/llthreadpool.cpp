@@ -0,0 +1,380 @@
+/**
+ * @file llthreadpool.cpp
+ * @brief Shared pool of worker threads servicing LLQueuedThread request queues.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+#include "llthreadpool.h"
+
+#include "llqueuedthread.h"
+#include "llstl.h"
+#include "llsys.h"
+#include "lltimer.h"
+
+// Keep at least two workers so one long request can't stall every queue
+const U32 MIN_POOL_WORKERS = 2;
+const U32 MAX_POOL_WORKERS = 16;
+
+//============================================================================
+
+// MAIN THREAD
+LLThreadPool::LLThreadPool(const std::string& name, U32 num_workers) :
+	mName(name),
+	mScheduledCount(0),
+	mNextDue(0),
+	mNextWorker(0),
+	mQuitting(false)
+{
+	if (num_workers == 0)
+	{
+		num_workers = getDefaultWorkerCount();
+	}
+	num_workers = llclamp(num_workers, MIN_POOL_WORKERS, MAX_POOL_WORKERS);
+
+	mIdleCondition = new LLCondition(NULL);
+	mDrainCondition = new LLCondition(NULL);
+
+	// Create every worker before starting any, workers steal from each other
+	for (U32 i = 0; i < num_workers; ++i)
+	{
+		mWorkers.push_back(new Worker(llformat("%s%d", name.c_str(), i), this, i));
+	}
+	for (worker_list_t::iterator iter = mWorkers.begin();
+		 iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->start();
+	}
+	llinfos << "LLThreadPool " << mName << " started with " << num_workers << " workers" << llendl;
+}
+
+// MAIN THREAD
+LLThreadPool::~LLThreadPool()
+{
+	shutdown();
+	delete mIdleCondition;
+	mIdleCondition = NULL;
+	delete mDrainCondition;
+	mDrainCondition = NULL;
+}
+
+// MAIN THREAD
+void LLThreadPool::shutdown()
+{
+	if (mWorkers.empty())
+	{
+		return;
+	}
+
+	mIdleCondition->lock();
+	mQuitting = true;
+	mIdleCondition->broadcast();
+	mIdleCondition->unlock();
+
+	for (worker_list_t::iterator iter = mWorkers.begin();
+		 iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->shutdown();
+	}
+	std::for_each(mWorkers.begin(), mWorkers.end(), DeletePointer());
+	mWorkers.clear();
+	mDeferred.clear();
+	mNextDue = 0;
+}
+
+// static
+U32 LLThreadPool::getDefaultWorkerCount()
+{
+	U32 cores = LLCPUInfo::getCoreCount();
+	return llclamp(cores > 1 ? cores - 1 : 1, MIN_POOL_WORKERS, MAX_POOL_WORKERS);
+}
+
+// static
+LLThreadPool::lane_t LLThreadPool::laneForPriority(U32 priority)
+{
+	if (priority >= LLQueuedThread::PRIORITY_HIGH)
+	{
+		return LANE_HIGH;
+	}
+	else if (priority >= LLQueuedThread::PRIORITY_NORMAL)
+	{
+		return LANE_NORMAL;
+	}
+	return LANE_LOW;
+}
+
+//----------------------------------------------------------------------------
+
+// Any thread
+void LLThreadPool::schedule(LLQueuedThread* queue, lane_t lane)
+{
+	llassert_always(!mWorkers.empty());
+
+	// Work rescheduled by a worker stays on that worker, anything else is
+	// spread around and balanced by stealing.
+	Worker* worker = getCurrentWorker();
+	if (!worker)
+	{
+		worker = mWorkers[mNextWorker++ % mWorkers.size()];
+	}
+
+	mIdleCondition->lock();
+	worker->push(queue, lane);
+	++mScheduledCount;
+	mIdleCondition->signal();
+	mIdleCondition->unlock();
+}
+
+// Any thread
+void LLThreadPool::scheduleDeferred(LLQueuedThread* queue, lane_t lane, U32 delay_ms)
+{
+	llassert_always(!mWorkers.empty());
+
+	Deferred deferred;
+	deferred.mDue = LLTimer::getTotalTime() + (U64)delay_ms * 1000;
+	deferred.mQueue = queue;
+	deferred.mLane = lane;
+
+	mIdleCondition->lock();
+	mDeferred.push_back(deferred);
+	if (!mNextDue || deferred.mDue < mNextDue)
+	{
+		mNextDue = deferred.mDue;
+	}
+	// Someone waiting with no timeout has to pick up the new due time
+	mIdleCondition->signal();
+	mIdleCondition->unlock();
+}
+
+// WORKER THREAD
+U64 LLThreadPool::promoteDeferred(Worker* self)
+{
+	U64 now = LLTimer::getTotalTime();
+	U64 next_due = 0;
+	for (deferred_list_t::iterator iter = mDeferred.begin(); iter != mDeferred.end(); )
+	{
+		if (iter->mDue <= now)
+		{
+			self->push(iter->mQueue, iter->mLane);
+			++mScheduledCount;
+			iter = mDeferred.erase(iter);
+		}
+		else
+		{
+			if (!next_due || iter->mDue < next_due)
+			{
+				next_due = iter->mDue;
+			}
+			++iter;
+		}
+	}
+	mNextDue = next_due;
+	return next_due ? next_due - now : 0;
+}
+
+// WORKER THREAD
+LLQueuedThread* LLThreadPool::getNextQueue(Worker* self)
+{
+	const U32 count = mWorkers.size();
+	while (1)
+	{
+		if (mQuitting)
+		{
+			return NULL;
+		}
+
+		// Checked before the lanes, busy lanes mustn't keep deferred slots
+		// from ever coming due
+		U64 next_due = mNextDue;
+		if (next_due && next_due <= LLTimer::getTotalTime())
+		{
+			mIdleCondition->lock();
+			promoteDeferred(self);
+			mIdleCondition->unlock();
+		}
+
+		// Higher lanes first, anywhere in the pool
+		for (S32 lane = 0; lane < LANE_COUNT; ++lane)
+		{
+			LLQueuedThread* queue = self->pop((lane_t)lane);
+			for (U32 i = 1; !queue && i < count; ++i)
+			{
+				queue = mWorkers[(self->getIndex() + i) % count]->steal((lane_t)lane);
+			}
+			if (queue)
+			{
+				// Can't run ahead of schedule(), which counts the slot
+				// before letting go of the lock
+				mIdleCondition->lock();
+				--mScheduledCount;
+				llassert(mScheduledCount >= 0);
+				mIdleCondition->unlock();
+				return queue;
+			}
+		}
+
+		mIdleCondition->lock();
+		while (mScheduledCount <= 0 && !mQuitting)
+		{
+			U64 wait_us = promoteDeferred(self);
+			if (mScheduledCount > 0)
+			{
+				break;
+			}
+			if (wait_us)
+			{
+				mIdleCondition->waitFor(llmax((U32)(wait_us / 1000), (U32)1));
+			}
+			else
+			{
+				mIdleCondition->wait();
+			}
+		}
+		mIdleCondition->unlock();
+	}
+}
+
+// WORKER THREAD
+void LLThreadPool::setServicing(Worker* self, LLQueuedThread* queue)
+{
+	mDrainCondition->lock();
+	self->mServicing = queue;
+	if (!queue)
+	{
+		mDrainCondition->broadcast();
+	}
+	mDrainCondition->unlock();
+}
+
+// Any thread but a worker
+void LLThreadPool::drain(LLQueuedThread* queue)
+{
+	mDrainCondition->lock();
+	while (1)
+	{
+		bool busy = false;
+		for (worker_list_t::iterator iter = mWorkers.begin();
+			 iter != mWorkers.end(); ++iter)
+		{
+			if ((*iter)->mServicing == queue)
+			{
+				busy = true;
+				break;
+			}
+		}
+		if (!busy)
+		{
+			break;
+		}
+		mDrainCondition->wait();
+	}
+	mDrainCondition->unlock();
+}
+
+// Any thread
+LLThreadPool::Worker* LLThreadPool::getCurrentWorker()
+{
+	U32 id = LLThread::currentID();
+	for (worker_list_t::iterator iter = mWorkers.begin();
+		 iter != mWorkers.end(); ++iter)
+	{
+		if ((*iter)->getThreadID() == id)
+		{
+			return *iter;
+		}
+	}
+	return NULL;
+}
+
+//============================================================================
+
+LLThreadPool::Worker::Worker(const std::string& name, LLThreadPool* pool, U32 index) :
+	LLThread(name),
+	mServicing(NULL),
+	mPool(pool),
+	mIndex(index),
+	mThreadID(0)
+{
+	mLaneMutex = new LLMutex(NULL);
+}
+
+LLThreadPool::Worker::~Worker()
+{
+	delete mLaneMutex;
+	mLaneMutex = NULL;
+}
+
+// Any thread
+void LLThreadPool::Worker::push(LLQueuedThread* queue, lane_t lane)
+{
+	LLMutexLock lock(mLaneMutex);
+	mLanes[lane].push_back(queue);
+}
+
+// WORKER THREAD
+// Owner takes the oldest entry so queues are serviced round robin
+LLQueuedThread* LLThreadPool::Worker::pop(lane_t lane)
+{
+	LLMutexLock lock(mLaneMutex);
+	if (mLanes[lane].empty())
+	{
+		return NULL;
+	}
+	LLQueuedThread* queue = mLanes[lane].front();
+	mLanes[lane].pop_front();
+	return queue;
+}
+
+// Any worker thread
+// Thieves take from the other end to stay out of the owner's way
+LLQueuedThread* LLThreadPool::Worker::steal(lane_t lane)
+{
+	LLMutexLock lock(mLaneMutex);
+	if (mLanes[lane].empty())
+	{
+		return NULL;
+	}
+	LLQueuedThread* queue = mLanes[lane].back();
+	mLanes[lane].pop_back();
+	return queue;
+}
+
+// virtual
+void LLThreadPool::Worker::run()
+{
+	mThreadID = LLThread::currentID();
+	while (1)
+	{
+		LLQueuedThread* queue = mPool->getNextQueue(this);
+		if (!queue)
+		{
+			break;
+		}
+		// Flagged before the slot is given back, so a queue can't stop
+		// without drain() seeing the worker that stopped it
+		mPool->setServicing(this, queue);
+		queue->servicePooled();
+		mPool->setServicing(this, NULL);
+	}
+	llinfos << "LLThreadPool worker " << mName << " EXITING." << llendl;
+}
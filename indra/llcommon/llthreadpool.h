@@ -0,0 +1,159 @@
+/**
+ * @file llthreadpool.h
+ * @brief Shared pool of worker threads servicing LLQueuedThread request queues.
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLTHREADPOOL_H
+#define LL_LLTHREADPOOL_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "llthread.h"
+
+class LLQueuedThread;
+
+//============================================================================
+// LLThreadPool
+//
+// A fixed set of worker threads shared by any number of LLQueuedThreads.
+// A queued thread constructed while a shared pool is set (see
+// LLQueuedThread::setSharedPool()) does not start its own thread; instead it
+// schedules itself here whenever it has pending requests, and a pool worker
+// services it by running its next request.
+//
+// Each worker owns one deque per priority lane. Workers drain their own
+// lanes first (highest lane first), then steal from the other workers, and
+// sleep on a condition when there is nothing to do, so idle workers never spin.
+// Deferred slots wait in a list of their own until they are due, the first
+// worker to look after that moves them into its lanes.
+//
+// A queue is in the pool at most getMaxConcurrency() times, so a queue whose
+// requests are not safe to run concurrently (the default) is only ever
+// serviced by one worker at a time.
+
+class LL_COMMON_API LLThreadPool
+{
+public:
+	enum lane_t {
+		LANE_HIGH = 0,		// top request >= PRIORITY_HIGH
+		LANE_NORMAL = 1,	// top request >= PRIORITY_NORMAL
+		LANE_LOW = 2,		// everything else
+		LANE_COUNT = 3
+	};
+
+	// num_workers == 0 uses one worker per core, minus the main thread
+	LLThreadPool(const std::string& name, U32 num_workers = 0);
+	~LLThreadPool();
+
+	// Stops and deletes the workers. Queues must be shut down first.
+	void shutdown();
+
+	// Any thread. Adds one service slot for queue in the given lane.
+	void schedule(LLQueuedThread* queue, lane_t lane);
+	// Any thread. Same, but the slot can't be taken for delay_ms. Lets a
+	// queue poll work that isn't ready without a worker sleeping on it.
+	void scheduleDeferred(LLQueuedThread* queue, lane_t lane, U32 delay_ms);
+
+	// Any thread but a worker. Blocks until no worker is inside
+	// queue->servicePooled(). Only useful once the queue has stopped
+	// scheduling itself, see LLQueuedThread::shutdown().
+	void drain(LLQueuedThread* queue);
+
+	U32 getWorkerCount() const { return mWorkers.size(); }
+	bool isRunning() const { return !mQuitting; }
+
+	static U32 getDefaultWorkerCount();
+	static lane_t laneForPriority(U32 priority);
+
+private:
+	class Worker : public LLThread
+	{
+	public:
+		Worker(const std::string& name, LLThreadPool* pool, U32 index);
+		~Worker();
+
+		void push(LLQueuedThread* queue, lane_t lane);
+		LLQueuedThread* pop(lane_t lane);
+		LLQueuedThread* steal(lane_t lane);
+
+		U32 getIndex() const { return mIndex; }
+		U32 getThreadID() const { return mThreadID; }
+
+		LLQueuedThread* mServicing; // guarded by mPool->mDrainCondition
+
+	protected:
+		/*virtual*/ void run(void);
+
+	private:
+		LLThreadPool* mPool;
+		U32 mIndex;
+		U32 mThreadID;
+		LLMutex* mLaneMutex;
+		typedef std::deque<LLQueuedThread*> lane_queue_t;
+		lane_queue_t mLanes[LANE_COUNT];
+	};
+	friend class Worker;
+
+	// No copy constructor or copy assignment
+	LLThreadPool(const LLThreadPool&);
+	LLThreadPool& operator=(const LLThreadPool&);
+
+	// WORKER THREAD. Blocks until there is work or the pool is quitting.
+	LLQueuedThread* getNextQueue(Worker* self);
+	void setServicing(Worker* self, LLQueuedThread* queue);
+	// mIdleCondition must be locked. Returns the microseconds until the
+	// next deferred slot is due, 0 if there is none left.
+	U64 promoteDeferred(Worker* self);
+	Worker* getCurrentWorker();
+
+private:
+	std::string mName;
+	typedef std::vector<Worker*> worker_list_t;
+	worker_list_t mWorkers;
+
+	// Idle workers wait on this. It guards mScheduledCount, the number of
+	// service slots in the lanes, which schedule() raises in the same lock
+	// as the push so a worker can't take a slot before it is counted.
+	LLCondition* mIdleCondition;
+	S32 mScheduledCount;
+	struct Deferred
+	{
+		U64 mDue; // LLTimer::getTotalTime()
+		LLQueuedThread* mQueue;
+		lane_t mLane;
+	};
+	typedef std::vector<Deferred> deferred_list_t;
+	deferred_list_t mDeferred; // guarded by mIdleCondition
+	// Earliest mDue in mDeferred, 0 if empty. Written with mIdleCondition
+	// locked, read without it to skip the lock when nothing is due.
+	volatile U64 mNextDue;
+	// drain() waits on this for workers to leave a queue
+	LLCondition* mDrainCondition;
+	LLAtomicU32 mNextWorker;
+	volatile bool mQuitting;
+};
+
+#endif // LL_LLTHREADPOOL_H
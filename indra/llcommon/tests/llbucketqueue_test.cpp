@@ -0,0 +1,306 @@
+/**
+ * @file llbucketqueue_test.cpp
+ * @brief Tests and contention benchmark for LLBucketQueue
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <set>
+#include <vector>
+
+#include "../llbucketqueue.h"
+#include "../llqueuedthread.h"
+#include "../llthread.h"
+#include "../lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	struct TestEntry : public LLBucketQueueEntry<TestEntry>
+	{
+		TestEntry(U32 priority, U32 id) : mPriority(priority), mID(id) {}
+		U32 getPriority() const { return mPriority; }
+		bool higherPriority(const TestEntry& second) const
+		{
+			// Same ordering as LLQueuedThread::QueuedRequest
+			if (mPriority == second.mPriority)
+				return mID < second.mID;
+			else
+				return mPriority > second.mPriority;
+		}
+		U32 mPriority;
+		U32 mID;
+	};
+
+	struct entry_less
+	{
+		bool operator()(const TestEntry* lhs, const TestEntry* rhs) const
+		{
+			return lhs->higherPriority(*rhs);
+		}
+	};
+
+	// The queues under test, same interface and locking as LLQueuedThread uses
+	class SetQueue
+	{
+	public:
+		void insert(TestEntry* entry) { mSet.insert(entry); }
+		void erase(TestEntry* entry) { mSet.erase(entry); }
+		TestEntry* pop()
+		{
+			if (mSet.empty()) return NULL;
+			TestEntry* entry = *mSet.begin();
+			mSet.erase(mSet.begin());
+			return entry;
+		}
+	private:
+		std::set<TestEntry*, entry_less> mSet;
+	};
+
+	class BucketQueue
+	{
+	public:
+		void insert(TestEntry* entry) { mQueue.insert(entry); }
+		void erase(TestEntry* entry) { mQueue.erase(entry); }
+		TestEntry* pop() { return mQueue.pop(); }
+	private:
+		LLBucketQueue<TestEntry> mQueue;
+	};
+
+	// Reprioritizes a private slice of the entries, the way
+	// LLTextureFetch::updateRequestPriority() hammers setPriority()
+	template <class QUEUE>
+	class Contender : public LLThread
+	{
+	public:
+		Contender(QUEUE* queue, LLMutex* mutex, std::vector<TestEntry*>& entries, S32 first, S32 count, S32 iterations)
+			: LLThread("contender"), mDone(false), mQueue(queue), mMutex(mutex), mEntries(entries),
+			  mFirst(first), mCount(count), mIterations(iterations)
+		{
+		}
+		/*virtual*/ void run()
+		{
+			U32 seed = mFirst + 1;
+			for (S32 i = 0; i < mIterations; ++i)
+			{
+				seed = seed * 1664525 + 1013904223;
+				TestEntry* entry = mEntries[mFirst + (seed >> 8) % mCount];
+				LLMutexLock lock(mMutex);
+				mQueue->erase(entry);
+				entry->mPriority = LLQueuedThread::PRIORITY_NORMAL | ((seed >> 4) & LLQueuedThread::PRIORITY_LOWBITS);
+				mQueue->insert(entry);
+			}
+			mDone = true;
+		}
+		volatile bool mDone;
+	private:
+		QUEUE* mQueue;
+		LLMutex* mMutex;
+		std::vector<TestEntry*>& mEntries;
+		S32 mFirst;
+		S32 mCount;
+		S32 mIterations;
+	};
+
+	template <class QUEUE>
+	F64 run_contention(S32 num_threads, S32 num_entries, S32 iterations)
+	{
+		QUEUE queue;
+		LLMutex mutex(NULL);
+		std::vector<TestEntry*> entries;
+		for (S32 i = 0; i < num_entries; ++i)
+		{
+			entries.push_back(new TestEntry(LLQueuedThread::PRIORITY_NORMAL | (i * 7919), i));
+			queue.insert(entries.back());
+		}
+
+		LLTimer timer;
+		std::vector<Contender<QUEUE>*> threads;
+		S32 slice = num_entries / num_threads;
+		for (S32 i = 0; i < num_threads; ++i)
+		{
+			threads.push_back(new Contender<QUEUE>(&queue, &mutex, entries, i * slice, slice, iterations));
+			threads.back()->start();
+		}
+		// Meanwhile this thread keeps popping and requeueing like processNextRequest()
+		bool done = false;
+		while (!done)
+		{
+			{
+				LLMutexLock lock(&mutex);
+				TestEntry* entry = queue.pop();
+				if (entry)
+				{
+					queue.insert(entry);
+				}
+			}
+			done = true;
+			for (S32 i = 0; i < num_threads; ++i)
+			{
+				done = done && threads[i]->mDone;
+			}
+		}
+		F64 elapsed = timer.getElapsedTimeF64();
+
+		for (S32 i = 0; i < num_threads; ++i)
+		{
+			delete threads[i];
+		}
+		for (S32 i = 0; i < num_entries; ++i)
+		{
+			delete entries[i];
+		}
+		return elapsed;
+	}
+}
+
+namespace tut
+{
+	struct bucketqueue_test
+	{
+	};
+	typedef test_group<bucketqueue_test> bucketqueue_group_t;
+	typedef bucketqueue_group_t::object bucketqueue_object_t;
+	tut::bucketqueue_group_t bucketqueue_instance("LLBucketQueue");
+
+	template<> template<>
+	void bucketqueue_object_t::test<1>()
+	{
+		// Priority classes always come out in order, equal priorities by ID
+		LLBucketQueue<TestEntry> queue;
+		TestEntry low(LLQueuedThread::PRIORITY_LOW, 1);
+		TestEntry normal1(LLQueuedThread::PRIORITY_NORMAL, 2);
+		TestEntry normal2(LLQueuedThread::PRIORITY_NORMAL, 3);
+		TestEntry urgent(LLQueuedThread::PRIORITY_URGENT, 4);
+		TestEntry immediate(LLQueuedThread::PRIORITY_IMMEDIATE, 5);
+		queue.insert(&low);
+		queue.insert(&normal1);
+		queue.insert(&immediate);
+		queue.insert(&normal2);
+		queue.insert(&urgent);
+		ensure_equals("size", queue.size(), (size_t)5);
+		ensure("immediate first", queue.pop() == &immediate);
+		ensure("urgent second", queue.pop() == &urgent);
+		ensure("normal lower ID first", queue.pop() == &normal1);
+		ensure("normal lower ID first", queue.pop() == &normal2);
+		ensure("low last", queue.pop() == &low);
+		ensure("empty", queue.empty() && queue.pop() == NULL);
+	}
+
+	template<> template<>
+	void bucketqueue_object_t::test<2>()
+	{
+		// Reprioritizing and erasing keep the queue consistent
+		LLBucketQueue<TestEntry> queue;
+		std::vector<TestEntry*> entries;
+		U32 seed = 12345;
+		for (U32 i = 0; i < 1000; ++i)
+		{
+			seed = seed * 1664525 + 1013904223;
+			entries.push_back(new TestEntry(seed & 0x7FFFFFFF, i));
+			queue.insert(entries.back());
+		}
+		for (U32 i = 0; i < 1000; i += 3)
+		{
+			ensure_equals("erase queued entry", queue.erase(entries[i]), (size_t)1);
+			ensure_equals("erase twice", queue.erase(entries[i]), (size_t)0);
+			entries[i]->mPriority = LLQueuedThread::PRIORITY_HIGH | i;
+			queue.insert(entries[i]);
+		}
+		ensure_equals("size after reprioritize", queue.size(), (size_t)1000);
+
+		size_t walked = 0;
+		for (LLBucketQueue<TestEntry>::iterator iter = queue.begin(); iter != queue.end(); ++iter)
+		{
+			++walked;
+		}
+		ensure_equals("iteration visits everything", walked, (size_t)1000);
+
+		TestEntry* last = NULL;
+		size_t popped = 0;
+		while (TestEntry* entry = queue.pop())
+		{
+			ensure("same order as std::set", !last || !entry->higherPriority(*last));
+			last = entry;
+			++popped;
+		}
+		ensure_equals("everything popped", popped, (size_t)1000);
+		for (U32 i = 0; i < 1000; ++i)
+		{
+			delete entries[i];
+		}
+	}
+
+	template<> template<>
+	void bucketqueue_object_t::test<3>()
+	{
+		// Microbenchmark: the old std::set queue against LLBucketQueue, with
+		// several threads reprioritizing while one pops. Reported, not enforced,
+		// timings on a build machine are too noisy to assert on.
+		const S32 NUM_THREADS = 4;
+		const S32 NUM_ENTRIES = 4000;
+		const S32 ITERATIONS = 50000;
+		F64 set_time = run_contention<SetQueue>(NUM_THREADS, NUM_ENTRIES, ITERATIONS);
+		F64 bucket_time = run_contention<BucketQueue>(NUM_THREADS, NUM_ENTRIES, ITERATIONS);
+		llinfos << "Reprioritize " << NUM_THREADS * ITERATIONS << " requests with "
+				<< NUM_ENTRIES << " queued: std::set " << set_time * 1000.0 << " ms, LLBucketQueue "
+				<< bucket_time * 1000.0 << " ms" << llendl;
+		ensure("benchmark ran", set_time > 0.0 && bucket_time > 0.0);
+	}
+
+	template<> template<>
+	void bucketqueue_object_t::test<4>()
+	{
+		// Low priority bits order entries that share a bucket, the way
+		// LLTextureFetch packs pixel area into the bottom 28 bits
+		LLBucketQueue<TestEntry> queue;
+		const U32 base = LLQueuedThread::PRIORITY_HIGH;
+		TestEntry small(base | 0x10, 1);
+		TestEntry medium(base | 0x400, 2);
+		TestEntry large(base | 0x7FFF, 3);
+		TestEntry large_late(base | 0x7FFF, 0);
+		ensure("entries share a bucket",
+			   LLBucketQueue<TestEntry>::getBucket(small.getPriority()) ==
+			   LLBucketQueue<TestEntry>::getBucket(large.getPriority()));
+		queue.insert(&small);
+		queue.insert(&large);
+		queue.insert(&medium);
+		queue.insert(&large_late);
+		ensure("equal priority, lower ID first", queue.pop() == &large_late);
+		ensure("largest low bits next", queue.pop() == &large);
+		ensure("then medium", queue.pop() == &medium);
+		ensure("smallest last", queue.pop() == &small);
+
+		// Iteration matches pop() order
+		queue.insert(&medium);
+		queue.insert(&small);
+		queue.insert(&large);
+		LLBucketQueue<TestEntry>::iterator iter = queue.begin();
+		ensure("walk large", *iter == &large);
+		ensure("walk medium", *++iter == &medium);
+		ensure("walk small", *++iter == &small);
+		ensure("walk end", ++iter == queue.end());
+	}
+}
@@ -33,6 +33,7 @@
 #include "../llsd.h"
 #include "../llsdserialize.h"
 #include "../llformat.h"
+#include "../lltimer.h"
 
 #include "../test/lltut.h"
 
@@ -1296,6 +1297,386 @@ namespace tut
 	}
 */
 
+	/**
+	 * @class TestLLSDBinaryBuffer
+	 * @brief Binary LLSD to and from memory, and LLSDBinaryView
+	 */
+	class TestLLSDBinaryBuffer
+	{
+	public:
+		TestLLSDBinaryBuffer() {}
+
+		// Something shaped like a FetchInventoryDescendents2 reply
+		static LLSD makeInventoryReply(S32 folder_count, S32 item_count)
+		{
+			LLSD folders = LLSD::emptyArray();
+			for (S32 i = 0; i < folder_count; ++i)
+			{
+				LLUUID folder_id;
+				folder_id.generate();
+				LLSD folder;
+				folder["folder_id"] = folder_id;
+				folder["owner_id"] = LLUUID::generateNewID();
+				folder["agent_id"] = folder["owner_id"];
+				folder["version"] = i + 3;
+				folder["descendents"] = item_count;
+				folder["categories"] = LLSD::emptyArray();
+				LLSD items = LLSD::emptyArray();
+				for (S32 j = 0; j < item_count; ++j)
+				{
+					LLSD item;
+					item["item_id"] = LLUUID::generateNewID();
+					item["parent_id"] = folder_id;
+					item["asset_id"] = LLUUID::generateNewID();
+					item["name"] = llformat("Object %d-%d", i, j);
+					item["desc"] = "(No Description)";
+					item["type"] = 6;
+					item["inv_type"] = 6;
+					item["flags"] = 0;
+					item["created_at"] = 1300000000 + j;
+					LLSD perms;
+					perms["creator_id"] = folder["owner_id"];
+					perms["owner_id"] = folder["owner_id"];
+					perms["group_id"] = LLUUID::null;
+					perms["base_mask"] = (S32)0x7fffffff;
+					perms["owner_mask"] = (S32)0x7fffffff;
+					perms["group_mask"] = 0;
+					perms["everyone_mask"] = 0;
+					perms["next_owner_mask"] = (S32)0x82000;
+					perms["is_owner_group"] = false;
+					item["permissions"] = perms;
+					LLSD sale;
+					sale["sale_type"] = 0;
+					sale["sale_price"] = 10;
+					item["sale_info"] = sale;
+					items.append(item);
+				}
+				folder["items"] = items;
+				folders.append(folder);
+			}
+			LLSD reply;
+			reply["agent_id"] = LLUUID::generateNewID();
+			reply["folders"] = folders;
+			return reply;
+		}
+
+		// Something shaped like an ObjectMedia reply for a whole region
+		static LLSD makeObjectMediaReply(S32 object_count, S32 face_count)
+		{
+			LLSD objects = LLSD::emptyArray();
+			for (S32 i = 0; i < object_count; ++i)
+			{
+				LLSD object;
+				object["object_id"] = LLUUID::generateNewID();
+				object["object_media_version"] = llformat("x-mv:%010d/%s", i, LLUUID::generateNewID().asString().c_str());
+				LLSD faces = LLSD::emptyArray();
+				for (S32 face = 0; face < face_count; ++face)
+				{
+					if (face % 3)
+					{
+						faces.append(LLSD());
+						continue;
+					}
+					LLSD media;
+					media["alt_image_enable"] = false;
+					media["auto_loop"] = true;
+					media["auto_play"] = true;
+					media["auto_scale"] = true;
+					media["auto_zoom"] = false;
+					media["controls"] = 0;
+					media["current_url"] = llformat("http://example.com/shop/%d/face/%d?session=a1b2c3", i, face);
+					media["home_url"] = "http://example.com/shop/";
+					media["first_click_interact"] = false;
+					media["height_pixels"] = 512;
+					media["width_pixels"] = 1024;
+					media["perms_control"] = 7;
+					media["perms_interact"] = 7;
+					media["whitelist_enable"] = false;
+					media["whitelist"] = LLSD::emptyArray();
+					faces.append(media);
+				}
+				object["object_media_data"] = faces;
+				objects.append(object);
+			}
+			return objects;
+		}
+
+		void ensureBuffer(const std::string& msg, const LLSD& input)
+		{
+			std::ostringstream ostr;
+			S32 stream_count = LLSDSerialize::toBinary(input, ostr);
+			std::vector<U8> buf;
+			S32 buf_count = LLSDSerialize::toBinary(input, buf);
+			ensure_equals((msg + " format count").c_str(), buf_count, stream_count);
+			ensure_equals((msg + " same bytes").c_str(), std::string(buf.begin(), buf.end()), ostr.str());
+
+			LLSD parsed;
+			S32 parse_count = LLSDSerialize::fromBinary(parsed, &buf[0], buf.size());
+			ensure_equals((msg + " parse count").c_str(), parse_count, stream_count);
+			ensure_equals((msg + " round trip").c_str(), parsed, input);
+
+			LLSDBinaryView view(&buf[0], buf.size());
+			ensure_equals((msg + " view").c_str(), view.asLLSD(), input);
+		}
+
+		// Same shape as TestLLSDParsing::ensureParse(), from memory
+		void ensureParse(
+			const std::string& msg,
+			const std::string& in,
+			const LLSD& expected_value,
+			S32 expected_count)
+		{
+			LLSD parsed_result;
+			S32 parsed_count = LLSDSerialize::fromBinary(
+				parsed_result,
+				(const U8*)in.data(),
+				in.size());
+			ensure_equals(msg.c_str(), parsed_result, expected_value);
+			ensure_equals(msg + " (count)", parsed_count, expected_count);
+		}
+
+		// A type byte followed by a network order size and the payload
+		static std::string sized(char type, U32 size, const std::string& payload)
+		{
+			uint32_t net_size = htonl(size);
+			std::string out(1, type);
+			out.append((const char*)&net_size, sizeof(uint32_t));
+			out.append(payload);
+			return out;
+		}
+	};
+
+	typedef tut::test_group<TestLLSDBinaryBuffer> TestLLSDBinaryBufferGroup;
+	typedef TestLLSDBinaryBufferGroup::object TestLLSDBinaryBufferObject;
+	TestLLSDBinaryBufferGroup gTestLLSDBinaryBufferGroup(
+		"llsd binary buffer");
+
+	template<> template<> 
+	void TestLLSDBinaryBufferObject::test<1>()
+	{
+		ensureBuffer("undef", LLSD());
+		ensureBuffer("true", LLSD(true));
+		ensureBuffer("integer", LLSD(-234567));
+		ensureBuffer("real", LLSD(1.5));
+		ensureBuffer("uuid", LLSD(LLUUID::generateNewID()));
+		ensureBuffer("string", LLSD("foobar"));
+		ensureBuffer("empty string", LLSD(""));
+		ensureBuffer("uri", LLSD(LLURI("http://www.secondlife.com/")));
+		ensureBuffer("date", LLSD(LLDate(12345.0)));
+		LLSD::Binary bin;
+		bin.push_back(0); bin.push_back(0xff); bin.push_back('x');
+		ensureBuffer("binary", LLSD(bin));
+		ensureBuffer("inventory", makeInventoryReply(3, 10));
+		ensureBuffer("object media", makeObjectMediaReply(5, 6));
+	}
+
+	template<> template<> 
+	void TestLLSDBinaryBufferObject::test<2>()
+	{
+		// Truncating a good payload anywhere must fail cleanly
+		std::vector<U8> buf;
+		LLSDSerialize::toBinary(makeInventoryReply(1, 2), buf);
+		for (size_t len = 1; len < buf.size(); ++len)
+		{
+			LLSD parsed;
+			S32 count = LLSDSerialize::fromBinary(parsed, &buf[0], len);
+			ensure_equals("truncated count", count, (S32)LLSDParser::PARSE_FAILURE);
+			ensure("truncated result", parsed.isUndefined());
+		}
+
+		// A container claiming more children than there are bytes for
+		std::vector<U8> huge;
+		huge.push_back('[');
+		uint32_t size = htonl(0x7fffffff);
+		huge.resize(huge.size() + 4);
+		memcpy(&huge[1], &size, sizeof(uint32_t));
+		huge.push_back(']');
+		LLSD parsed;
+		ensure_equals("oversize array",
+					  LLSDSerialize::fromBinary(parsed, &huge[0], huge.size()),
+					  (S32)LLSDParser::PARSE_FAILURE);
+		ensure("oversize array result", parsed.isUndefined());
+		ensure("oversize array view", LLSDBinaryView(&huge[0], huge.size()).asLLSD().isUndefined());
+
+		// Nesting deeper than anything real
+		std::vector<U8> deep;
+		for (S32 i = 0; i < 10000; ++i)
+		{
+			deep.push_back('[');
+			U32 one = htonl(1);
+			deep.insert(deep.end(), (U8*)&one, (U8*)&one + 4);
+		}
+		ensure_equals("too deep",
+					  LLSDSerialize::fromBinary(parsed, &deep[0], deep.size()),
+					  (S32)LLSDParser::PARSE_FAILURE);
+	}
+
+	template<> template<> 
+	void TestLLSDBinaryBufferObject::test<3>()
+	{
+		LLSD reply = makeInventoryReply(2, 3);
+		std::vector<U8> buf;
+		LLSDSerialize::toBinary(reply, buf);
+		LLSDBinaryView view(&buf[0], buf.size());
+
+		ensure("map", view.isMap());
+		ensure_equals("map size", view.size(), reply.size());
+		ensure_equals("uuid", view["agent_id"].asUUID(), reply["agent_id"].asUUID());
+		ensure("missing key", view["no_such_key"].isUndefined());
+		ensure("index into map", view[0].isUndefined());
+
+		LLSDBinaryView folders = view["folders"];
+		ensure("array", folders.isArray());
+		ensure_equals("array size", folders.size(), 2);
+		ensure("past the end", folders[2].isUndefined());
+		ensure("key into array", folders["folder_id"].isUndefined());
+
+		LLSDBinaryView item = folders[1]["items"][2];
+		ensure_equals("integer", item["created_at"].asInteger(), 1300000002);
+		ensure_equals("string", item["name"].asString(), std::string("Object 1-2"));
+		ensure_equals("nested boolean", item["permissions"]["is_owner_group"].asBoolean(), false);
+		ensure_equals("subtree", item.asLLSD(), reply["folders"][1]["items"][2]);
+
+		// Strings are handed back where they lie
+		LLSDBinaryView desc = item["desc"];
+		ensure("in place", (const U8*)desc.data() > &buf[0] && (const U8*)desc.data() < &buf[0] + buf.size());
+		ensure_equals("in place size", desc.dataSize(), 16);
+		ensure("in place bytes", !strncmp(desc.data(), "(No Description)", 16));
+
+		std::vector<LLSDBinaryView> values;
+		std::vector<LLSDBinaryView> keys;
+		ensure("children", item["sale_info"].getChildren(values, &keys));
+		ensure_equals("child count", values.size(), (size_t)2);
+		ensure_equals("key count", keys.size(), (size_t)2);
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			ensure_equals("child value", values[i].asInteger(), reply["folders"][1]["items"][2]["sale_info"][keys[i].asString()].asInteger());
+		}
+	}
+
+	template<> template<> 
+	void TestLLSDBinaryBufferObject::test<4>()
+	{
+		// Notation style strings can turn up in binary llsd from other
+		// writers, they are unescaped but can't be viewed in place.
+		std::string in("{\0\0\0\1k\0\0\0\1a'it\\'s'}", 20);
+		LLSD parsed;
+		ensure_equals("quoted parse", LLSDSerialize::fromBinary(parsed, (const U8*)in.data(), in.size()), 2);
+		ensure_equals("quoted value", parsed["a"].asString(), std::string("it's"));
+
+		LLSDBinaryView view((const U8*)in.data(), in.size());
+		ensure_equals("quoted view", view["a"].asString(), std::string("it's"));
+		ensure("quoted view data", view["a"].data() == NULL);
+	}
+
+	template<> template<> 
+	void TestLLSDBinaryBufferObject::test<5>()
+	{
+		// The stream parsing cases, from a memory buffer
+		LLSD::Binary bin;
+		bin.push_back('a'); bin.push_back('b'); bin.push_back('c');
+		bin.push_back('3'); bin.push_back('2'); bin.push_back('1');
+		ensureParse("correct string parse", sized('s', 6, "abc321"), LLSD("abc321"), 1);
+		ensureParse("incorrect size string parse 1", sized('s', 7, "abc321"), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("incorrect size string parse 2", sized('s', 100000, "abc321"), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("correct binary parse", sized('b', 6, "abc321"), LLSD(bin), 1);
+		ensureParse("incorrect size binary parse 1", sized('b', 7, "abc321"), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("incorrect size binary parse 2", sized('b', 100000, "abc321"), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("correct uri parse", sized('l', 13, "http://sl.com"), LLSD(LLURI("http://sl.com")), 1);
+		ensureParse("incorrect size uri parse", sized('l', 14, "http://sl.com"), LLSD(), LLSDParser::PARSE_FAILURE);
+
+		ensureParse("malformed binary map", "{'ha ha'", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("malformed binary array", "['ha ha'", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("malformed binary string", "'ha ha", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("bad noise", "g48ejlnfr", LLSD(), LLSDParser::PARSE_FAILURE);
+
+		ensureParse("valid undef", "!", LLSD(), 1);
+		ensureParse("valid boolean false", "0", LLSD(false), 1);
+		ensureParse("valid boolean true", "1", LLSD(true), 1);
+		ensureParse("invalid true", "t", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("invalid false", "f", LLSD(), LLSDParser::PARSE_FAILURE);
+
+		uint32_t val_int = htonl(23);
+		std::string integer("i");
+		integer.append((const char*)&val_int, sizeof(uint32_t));
+
+		LLSD map;
+		map["amy"] = 23;
+		std::string entry = sized('k', 3, "amy") + integer;
+		ensureParse("valid map", sized('{', 1, entry) + "}", map, 2);
+		ensureParse("invalid key size", sized('{', 1, sized('k', 1, "amy") + integer), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("valid key size, unterminated map", sized('{', 1, entry), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("invalid map too long", sized('{', 0, entry) + "}", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("invalid map too short", sized('{', 2, entry) + "}", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("empty map", sized('{', 0, "}"), LLSD::emptyMap(), 1);
+
+		LLSD array;
+		array.append("amy");
+		array.append(23);
+		std::string elements = "\"amy\"" + integer;
+		ensureParse("valid array", sized('[', 2, elements) + "]", array, 3);
+		ensureParse("invalid array size", sized('[', 1, elements), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("unterminated array", sized('[', 2, elements), LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("array too short", sized('[', 3, elements) + "]", LLSD(), LLSDParser::PARSE_FAILURE);
+		ensureParse("empty array", sized('[', 0, "]"), LLSD::emptyArray(), 1);
+	}
+
+	template<> template<> 
+	void TestLLSDBinaryBufferObject::test<6>()
+	{
+		// Benchmark: the stream and the buffer formatter and parser on
+		// replies with thousands of items, as big as the viewer sees.
+		// Reported, not enforced, timings on a build machine are too noisy
+		// to assert on.
+		const S32 ITERATIONS = 5;
+		const char* names[] = { "inventory", "object media" };
+		LLSD payloads[] = { makeInventoryReply(20, 200), makeObjectMediaReply(2000, 8) };
+		for (S32 p = 0; p < 2; ++p)
+		{
+			const LLSD& input = payloads[p];
+			F64 stream_format = 0.0;
+			F64 buffer_format = 0.0;
+			F64 stream_parse = 0.0;
+			F64 buffer_parse = 0.0;
+			size_t bytes = 0;
+			LLTimer timer;
+			for (S32 i = 0; i < ITERATIONS; ++i)
+			{
+				timer.reset();
+				std::ostringstream ostr;
+				LLSDSerialize::toBinary(input, ostr);
+				std::string formatted = ostr.str();
+				stream_format += timer.getElapsedTimeF64();
+
+				timer.reset();
+				std::vector<U8> buf;
+				LLSDSerialize::toBinary(input, buf);
+				buffer_format += timer.getElapsedTimeF64();
+				ensure_equals(std::string(names[p]) + " same bytes", buf.size(), formatted.size());
+				bytes = buf.size();
+
+				timer.reset();
+				std::istringstream istr(formatted);
+				LLSD from_stream;
+				LLSDSerialize::fromBinary(from_stream, istr, formatted.size());
+				stream_parse += timer.getElapsedTimeF64();
+
+				timer.reset();
+				LLSD from_buffer;
+				LLSDSerialize::fromBinary(from_buffer, &buf[0], buf.size());
+				buffer_parse += timer.getElapsedTimeF64();
+				ensure_equals(std::string(names[p]) + " parsed size", from_buffer.size(), from_stream.size());
+			}
+			llinfos << names[p] << " reply, " << bytes << " bytes: format "
+					<< stream_format * 1000.0 / ITERATIONS << " ms stream, "
+					<< buffer_format * 1000.0 / ITERATIONS << " ms buffer ("
+					<< (buffer_format > 0.0 ? stream_format / buffer_format : 0.0) << "x), parse "
+					<< stream_parse * 1000.0 / ITERATIONS << " ms stream, "
+					<< buffer_parse * 1000.0 / ITERATIONS << " ms buffer ("
+					<< (buffer_parse > 0.0 ? stream_parse / buffer_parse : 0.0) << "x)" << llendl;
+		}
+	}
+
    /**
 	 * @class TestLLSDCrossCompatible
 	 * @brief Miscellaneous serialization and parsing tests
@@ -0,0 +1,281 @@
+/**
+ * @file llthreadpool_test.cpp
+ * @brief Tests for LLThreadPool servicing pooled LLQueuedThreads
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "../llthreadpool.h"
+#include "../llqueuedthread.h"
+#include "../llparallelforthread.h"
+#include "../lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	// Counts how many of its requests have run, and how many ran at once
+	class CountingQueue : public LLQueuedThread
+	{
+	public:
+		class CountingRequest : public LLQueuedThread::QueuedRequest
+		{
+		public:
+			CountingRequest(handle_t handle, U32 priority, CountingQueue* queue)
+				: LLQueuedThread::QueuedRequest(handle, priority, FLAG_AUTO_COMPLETE),
+				  mQueue(queue)
+			{
+			}
+
+			/*virtual*/ bool processRequest()
+			{
+				if (mQueue->mHold)
+				{
+					// Still waiting on something, poll again later
+					mQueue->mPolls++;
+					return false;
+				}
+				mQueue->mActive++;
+				S32 active = mQueue->mActive;
+				if (active > mQueue->mMaxActive)
+				{
+					mQueue->mMaxActive = active;
+				}
+				ms_sleep(5);
+				mQueue->mActive--;
+				mQueue->mDone++;
+				return true;
+			}
+
+		private:
+			CountingQueue* mQueue;
+		};
+
+		CountingQueue(S32 concurrency)
+			: LLQueuedThread("counting", true),
+			  mActive(0),
+			  mMaxActive(0),
+			  mDone(0),
+			  mPolls(0),
+			  mHold(false)
+		{
+			setMaxConcurrency(concurrency);
+		}
+
+		void add(U32 priority)
+		{
+			addRequest(new CountingRequest(generateHandle(), priority, this));
+		}
+
+		bool pooled() const { return isPooled(); }
+
+		LLAtomicS32 mActive;
+		volatile S32 mMaxActive; // only a rough high water mark
+		LLAtomicS32 mDone;
+		LLAtomicS32 mPolls;
+		volatile bool mHold;
+	};
+
+	// Counts how often each item of a batch ran
+	class CountingBatch : public LLParallelForThread
+	{
+	public:
+		CountingBatch() : LLParallelForThread("batch"), mRuns(NULL) {}
+
+		void run(std::vector<LLAtomicS32>& runs)
+		{
+			mRuns = &runs;
+			runBatch((S32)runs.size());
+			mRuns = NULL;
+		}
+
+		bool pooled() const { return isPooled(); }
+
+	protected:
+		/*virtual*/ void processItem(S32 index)
+		{
+			ms_sleep(index % 3);
+			(*mRuns)[index]++;
+		}
+
+	private:
+		std::vector<LLAtomicS32>* mRuns;
+	};
+
+	bool wait_for(LLAtomicS32& counter, S32 count)
+	{
+		for (S32 i = 0; i < 200 && counter < count; ++i)
+		{
+			ms_sleep(50);
+		}
+		return counter == count;
+	}
+}
+
+namespace tut
+{
+	struct threadpool_test
+	{
+		threadpool_test()
+		{
+			mPool = new LLThreadPool("testpool", 4);
+			LLQueuedThread::setSharedPool(mPool);
+		}
+		~threadpool_test()
+		{
+			LLQueuedThread::setSharedPool(NULL);
+			delete mPool;
+		}
+		LLThreadPool* mPool;
+	};
+	typedef test_group<threadpool_test> threadpool_group_t;
+	typedef threadpool_group_t::object threadpool_object_t;
+	tut::threadpool_group_t threadpool_instance("LLThreadPool");
+
+	template<> template<>
+	void threadpool_object_t::test<1>()
+	{
+		ensure_equals("worker count", mPool->getWorkerCount(), 4U);
+		ensure("lane for high", LLThreadPool::laneForPriority(LLQueuedThread::PRIORITY_URGENT) == LLThreadPool::LANE_HIGH);
+		ensure("lane for normal", LLThreadPool::laneForPriority(LLQueuedThread::PRIORITY_NORMAL + 1) == LLThreadPool::LANE_NORMAL);
+		ensure("lane for low", LLThreadPool::laneForPriority(LLQueuedThread::PRIORITY_LOW) == LLThreadPool::LANE_LOW);
+	}
+
+	template<> template<>
+	void threadpool_object_t::test<2>()
+	{
+		// A serial queue runs every request, one at a time
+		CountingQueue* queue = new CountingQueue(1);
+		ensure("queue uses the shared pool", queue->pooled());
+		const S32 NUM_REQUESTS = 20;
+		for (S32 i = 0; i < NUM_REQUESTS; ++i)
+		{
+			queue->add(LLQueuedThread::PRIORITY_NORMAL);
+		}
+		ensure("all requests processed", wait_for(queue->mDone, NUM_REQUESTS));
+		ensure_equals("serial queue never ran concurrently", (S32)queue->mMaxActive, 1);
+		queue->shutdown();
+		ensure("queue stopped", queue->isStopped());
+		delete queue;
+	}
+
+	template<> template<>
+	void threadpool_object_t::test<3>()
+	{
+		// Several queues at once, one of them allowed to use the whole pool
+		CountingQueue* wide = new CountingQueue(4);
+		CountingQueue* serial = new CountingQueue(1);
+		const S32 NUM_REQUESTS = 40;
+		for (S32 i = 0; i < NUM_REQUESTS; ++i)
+		{
+			wide->add(LLQueuedThread::PRIORITY_HIGH);
+			serial->add(LLQueuedThread::PRIORITY_LOW);
+		}
+		ensure("wide queue processed", wait_for(wide->mDone, NUM_REQUESTS));
+		ensure("serial queue processed", wait_for(serial->mDone, NUM_REQUESTS));
+		ensure("wide queue ran on several workers", wide->mMaxActive > 1);
+		ensure("wide queue stayed within its limit", wide->mMaxActive <= 4);
+		ensure_equals("serial queue never ran concurrently", (S32)serial->mMaxActive, 1);
+		delete wide;
+		delete serial;
+	}
+
+	template<> template<>
+	void threadpool_object_t::test<4>()
+	{
+		// Queues constructed without a shared pool keep their own thread
+		LLQueuedThread::setSharedPool(NULL);
+		CountingQueue* queue = new CountingQueue(1);
+		ensure("queue has its own thread", !queue->pooled());
+		queue->add(LLQueuedThread::PRIORITY_NORMAL);
+		ensure("request processed", wait_for(queue->mDone, 1));
+		delete queue;
+	}
+
+	template<> template<>
+	void threadpool_object_t::test<5>()
+	{
+		// A request that isn't ready keeps being polled by the pool without
+		// the owner's update(), but backs off instead of spinning a worker
+		CountingQueue* queue = new CountingQueue(1);
+		queue->mHold = true;
+		queue->add(LLQueuedThread::PRIORITY_NORMAL);
+		ms_sleep(200);
+		S32 polls = queue->mPolls;
+		ensure("polled again without an update", polls > 1);
+		ensure("polling backs off", polls < 1000);
+		ensure_equals("still pending", queue->getPending(), 1);
+
+		queue->mHold = false;
+		ensure("processed without an update", wait_for(queue->mDone, 1));
+		delete queue;
+	}
+
+	template<> template<>
+	void threadpool_object_t::test<6>()
+	{
+		// Queues torn down with requests in flight, shutdown() has to wait
+		// for the worker on its way out before the queue goes away
+		const S32 NUM_REQUESTS = 8;
+		for (S32 i = 0; i < 50; ++i)
+		{
+			CountingQueue* queue = new CountingQueue(2);
+			for (S32 j = 0; j < NUM_REQUESTS; ++j)
+			{
+				queue->add(LLQueuedThread::PRIORITY_NORMAL);
+			}
+			queue->shutdown();
+			ensure("queue stopped", queue->isStopped());
+			delete queue;
+		}
+		// The pool is still usable
+		CountingQueue* queue = new CountingQueue(1);
+		queue->add(LLQueuedThread::PRIORITY_NORMAL);
+		ensure("request processed", wait_for(queue->mDone, 1));
+		delete queue;
+	}
+
+	template<> template<>
+	void threadpool_object_t::test<7>()
+	{
+		// Batches back to back, each item runs exactly once and a batch is
+		// done when runBatch() returns, whatever requests are left over
+		CountingBatch* batch = new CountingBatch;
+		ensure("batch uses the shared pool", batch->pooled());
+		for (S32 i = 0; i < 20; ++i)
+		{
+			std::vector<LLAtomicS32> runs(i * 7);
+			for (size_t j = 0; j < runs.size(); ++j)
+			{
+				runs[j] = 0;
+			}
+			batch->run(runs);
+			for (size_t j = 0; j < runs.size(); ++j)
+			{
+				ensure_equals(llformat("batch %d item %d", i, (S32)j), (S32)runs[j], 1);
+			}
+		}
+		delete batch;
+	}
+}
@@ -250,6 +250,25 @@ void LLImageJ2C::setLastError(const std::string& message, const std::string& fil
 		mLastError += std::string(" FILE: ") + filename;
 }
 
+// virtual
+void LLImageJ2C::deleteData()
+{
+	if (mImpl)
+	{
+		mImpl->resetDecodeState();
+	}
+	LLImageFormatted::deleteData();
+}
+
+// virtual
+void LLImageJ2C::releaseDecodeState()
+{
+	if (mImpl)
+	{
+		mImpl->resetDecodeState();
+	}
+}
+
 // virtual
 S8  LLImageJ2C::getRawDiscardLevel()
 {
@@ -47,6 +47,7 @@ public:
 	/*virtual*/ BOOL updateData();
 	/*virtual*/ BOOL decode(LLImageRaw *raw_imagep, F32 decode_time);
 	/*virtual*/ BOOL decodeChannels(LLImageRaw *raw_imagep, F32 decode_time, S32 first_channel, S32 max_channel_count);
+	/*virtual*/ void releaseDecodeState();
 	/*virtual*/ BOOL encode(const LLImageRaw *raw_imagep, F32 encode_time);
 	/*virtual*/ S32 calcHeaderSize();
 	/*virtual*/ S32 calcDataSize(S32 discard_level = 0);
@@ -55,6 +56,8 @@ public:
 	// Override these so that we don't try to set a global variable from a DLL
 	/*virtual*/ void resetLastError();
 	/*virtual*/ void setLastError(const std::string& message, const std::string& filename = std::string());
+	// LLImageBase
+	/*virtual*/ void deleteData();
 	
 	
 	// Encode with comment text 
@@ -119,6 +122,9 @@ protected:
 	virtual BOOL decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count) = 0;
 	virtual BOOL encodeImpl(LLImageJ2C &base, const LLImageRaw &raw_image, const char* comment_text, F32 encode_time=0.0,
 							BOOL reversible=FALSE) = 0;
+	// Drop anything kept from a previous decodeImpl() call. Called whenever
+	// the codestream changes.
+	virtual void resetDecodeState() {}
 
 	friend class LLImageJ2C;
 };
@@ -28,14 +28,77 @@
 
 #include "llimageworker.h"
 #include "llimagedxt.h"
+#include "llstl.h"
+#include "llsys.h"
+#include "llthreadpool.h"
+
+// Requests queued per pool thread before isSaturated() reports true
+const S32 DECODE_QUEUE_DEPTH_PER_THREAD = 16;
+// Never grow the pool past this, decodes are also memory bandwidth bound
+const U32 MAX_DECODE_POOL_SIZE = 8;
 
 //----------------------------------------------------------------------------
 
 // MAIN THREAD
-LLImageDecodeThread::LLImageDecodeThread(bool threaded)
-	: LLQueuedThread("imagedecode", threaded)
+LLImageDecodeThread::LLImageDecodeThread(bool threaded, U32 pool_size)
+	: LLQueuedThread("imagedecode", threaded),
+	  mPoolSize(1)
 {
 	mCreationMutex = new LLMutex(getAPRPool());
+
+	if (isPooled())
+	{
+		// The shared thread pool already has workers, let several of them
+		// decode at once instead of starting our own.
+		mPoolSize = llclamp(pool_size, (U32)1, llmin(MAX_DECODE_POOL_SIZE, getSharedPool()->getWorkerCount()));
+		setMaxConcurrency(mPoolSize);
+	}
+	else if (threaded)
+	{
+		mPoolSize = llclamp(pool_size, (U32)1, MAX_DECODE_POOL_SIZE);
+		for (U32 i = 1; i < mPoolSize; ++i)
+		{
+			DecodeWorker* worker = new DecodeWorker(llformat("imagedecode%d", i), this);
+			mWorkers.push_back(worker);
+			worker->start();
+		}
+		if (!mWorkers.empty())
+		{
+			llinfos << "Image decode pool started with " << mPoolSize << " threads" << llendl;
+		}
+	}
+}
+
+// MAIN THREAD
+LLImageDecodeThread::~LLImageDecodeThread()
+{
+	shutdown();
+	delete mCreationMutex;
+	mCreationMutex = NULL;
+}
+
+// MAIN THREAD
+// virtual
+void LLImageDecodeThread::shutdown()
+{
+	// Stop the pool first: the workers pull from our queue, which
+	// LLQueuedThread::shutdown() deletes.
+	for (worker_list_t::iterator iter = mWorkers.begin();
+		 iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->shutdown();
+	}
+	std::for_each(mWorkers.begin(), mWorkers.end(), DeletePointer());
+	mWorkers.clear();
+
+	LLQueuedThread::shutdown();
+}
+
+// static
+U32 LLImageDecodeThread::getDefaultPoolSize()
+{
+	U32 cores = LLCPUInfo::getCoreCount();
+	return llclamp(cores > 2 ? cores - 2 : 1, (U32)1, MAX_DECODE_POOL_SIZE);
 }
 
 // MAIN THREAD
@@ -58,10 +121,38 @@ S32 LLImageDecodeThread::update(U32 max_time_ms)
 		}
 	}
 	mCreationList.clear();
-	S32 res = LLQueuedThread::update(max_time_ms);
+	S32 res = LLQueuedThread::update(max_time_ms); // unpauses
+	if (res > 0)
+	{
+		wakeWorkers();
+	}
 	return res;
 }
 
+// MAIN THREAD
+void LLImageDecodeThread::wakeWorkers()
+{
+	// Never call with mCreationMutex or our run condition locked:
+	// worker runCondition() locks our run condition.
+	for (worker_list_t::iterator iter = mWorkers.begin();
+		 iter != mWorkers.end(); ++iter)
+	{
+		(*iter)->wake();
+	}
+}
+
+// Any thread
+bool LLImageDecodeThread::isSaturated()
+{
+	S32 queued;
+	{
+		LLMutexLock lock(mCreationMutex);
+		queued = mCreationList.size();
+	}
+	queued += getPending();
+	return queued >= (S32)getPoolSize() * DECODE_QUEUE_DEPTH_PER_THREAD;
+}
+
 LLImageDecodeThread::handle_t LLImageDecodeThread::decodeImage(LLImageFormatted* image, 
 	U32 priority, S32 discard, BOOL needs_aux, Responder* responder)
 {
@@ -86,6 +177,42 @@ LLImageDecodeThread::Responder::~Responder()
 
 //----------------------------------------------------------------------------
 
+LLImageDecodeThread::DecodeWorker::DecodeWorker(const std::string& name, LLImageDecodeThread* owner)
+	: LLThread(name),
+	  mOwner(owner)
+{
+}
+
+// virtual
+bool LLImageDecodeThread::DecodeWorker::runCondition()
+{
+	// mRunCondition is locked here, getPending() locks the owner's.
+	// The owner never wakes us with its own condition locked.
+	return !mOwner->isPaused() && mOwner->getPending() > 0;
+}
+
+// virtual
+void LLImageDecodeThread::DecodeWorker::run()
+{
+	while (1)
+	{
+		// Sleeps until the owner has queued work and is not paused
+		checkPause();
+
+		if (isQuitting())
+		{
+			break;
+		}
+
+		// Requests are in progress on exactly one thread at a time,
+		// see LLQueuedThread::processNextRequest()
+		mOwner->processNextRequest();
+	}
+	llinfos << "LLImageDecodeThread worker " << mName << " EXITING." << llendl;
+}
+
+//----------------------------------------------------------------------------
+
 LLImageDecodeThread::ImageRequest::ImageRequest(handle_t handle, LLImageFormatted* image, 
 												U32 priority, S32 discard, BOOL needs_aux,
 												LLImageDecodeThread::Responder* responder)
@@ -157,6 +284,11 @@ bool LLImageDecodeThread::ImageRequest::processRequest()
 
 void LLImageDecodeThread::ImageRequest::finishRequest(bool completed)
 {
+	if (mFormattedImage.notNull())
+	{
+		// Done or aborted, either way no aux pass is coming for this decode
+		mFormattedImage->releaseDecodeState();
+	}
 	if (mResponder.notNull())
 	{
 		bool success = completed && mDecodedRaw && (!mNeedsAux || mDecodedAux);
@@ -71,17 +71,51 @@ public:
 		LLPointer<LLImageDecodeThread::Responder> mResponder;
 	};
 	
+private:
+	// Extra decode thread of the pool. Pulls requests from the owner's queue
+	// so priority ordering is shared by every thread of the pool.
+	class DecodeWorker : public LLThread
+	{
+	public:
+		DecodeWorker(const std::string& name, LLImageDecodeThread* owner);
+
+	protected:
+		/*virtual*/ bool runCondition(void);
+		/*virtual*/ void run(void);
+
+	private:
+		LLImageDecodeThread* mOwner;
+	};
+	friend class DecodeWorker;
+	
 public:
-	LLImageDecodeThread(bool threaded = true);
+	// pool_size is the total number of decode threads, including this one.
+	// It is ignored when not threaded. With a shared LLThreadPool it is the
+	// number of pool workers that may decode at once.
+	LLImageDecodeThread(bool threaded = true, U32 pool_size = 1);
+	virtual ~LLImageDecodeThread();
+	/*virtual*/ void shutdown();
+
 	handle_t decodeImage(LLImageFormatted* image,
 						 U32 priority, S32 discard, BOOL needs_aux,
 						 Responder* responder);
 	S32 update(U32 max_time_ms);
 
+	// Back-pressure: true when enough decodes are queued to keep every
+	// thread of the pool busy, callers should hold off submitting more.
+	bool isSaturated();
+	U32 getPoolSize() const { return mPoolSize; }
+
+	// Pool size to use on this machine: one thread per core, minus the
+	// main thread and the texture fetch thread.
+	static U32 getDefaultPoolSize();
+
 	// Used by unit tests to check the consistency of the thread instance
 	S32 tut_size();
 	
 private:
+	void wakeWorkers();
+
 	struct creation_info
 	{
 		handle_t handle;
@@ -97,6 +131,10 @@ private:
 	typedef std::list<creation_info> creation_list_t;
 	creation_list_t mCreationList;
 	LLMutex* mCreationMutex;
+
+	typedef std::vector<DecodeWorker*> worker_list_t;
+	worker_list_t mWorkers;
+	U32 mPoolSize;
 };
 
 #endif
@@ -232,6 +232,41 @@ namespace tut
 		ensure("LLImageDecodeThread: threaded work unit not processed", done == true);
 	}
 
+	template<> template<>
+	void imagedecodethread_object_t::test<3>()
+	{
+		// Test a *threaded* instance of the class with a pool of decode threads
+		mThread = new LLImageDecodeThread(true, 3);
+		ensure("LLImageDecodeThread: pool constructor failed", mThread != NULL);
+		ensure("LLImageDecodeThread: pool size incorrect", mThread->getPoolSize() == 3);
+		ensure("LLImageDecodeThread: pool should not start saturated", !mThread->isSaturated());
+		// Insert several work orders so more than one thread of the pool gets to pick them up
+		const S32 NUM_REQUESTS = 8;
+		bool done[NUM_REQUESTS];
+		for (S32 i = 0; i < NUM_REQUESTS; ++i)
+		{
+			LLImageDecodeThread::handle_t decodeHandle = mThread->decodeImage(NULL, LLQueuedThread::PRIORITY_NORMAL + i, 0, FALSE, new responder_test(&done[i]));
+			ensure("LLImageDecodeThread: pool decodeImage(), returned handle is null", decodeHandle != 0);
+		}
+		mThread->update(1);
+		const U32 INCREMENT_TIME = 500;				// 500 milliseconds
+		const U32 MAX_TIME = 20 * INCREMENT_TIME;	// Do the loop 20 times max, i.e. wait 10 seconds but no more
+		U32 total_time = 0;
+		bool all_done = false;
+		while (!all_done && (total_time < MAX_TIME))
+		{
+			ms_sleep(INCREMENT_TIME);
+			total_time += INCREMENT_TIME;
+			all_done = true;
+			for (S32 i = 0; i < NUM_REQUESTS; ++i)
+			{
+				all_done = all_done && done[i];
+			}
+		}
+		// Verifies that every responder has now been called
+		ensure("LLImageDecodeThread: pool work units not processed", all_done);
+	}
+
 	// ---------------------------------------------------------------------------------------
 	// Test the LLImageDecodeThread::ImageRequest interface
 	// ---------------------------------------------------------------------------------------
@@ -92,13 +92,31 @@ void info_callback(const char* msg, void*)
 
 
 LLImageJ2COJ::LLImageJ2COJ()
-	: LLImageJ2CImpl()
+	: LLImageJ2CImpl(),
+	  mDecodedImage(NULL),
+	  mDecodedData(NULL),
+	  mDecodedSize(0),
+	  mDecodedReduce(-1)
 {
 }
 
 
 LLImageJ2COJ::~LLImageJ2COJ()
 {
+	resetDecodeState();
+}
+
+// virtual
+void LLImageJ2COJ::resetDecodeState()
+{
+	if (mDecodedImage)
+	{
+		opj_image_destroy(mDecodedImage);
+		mDecodedImage = NULL;
+	}
+	mDecodedData = NULL;
+	mDecodedSize = 0;
+	mDecodedReduce = -1;
 }
 
 
@@ -110,87 +128,103 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 
 	LLTimer decode_timer;
 
-	opj_dparameters_t parameters;	/* decompression parameters */
-	opj_event_mgr_t event_mgr;		/* event manager */
 	opj_image_t *image = NULL;
+	S32 reduce = base.getRawDiscardLevel();
 
-	opj_dinfo_t* dinfo = NULL;	/* handle to a decompressor */
-	opj_cio_t *cio = NULL;
+	if (mDecodedImage && mDecodedData == base.getData() &&
+		mDecodedSize == base.getDataSize() && mDecodedReduce == reduce)
+	{
+		// Same bytes at the same level as the last pass (the aux channel
+		// after the color channels), the samples are still here.
+		image = mDecodedImage;
+	}
+	else
+	{
+		resetDecodeState();
 
+		opj_dparameters_t parameters;	/* decompression parameters */
+		opj_event_mgr_t event_mgr;		/* event manager */
 
-	/* configure the event callbacks (not required) */
-	memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
-	event_mgr.error_handler = error_callback;
-	event_mgr.warning_handler = warning_callback;
-	event_mgr.info_handler = info_callback;
+		opj_dinfo_t* dinfo = NULL;	/* handle to a decompressor */
+		opj_cio_t *cio = NULL;
 
-	/* set decoding parameters to default values */
-	opj_set_default_decoder_parameters(&parameters);
 
-	parameters.cp_reduce = base.getRawDiscardLevel();
+		/* configure the event callbacks (not required) */
+		memset(&event_mgr, 0, sizeof(opj_event_mgr_t));
+		event_mgr.error_handler = error_callback;
+		event_mgr.warning_handler = warning_callback;
+		event_mgr.info_handler = info_callback;
 
-	/* decode the code-stream */
-	/* ---------------------- */
+		/* set decoding parameters to default values */
+		opj_set_default_decoder_parameters(&parameters);
 
-	/* JPEG-2000 codestream */
+		parameters.cp_reduce = reduce;
 
-	/* get a decoder handle */
-	dinfo = opj_create_decompress(CODEC_J2K);
+		/* decode the code-stream */
+		/* ---------------------- */
 
-	/* catch events using our callbacks and give a local context */
-	opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);			
+		/* JPEG-2000 codestream */
 
-	/* setup the decoder decoding parameters using user parameters */
-	opj_setup_decoder(dinfo, &parameters);
+		/* get a decoder handle */
+		dinfo = opj_create_decompress(CODEC_J2K);
 
-	/* open a byte stream */
-	cio = opj_cio_open((opj_common_ptr)dinfo, base.getData(), base.getDataSize());
+		/* catch events using our callbacks and give a local context */
+		opj_set_event_mgr((opj_common_ptr)dinfo, &event_mgr, stderr);			
 
-	/* decode the stream and fill the image structure */
-	image = opj_decode(dinfo, cio);
+		/* setup the decoder decoding parameters using user parameters */
+		opj_setup_decoder(dinfo, &parameters);
 
-	/* close the byte stream */
-	opj_cio_close(cio);
+		/* open a byte stream */
+		cio = opj_cio_open((opj_common_ptr)dinfo, base.getData(), base.getDataSize());
 
-	/* free remaining structures */
-	if(dinfo)
-	{
-		opj_destroy_decompress(dinfo);
-	}
+		/* decode the stream and fill the image structure */
+		image = opj_decode(dinfo, cio);
 
-	// The image decode failed if the return was NULL or the component
-	// count was zero.  The latter is just a sanity check before we
-	// dereference the array.
-	if(!image || !image->numcomps)
-	{
-		LL_DEBUGS("Texture") << "ERROR -> decodeImpl: failed to decode image!" << LL_ENDL;
-		if (image)
+		/* close the byte stream */
+		opj_cio_close(cio);
+
+		/* free remaining structures */
+		if(dinfo)
 		{
-			opj_image_destroy(image);
+			opj_destroy_decompress(dinfo);
 		}
 
-		return TRUE; // done
-	}
+		// The image decode failed if the return was NULL or the component
+		// count was zero.  The latter is just a sanity check before we
+		// dereference the array.
+		if(!image || !image->numcomps)
+		{
+			LL_DEBUGS("Texture") << "ERROR -> decodeImpl: failed to decode image!" << LL_ENDL;
+			if (image)
+			{
+				opj_image_destroy(image);
+			}
 
-	// sometimes we get bad data out of the cache - check to see if the decode succeeded
-	for (S32 i = 0; i < image->numcomps; i++)
-	{
-		if (image->comps[i].factor != base.getRawDiscardLevel())
+			return TRUE; // done
+		}
+
+		// sometimes we get bad data out of the cache - check to see if the decode succeeded
+		for (S32 i = 0; i < image->numcomps; i++)
 		{
-			// if we didn't get the discard level we're expecting, fail
-			opj_image_destroy(image);
-			base.mDecoding = FALSE;
-			return TRUE;
+			if (image->comps[i].factor != reduce)
+			{
+				// if we didn't get the discard level we're expecting, fail
+				opj_image_destroy(image);
+				base.mDecoding = FALSE;
+				return TRUE;
+			}
 		}
+
+		mDecodedImage = image;
+		mDecodedData = base.getData();
+		mDecodedSize = base.getDataSize();
+		mDecodedReduce = reduce;
 	}
 	
 	if(image->numcomps <= first_channel)
 	{
 		llwarns << "trying to decode more channels than are present in image: numcomps: " << image->numcomps << " first_channel: " << first_channel << llendl;
-		if (image)
-		{
-			opj_image_destroy(image);
-		}
+		resetDecodeState();
 			
 		return TRUE;
 	}
@@ -237,14 +271,17 @@ BOOL LLImageJ2COJ::decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decod
 		else // Some rare OpenJPEG versions have this bug.
 		{
 			LL_DEBUGS("Texture") << "ERROR -> decodeImpl: failed to decode image! (NULL comp data - OpenJPEG bug)" << LL_ENDL;
-			opj_image_destroy(image);
+			resetDecodeState();
 
 			return TRUE; // done
 		}
 	}
 
-	/* free image data structure */
-	opj_image_destroy(image);
+	if (first_channel + channels >= img_components)
+	{
+		// Every component has been handed out, don't hold on to the samples
+		resetDecodeState();
+	}
 
 	return TRUE; // done
 }
@@ -29,6 +29,8 @@
 
 #include "llimagej2c.h"
 
+struct opj_image;
+
 class LLImageJ2COJ : public LLImageJ2CImpl
 {	
 public:
@@ -40,11 +42,21 @@ protected:
 	/*virtual*/ BOOL decodeImpl(LLImageJ2C &base, LLImageRaw &raw_image, F32 decode_time, S32 first_channel, S32 max_channel_count);
 	/*virtual*/ BOOL encodeImpl(LLImageJ2C &base, const LLImageRaw &raw_image, const char* comment_text, F32 encode_time=0.0,
 								BOOL reversible = FALSE);
+	/*virtual*/ void resetDecodeState();
 	int ceildivpow2(int a, int b)
 	{
 		// Divide a by b to the power of 2 and round upwards.
 		return (a + (1 << b) - 1) >> b;
 	}
+
+private:
+	// Samples of the last decode, kept until every component has been
+	// copied out or the decode request is done, so the aux channel pass
+	// doesn't run the codec again.
+	struct opj_image* mDecodedImage;
+	const U8* mDecodedData;	// Stream the samples came from
+	S32 mDecodedSize;
+	S32 mDecodedReduce;
 };
 
 #endif
@@ -28,6 +28,7 @@
 
 #include <set>
 
+#include "llapr.h"
 #include "llerror.h"
 #include "llmemtype.h"
 
@@ -40,6 +41,7 @@
 #include "lldarray.h"
 #include "llvolume.h"
 #include "llstl.h"
+#include "llv4math.h"
 
 #define DEBUG_SILHOUETTE_BINORMALS 0
 #define DEBUG_SILHOUETTE_NORMALS 0 // TomY: Use this to display normals using the silhouette
@@ -82,6 +84,57 @@ const S32 SCULPT_MIN_AREA_DETAIL = 1;
 
 #define GEN_TRI_STRIP 0
 
+// Room past the last vertex for the SSE loops to read (and, while building
+// normals, write) a whole register
+const S32 VERTEX_STREAM_SLACK = 4;
+
+#if LL_VECTORIZE
+// Stores four vertices held as x, y and z registers as four packed LLVector3s
+inline void store_vec3x4(F32* dst, const __m128& x, const __m128& y, const __m128& z)
+{
+	__m128 xy01 = _mm_unpacklo_ps(x, y);							// x0 y0 x1 y1
+	__m128 xy23 = _mm_unpackhi_ps(x, y);							// x2 y2 x3 y3
+	__m128 zx = _mm_shuffle_ps(z, xy01, _MM_SHUFFLE(2,2,0,0));		// z0 z0 x1 x1
+	__m128 yz = _mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1,1,3,3));		// y1 y1 z1 z1
+	__m128 zx2 = _mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2,2,2,2));		// z2 z2 x3 x3
+	__m128 yz3 = _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3,3,3,3));		// y3 y3 z3 z3
+	_mm_storeu_ps(dst, _mm_shuffle_ps(xy01, zx, _MM_SHUFFLE(2,0,1,0)));		// x0 y0 z0 x1
+	_mm_storeu_ps(dst + 4, _mm_shuffle_ps(yz, xy23, _MM_SHUFFLE(1,0,2,0)));	// y1 z1 x2 y2
+	_mm_storeu_ps(dst + 8, _mm_shuffle_ps(zx2, yz3, _MM_SHUFFLE(2,0,2,0)));	// z2 x3 y3 z3
+}
+
+// Same for a strider that isn't packed
+inline void store_vec3x4(LLStrider<LLVector3>& dst, const __m128& x, const __m128& y, const __m128& z)
+{
+	if (dst.getSkip() == sizeof(LLVector3))
+	{
+		store_vec3x4(dst.get()->mV, x, y, z);
+		dst += 4;
+	}
+	else
+	{
+		F32 tmp[3][4];
+		_mm_storeu_ps(tmp[0], x);
+		_mm_storeu_ps(tmp[1], y);
+		_mm_storeu_ps(tmp[2], z);
+		for (S32 i = 0; i < 4; i++)
+		{
+			(dst++)->setVec(tmp[0][i], tmp[1][i], tmp[2][i]);
+		}
+	}
+}
+
+// a x b for four vectors at once
+inline void cross4(const __m128& ax, const __m128& ay, const __m128& az,
+				   const __m128& bx, const __m128& by, const __m128& bz,
+				   __m128& rx, __m128& ry, __m128& rz)
+{
+	rx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+	ry = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+	rz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+}
+#endif
+
 BOOL check_same_clock_dir( const LLVector3& pt1, const LLVector3& pt2, const LLVector3& pt3, const LLVector3& norm)
 {    
 	LLVector3 test = (pt2-pt1)%(pt3-pt2);
@@ -1658,10 +1711,13 @@ LLProfile::~LLProfile()
 }
 
 
-S32 LLVolume::sNumMeshPoints = 0;
+// Volumes are built on LLVolumeMgr's build thread too
+static LLAtomicS32 sNumMeshPoints(0);
 
-LLVolume::LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL generate_single_face, const BOOL is_unique)
-	: mParams(params)
+LLVolume::LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL generate_single_face, const BOOL is_unique,
+				   const BOOL defer_build)
+	: mParams(params),
+	  mBuildState(BUILD_DEFERRED)
 {
 	LLMemType m1(LLMemType::MTYPE_VOLUME);
 	
@@ -1683,11 +1739,35 @@ LLVolume::LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL ge
 
 	mGenerateSingleFace = generate_single_face;
 
+	if (!defer_build)
+	{
+		build();
+	}
+}
+
+void LLVolume::build()
+{
 	generate();
-	if (mParams.getSculptID().isNull() && params.getSculptType() == LL_SCULPT_TYPE_NONE)
+	if (mParams.getSculptID().isNull() && mParams.getSculptType() == LL_SCULPT_TYPE_NONE)
 	{
 		createVolumeFaces();
 	}
+	setBuildState(BUILD_DONE);
+}
+
+BOOL LLVolume::isBuilt() const
+{
+	return getBuildState() == BUILD_DONE;
+}
+
+U32 LLVolume::getBuildState() const
+{
+	return apr_atomic_read32(const_cast<volatile apr_uint32_t*>(&mBuildState));
+}
+
+void LLVolume::setBuildState(U32 state)
+{
+	apr_atomic_set32(&mBuildState, state);
 }
 
 void LLVolume::resizePath(S32 length)
@@ -1721,6 +1801,37 @@ LLVolume::~LLVolume()
 	mVolumeFaces.clear();
 }
 
+// Sweeps count profile points, split into x and y, out along the path:
+// dst[i] = x[i] * row_x + y[i] * row_y + offset, where the rows are the
+// path point's scaled rotation
+static void sweep_profile(const F32* x, const F32* y, S32 count,
+						  const LLVector3& row_x, const LLVector3& row_y, const LLVector3& offset,
+						  LLVolume::Point* dst)
+{
+	S32 i = 0;
+#if LL_VECTORIZE
+	if (sizeof(LLVolume::Point) == sizeof(LLVector3))
+	{
+		const __m128 rxx = _mm_set1_ps(row_x.mV[VX]), rxy = _mm_set1_ps(row_x.mV[VY]), rxz = _mm_set1_ps(row_x.mV[VZ]);
+		const __m128 ryx = _mm_set1_ps(row_y.mV[VX]), ryy = _mm_set1_ps(row_y.mV[VY]), ryz = _mm_set1_ps(row_y.mV[VZ]);
+		const __m128 ox = _mm_set1_ps(offset.mV[VX]), oy = _mm_set1_ps(offset.mV[VY]), oz = _mm_set1_ps(offset.mV[VZ]);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 px = _mm_loadu_ps(x + i);
+			__m128 py = _mm_loadu_ps(y + i);
+			store_vec3x4(dst[i].mPos.mV,
+						 _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, rxx), _mm_mul_ps(py, ryx)), ox),
+						 _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, rxy), _mm_mul_ps(py, ryy)), oy),
+						 _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, rxz), _mm_mul_ps(py, ryz)), oz));
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		dst[i].mPos = x[i] * row_x + y[i] * row_y + offset;
+	}
+}
+
 BOOL LLVolume::generate()
 {
 	LLMemType m1(LLMemType::MTYPE_VOLUME);
@@ -1803,24 +1914,25 @@ BOOL LLVolume::generate()
 
 		//generate vertex positions
 
+		// The profile split into x and y, its z is a texture coordinate
+		std::vector<F32> profile_x(sizeT);
+		std::vector<F32> profile_y(sizeT);
+		for (S32 t = 0; t < sizeT; ++t)
+		{
+			profile_x[t] = mProfilep->mProfile[t].mV[VX];
+			profile_y[t] = mProfilep->mProfile[t].mV[VY];
+		}
+
 		// Run along the path.
 		for (S32 s = 0; s < sizeS; ++s)
 		{
-			LLVector2  scale = mPathp->mPath[s].mScale;
-			LLQuaternion rot = mPathp->mPath[s].mRot;
+			const LLPath::PathPt& path_pt = mPathp->mPath[s];
 
 			// Run along the profile.
-			for (S32 t = 0; t < sizeT; ++t)
-			{
-				S32 m = s*sizeT + t;
-				Point& pt = mMesh[m];
-				
-				pt.mPos.mV[0] = mProfilep->mProfile[t].mV[0] * scale.mV[0];
-				pt.mPos.mV[1] = mProfilep->mProfile[t].mV[1] * scale.mV[1];
-				pt.mPos.mV[2] = 0.0f;
-				pt.mPos       = pt.mPos * rot;
-				pt.mPos      += mPathp->mPath[s].mPos;
-			}
+			sweep_profile(&profile_x[0], &profile_y[0], sizeT,
+						  LLVector3(path_pt.mScale.mV[VX], 0.f, 0.f) * path_pt.mRot,
+						  LLVector3(0.f, path_pt.mScale.mV[VY], 0.f) * path_pt.mRot,
+						  path_pt.mPos, &mMesh[s*sizeT]);
 		}
 
 		for (std::vector<LLProfile::Face>::iterator iter = mProfilep->mFaces.begin();
@@ -3420,9 +3532,9 @@ void LLVolume::generateSilhouetteVertices(std::vector<LLVector3> &vertices,
 				S32 v3 = face.mIndices[j*3+2];
 
 				//get current face center
-				LLVector3 cCenter = (face.mVertices[v1].mPosition + 
-									face.mVertices[v2].mPosition + 
-									face.mVertices[v3].mPosition) / 3.0f;
+				LLVector3 cCenter = (face.getPosition(v1) + 
+									face.getPosition(v2) + 
+									face.getPosition(v3)) / 3.0f;
 
 				//for each edge
 				for (S32 k = 0; k < 3; k++) {
@@ -3440,9 +3552,9 @@ void LLVolume::generateSilhouetteVertices(std::vector<LLVector3> &vertices,
 					v3 = face.mIndices[nIndex*3+2];
 
 					//get neighbor face center
-					LLVector3 nCenter = (face.mVertices[v1].mPosition + 
-									face.mVertices[v2].mPosition + 
-									face.mVertices[v3].mPosition) / 3.0f;
+					LLVector3 nCenter = (face.getPosition(v1) + 
+									face.getPosition(v2) + 
+									face.getPosition(v3)) / 3.0f;
 
 					//draw line
 					vertices.push_back(cCenter);
@@ -3465,15 +3577,15 @@ void LLVolume::generateSilhouetteVertices(std::vector<LLVector3> &vertices,
 #elif DEBUG_SILHOUETTE_NORMALS
 
 			//for each vertex
-			for (U32 j = 0; j < face.mVertices.size(); j++) {
-				vertices.push_back(face.mVertices[j].mPosition);
-				vertices.push_back(face.mVertices[j].mPosition + face.mVertices[j].mNormal*0.1f);
+			for (S32 j = 0; j < face.getNumVertices(); j++) {
+				vertices.push_back(face.getPosition(j));
+				vertices.push_back(face.getPosition(j) + face.getNormal(j)*0.1f);
 				normals.push_back(LLVector3(0,0,1));
 				normals.push_back(LLVector3(0,0,1));
 				segments.push_back(vertices.size());
 #if DEBUG_SILHOUETTE_BINORMALS
-				vertices.push_back(face.mVertices[j].mPosition);
-				vertices.push_back(face.mVertices[j].mPosition + face.mVertices[j].mBinormal*0.1f);
+				vertices.push_back(face.getPosition(j));
+				vertices.push_back(face.getPosition(j) + face.getBinormal(j)*0.1f);
 				normals.push_back(LLVector3(0,0,1));
 				normals.push_back(LLVector3(0,0,1));
 				segments.push_back(vertices.size());
@@ -3499,8 +3611,8 @@ void LLVolume::generateSilhouetteVertices(std::vector<LLVector3> &vertices,
 				S32 v2 = face.mIndices[j*3+1];
 				S32 v3 = face.mIndices[j*3+2];
 
-				LLVector3 norm = (face.mVertices[v1].mPosition - face.mVertices[v2].mPosition) % 
-					(face.mVertices[v2].mPosition - face.mVertices[v3].mPosition);
+				LLVector3 norm = (face.getPosition(v1) - face.getPosition(v2)) % 
+					(face.getPosition(v2) - face.getPosition(v3));
 				
 				if (norm.magVecSquared() < 0.00000001f) 
 				{
@@ -3509,7 +3621,7 @@ void LLVolume::generateSilhouetteVertices(std::vector<LLVector3> &vertices,
 				else 
 				{
 					//get view vector
-					LLVector3 view = (obj_cam_vec-face.mVertices[v1].mPosition);
+					LLVector3 view = (obj_cam_vec-face.getPosition(v1));
 					bool away = view * norm > 0.0f; 
 					if (away) 
 					{
@@ -3556,13 +3668,13 @@ void LLVolume::generateSilhouetteVertices(std::vector<LLVector3> &vertices,
 						S32 v1 = face.mIndices[j*3+k];
 						S32 v2 = face.mIndices[j*3+((k+1)%3)];
 						
-						vertices.push_back(face.mVertices[v1].mPosition*mat);
-						LLVector3 norm1 = face.mVertices[v1].mNormal * norm_mat;
+						vertices.push_back(face.getPosition(v1)*mat);
+						LLVector3 norm1 = face.getNormal(v1) * norm_mat;
 						norm1.normVec();
 						normals.push_back(norm1);
 
-						vertices.push_back(face.mVertices[v2].mPosition*mat);
-						LLVector3 norm2 = face.mVertices[v2].mNormal * norm_mat;
+						vertices.push_back(face.getPosition(v2)*mat);
+						LLVector3 norm2 = face.getNormal(v2) * norm_mat;
 						norm2.normVec();
 						normals.push_back(norm2);
 
@@ -3621,9 +3733,9 @@ S32 LLVolume::lineSegmentIntersect(const LLVector3& start, const LLVector3& end,
 
 				F32 a, b, t;
 			
-				if (LLTriangleRayIntersect(face.mVertices[index1].mPosition,
-										   face.mVertices[index2].mPosition,
-										   face.mVertices[index3].mPosition,
+				if (LLTriangleRayIntersect(face.getPosition(index1),
+										   face.getPosition(index2),
+										   face.getPosition(index3),
 										   start, dir, &a, &b, &t, FALSE))
 				{
 					if ((t >= 0.f) &&      // if hit is after start
@@ -3640,24 +3752,24 @@ S32 LLVolume::lineSegmentIntersect(const LLVector3& start, const LLVector3& end,
 			
 						if (tex_coord != NULL)
 			{
-							*tex_coord = ((1.f - a - b)  * face.mVertices[index1].mTexCoord +
-										  a              * face.mVertices[index2].mTexCoord +
-										  b              * face.mVertices[index3].mTexCoord);
+							*tex_coord = ((1.f - a - b)  * face.getTexCoord(index1) +
+										  a              * face.getTexCoord(index2) +
+										  b              * face.getTexCoord(index3));
 
 						}
 
 						if (normal != NULL)
 				{
-							*normal    = ((1.f - a - b)  * face.mVertices[index1].mNormal + 
-										  a              * face.mVertices[index2].mNormal +
-										  b              * face.mVertices[index3].mNormal);
+							*normal    = ((1.f - a - b)  * face.getNormal(index1) + 
+										  a              * face.getNormal(index2) +
+										  b              * face.getNormal(index3));
 						}
 
 						if (bi_normal != NULL)
 					{
-							*bi_normal = ((1.f - a - b)  * face.mVertices[index1].mBinormal + 
-										  a              * face.mVertices[index2].mBinormal +
-										  b              * face.mVertices[index3].mBinormal);
+							*bi_normal = ((1.f - a - b)  * face.getBinormal(index1) + 
+										  a              * face.getBinormal(index2) +
+										  b              * face.getBinormal(index3));
 						}
 
 					}
@@ -4404,6 +4516,441 @@ std::ostream& operator<<(std::ostream &s, const LLVolume *volumep)
 }
 
 
+//-----------------------------------------------------------------------------
+// LLVolumeFace vertex streams
+//-----------------------------------------------------------------------------
+
+// Allocates num_streams zeroed streams of capacity floats, all 16 byte
+// aligned. Returns the block to delete[] later.
+static U8* allocate_vertex_streams(S32 num_streams, S32 capacity, F32** streams)
+{
+	S32 bytes = num_streams * capacity * sizeof(F32);
+	U8* data = new U8[bytes + 15];
+	F32* aligned = (F32*)(((size_t)data + 15) & ~(size_t)15);
+	memset(aligned, 0, bytes);
+	for (S32 i = 0; i < num_streams; i++)
+	{
+		streams[i] = aligned + i * capacity;
+	}
+	return data;
+}
+
+LLVolumeFace::LLVolumeFace() : 
+	mID(0),
+	mTypeMask(0),
+	mHasBinormals(FALSE),
+	mBeginS(0),
+	mBeginT(0),
+	mNumS(0),
+	mNumT(0),
+	mNumVertices(0),
+	mVertexCapacity(0),
+	mVertexData(NULL),
+	mBinormalData(NULL)
+{
+	for (S32 i = 0; i < NUM_STREAMS; i++)
+	{
+		mStreams[i] = NULL;
+	}
+}
+
+LLVolumeFace::LLVolumeFace(const LLVolumeFace& src) :
+	mNumVertices(0),
+	mVertexCapacity(0),
+	mVertexData(NULL),
+	mBinormalData(NULL)
+{
+	for (S32 i = 0; i < NUM_STREAMS; i++)
+	{
+		mStreams[i] = NULL;
+	}
+	*this = src;
+}
+
+LLVolumeFace::~LLVolumeFace()
+{
+	freeVertices();
+}
+
+LLVolumeFace& LLVolumeFace::operator=(const LLVolumeFace& src)
+{
+	if (this != &src)
+	{
+		mID = src.mID;
+		mTypeMask = src.mTypeMask;
+		mCenter = src.mCenter;
+		mHasBinormals = src.mHasBinormals;
+		mBeginS = src.mBeginS;
+		mBeginT = src.mBeginT;
+		mNumS = src.mNumS;
+		mNumT = src.mNumT;
+		mExtents[0] = src.mExtents[0];
+		mExtents[1] = src.mExtents[1];
+		mIndices = src.mIndices;
+		mTriStrip = src.mTriStrip;
+		mEdge = src.mEdge;
+		copyVertices(src);
+	}
+	return *this;
+}
+
+void LLVolumeFace::freeVertices()
+{
+	delete [] mVertexData;
+	mVertexData = NULL;
+	delete [] mBinormalData;
+	mBinormalData = NULL;
+	for (S32 i = 0; i < NUM_STREAMS; i++)
+	{
+		mStreams[i] = NULL;
+	}
+	mNumVertices = 0;
+	mVertexCapacity = 0;
+}
+
+void LLVolumeFace::copyVertices(const LLVolumeFace& src)
+{
+	if (!src.mBinormalData && mBinormalData)
+	{
+		delete [] mBinormalData;
+		mBinormalData = NULL;
+		mStreams[BINORMAL_X] = mStreams[BINORMAL_Y] = mStreams[BINORMAL_Z] = NULL;
+	}
+	resizeVertices(src.mNumVertices);
+	if (src.mBinormalData)
+	{
+		allocateBinormals();
+	}
+	for (S32 i = 0; i < NUM_STREAMS; i++)
+	{
+		if (src.mStreams[i])
+		{
+			memcpy(mStreams[i], src.mStreams[i], mNumVertices * sizeof(F32));
+		}
+	}
+}
+
+void LLVolumeFace::resizeVertices(S32 num_vertices)
+{
+	if (num_vertices + VERTEX_STREAM_SLACK > mVertexCapacity)
+	{
+		LLMemType m1(LLMemType::MTYPE_VOLUME);
+
+		// Caps grow a vertex at a time
+		S32 capacity = llmax(num_vertices, mVertexCapacity + mVertexCapacity / 2) + VERTEX_STREAM_SLACK;
+		capacity = (capacity + 3) & ~3;
+
+		F32* streams[NUM_STREAMS];
+		U8* data = allocate_vertex_streams(NUM_BASE_STREAMS, capacity, streams);
+		U8* binormal_data = NULL;
+		if (mBinormalData)
+		{
+			binormal_data = allocate_vertex_streams(NUM_STREAMS - NUM_BASE_STREAMS, capacity, streams + BINORMAL_X);
+		}
+		else
+		{
+			streams[BINORMAL_X] = streams[BINORMAL_Y] = streams[BINORMAL_Z] = NULL;
+		}
+
+		S32 keep = llmin(mNumVertices, num_vertices);
+		for (S32 i = 0; i < NUM_STREAMS; i++)
+		{
+			if (mStreams[i])
+			{
+				memcpy(streams[i], mStreams[i], keep * sizeof(F32));
+			}
+			mStreams[i] = streams[i];
+		}
+
+		delete [] mVertexData;
+		delete [] mBinormalData;
+		mVertexData = data;
+		mBinormalData = binormal_data;
+		mVertexCapacity = capacity;
+	}
+	else if (num_vertices < mNumVertices)
+	{
+		// New vertices have to come back as zeroes
+		for (S32 i = 0; i < NUM_STREAMS; i++)
+		{
+			if (mStreams[i])
+			{
+				memset(mStreams[i] + num_vertices, 0, (mNumVertices - num_vertices) * sizeof(F32));
+			}
+		}
+	}
+	mNumVertices = num_vertices;
+}
+
+void LLVolumeFace::allocateBinormals()
+{
+	if (!mBinormalData)
+	{
+		LLMemType m1(LLMemType::MTYPE_VOLUME);
+		mBinormalData = allocate_vertex_streams(NUM_STREAMS - NUM_BASE_STREAMS, mVertexCapacity, mStreams + BINORMAL_X);
+	}
+}
+
+void LLVolumeFace::pushVertex(const VertexData& vertex)
+{
+	resizeVertices(mNumVertices + 1);
+	setVertex(mNumVertices - 1, vertex);
+}
+
+void LLVolumeFace::setVertex(S32 i, const VertexData& vertex)
+{
+	setPosition(i, vertex.mPosition);
+	setNormal(i, vertex.mNormal);
+	setTexCoord(i, vertex.mTexCoord);
+	if (mBinormalData || !vertex.mBinormal.isExactlyZero())
+	{
+		setBinormal(i, vertex.mBinormal);
+	}
+}
+
+S32 LLVolumeFace::getVertexDataSize() const
+{
+	S32 num_streams = mBinormalData ? NUM_STREAMS : NUM_BASE_STREAMS;
+	return num_streams * mVertexCapacity * sizeof(F32);
+}
+
+void LLVolumeFace::getTransformedPositions(const LLMatrix4& mat, LLStrider<LLVector3> dst) const
+{
+	const F32* x = mStreams[POSITION_X];
+	const F32* y = mStreams[POSITION_Y];
+	const F32* z = mStreams[POSITION_Z];
+	S32 i = 0;
+
+#if LL_VECTORIZE
+	// Row vector times matrix, four vertices at a time
+	const __m128 m00 = _mm_set1_ps(mat.mMatrix[VX][VX]), m01 = _mm_set1_ps(mat.mMatrix[VX][VY]), m02 = _mm_set1_ps(mat.mMatrix[VX][VZ]);
+	const __m128 m10 = _mm_set1_ps(mat.mMatrix[VY][VX]), m11 = _mm_set1_ps(mat.mMatrix[VY][VY]), m12 = _mm_set1_ps(mat.mMatrix[VY][VZ]);
+	const __m128 m20 = _mm_set1_ps(mat.mMatrix[VZ][VX]), m21 = _mm_set1_ps(mat.mMatrix[VZ][VY]), m22 = _mm_set1_ps(mat.mMatrix[VZ][VZ]);
+	const __m128 m30 = _mm_set1_ps(mat.mMatrix[VW][VX]), m31 = _mm_set1_ps(mat.mMatrix[VW][VY]), m32 = _mm_set1_ps(mat.mMatrix[VW][VZ]);
+	for (; i + 4 <= mNumVertices; i += 4)
+	{
+		__m128 vx = _mm_load_ps(x + i);
+		__m128 vy = _mm_load_ps(y + i);
+		__m128 vz = _mm_load_ps(z + i);
+		__m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m00), _mm_mul_ps(vy, m10)), _mm_add_ps(_mm_mul_ps(vz, m20), m30));
+		__m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m01), _mm_mul_ps(vy, m11)), _mm_add_ps(_mm_mul_ps(vz, m21), m31));
+		__m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m02), _mm_mul_ps(vy, m12)), _mm_add_ps(_mm_mul_ps(vz, m22), m32));
+		store_vec3x4(dst, ox, oy, oz);
+	}
+#endif
+
+	for (; i < mNumVertices; i++)
+	{
+		*dst++ = LLVector3(x[i], y[i], z[i]) * mat;
+	}
+}
+
+void LLVolumeFace::getTransformedNormals(const LLMatrix3& norm_mat, LLStrider<LLVector3> dst, BOOL binormals) const
+{
+	S32 first = binormals ? BINORMAL_X : NORMAL_X;
+	if (!mStreams[first])
+	{
+		for (S32 i = 0; i < mNumVertices; i++)
+		{
+			*dst++ = LLVector3::zero;
+		}
+		return;
+	}
+
+	const F32* x = mStreams[first];
+	const F32* y = mStreams[first + 1];
+	const F32* z = mStreams[first + 2];
+	S32 i = 0;
+
+#if LL_VECTORIZE
+	const __m128 m00 = _mm_set1_ps(norm_mat.mMatrix[VX][VX]), m01 = _mm_set1_ps(norm_mat.mMatrix[VX][VY]), m02 = _mm_set1_ps(norm_mat.mMatrix[VX][VZ]);
+	const __m128 m10 = _mm_set1_ps(norm_mat.mMatrix[VY][VX]), m11 = _mm_set1_ps(norm_mat.mMatrix[VY][VY]), m12 = _mm_set1_ps(norm_mat.mMatrix[VY][VZ]);
+	const __m128 m20 = _mm_set1_ps(norm_mat.mMatrix[VZ][VX]), m21 = _mm_set1_ps(norm_mat.mMatrix[VZ][VY]), m22 = _mm_set1_ps(norm_mat.mMatrix[VZ][VZ]);
+	const __m128 threshold = _mm_set1_ps(FP_MAG_THRESHOLD);
+	const __m128 one = _mm_set1_ps(1.f);
+	for (; i + 4 <= mNumVertices; i += 4)
+	{
+		__m128 vx = _mm_load_ps(x + i);
+		__m128 vy = _mm_load_ps(y + i);
+		__m128 vz = _mm_load_ps(z + i);
+		__m128 ox = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m00), _mm_mul_ps(vy, m10)), _mm_mul_ps(vz, m20));
+		__m128 oy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m01), _mm_mul_ps(vy, m11)), _mm_mul_ps(vz, m21));
+		__m128 oz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m02), _mm_mul_ps(vy, m12)), _mm_mul_ps(vz, m22));
+
+		// Same as LLVector3::normVec(): too short to normalize comes out as zero
+		__m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+		__m128 oomag = _mm_and_ps(_mm_div_ps(one, mag), _mm_cmpgt_ps(mag, threshold));
+		store_vec3x4(dst, _mm_mul_ps(ox, oomag), _mm_mul_ps(oy, oomag), _mm_mul_ps(oz, oomag));
+	}
+#endif
+
+	for (; i < mNumVertices; i++)
+	{
+		LLVector3 normal = LLVector3(x[i], y[i], z[i]) * norm_mat;
+		normal.normVec();
+		*dst++ = normal;
+	}
+}
+
+void LLVolumeFace::createSideNormals()
+{
+	// Each quad of the grid is split into the triangles (bl, tr, tl) and
+	// (bl, br, tr), see the indices in createSide(). A vertex gets the sum
+	// of the normals of the triangles around it, counting the ones it is
+	// the top right corner of twice to even out the quad. Working that out
+	// per vertex from the grid instead of walking mIndices lets us do four
+	// vertices at a time.
+	S32 quads_s = mNumS - 1;
+	S32 quads_t = mNumT - 1;
+	if (quads_s <= 0 || quads_t <= 0)
+	{
+		for (S32 i = NORMAL_X; i <= NORMAL_Z; i++)
+		{
+			memset(mStreams[i], 0, mNumVertices * sizeof(F32));
+		}
+		return;
+	}
+
+	// Triangle normals a and b of quad (s, t) go in row t+1, column s+1 of
+	// these, so the quads around every vertex are there with a border of
+	// zeroes instead of range checks
+	const S32 width = mNumS + 1;
+	const S32 stride = (mNumT + 1) * width + VERTEX_STREAM_SLACK;
+	std::vector<F32> quad_normals(stride * 6, 0.f);
+	F32* ax = &quad_normals[0];
+	F32* ay = ax + stride;
+	F32* az = ay + stride;
+	F32* bx = az + stride;
+	F32* by = bx + stride;
+	F32* bz = by + stride;
+
+	const F32* px = mStreams[POSITION_X];
+	const F32* py = mStreams[POSITION_Y];
+	const F32* pz = mStreams[POSITION_Z];
+
+	for (S32 t = 0; t < quads_t; t++)
+	{
+		S32 s = 0;
+		S32 row = mNumS * t;
+		S32 quad = (t + 1) * width + 1;
+#if LL_VECTORIZE
+		// The last block may run past the end of the row, that is cleaned
+		// up below
+		for (; s < quads_s; s += 4)
+		{
+			S32 bl = row + s;
+			S32 tl = bl + mNumS;
+			__m128 blx = _mm_loadu_ps(px + bl), bly = _mm_loadu_ps(py + bl), blz = _mm_loadu_ps(pz + bl);
+			__m128 brx = _mm_loadu_ps(px + bl + 1), bry = _mm_loadu_ps(py + bl + 1), brz = _mm_loadu_ps(pz + bl + 1);
+			__m128 tlx = _mm_loadu_ps(px + tl), tly = _mm_loadu_ps(py + tl), tlz = _mm_loadu_ps(pz + tl);
+			__m128 trx = _mm_loadu_ps(px + tl + 1), tr_y = _mm_loadu_ps(py + tl + 1), trz = _mm_loadu_ps(pz + tl + 1);
+
+			// bl - tr is shared by both triangles
+			__m128 dx = _mm_sub_ps(blx, trx), dy = _mm_sub_ps(bly, tr_y), dz = _mm_sub_ps(blz, trz);
+			__m128 rx, ry, rz;
+			cross4(dx, dy, dz, _mm_sub_ps(blx, tlx), _mm_sub_ps(bly, tly), _mm_sub_ps(blz, tlz), rx, ry, rz);
+			_mm_storeu_ps(ax + quad + s, rx);
+			_mm_storeu_ps(ay + quad + s, ry);
+			_mm_storeu_ps(az + quad + s, rz);
+			cross4(_mm_sub_ps(blx, brx), _mm_sub_ps(bly, bry), _mm_sub_ps(blz, brz), dx, dy, dz, rx, ry, rz);
+			_mm_storeu_ps(bx + quad + s, rx);
+			_mm_storeu_ps(by + quad + s, ry);
+			_mm_storeu_ps(bz + quad + s, rz);
+		}
+#else
+		for (; s < quads_s; s++)
+		{
+			S32 bl = row + s;
+			S32 tl = bl + mNumS;
+			LLVector3 p_bl(px[bl], py[bl], pz[bl]);
+			LLVector3 p_br(px[bl + 1], py[bl + 1], pz[bl + 1]);
+			LLVector3 p_tl(px[tl], py[tl], pz[tl]);
+			LLVector3 p_tr(px[tl + 1], py[tl + 1], pz[tl + 1]);
+			LLVector3 a = (p_bl - p_tr) % (p_bl - p_tl);
+			LLVector3 b = (p_bl - p_br) % (p_bl - p_tr);
+			ax[quad + s] = a.mV[VX];
+			ay[quad + s] = a.mV[VY];
+			az[quad + s] = a.mV[VZ];
+			bx[quad + s] = b.mV[VX];
+			by[quad + s] = b.mV[VY];
+			bz[quad + s] = b.mV[VZ];
+		}
+#endif
+	}
+
+#if LL_VECTORIZE
+	// Put the border back where the last blocks ran over it
+	for (S32 t = 1; t <= mNumT; t++)
+	{
+		for (S32 j = 0; j < 6; j++)
+		{
+			F32* quads = &quad_normals[j * stride];
+			quads[t * width] = 0.f;
+			if (t < mNumT)
+			{
+				quads[t * width + mNumS] = 0.f;
+			}
+			else
+			{
+				memset(quads + t * width, 0, (width + VERTEX_STREAM_SLACK) * sizeof(F32));
+			}
+		}
+	}
+#endif
+
+	F32* nx = mStreams[NORMAL_X];
+	F32* ny = mStreams[NORMAL_Y];
+	F32* nz = mStreams[NORMAL_Z];
+	for (S32 t = 0; t < mNumT; t++)
+	{
+		S32 s = 0;
+		S32 row = mNumS * t;
+		// Quads that have this vertex as their bottom left, bottom right,
+		// top left and top right corner
+		S32 q_bl = (t + 1) * width + 1;
+		S32 q_br = q_bl - 1;
+		S32 q_tl = q_bl - width;
+		S32 q_tr = q_tl - 1;
+#if LL_VECTORIZE
+		// Runs past the end of the row into the next one, which gets
+		// written over after, or the slack
+		const __m128 two = _mm_set1_ps(2.f);
+		for (; s < mNumS; s += 4)
+		{
+			__m128 n[3];
+			const F32* a[3] = { ax, ay, az };
+			const F32* b[3] = { bx, by, bz };
+			for (S32 c = 0; c < 3; c++)
+			{
+				__m128 sum = _mm_add_ps(_mm_loadu_ps(a[c] + q_bl + s), _mm_loadu_ps(b[c] + q_bl + s));
+				sum = _mm_add_ps(sum, _mm_loadu_ps(b[c] + q_br + s));
+				sum = _mm_add_ps(sum, _mm_loadu_ps(a[c] + q_tl + s));
+				__m128 tr = _mm_add_ps(_mm_loadu_ps(a[c] + q_tr + s), _mm_loadu_ps(b[c] + q_tr + s));
+				n[c] = _mm_add_ps(sum, _mm_mul_ps(tr, two));
+			}
+			_mm_storeu_ps(nx + row + s, n[0]);
+			_mm_storeu_ps(ny + row + s, n[1]);
+			_mm_storeu_ps(nz + row + s, n[2]);
+		}
+#else
+		for (; s < mNumS; s++)
+		{
+			nx[row + s] = ax[q_bl + s] + bx[q_bl + s] + bx[q_br + s] + ax[q_tl + s] + 2.f * (ax[q_tr + s] + bx[q_tr + s]);
+			ny[row + s] = ay[q_bl + s] + by[q_bl + s] + by[q_br + s] + ay[q_tl + s] + 2.f * (ay[q_tr + s] + by[q_tr + s]);
+			nz[row + s] = az[q_bl + s] + bz[q_bl + s] + bz[q_br + s] + az[q_tl + s] + 2.f * (az[q_tr + s] + bz[q_tr + s]);
+		}
+#endif
+	}
+
+#if LL_VECTORIZE
+	// Whatever the last row left in the padding has to go
+	for (S32 i = NORMAL_X; i <= NORMAL_Z; i++)
+	{
+		memset(mStreams[i] + mNumVertices, 0, VERTEX_STREAM_SLACK * sizeof(F32));
+	}
+#endif
+}
+
 BOOL LLVolumeFace::create(LLVolume* volume, BOOL partial_build)
 {
 	if (mTypeMask & CAP_MASK)
@@ -4495,10 +5042,10 @@ BOOL LLVolumeFace::createUnCutCubeCap(LLVolume* volume, BOOL partial_build)
 
 	if (partial_build)
 	{
-		mVertices.clear();
+		resizeVertices(0);
 	}
 
-	S32	vtop = mVertices.size();
+	S32	vtop = getNumVertices();
 	for(int gx = 0;gx<grid_size+1;gx++){
 		for(int gy = 0;gy<grid_size+1;gy++){
 			VertexData newVert;
@@ -4509,7 +5056,7 @@ BOOL LLVolumeFace::createUnCutCubeCap(LLVolume* volume, BOOL partial_build)
 				newVert,
 				(F32)gx/(F32)grid_size,
 				(F32)gy/(F32)grid_size);
-			mVertices.push_back(newVert);
+			pushVertex(newVert);
 
 			if (gx == 0 && gy == 0)
 			{
@@ -4623,7 +5170,7 @@ BOOL LLVolumeFace::createCap(LLVolume* volume, BOOL partial_build)
 	num_vertices = profile.size();
 	num_indices = (profile.size() - 2)*3;
 
-	mVertices.resize(num_vertices);
+	resizeVertices(num_vertices);
 
 	if (!partial_build)
 	{
@@ -4657,29 +5204,30 @@ BOOL LLVolumeFace::createCap(LLVolume* volume, BOOL partial_build)
 	// Copy the vertices into the array
 	for (S32 i = 0; i < num_vertices; i++)
 	{
+		LLVector2 tc;
 		if (mTypeMask & TOP_MASK)
 		{
-			mVertices[i].mTexCoord.mV[0] = profile[i].mV[0]+0.5f;
-			mVertices[i].mTexCoord.mV[1] = profile[i].mV[1]+0.5f;
+			tc.mV[0] = profile[i].mV[0]+0.5f;
+			tc.mV[1] = profile[i].mV[1]+0.5f;
 		}
 		else
 		{
 			// Mirror for underside.
-			mVertices[i].mTexCoord.mV[0] = profile[i].mV[0]+0.5f;
-			mVertices[i].mTexCoord.mV[1] = 0.5f - profile[i].mV[1];
+			tc.mV[0] = profile[i].mV[0]+0.5f;
+			tc.mV[1] = 0.5f - profile[i].mV[1];
 		}
-
-		mVertices[i].mPosition = mesh[i + offset].mPos;
+		setTexCoord(i, tc);
+		setPosition(i, mesh[i + offset].mPos);
 		
 		if (i == 0)
 		{
-			min = max = mVertices[i].mPosition;
-			min_uv = max_uv = mVertices[i].mTexCoord;
+			min = max = mesh[i + offset].mPos;
+			min_uv = max_uv = tc;
 		}
 		else
 		{
-			update_min_max(min,max, mVertices[i].mPosition);
-			update_min_max(min_uv, max_uv, mVertices[i].mTexCoord);
+			update_min_max(min,max, mesh[i + offset].mPos);
+			update_min_max(min_uv, max_uv, tc);
 		}
 	}
 
@@ -4688,16 +5236,16 @@ BOOL LLVolumeFace::createCap(LLVolume* volume, BOOL partial_build)
 
 	LLVector3 binormal = calc_binormal_from_triangle( 
 		mCenter, cuv,
-		mVertices[0].mPosition, mVertices[0].mTexCoord,
-		mVertices[1].mPosition, mVertices[1].mTexCoord);
+		getPosition(0), getTexCoord(0),
+		getPosition(1), getTexCoord(1));
 	binormal.normVec();
 
 	LLVector3 d0;
 	LLVector3 d1;
 	LLVector3 normal;
 
-	d0 = mCenter-mVertices[0].mPosition;
-	d1 = mCenter-mVertices[1].mPosition;
+	d0 = mCenter-getPosition(0);
+	d1 = mCenter-getPosition(1);
 
 	normal = (mTypeMask & TOP_MASK) ? (d0%d1) : (d1%d0);
 	normal.normVec();
@@ -4710,7 +5258,7 @@ BOOL LLVolumeFace::createCap(LLVolume* volume, BOOL partial_build)
 	
 	if (!(mTypeMask & HOLLOW_MASK) && !(mTypeMask & OPEN_MASK))
 	{
-		mVertices.push_back(vd);
+		pushVertex(vd);
 		num_vertices++;
 		if (!partial_build)
 		{
@@ -4721,8 +5269,8 @@ BOOL LLVolumeFace::createCap(LLVolume* volume, BOOL partial_build)
 	
 	for (S32 i = 0; i < num_vertices; i++)
 	{
-		mVertices[i].mBinormal = binormal;
-		mVertices[i].mNormal = normal;
+		setBinormal(i, binormal);
+		setNormal(i, normal);
 	}
 
 	mHasBinormals = TRUE;
@@ -5052,39 +5600,37 @@ void LLVolumeFace::createBinormals()
 	
 	if (!mHasBinormals)
 	{
+		allocateBinormals();
+
 		//generate binormals
 		for (U32 i = 0; i < mIndices.size()/3; i++) 
 		{	//for each triangle
-			const VertexData& v0 = mVertices[mIndices[i*3+0]];
-			const VertexData& v1 = mVertices[mIndices[i*3+1]];
-			const VertexData& v2 = mVertices[mIndices[i*3+2]];
+			const U16* idx = &(mIndices[i*3]);
 						
 			//calculate binormal
-			LLVector3 binorm = calc_binormal_from_triangle(v0.mPosition, v0.mTexCoord,
-															v1.mPosition, v1.mTexCoord,
-															v2.mPosition, v2.mTexCoord);
+			LLVector3 binorm = calc_binormal_from_triangle(getPosition(idx[0]), getTexCoord(idx[0]),
+															getPosition(idx[1]), getTexCoord(idx[1]),
+															getPosition(idx[2]), getTexCoord(idx[2]));
 
 			for (U32 j = 0; j < 3; j++) 
 			{ //add triangle normal to vertices
-				mVertices[mIndices[i*3+j]].mBinormal += binorm; // * (weight_sum - d[j])/weight_sum;
+				setBinormal(idx[j], getBinormal(idx[j]) + binorm); // * (weight_sum - d[j])/weight_sum;
 			}
 
 			//even out quad contributions
-			if (i % 2 == 0) 
-			{
-				mVertices[mIndices[i*3+2]].mBinormal += binorm;
-			}
-			else 
-			{
-				mVertices[mIndices[i*3+1]].mBinormal += binorm;
-			}
+			S32 v = (i % 2 == 0) ? idx[2] : idx[1];
+			setBinormal(v, getBinormal(v) + binorm);
 		}
 
 		//normalize binormals
-		for (U32 i = 0; i < mVertices.size(); i++) 
+		for (S32 i = 0; i < mNumVertices; i++) 
 		{
-			mVertices[i].mBinormal.normVec();
-			mVertices[i].mNormal.normVec();
+			LLVector3 binormal = getBinormal(i);
+			binormal.normVec();
+			setBinormal(i, binormal);
+			LLVector3 normal = getNormal(i);
+			normal.normVec();
+			setNormal(i, normal);
 		}
 
 		mHasBinormals = TRUE;
@@ -5117,7 +5663,16 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 	num_vertices = mNumS*mNumT;
 	num_indices = (mNumS-1)*(mNumT-1)*6;
 
-	mVertices.resize(num_vertices);
+	resizeVertices(num_vertices);
+	// Normals get written over below, binormals are summed up from zero
+	// again by createBinormals()
+	if (mStreams[BINORMAL_X])
+	{
+		for (S32 j = BINORMAL_X; j <= BINORMAL_Z; j++)
+		{
+			memset(mStreams[j], 0, num_vertices * sizeof(F32));
+		}
+	}
 
 	if (!partial_build)
 	{
@@ -5179,21 +5734,15 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 				i = mBeginS + s + max_s*t;
 			}
 
-			mVertices[cur_vertex].mPosition = mesh[i].mPos;
-			mVertices[cur_vertex].mTexCoord = LLVector2(ss,tt);
-		
-			mVertices[cur_vertex].mNormal = LLVector3(0,0,0);
-			mVertices[cur_vertex].mBinormal = LLVector3(0,0,0);
+			setPosition(cur_vertex, mesh[i].mPos);
+			setTexCoord(cur_vertex, LLVector2(ss,tt));
 
 			cur_vertex++;
 
 			if ((mTypeMask & INNER_MASK) && (mTypeMask & FLAT_MASK) && mNumS > 2 && s > 0)
 			{
-				mVertices[cur_vertex].mPosition = mesh[i].mPos;
-				mVertices[cur_vertex].mTexCoord = LLVector2(ss,tt);
-			
-				mVertices[cur_vertex].mNormal = LLVector3(0,0,0);
-				mVertices[cur_vertex].mBinormal = LLVector3(0,0,0);
+				setPosition(cur_vertex, mesh[i].mPos);
+				setTexCoord(cur_vertex, LLVector2(ss,tt));
 				cur_vertex++;
 			}
 		}
@@ -5211,11 +5760,8 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 
 			i = mBeginS + s + max_s*t;
 			ss = profile[mBeginS + s].mV[2] - begin_stex;
-			mVertices[cur_vertex].mPosition = mesh[i].mPos;
-			mVertices[cur_vertex].mTexCoord = LLVector2(ss,tt);
-		
-			mVertices[cur_vertex].mNormal = LLVector3(0,0,0);
-			mVertices[cur_vertex].mBinormal = LLVector3(0,0,0);
+			setPosition(cur_vertex, mesh[i].mPos);
+			setTexCoord(cur_vertex, LLVector2(ss,tt));
 
 			cur_vertex++;
 		}
@@ -5227,10 +5773,10 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 	LLVector3& face_max = mExtents[1];
 	mCenter.clearVec();
 
-	face_min = face_max = mVertices[0].mPosition;
-	for (U32 i = 1; i < mVertices.size(); ++i)
+	face_min = face_max = getPosition(0);
+	for (S32 i = 1; i < mNumVertices; ++i)
 	{
-		update_min_max(face_min, face_max, mVertices[i].mPosition);
+		update_min_max(face_min, face_max, getPosition(i));
 	}
 
 	mCenter = (face_min + face_max) * 0.5f;
@@ -5327,37 +5873,21 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 	}
 
 	//generate normals 
-	for (U32 i = 0; i < mIndices.size()/3; i++) //for each triangle
-	{
-		const U16* idx = &(mIndices[i*3]);
-			
-		VertexData* v[] = 
-		{	&mVertices[idx[0]], &mVertices[idx[1]], &mVertices[idx[2]] };
-					
-		//calculate triangle normal
-		LLVector3 norm = (v[0]->mPosition-v[1]->mPosition) % (v[0]->mPosition-v[2]->mPosition);
-
-		v[0]->mNormal += norm;
-		v[1]->mNormal += norm;
-		v[2]->mNormal += norm;
-
-		//even out quad contributions
-		v[i%2+1]->mNormal += norm;
-	}
+	createSideNormals();
 	
 	// adjust normals based on wrapping and stitching
 	
-	BOOL s_bottom_converges = ((mVertices[0].mPosition - mVertices[mNumS*(mNumT-2)].mPosition).magVecSquared() < 0.000001f);
-	BOOL s_top_converges = ((mVertices[mNumS-1].mPosition - mVertices[mNumS*(mNumT-2)+mNumS-1].mPosition).magVecSquared() < 0.000001f);
+	BOOL s_bottom_converges = ((getPosition(0) - getPosition(mNumS*(mNumT-2))).magVecSquared() < 0.000001f);
+	BOOL s_top_converges = ((getPosition(mNumS-1) - getPosition(mNumS*(mNumT-2)+mNumS-1)).magVecSquared() < 0.000001f);
 	if (sculpt_stitching == LL_SCULPT_TYPE_NONE)  // logic for non-sculpt volumes
 	{
 		if (volume->getPath().isOpen() == FALSE)
 		{ //wrap normals on T
 			for (S32 i = 0; i < mNumS; i++)
 			{
-				LLVector3 norm = mVertices[i].mNormal + mVertices[mNumS*(mNumT-1)+i].mNormal;
-				mVertices[i].mNormal = norm;
-				mVertices[mNumS*(mNumT-1)+i].mNormal = norm;
+				LLVector3 norm = getNormal(i) + getNormal(mNumS*(mNumT-1)+i);
+				setNormal(i, norm);
+				setNormal(mNumS*(mNumT-1)+i, norm);
 			}
 		}
 
@@ -5365,9 +5895,9 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 		{ //wrap normals on S
 			for (S32 i = 0; i < mNumT; i++)
 			{
-				LLVector3 norm = mVertices[mNumS*i].mNormal + mVertices[mNumS*i+mNumS-1].mNormal;
-				mVertices[mNumS * i].mNormal = norm;
-				mVertices[mNumS * i+mNumS-1].mNormal = norm;
+				LLVector3 norm = getNormal(mNumS*i) + getNormal(mNumS*i+mNumS-1);
+				setNormal(mNumS * i, norm);
+				setNormal(mNumS * i+mNumS-1, norm);
 			}
 		}
 	
@@ -5378,7 +5908,7 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 			{ //all lower S have same normal
 				for (S32 i = 0; i < mNumT; i++)
 				{
-					mVertices[mNumS*i].mNormal = LLVector3(1,0,0);
+					setNormal(mNumS*i, LLVector3(1,0,0));
 				}
 			}
 
@@ -5386,7 +5916,7 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 			{ //all upper S have same normal
 				for (S32 i = 0; i < mNumT; i++)
 				{
-					mVertices[mNumS*i+mNumS-1].mNormal = LLVector3(-1,0,0);
+					setNormal(mNumS*i+mNumS-1, LLVector3(-1,0,0));
 				}
 			}
 		}
@@ -5417,13 +5947,13 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 			LLVector3 average(0.0, 0.0, 0.0);
 			for (S32 i = 0; i < mNumS; i++)
 			{
-				average += mVertices[i].mNormal;
+				average += getNormal(i);
 			}
 
 			// set average
 			for (S32 i = 0; i < mNumS; i++)
 			{
-				mVertices[i].mNormal = average;
+				setNormal(i, average);
 			}
 
 			// average normals for south pole
@@ -5431,13 +5961,13 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 			average = LLVector3(0.0, 0.0, 0.0);
 			for (S32 i = 0; i < mNumS; i++)
 			{
-				average += mVertices[i + mNumS * (mNumT - 1)].mNormal;
+				average += getNormal(i + mNumS * (mNumT - 1));
 			}
 
 			// set average
 			for (S32 i = 0; i < mNumS; i++)
 			{
-				mVertices[i + mNumS * (mNumT - 1)].mNormal = average;
+				setNormal(i + mNumS * (mNumT - 1), average);
 			}
 
 		}
@@ -5447,9 +5977,9 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 		{
 			for (S32 i = 0; i < mNumT; i++)
 			{
-				LLVector3 norm = mVertices[mNumS*i].mNormal + mVertices[mNumS*i+mNumS-1].mNormal;
-				mVertices[mNumS * i].mNormal = norm;
-				mVertices[mNumS * i+mNumS-1].mNormal = norm;
+				LLVector3 norm = getNormal(mNumS*i) + getNormal(mNumS*i+mNumS-1);
+				setNormal(mNumS * i, norm);
+				setNormal(mNumS * i+mNumS-1, norm);
 			}
 		}
 
@@ -5459,9 +5989,9 @@ BOOL LLVolumeFace::createSide(LLVolume* volume, BOOL partial_build)
 		{
 			for (S32 i = 0; i < mNumS; i++)
 			{
-				LLVector3 norm = mVertices[i].mNormal + mVertices[mNumS*(mNumT-1)+i].mNormal;
-				mVertices[i].mNormal = norm;
-				mVertices[mNumS*(mNumT-1)+i].mNormal = norm;
+				LLVector3 norm = getNormal(i) + getNormal(mNumS*(mNumT-1)+i);
+				setNormal(i, norm);
+				setNormal(mNumS*(mNumT-1)+i, norm);
 			}
 			
 		}
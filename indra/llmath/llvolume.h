@@ -36,6 +36,8 @@ class LLProfile;
 class LLPath;
 class LLVolumeFace;
 class LLVolume;
+class LLMatrix3;
+class LLMatrix4;
 
 #include "lldarray.h"
 #include "lluuid.h"
@@ -779,21 +781,16 @@ public:
 class LLVolumeFace
 {
 public:
-	LLVolumeFace() : 
-		mID(0),
-		mTypeMask(0),
-		mHasBinormals(FALSE),
-		mBeginS(0),
-		mBeginT(0),
-		mNumS(0),
-		mNumT(0)
-	{
-	}
+	LLVolumeFace();
+	LLVolumeFace(const LLVolumeFace& src);
+	~LLVolumeFace();
+	LLVolumeFace& operator=(const LLVolumeFace& src);
 
 	BOOL create(LLVolume* volume, BOOL partial_build = FALSE);
 	void createBinormals();
 	void makeTriStrip();
 	
+	// A single vertex, for code that builds or looks at one at a time
 	class VertexData
 	{
 	public:
@@ -803,6 +800,66 @@ public:
 		LLVector2 mTexCoord;
 	};
 
+	// Vertices are stored as a structure of arrays: each component has a
+	// stream of its own, 16 byte aligned and padded past the last vertex,
+	// so the loops over them can do four vertices at a time. Binormal
+	// streams are only allocated for faces that have binormals.
+	enum
+	{
+		POSITION_X = 0,
+		POSITION_Y,
+		POSITION_Z,
+		NORMAL_X,
+		NORMAL_Y,
+		NORMAL_Z,
+		TEXCOORD_U,
+		TEXCOORD_V,
+		BINORMAL_X,
+		BINORMAL_Y,
+		BINORMAL_Z,
+		NUM_STREAMS,
+		NUM_BASE_STREAMS = BINORMAL_X
+	};
+
+	S32 getNumVertices() const								{ return mNumVertices; }
+	// New vertices are all zeroes
+	void resizeVertices(S32 num_vertices);
+	void pushVertex(const VertexData& vertex);
+	const F32* getStream(S32 stream) const					{ return mStreams[stream]; }
+	F32* getStream(S32 stream)								{ return mStreams[stream]; }
+
+	LLVector3 getPosition(S32 i) const
+	{
+		return LLVector3(mStreams[POSITION_X][i], mStreams[POSITION_Y][i], mStreams[POSITION_Z][i]);
+	}
+	LLVector3 getNormal(S32 i) const
+	{
+		return LLVector3(mStreams[NORMAL_X][i], mStreams[NORMAL_Y][i], mStreams[NORMAL_Z][i]);
+	}
+	// Zero for faces without binormals
+	LLVector3 getBinormal(S32 i) const
+	{
+		return mStreams[BINORMAL_X] ? LLVector3(mStreams[BINORMAL_X][i], mStreams[BINORMAL_Y][i], mStreams[BINORMAL_Z][i]) : LLVector3::zero;
+	}
+	LLVector2 getTexCoord(S32 i) const
+	{
+		return LLVector2(mStreams[TEXCOORD_U][i], mStreams[TEXCOORD_V][i]);
+	}
+	void setPosition(S32 i, const LLVector3& pos)			{ setStreams(POSITION_X, i, pos); }
+	void setNormal(S32 i, const LLVector3& normal)			{ setStreams(NORMAL_X, i, normal); }
+	void setBinormal(S32 i, const LLVector3& binormal)		{ allocateBinormals(); setStreams(BINORMAL_X, i, binormal); }
+	void setTexCoord(S32 i, const LLVector2& tc)			{ mStreams[TEXCOORD_U][i] = tc.mV[VX]; mStreams[TEXCOORD_V][i] = tc.mV[VY]; }
+	void setVertex(S32 i, const VertexData& vertex);
+
+	// Fill vertex buffer strides the way LLFace::getGeometryVolume() wants
+	// them: positions transformed by mat, normals (or binormals) rotated by
+	// norm_mat and normalized.
+	void getTransformedPositions(const LLMatrix4& mat, LLStrider<LLVector3> dst) const;
+	void getTransformedNormals(const LLMatrix3& norm_mat, LLStrider<LLVector3> dst, BOOL binormals = FALSE) const;
+
+	// Bytes of vertex data, for stats
+	S32 getVertexDataSize() const;
+
 	enum
 	{
 		SINGLE_MASK =	0x0001,
@@ -832,7 +889,6 @@ public:
 
 	LLVector3 mExtents[2]; //minimum and maximum point of face
 
-	std::vector<VertexData> mVertices;
 	std::vector<U16>	mIndices;
 	std::vector<U16>	mTriStrip;
 	std::vector<S32>	mEdge;
@@ -841,11 +897,30 @@ private:
 	BOOL createUnCutCubeCap(LLVolume* volume, BOOL partial_build = FALSE);
 	BOOL createCap(LLVolume* volume, BOOL partial_build = FALSE);
 	BOOL createSide(LLVolume* volume, BOOL partial_build = FALSE);
+	// Smooth normals of a side's grid of mNumS by mNumT vertices
+	void createSideNormals();
+
+	void setStreams(S32 first, S32 i, const LLVector3& vec)
+	{
+		mStreams[first][i] = vec.mV[VX];
+		mStreams[first + 1][i] = vec.mV[VY];
+		mStreams[first + 2][i] = vec.mV[VZ];
+	}
+	void allocateBinormals();
+	void freeVertices();
+	void copyVertices(const LLVolumeFace& src);
+
+	S32 mNumVertices;
+	S32 mVertexCapacity; // floats per stream
+	F32* mStreams[NUM_STREAMS];
+	U8* mVertexData; // base streams, as allocated
+	U8* mBinormalData;
 };
 
 class LLVolume : public LLRefCount
 {
 	friend class LLVolumeLODGroup;
+	friend class LLVolumeMgr;
 
 private:
 	LLVolume(const LLVolume&);  // Don't implement
@@ -866,7 +941,18 @@ public:
 		S32 mCountT;
 	};
 
-	LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL generate_single_face = FALSE, const BOOL is_unique = FALSE);
+	enum
+	{
+		BUILD_DEFERRED = 0,	// made with defer_build, nobody has asked for it yet
+		BUILD_QUEUED,		// waiting on LLVolumeMgr's build thread
+		BUILD_IN_PROGRESS,
+		BUILD_DONE
+	};
+
+	// With defer_build the path, profile and faces are left for build(),
+	// see LLVolumeMgr::requestVolume().
+	LLVolume(const LLVolumeParams &params, const F32 detail, const BOOL generate_single_face = FALSE, const BOOL is_unique = FALSE,
+			 const BOOL defer_build = FALSE);
 	
 	U8 getProfileType()	const								{ return mParams.getProfileParams().getCurveType(); }
 	U8 getPathType() const									{ return mParams.getPathParams().getCurveType(); }
@@ -890,6 +976,10 @@ public:
 	BOOL isCap(S32 face);
 	BOOL isFlat(S32 face);
 	BOOL isUnique() const									{ return mUnique; }
+	// A volume that isn't built has no faces yet, don't use it until it is
+	BOOL isBuilt() const;
+	// One of BUILD_*, for when isBuilt() isn't enough
+	U32 getBuildState() const;
 
 	S32 getSculptLevel() const                              { return mSculptLevel; }
 	
@@ -931,7 +1021,6 @@ public:
 	LLFaceID generateFaceMask();
 
 	BOOL isFaceMaskValid(LLFaceID face_mask);
-	static S32 sNumMeshPoints;
 
 	friend std::ostream& operator<<(std::ostream &s, const LLVolume &volume);
 	friend std::ostream& operator<<(std::ostream &s, const LLVolume *volumep);		// HACK to bypass Windoze confusion over 
@@ -952,6 +1041,8 @@ private:
 protected:
 	BOOL generate();
 	void createVolumeFaces();
+	// Generates everything the constructor would have, may run on any thread
+	void build();
 
  protected:
 	BOOL mUnique;
@@ -966,6 +1057,11 @@ protected:
 	BOOL mGenerateSingleFace;
 	typedef std::vector<LLVolumeFace> face_list_t;
 	face_list_t mVolumeFaces;
+
+	// One of BUILD_*, only touched through getBuildState() and
+	// setBuildState() since the build thread changes it
+	void setBuildState(U32 state);
+	volatile U32 mBuildState;
 };
 
 std::ostream& operator<<(std::ostream &s, const LLVolumeParams &volume_params);
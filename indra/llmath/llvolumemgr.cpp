@@ -27,6 +27,7 @@
 
 #include "llvolumemgr.h"
 #include "llmemtype.h"
+#include "llthreadpool.h"
 #include "llvolume.h"
 
 
@@ -45,7 +46,9 @@ F32 LLVolumeLODGroup::mDetailScales[NUM_LODS] = {1.f, 1.5f, 2.5f, 4.f};
 //============================================================================
 
 LLVolumeMgr::LLVolumeMgr()
-:	mDataMutex(NULL)
+:	mDataMutex(NULL),
+	mBuildThread(NULL),
+	mBuildCondition(NULL)
 {
 	// the LLMutex magic interferes with easy unit testing,
 	// so you now must manually call useMutex() to use it
@@ -54,10 +57,21 @@ LLVolumeMgr::LLVolumeMgr()
 
 LLVolumeMgr::~LLVolumeMgr()
 {
+	if (mBuildThread)
+	{
+		// Builds still queued are dropped along with their volumes
+		mBuildThread->shutdown();
+		delete mBuildThread;
+		mBuildThread = NULL;
+	}
+	mBuildingVolumes.clear();
+
 	cleanup();
 
 	delete mDataMutex;
 	mDataMutex = NULL;
+	delete mBuildCondition;
+	mBuildCondition = NULL;
 }
 
 BOOL LLVolumeMgr::cleanup()
@@ -91,6 +105,110 @@ BOOL LLVolumeMgr::cleanup()
 //  also holds a LLPointer so the volume will only go away after
 //  anything holding the volume and the LODGroup are destroyed
 LLVolume* LLVolumeMgr::refVolume(const LLVolumeParams &volume_params, const S32 detail)
+{
+	LLVolume* volumep = findOrCreateGroup(volume_params)->refLOD(detail);
+	if (!volumep->isBuilt())
+	{
+		// Somebody else requested this LOD, but we can't wait for it
+		finishBuild(volumep, true);
+	}
+	return volumep;
+}
+
+LLVolume* LLVolumeMgr::requestVolume(const LLVolumeParams &volume_params, const S32 detail)
+{
+	if (!mBuildThread)
+	{
+		return refVolume(volume_params, detail);
+	}
+
+	LLVolume* volumep = findOrCreateGroup(volume_params)->refLOD(detail, true);
+	mBuildCondition->lock();
+	bool queue = (volumep->getBuildState() == LLVolume::BUILD_DEFERRED);
+	if (queue)
+	{
+		volumep->setBuildState(LLVolume::BUILD_QUEUED);
+	}
+	mBuildCondition->unlock();
+
+	if (queue)
+	{
+		// The LOD group drops the volume once nobody uses it, but the build
+		// thread may still be working on it
+		mBuildingVolumes.push_back(volumep);
+		mBuildThread->buildVolume(this, volumep, LLQueuedThread::PRIORITY_NORMAL);
+	}
+	return volumep;
+}
+
+S32 LLVolumeMgr::update(U32 max_time_ms)
+{
+	if (!mBuildThread)
+	{
+		return 0;
+	}
+
+	mBuildThread->update(max_time_ms);
+
+	for (U32 i = 0; i < mBuildingVolumes.size(); )
+	{
+		if (mBuildingVolumes[i]->isBuilt())
+		{
+			mBuildingVolumes[i] = mBuildingVolumes.back();
+			mBuildingVolumes.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+	return (S32)mBuildingVolumes.size();
+}
+
+bool LLVolumeMgr::claimBuild(LLVolume* volumep)
+{
+	LLMutexLock lock(mBuildCondition);
+	U32 state = volumep->getBuildState();
+	if (state == LLVolume::BUILD_DEFERRED || state == LLVolume::BUILD_QUEUED)
+	{
+		volumep->setBuildState(LLVolume::BUILD_IN_PROGRESS);
+		return true;
+	}
+	return false;
+}
+
+void LLVolumeMgr::finishBuild(LLVolume* volumep, bool wait)
+{
+	if (claimBuild(volumep))
+	{
+		volumep->build();
+		mBuildCondition->lock();
+		mBuildCondition->broadcast();
+		mBuildCondition->unlock();
+	}
+	else if (wait)
+	{
+		// Whoever has it broadcasts once it is built
+		mBuildCondition->lock();
+		while (!volumep->isBuilt())
+		{
+			mBuildCondition->wait();
+		}
+		mBuildCondition->unlock();
+	}
+}
+
+void LLVolumeMgr::useBuildThread(bool threaded)
+{
+	if (!mBuildThread)
+	{
+		mBuildCondition = new LLCondition(gAPRPoolp);
+		mBuildThread = new LLVolumeBuildThread(threaded);
+	}
+}
+
+// protected
+LLVolumeLODGroup* LLVolumeMgr::findOrCreateGroup(const LLVolumeParams& volume_params)
 {
 	LLVolumeLODGroup* volgroupp;
 	if (mDataMutex)
@@ -110,7 +228,7 @@ LLVolume* LLVolumeMgr::refVolume(const LLVolumeParams &volume_params, const S32
 	{
 		mDataMutex->unlock();
 	}
-	return volgroupp->refLOD(detail);
+	return volgroupp;
 }
 
 // virtual
@@ -289,7 +407,7 @@ bool LLVolumeLODGroup::cleanupRefs()
 	return res;
 }
 
-LLVolume* LLVolumeLODGroup::refLOD(const S32 detail)
+LLVolume* LLVolumeLODGroup::refLOD(const S32 detail, bool defer_build)
 {
 	llassert(detail >=0 && detail < NUM_LODS);
 	mAccessCount[detail]++;
@@ -298,7 +416,7 @@ LLVolume* LLVolumeLODGroup::refLOD(const S32 detail)
 	if (mVolumeLODs[detail].isNull())
 	{
 		LLMemType m1(LLMemType::MTYPE_VOLUME);
-		mVolumeLODs[detail] = new LLVolume(mVolumeParams, mDetailScales[detail]);
+		mVolumeLODs[detail] = new LLVolume(mVolumeParams, mDetailScales[detail], FALSE, FALSE, defer_build);
 	}
 	mLODRefs[detail]++;
 	return mVolumeLODs[detail];
@@ -396,3 +514,45 @@ std::ostream& operator<<(std::ostream& s, const LLVolumeLODGroup& volgroup)
 	return s;
 }
 
+
+//============================================================================
+
+LLVolumeBuildThread::LLVolumeBuildThread(bool threaded)
+	: LLQueuedThread("volumebuild", threaded)
+{
+	if (isPooled())
+	{
+		setMaxConcurrency(getSharedPool()->getWorkerCount());
+	}
+}
+
+LLVolumeBuildThread::handle_t LLVolumeBuildThread::buildVolume(LLVolumeMgr* volume_mgr, LLVolume* volumep, U32 priority)
+{
+	handle_t handle = generateHandle();
+	BuildRequest* req = new BuildRequest(handle, priority, volume_mgr, volumep);
+	bool res = addRequest(req);
+	if (!res)
+	{
+		llerrs << "LLVolumeBuildThread::buildVolume called after shutdown" << llendl;
+	}
+	return handle;
+}
+
+LLVolumeBuildThread::BuildRequest::BuildRequest(handle_t handle, U32 priority, LLVolumeMgr* volume_mgr, LLVolume* volumep)
+	: LLQueuedThread::QueuedRequest(handle, priority, FLAG_AUTO_COMPLETE),
+	  mVolumeMgr(volume_mgr),
+	  mVolumep(volumep)
+{
+}
+
+LLVolumeBuildThread::BuildRequest::~BuildRequest()
+{
+}
+
+// virtual, called from own thread
+bool LLVolumeBuildThread::BuildRequest::processRequest()
+{
+	// The main thread may have needed it first, nothing left to do then
+	mVolumeMgr->finishBuild(mVolumep, false);
+	return true;
+}
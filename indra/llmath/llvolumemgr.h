@@ -28,13 +28,16 @@
 #define LL_LLVOLUMEMGR_H
 
 #include <map>
+#include <vector>
 
 #include "llvolume.h"
 #include "llpointer.h"
+#include "llqueuedthread.h"
 #include "llthread.h"
 
 class LLVolumeParams;
 class LLVolumeLODGroup;
+class LLVolumeMgr;
 
 class LLVolumeLODGroup
 {
@@ -54,7 +57,8 @@ public:
 	static void getDetailProximity(const F32 tan_angle, F32 &to_lower, F32& to_higher);
 	static F32 getVolumeScaleFromDetail(const S32 detail);
 
-	LLVolume* refLOD(const S32 detail);
+	// With defer_build a volume that isn't cached yet is created unbuilt
+	LLVolume* refLOD(const S32 detail, bool defer_build = false);
 	BOOL derefLOD(LLVolume *volumep);
 	S32 getNumRefs() const { return mRefs; }
 	
@@ -74,8 +78,35 @@ protected:
 	S32		mAccessCount[NUM_LODS];
 };
 
+// Generates deferred volumes for LLVolumeMgr::requestVolume() off the main
+// thread. Volumes don't share any state while building, so with a shared
+// LLThreadPool several workers may build at once.
+class LLVolumeBuildThread : public LLQueuedThread
+{
+public:
+	class BuildRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		virtual ~BuildRequest(); // use deleteRequest()
+
+	public:
+		BuildRequest(handle_t handle, U32 priority, LLVolumeMgr* volume_mgr, LLVolume* volumep);
+
+		/*virtual*/ bool processRequest();
+
+	private:
+		LLVolumeMgr* mVolumeMgr;
+		LLVolume* mVolumep; // LLVolumeMgr holds on to it until it is built
+	};
+
+	LLVolumeBuildThread(bool threaded = true);
+
+	handle_t buildVolume(LLVolumeMgr* volume_mgr, LLVolume* volumep, U32 priority);
+};
+
 class LLVolumeMgr
 {
+	friend class LLVolumeBuildThread::BuildRequest;
 public:
 	LLVolumeMgr();
 	virtual ~LLVolumeMgr();
@@ -94,9 +125,23 @@ public:
 	// manually call this for mutex magic
 	void useMutex();
 
+	// Same magic for the build thread used by requestVolume()
+	void useBuildThread(bool threaded = true);
+
+	// Like refVolume(), except that a LOD that isn't cached yet comes back
+	// unbuilt and gets built on the build thread. Keep using the volume you
+	// had until LLVolume::isBuilt(). Without a build thread this is
+	// refVolume().
+	LLVolume* requestVolume(const LLVolumeParams &volume_params, const S32 detail);
+
+	// MAIN thread, once a frame: runs the build thread and lets go of the
+	// volumes it is done with. Returns the number of builds pending.
+	S32 update(U32 max_time_ms);
+
 	friend std::ostream& operator<<(std::ostream& s, const LLVolumeMgr& volume_mgr);
 
 protected:
+	LLVolumeLODGroup* findOrCreateGroup(const LLVolumeParams& volume_params);
 	void insertGroup(LLVolumeLODGroup* volgroup);
 	// Overridden in llphysics/abstract/utils/llphysicsvolumemanager.h
 	virtual LLVolumeLODGroup* createNewGroup(const LLVolumeParams& volume_params);
@@ -106,6 +151,19 @@ protected:
 	volume_lod_group_map_t mVolumeLODGroups;
 
 	LLMutex* mDataMutex;
+
+private:
+	// Takes a deferred volume for building, false if some thread already did
+	bool claimBuild(LLVolume* volumep);
+	// Builds volumep here unless another thread has it, then waits for that
+	// one to finish if wait is set
+	void finishBuild(LLVolume* volumep, bool wait);
+
+	LLVolumeBuildThread* mBuildThread;
+	LLCondition* mBuildCondition;	// guards build states, broadcast when a build finishes
+	// Volumes the build thread has been given, kept alive until done
+	typedef std::vector<LLPointer<LLVolume> > volume_list_t;
+	volume_list_t mBuildingVolumes;
 };
 
 #endif // LL_LLVOLUMEMGR_H
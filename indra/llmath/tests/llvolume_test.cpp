@@ -0,0 +1,539 @@
+/**
+ * @file llvolume_test.cpp
+ * @brief Tests for LLVolumeFace's vertex streams and the loops over them
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "../llvolume.h"
+#include "../llvolumemgr.h"
+#include "../m3math.h"
+#include "../m4math.h"
+#include "../llquaternion.h"
+#include "llpointer.h"
+#include "llthreadpool.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	const F32 TOLERANCE = 0.0001f;
+
+	// A spread of the prims people build with, see LLVolumeParams::setCube()
+	// for the defaults everything starts from. Those have no revolutions,
+	// circle paths need one.
+	std::vector<LLVolumeParams> make_corpus()
+	{
+		std::vector<LLVolumeParams> corpus;
+		LLVolumeParams params;
+
+		params.setCube();
+		corpus.push_back(params);		// box
+		params.setHollow(0.5f);
+		corpus.push_back(params);		// hollow box
+		params.setBeginAndEndS(0.125f, 0.75f);
+		params.setTwistEnd(0.5f);
+		corpus.push_back(params);		// cut, hollow, twisted box
+
+		params.setCube();
+		params.setType(LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_LINE);
+		corpus.push_back(params);		// cylinder
+		params.setTaper(0.5f, 0.25f);
+		params.setShear(0.2f, 0.f);
+		corpus.push_back(params);		// tapered, sheared cylinder
+
+		params.setCube();
+		params.setType(LL_PCODE_PROFILE_EQUALTRI, LL_PCODE_PATH_LINE);
+		corpus.push_back(params);		// prism
+
+		params.setCube();
+		params.setType(LL_PCODE_PROFILE_CIRCLE_HALF, LL_PCODE_PATH_CIRCLE);
+		params.setRevolutions(1.f);
+		corpus.push_back(params);		// sphere
+		params.setBeginAndEndT(0.f, 0.6f);
+		corpus.push_back(params);		// dimpled sphere
+
+		params.setCube();
+		params.setType(LL_PCODE_PROFILE_CIRCLE, LL_PCODE_PATH_CIRCLE);
+		params.setRevolutions(1.f);
+		params.setRatio(1.f, 0.25f);
+		corpus.push_back(params);		// torus
+		params.setHollow(0.3f);
+		params.setRevolutions(2.f);
+		corpus.push_back(params);		// hollow two turn torus
+
+		params.setCube();
+		params.setType(LL_PCODE_PROFILE_SQUARE, LL_PCODE_PATH_CIRCLE);
+		params.setRevolutions(1.f);
+		params.setRatio(1.f, 0.25f);
+		corpus.push_back(params);		// tube
+
+		return corpus;
+	}
+
+	// LOD levels, as in LLVolumeLODGroup
+	const F32 DETAILS[] = { 1.f, 1.5f, 2.5f, 4.f };
+	const S32 NUM_DETAILS = sizeof(DETAILS) / sizeof(DETAILS[0]);
+
+	bool close_enough(const LLVector3& a, const LLVector3& b)
+	{
+		return fabsf(a.mV[VX] - b.mV[VX]) < TOLERANCE &&
+			   fabsf(a.mV[VY] - b.mV[VY]) < TOLERANCE &&
+			   fabsf(a.mV[VZ] - b.mV[VZ]) < TOLERANCE;
+	}
+
+	struct Vertex
+	{
+		LLVector3 mPosition;
+		LLVector3 mNormal;
+		LLVector3 mBinormal;
+	};
+
+	// The side normals the way they were summed before the streams, one
+	// triangle at a time off mIndices, then wrapped and stitched the way
+	// LLVolumeFace::createSide() does for prims
+	void indexed_side_normals(const LLVolume* volume, const LLVolumeFace& face, std::vector<LLVector3>& normals)
+	{
+		normals.assign(face.getNumVertices(), LLVector3::zero);
+		for (U32 i = 0; i < face.mIndices.size() / 3; i++)
+		{
+			const U16* idx = &face.mIndices[i * 3];
+			LLVector3 v0 = face.getPosition(idx[0]);
+			LLVector3 norm = (v0 - face.getPosition(idx[1])) % (v0 - face.getPosition(idx[2]));
+			normals[idx[0]] += norm;
+			normals[idx[1]] += norm;
+			normals[idx[2]] += norm;
+			// even out quad contributions
+			normals[idx[i % 2 + 1]] += norm;
+		}
+
+		const S32 num_s = face.mNumS;
+		const S32 num_t = face.mNumT;
+		BOOL s_bottom_converges = (face.getPosition(0) - face.getPosition(num_s * (num_t - 2))).magVecSquared() < 0.000001f;
+		BOOL s_top_converges = (face.getPosition(num_s - 1) - face.getPosition(num_s * (num_t - 2) + num_s - 1)).magVecSquared() < 0.000001f;
+		if (!volume->getPath().isOpen())
+		{
+			for (S32 i = 0; i < num_s; i++)
+			{
+				LLVector3 norm = normals[i] + normals[num_s * (num_t - 1) + i];
+				normals[i] = norm;
+				normals[num_s * (num_t - 1) + i] = norm;
+			}
+		}
+		if (!volume->getProfile().isOpen() && !s_bottom_converges)
+		{
+			for (S32 i = 0; i < num_t; i++)
+			{
+				LLVector3 norm = normals[num_s * i] + normals[num_s * i + num_s - 1];
+				normals[num_s * i] = norm;
+				normals[num_s * i + num_s - 1] = norm;
+			}
+		}
+		if (volume->getPathType() == LL_PCODE_PATH_CIRCLE &&
+			(volume->getProfileType() & LL_PCODE_PROFILE_MASK) == LL_PCODE_PROFILE_CIRCLE_HALF)
+		{
+			for (S32 i = 0; i < num_t; i++)
+			{
+				if (s_bottom_converges)
+				{
+					normals[num_s * i] = LLVector3(1.f, 0.f, 0.f);
+				}
+				if (s_top_converges)
+				{
+					normals[num_s * i + num_s - 1] = LLVector3(-1.f, 0.f, 0.f);
+				}
+			}
+		}
+	}
+
+	// refVolume() on the LOD requested[index] was requested for, which
+	// mustn't come back until that one is built
+	void ref_and_check(LLVolumeMgr* mgr, const std::vector<LLVolumeParams>& corpus,
+					   const std::vector<LLPointer<LLVolume> >& requested, S32 index)
+	{
+		const LLVolumeParams& params = corpus[index / LLVolumeLODGroup::NUM_LODS];
+		LLVolume* volumep = mgr->refVolume(params, index % LLVolumeLODGroup::NUM_LODS);
+		tut::ensure("refVolume() returns the requested LOD", volumep == requested[index].get());
+		tut::ensure("refVolume() returns built", volumep->isBuilt());
+		tut::ensure("built volume has faces", volumep->getNumVolumeFaces() > 0);
+	}
+
+	// Something with rotation, scale and translation in it
+	LLMatrix4 test_matrix()
+	{
+		LLMatrix4 mat;
+		mat.initAll(LLVector3(0.5f, 2.f, 1.5f),
+					LLQuaternion(0.3f, LLVector3(1.f, 2.f, 3.f)),
+					LLVector3(10.f, -20.f, 30.f));
+		return mat;
+	}
+}
+
+namespace tut
+{
+	struct llvolume_data
+	{
+		llvolume_data() : mCorpus(make_corpus())
+		{
+		}
+		std::vector<LLVolumeParams> mCorpus;
+	};
+	typedef test_group<llvolume_data> llvolume_group;
+	typedef llvolume_group::object llvolume_object;
+	llvolume_group llvolumegrp("LLVolume");
+
+	template<> template<>
+	void llvolume_object::test<1>()
+	{
+		set_test_name("mesh sweep matches the path and profile");
+		for (size_t p = 0; p < mCorpus.size(); ++p)
+		{
+			LLPointer<LLVolume> volume = new LLVolume(mCorpus[p], DETAILS[NUM_DETAILS - 1]);
+			const std::vector<LLVolume::Point>& mesh = volume->getMesh();
+			const std::vector<LLVector3>& profile = volume->getProfile().mProfile;
+			const std::vector<LLPath::PathPt>& path = volume->getPath().mPath;
+			ensure_equals("mesh size", mesh.size(), profile.size() * path.size());
+			for (size_t s = 0; s < path.size(); ++s)
+			{
+				for (size_t t = 0; t < profile.size(); ++t)
+				{
+					LLVector3 expected(profile[t].mV[VX] * path[s].mScale.mV[VX],
+									   profile[t].mV[VY] * path[s].mScale.mV[VY],
+									   0.f);
+					expected = expected * path[s].mRot + path[s].mPos;
+					ensure(llformat("params %d point %d, %d", (S32)p, (S32)s, (S32)t),
+						   close_enough(mesh[s * profile.size() + t].mPos, expected));
+				}
+			}
+		}
+	}
+
+	template<> template<>
+	void llvolume_object::test<2>()
+	{
+		set_test_name("transforms match the scalar ones");
+		LLMatrix4 mat = test_matrix();
+		LLMatrix3 norm_mat = mat.getMat3();
+		norm_mat.adjointTranspose();
+
+		for (size_t p = 0; p < mCorpus.size(); ++p)
+		{
+			for (S32 d = 0; d < NUM_DETAILS; ++d)
+			{
+				LLPointer<LLVolume> volume = new LLVolume(mCorpus[p], DETAILS[d]);
+				for (S32 f = 0; f < volume->getNumVolumeFaces(); ++f)
+				{
+					volume->genBinormals(f);
+					const LLVolumeFace& face = volume->getVolumeFace(f);
+					S32 num_vertices = face.getNumVertices();
+					ensure("face has vertices", num_vertices > 0);
+
+					// Interleaved, the way vertex buffers lay them out
+					std::vector<Vertex> vertices(num_vertices);
+					LLStrider<LLVector3> positions;
+					positions = &vertices[0].mPosition;
+					positions.setStride(sizeof(Vertex));
+					LLStrider<LLVector3> normals;
+					normals = &vertices[0].mNormal;
+					normals.setStride(sizeof(Vertex));
+					LLStrider<LLVector3> binormals;
+					binormals = &vertices[0].mBinormal;
+					binormals.setStride(sizeof(Vertex));
+					face.getTransformedPositions(mat, positions);
+					face.getTransformedNormals(norm_mat, normals);
+					face.getTransformedNormals(norm_mat, binormals, TRUE);
+
+					// And packed
+					std::vector<LLVector3> packed(num_vertices);
+					LLStrider<LLVector3> packed_positions;
+					packed_positions = &packed[0];
+					face.getTransformedPositions(mat, packed_positions);
+
+					for (S32 i = 0; i < num_vertices; ++i)
+					{
+						std::string msg = llformat("params %d detail %d face %d vertex %d", (S32)p, d, f, i);
+						LLVector3 position = face.getPosition(i) * mat;
+						ensure(msg + " position", close_enough(vertices[i].mPosition, position));
+						ensure(msg + " packed position", close_enough(packed[i], position));
+						LLVector3 normal = face.getNormal(i) * norm_mat;
+						normal.normVec();
+						ensure(msg + " normal", close_enough(vertices[i].mNormal, normal));
+						LLVector3 binormal = face.getBinormal(i) * norm_mat;
+						binormal.normVec();
+						ensure(msg + " binormal", close_enough(vertices[i].mBinormal, binormal));
+					}
+				}
+			}
+		}
+	}
+
+	template<> template<>
+	void llvolume_object::test<3>()
+	{
+		set_test_name("vertex streams");
+		LLVolumeFace face;
+		ensure_equals("empty", face.getNumVertices(), 0);
+
+		LLVolumeFace::VertexData vertex;
+		for (S32 i = 0; i < 10; ++i)
+		{
+			vertex.mPosition.setVec((F32)i, 1.f, 2.f);
+			vertex.mNormal.setVec(0.f, 0.f, 1.f);
+			vertex.mBinormal.clearVec();
+			vertex.mTexCoord.setVec(0.5f, (F32)i);
+			face.pushVertex(vertex);
+		}
+		ensure_equals("pushed", face.getNumVertices(), 10);
+		ensure("aligned", ((size_t)face.getStream(LLVolumeFace::POSITION_X) & 15) == 0);
+		ensure("no binormals until there are some", face.getStream(LLVolumeFace::BINORMAL_X) == NULL);
+		ensure("zero binormal", face.getBinormal(3).isExactlyZero());
+		S32 size_without_binormals = face.getVertexDataSize();
+
+		face.setBinormal(3, LLVector3(1.f, 0.f, 0.f));
+		ensure("binormals allocated", face.getStream(LLVolumeFace::BINORMAL_X) != NULL);
+		ensure("binormals cost more", face.getVertexDataSize() > size_without_binormals);
+		ensure("binormal set", face.getBinormal(3) == LLVector3(1.f, 0.f, 0.f));
+		ensure("other binormals zero", face.getBinormal(4).isExactlyZero());
+
+		LLVolumeFace copy(face);
+		ensure_equals("copied", copy.getNumVertices(), 10);
+		ensure("copied position", copy.getPosition(7) == LLVector3(7.f, 1.f, 2.f));
+		ensure("copied tex coord", copy.getTexCoord(7) == LLVector2(0.5f, 7.f));
+		ensure("copied binormal", copy.getBinormal(3) == LLVector3(1.f, 0.f, 0.f));
+		ensure("deep copy", copy.getStream(LLVolumeFace::POSITION_X) != face.getStream(LLVolumeFace::POSITION_X));
+
+		face.resizeVertices(2);
+		face.resizeVertices(5);
+		ensure("kept", face.getPosition(1) == LLVector3(1.f, 1.f, 2.f));
+		ensure("regrown vertices are zero", face.getPosition(4).isExactlyZero() &&
+			   face.getNormal(4).isExactlyZero() && face.getBinormal(3).isExactlyZero());
+		ensure("copy untouched", copy.getPosition(4) == LLVector3(4.f, 1.f, 2.f));
+	}
+
+	template<> template<>
+	void llvolume_object::test<4>()
+	{
+		set_test_name("grid side normals match the indexed ones");
+		std::vector<LLVector3> expected;
+		for (size_t p = 0; p < mCorpus.size(); ++p)
+		{
+			for (S32 d = 0; d < NUM_DETAILS; ++d)
+			{
+				LLPointer<LLVolume> volume = new LLVolume(mCorpus[p], DETAILS[d]);
+				for (S32 f = 0; f < volume->getNumVolumeFaces(); ++f)
+				{
+					const LLVolumeFace& face = volume->getVolumeFace(f);
+					if (face.mTypeMask & LLVolumeFace::CAP_MASK)
+					{
+						continue;
+					}
+					std::string msg = llformat("params %d detail %d face %d", (S32)p, d, f);
+					ensure_equals(msg + " grid size", face.mNumS * face.mNumT, face.getNumVertices());
+					indexed_side_normals(volume, face, expected);
+					for (S32 i = 0; i < face.getNumVertices(); ++i)
+					{
+						// Summed in a different order, so compare directions
+						LLVector3 normal = face.getNormal(i);
+						LLVector3 expected_normal = expected[i];
+						normal.normVec();
+						expected_normal.normVec();
+						ensure(llformat("%s vertex %d normal", msg.c_str(), i), close_enough(normal, expected_normal));
+					}
+				}
+			}
+		}
+	}
+
+	template<> template<>
+	void llvolume_object::test<5>()
+	{
+		// Benchmark: building every LOD of the corpus and transforming the
+		// faces into an interleaved buffer, as LLFace::getGeometryVolume()
+		// does, against the per vertex loop it used before the streams.
+		// Reported, not enforced, timings on a build machine are too noisy
+		// to assert on.
+		const S32 ITERATIONS = 20;
+		LLMatrix4 mat = test_matrix();
+		LLMatrix3 norm_mat = mat.getMat3();
+		norm_mat.adjointTranspose();
+
+		F64 build_time = 0.0;
+		F64 normal_time = 0.0;
+		F64 transform_time = 0.0;
+		F64 scalar_time = 0.0;
+		S64 num_vertices = 0;
+		S64 vertex_bytes = 0;
+		std::vector<Vertex> buffer;
+		std::vector<LLVector3> normals;
+		LLTimer timer;
+		for (S32 iteration = 0; iteration < ITERATIONS; ++iteration)
+		{
+			for (size_t p = 0; p < mCorpus.size(); ++p)
+			{
+				for (S32 d = 0; d < NUM_DETAILS; ++d)
+				{
+					timer.reset();
+					LLPointer<LLVolume> volume = new LLVolume(mCorpus[p], DETAILS[d]);
+					build_time += timer.getElapsedTimeF64();
+
+					for (S32 f = 0; f < volume->getNumVolumeFaces(); ++f)
+					{
+						const LLVolumeFace& face = volume->getVolumeFace(f);
+						S32 count = face.getNumVertices();
+						if (!count)
+						{
+							continue;
+						}
+						buffer.resize(count);
+						LLStrider<LLVector3> positions;
+						positions = &buffer[0].mPosition;
+						positions.setStride(sizeof(Vertex));
+						LLStrider<LLVector3> normal_strider;
+						normal_strider = &buffer[0].mNormal;
+						normal_strider.setStride(sizeof(Vertex));
+
+						timer.reset();
+						face.getTransformedPositions(mat, positions);
+						face.getTransformedNormals(norm_mat, normal_strider);
+						transform_time += timer.getElapsedTimeF64();
+
+						timer.reset();
+						for (S32 i = 0; i < count; ++i)
+						{
+							buffer[i].mPosition = face.getPosition(i) * mat;
+							LLVector3 normal = face.getNormal(i) * norm_mat;
+							normal.normVec();
+							buffer[i].mNormal = normal;
+						}
+						scalar_time += timer.getElapsedTimeF64();
+
+						if (!(face.mTypeMask & LLVolumeFace::CAP_MASK))
+						{
+							// What the side normals cost summed off the indices,
+							// a share of the build time above
+							timer.reset();
+							indexed_side_normals(volume, face, normals);
+							normal_time += timer.getElapsedTimeF64();
+						}
+
+						if (iteration == 0)
+						{
+							num_vertices += count;
+							vertex_bytes += face.getVertexDataSize();
+						}
+					}
+				}
+			}
+		}
+		ensure("corpus has vertices", num_vertices > 0);
+		S32 num_volumes = ITERATIONS * mCorpus.size() * NUM_DETAILS;
+		llinfos << "Built " << num_volumes << " volumes (" << num_vertices * ITERATIONS << " vertices) in "
+				<< build_time * 1000.0 << " ms, summing their side normals off the indices would take "
+				<< normal_time * 1000.0 << " ms" << llendl;
+		llinfos << "Transformed their faces in " << transform_time * 1000.0 << " ms, the per vertex loop took "
+				<< scalar_time * 1000.0 << " ms ("
+				<< (transform_time > 0.0 ? scalar_time / transform_time : 0.0) << "x)" << llendl;
+		llinfos << (F64)vertex_bytes / (F64)num_vertices << " bytes per vertex ("
+				<< sizeof(LLVolumeFace::VertexData) << " interleaved)" << llendl;
+	}
+
+	template<> template<>
+	void llvolume_object::test<6>()
+	{
+		set_test_name("deferred builds race refVolume()");
+		// Several pool workers build what requestVolume() queued while the
+		// main thread asks for the same LODs again through refVolume(). By
+		// then each one is either still queued (the main thread claims and
+		// builds it), being built (it waits for the worker) or done. Which
+		// of those happen is down to timing, the results mustn't be.
+		LLThreadPool* pool = new LLThreadPool("volumetest", 4);
+		LLQueuedThread::setSharedPool(pool);
+		const S32 ITERATIONS = 50;
+		for (S32 iteration = 0; iteration < ITERATIONS; ++iteration)
+		{
+			LLVolumeMgr* mgr = new LLVolumeMgr;
+			mgr->useMutex();
+			mgr->useBuildThread();
+
+			std::vector<LLPointer<LLVolume> > requested;
+			for (size_t p = 0; p < mCorpus.size(); ++p)
+			{
+				for (S32 detail = 0; detail < LLVolumeLODGroup::NUM_LODS; ++detail)
+				{
+					requested.push_back(mgr->requestVolume(mCorpus[p], detail));
+				}
+			}
+
+			// Every other pass catches one the workers are on first, so
+			// refVolume() has to wait for it. Then the rest back to front,
+			// the last requests being the likeliest to still be queued.
+			std::vector<bool> reffed(requested.size(), false);
+			bool caught = (iteration % 2 == 0);
+			bool queued = true;
+			while (!caught && queued)
+			{
+				queued = false;
+				for (size_t i = 0; i < requested.size() && !caught; ++i)
+				{
+					U32 state = requested[i]->getBuildState();
+					if (state == LLVolume::BUILD_IN_PROGRESS)
+					{
+						ref_and_check(mgr, mCorpus, requested, i);
+						reffed[i] = true;
+						caught = true;
+					}
+					queued |= (state == LLVolume::BUILD_QUEUED);
+				}
+			}
+			for (S32 i = (S32)requested.size() - 1; i >= 0; --i)
+			{
+				if (!reffed[i])
+				{
+					ref_and_check(mgr, mCorpus, requested, i);
+				}
+			}
+
+			for (S32 i = 0; i < 200 && mgr->update(1) > 0; ++i)
+			{
+				ms_sleep(10);
+			}
+			ensure_equals("no builds left pending", mgr->update(1), 0);
+
+			for (size_t i = 0; i < requested.size(); ++i)
+			{
+				// Once for requestVolume(), once for refVolume()
+				mgr->unrefVolume(requested[i]);
+				mgr->unrefVolume(requested[i]);
+			}
+			requested.clear();
+			ensure("no dangling references", mgr->cleanup());
+			delete mgr;
+		}
+		LLQueuedThread::setSharedPool(NULL);
+		delete pool;
+	}
+}
@@ -61,8 +61,6 @@ const S32 PING_START_BLOCK = 3;		// How many pings behind we have to be to consi
 const S32 PING_RELEASE_BLOCK = 2;	// How many pings behind we have to be to consider ourself unblocked.
 
 const F32 TARGET_PERIOD_LENGTH = 5.f;	// seconds
-const F32 LL_DUPLICATE_SUPPRESSION_TIMEOUT = 60.f; //seconds - this can be long, as time-based cleanup is
-													// only done when wrapping packetids, now...
 
 LLCircuitData::LLCircuitData(const LLHost &host, TPACKETID in_id, 
 							 const F32 circuit_heartbeat_interval, const F32 circuit_timeout)
@@ -129,35 +127,15 @@ LLCircuitData::~LLCircuitData()
 	// Clean up all pending transfers.
 	gTransferManager.cleanupConnection(mHost);
 
-	// remove all pending reliable messages on this circuit
+	// remove all pending reliable messages on this circuit, final retries
+	// included
 	std::vector<TPACKETID> doomed;
-	reliable_iter iter;
-	reliable_iter end = mUnackedPackets.end();
-	for(iter = mUnackedPackets.begin(); iter != end; ++iter)
+	mWalkPackets.clear();
+	mUnackedPackets.getAllPackets(mWalkPackets);
+	for (std::vector<LLReliablePacket*>::iterator iter = mWalkPackets.begin();
+		 iter != mWalkPackets.end(); ++iter)
 	{
-		packetp = iter->second;
-		gMessageSystem->mFailedResendPackets++;
-		if(gMessageSystem->mVerboseLog)
-		{
-			doomed.push_back(packetp->mPacketID);
-		}
-		if (packetp->mCallback)
-		{
-			packetp->mCallback(packetp->mCallbackData,LL_ERR_CIRCUIT_GONE);
-		}
-
-		// Update stats
-		mUnackedPacketCount--;
-		mUnackedPacketBytes -= packetp->mBufferLength;
-
-		delete packetp;
-	}
-
-	// remove all pending final retry reliable messages on this circuit
-	end = mFinalRetryPackets.end();
-	for(iter = mFinalRetryPackets.begin(); iter != end; ++iter)
-	{
-		packetp = iter->second;
+		packetp = *iter;
 		gMessageSystem->mFailedResendPackets++;
 		if(gMessageSystem->mVerboseLog)
 		{
@@ -189,80 +167,40 @@ LLCircuitData::~LLCircuitData()
 
 void LLCircuitData::ackReliablePacket(TPACKETID packet_num)
 {
-	reliable_iter iter;
-	LLReliablePacket *packetp;
-
-	iter = mUnackedPackets.find(packet_num);
-	if (iter != mUnackedPackets.end())
+	// Looks in the unacked and the final retry packets
+	LLReliablePacket *packetp = mUnackedPackets.remove(packet_num);
+	if (!packetp)
 	{
-		packetp = iter->second;
-
-		if(gMessageSystem->mVerboseLog)
-		{
-			std::ostringstream str;
-			str << "MSG: <- " << packetp->mHost << "\tRELIABLE ACKED:\t"
-				<< packetp->mPacketID;
-			llinfos << str.str() << llendl;
-		}
-		if (packetp->mCallback)
-		{
-			if (packetp->mTimeout < 0.f)   // negative timeout will always return timeout even for successful ack, for debugging
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);					
-			}
-			else
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_NOERR);
-			}
-		}
-
-		// Update stats
-		mUnackedPacketCount--;
-		mUnackedPacketBytes -= packetp->mBufferLength;
-
-		// Cleanup
-		delete packetp;
-		mUnackedPackets.erase(iter);
+		// Couldn't find this packet on either of the unacked lists.
+		// maybe it's a duplicate ack?
 		return;
 	}
 
-	iter = mFinalRetryPackets.find(packet_num);
-	if (iter != mFinalRetryPackets.end())
+	if(gMessageSystem->mVerboseLog)
 	{
-		packetp = iter->second;
-		// llinfos << "Packet " << packet_num << " removed from the pending list" << llendl;
-		if(gMessageSystem->mVerboseLog)
+		std::ostringstream str;
+		str << "MSG: <- " << packetp->mHost << "\tRELIABLE ACKED:\t"
+			<< packetp->mPacketID;
+		llinfos << str.str() << llendl;
+	}
+	if (packetp->mCallback)
+	{
+		if (packetp->mTimeout < 0.f)   // negative timeout will always return timeout even for successful ack, for debugging
 		{
-			std::ostringstream str;
-			str << "MSG: <- " << packetp->mHost << "\tRELIABLE ACKED:\t"
-				<< packetp->mPacketID;
-			llinfos << str.str() << llendl;
+			packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);					
 		}
-		if (packetp->mCallback)
+		else
 		{
-			if (packetp->mTimeout < 0.f)   // negative timeout will always return timeout even for successful ack, for debugging
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_TCP_TIMEOUT);					
-			}
-			else
-			{
-				packetp->mCallback(packetp->mCallbackData,LL_ERR_NOERR);
-			}
+			packetp->mCallback(packetp->mCallbackData,LL_ERR_NOERR);
 		}
+	}
 
-		// Update stats
-		mUnackedPacketCount--;
-		mUnackedPacketBytes -= packetp->mBufferLength;
+	// Update stats
+	mUnackedPacketCount--;
+	mUnackedPacketBytes -= packetp->mBufferLength;
 
-		// Cleanup
-		delete packetp;
-		mFinalRetryPackets.erase(iter);
-	}
-	else
-	{
-		// Couldn't find this packet on either of the unacked lists.
-		// maybe it's a duplicate ack?
-	}
+	// Cleanup
+	delete packetp;
 }
 
 
@@ -280,11 +218,14 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 	// I'm not going to worry about this for now - djs
 	//
 
-	reliable_iter iter;
+	// Walk a copy, callbacks may send more reliable packets on this circuit
+	mWalkPackets.clear();
+	mUnackedPackets.getPackets(FALSE, mWalkPackets);
+	std::vector<LLReliablePacket*>::iterator iter;
 	BOOL have_resend_overflow = FALSE;
-	for (iter = mUnackedPackets.begin(); iter != mUnackedPackets.end();)
+	for (iter = mWalkPackets.begin(); iter != mWalkPackets.end(); ++iter)
 	{
-		packetp = iter->second;
+		packetp = *iter;
 
 		// Only check overflow if we haven't had one yet.
 		if (!have_resend_overflow)
@@ -305,12 +246,7 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 					// This circuit has overflowed.  Do not retry.  Do not pass go.
 					packetp->mRetries = 0;
 					// Remove it from this list and add it to the final list.
-					mUnackedPackets.erase(iter++);
-					mFinalRetryPackets[packetp->mPacketID] = packetp;
-				}
-				else
-				{
-					++iter;
+					mUnackedPackets.setFinalRetry(packetp->mPacketID);
 				}
 				// Move on to the next unacked packet.
 				continue;
@@ -365,27 +301,20 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 			if (!packetp->mRetries)
 			{
 				// Last resend, remove it from this list and add it to the final list.
-				mUnackedPackets.erase(iter++);
-				mFinalRetryPackets[packetp->mPacketID] = packetp;
-			}
-			else
-			{
-				// Don't remove it yet, it still gets to try to resend at least once.
-				++iter;
+				mUnackedPackets.setFinalRetry(packetp->mPacketID);
 			}
+			// else don't remove it yet, it still gets to try to resend at least once.
 			resent_packets++;
 		}
-		else
-		{
-			// Don't need to do anything with this packet, keep iterating.
-			++iter;
-		}
+		// else don't need to do anything with this packet, keep iterating.
 	}
 
 
-	for (iter = mFinalRetryPackets.begin(); iter != mFinalRetryPackets.end();)
+	mWalkPackets.clear();
+	mUnackedPackets.getPackets(TRUE, mWalkPackets);
+	for (iter = mWalkPackets.begin(); iter != mWalkPackets.end(); ++iter)
 	{
-		packetp = iter->second;
+		packetp = *iter;
 		if (now > packetp->mExpirationTime)
 		{
 			// fail (too many retries)
@@ -413,16 +342,102 @@ S32 LLCircuitData::resendUnackedPackets(const F64 now)
 			mUnackedPacketCount--;
 			mUnackedPacketBytes -= packetp->mBufferLength;
 
-			mFinalRetryPackets.erase(iter++);
+			mUnackedPackets.remove(packetp->mPacketID);
 			delete packetp;
 		}
-		else
+	}
+
+	return mUnackedPacketCount;
+}
+
+
+LLCircuitHostTable::LLCircuitHostTable()
+:	mEntries(16),
+	mMask(15),
+	mCount(0)
+{
+}
+
+U32 LLCircuitHostTable::homeSlot(const LLHost& host) const
+{
+	U32 hash = (host.getAddress() * 0x9e3779b1U) ^ (host.getPort() * 0x85ebca6bU);
+	hash ^= hash >> 15;
+	return hash & mMask;
+}
+
+LLCircuitData* LLCircuitHostTable::find(const LLHost& host) const
+{
+	for (U32 pos = homeSlot(host); mEntries[pos].mCircuit; pos = (pos + 1) & mMask)
+	{
+		if (mEntries[pos].mHost == host)
 		{
-			++iter;
+			return mEntries[pos].mCircuit;
 		}
 	}
+	return NULL;
+}
 
-	return mUnackedPacketCount;
+void LLCircuitHostTable::grow()
+{
+	std::vector<Entry> old_entries(mEntries.size() * 2);
+	old_entries.swap(mEntries);
+	mMask = (U32)mEntries.size() - 1;
+	mCount = 0;
+	for (std::vector<Entry>::const_iterator iter = old_entries.begin(); iter != old_entries.end(); ++iter)
+	{
+		if (iter->mCircuit)
+		{
+			insert(iter->mHost, iter->mCircuit);
+		}
+	}
+}
+
+void LLCircuitHostTable::insert(const LLHost& host, LLCircuitData* circuit)
+{
+	if ((U32)(mCount + 1) * 2 > mEntries.size())
+	{
+		grow();
+	}
+
+	U32 pos = homeSlot(host);
+	while (mEntries[pos].mCircuit && mEntries[pos].mHost != host)
+	{
+		pos = (pos + 1) & mMask;
+	}
+	if (!mEntries[pos].mCircuit)
+	{
+		mCount++;
+	}
+	mEntries[pos].mHost = host;
+	mEntries[pos].mCircuit = circuit;
+}
+
+void LLCircuitHostTable::erase(const LLHost& host)
+{
+	U32 pos = homeSlot(host);
+	while (mEntries[pos].mCircuit && mEntries[pos].mHost != host)
+	{
+		pos = (pos + 1) & mMask;
+	}
+	if (!mEntries[pos].mCircuit)
+	{
+		return;
+	}
+	mEntries[pos].mCircuit = NULL;
+	mCount--;
+
+	// Pull later entries of the same run back into the hole when that
+	// does not put them in front of their home slot
+	for (U32 next = (pos + 1) & mMask; mEntries[next].mCircuit; next = (next + 1) & mMask)
+	{
+		U32 home = homeSlot(mEntries[next].mHost);
+		if (((pos - home) & mMask) < ((next - home) & mMask))
+		{
+			mEntries[pos] = mEntries[next];
+			mEntries[next].mCircuit = NULL;
+			pos = next;
+		}
+	}
 }
 
 
@@ -446,7 +461,8 @@ LLCircuitData *LLCircuit::addCircuitData(const LLHost &host, TPACKETID in_id)
 	// This should really validate if one already exists
 	llinfos << "LLCircuit::addCircuitData for " << host << llendl;
 	LLCircuitData *tempp = new LLCircuitData(host, in_id, mHeartbeatInterval, mHeartbeatTimeout);
-	mCircuitData.insert(circuit_data_map::value_type(host, tempp));
+	circuit_data_map::iterator it = mCircuitData.insert(circuit_data_map::value_type(host, tempp)).first;
+	mCircuitTable.insert(host, it->second);
 	mPingSet.insert(tempp);
 
 	mLastCircuit = tempp;
@@ -462,6 +478,7 @@ void LLCircuit::removeCircuitData(const LLHost &host)
 	{
 		LLCircuitData *cdp = it->second;
 		mCircuitData.erase(it);
+		mCircuitTable.erase(host);
 
 		LLCircuit::ping_set_t::iterator psit = mPingSet.find(cdp);
 		if (psit != mPingSet.end())
@@ -570,14 +587,8 @@ void LLCircuitData::addReliablePacket(S32 mSocket, U8 *buf_ptr, S32 buf_len, LLR
 	mUnackedPacketCount++;
 	mUnackedPacketBytes += packet_info->mBufferLength;
 
-	if (params && params->mRetries)
-	{
-		mUnackedPackets[packet_info->mPacketID] = packet_info;
-	}
-	else
-	{
-		mFinalRetryPackets[packet_info->mPacketID] = packet_info;
-	}
+	// Without retries it goes straight to the final list
+	mUnackedPackets.add(packet_info, !(params && params->mRetries));
 }
 
 
@@ -600,7 +611,7 @@ void LLCircuit::resendUnackedPackets(S32& unacked_list_length, S32& unacked_list
 
 BOOL LLCircuitData::isDuplicateResend(TPACKETID packetnum)
 {
-	return (mRecentlyReceivedReliablePackets.find(packetnum) != mRecentlyReceivedReliablePackets.end());
+	return mRecentlyReceivedReliablePackets.contains(packetnum);
 }
 
 
@@ -621,13 +632,12 @@ LLCircuitData* LLCircuit::findCircuit(const LLHost& host) const
 		return mLastCircuit;
 	}
 
-	circuit_data_map::const_iterator it = mCircuitData.find(host);
-	if(it == mCircuitData.end())
+	LLCircuitData* cdp = mCircuitTable.find(host);
+	if (cdp)
 	{
-		return NULL;
+		mLastCircuit = cdp;
 	}
-	mLastCircuit = it->second;
-	return mLastCircuit;
+	return cdp;
 }
 
 
@@ -861,93 +871,13 @@ BOOL LLCircuitData::updateWatchDogTimers(LLMessageSystem *msgsys)
 	// for the packet that it was out of order with was received BEFORE
 	// the ping was sent.
 
-	// Find the current oldest reliable packetID
-	// This is to handle the case if we actually manage to wrap our
-	// packet IDs - the oldest will actually have a higher packet ID
-	// than the current.
-	BOOL wrapped = FALSE;
-	reliable_iter iter;
-	iter = mUnackedPackets.upper_bound(getPacketOutID());
-	if (iter == mUnackedPackets.end())
-	{
-		// Nothing AFTER this one, so we want the lowest packet ID
-		// then.
-		iter = mUnackedPackets.begin();
-		wrapped = TRUE;
-	}
-
-	TPACKETID packet_id = 0;
-
-	// Check against the "final" packets
-	BOOL wrapped_final = FALSE;
-	reliable_iter iter_final;
-	iter_final = mFinalRetryPackets.upper_bound(getPacketOutID());
-	if (iter_final == mFinalRetryPackets.end())
-	{
-		iter_final = mFinalRetryPackets.begin();
-		wrapped_final = TRUE;
-	}
-
-	//llinfos << mHost << " - unacked count " << mUnackedPackets.size() << llendl;
-	//llinfos << mHost << " - final count " << mFinalRetryPackets.size() << llendl;
-	if (wrapped != wrapped_final)
-	{
-		// One of the "unacked" or "final" lists hasn't wrapped.  Whichever one
-		// hasn't has the oldest packet.
-		if (!wrapped)
-		{
-			// Hasn't wrapped, so the one on the
-			// unacked packet list is older
-			packet_id = iter->first;
-			//llinfos << mHost << ": nowrapped unacked" << llendl;
-		}
-		else
-		{
-			packet_id = iter_final->first;
-			//llinfos << mHost << ": nowrapped final" << llendl;
-		}
-	}
-	else
-	{
-		// They both wrapped, we can just use the minimum of the two.
-		if ((iter == mUnackedPackets.end()) && (iter_final == mFinalRetryPackets.end()))
-		{
-			// Wow!  No unacked packets at all!
-			// Send the ID of the last packet we sent out.
-			// This will flush all of the destination's
-			// unacked packets, theoretically.
-			//llinfos << mHost << ": No unacked!" << llendl;
-			packet_id = getPacketOutID();
-		}
-		else
-		{
-			BOOL had_unacked = FALSE;
-			if (iter != mUnackedPackets.end())
-			{
-				// Unacked list has the lowest so far
-				packet_id = iter->first;
-				had_unacked = TRUE;
-				//llinfos << mHost << ": Unacked" << llendl;
-			}
-
-			if (iter_final != mFinalRetryPackets.end())
-			{
-				// Use the lowest of the unacked list and the final list
-				if (had_unacked)
-				{
-					// Both had a packet, use the lowest.
-					packet_id = llmin(packet_id, iter_final->first);
-					//llinfos << mHost << ": Min of unacked/final" << llendl;
-				}
-				else
-				{
-					// Only the final had a packet, use it.
-					packet_id = iter_final->first;
-					//llinfos << mHost << ": Final!" << llendl;
-				}
-			}
-		}
-	}
+	// Find the current oldest reliable packetID, on the unacked or the
+	// final list. This is to handle the case if we actually manage to wrap
+	// our packet IDs - the oldest will actually have a higher packet ID
+	// than the current. With no unacked packets at all this is the ID of
+	// the last packet we sent out, which will flush all of the
+	// destination's unacked packets, theoretically.
+	TPACKETID packet_id = mUnackedPackets.getOldestID(getPacketOutID());
 
 	// Send off the another ping.
 	pingTimerStart();
@@ -997,47 +927,9 @@ void LLCircuitData::clearDuplicateList(TPACKETID oldest_id)
 	// purge old data from the duplicate suppression queue
 
 	// we want to KEEP all x where oldest_id <= x <= last incoming packet, and delete everything else.
-
-	//llinfos << mHost << ": clearing before oldest " << oldest_id << llendl;
-	//llinfos << "Recent list before: " << mRecentlyReceivedReliablePackets.size() << llendl;
-	if (oldest_id < mHighestPacketID)
-	{
-		// Clean up everything with a packet ID less than oldest_id.
-		packet_time_map::iterator pit_start;
-		packet_time_map::iterator pit_end;
-		pit_start = mRecentlyReceivedReliablePackets.begin();
-		pit_end = mRecentlyReceivedReliablePackets.lower_bound(oldest_id);
-		mRecentlyReceivedReliablePackets.erase(pit_start, pit_end);
-	}
-
-	// Do timeout checks on everything with an ID > mHighestPacketID.
-	// This should be empty except for wrapping IDs.  Thus, this should be
-	// highly rare.
-	U64 mt_usec = LLMessageSystem::getMessageTimeUsecs();
-
-	packet_time_map::iterator pit;
-	for(pit = mRecentlyReceivedReliablePackets.upper_bound(mHighestPacketID);
-		pit != mRecentlyReceivedReliablePackets.end(); )
-	{
-		// Validate that the packet ID seems far enough away
-		if ((pit->first - mHighestPacketID) < 100)
-		{
-			llwarns << "Probably incorrectly timing out non-wrapped packets!" << llendl;
-		}
-		U64 delta_t_usec = mt_usec - (*pit).second;
-		F64 delta_t_sec = delta_t_usec * SEC_PER_USEC;
-		if (delta_t_sec > LL_DUPLICATE_SUPPRESSION_TIMEOUT)
-		{
-			// enough time has elapsed we're not likely to get a duplicate on this one
-			llinfos << "Clearing " << pit->first << " from recent list" << llendl;
-			mRecentlyReceivedReliablePackets.erase(pit++);
-		}
-		else
-		{
-			++pit;
-		}
-	}
-	//llinfos << "Recent list after: " << mRecentlyReceivedReliablePackets.size() << llendl;
+	// The range is taken modulo the packet ID range, so IDs from before
+	// a wrap go too.
+	mRecentlyReceivedReliablePackets.keepRange(oldest_id, mHighestPacketID);
 }
 
 BOOL LLCircuitData::checkCircuitTimeout()
@@ -1277,6 +1169,7 @@ void LLCircuitData::pingTimerStop(const U8 ping_id)
 
 	U32 msec = (U32) ((delta_ping*mHeartbeatInterval  + time) * 1000.f);
 	setPingDelay(msec);
+	mCongestion.addRTTSample(msec / 1000.f, mt_secs);
 
 	mPingsInTransit = delta_ping;
 	if (mBlocked && (mPingsInTransit <= PING_RELEASE_BLOCK))
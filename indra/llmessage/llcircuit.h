@@ -40,6 +40,7 @@
 #include "llpacketack.h"
 #include "lluuid.h"
 #include "llthrottle.h"
+#include "llcongestioncontroller.h"
 #include "llstat.h"
 
 //
@@ -132,6 +133,7 @@ public:
     LLHost      getHost() const { return mHost; }
 
 	LLThrottleGroup &getThrottleGroup()		{	return mThrottles; }
+	LLCongestionController &getCongestionController()	{	return mCongestion; }
 
 	class less
 	{
@@ -197,6 +199,7 @@ protected:
 	LLUUID mRemoteSessionID;
 
 	LLThrottleGroup	mThrottles;
+	LLCongestionController mCongestion;	// fed our pings, the owner feeds it packet counts
 
 	TPACKETID		mWrapID;
 
@@ -236,14 +239,11 @@ protected:
 	typedef std::map<TPACKETID, U64> packet_time_map;
 
 	packet_time_map							mPotentialLostPackets;
-	packet_time_map							mRecentlyReceivedReliablePackets;
+	LLRecentPacketIDs						mRecentlyReceivedReliablePackets;
 	std::vector<TPACKETID> mAcks;
 
-	typedef std::map<TPACKETID, LLReliablePacket *> reliable_map;
-	typedef reliable_map::iterator					reliable_iter;
-
-	reliable_map							mUnackedPackets;
-	reliable_map							mFinalRetryPackets;
+	LLReliablePacketWindow					mUnackedPackets;	// and the final retries
+	std::vector<LLReliablePacket*>			mWalkPackets;		// scratch for walking mUnackedPackets
 
 	S32										mUnackedPacketCount;
 	S32										mUnackedPacketBytes;
@@ -281,6 +281,35 @@ protected:
 };
 
 
+// Circuits by host, for LLCircuit::findCircuit() which runs for every
+// packet in and out.  Open addressing with linear probing, at most half
+// full, and removal shifts entries back so there are no tombstones.
+class LLCircuitHostTable
+{
+public:
+	LLCircuitHostTable();
+
+	LLCircuitData* find(const LLHost& host) const;
+	void insert(const LLHost& host, LLCircuitData* circuit);
+	void erase(const LLHost& host);
+
+private:
+	struct Entry
+	{
+		Entry() : mCircuit(NULL) {}
+		LLHost mHost;
+		LLCircuitData* mCircuit;	// NULL for an empty slot
+	};
+
+	U32 homeSlot(const LLHost& host) const;
+	void grow();
+
+	std::vector<Entry> mEntries;
+	U32 mMask;
+	S32 mCount;
+};
+
+
 // Actually a singleton class -- the global messagesystem
 // has a single LLCircuit member.
 class LLCircuit
@@ -332,6 +361,7 @@ public:
 	circuit_data_map mSendAckMap; // Map of circuits which need to send acks
 protected:
 	circuit_data_map mCircuitData;
+	LLCircuitHostTable mCircuitTable;	// the same circuits, for findCircuit()
 
 	typedef std::set<LLCircuitData *, LLCircuitData::less> ping_set_t; // Circuits sorted by next ping time
 	ping_set_t mPingSet;
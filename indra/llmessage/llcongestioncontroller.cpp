@@ -0,0 +1,215 @@
+/** 
+ * @file llcongestioncontroller.cpp
+ * @brief Per circuit bandwidth from round trip time and packet loss
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * 
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llcongestioncontroller.h"
+#include "llmath.h"
+
+//static
+const F32 LLCongestionController::UPDATE_PERIOD = 1.f;
+
+const S32 MIN_PACKETS_FOR_LOSS = 20;	// fewer in a period say nothing about loss
+const F32 LOSS_ALPHA = 0.5f;			// weight of the last period in the smoothed loss
+const F32 LOSS_BACKOFF = 0.03f;			// back off above this fraction lost, smoothed...
+const F32 LOSS_SEVERE = 0.10f;			// ...or this in one period, and harder
+const F32 LOSS_EASE = 0.02f;			// only open up below this, lossy links lose some anyway
+const F32 DECREASE_FACTOR = 0.8f;
+const F32 SEVERE_DECREASE_FACTOR = 0.5f;
+const F32 INCREASE_FRACTION = 0.03f;	// of the maximum, per period
+const F32 RTT_ALPHA = 0.125f;
+const F32 QUEUE_DELAY_FRACTION = 0.5f;	// of the minimum round trip, before we call it a queue
+const F32 QUEUE_DELAY_MIN = 0.025f;		// seconds, so a LAN's tiny pings don't count jitter
+const F32 MIN_RTT_WINDOW = 120.f;		// seconds, lets the minimum follow a route change
+const F32 REPORT_CHANGE = 0.1f;			// fraction the rate moves before it is worth a message
+const F32 MIN_REPORT_INTERVAL = 5.f;	// seconds between reports of a higher rate
+
+LLCongestionController::LLCongestionController()
+:	mMinBPS(0.f),
+	mMaxBPS(0.f),
+	mRate(0.f),
+	mReportedRate(0.f),
+	mLossRate(0.f),
+	mLastRTT(0.f),
+	mLastRTTTime(0.0),
+	mSmoothedRTT(0.f),
+	mMinRTT(0.f),
+	mWindowMinRTT(0.f),
+	mWindowStart(0.0),
+	mLastUpdate(0.0),
+	mLastDecrease(0.0),
+	mLastReport(0.0),
+	mLastPacketsIn(0),
+	mLastPacketsLost(0),
+	mHaveCounts(FALSE)
+{
+}
+
+void LLCongestionController::setRange(F32 min_bps, F32 max_bps)
+{
+	max_bps = llmax(min_bps, max_bps);
+	if (mMaxBPS == 0.f)
+	{
+		mRate = max_bps;
+		mReportedRate = max_bps;
+	}
+	mMinBPS = min_bps;
+	mMaxBPS = max_bps;
+	mRate = llclamp(mRate, mMinBPS, mMaxBPS);
+}
+
+void LLCongestionController::setRate(F32 bps)
+{
+	mRate = llclamp(bps, mMinBPS, mMaxBPS);
+	mReportedRate = mRate;
+}
+
+void LLCongestionController::addRTTSample(F32 rtt_secs, F64 now)
+{
+	if (rtt_secs <= 0.f)
+	{
+		return;
+	}
+
+	mLastRTT = rtt_secs;
+	mLastRTTTime = now;
+	if (mSmoothedRTT == 0.f)
+	{
+		mSmoothedRTT = rtt_secs;
+		mWindowStart = now;
+	}
+	else
+	{
+		mSmoothedRTT = (1.f - RTT_ALPHA) * mSmoothedRTT + RTT_ALPHA * rtt_secs;
+	}
+
+	if (now - mWindowStart > MIN_RTT_WINDOW)
+	{
+		// Forget minimums older than the last window
+		mMinRTT = mWindowMinRTT;
+		mWindowMinRTT = 0.f;
+		mWindowStart = now;
+	}
+	if (mWindowMinRTT == 0.f || rtt_secs < mWindowMinRTT)
+	{
+		mWindowMinRTT = rtt_secs;
+	}
+	if (mMinRTT == 0.f || rtt_secs < mMinRTT)
+	{
+		mMinRTT = rtt_secs;
+	}
+}
+
+BOOL LLCongestionController::update(F64 now, U32 packets_in, U32 packets_lost)
+{
+	if (!mHaveCounts)
+	{
+		mLastPacketsIn = packets_in;
+		mLastPacketsLost = packets_lost;
+		mLastUpdate = now;
+		mHaveCounts = TRUE;
+		return FALSE;
+	}
+	if (now - mLastUpdate < UPDATE_PERIOD || mMaxBPS == 0.f)
+	{
+		return FALSE;
+	}
+	mLastUpdate = now;
+
+	U32 received = packets_in - mLastPacketsIn;
+	U32 lost = packets_lost - mLastPacketsLost;
+	S32 total = (S32)(received + lost);
+	if (total < MIN_PACKETS_FOR_LOSS)
+	{
+		// A quiet link is no reason to open up or close down, keep
+		// counting until there is enough to go on
+		return FALSE;
+	}
+	mLastPacketsIn = packets_in;
+	mLastPacketsLost = packets_lost;
+
+	F32 loss = (F32)lost / (F32)total;
+	mLossRate = (1.f - LOSS_ALPHA) * mLossRate + LOSS_ALPHA * loss;
+
+	// Pings are few and far between, so go by the latest round trip
+	// rather than the smoothed one. Until the next one comes in a queue
+	// seen holds the rate, it takes one taken since the last cut to cut
+	// again.
+	BOOL queueing = FALSE;
+	if (mMinRTT > 0.f)
+	{
+		F32 queue_delay = mLastRTT - mMinRTT;
+		queueing = queue_delay > llmax(mMinRTT * QUEUE_DELAY_FRACTION, QUEUE_DELAY_MIN);
+	}
+	BOOL losing = mLossRate > LOSS_BACKOFF || loss > LOSS_SEVERE;
+
+	if (losing || queueing)
+	{
+		// A cut takes a round trip to show up in what we see, so don't
+		// cut again for the same congestion
+		if ((losing || mLastRTTTime > mLastDecrease)
+			&& now - mLastDecrease >= mSmoothedRTT + UPDATE_PERIOD)
+		{
+			mRate *= loss > LOSS_SEVERE ? SEVERE_DECREASE_FACTOR : DECREASE_FACTOR;
+			mLastDecrease = now;
+		}
+	}
+	else if (mLossRate <= LOSS_EASE)
+	{
+		mRate += mMaxBPS * INCREASE_FRACTION;
+	}
+	mRate = llclamp(mRate, mMinBPS, mMaxBPS);
+
+	return reportIfChanged(now);
+}
+
+BOOL LLCongestionController::reportIfChanged(F64 now)
+{
+	if (mRate == mReportedRate)
+	{
+		return FALSE;
+	}
+
+	// Slow down at once, speed up at a pace that doesn't flood the other
+	// end with throttle messages
+	BOOL at_bound = (mRate == mMinBPS || mRate == mMaxBPS);
+	BOOL report = FALSE;
+	if (mRate < mReportedRate)
+	{
+		report = at_bound || mRate <= mReportedRate * (1.f - REPORT_CHANGE);
+	}
+	else if (now - mLastReport >= MIN_REPORT_INTERVAL)
+	{
+		report = at_bound || mRate >= mReportedRate * (1.f + REPORT_CHANGE);
+	}
+
+	if (report)
+	{
+		mReportedRate = mRate;
+		mLastReport = now;
+	}
+	return report;
+}
@@ -0,0 +1,88 @@
+/** 
+ * @file llcongestioncontroller.h
+ * @brief Per circuit bandwidth from round trip time and packet loss
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ * 
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ * 
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * 
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLCONGESTIONCONTROLLER_H
+#define LL_LLCONGESTIONCONTROLLER_H
+
+// Picks the bandwidth to ask of the other end of a circuit from what the
+// circuit sees: the packet loss on incoming packets and how far the ping
+// time has risen above the lowest one seen lately, which is queueing on
+// the path.  Additive increase while the link is clean, multiplicative
+// decrease on loss or a queue building, once per round trip at most.
+//
+// Times are passed in so a simulated link can drive it faster than real
+// time.
+class LLCongestionController
+{
+public:
+	LLCongestionController();
+
+	// Bounds on the rate, in bits per second.  The first call starts the
+	// rate at max_bps.
+	void setRange(F32 min_bps, F32 max_bps);
+
+	// Starts from a rate learned elsewhere, e.g. on the last region's circuit
+	void setRate(F32 bps);
+
+	void addRTTSample(F32 rtt_secs, F64 now);
+
+	// Takes the circuit's running packet counts and adjusts the rate once
+	// per UPDATE_PERIOD. TRUE if the rate moved enough to tell the other
+	// end about.
+	BOOL update(F64 now, U32 packets_in, U32 packets_lost);
+
+	F32 getRate() const				{ return mRate; }
+	F32 getLossRate() const			{ return mLossRate; }
+	F32 getSmoothedRTT() const		{ return mSmoothedRTT; }
+	F32 getMinRTT() const			{ return mMinRTT; }
+
+	static const F32 UPDATE_PERIOD;	// seconds
+
+private:
+	BOOL reportIfChanged(F64 now);
+
+	F32 mMinBPS;
+	F32 mMaxBPS;
+	F32 mRate;
+	F32 mReportedRate;
+
+	F32 mLossRate;			// smoothed fraction of incoming packets lost
+	F32 mLastRTT;			// seconds, the latest sample...
+	F64 mLastRTTTime;		// ...and when it came in
+	F32 mSmoothedRTT;		// seconds, 0 until the first sample
+	F32 mMinRTT;			// lowest over the last window or two
+	F32 mWindowMinRTT;		// lowest in the current window
+	F64 mWindowStart;
+
+	F64 mLastUpdate;
+	F64 mLastDecrease;
+	F64 mLastReport;
+	U32 mLastPacketsIn;
+	U32 mLastPacketsLost;
+	BOOL mHaveCounts;
+};
+
+#endif // LL_LLCONGESTIONCONTROLLER_H
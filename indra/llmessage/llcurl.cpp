@@ -73,6 +73,11 @@ static const S32 MULTI_PERFORM_CALL_REPEAT	= 5;
 static const S32 CURL_REQUEST_TIMEOUT = 30; // seconds
 static const S32 MAX_ACTIVE_REQUEST_COUNT = 100;
 
+// LLCurlTextureRequest
+static const S32 TEXTURE_DNS_CACHE_TIMEOUT = 600; // seconds
+static const S32 TEXTURE_INITIAL_CONCURRENCY = 8;
+static const F32 TEXTURE_THROUGHPUT_WINDOW = 1.f; // seconds
+
 // DEBUG //
 S32 gCurlEasyCount = 0;
 S32 gCurlMultiCount = 0;
@@ -501,6 +506,10 @@ public:
 	
 	void removeEasy(Easy* easy);
 
+	void setopt(CURLMoption option, S32 value);
+	// Idle easy handles kept for reuse
+	void setEasyPoolSize(U32 size) { mEasyPoolSize = size; }
+
 	S32 process();
 	S32 perform();
 	
@@ -520,11 +529,13 @@ private:
 	easy_active_map_t mEasyActiveMap;
 	typedef std::set<Easy*> easy_free_list_t;
 	easy_free_list_t mEasyFreeList;
+	U32 mEasyPoolSize;
 };
 
 LLCurl::Multi::Multi()
 	: mQueued(0),
-	  mErrorCount(0)
+	  mErrorCount(0),
+	  mEasyPoolSize(EASY_HANDLE_POOL_SIZE)
 {
 	mCurlMultiHandle = curl_multi_init();
 	if (!mCurlMultiHandle)
@@ -654,7 +665,7 @@ void LLCurl::Multi::easyFree(Easy* easy)
 {
 	mEasyActiveList.erase(easy);
 	mEasyActiveMap.erase(easy->getCurlHandle());
-	if (mEasyFreeList.size() < EASY_HANDLE_POOL_SIZE)
+	if (mEasyFreeList.size() < mEasyPoolSize)
 	{
 		easy->resetState();
 		mEasyFreeList.insert(easy);
@@ -671,6 +682,15 @@ void LLCurl::Multi::removeEasy(Easy* easy)
 	easyFree(easy);
 }
 
+void LLCurl::Multi::setopt(CURLMoption option, S32 value)
+{
+	CURLMcode mcode = curl_multi_setopt(mCurlMultiHandle, option, (long)value);
+	if (mcode != CURLM_OK)
+	{
+		llwarns << "Curl Error: " << curl_multi_strerror(mcode) << llendl;
+	}
+}
+
 //static
 std::string LLCurl::strerror(CURLcode errorcode)
 {
@@ -821,6 +841,303 @@ S32 LLCurlRequest::getQueued()
 	return queued;
 }
 
+////////////////////////////////////////////////////////////////////////////
+// For fetching textures over a persistent set of connections
+
+// Hands the result to the caller's responder and tells the engine how the
+// transfer went.
+class LLCurlTextureRequest::Completion : public LLCurl::Responder
+{
+public:
+	Completion(LLCurlTextureRequest* engine, LLCurl::ResponderPtr responder)
+		: mEngine(engine), mResponder(responder)
+	{
+	}
+
+	/*virtual*/ void completedRaw(U32 status, const std::string& reason,
+								  const LLChannelDescriptors& channels,
+								  const LLIOPipe::buffer_ptr_t& buffer)
+	{
+		S32 bytes = buffer ? buffer->countAfter(channels.in(), NULL) : 0;
+		mEngine->requestDone(status, bytes);
+		if (mResponder)
+		{
+			mResponder->completedRaw(status, reason, channels, buffer);
+		}
+	}
+
+	/*virtual*/ bool followRedir()
+	{
+		return mResponder && mResponder->followRedir();
+	}
+
+private:
+	LLCurlTextureRequest* mEngine;
+	LLCurl::ResponderPtr mResponder;
+};
+
+LLCurlTextureRequest::LLCurlTextureRequest(S32 max_concurrency) :
+	mActiveCount(0),
+	mWindowBytes(0),
+	mWindowErrors(0),
+	mWindowSaturated(false),
+	mLastThroughput(0.f)
+{
+	mMutex = new LLMutex(NULL);
+	mMulti = new LLCurl::Multi();
+	mMaxConcurrency = 0;
+	mConcurrency = TEXTURE_INITIAL_CONCURRENCY;
+	setMaxConcurrency(max_concurrency);
+}
+
+LLCurlTextureRequest::~LLCurlTextureRequest()
+{
+	// Requests in flight are dropped with the multi, their responders are
+	// released without being called.
+	delete mMulti;
+	mMulti = NULL;
+	for (pending_queue_t::iterator iter = mPendingQueue.begin();
+		 iter != mPendingQueue.end(); ++iter)
+	{
+		delete iter->second;
+	}
+	mPendingQueue.clear();
+	mPendingMap.clear();
+	delete mMutex;
+	mMutex = NULL;
+}
+
+void LLCurlTextureRequest::setMaxConcurrency(S32 count)
+{
+	mMaxConcurrency = llmax(count, (S32)MIN_CONCURRENCY);
+	mConcurrency = llclamp(mConcurrency, (S32)MIN_CONCURRENCY, mMaxConcurrency);
+	// Keep a connection and an easy handle around for every request we may run
+	mMulti->setopt(CURLMOPT_MAXCONNECTS, mMaxConcurrency);
+	mMulti->setEasyPoolSize(mMaxConcurrency);
+}
+
+void LLCurlTextureRequest::setPipelining(bool pipelining)
+{
+#if LIBCURL_VERSION_NUM >= 0x071000
+	mMulti->setopt(CURLMOPT_PIPELINING, pipelining ? 1 : 0);
+#endif
+}
+
+// mMutex locked
+void LLCurlTextureRequest::queueRequest(Request* request)
+{
+	pending_queue_t::iterator iter = mPendingQueue.insert(std::make_pair(request->mPriority, request));
+	mPendingMap[request->mID] = iter;
+}
+
+// mMutex locked
+LLCurlTextureRequest::Request* LLCurlTextureRequest::dequeueRequest(const LLUUID& id)
+{
+	pending_map_t::iterator iter = mPendingMap.find(id);
+	if (iter == mPendingMap.end())
+	{
+		return NULL;
+	}
+	Request* request = iter->second->second;
+	mPendingQueue.erase(iter->second);
+	mPendingMap.erase(iter);
+	return request;
+}
+
+// Any thread
+bool LLCurlTextureRequest::getByteRange(const LLUUID& id, const std::string& url,
+										const headers_t& headers, S32 offset, S32 length,
+										U32 priority, LLCurl::ResponderPtr responder)
+{
+	Request* request = new Request;
+	request->mID = id;
+	request->mURL = url;
+	request->mHeaders = headers;
+	request->mOffset = offset;
+	request->mLength = length;
+	request->mPriority = priority;
+	request->mResponder = responder;
+
+	LLMutexLock lock(mMutex);
+	delete dequeueRequest(id);
+	queueRequest(request);
+	return true;
+}
+
+// Any thread
+bool LLCurlTextureRequest::extendByteRange(const LLUUID& id, S32 length)
+{
+	LLMutexLock lock(mMutex);
+	pending_map_t::iterator iter = mPendingMap.find(id);
+	if (iter == mPendingMap.end())
+	{
+		return false;
+	}
+	Request* request = iter->second->second;
+	if (request->mLength > 0 && length > request->mLength)
+	{
+		request->mLength = length;
+	}
+	else if (length <= 0)
+	{
+		request->mLength = length; // to the end
+	}
+	return true;
+}
+
+// Any thread
+void LLCurlTextureRequest::setPriority(const LLUUID& id, U32 priority)
+{
+	LLMutexLock lock(mMutex);
+	pending_map_t::iterator iter = mPendingMap.find(id);
+	if (iter != mPendingMap.end() && iter->second->first != priority)
+	{
+		Request* request = dequeueRequest(id);
+		request->mPriority = priority;
+		queueRequest(request);
+	}
+}
+
+// Any thread
+bool LLCurlTextureRequest::cancel(const LLUUID& id)
+{
+	LLMutexLock lock(mMutex);
+	Request* request = dequeueRequest(id);
+	delete request;
+	return request != NULL;
+}
+
+S32 LLCurlTextureRequest::process()
+{
+	startRequests();
+	// Responders run here, without mMutex held, they may queue more work
+	S32 processed = mMulti->process();
+	updateConcurrency();
+	startRequests();
+	return processed;
+}
+
+S32 LLCurlTextureRequest::getQueued()
+{
+	LLMutexLock lock(mMutex);
+	return (S32)mPendingQueue.size() + mActiveCount;
+}
+
+bool LLCurlTextureRequest::isSaturated()
+{
+	LLMutexLock lock(mMutex);
+	return (S32)mPendingQueue.size() >= mConcurrency;
+}
+
+void LLCurlTextureRequest::startRequests()
+{
+	while (mActiveCount < mConcurrency)
+	{
+		Request* request = NULL;
+		{
+			LLMutexLock lock(mMutex);
+			if (mPendingQueue.empty())
+			{
+				break;
+			}
+			request = dequeueRequest(mPendingQueue.begin()->second->mID);
+		}
+		if (startRequest(request))
+		{
+			++mActiveCount;
+		}
+		delete request;
+	}
+	if (mActiveCount >= mConcurrency)
+	{
+		mWindowSaturated = true;
+	}
+}
+
+bool LLCurlTextureRequest::startRequest(Request* request)
+{
+	LLCurl::ResponderPtr completion = new Completion(this, request->mResponder);
+	LLCurl::Easy* easy = mMulti->allocEasy();
+	if (easy)
+	{
+		easy->prepRequest(request->mURL, request->mHeaders, completion);
+		easy->setopt(CURLOPT_HTTPGET, 1);
+		// All our easy handles share the multi's DNS cache, keep entries
+		// around instead of resolving the texture host for every request.
+		easy->setopt(CURLOPT_DNS_CACHE_TIMEOUT, TEXTURE_DNS_CACHE_TIMEOUT);
+		if (request->mLength > 0)
+		{
+			std::string range = llformat("Range: bytes=%d-%d", request->mOffset, request->mOffset + request->mLength - 1);
+			easy->slist_append(range.c_str());
+		}
+		else if (request->mOffset > 0)
+		{
+			std::string range = llformat("Range: bytes=%d-", request->mOffset);
+			easy->slist_append(range.c_str());
+		}
+		easy->setHeaders();
+		if (mMulti->addEasy(easy))
+		{
+			return true;
+		}
+		mMulti->removeEasy(easy);
+	}
+	// Report the failure the way a failed transfer would be reported
+	if (request->mResponder)
+	{
+		request->mResponder->completedRaw(499, "Unable to start texture request",
+										  LLChannelDescriptors(), LLIOPipe::buffer_ptr_t());
+	}
+	return false;
+}
+
+void LLCurlTextureRequest::requestDone(U32 status, S32 bytes)
+{
+	--mActiveCount;
+	mWindowBytes += bytes;
+	// Server overloaded (503) or the transfer failed outright (499)
+	if (status == 503 || status == 499)
+	{
+		++mWindowErrors;
+	}
+}
+
+// Hill climbing on throughput: keep adding connections while that pays off,
+// step back when it stops helping and back off hard on errors.
+void LLCurlTextureRequest::updateConcurrency()
+{
+	F32 elapsed = mWindowTimer.getElapsedTimeF32();
+	if (elapsed < TEXTURE_THROUGHPUT_WINDOW)
+	{
+		return;
+	}
+	F32 throughput = (F32)mWindowBytes / elapsed;
+	if (mWindowErrors > 0)
+	{
+		mConcurrency = llmax((S32)MIN_CONCURRENCY, mConcurrency * 3 / 4);
+	}
+	else if (mWindowSaturated)
+	{
+		// Only a window that kept every slot busy says anything about the limit
+		if (throughput > mLastThroughput * 1.05f)
+		{
+			mConcurrency = llmin(mMaxConcurrency, mConcurrency + 1);
+		}
+		else if (throughput < mLastThroughput * 0.9f)
+		{
+			mConcurrency = llmax((S32)MIN_CONCURRENCY, mConcurrency - 1);
+		}
+	}
+	if (mWindowSaturated || mWindowErrors > 0)
+	{
+		mLastThroughput = throughput;
+	}
+	mWindowTimer.reset();
+	mWindowBytes = 0;
+	mWindowErrors = 0;
+	mWindowSaturated = mActiveCount >= mConcurrency;
+}
+
 ////////////////////////////////////////////////////////////////////////////
 // For generating one easy request
 // associated with a single multi request
@@ -31,6 +31,8 @@
 
 #include "linden_common.h"
 
+#include <functional>
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -41,6 +43,8 @@
 #include "llbuffer.h"
 #include "lliopipe.h"
 #include "llsd.h"
+#include "lltimer.h"
+#include "lluuid.h"
 
 class LLMutex;
 
@@ -218,6 +222,94 @@ private:
 	U32 mThreadID; // debug
 };
 
+// Texture fetching engine. Unlike LLCurlRequest it keeps one multi handle
+// for its whole life, so connections (and HTTP/1.1 pipelines if enabled)
+// and the DNS cache survive between requests. Range GETs are queued by
+// priority and only go on the wire when a connection slot is free, which
+// leaves room to grow a queued request instead of issuing a second one for
+// the same texture. The number of requests in flight follows the measured
+// throughput between a floor and setMaxConcurrency().
+//
+// getByteRange(), extendByteRange(), setPriority() and cancel() may be called
+// from any thread. process() and getConcurrency() must not run on two
+// threads at once.
+class LLCurlTextureRequest
+{
+public:
+	typedef std::vector<std::string> headers_t;
+
+	LLCurlTextureRequest(S32 max_concurrency = DEFAULT_MAX_CONCURRENCY);
+	~LLCurlTextureRequest();
+
+	// Queues a GET of length bytes at offset (length <= 0: to the end) for id,
+	// replacing any request for id that has not been sent yet.
+	bool getByteRange(const LLUUID& id, const std::string& url, const headers_t& headers,
+					  S32 offset, S32 length, U32 priority, LLCurl::ResponderPtr responder);
+	// Grows the request queued for id to length bytes from its offset.
+	// Returns false if there is none or it has already been sent.
+	bool extendByteRange(const LLUUID& id, S32 length);
+	void setPriority(const LLUUID& id, U32 priority);
+	// Drops a request that has not been sent, its responder is never called
+	bool cancel(const LLUUID& id);
+
+	// Note: call once per frame
+	S32  process();
+	S32  getQueued();
+	// True when a full window of requests is already waiting to be sent
+	bool isSaturated();
+
+	void setMaxConcurrency(S32 count);
+	S32  getConcurrency() const { return mConcurrency; }
+	void setPipelining(bool pipelining);
+
+	enum
+	{
+		DEFAULT_MAX_CONCURRENCY = 32,
+		MIN_CONCURRENCY = 2
+	};
+
+private:
+	class Completion;
+	friend class Completion;
+
+	struct Request
+	{
+		LLUUID mID;
+		std::string mURL;
+		headers_t mHeaders;
+		S32 mOffset;
+		S32 mLength;
+		U32 mPriority;
+		LLCurl::ResponderPtr mResponder;
+	};
+
+	void startRequests();
+	bool startRequest(Request* request);
+	void requestDone(U32 status, S32 bytes);
+	void updateConcurrency();
+	void queueRequest(Request* request); // mMutex locked
+	Request* dequeueRequest(const LLUUID& id); // mMutex locked
+
+private:
+	typedef std::multimap<U32, Request*, std::greater<U32> > pending_queue_t;
+	typedef std::map<LLUUID, pending_queue_t::iterator> pending_map_t;
+	pending_queue_t mPendingQueue;
+	pending_map_t mPendingMap;
+	LLMutex* mMutex;	// Guards the pending requests only
+
+	LLCurl::Multi* mMulti;
+	S32 mActiveCount;
+	S32 mConcurrency;
+	S32 mMaxConcurrency;
+
+	// Throughput measurement for the current window
+	LLTimer mWindowTimer;
+	S32 mWindowBytes;
+	S32 mWindowErrors;
+	bool mWindowSaturated;
+	F32 mLastThroughput;
+};
+
 class LLCurlEasyRequest
 {
 public:
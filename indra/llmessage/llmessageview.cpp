@@ -0,0 +1,261 @@
+/**
+ * @file llmessageview.cpp
+ * @brief Base of the typed message views generated from message_template.msg
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llmessageview.h"
+
+#include "llmessagetemplate.h"
+#include "llquaternion.h"
+#include "v3dmath.h"
+#include "v3math.h"
+#include "v4math.h"
+
+//static
+void LLMessageView::resolve(Layout& layout)
+{
+	if (layout.mResolved)
+	{
+		return;
+	}
+	LLMessageStringTable* strings = LLMessageStringTable::getInstance();
+	layout.mName = strings->getString(layout.mName);
+	for (S32 i = 0; i < layout.mNumBlocks; ++i)
+	{
+		BlockLayout& block = layout.mBlocks[i];
+		block.mName = strings->getString(block.mName);
+		for (S32 j = 0; j < block.mNumVars; ++j)
+		{
+			block.mVars[j].mName = strings->getString(block.mVars[j].mName);
+		}
+	}
+	layout.mResolved = TRUE;
+}
+
+//static
+BOOL LLMessageView::matches(const Layout& layout, const LLMessageTemplate* msg_template)
+{
+	// Names are canonical on both sides, pointers can be compared
+	if (!msg_template
+		|| msg_template->mName != layout.mName
+		|| (S32)msg_template->mMemberBlocks.size() != layout.mNumBlocks)
+	{
+		return FALSE;
+	}
+
+	S32 i = 0;
+	for (LLMessageTemplate::message_block_map_t::const_iterator block_iter = msg_template->mMemberBlocks.begin();
+		 block_iter != msg_template->mMemberBlocks.end(); ++block_iter, ++i)
+	{
+		const LLMessageBlock* mbci = *block_iter;
+		const BlockLayout& block = layout.mBlocks[i];
+		if (mbci->mName != block.mName
+			|| (S32)mbci->mMemberVariables.size() != block.mNumVars)
+		{
+			return FALSE;
+		}
+
+		S32 j = 0;
+		for (LLMessageBlock::message_variable_map_t::const_iterator var_iter = mbci->mMemberVariables.begin();
+			 var_iter != mbci->mMemberVariables.end(); ++var_iter, ++j)
+		{
+			const LLMessageVariable* mvci = *var_iter;
+			const VarLayout& var = block.mVars[j];
+			if (mvci->getName() != var.mName
+				|| mvci->getType() != var.mType
+				|| mvci->getSize() != var.mSize)
+			{
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+LLMessageView::LLMessageView(LLMessageSystem* msg, Layout& layout)
+	: mMsg(msg),
+	  mLayout(layout),
+	  mReader(NULL)
+{
+	resolve(layout);
+
+	LLTemplateMessageReader* reader = msg->getTemplateMessageReader();
+	if (!reader)
+	{
+		return;
+	}
+
+	// Compared once per template, after that a view costs a pointer compare
+	const LLMessageTemplate* msg_template = reader->getMessageTemplate();
+	if (msg_template != layout.mCheckedTemplate)
+	{
+		layout.mCheckedTemplate = msg_template;
+		layout.mMatches = matches(layout, msg_template);
+		if (!layout.mMatches)
+		{
+			llwarns << "Message " << layout.mName << " does not match the template "
+				<< "llmessageviews.h was generated from, reading it by name" << llendl;
+		}
+	}
+	if (layout.mMatches)
+	{
+		mReader = reader;
+	}
+}
+
+F32 LLMessageView::readF32(S32 block, S32 var, S32 blocknum) const
+{
+	F32 data;
+	if (!mReader)
+	{
+		mMsg->getF32Fast(blockName(block), varName(block, var), data, blocknum);
+		return data;
+	}
+
+	mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	if (!llfinite(data))
+	{
+		llwarns << "non-finite in " << mLayout.mName << " " << blockName(block)
+			<< " " << varName(block, var) << llendl;
+		data = 0.f;
+	}
+	return data;
+}
+
+F64 LLMessageView::readF64(S32 block, S32 var, S32 blocknum) const
+{
+	F64 data;
+	if (!mReader)
+	{
+		mMsg->getF64Fast(blockName(block), varName(block, var), data, blocknum);
+		return data;
+	}
+
+	mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	if (!llfinite(data))
+	{
+		llwarns << "non-finite in " << mLayout.mName << " " << blockName(block)
+			<< " " << varName(block, var) << llendl;
+		data = 0.0;
+	}
+	return data;
+}
+
+LLVector3 LLMessageView::readVector3(S32 block, S32 var, S32 blocknum) const
+{
+	LLVector3 data;
+	if (!mReader)
+	{
+		mMsg->getVector3Fast(blockName(block), varName(block, var), data, blocknum);
+		return data;
+	}
+
+	mReader->getDataAt(block, var, &data.mV[0], sizeof(data.mV), blocknum);
+	if (!data.isFinite())
+	{
+		llwarns << "non-finite in " << mLayout.mName << " " << blockName(block)
+			<< " " << varName(block, var) << llendl;
+		data.zeroVec();
+	}
+	return data;
+}
+
+LLVector4 LLMessageView::readVector4(S32 block, S32 var, S32 blocknum) const
+{
+	LLVector4 data;
+	if (!mReader)
+	{
+		mMsg->getVector4Fast(blockName(block), varName(block, var), data, blocknum);
+		return data;
+	}
+
+	mReader->getDataAt(block, var, &data.mV[0], sizeof(data.mV), blocknum);
+	if (!data.isFinite())
+	{
+		llwarns << "non-finite in " << mLayout.mName << " " << blockName(block)
+			<< " " << varName(block, var) << llendl;
+		data.zeroVec();
+	}
+	return data;
+}
+
+LLVector3d LLMessageView::readVector3d(S32 block, S32 var, S32 blocknum) const
+{
+	LLVector3d data;
+	if (!mReader)
+	{
+		mMsg->getVector3dFast(blockName(block), varName(block, var), data, blocknum);
+		return data;
+	}
+
+	mReader->getDataAt(block, var, &data.mdV[0], sizeof(data.mdV), blocknum);
+	if (!data.isFinite())
+	{
+		llwarns << "non-finite in " << mLayout.mName << " " << blockName(block)
+			<< " " << varName(block, var) << llendl;
+		data.zeroVec();
+	}
+	return data;
+}
+
+LLQuaternion LLMessageView::readQuat(S32 block, S32 var, S32 blocknum) const
+{
+	LLQuaternion data;
+	if (!mReader)
+	{
+		mMsg->getQuatFast(blockName(block), varName(block, var), data, blocknum);
+		return data;
+	}
+
+	// Sent packed as the vector part, see LLQuaternion::packToVector3()
+	LLVector3 vec;
+	mReader->getDataAt(block, var, &vec.mV[0], sizeof(vec.mV), blocknum);
+	if (vec.isFinite())
+	{
+		data.unpackFromVector3(vec);
+	}
+	else
+	{
+		llwarns << "non-finite in " << mLayout.mName << " " << blockName(block)
+			<< " " << varName(block, var) << llendl;
+		data.loadIdentity();
+	}
+	return data;
+}
+
+void LLMessageView::readString(S32 block, S32 var, S32 blocknum, std::string& str) const
+{
+	if (!mReader)
+	{
+		mMsg->getStringFast(blockName(block), varName(block, var), str, blocknum);
+		return;
+	}
+
+	char buffer[MTUBYTES + 1] = {0};
+	mReader->getDataAt(block, var, buffer, 0, blocknum, MTUBYTES);
+	buffer[MTUBYTES] = '\0';
+	str = buffer;
+}
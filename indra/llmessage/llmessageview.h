@@ -0,0 +1,345 @@
+/**
+ * @file llmessageview.h
+ * @brief Base of the typed message views generated from message_template.msg
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLMESSAGEVIEW_H
+#define LL_LLMESSAGEVIEW_H
+
+#include "llmsgvariabletype.h"
+#include "lltemplatemessagereader.h"
+#include "message.h"
+
+class LLMessageTemplate;
+
+// Typed access to the message being handled, without looking blocks and
+// variables up by name.  scripts/gen_message_views.py writes a subclass of
+// this for every message in message_template.msg into llmessageviews.h,
+// with a getter per variable:
+//
+//	LLMessageViews::ObjectUpdate view(mesgsys);
+//	U64 region_handle = view.getRegionData().getRegionHandle();
+//	for (S32 i = 0; i < view.getObjectDataCount(); ++i)
+//	{
+//		U32 local_id = view.getObjectData(i).getID();
+//
+// Views know where each variable sits in the template, so when the message
+// came in through LLTemplateMessageReader they read it by position.  For
+// LLSD messages, or if the template loaded at runtime does not match the one
+// the views were generated from, they fall back on the by-name getters of
+// LLMessageSystem.  The two APIs can be mixed in one handler.
+class LLMessageView
+{
+public:
+	// The shape of a message as the generator saw it. Names start out as
+	// plain literals and are swapped for the canonical strings of
+	// LLMessageStringTable on first use.
+	struct VarLayout
+	{
+		const char* mName;
+		EMsgVariableType mType;
+		S32 mSize;	// for MVT_VARIABLE the size of the length prefix
+	};
+
+	struct BlockLayout
+	{
+		const char* mName;
+		S32 mNumVars;
+		VarLayout* mVars;
+	};
+
+	struct Layout
+	{
+		const char* mName;
+		S32 mNumBlocks;
+		BlockLayout* mBlocks;
+		BOOL mResolved;
+		const LLMessageTemplate* mCheckedTemplate;	// last template compared against
+		BOOL mMatches;
+	};
+
+	// Swaps the names in layout for canonical strings, once
+	static void resolve(Layout& layout);
+
+	LLMessageView(LLMessageSystem* msg, Layout& layout);
+
+	const char* getMessageName() const { return mLayout.mName; }
+
+	// For the generated accessors. Blocks and variables are counted in
+	// template order.
+	S32 getBlockCount(S32 block) const;
+	S32 getVarSize(S32 block, S32 var, S32 blocknum) const;
+
+	BOOL readBOOL(S32 block, S32 var, S32 blocknum) const;
+	S8 readS8(S32 block, S32 var, S32 blocknum) const;
+	U8 readU8(S32 block, S32 var, S32 blocknum) const;
+	S16 readS16(S32 block, S32 var, S32 blocknum) const;
+	U16 readU16(S32 block, S32 var, S32 blocknum) const;
+	S32 readS32(S32 block, S32 var, S32 blocknum) const;
+	U32 readU32(S32 block, S32 var, S32 blocknum) const;
+	U64 readU64(S32 block, S32 var, S32 blocknum) const;
+	F32 readF32(S32 block, S32 var, S32 blocknum) const;
+	F64 readF64(S32 block, S32 var, S32 blocknum) const;
+	LLVector3 readVector3(S32 block, S32 var, S32 blocknum) const;
+	LLVector4 readVector4(S32 block, S32 var, S32 blocknum) const;
+	LLVector3d readVector3d(S32 block, S32 var, S32 blocknum) const;
+	LLQuaternion readQuat(S32 block, S32 var, S32 blocknum) const;
+	LLUUID readUUID(S32 block, S32 var, S32 blocknum) const;
+	U32 readIPAddr(S32 block, S32 var, S32 blocknum) const;
+	U16 readIPPort(S32 block, S32 var, S32 blocknum) const;
+	void readBinary(S32 block, S32 var, S32 blocknum, void* datap, S32 size,
+					S32 max_size = S32_MAX) const;
+	void readString(S32 block, S32 var, S32 blocknum, std::string& str) const;
+
+private:
+	const char* blockName(S32 block) const { return mLayout.mBlocks[block].mName; }
+	const char* varName(S32 block, S32 var) const { return mLayout.mBlocks[block].mVars[var].mName; }
+
+	static BOOL matches(const Layout& layout, const LLMessageTemplate* msg_template);
+
+	LLMessageSystem* mMsg;
+	const Layout& mLayout;
+	LLTemplateMessageReader* mReader;	// NULL to read by name
+};
+
+// Base of the generated builders in llmessageviews.h, which wrap
+// newMessageFast(), nextBlockFast() and the add*Fast() calls with names
+// that are checked when the viewer compiles:
+//
+//	LLMessageBuilders::RequestMultipleObjects builder(msg);
+//	builder.nextAgentData().addAgentID(agent_id).addSessionID(session_id);
+class LLMessageViewBuilder
+{
+public:
+	LLMessageViewBuilder(LLMessageSystem* msg, LLMessageView::Layout& layout)
+		: mMsg(msg), mLayout(layout)
+	{
+		LLMessageView::resolve(layout);
+		msg->newMessageFast(layout.mName);
+	}
+
+	// Adds to the block nextBlock() started, returned by the generated
+	// next*() methods
+	class BlockBuilder
+	{
+	public:
+		BlockBuilder(LLMessageSystem* msg, const LLMessageView::BlockLayout& block)
+			: mMsg(msg), mBlock(block) {}
+
+	protected:
+		const char* varName(S32 var) const { return mBlock.mVars[var].mName; }
+
+		LLMessageSystem* mMsg;
+		const LLMessageView::BlockLayout& mBlock;
+	};
+
+protected:
+	const LLMessageView::BlockLayout& nextBlock(S32 block)
+	{
+		const LLMessageView::BlockLayout& block_layout = mLayout.mBlocks[block];
+		mMsg->nextBlockFast(block_layout.mName);
+		return block_layout;
+	}
+
+	LLMessageSystem* mMsg;
+	const LLMessageView::Layout& mLayout;
+};
+
+inline S32 LLMessageView::getBlockCount(S32 block) const
+{
+	return mReader ? mReader->getNumberOfBlocksAt(block)
+				   : mMsg->getNumberOfBlocksFast(blockName(block));
+}
+
+inline S32 LLMessageView::getVarSize(S32 block, S32 var, S32 blocknum) const
+{
+	return mReader ? mReader->getSizeAt(block, blocknum, var)
+				   : mMsg->getSizeFast(blockName(block), blocknum, varName(block, var));
+}
+
+inline S8 LLMessageView::readS8(S32 block, S32 var, S32 blocknum) const
+{
+	S8 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getS8Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline U8 LLMessageView::readU8(S32 block, S32 var, S32 blocknum) const
+{
+	U8 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getU8Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline S16 LLMessageView::readS16(S32 block, S32 var, S32 blocknum) const
+{
+	S16 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getS16Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline U16 LLMessageView::readU16(S32 block, S32 var, S32 blocknum) const
+{
+	U16 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getU16Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline S32 LLMessageView::readS32(S32 block, S32 var, S32 blocknum) const
+{
+	S32 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getS32Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline U32 LLMessageView::readU32(S32 block, S32 var, S32 blocknum) const
+{
+	U32 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getU32Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline U64 LLMessageView::readU64(S32 block, S32 var, S32 blocknum) const
+{
+	U64 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getU64Fast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline BOOL LLMessageView::readBOOL(S32 block, S32 var, S32 blocknum) const
+{
+	if (mReader)
+	{
+		U8 data;
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+		return (BOOL) data;
+	}
+	BOOL data;
+	mMsg->getBOOLFast(blockName(block), varName(block, var), data, blocknum);
+	return data;
+}
+
+inline LLUUID LLMessageView::readUUID(S32 block, S32 var, S32 blocknum) const
+{
+	LLUUID data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data.mData[0], sizeof(data.mData), blocknum);
+	}
+	else
+	{
+		mMsg->getUUIDFast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline U32 LLMessageView::readIPAddr(S32 block, S32 var, S32 blocknum) const
+{
+	U32 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+	}
+	else
+	{
+		mMsg->getIPAddrFast(blockName(block), varName(block, var), data, blocknum);
+	}
+	return data;
+}
+
+inline U16 LLMessageView::readIPPort(S32 block, S32 var, S32 blocknum) const
+{
+	U16 data;
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, &data, sizeof(data), blocknum);
+		return ntohs(data);
+	}
+	mMsg->getIPPortFast(blockName(block), varName(block, var), data, blocknum);
+	return data;
+}
+
+inline void LLMessageView::readBinary(S32 block, S32 var, S32 blocknum, void* datap,
+									  S32 size, S32 max_size) const
+{
+	if (mReader)
+	{
+		mReader->getDataAt(block, var, datap, size, blocknum, max_size);
+	}
+	else
+	{
+		mMsg->getBinaryDataFast(blockName(block), varName(block, var), datap, size, blocknum, max_size);
+	}
+}
+
+#endif // LL_LLMESSAGEVIEW_H
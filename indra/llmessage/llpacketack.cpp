@@ -29,12 +29,15 @@
 #include "linden_common.h"
 #include "llpacketack.h"
 
+#include <algorithm>
+
 #if !LL_WINDOWS
 #include <netinet/in.h>
 #else
 #include "winsock2.h"
 #endif
 
+#include "bitpack.h"
 #include "message.h"
 
 LLReliablePacket::LLReliablePacket(
@@ -80,3 +83,336 @@ LLReliablePacket::LLReliablePacket(
 			
 	}
 }
+
+// Packet IDs count modulo LL_MAX_OUT_PACKET_ID
+static inline U32 packet_id_distance(TPACKETID from, TPACKETID to)
+{
+	return (to - from) & (LL_MAX_OUT_PACKET_ID - 1);
+}
+
+LLReliablePacketWindow::LLReliablePacketWindow()
+:	mSlots(MIN_SLOTS, (LLReliablePacket*)NULL),
+	mUsedBits(MIN_SLOTS / 32, 0),
+	mFinalBits(MIN_SLOTS / 32, 0),
+	mMask(MIN_SLOTS - 1),
+	mNewestID(0),
+	mCount(0)
+{
+}
+
+//static
+void LLReliablePacketWindow::setBit(std::vector<U32>& bits, S32 pos, BOOL on)
+{
+	U32 bit = 1U << (pos & 31);
+	if (on)
+	{
+		bits[pos >> 5] |= bit;
+	}
+	else
+	{
+		bits[pos >> 5] &= ~bit;
+	}
+}
+
+void LLReliablePacketWindow::grow()
+{
+	std::vector<LLReliablePacket*> old_slots;
+	old_slots.swap(mSlots);
+	std::vector<U32> old_final;
+	old_final.swap(mFinalBits);
+
+	U32 size = (U32)old_slots.size() * 2;
+	mSlots.assign(size, (LLReliablePacket*)NULL);
+	mUsedBits.assign(size / 32, 0);
+	mFinalBits.assign(size / 32, 0);
+	mMask = size - 1;
+
+	// IDs apart in the low bits stay apart with one more bit
+	for (S32 i = 0; i < (S32)old_slots.size(); ++i)
+	{
+		LLReliablePacket* packet = old_slots[i];
+		if (packet)
+		{
+			S32 pos = packet->mPacketID & mMask;
+			mSlots[pos] = packet;
+			setBit(mUsedBits, pos, TRUE);
+			setBit(mFinalBits, pos, (old_final[i >> 5] >> (i & 31)) & 1);
+		}
+	}
+}
+
+void LLReliablePacketWindow::add(LLReliablePacket* packet, BOOL final_retry)
+{
+	TPACKETID id = packet->mPacketID;
+	if (!mCount || packet_id_distance(mNewestID, id) < LL_MAX_OUT_PACKET_ID / 2)
+	{
+		mNewestID = id;
+	}
+
+	while (mSlots[id & mMask] && mSlots.size() < MAX_SLOTS)
+	{
+		grow();
+	}
+
+	S32 pos = id & mMask;
+	LLReliablePacket* old_packet = mSlots[pos];
+	if (old_packet)
+	{
+		// Still waiting after a whole window of packets went out after it
+		mOverflow[old_packet->mPacketID] = std::make_pair(old_packet, isFinalSlot(pos));
+	}
+	else
+	{
+		setBit(mUsedBits, pos, TRUE);
+	}
+	mSlots[pos] = packet;
+	setBit(mFinalBits, pos, final_retry);
+	mCount++;
+}
+
+LLReliablePacket* LLReliablePacketWindow::find(TPACKETID id, BOOL* final_retry) const
+{
+	S32 pos = id & mMask;
+	LLReliablePacket* packet = mSlots[pos];
+	if (packet && packet->mPacketID == id)
+	{
+		if (final_retry)
+		{
+			*final_retry = isFinalSlot(pos);
+		}
+		return packet;
+	}
+
+	if (!mOverflow.empty())
+	{
+		overflow_map_t::const_iterator iter = mOverflow.find(id);
+		if (iter != mOverflow.end())
+		{
+			if (final_retry)
+			{
+				*final_retry = iter->second.second;
+			}
+			return iter->second.first;
+		}
+	}
+	return NULL;
+}
+
+LLReliablePacket* LLReliablePacketWindow::remove(TPACKETID id)
+{
+	S32 pos = id & mMask;
+	LLReliablePacket* packet = mSlots[pos];
+	if (packet && packet->mPacketID == id)
+	{
+		mSlots[pos] = NULL;
+		setBit(mUsedBits, pos, FALSE);
+		setBit(mFinalBits, pos, FALSE);
+		mCount--;
+		return packet;
+	}
+
+	if (!mOverflow.empty())
+	{
+		overflow_map_t::iterator iter = mOverflow.find(id);
+		if (iter != mOverflow.end())
+		{
+			packet = iter->second.first;
+			mOverflow.erase(iter);
+			mCount--;
+			return packet;
+		}
+	}
+	return NULL;
+}
+
+void LLReliablePacketWindow::setFinalRetry(TPACKETID id)
+{
+	S32 pos = id & mMask;
+	LLReliablePacket* packet = mSlots[pos];
+	if (packet && packet->mPacketID == id)
+	{
+		setBit(mFinalBits, pos, TRUE);
+		return;
+	}
+
+	overflow_map_t::iterator iter = mOverflow.find(id);
+	if (iter != mOverflow.end())
+	{
+		iter->second.second = TRUE;
+	}
+}
+
+S32 LLReliablePacketWindow::nextInUse(S32 pos, S32 end, BOOL final_retry) const
+{
+	while (pos < end)
+	{
+		S32 word = pos >> 5;
+		U32 bits = mUsedBits[word] & (final_retry ? mFinalBits[word] : ~mFinalBits[word]);
+		bits &= ~0U << (pos & 31);
+		if (bits)
+		{
+			return llmin((word << 5) + ll_lowest_bit(bits), end);
+		}
+		pos = (word + 1) << 5;
+	}
+	return end;
+}
+
+void LLReliablePacketWindow::getPackets(BOOL final_retry, std::vector<LLReliablePacket*>& packets) const
+{
+	// Parked packets are older than anything in the slots
+	for (overflow_map_t::const_iterator iter = mOverflow.begin(); iter != mOverflow.end(); ++iter)
+	{
+		if (iter->second.second == final_retry)
+		{
+			packets.push_back(iter->second.first);
+		}
+	}
+
+	if (!mCount)
+	{
+		return;
+	}
+
+	// The slot after the newest packet holds the oldest
+	S32 size = (S32)mSlots.size();
+	S32 start = (mNewestID + 1) & mMask;
+	for (S32 pos = nextInUse(start, size, final_retry); pos < size; pos = nextInUse(pos + 1, size, final_retry))
+	{
+		packets.push_back(mSlots[pos]);
+	}
+	for (S32 pos = nextInUse(0, start, final_retry); pos < start; pos = nextInUse(pos + 1, start, final_retry))
+	{
+		packets.push_back(mSlots[pos]);
+	}
+}
+
+void LLReliablePacketWindow::getAllPackets(std::vector<LLReliablePacket*>& packets) const
+{
+	getPackets(FALSE, packets);
+	getPackets(TRUE, packets);
+}
+
+TPACKETID LLReliablePacketWindow::getOldestID(TPACKETID newest_id) const
+{
+	if (!mCount)
+	{
+		return newest_id;
+	}
+
+	TPACKETID first = (newest_id + 1) & (LL_MAX_OUT_PACKET_ID - 1);
+	TPACKETID oldest_id = newest_id;
+	U32 oldest_distance = LL_MAX_OUT_PACKET_ID;
+	for (overflow_map_t::const_iterator iter = mOverflow.begin(); iter != mOverflow.end(); ++iter)
+	{
+		U32 distance = packet_id_distance(first, iter->first);
+		if (distance < oldest_distance)
+		{
+			oldest_distance = distance;
+			oldest_id = iter->first;
+		}
+	}
+
+	S32 size = (S32)mSlots.size();
+	S32 start = (mNewestID + 1) & mMask;
+	for (S32 i = 0; i < 2; ++i)
+	{
+		BOOL final_retry = (BOOL)i;
+		S32 pos = nextInUse(start, size, final_retry);
+		if (pos == size)
+		{
+			pos = nextInUse(0, start, final_retry);
+			if (pos == start)
+			{
+				continue;
+			}
+		}
+		TPACKETID id = mSlots[pos]->mPacketID;
+		U32 distance = packet_id_distance(first, id);
+		if (distance < oldest_distance)
+		{
+			oldest_distance = distance;
+			oldest_id = id;
+		}
+	}
+	return oldest_id;
+}
+
+LLRecentPacketIDs::LLRecentPacketIDs()
+:	mSlots(MIN_SLOTS, 0),
+	mMask(MIN_SLOTS - 1),
+	mOldestKept(0),
+	mCount(0)
+{
+}
+
+BOOL LLRecentPacketIDs::isKept(TPACKETID id, TPACKETID newest_id) const
+{
+	return packet_id_distance(mOldestKept, id) <= packet_id_distance(mOldestKept, newest_id);
+}
+
+void LLRecentPacketIDs::grow()
+{
+	std::vector<TPACKETID> old_slots;
+	old_slots.swap(mSlots);
+	U32 size = (U32)old_slots.size() * 2;
+	mSlots.assign(size, 0);
+	mMask = size - 1;
+	for (std::vector<TPACKETID>::const_iterator iter = old_slots.begin(); iter != old_slots.end(); ++iter)
+	{
+		if (*iter)
+		{
+			mSlots[(*iter - 1) & mMask] = *iter;
+		}
+	}
+}
+
+void LLRecentPacketIDs::insert(TPACKETID id)
+{
+	if (!mCount)
+	{
+		mOldestKept = id;
+	}
+
+	TPACKETID held = mSlots[id & mMask];
+	while (held && held != id + 1 && isKept(held - 1, id) && mSlots.size() < MAX_SLOTS)
+	{
+		// The sender could still resend the one in the way, keep both
+		grow();
+		held = mSlots[id & mMask];
+	}
+
+	if (held == id + 1)
+	{
+		return;
+	}
+	if (!held)
+	{
+		mCount++;
+	}
+	// else it pushes out one the sender will not resend, or one a full
+	// table behind when the table is as large as it gets
+	mSlots[id & mMask] = id + 1;
+}
+
+void LLRecentPacketIDs::keepRange(TPACKETID oldest_id, TPACKETID newest_id)
+{
+	mOldestKept = oldest_id;
+	for (std::vector<TPACKETID>::iterator iter = mSlots.begin(); iter != mSlots.end(); ++iter)
+	{
+		if (*iter && !isKept(*iter - 1, newest_id))
+		{
+			*iter = 0;
+			mCount--;
+		}
+	}
+}
+
+void LLRecentPacketIDs::clear()
+{
+	if (mCount)
+	{
+		std::fill(mSlots.begin(), mSlots.end(), 0);
+		mCount = 0;
+	}
+}
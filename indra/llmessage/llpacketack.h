@@ -27,6 +27,9 @@
 #ifndef LL_LLPACKETACK_H
 #define LL_LLPACKETACK_H
 
+#include <map>
+#include <vector>
+
 #include "llhost.h"
 
 class LLReliablePacketParams
@@ -92,7 +95,10 @@ public:
 		mBuffer = NULL;
 	};
 
+	TPACKETID getPacketID() const { return mPacketID; }
+
 	friend class LLCircuitData;
+	friend class LLReliablePacketWindow;
 protected:
 	S32 mSocket;
 	LLHost mHost;
@@ -111,5 +117,106 @@ protected:
 	F64 mExpirationTime;
 };
 
+// The reliable packets a circuit has sent and not had acked, by packet ID.
+// Outgoing IDs are sequential, so a slot per ID modulo a power of two finds
+// a packet in one step, and the slots in use are kept in bit sets so walks
+// skip the acked ones 32 at a time.  Packets still waiting when their slot
+// is wanted again by an ID the window's size later move to an overflow map,
+// which only happens when the window is at its largest.
+//
+// A packet is either on the unacked list, still to be resent, or on the
+// final retry list, waiting out its last timeout.
+class LLReliablePacketWindow
+{
+public:
+	LLReliablePacketWindow();
+
+	// Does not delete the packets, the circuit owns them
+	~LLReliablePacketWindow() {}
+
+	void add(LLReliablePacket* packet, BOOL final_retry);
+
+	// NULL if id is not waiting for an ack
+	LLReliablePacket* find(TPACKETID id, BOOL* final_retry = NULL) const;
+
+	// Removes id and returns its packet, NULL if it was not waiting
+	LLReliablePacket* remove(TPACKETID id);
+
+	// Moves id to the final retry list
+	void setFinalRetry(TPACKETID id);
+
+	S32 size() const { return mCount; }
+	BOOL empty() const { return mCount == 0; }
+
+	// Appends the packets on one list to packets, oldest first
+	void getPackets(BOOL final_retry, std::vector<LLReliablePacket*>& packets) const;
+
+	// The oldest ID waiting for an ack, counting from the one after
+	// newest_id so a wrap of the IDs is handled. newest_id if none are.
+	TPACKETID getOldestID(TPACKETID newest_id) const;
+
+	// Every packet on both lists, in no particular order
+	void getAllPackets(std::vector<LLReliablePacket*>& packets) const;
+
+private:
+	enum
+	{
+		MIN_SLOTS = 64,
+		MAX_SLOTS = 16384
+	};
+
+	typedef std::map<TPACKETID, std::pair<LLReliablePacket*, BOOL> > overflow_map_t;
+
+	void grow();
+	S32 nextInUse(S32 pos, S32 end, BOOL final_retry) const;
+	BOOL isFinalSlot(S32 pos) const { return (mFinalBits[pos >> 5] >> (pos & 31)) & 1; }
+	static void setBit(std::vector<U32>& bits, S32 pos, BOOL on);
+
+	std::vector<LLReliablePacket*> mSlots;
+	std::vector<U32> mUsedBits;		// slot holds a packet
+	std::vector<U32> mFinalBits;	// ...and it is on the final retry list
+	U32 mMask;
+	TPACKETID mNewestID;			// last added, walks start after it
+	overflow_map_t mOverflow;
+	S32 mCount;
+};
+
+// IDs of the reliable packets a circuit received lately, so resends of
+// ones already handled can be dropped.  Each ID has the slot of its low
+// bits and the table doubles when an ID would push out one that is still
+// newer than the sender's oldest unacked packet.
+class LLRecentPacketIDs
+{
+public:
+	LLRecentPacketIDs();
+
+	void insert(TPACKETID id);
+	BOOL contains(TPACKETID id) const
+	{
+		return mSlots[id & mMask] == id + 1;
+	}
+
+	// Forgets everything not in [oldest_id, newest_id], modulo the ID range
+	void keepRange(TPACKETID oldest_id, TPACKETID newest_id);
+
+	void clear();
+	S32 size() const { return mCount; }
+
+private:
+	enum
+	{
+		MIN_SLOTS = 256,
+		MAX_SLOTS = 65536
+	};
+
+	void grow();
+	BOOL isKept(TPACKETID id, TPACKETID newest_id) const;
+
+	std::vector<TPACKETID> mSlots;	// ID + 1, 0 for an empty slot
+	U32 mMask;
+	TPACKETID mOldestKept;	// the sender's last oldest unacked packet
+	S32 mCount;
+};
+
 #endif
 
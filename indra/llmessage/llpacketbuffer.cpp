@@ -34,24 +34,9 @@
 
 ///////////////////////////////////////////////////////////
 
-LLPacketBuffer::LLPacketBuffer(const LLHost &host, const char *datap, const S32 size) : mHost(host)
+LLPacketBuffer::LLPacketBuffer(const LLHost &host, const char *datap, const S32 size)
 {
-	mSize = 0;
-	mData[0] = '!';
-
-	if (size > NET_BUFFER_SIZE)
-	{
-		llerrs << "Sending packet > " << NET_BUFFER_SIZE << " of size " << size << llendl;
-	}
-	else
-	{
-		if (datap != NULL)
-		{
-			memcpy(mData, datap, size);
-			mSize = size;
-		}
-	}
-	
+	init(host, datap, size);
 }
 
 LLPacketBuffer::LLPacketBuffer (S32 hSocket)
@@ -74,3 +59,43 @@ void LLPacketBuffer::init (S32 hSocket)
 	mReceivingIF = ::get_receiving_interface();
 }
 
+void LLPacketBuffer::init(const LLHost &host, const char *datap, const S32 size)
+{
+	mHost = host;
+	mReceivingIF.invalidate();
+	mSize = 0;
+	mData[0] = '!';
+
+	if (size > NET_BUFFER_SIZE)
+	{
+		llerrs << "Sending packet > " << NET_BUFFER_SIZE << " of size " << size << llendl;
+	}
+	else
+	{
+		if (datap != NULL)
+		{
+			memcpy(mData, datap, size);
+			mSize = size;
+		}
+	}
+}
+
+// static
+S32 LLPacketBuffer::receiveBatch(S32 hSocket, LLPacketBuffer** packets, S32 count)
+{
+	LLNetDatagram datagrams[MAX_BATCH];
+	count = llmin(count, (S32)MAX_BATCH);
+	for (S32 i = 0; i < count; ++i)
+	{
+		datagrams[i].mData = packets[i]->mData;
+	}
+	S32 received = receive_packets(hSocket, datagrams, count);
+	for (S32 i = 0; i < received; ++i)
+	{
+		LLPacketBuffer* packetp = packets[i];
+		packetp->mSize = datagrams[i].mSize;
+		packetp->mHost.set(datagrams[i].mIP, datagrams[i].mPort);
+		packetp->mReceivingIF.set(datagrams[i].mReceivingIF, INVALID_PORT);
+	}
+	return received;
+}
@@ -40,9 +40,16 @@ public:
 
 	S32			getSize() const					{ return mSize; }
 	const char	*getData() const				{ return mData; }
+	char		*getData()						{ return mData; }
 	LLHost		getHost() const					{ return mHost; }
 	LLHost		getReceivingInterface() const	{ return mReceivingIF; }
 	void init(S32 hSocket);
+	void init(const LLHost &host, const char *datap, const S32 size);
+
+	// Receives up to count (at most MAX_BATCH) packets into packets[] with
+	// one batched call, returns how many arrived
+	enum { MAX_BATCH = 64 };
+	static S32 receiveBatch(S32 hSocket, LLPacketBuffer** packets, S32 count);
 
 protected:
 	char	mData[NET_BUFFER_SIZE];        // packet data		/* Flawfinder : ignore */
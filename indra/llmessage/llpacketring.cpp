@@ -33,8 +33,12 @@
 #include "lltimer.h"
 #include "timing.h"
 #include "llrand.h"
+#include "llstl.h"
 #include "u64.h"
 
+// Enough for the receive and send batches plus a backlog of throttled packets
+const S32 MAX_FREE_PACKET_BUFFERS = 64;
+
 ///////////////////////////////////////////////////////////
 LLPacketRing::LLPacketRing () :
 	mUseInThrottle(FALSE),
@@ -47,8 +51,15 @@ LLPacketRing::LLPacketRing () :
 	mInBufferLength(0),
 	mOutBufferLength(0),
 	mDropPercentage(0.0f),
-	mPacketsToDrop(0x0)
+	mPacketsToDrop(0x0),
+	mReceiveBatchCount(0),
+	mReceiveBatchNext(0),
+	mCurrentPacket(NULL),
+	mBatchingSends(FALSE),
+	mSendBatchSocket(-1),
+	mSendBatchFailures(0)
 {
+	memset(mReceiveBatch, 0, sizeof(mReceiveBatch));
 }
 
 ///////////////////////////////////////////////////////////
@@ -75,6 +86,46 @@ void LLPacketRing::cleanup ()
 		delete packetp;
 		mSendQueue.pop();
 	}
+
+	for (S32 i = 0; i < RECEIVE_BATCH_SIZE; ++i)
+	{
+		delete mReceiveBatch[i];
+		mReceiveBatch[i] = NULL;
+	}
+	mReceiveBatchCount = 0;
+	mReceiveBatchNext = 0;
+	delete mCurrentPacket;
+	mCurrentPacket = NULL;
+
+	for_each(mSendBatch.begin(), mSendBatch.end(), DeletePointer());
+	mSendBatch.clear();
+	mBatchingSends = FALSE;
+
+	for_each(mFreeBuffers.begin(), mFreeBuffers.end(), DeletePointer());
+	mFreeBuffers.clear();
+}
+
+LLPacketBuffer* LLPacketRing::allocPacketBuffer()
+{
+	if (mFreeBuffers.empty())
+	{
+		return new LLPacketBuffer(LLHost(), NULL, 0);
+	}
+	LLPacketBuffer* packetp = mFreeBuffers.back();
+	mFreeBuffers.pop_back();
+	return packetp;
+}
+
+void LLPacketRing::freePacketBuffer(LLPacketBuffer* packetp)
+{
+	if ((S32)mFreeBuffers.size() < MAX_FREE_PACKET_BUFFERS)
+	{
+		mFreeBuffers.push_back(packetp);
+	}
+	else
+	{
+		delete packetp;
+	}
 }
 
 ///////////////////////////////////////////////////////////
@@ -109,7 +160,33 @@ void LLPacketRing::setOutBandwidth(const F32 bps)
 	mOutThrottle.setRate(bps);
 }
 ///////////////////////////////////////////////////////////
-S32 LLPacketRing::receiveFromRing (S32 socket, char *datap)
+LLPacketBuffer* LLPacketRing::receiveFromNet(S32 socket)
+{
+	if (mReceiveBatchNext >= mReceiveBatchCount)
+	{
+		// Batch used up, refill it with one batched receive
+		for (S32 i = 0; i < RECEIVE_BATCH_SIZE; ++i)
+		{
+			if (!mReceiveBatch[i])
+			{
+				mReceiveBatch[i] = allocPacketBuffer();
+			}
+		}
+		mReceiveBatchCount = LLPacketBuffer::receiveBatch(socket, mReceiveBatch, RECEIVE_BATCH_SIZE);
+		mReceiveBatchNext = 0;
+		if (!mReceiveBatchCount)
+		{
+			return NULL;
+		}
+	}
+
+	LLPacketBuffer* packetp = mReceiveBatch[mReceiveBatchNext];
+	mReceiveBatch[mReceiveBatchNext++] = NULL;
+	return packetp;
+}
+
+///////////////////////////////////////////////////////////
+S32 LLPacketRing::receiveFromRing (S32 socket, char **datap)
 {
 
 	if (mInThrottle.checkOverflow(0))
@@ -129,14 +206,11 @@ S32 LLPacketRing::receiveFromRing (S32 socket, char *datap)
 	packetp = mReceiveQueue.front();
 	mReceiveQueue.pop();
 	packet_size = packetp->getSize();
-	if (packetp->getData() != NULL)
-	{
-		memcpy(datap, packetp->getData(), packet_size);	/*Flawfinder: ignore*/
-	}
+	*datap = packetp->getData();
 	// need to set sender IP/port!!
 	mLastSender = packetp->getHost();
 	mLastReceivingIF = packetp->getReceivingInterface();
-	delete packetp;
+	mCurrentPacket = packetp;
 
 	this->mInBufferLength -= packet_size;
 
@@ -146,66 +220,54 @@ S32 LLPacketRing::receiveFromRing (S32 socket, char *datap)
 }
 
 ///////////////////////////////////////////////////////////
-S32 LLPacketRing::receivePacket (S32 socket, char *datap)
+S32 LLPacketRing::receivePacket (S32 socket, char **datap)
 {
 	S32 packet_size = 0;
+	*datap = NULL;
+
+	// The caller is done with the last packet
+	if (mCurrentPacket)
+	{
+		freePacketBuffer(mCurrentPacket);
+		mCurrentPacket = NULL;
+	}
 
 	// If using the throttle, simulate a limited size input buffer.
 	if (mUseInThrottle)
 	{
-		BOOL done = FALSE;
-
-		// push any current net packet (if any) onto delay ring
-		while (!done)
+		// push any current net packets onto delay ring
+		LLPacketBuffer *packetp;
+		while ((packetp = receiveFromNet(socket)) != NULL)
 		{
-			LLPacketBuffer *packetp;
-			packetp = new LLPacketBuffer(socket);
+			if (!packetp->getSize())
+			{
+				freePacketBuffer(packetp);
+				continue;
+			}
+
+			mActualBitsIn += packetp->getSize() * 8;
 
-			if (packetp->getSize())
+			// Fake packet loss
+			if (mDropPercentage && (ll_frand(100.f) < mDropPercentage))
 			{
-				mActualBitsIn += packetp->getSize() * 8;
-
-				// Fake packet loss
-				if (mDropPercentage && (ll_frand(100.f) < mDropPercentage))
-				{
-					mPacketsToDrop++;
-				}
-
-				if (mPacketsToDrop)
-				{
-					delete packetp;
-					packetp = NULL;
-					packet_size = 0;
-					mPacketsToDrop--;
-				}
+				mPacketsToDrop++;
 			}
 
-			// If we faked packet loss, then we don't have a packet
-			// to use for buffer overflow testing
-			if (packetp)
+			if (mPacketsToDrop)
 			{
-				if (mInBufferLength + packetp->getSize() > mMaxBufferLength)
-				{
-					// Toss it.
-					llwarns << "Throwing away packet, overflowing buffer" << llendl;
-					delete packetp;
-					packetp = NULL;
-				}
-				else if (packetp->getSize())
-				{
-					mReceiveQueue.push(packetp);
-					mInBufferLength += packetp->getSize();
-				}
-				else
-				{
-					delete packetp;
-					packetp = NULL;
-					done = true;
-				}
+				freePacketBuffer(packetp);
+				mPacketsToDrop--;
+			}
+			else if (mInBufferLength + packetp->getSize() > mMaxBufferLength)
+			{
+				// Toss it.
+				llwarns << "Throwing away packet, overflowing buffer" << llendl;
+				freePacketBuffer(packetp);
 			}
 			else
 			{
-				// No packetp, keep going? - no packetp == faked packet loss
+				mReceiveQueue.push(packetp);
+				mInBufferLength += packetp->getSize();
 			}
 		}
 
@@ -216,12 +278,15 @@ S32 LLPacketRing::receivePacket (S32 socket, char *datap)
 	else
 	{
 		// no delay, pull straight from net
-		packet_size = receive_packet(socket, datap);		
-		mLastSender = ::get_sender();
-		mLastReceivingIF = ::get_receiving_interface();
-
-		if (packet_size)  // did we actually get a packet?
+		LLPacketBuffer* packetp = receiveFromNet(socket);
+		if (packetp)  // did we actually get a packet?
 		{
+			mCurrentPacket = packetp;
+			packet_size = packetp->getSize();
+			*datap = packetp->getData();
+			mLastSender = packetp->getHost();
+			mLastReceivingIF = packetp->getReceivingInterface();
+
 			if (mDropPercentage && (ll_frand(100.f) < mDropPercentage))
 			{
 				mPacketsToDrop++;
@@ -243,7 +308,7 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 	BOOL status = TRUE;
 	if (!mUseOutThrottle)
 	{
-		return send_packet(h_socket, send_buffer, buf_size, host.getAddress(), host.getPort() );
+		return sendToNet(h_socket, send_buffer, buf_size, host);
 	}
 	else
 	{
@@ -264,16 +329,16 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 				mOutBufferLength -= packetp->getSize();
 				packet_size = packetp->getSize();
 
-				status = send_packet(h_socket, packetp->getData(), packet_size, packetp->getHost().getAddress(), packetp->getHost().getPort());
+				status = sendToNet(h_socket, packetp->getData(), packet_size, packetp->getHost());
 				
-				delete packetp;
+				freePacketBuffer(packetp);
 				// Update the throttle
 				mOutThrottle.throttleOverflow(packet_size * 8.f);
 			}
 			else
 			{
 				// If the queue's empty, we can just send this packet right away.
-				status = send_packet(h_socket, send_buffer, buf_size, host.getAddress(), host.getPort() );
+				status = sendToNet(h_socket, send_buffer, buf_size, host);
 				packet_size = buf_size;
 
 				// Update the throttle
@@ -302,7 +367,8 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 				llinfos << "Outbound packet queue " << mOutBufferLength << " bytes" << llendl;
 				queue_timer.reset();
 			}
-			packetp = new LLPacketBuffer(host, send_buffer, buf_size);
+			packetp = allocPacketBuffer();
+			packetp->init(host, send_buffer, buf_size);
 
 			mOutBufferLength += packetp->getSize();
 			mSendQueue.push(packetp);
@@ -311,3 +377,62 @@ BOOL LLPacketRing::sendPacket(int h_socket, char * send_buffer, S32 buf_size, LL
 
 	return status;
 }
+
+BOOL LLPacketRing::sendToNet(int h_socket, const char* send_buffer, S32 buf_size, const LLHost& host)
+{
+	if (!mBatchingSends)
+	{
+		return send_packet(h_socket, send_buffer, buf_size, host.getAddress(), host.getPort());
+	}
+
+	if (!mSendBatch.empty()
+		&& (h_socket != mSendBatchSocket || mSendBatch.size() >= SEND_BATCH_SIZE))
+	{
+		mSendBatchFailures += sendBatch();
+	}
+	// send_buffer gets reused for the next message, keep a copy
+	LLPacketBuffer* packetp = allocPacketBuffer();
+	packetp->init(host, send_buffer, buf_size);
+	mSendBatch.push_back(packetp);
+	mSendBatchSocket = h_socket;
+	return TRUE;
+}
+
+S32 LLPacketRing::sendBatch()
+{
+	S32 count = (S32)mSendBatch.size();
+	if (!count)
+	{
+		return 0;
+	}
+	LLNetDatagram datagrams[SEND_BATCH_SIZE];
+	for (S32 i = 0; i < count; ++i)
+	{
+		LLPacketBuffer* packetp = mSendBatch[i];
+		datagrams[i].mData = packetp->getData();
+		datagrams[i].mSize = packetp->getSize();
+		datagrams[i].mIP = packetp->getHost().getAddress();
+		datagrams[i].mPort = packetp->getHost().getPort();
+		datagrams[i].mReceivingIF = INVALID_HOST_IP_ADDRESS;
+	}
+	S32 failed = send_packets(mSendBatchSocket, datagrams, count);
+	for (S32 i = 0; i < count; ++i)
+	{
+		freePacketBuffer(mSendBatch[i]);
+	}
+	mSendBatch.clear();
+	return failed;
+}
+
+void LLPacketRing::beginSendBatch()
+{
+	mBatchingSends = TRUE;
+}
+
+S32 LLPacketRing::flushSendBatch()
+{
+	S32 failed = mSendBatchFailures + sendBatch();
+	mSendBatchFailures = 0;
+	mBatchingSends = FALSE;
+	return failed;
+}
@@ -29,6 +29,7 @@
 #define LL_LLPACKETRING_H
 
 #include <queue>
+#include <vector>
 
 #include "llpacketbuffer.h"
 #include "llhost.h"
@@ -50,17 +51,43 @@ public:
 	void setUseOutThrottle(const BOOL use_throttle);
 	void setInBandwidth(const F32 bps);
 	void setOutBandwidth(const F32 bps);
-	S32  receivePacket (S32 socket, char *datap);
-	S32  receiveFromRing (S32 socket, char *datap);
+	// Returns the size of the next packet, 0 if there is none. Packets are
+	// read off the socket in batches, *datap points into the ring's own
+	// buffer and stays valid until the next receivePacket() call.
+	S32  receivePacket (S32 socket, char **datap);
+	S32  receiveFromRing (S32 socket, char **datap);
 
 	BOOL sendPacket(int h_socket, char * send_buffer, S32 buf_size, LLHost host);
 
+	// Packets sent between these two go out together, in as few system
+	// calls as the platform allows. sendPacket() reports success for them,
+	// flushSendBatch() returns how many actually failed.
+	void beginSendBatch();
+	S32  flushSendBatch();
+
 	inline LLHost getLastSender();
 	inline LLHost getLastReceivingInterface();
 
 	S32 getAndResetActualInBits()				{ S32 bits = mActualBitsIn; mActualBitsIn = 0; return bits;}
 	S32 getAndResetActualOutBits()				{ S32 bits = mActualBitsOut; mActualBitsOut = 0; return bits;}
 protected:
+	enum
+	{
+		RECEIVE_BATCH_SIZE = 32,
+		SEND_BATCH_SIZE = 32
+	};
+
+	// Packets go through recycled buffers instead of an 8K new/delete each
+	LLPacketBuffer* allocPacketBuffer();
+	void freePacketBuffer(LLPacketBuffer* packetp);
+
+	// Next packet off the socket, NULL when it's drained. The caller owns it.
+	LLPacketBuffer* receiveFromNet(S32 socket);
+
+	// Sends now, or adds to the send batch
+	BOOL sendToNet(int h_socket, const char* send_buffer, S32 buf_size, const LLHost& host);
+	S32 sendBatch();
+
 	BOOL mUseInThrottle;
 	BOOL mUseOutThrottle;
 	
@@ -79,6 +106,17 @@ protected:
 
 	std::queue<LLPacketBuffer *> mReceiveQueue;
 	std::queue<LLPacketBuffer *> mSendQueue;
+	std::vector<LLPacketBuffer *> mFreeBuffers;
+
+	LLPacketBuffer* mReceiveBatch[RECEIVE_BATCH_SIZE];
+	S32 mReceiveBatchCount;			// packets received into mReceiveBatch
+	S32 mReceiveBatchNext;			// next one to hand out
+	LLPacketBuffer* mCurrentPacket;	// last one handed out by receivePacket()
+
+	BOOL mBatchingSends;
+	S32 mSendBatchSocket;
+	S32 mSendBatchFailures;
+	std::vector<LLPacketBuffer *> mSendBatch;
 
 	LLHost mLastSender;
 	LLHost mLastReceivingIF;
@@ -40,6 +40,7 @@
 LLTemplateMessageReader::LLTemplateMessageReader(message_template_number_map_t&
 												 number_template_map) :
 	mReceiveSize(0),
+	mReceiveBuffer(NULL),
 	mCurrentRMessageTemplate(NULL),
 	mCurrentRMessageData(NULL),
 	mMessageNumbers(number_template_map)
@@ -57,11 +58,51 @@ LLTemplateMessageReader::~LLTemplateMessageReader()
 void LLTemplateMessageReader::clearMessage()
 {
 	mReceiveSize = -1;
+	mReceiveBuffer = NULL;
 	mCurrentRMessageTemplate = NULL;
+	mBlockRefs.clear();
+	mVarRefs.clear();
 	delete mCurrentRMessageData;
 	mCurrentRMessageData = NULL;
 }
 
+const LLTemplateMessageReader::LLMsgBlockRef* LLTemplateMessageReader::findBlock(const char* blockname) const
+{
+	// Messages have a handful of blocks at most, and names are canonical
+	// pointers, so a scan beats any map
+	for (std::vector<LLMsgBlockRef>::const_iterator iter = mBlockRefs.begin();
+		 iter != mBlockRefs.end(); ++iter)
+	{
+		if (iter->mBlock->mName == blockname)
+		{
+			// blocks sent with no instances are kept for getDataAt(), but
+			// by name they are not in the message
+			return iter->mCount ? &(*iter) : NULL;
+		}
+	}
+	return NULL;
+}
+
+const LLTemplateMessageReader::LLMsgVarRef* LLTemplateMessageReader::findVariable(const LLMsgBlockRef& block,
+																				  S32 blocknum,
+																				  const char* varname) const
+{
+	S32 num_vars = (S32)block.mBlock->mMemberVariables.size();
+	if (blocknum < 0 || blocknum >= block.mCount || !num_vars)
+	{
+		return NULL;
+	}
+	const LLMsgVarRef* var_ref = &mVarRefs[block.mFirstVar + blocknum * num_vars];
+	for (S32 i = 0; i < num_vars; ++i, ++var_ref)
+	{
+		if (var_ref->mVariable->getName() == varname)
+		{
+			return var_ref;
+		}
+	}
+	return NULL;
+}
+
 void LLTemplateMessageReader::getData(const char *blockname, const char *varname, void *datap, S32 size, S32 blocknum, S32 max_size)
 {
 	// is there a message ready to go?
@@ -71,77 +112,114 @@ void LLTemplateMessageReader::getData(const char *blockname, const char *varname
 		return;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mReceiveBuffer)
 	{
-		llerrs << "Invalid mCurrentMessageData in getData!" << llendl;
+		llerrs << "Invalid mReceiveBuffer in getData!" << llendl;
 		return;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; // this works because it's just a hash.  The bnamep is never derefference
-	char *vnamep = (char *)varname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	const LLMsgBlockRef* block = findBlock(blockname);
+	if (!block || blocknum < 0 || blocknum >= block->mCount)
 	{
 		llerrs << "Block " << blockname << " #" << blocknum
-			<< " not in message " << mCurrentRMessageData->mName << llendl;
+			<< " not in message " << mCurrentRMessageTemplate->mName << llendl;
 		return;
 	}
 
-	LLMsgBlkData *msg_block_data = iter->second;
-	LLMsgVarData& vardata = msg_block_data->mMemberVarData[vnamep];
-
-	if (!vardata.getName())
+	const LLMsgVarRef* vardata = findVariable(*block, blocknum, varname);
+	if (!vardata)
 	{
-		llerrs << "Variable "<< vnamep << " not in message "
-			<< mCurrentRMessageData->mName<< " block " << bnamep << llendl;
+		llerrs << "Variable "<< varname << " not in message "
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return;
 	}
 
-	if (size && size != vardata.getSize())
+	copyData(*vardata, datap, size, max_size);
+}
+
+void LLTemplateMessageReader::copyData(const LLMsgVarRef& vardata, void *datap, S32 size, S32 max_size) const
+{
+	if (size && size != vardata.mSize)
 	{
-		llerrs << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llerrs << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << vardata.mVariable->getName()
+			<< " is size " << vardata.mSize
 			<< " but copying into buffer of size " << size
 			<< llendl;
 		return;
 	}
 
-
-	const S32 vardata_size = vardata.getSize();
-	if( max_size >= vardata_size )
+	const S32 vardata_size = vardata.mSize;
+	if (vardata.mOffset < 0)
+	{
+		// ran off the end of the packet, default to 0s
+		memset(datap, 0, llmin(max_size, vardata_size));
+	}
+	else if( max_size >= vardata_size )
 	{   
-		switch( vardata_size )
-		{ 
-		case 1:
-			*((U8*)datap) = *((U8*)vardata.getData());
-			break;
-		case 2:
-			*((U16*)datap) = *((U16*)vardata.getData());
-			break;
-		case 4:
-			*((U32*)datap) = *((U32*)vardata.getData());
-			break;
-		case 8:
-			((U32*)datap)[0] = ((U32*)vardata.getData())[0];
-			((U32*)datap)[1] = ((U32*)vardata.getData())[1];
-			break;
-		default:
-			memcpy(datap, vardata.getData(), vardata_size);
-			break;
-		}
+		htonmemcpy(datap, mReceiveBuffer + vardata.mOffset, vardata.mVariable->getType(), vardata_size);
 	}
 	else
 	{
-		llwarns << "Msg " << mCurrentRMessageData->mName 
-			<< " variable " << vnamep
-			<< " is size " << vardata.getSize()
+		llwarns << "Msg " << mCurrentRMessageTemplate->mName 
+			<< " variable " << vardata.mVariable->getName()
+			<< " is size " << vardata_size
 			<< " but truncated to max size of " << max_size
 			<< llendl;
 
-		memcpy(datap, vardata.getData(), max_size);
+		memcpy(datap, mReceiveBuffer + vardata.mOffset, max_size);
+	}
+}
+
+const LLTemplateMessageReader::LLMsgVarRef* LLTemplateMessageReader::getVarRefAt(S32 block_index, S32 var_index, S32 blocknum) const
+{
+	if (mReceiveSize == -1 || !mReceiveBuffer)
+	{
+		llerrs << "No message waiting for decode!" << llendl;
+		return NULL;
+	}
+	if (block_index < 0 || block_index >= (S32)mBlockRefs.size())
+	{
+		llerrs << "Block index " << block_index << " not in message "
+			<< mCurrentRMessageTemplate->mName << llendl;
+		return NULL;
+	}
+
+	const LLMsgBlockRef& block = mBlockRefs[block_index];
+	S32 num_vars = (S32)block.mBlock->mMemberVariables.size();
+	if (blocknum < 0 || blocknum >= block.mCount
+		|| var_index < 0 || var_index >= num_vars)
+	{
+		llerrs << "Block " << block.mBlock->mName << " #" << blocknum
+			<< " variable index " << var_index << " not in message "
+			<< mCurrentRMessageTemplate->mName << llendl;
+		return NULL;
+	}
+	return &mVarRefs[block.mFirstVar + blocknum * num_vars + var_index];
+}
+
+S32 LLTemplateMessageReader::getNumberOfBlocksAt(S32 block_index) const
+{
+	if (block_index < 0 || block_index >= (S32)mBlockRefs.size())
+	{
+		return 0;
+	}
+	return mBlockRefs[block_index].mCount;
+}
+
+S32 LLTemplateMessageReader::getSizeAt(S32 block_index, S32 blocknum, S32 var_index) const
+{
+	const LLMsgVarRef* vardata = getVarRefAt(block_index, var_index, blocknum);
+	return vardata ? vardata->mSize : LL_VARIABLE_NOT_IN_BLOCK;
+}
+
+void LLTemplateMessageReader::getDataAt(S32 block_index, S32 var_index, void *datap,
+										S32 size, S32 blocknum, S32 max_size) const
+{
+	const LLMsgVarRef* vardata = getVarRefAt(block_index, var_index, blocknum);
+	if (vardata)
+	{
+		copyData(*vardata, datap, size, max_size);
 	}
 }
 
@@ -154,22 +232,14 @@ S32 LLTemplateMessageReader::getNumberOfBlocks(const char *blockname)
 		return -1;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mReceiveBuffer)
 	{
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "Invalid mReceiveBuffer in getNumberOfBlocks!" << llendl;
 		return -1;
 	}
 
-	char *bnamep = (char *)blockname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
-	{
-		return 0;
-	}
-
-	return (iter->second)->mBlockNumber;
+	const LLMsgBlockRef* block = findBlock(blockname);
+	return block ? block->mCount : 0;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
@@ -181,43 +251,36 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, const char *varname)
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mReceiveBuffer)
 	{	// This is a serious error - crash
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "Invalid mReceiveBuffer in getSize!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	const LLMsgBlockRef* block = findBlock(blockname);
+	if (!block)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message "
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " not in message "
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
 
-	char *vnamep = (char *)varname; 
-
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	const LLMsgVarRef* vardata = findVariable(*block, 0, varname);
+	if (!vardata)
 	{	// don't crash
 		llinfos << "Variable " << varname << " not in message "
-			<< mCurrentRMessageData->mName << " block " << bnamep << llendl;
+			<< mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	if (mCurrentRMessageTemplate->mMemberBlocks[bnamep]->mType != MBT_SINGLE)
+	if (block->mBlock->mType != MBT_SINGLE)
 	{	// This is a serious error - crash
-		llerrs << "Block " << bnamep << " isn't type MBT_SINGLE,"
+		llerrs << "Block " << blockname << " isn't type MBT_SINGLE,"
 			" use getSize with blocknum argument!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	return vardata.getSize();
+	return vardata->mSize;
 }
 
 S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const char *varname)
@@ -229,35 +292,29 @@ S32 LLTemplateMessageReader::getSize(const char *blockname, S32 blocknum, const
 		return LL_MESSAGE_ERROR;
 	}
 
-	if (!mCurrentRMessageData)
+	if (!mReceiveBuffer)
 	{	// This is a serious error - crash
-		llerrs << "Invalid mCurrentRMessageData in getData!" << llendl;
+		llerrs << "Invalid mReceiveBuffer in getSize!" << llendl;
 		return LL_MESSAGE_ERROR;
 	}
 
-	char *bnamep = (char *)blockname + blocknum; 
-	char *vnamep = (char *)varname; 
-
-	LLMsgData::msg_blk_data_map_t::const_iterator iter = mCurrentRMessageData->mMemberBlocks.find(bnamep);
-	
-	if (iter == mCurrentRMessageData->mMemberBlocks.end())
+	const LLMsgBlockRef* block = findBlock(blockname);
+	if (!block || blocknum < 0 || blocknum >= block->mCount)
 	{	// don't crash
-		llinfos << "Block " << bnamep << " not in message " 
-			<< mCurrentRMessageData->mName << llendl;
+		llinfos << "Block " << blockname << " #" << blocknum << " not in message " 
+			<< mCurrentRMessageTemplate->mName << llendl;
 		return LL_BLOCK_NOT_IN_MESSAGE;
 	}
 
-	LLMsgBlkData* msg_data = iter->second;
-	LLMsgVarData& vardata = msg_data->mMemberVarData[vnamep];
-	
-	if (!vardata.getName())
+	const LLMsgVarRef* vardata = findVariable(*block, blocknum, varname);
+	if (!vardata)
 	{	// don't crash
-		llinfos << "Variable " << vnamep << " not in message "
-			<<  mCurrentRMessageData->mName << " block " << bnamep << llendl;
+		llinfos << "Variable " << varname << " not in message "
+			<<  mCurrentRMessageTemplate->mName << " block " << blockname << llendl;
 		return LL_VARIABLE_NOT_IN_BLOCK;
 	}
 
-	return vardata.getSize();
+	return vardata->mSize;
 }
 
 void LLTemplateMessageReader::getBinaryData(const char *blockname, 
@@ -533,15 +590,21 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 	llassert( mCurrentRMessageTemplate);
 	llassert( !mCurrentRMessageData );
 	delete mCurrentRMessageData; // just to make sure
+	mCurrentRMessageData = NULL;
+
+	// Nothing is copied out of the packet here, we only note where each
+	// variable starts. The vectors keep their capacity from message to
+	// message, so after warm-up decoding doesn't allocate.
+	mReceiveBuffer = buffer;
+	mBlockRefs.clear();
+	mVarRefs.clear();
+	BOOL have_blocks = FALSE;
 
 	// The offset tells us how may bytes to skip after the end of the
 	// message name.
 	U8 offset = buffer[PHL_OFFSET];
 	S32 decode_pos = LL_PACKET_ID_SIZE + (S32)(mCurrentRMessageTemplate->mFrequency) + offset;
 
-	// create base working data set
-	mCurrentRMessageData = new LLMsgData(mCurrentRMessageTemplate->mName);
-	
 	// loop through the template building the data structure as we go
 	LLMessageTemplate::message_block_map_t::const_iterator iter;
 	for(iter = mCurrentRMessageTemplate->mMemberBlocks.begin();
@@ -589,36 +652,29 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 			return FALSE;
 		}
 
-		LLMsgBlkData* cur_data_block = NULL;
+		// Blocks with no instances still get a ref, so mBlockRefs lines up
+		// with the template's blocks for getDataAt()
+		LLMsgBlockRef block_ref;
+		block_ref.mBlock = mbci;
+		block_ref.mCount = repeat_number;
+		block_ref.mFirstVar = (S32)mVarRefs.size();
+		mBlockRefs.push_back(block_ref);
+		if (repeat_number)
+		{
+			have_blocks = TRUE;
+		}
 
 		// now loop through the block
 		for (i = 0; i < repeat_number; i++)
 		{
-			if (i)
-			{
-				// build new name to prevent collisions
-				// TODO: This should really change to a vector
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
-				cur_data_block->mName = mbci->mName + i;
-			}
-			else
-			{
-				cur_data_block = new LLMsgBlkData(mbci->mName, repeat_number);
-			}
-
-			// add the block to the message
-			mCurrentRMessageData->addBlock(cur_data_block);
-
 			// now read the variables
 			for (LLMessageBlock::message_variable_map_t::const_iterator iter = 
 					 mbci->mMemberVariables.begin();
 				 iter != mbci->mMemberVariables.end(); iter++)
 			{
 				const LLMessageVariable& mvci = **iter;
-
-				// ok, build out the variables
-				// add variable block
-				cur_data_block->addVariable(mvci.getName(), mvci.getType());
+				LLMsgVarRef var_ref;
+				var_ref.mVariable = &mvci;
 
 				// what type of variable?
 				if (mvci.getType() == MVT_VARIABLE)
@@ -658,37 +714,40 @@ BOOL LLTemplateMessageReader::decodeData(const U8* buffer, const LLHost& sender
 					}
 					decode_pos += data_size;
 
-					cur_data_block->addData(mvci.getName(), &buffer[decode_pos], tsize, mvci.getType());
+					var_ref.mOffset = decode_pos;
+					var_ref.mSize = tsize;
+					if (tsize && (decode_pos + (S32)tsize) > mReceiveSize)
+					{
+						// Used to be copied from whatever followed the packet
+						// in the receive buffer, now we stop at its end
+						logRanOffEndOfPacket(sender, decode_pos, tsize);
+						var_ref.mSize = llmax(0, mReceiveSize - decode_pos);
+					}
 					decode_pos += tsize;
 				}
 				else
 				{
 					// fixed!
-					// so, copy data pointer and set data size to fixed size
+					var_ref.mSize = mvci.getSize();
 					if ((decode_pos + mvci.getSize()) > mReceiveSize)
 					{
 						logRanOffEndOfPacket(sender, decode_pos, mvci.getSize());
 
 						// default to 0s.
-						U32 size = mvci.getSize();
-						std::vector<U8> data(size, 0);
-						cur_data_block->addData(mvci.getName(), &(data[0]), 
-												size, mvci.getType());
+						var_ref.mOffset = -1;
 					}
 					else
 					{
-						cur_data_block->addData(mvci.getName(), 
-												&buffer[decode_pos], 
-												mvci.getSize(), 
-												mvci.getType());
+						var_ref.mOffset = decode_pos;
 					}
 					decode_pos += mvci.getSize();
 				}
+				mVarRefs.push_back(var_ref);
 			}
 		}
 	}
 
-	if (mCurrentRMessageData->mMemberBlocks.empty()
+	if (!have_blocks
 		&& !mCurrentRMessageTemplate->mMemberBlocks.empty())
 	{
 		lldebugs << "Empty message '" << mCurrentRMessageTemplate->mName << "' (no blocks)" << llendl;
@@ -823,5 +882,46 @@ void LLTemplateMessageReader::copyToBuilder(LLMessageBuilder& builder) const
     {
         return;
     }
+	if (!mCurrentRMessageData)
+	{
+		mCurrentRMessageData = buildMessageData();
+	}
 	builder.copyFromMessageData(*mCurrentRMessageData);
 }
+
+LLMsgData* LLTemplateMessageReader::buildMessageData() const
+{
+	LLMsgData* data = new LLMsgData(mCurrentRMessageTemplate->mName);
+	for (std::vector<LLMsgBlockRef>::const_iterator iter = mBlockRefs.begin();
+		 iter != mBlockRefs.end(); ++iter)
+	{
+		const LLMessageBlock* mbci = iter->mBlock;
+		S32 num_vars = (S32)mbci->mMemberVariables.size();
+		for (S32 i = 0; i < iter->mCount; i++)
+		{
+			LLMsgBlkData* cur_data_block = new LLMsgBlkData(mbci->mName, iter->mCount);
+			// build new name to prevent collisions
+			cur_data_block->mName = mbci->mName + i;
+			data->addBlock(cur_data_block);
+
+			const LLMsgVarRef* var_ref = num_vars ? &mVarRefs[iter->mFirstVar + i * num_vars] : NULL;
+			for (S32 j = 0; j < num_vars; ++j, ++var_ref)
+			{
+				const LLMessageVariable& mvci = *var_ref->mVariable;
+				cur_data_block->addVariable(mvci.getName(), mvci.getType());
+				if (var_ref->mOffset >= 0)
+				{
+					cur_data_block->addData(mvci.getName(), mReceiveBuffer + var_ref->mOffset,
+											var_ref->mSize, mvci.getType());
+				}
+				else
+				{
+					std::vector<U8> zeros(var_ref->mSize, 0);
+					cur_data_block->addData(mvci.getName(), &zeros[0],
+											var_ref->mSize, mvci.getType());
+				}
+			}
+		}
+	}
+	return data;
+}
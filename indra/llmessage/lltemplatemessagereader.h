@@ -30,8 +30,11 @@
 #include "llmessagereader.h"
 
 #include <map>
+#include <vector>
 
+class LLMessageBlock;
 class LLMessageTemplate;
+class LLMessageVariable;
 class LLMsgData;
 
 class LLTemplateMessageReader : public LLMessageReader
@@ -100,11 +103,24 @@ public:
 
 	BOOL validateMessage(const U8* buffer, S32 buffer_size, 
 						 const LLHost& sender, bool trusted = false);
+
+	// Decodes in place: variables are read straight out of buffer, so it
+	// must stay valid and unchanged until clearMessage().
 	BOOL readMessage(const U8* buffer, const LLHost& sender);
 
 	bool isTrusted() const;
 	bool isBanned(bool trusted_source) const;
 	bool isUdpBanned() const;
+
+	// Access by position in the template instead of by name, for the
+	// generated views in llmessageviews.h. Indices count blocks and the
+	// variables of a block in template order, blocks the sender left out
+	// have 0 instances.
+	const LLMessageTemplate* getMessageTemplate() const { return mCurrentRMessageTemplate; }
+	S32 getNumberOfBlocksAt(S32 block_index) const;
+	S32 getSizeAt(S32 block_index, S32 blocknum, S32 var_index) const;
+	void getDataAt(S32 block_index, S32 var_index, void *datap, S32 size = 0,
+				   S32 blocknum = 0, S32 max_size = S32_MAX) const;
 	
 private:
 
@@ -118,9 +134,39 @@ private:
 
 	BOOL decodeData(const U8* buffer, const LLHost& sender );
 
+	// Where one variable of one block instance sits in mReceiveBuffer
+	struct LLMsgVarRef
+	{
+		const LLMessageVariable* mVariable;
+		S32 mOffset;	// -1 if it was past the end of the packet, reads as 0s
+		S32 mSize;
+	};
+
+	// A template block of the current message, in template order. Each of its mCount
+	// instances owns one run of mVarRefs, one per template variable.
+	struct LLMsgBlockRef
+	{
+		const LLMessageBlock* mBlock;
+		S32 mCount;
+		S32 mFirstVar;
+	};
+
+	const LLMsgBlockRef* findBlock(const char* blockname) const;
+	const LLMsgVarRef* getVarRefAt(S32 block_index, S32 var_index, S32 blocknum) const;
+	void copyData(const LLMsgVarRef& vardata, void *datap, S32 size, S32 max_size) const;
+	const LLMsgVarRef* findVariable(const LLMsgBlockRef& block, S32 blocknum,
+									const char* varname) const;
+
+	// Copies the current message into an LLMsgData, only needed for
+	// copyToBuilder()
+	LLMsgData* buildMessageData() const;
+
 	S32	mReceiveSize;
+	const U8* mReceiveBuffer;
 	LLMessageTemplate* mCurrentRMessageTemplate;
-	LLMsgData* mCurrentRMessageData;
+	std::vector<LLMsgBlockRef> mBlockRefs;	// cleared, not freed, between messages
+	std::vector<LLMsgVarRef> mVarRefs;
+	mutable LLMsgData* mCurrentRMessageData;
 	message_template_number_map_t& mMessageNumbers;
 };
 
@@ -318,6 +318,7 @@ LLMessageSystem::LLMessageSystem(const std::string& filename, U32 port,
 	mMaxMessageCounts = 200; // >= 0 means dump warnings
 	mMaxMessageTime   = 1.f;
 
+	mTrueReceiveBuffer = NULL;
 	mTrueReceiveSize = 0;
 
 	mReceiveTime = 0.f;
@@ -551,9 +552,11 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 		S32 acks = 0;
 		S32 true_rcv_size = 0;
 
+		// Decoded where the ring received it, no copy
+		char* packet = NULL;
+		mTrueReceiveSize = mPacketRing.receivePacket(mSocket, &packet);
+		mTrueReceiveBuffer = (U8*)packet;
 		U8* buffer = mTrueReceiveBuffer;
-		
-		mTrueReceiveSize = mPacketRing.receivePacket(mSocket, (char *)mTrueReceiveBuffer);
 		// If you want to dump all received packets into SecondLife.log, uncomment this
 		//dumpPacketToLog();
 		
@@ -599,8 +602,10 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 				}
 			}
 
-			// process the message as normal
-			mIncomingCompressedSize = zeroCodeExpand(&buffer, &receive_size);
+			// process the message as normal. The packet header is never
+			// zero coded, so the zero coded body is only expanded once we
+			// know we won't discard the packet unread.
+			mTotalBytesIn += receive_size;
 			mCurrentRecvPacketID = ntohl(*((U32*)(&buffer[1])));
 			host = getSender();
 
@@ -665,8 +670,10 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 					{
 						std::ostringstream str;
 						str << "MSG: <- " << host;
+						// Dropped before the body is expanded, so this packet
+						// only has its size on the wire
 						std::string tbuf;
-						tbuf = llformat( "\t%6d\t%6d\t%6d ", receive_size, (mIncomingCompressedSize ? mIncomingCompressedSize : receive_size), mCurrentRecvPacketID);
+						tbuf = llformat( "\t%6d\t%6d\t%6d ", receive_size, receive_size, mCurrentRecvPacketID);
 						str << tbuf << "(unknown)"
 							<< (recv_reliable ? " reliable" : "")
 							<< " resent "
@@ -680,6 +687,10 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 				}
 			}
 
+			// Non zero coded packets are decoded in place in the ring's
+			// buffer, the rest in mEncodedRecvBuffer.
+			mIncomingCompressedSize = zeroCodeExpand(&buffer, &receive_size);
+
 			// UseCircuitCode can be a valid, off-circuit packet.
 			// But we don't want to acknowledge UseCircuitCode until the circuit is
 			// available, which is why the acknowledgement test is done above.  JC
@@ -740,7 +751,7 @@ BOOL LLMessageSystem::checkMessages( S64 frame_count )
 				if (cdp && recv_reliable)
 				{
 					// Add to the recently received list for duplicate suppression
-					cdp->mRecentlyReceivedReliablePackets[mCurrentRecvPacketID] = getMessageTimeUsecs();
+					cdp->mRecentlyReceivedReliablePackets.insert(mCurrentRecvPacketID);
 
 					// Put it onto the list of packets to be acked
 					cdp->collectRAck(mCurrentRecvPacketID);
@@ -811,6 +822,10 @@ void LLMessageSystem::processAcks()
 
 	BOOL dump = FALSE;
 	{
+		// Resends, acks and pings for every circuit go out in as few
+		// system calls as possible
+		mPacketRing.beginSendBatch();
+
 		// Check the status of circuits
 		mCircuitInfo.updateWatchDogTimers(this);
 
@@ -830,6 +845,8 @@ void LLMessageSystem::processAcks()
 			mDenyTrustedCircuitSet.clear();
 		}
 
+		mSendPacketFailureCount += mPacketRing.flushSendBatch();
+
 		if (mMaxMessageCounts >= 0)
 		{
 			if (mNumMessageCounts >= mMaxMessageCounts)
@@ -881,6 +898,7 @@ void LLMessageSystem::copyMessageReceivedToSend()
 
 LLSD LLMessageSystem::getReceivedMessageLLSD() const
 {
+	LLMemType mt_llsd(LLMemType::MTYPE_LLSD);
 	LLSDMessageBuilder builder;
 	mMessageReader->copyToBuilder(builder);
 	return builder.getMessage();
@@ -2877,8 +2895,6 @@ S32 LLMessageSystem::zeroCodeExpand(U8** data, S32* data_size)
 			<< llendl;
 	}
 
-	mTotalBytesIn += *data_size;
-
 	// if we're not zero-coded, simply return.
 	if (!(*data[0] & LL_ZERO_CODE_FLAG))
 	{
@@ -4004,6 +4020,15 @@ S32 LLMessageSystem::getReceiveSize() const
 	return mMessageReader->getMessageSize();
 }
 
+LLTemplateMessageReader* LLMessageSystem::getTemplateMessageReader() const
+{
+	if (mMessageReader && mMessageReader == mTemplateMessageReader)
+	{
+		return mTemplateMessageReader;
+	}
+	return NULL;
+}
+
 //static 
 void LLMessageSystem::setTimeDecodes( BOOL b )
 {
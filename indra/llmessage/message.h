@@ -673,6 +673,10 @@ public:
 	S32		getReceiveCompressedSize() const { return mIncomingCompressedSize; }
 	S32		getReceiveBytes() const;
 
+	// The reader of the message being handled if it came in as a template
+	// message, NULL for LLSD messages
+	LLTemplateMessageReader* getTemplateMessageReader() const;
+
 	S32		getUnackedListSize() const			{ return mUnackedListSize; }
 
 	//const char* getCurrentSMessageName() const { return mCurrentSMessageName; }
@@ -776,7 +780,7 @@ private:
 	LLMessagePollInfo						*mPollInfop;
 
 	U8	mEncodedRecvBuffer[MAX_BUFFER_SIZE];
-	U8	mTrueReceiveBuffer[MAX_BUFFER_SIZE];
+	U8*	mTrueReceiveBuffer;		// current packet, owned by mPacketRing
 	S32	mTrueReceiveSize;
 
 	// Must be valid during decode
@@ -663,4 +663,172 @@ BOOL send_packet(int hSocket, const char * sendBuffer, int size, U32 recipient,
 
 #endif
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// Batched versions
+//////////////////////////////////////////////////////////////////////////////////////////
+
+// recvmmsg() arrived in glibc 2.12, sendmmsg() in 2.14
+#if LL_LINUX && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 14))
+#define LL_NET_MMSG 1
+#else
+#define LL_NET_MMSG 0
+#endif
+
+#if LL_NET_MMSG
+// Most datagrams handed to the kernel in one call
+const S32 MAX_MMSG_BATCH = 64;
+
+// Cleared if the running kernel doesn't have the calls (before 2.6.33 / 3.0)
+static bool sUseMMsg = true;
+
+// Returns -1 if recvmmsg() isn't available
+static S32 receive_mmsg(int hSocket, LLNetDatagram* datagrams, S32 count)
+{
+	struct mmsghdr msgs[MAX_MMSG_BATCH];
+	struct iovec iovs[MAX_MMSG_BATCH];
+	struct sockaddr_in addrs[MAX_MMSG_BATCH];
+	char cmsgs[MAX_MMSG_BATCH][CMSG_SPACE(sizeof(struct in_pktinfo))];
+
+	count = llmin(count, MAX_MMSG_BATCH);
+	memset(msgs, 0, sizeof(msgs[0]) * count);
+	for (S32 i = 0; i < count; ++i)
+	{
+		iovs[i].iov_base = datagrams[i].mData;
+		iovs[i].iov_len = NET_BUFFER_SIZE;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_control = cmsgs[i];
+		msgs[i].msg_hdr.msg_controllen = sizeof(cmsgs[i]);
+	}
+
+	int received = recvmmsg(hSocket, msgs, count, MSG_DONTWAIT, NULL);
+	if (received < 0)
+	{
+		if (errno == ENOSYS)
+		{
+			llwarns << "recvmmsg() not available, receiving one packet at a time" << llendl;
+			sUseMMsg = false;
+			return -1;
+		}
+		// EAGAIN, nothing waiting
+		return 0;
+	}
+
+	for (S32 i = 0; i < received; ++i)
+	{
+		LLNetDatagram& datagram = datagrams[i];
+		datagram.mSize = msgs[i].msg_len;
+		datagram.mIP = addrs[i].sin_addr.s_addr;
+		datagram.mPort = ntohs(addrs[i].sin_port);
+		datagram.mReceivingIF = INVALID_HOST_IP_ADDRESS;
+		// Same as recvfrom_destip()
+		for (struct cmsghdr* cmsgptr = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsgptr != NULL;
+			 cmsgptr = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsgptr))
+		{
+			if (cmsgptr->cmsg_level == SOL_IP && cmsgptr->cmsg_type == IP_PKTINFO)
+			{
+				in_pktinfo *pktinfo = (in_pktinfo *)CMSG_DATA(cmsgptr);
+				datagram.mReceivingIF = pktinfo->ipi_spec_dst.s_addr;
+			}
+		}
+	}
+	return received;
+}
+
+// Returns how many went out, 0 on any error
+static S32 send_mmsg(int hSocket, const LLNetDatagram* datagrams, S32 count)
+{
+	struct mmsghdr msgs[MAX_MMSG_BATCH];
+	struct iovec iovs[MAX_MMSG_BATCH];
+	struct sockaddr_in addrs[MAX_MMSG_BATCH];
+
+	count = llmin(count, MAX_MMSG_BATCH);
+	memset(msgs, 0, sizeof(msgs[0]) * count);
+	memset(addrs, 0, sizeof(addrs[0]) * count);
+	for (S32 i = 0; i < count; ++i)
+	{
+		addrs[i].sin_family = AF_INET;
+		addrs[i].sin_addr.s_addr = datagrams[i].mIP;
+		addrs[i].sin_port = htons(datagrams[i].mPort);
+		iovs[i].iov_base = datagrams[i].mData;
+		iovs[i].iov_len = datagrams[i].mSize;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int sent = sendmmsg(hSocket, msgs, count, 0);
+	if (sent < 0)
+	{
+		if (errno == ENOSYS)
+		{
+			llwarns << "sendmmsg() not available, sending one packet at a time" << llendl;
+			sUseMMsg = false;
+		}
+		return 0;
+	}
+	return sent;
+}
+#endif // LL_NET_MMSG
+
+S32 receive_packets(int hSocket, LLNetDatagram* datagrams, S32 count)
+{
+#if LL_NET_MMSG
+	if (sUseMMsg)
+	{
+		S32 received = receive_mmsg(hSocket, datagrams, count);
+		if (received >= 0)
+		{
+			return received;
+		}
+	}
+#endif
+	S32 received = 0;
+	while (received < count)
+	{
+		LLNetDatagram& datagram = datagrams[received];
+		datagram.mSize = receive_packet(hSocket, datagram.mData);
+		if (!datagram.mSize)
+		{
+			break;
+		}
+		datagram.mIP = get_sender_ip();
+		datagram.mPort = get_sender_port();
+		datagram.mReceivingIF = get_receiving_interface_ip();
+		++received;
+	}
+	return received;
+}
+
+S32 send_packets(int hSocket, const LLNetDatagram* datagrams, S32 count)
+{
+	S32 failed = 0;
+	S32 next = 0;
+	while (next < count)
+	{
+#if LL_NET_MMSG
+		if (sUseMMsg)
+		{
+			S32 sent = send_mmsg(hSocket, datagrams + next, count - next);
+			if (sent > 0)
+			{
+				next += sent;
+				continue;
+			}
+			// Nothing went out, let send_packet() retry the first one
+			// and report what's wrong
+		}
+#endif
+		const LLNetDatagram& datagram = datagrams[next++];
+		if (!send_packet(hSocket, datagram.mData, datagram.mSize, datagram.mIP, datagram.mPort))
+		{
+			++failed;
+		}
+	}
+	return failed;
+}
+
 //EOF
@@ -45,6 +45,25 @@ S32		receive_packet(int hSocket, char * receiveBuffer);
 
 BOOL	send_packet(int hSocket, const char *sendBuffer, int size, U32 recipient, int nPort);	// Returns TRUE on success.
 
+// One datagram for the batched calls below. Addresses are in network
+// order, ports in host order, like LLHost.
+struct LLNetDatagram
+{
+	char*	mData;			// NET_BUFFER_SIZE bytes when receiving
+	S32		mSize;
+	U32		mIP;			// sender when receiving, recipient when sending
+	U32		mPort;
+	U32		mReceivingIF;	// receive only, INVALID_HOST_IP_ADDRESS if unknown
+};
+
+// Batched receive_packet(): fills up to count datagrams, in one recvmmsg()
+// on Linux. Returns how many were received, 0 when the socket is drained.
+// Doesn't update get_sender() and friends.
+S32		receive_packets(int hSocket, LLNetDatagram* datagrams, S32 count);
+
+// Batched send_packet(), one sendmmsg() on Linux. Returns how many failed.
+S32		send_packets(int hSocket, const LLNetDatagram* datagrams, S32 count);
+
 //void	get_sender(char * tmp);
 LLHost  get_sender();
 U32		get_sender_port();
@@ -0,0 +1,203 @@
+/**
+ * @file llcongestioncontroller_test.cpp
+ * @brief Tests for LLCongestionController on a simulated lossy link
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "../llcongestioncontroller.h"
+
+#include "../test/lltut.h"
+
+namespace tut
+{
+	// A sender at the controller's rate into a link with a bottleneck
+	// queue, a base round trip and random loss, in simulated time
+	struct congestion_data
+	{
+		congestion_data()
+		:	mCapacity(1000000.f),
+			mBaseRTT(0.1f),
+			mLoss(0.f),
+			mQueueSecs(0.25f),
+			mNow(0.0),
+			mQueueBits(0.f),
+			mSendCredit(0.f),
+			mPacketsIn(0),
+			mPacketsLost(0),
+			mSeed(1),
+			mNextPing(0.0),
+			mReports(0),
+			mUpdates(0)
+		{
+			mController.setRange(MIN_BPS, MAX_BPS);
+		}
+
+		// Runs for seconds and returns the mean rate over them
+		F32 run(F32 seconds)
+		{
+			const F32 TICK = 0.01f;
+			const F32 PACKET_BITS = 8000.f;
+			const F32 PING_INTERVAL = 5.f;	// the viewer's circuit heartbeat
+
+			F64 rate_sum = 0.0;
+			S32 ticks = llround(seconds / TICK);
+			for (S32 i = 0; i < ticks; ++i)
+			{
+				mNow += TICK;
+				rate_sum += mController.getRate();
+
+				mSendCredit += mController.getRate() * TICK;
+				while (mSendCredit >= PACKET_BITS)
+				{
+					mSendCredit -= PACKET_BITS;
+					if (random() < mLoss
+						|| mQueueBits + PACKET_BITS > mCapacity * mQueueSecs)
+					{
+						mPacketsLost++;
+					}
+					else
+					{
+						mQueueBits += PACKET_BITS;
+						mPacketsIn++;
+					}
+				}
+				mQueueBits = llmax(0.f, mQueueBits - mCapacity * TICK);
+
+				if (mNow >= mNextPing)
+				{
+					mController.addRTTSample(mBaseRTT + mQueueBits / mCapacity, mNow);
+					mNextPing = mNow + PING_INTERVAL;
+				}
+
+				if (mController.update(mNow, mPacketsIn, mPacketsLost))
+				{
+					mReports++;
+				}
+				if (fmod(mNow, LLCongestionController::UPDATE_PERIOD) < TICK)
+				{
+					mUpdates++;
+				}
+			}
+			return (F32)(rate_sum / ticks);
+		}
+
+		F32 random()
+		{
+			mSeed = mSeed * 1103515245 + 12345;
+			return (F32)((mSeed >> 8) & 0xffff) / 65536.f;
+		}
+
+		static const F32 MIN_BPS;
+		static const F32 MAX_BPS;
+
+		LLCongestionController mController;
+		F32 mCapacity;		// bits per second through the bottleneck
+		F32 mBaseRTT;		// seconds with the queue empty
+		F32 mLoss;			// fraction lost on the way regardless
+		F32 mQueueSecs;		// bottleneck buffer, in seconds at capacity
+		F64 mNow;
+		F32 mQueueBits;
+		F32 mSendCredit;
+		U32 mPacketsIn;
+		U32 mPacketsLost;
+		U32 mSeed;
+		F64 mNextPing;
+		S32 mReports;
+		S32 mUpdates;
+	};
+	const F32 congestion_data::MIN_BPS = 100000.f;
+	const F32 congestion_data::MAX_BPS = 3000000.f;
+
+	typedef test_group<congestion_data> congestion_group;
+	typedef congestion_group::object congestion_object;
+	congestion_group congestiongrp("LLCongestionController");
+
+	template<> template<>
+	void congestion_object::test<1>()
+	{
+		set_test_name("settles under the bottleneck");
+		run(60.f);
+		F32 rate = run(120.f);
+		ensure("uses the link", rate > mCapacity * 0.5f);
+		ensure("doesn't swamp it", rate < mCapacity * 1.3f);
+		ensure("few throttle messages", mReports < mUpdates / 3);
+	}
+
+	template<> template<>
+	void congestion_object::test<2>()
+	{
+		set_test_name("opens up to the maximum on a fat link");
+		mCapacity = 10000000.f;
+		mController.setRate(MIN_BPS);
+		run(40.f);
+		ensure_equals("at the maximum", mController.getRate(), MAX_BPS);
+	}
+
+	template<> template<>
+	void congestion_object::test<3>()
+	{
+		set_test_name("rides out light random loss");
+		mCapacity = 10000000.f;
+		mLoss = 0.01f;
+		F32 rate = run(60.f);
+		ensure("stays up", rate > MAX_BPS * 0.8f);
+	}
+
+	template<> template<>
+	void congestion_object::test<4>()
+	{
+		set_test_name("backs off from heavy loss");
+		mCapacity = 10000000.f;
+		mLoss = 0.15f;
+		run(30.f);
+		ensure_equals("at the minimum", mController.getRate(), MIN_BPS);
+	}
+
+	template<> template<>
+	void congestion_object::test<5>()
+	{
+		set_test_name("follows the bottleneck down and back up");
+		mCapacity = 2000000.f;
+		run(60.f);
+		mCapacity = 500000.f;
+		run(20.f);
+		F32 rate = run(60.f);
+		ensure("down", rate < 500000.f * 1.3f);
+		mCapacity = 2000000.f;
+		rate = run(60.f);
+		ensure("up again", rate > 2000000.f * 0.5f);
+	}
+
+	template<> template<>
+	void congestion_object::test<6>()
+	{
+		set_test_name("backs off from a standing queue");
+		// A deep buffer hides the congestion from the loss count
+		mQueueSecs = 5.f;
+		run(120.f);
+		ensure("queue drained", mQueueBits / mCapacity < 1.f);
+		ensure("rounds trips near the base", mController.getSmoothedRTT() < mBaseRTT + 1.f);
+	}
+}
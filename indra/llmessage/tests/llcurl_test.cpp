@@ -0,0 +1,291 @@
+/**
+ * @file llcurl_test.cpp
+ * @brief Tests for LLCurlTextureRequest against the stand-in texture server
+ *        in test_llcurl_peer.py
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "../llcurl.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	// Must match test_llcurl_peer.py
+	const char* SERVER = "http://127.0.0.1:8000";
+	const S32 TEXTURE_SIZE = 20000;
+
+	U8 texture_byte(S32 texture, S32 offset)
+	{
+		return (U8)((texture * 31 + offset) % 251);
+	}
+
+	struct Result
+	{
+		Result() : mDone(false), mStatus(0) {}
+		bool mDone;
+		U32 mStatus;
+		std::string mData;
+	};
+
+	class RecordingResponder : public LLCurl::Responder
+	{
+	public:
+		RecordingResponder(Result* result) : mResult(result) {}
+
+		/*virtual*/ void completedRaw(U32 status, const std::string& reason,
+									  const LLChannelDescriptors& channels,
+									  const LLIOPipe::buffer_ptr_t& buffer)
+		{
+			mResult->mStatus = status;
+			if (buffer)
+			{
+				S32 size = buffer->countAfter(channels.in(), NULL);
+				if (size > 0)
+				{
+					std::vector<U8> data(size);
+					buffer->readAfter(channels.in(), NULL, &data[0], size);
+					mResult->mData.assign((const char*)&data[0], size);
+				}
+			}
+			mResult->mDone = true;
+		}
+
+	private:
+		Result* mResult;
+	};
+
+	LLUUID texture_id(S32 texture)
+	{
+		LLUUID id;
+		id.mData[0] = (U8)texture;
+		id.mData[1] = 1;
+		return id;
+	}
+
+	std::string texture_url(S32 texture)
+	{
+		return llformat("%s/texture/%d", SERVER, texture);
+	}
+
+	bool pump(LLCurlTextureRequest& engine, const std::vector<Result*>& results)
+	{
+		for (S32 i = 0; i < 1000; ++i)
+		{
+			engine.process();
+			bool done = true;
+			for (size_t r = 0; r < results.size(); ++r)
+			{
+				done = done && results[r]->mDone;
+			}
+			if (done)
+			{
+				return true;
+			}
+			ms_sleep(10);
+		}
+		return false;
+	}
+
+	bool check_range(const Result& result, S32 texture, S32 offset, S32 length)
+	{
+		if (result.mStatus != 206 || (S32)result.mData.size() != length)
+		{
+			return false;
+		}
+		for (S32 i = 0; i < length; ++i)
+		{
+			if ((U8)result.mData[i] != texture_byte(texture, offset + i))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+namespace tut
+{
+	struct llcurl_data
+	{
+		llcurl_data()
+		{
+			LLCurl::initClass();
+			mEngine = new LLCurlTextureRequest(4);
+			fetch("/reset");
+		}
+		~llcurl_data()
+		{
+			delete mEngine;
+			LLCurl::cleanupClass();
+		}
+
+		// Plain GET of one of the server's bookkeeping pages
+		std::string fetch(const std::string& path)
+		{
+			Result result;
+			std::vector<Result*> results(1, &result);
+			mEngine->getByteRange(LLUUID::null, SERVER + path, LLCurlTextureRequest::headers_t(),
+								  0, -1, 0, new RecordingResponder(&result));
+			pump(*mEngine, results);
+			return result.mData;
+		}
+
+		S32 stat(const std::string& name)
+		{
+			std::string stats = fetch("/stats");
+			std::string::size_type pos = stats.find(name + "=");
+			if (pos == std::string::npos)
+			{
+				return -1;
+			}
+			return atoi(stats.c_str() + pos + name.size() + 1);
+		}
+
+		LLCurlTextureRequest* mEngine;
+	};
+	typedef test_group<llcurl_data> llcurl_group;
+	typedef llcurl_group::object llcurl_object;
+	llcurl_group llcurlgrp("LLCurlTextureRequest");
+
+	template<> template<>
+	void llcurl_object::test<1>()
+	{
+		set_test_name("header then body ranges");
+		const S32 NUM_TEXTURES = 10;
+		const S32 HEADER_SIZE = 600;
+		std::vector<Result*> results;
+		for (S32 i = 0; i < NUM_TEXTURES; ++i)
+		{
+			results.push_back(new Result);
+			mEngine->getByteRange(texture_id(i), texture_url(i), LLCurlTextureRequest::headers_t(),
+								  0, HEADER_SIZE, i, new RecordingResponder(results.back()));
+		}
+		ensure("headers received", pump(*mEngine, results));
+		for (S32 i = 0; i < NUM_TEXTURES; ++i)
+		{
+			ensure(llformat("header %d", i), check_range(*results[i], i, 0, HEADER_SIZE));
+			*results[i] = Result();
+			mEngine->getByteRange(texture_id(i), texture_url(i), LLCurlTextureRequest::headers_t(),
+								  HEADER_SIZE, -1, i, new RecordingResponder(results[i]));
+		}
+		ensure("bodies received", pump(*mEngine, results));
+		for (S32 i = 0; i < NUM_TEXTURES; ++i)
+		{
+			ensure(llformat("body %d", i), check_range(*results[i], i, HEADER_SIZE, TEXTURE_SIZE - HEADER_SIZE));
+			delete results[i];
+		}
+		ensure("concurrency within limits",
+			   mEngine->getConcurrency() >= LLCurlTextureRequest::MIN_CONCURRENCY &&
+			   mEngine->getConcurrency() <= 4);
+	}
+
+	template<> template<>
+	void llcurl_object::test<2>()
+	{
+		set_test_name("queued request grows instead of a second request");
+		Result result;
+		std::vector<Result*> results(1, &result);
+		mEngine->getByteRange(texture_id(1), texture_url(1), LLCurlTextureRequest::headers_t(),
+							  0, 600, 0, new RecordingResponder(&result));
+		ensure("still queued", mEngine->extendByteRange(texture_id(1), 8000));
+		ensure("one request queued", mEngine->getQueued() == 1);
+		ensure("merged request received", pump(*mEngine, results));
+		ensure("merged range", check_range(result, 1, 0, 8000));
+		ensure("can't grow a finished request", !mEngine->extendByteRange(texture_id(1), 9000));
+		ensure_equals("server saw one request", stat("requests"), 1);
+	}
+
+	template<> template<>
+	void llcurl_object::test<3>()
+	{
+		set_test_name("cancel");
+		Result cancelled;
+		Result kept;
+		std::vector<Result*> results(1, &kept);
+		mEngine->getByteRange(texture_id(1), texture_url(1), LLCurlTextureRequest::headers_t(),
+							  0, 600, 0, new RecordingResponder(&cancelled));
+		mEngine->getByteRange(texture_id(2), texture_url(2), LLCurlTextureRequest::headers_t(),
+							  0, 600, 0, new RecordingResponder(&kept));
+		ensure("cancel queued", mEngine->cancel(texture_id(1)));
+		ensure("cancel twice", !mEngine->cancel(texture_id(1)));
+		ensure("kept request received", pump(*mEngine, results));
+		ensure("cancelled responder never called", !cancelled.mDone);
+		ensure_equals("server saw one request", stat("requests"), 1);
+	}
+
+	template<> template<>
+	void llcurl_object::test<4>()
+	{
+		set_test_name("connections are kept alive");
+		const S32 NUM_REQUESTS = 40;
+		std::vector<Result*> results;
+		for (S32 i = 0; i < NUM_REQUESTS; ++i)
+		{
+			results.push_back(new Result);
+			mEngine->getByteRange(texture_id(i), texture_url(i), LLCurlTextureRequest::headers_t(),
+								  0, 1000, 0, new RecordingResponder(results.back()));
+		}
+		ensure("all received", pump(*mEngine, results));
+		for (S32 i = 0; i < NUM_REQUESTS; ++i)
+		{
+			ensure(llformat("range %d", i), check_range(*results[i], i, 0, 1000));
+			delete results[i];
+		}
+		// The /reset and /stats connections count too
+		S32 connections = stat("connections");
+		ensure("connections reused", connections > 0 && connections <= 4 + 2);
+	}
+
+	template<> template<>
+	void llcurl_object::test<5>()
+	{
+		set_test_name("priority order");
+		LLCurlTextureRequest engine(LLCurlTextureRequest::MIN_CONCURRENCY);
+		std::vector<Result*> results;
+		for (S32 i = 0; i < 6; ++i)
+		{
+			results.push_back(new Result);
+			engine.getByteRange(texture_id(i), texture_url(i), LLCurlTextureRequest::headers_t(),
+								0, 100, i, new RecordingResponder(results.back()));
+		}
+		// Bump the lowest one above the rest
+		engine.setPriority(texture_id(0), 10);
+		ensure("all received", pump(engine, results));
+		for (S32 i = 0; i < 6; ++i)
+		{
+			delete results[i];
+		}
+		std::string stats = fetch("/stats");
+		std::string::size_type pos = stats.find("order=");
+		ensure("order reported", pos != std::string::npos);
+		std::string first_two = stats.substr(pos + 6, 3);
+		ensure(std::string("highest priorities first: ") + first_two,
+			   first_two == "0,5" || first_two == "5,0");
+	}
+}
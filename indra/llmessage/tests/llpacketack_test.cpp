@@ -0,0 +1,648 @@
+/**
+ * @file llpacketack_test.cpp
+ * @brief Tests for the reliable packet window, duplicate IDs, circuit table
+ * and the circuit's resend and ack path
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <map>
+#include <vector>
+
+#if !LL_WINDOWS
+#include <netinet/in.h>
+#else
+#include "winsock2.h"
+#endif
+
+#include "llapr.h"
+#include "../llcircuit.h"
+#include "../llpacketack.h"
+#include "../message.h"
+#include "../net.h"
+
+#include "../test/lltut.h"
+
+namespace
+{
+	// What the callbacks of reliable packets were told, in order
+	typedef std::vector<std::pair<TPACKETID, S32> > callback_list_t;
+	callback_list_t sCallbacks;
+
+	void record_callback(void** data, S32 result)
+	{
+		sCallbacks.push_back(std::make_pair((TPACKETID)(size_t)data, result));
+	}
+
+	// LLCircuitData's resend and ack path as it was with a std::map for the
+	// unacked packets and another for the final retries, kept to check the
+	// window based one against. Holds on to a copy of each packet like the
+	// circuit does, so the two can be timed against each other too.
+	class OldReliablePackets
+	{
+	public:
+		struct Packet
+		{
+			S32 mRetries;
+			BOOL mPingBasedRetry;
+			F32 mTimeout;
+			F64 mExpirationTime;
+			S32 mBufferLength;
+			LLReliablePacket* mPacket;
+		};
+
+		OldReliablePackets() : mUnackedPacketCount(0), mUnackedPacketBytes(0), mResent(0), mFailed(0) {}
+		~OldReliablePackets()
+		{
+			for (packet_map_t::iterator iter = mUnackedPackets.begin(); iter != mUnackedPackets.end(); ++iter)
+			{
+				delete iter->second.mPacket;
+			}
+			for (packet_map_t::iterator iter = mFinalRetryPackets.begin(); iter != mFinalRetryPackets.end(); ++iter)
+			{
+				delete iter->second.mPacket;
+			}
+		}
+
+		void add(TPACKETID id, LLReliablePacketParams& params, U8* buffer, S32 length, F64 stamp)
+		{
+			Packet packet;
+			packet.mPacket = new LLReliablePacket(0, buffer, length, &params);
+			packet.mRetries = params.mRetries;
+			packet.mPingBasedRetry = params.mPingBasedRetry;
+			packet.mTimeout = params.mTimeout;
+			packet.mExpirationTime = stamp + params.mTimeout;
+			// Packets without retries never keep their buffer
+			packet.mBufferLength = params.mRetries ? length : 0;
+			mUnackedPacketCount++;
+			mUnackedPacketBytes += packet.mBufferLength;
+			if (params.mRetries)
+			{
+				mUnackedPackets[id] = packet;
+			}
+			else
+			{
+				mFinalRetryPackets[id] = packet;
+			}
+		}
+
+		void ack(TPACKETID id)
+		{
+			packet_map_t::iterator iter = mUnackedPackets.find(id);
+			if (iter != mUnackedPackets.end())
+			{
+				remove(iter, LL_ERR_NOERR);
+				mUnackedPackets.erase(iter);
+				return;
+			}
+			iter = mFinalRetryPackets.find(id);
+			if (iter != mFinalRetryPackets.end())
+			{
+				remove(iter, LL_ERR_NOERR);
+				mFinalRetryPackets.erase(iter);
+			}
+		}
+
+		S32 resend(F64 now, F32 ping_delay_averaged)
+		{
+			BOOL have_resend_overflow = FALSE;
+			for (packet_map_t::iterator iter = mUnackedPackets.begin(); iter != mUnackedPackets.end(); )
+			{
+				Packet& packet = iter->second;
+				if (!have_resend_overflow)
+				{
+					have_resend_overflow = mThrottles.checkOverflow(TC_RESEND, 0);
+				}
+				if (have_resend_overflow)
+				{
+					if (mUnackedPacketBytes > 512000)
+					{
+						if (now > packet.mExpirationTime)
+						{
+							packet.mRetries = 0;
+							mFinalRetryPackets[iter->first] = packet;
+							mUnackedPackets.erase(iter++);
+						}
+						else
+						{
+							++iter;
+						}
+						continue;
+					}
+					break;
+				}
+
+				if (now > packet.mExpirationTime)
+				{
+					packet.mRetries--;
+					mResent++;
+					mThrottles.throttleOverflow(TC_RESEND, packet.mBufferLength * 8.f);
+					if (packet.mPingBasedRetry)
+					{
+						packet.mExpirationTime = now + llmax(LL_MINIMUM_RELIABLE_TIMEOUT_SECONDS, (LL_RELIABLE_TIMEOUT_FACTOR * ping_delay_averaged));
+					}
+					else
+					{
+						packet.mExpirationTime = now + packet.mTimeout;
+					}
+					if (!packet.mRetries)
+					{
+						mFinalRetryPackets[iter->first] = packet;
+						mUnackedPackets.erase(iter++);
+					}
+					else
+					{
+						++iter;
+					}
+				}
+				else
+				{
+					++iter;
+				}
+			}
+
+			for (packet_map_t::iterator iter = mFinalRetryPackets.begin(); iter != mFinalRetryPackets.end(); )
+			{
+				if (now > iter->second.mExpirationTime)
+				{
+					mFailed++;
+					remove(iter, LL_ERR_TCP_TIMEOUT);
+					mFinalRetryPackets.erase(iter++);
+				}
+				else
+				{
+					++iter;
+				}
+			}
+			return mUnackedPacketCount;
+		}
+
+		LLThrottleGroup mThrottles;
+		callback_list_t mCallbacks;
+		S32 mUnackedPacketCount;
+		S32 mUnackedPacketBytes;
+		U32 mResent;
+		U32 mFailed;
+
+	private:
+		typedef std::map<TPACKETID, Packet> packet_map_t;
+
+		void remove(packet_map_t::iterator iter, S32 result)
+		{
+			mCallbacks.push_back(std::make_pair(iter->first, result));
+			mUnackedPacketCount--;
+			mUnackedPacketBytes -= iter->second.mBufferLength;
+			delete iter->second.mPacket;
+		}
+
+		packet_map_t mUnackedPackets;
+		packet_map_t mFinalRetryPackets;
+	};
+
+	// Lets the test queue reliable packets the way LLMessageSystem does
+	class TestCircuitData : public LLCircuitData
+	{
+	public:
+		TestCircuitData(const LLHost& host) : LLCircuitData(host, 0, 5.f, 100.f) {}
+		using LLCircuitData::addReliablePacket;
+	};
+}
+
+namespace tut
+{
+	struct packetack_data
+	{
+		// An unreliable packet with id in its header, which is all the
+		// window looks at
+		LLReliablePacket* makePacket(TPACKETID id)
+		{
+			U8 buffer[LL_MINIMUM_VALID_PACKET_SIZE];
+			memset(buffer, 0, sizeof(buffer));
+			U32 net_id = htonl(id);
+			memcpy(&buffer[PHL_PACKET_ID], &net_id, sizeof(net_id));	/*Flawfinder: ignore*/
+			return new LLReliablePacket(0, buffer, sizeof(buffer), NULL);
+		}
+
+		// Disconnected message system, resends only need its packet ring.
+		// Resends go to a socket of our own that nobody reads.
+		void startMessaging(S32 port, S32& socket, LLHost& host)
+		{
+			static bool apr_ready = false;
+			if (!apr_ready)
+			{
+				ll_init_apr();
+				apr_ready = true;
+			}
+			start_messaging_system("notafile", port, 1, 0, 0, FALSE, "notasharedsecret", NULL, false, 5.f, 100.f);
+			ensure("message system", gMessageSystem != NULL);
+
+			int socket_port = port + 1;
+			ensure_equals("socket", start_net(socket, socket_port), 0);
+			host = LLHost(ip_string_to_u32("127.0.0.1"), socket_port);
+		}
+
+		void stopMessaging(S32 socket)
+		{
+			end_net(socket);
+			delete gMessageSystem;
+			gMessageSystem = NULL;
+		}
+
+		void deleteAll(LLReliablePacketWindow& window)
+		{
+			std::vector<LLReliablePacket*> packets;
+			window.getAllPackets(packets);
+			for (S32 i = 0; i < (S32)packets.size(); ++i)
+			{
+				delete window.remove(packets[i]->getPacketID());
+			}
+		}
+	};
+	typedef test_group<packetack_data> packetack_group;
+	typedef packetack_group::object packetack_object;
+	packetack_group packetackgrp("LLPacketAck");
+
+	template<> template<>
+	void packetack_object::test<1>()
+	{
+		set_test_name("window against a map under random acks");
+		LLReliablePacketWindow window;
+		std::map<TPACKETID, BOOL> expected;
+
+		const S32 PACKETS = 100000;
+		U32 seed = 12345;
+		for (TPACKETID id = 1; id <= PACKETS; ++id)
+		{
+			BOOL final_retry = (id % 7) == 0;
+			window.add(makePacket(id), final_retry);
+			expected[id] = final_retry;
+
+			// Acks come back out of order and some are lost for a while
+			seed = seed * 1103515245 + 12345;
+			if ((seed >> 16) % 4)
+			{
+				TPACKETID ack = id - (seed >> 20) % 64;
+				LLReliablePacket* packet = window.remove(ack);
+				ensure_equals("acked the expected packet", packet != NULL, expected.erase(ack) != 0);
+				delete packet;
+			}
+			if ((id % 1000) == 0)
+			{
+				// Something like a resend pass
+				std::vector<LLReliablePacket*> packets;
+				window.getPackets(FALSE, packets);
+				for (S32 i = 0; i < (S32)packets.size(); ++i)
+				{
+					window.setFinalRetry(packets[i]->getPacketID());
+					expected[packets[i]->getPacketID()] = TRUE;
+				}
+			}
+		}
+		ensure_equals("count", window.size(), (S32)expected.size());
+		for (std::map<TPACKETID, BOOL>::iterator iter = expected.begin(); iter != expected.end(); ++iter)
+		{
+			BOOL final_retry = FALSE;
+			ensure("still waiting", window.find(iter->first, &final_retry) != NULL);
+			ensure_equals("list", final_retry, iter->second);
+		}
+		ensure_equals("oldest", window.getOldestID(PACKETS), expected.begin()->first);
+		deleteAll(window);
+		ensure("empty", window.empty());
+	}
+
+	template<> template<>
+	void packetack_object::test<2>()
+	{
+		set_test_name("walks and oldest ID across the wrap");
+		LLReliablePacketWindow window;
+		TPACKETID first = LL_MAX_OUT_PACKET_ID - 10;
+		TPACKETID id = first;
+		for (S32 i = 0; i < 20; ++i)
+		{
+			window.add(makePacket(id), FALSE);
+			id = (id + 1) % LL_MAX_OUT_PACKET_ID;
+		}
+		TPACKETID newest = (id + LL_MAX_OUT_PACKET_ID - 1) % LL_MAX_OUT_PACKET_ID;
+
+		std::vector<LLReliablePacket*> packets;
+		window.getPackets(FALSE, packets);
+		ensure_equals("all unacked", (S32)packets.size(), 20);
+		ensure_equals("oldest first", packets.front()->getPacketID(), first);
+		ensure_equals("newest last", packets.back()->getPacketID(), newest);
+		ensure_equals("oldest ID", window.getOldestID(newest), first);
+
+		delete window.remove(first);
+		ensure_equals("next oldest", window.getOldestID(newest), first + 1);
+		deleteAll(window);
+		ensure_equals("nothing waiting", window.getOldestID(newest), newest);
+	}
+
+	template<> template<>
+	void packetack_object::test<3>()
+	{
+		set_test_name("packets outliving the largest window");
+		LLReliablePacketWindow window;
+		// Never acked, so they end up in the overflow
+		const S32 STUCK = 5;
+		for (TPACKETID id = 1; id <= STUCK; ++id)
+		{
+			window.add(makePacket(id), TRUE);
+		}
+		const S32 PACKETS = 40000;
+		for (TPACKETID id = STUCK + 1; id <= PACKETS; ++id)
+		{
+			window.add(makePacket(id), FALSE);
+			if (id > STUCK + 100)
+			{
+				delete window.remove(id - 100);
+			}
+		}
+		ensure_equals("count", window.size(), STUCK + 100);
+		ensure_equals("oldest", window.getOldestID(PACKETS), (TPACKETID)1);
+
+		std::vector<LLReliablePacket*> packets;
+		window.getPackets(TRUE, packets);
+		ensure_equals("final retries", (S32)packets.size(), STUCK);
+		for (S32 i = 0; i < STUCK; ++i)
+		{
+			ensure_equals("in order", packets[i]->getPacketID(), (TPACKETID)(i + 1));
+		}
+		deleteAll(window);
+		ensure("empty", window.empty());
+	}
+
+	template<> template<>
+	void packetack_object::test<4>()
+	{
+		set_test_name("recent IDs keep what the sender may resend");
+		LLRecentPacketIDs recent;
+		for (TPACKETID id = 1; id <= 1000; ++id)
+		{
+			recent.insert(id);
+		}
+		// Oldest unacked never moved, so nothing can be forgotten yet
+		for (TPACKETID id = 1; id <= 1000; ++id)
+		{
+			ensure("kept", recent.contains(id));
+		}
+		ensure("not seen", !recent.contains(1001));
+
+		recent.keepRange(900, 1000);
+		ensure_equals("trimmed", recent.size(), 101);
+		ensure("forgotten", !recent.contains(899));
+		ensure("still kept", recent.contains(900));
+
+		// Across the wrap
+		recent.clear();
+		recent.insert(LL_MAX_OUT_PACKET_ID - 2);
+		recent.insert(LL_MAX_OUT_PACKET_ID - 1);
+		recent.insert(0);
+		recent.insert(1);
+		recent.keepRange(LL_MAX_OUT_PACKET_ID - 1, 1);
+		ensure_equals("wrapped range", recent.size(), 3);
+		ensure("before the range", !recent.contains(LL_MAX_OUT_PACKET_ID - 2));
+		ensure("after the wrap", recent.contains(0));
+	}
+
+	template<> template<>
+	void packetack_object::test<5>()
+	{
+		set_test_name("circuit table against a map");
+		LLCircuitHostTable table;
+		std::map<LLHost, LLCircuitData*> expected;
+		// Only compared, never used
+		char circuits[16];
+
+		U32 seed = 54321;
+		for (S32 i = 0; i < 20000; ++i)
+		{
+			seed = seed * 1103515245 + 12345;
+			LLHost host(0x0a000000 | ((seed >> 16) % 512), 13000 + (seed >> 8) % 4);
+			if ((seed >> 4) % 3)
+			{
+				table.insert(host, (LLCircuitData*)&circuits[i % 16]);
+				expected[host] = (LLCircuitData*)&circuits[i % 16];
+			}
+			else
+			{
+				table.erase(host);
+				expected.erase(host);
+			}
+		}
+
+		for (U32 ip = 0; ip < 512; ++ip)
+		{
+			for (U32 port = 13000; port < 13004; ++port)
+			{
+				LLHost host(0x0a000000 | ip, port);
+				std::map<LLHost, LLCircuitData*>::iterator iter = expected.find(host);
+				LLCircuitData* want = iter == expected.end() ? NULL : iter->second;
+				ensure("found", table.find(host) == want);
+			}
+		}
+	}
+
+	template<> template<>
+	void packetack_object::test<6>()
+	{
+		set_test_name("circuit resends and acks like the std::map version under loss");
+		S32 socket = 0;
+		LLHost host;
+		startMessaging(13036, socket, host);
+
+		TestCircuitData* circuit = new TestCircuitData(host);
+		OldReliablePackets expected;
+		sCallbacks.clear();
+		const U32 resent_before = gMessageSystem->mResentPackets;
+		const U32 failed_before = gMessageSystem->mFailedResendPackets;
+		const F32 ping = circuit->getPingDelayAveraged();
+
+		// New packets are stamped with the wall clock, steps are far longer
+		// than the whole test takes and timeouts fall between steps, so both
+		// sides see the same packets come due on the same step.
+		const F64 STEP = 10.0;
+		const F64 start = (F64)((S64)totalTime()) / 1000000.0;
+		std::vector<TPACKETID> outstanding;
+		std::vector<U8> buffer;
+		TPACKETID next_id = 1;
+		U32 seed = 24680;
+		for (S32 step = 1; step <= 300; ++step)
+		{
+			for (S32 i = 0; i < 20; ++i)
+			{
+				seed = seed * 1103515245 + 12345;
+				LLReliablePacketParams params;
+				params.set(host, (seed >> 8) % 4, (seed >> 12) & 1,
+						   (F32)(STEP * ((seed >> 13) % 3) + STEP / 2),
+						   record_callback, (void**)(size_t)next_id, NULL);
+				S32 length = LL_MINIMUM_VALID_PACKET_SIZE + (seed >> 16) % 1200;
+				buffer.assign(length, 0);
+				U32 net_id = htonl(next_id);
+				memcpy(&buffer[PHL_PACKET_ID], &net_id, sizeof(net_id));	/*Flawfinder: ignore*/
+				F64 stamp = (F64)((S64)totalTime()) / 1000000.0;
+				circuit->addReliablePacket(socket, &buffer[0], length, &params);
+				expected.add(next_id, params, &buffer[0], length, stamp);
+				outstanding.push_back(next_id);
+				++next_id;
+			}
+
+			// Half the acks get through, none while the link is down, and
+			// some arrive twice or for packets that already gave up
+			bool link_down = step > 100 && step <= 160;
+			for (S32 i = 0; i < (S32)outstanding.size(); )
+			{
+				seed = seed * 1103515245 + 12345;
+				if (!link_down && (seed >> 16) % 2)
+				{
+					circuit->ackReliablePacket(outstanding[i]);
+					expected.ack(outstanding[i]);
+					if ((seed >> 20) % 8 == 0)
+					{
+						circuit->ackReliablePacket(outstanding[i]);
+						expected.ack(outstanding[i]);
+					}
+					outstanding[i] = outstanding.back();
+					outstanding.pop_back();
+				}
+				else
+				{
+					++i;
+				}
+			}
+
+			// Same resend budget on both sides every step
+			circuit->getThrottleGroup().resetDynamicAdjust();
+			expected.mThrottles.resetDynamicAdjust();
+			F64 now = start + step * STEP;
+			S32 count = circuit->resendUnackedPackets(now);
+			ensure_equals("unacked count returned", count, expected.resend(now, ping));
+			ensure_equals("unacked count", circuit->getUnackedPacketCount(), expected.mUnackedPacketCount);
+			ensure_equals("unacked bytes", circuit->getUnackedPacketBytes(), expected.mUnackedPacketBytes);
+			ensure_equals("resent", gMessageSystem->mResentPackets - resent_before, expected.mResent);
+			ensure_equals("gave up", gMessageSystem->mFailedResendPackets - failed_before, expected.mFailed);
+		}
+
+		ensure("packets were resent", expected.mResent > 0);
+		ensure("packets gave up", expected.mFailed > 0);
+		ensure_equals("callbacks", sCallbacks.size(), expected.mCallbacks.size());
+		for (S32 i = 0; i < (S32)sCallbacks.size(); ++i)
+		{
+			ensure_equals("callback packet", sCallbacks[i].first, expected.mCallbacks[i].first);
+			ensure_equals("callback result", sCallbacks[i].second, expected.mCallbacks[i].second);
+		}
+
+		delete circuit;
+		stopMessaging(socket);
+	}
+
+	template<> template<>
+	void packetack_object::test<7>()
+	{
+		// Benchmark: a second of a busy circuit at 100k packets a second,
+		// through LLCircuitData and through the std::map version. Acks come
+		// back after 50ms, one in fifty after 500ms, and there is a resend
+		// pass every 10ms. Timeouts are long enough that nothing is resent,
+		// both sides only keep, find and walk their packets. Reported, not
+		// enforced, timings on a build machine are too noisy to assert on.
+		S32 socket = 0;
+		LLHost host;
+		startMessaging(13038, socket, host);
+
+		const S32 STEPS = 100;
+		const S32 PACKETS_PER_STEP = 1000;
+		const S32 ACK_DELAY = 5;
+		const S32 LATE_ACK_DELAY = 50;
+		F64 circuit_time = 0.0;
+		F64 map_time = 0.0;
+		S32 peak_unacked = 0;
+		for (S32 pass = 0; pass < 2; ++pass)
+		{
+			const bool use_circuit = pass == 0;
+			TestCircuitData* circuit = use_circuit ? new TestCircuitData(host) : NULL;
+			OldReliablePackets* expected = use_circuit ? NULL : new OldReliablePackets;
+			const F32 ping = use_circuit ? circuit->getPingDelayAveraged() : 0.f;
+			sCallbacks.clear();
+
+			// Packets to ack, by the step their ack arrives
+			std::vector<std::vector<TPACKETID> > acks(STEPS + LATE_ACK_DELAY + 1);
+			std::vector<U8> buffer(LL_MINIMUM_VALID_PACKET_SIZE + 200, 0);
+			const F64 start = (F64)((S64)totalTime()) / 1000000.0;
+			TPACKETID next_id = 1;
+			LLTimer timer;
+			for (S32 step = 0; step < STEPS; ++step)
+			{
+				for (S32 i = 0; i < PACKETS_PER_STEP; ++i)
+				{
+					LLReliablePacketParams params;
+					params.set(host, 3, FALSE, 1000.f, record_callback, (void**)(size_t)next_id, NULL);
+					U32 net_id = htonl(next_id);
+					memcpy(&buffer[PHL_PACKET_ID], &net_id, sizeof(net_id));	/*Flawfinder: ignore*/
+					if (use_circuit)
+					{
+						circuit->addReliablePacket(socket, &buffer[0], buffer.size(), &params);
+					}
+					else
+					{
+						expected->add(next_id, params, &buffer[0], buffer.size(), start);
+					}
+					acks[step + (next_id % 50 ? ACK_DELAY : LATE_ACK_DELAY)].push_back(next_id);
+					++next_id;
+				}
+
+				for (S32 i = 0; i < (S32)acks[step].size(); ++i)
+				{
+					if (use_circuit)
+					{
+						circuit->ackReliablePacket(acks[step][i]);
+					}
+					else
+					{
+						expected->ack(acks[step][i]);
+					}
+				}
+
+				F64 now = start + step * 0.01;
+				S32 unacked = use_circuit ? circuit->resendUnackedPackets(now) : expected->resend(now, ping);
+				peak_unacked = llmax(peak_unacked, unacked);
+			}
+			if (use_circuit)
+			{
+				circuit_time = timer.getElapsedTimeF64();
+				ensure_equals("nothing resent", circuit->getUnackedPacketCount() + (S32)sCallbacks.size(), STEPS * PACKETS_PER_STEP);
+			}
+			else
+			{
+				map_time = timer.getElapsedTimeF64();
+				ensure_equals("nothing resent by the map", expected->mResent, 0U);
+			}
+			delete circuit;
+			delete expected;
+		}
+
+		llinfos << STEPS * PACKETS_PER_STEP << " packets, up to " << peak_unacked << " unacked: circuit "
+				<< circuit_time * 1000.0 << " ms, std::map " << map_time * 1000.0 << " ms ("
+				<< (circuit_time > 0.0 ? map_time / circuit_time : 0.0) << "x)" << llendl;
+		stopMessaging(socket);
+	}
+}
@@ -0,0 +1,152 @@
+/**
+ * @file llpacketring_test.cpp
+ * @brief Tests for LLPacketRing's batched transport over loopback
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include <vector>
+
+#include "../llpacketring.h"
+#include "../net.h"
+#include "lltimer.h"
+
+#include "../test/lltut.h"
+
+namespace tut
+{
+	struct packetring_data
+	{
+		packetring_data() : mSocket(-1), mPort(NET_USE_OS_ASSIGNED_PORT)
+		{
+			start_net(mSocket, mPort);
+			mSelf.set(ip_string_to_u32(LOOPBACK_ADDRESS_STRING), mPort);
+		}
+		~packetring_data()
+		{
+			end_net(mSocket);
+		}
+
+		// Sends count packets of size bytes to ourselves as one batch, the
+		// first byte of each is its sequence number
+		S32 sendToSelf(LLPacketRing& ring, S32 count, S32 size)
+		{
+			std::vector<char> packet(size, 'x');
+			ring.beginSendBatch();
+			for (S32 i = 0; i < count; ++i)
+			{
+				packet[0] = (char)i;
+				ring.sendPacket(mSocket, &packet[0], size, mSelf);
+			}
+			S32 failed = ring.flushSendBatch();
+			// Let loopback deliver everything
+			ms_sleep(50);
+			return failed;
+		}
+
+		S32 mSocket;
+		S32 mPort;
+		LLHost mSelf;
+	};
+	typedef test_group<packetring_data> packetring_group;
+	typedef packetring_group::object packetring_object;
+	packetring_group packetringgrp("LLPacketRing");
+
+	template<> template<>
+	void packetring_object::test<1>()
+	{
+		set_test_name("batched send and receive");
+		ensure("socket open", mSocket >= 0);
+		LLPacketRing ring;
+		const S32 NUM_PACKETS = 100;
+		ensure_equals("nothing failed", sendToSelf(ring, NUM_PACKETS, 200), 0);
+
+		for (S32 i = 0; i < NUM_PACKETS; ++i)
+		{
+			char* data = NULL;
+			S32 size = ring.receivePacket(mSocket, &data);
+			ensure_equals(llformat("packet %d size", i), size, 200);
+			ensure_equals(llformat("packet %d in order", i), (S32)(U8)data[0], i);
+			ensure("sender", ring.getLastSender() == mSelf);
+		}
+		char* data = NULL;
+		ensure_equals("drained", ring.receivePacket(mSocket, &data), 0);
+		ensure("no data when drained", data == NULL);
+	}
+
+	template<> template<>
+	void packetring_object::test<2>()
+	{
+		set_test_name("packet loss emulation");
+		LLPacketRing ring;
+		ring.setDropPercentage(100.f);
+		sendToSelf(ring, 20, 100);
+		for (S32 i = 0; i < 40; ++i)
+		{
+			char* data = NULL;
+			ensure_equals("everything dropped", ring.receivePacket(mSocket, &data), 0);
+		}
+		ring.setDropPercentage(0.f);
+		char* data = NULL;
+		ensure_equals("dropped packets are gone", ring.receivePacket(mSocket, &data), 0);
+	}
+
+	template<> template<>
+	void packetring_object::test<3>()
+	{
+		set_test_name("throttle emulation");
+		LLPacketRing ring;
+		ring.setUseInThrottle(TRUE);
+		ring.setInBandwidth(800000.f);
+		const S32 NUM_PACKETS = 20;
+		const S32 PACKET_SIZE = 1000;
+		sendToSelf(ring, NUM_PACKETS, PACKET_SIZE);
+
+		S32 received = 0;
+		char* data = NULL;
+		while (ring.receivePacket(mSocket, &data) > 0)
+		{
+			ensure_equals("in order", (S32)(U8)data[0], received);
+			++received;
+		}
+		ensure("throttled", received < NUM_PACKETS);
+		ensure_equals("all of them taken off the socket", ring.getAndResetActualInBits(),
+					  NUM_PACKETS * PACKET_SIZE * 8);
+
+		LLTimer timeout;
+		while (received < NUM_PACKETS && timeout.getElapsedTimeF32() < 5.f)
+		{
+			if (ring.receivePacket(mSocket, &data) > 0)
+			{
+				ensure_equals("in order", (S32)(U8)data[0], received);
+				++received;
+			}
+			else
+			{
+				ms_sleep(10);
+			}
+		}
+		ensure_equals("all delivered in the end", received, NUM_PACKETS);
+	}
+}
@@ -0,0 +1,137 @@
+#!/usr/bin/python
+"""\
+@file   test_llcurl_peer.py
+@brief  This script asynchronously runs the executable (with args) specified on
+        the command line, returning its result code. While that executable is
+        running, we stand in for the texture server: an HTTP/1.1 server with
+        keep-alive that answers range requests, for use by C++ tests.
+
+$LicenseInfo:firstyear=2010&license=viewerlgpl$
+Second Life Viewer Source Code
+Copyright (C) 2010, Linden Research, Inc.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation;
+version 2.1 of the License only.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+$/LicenseInfo$
+"""
+
+import os
+import re
+import sys
+from threading import Thread, Lock
+from BaseHTTPServer import HTTPServer, BaseHTTPRequestHandler
+from SocketServer import ThreadingMixIn
+
+mydir = os.path.dirname(__file__)       # expected to be .../indra/llmessage/tests/
+sys.path.insert(0, os.path.join(mydir, os.pardir, os.pardir, "lib", "python"))
+from testrunner import run, debug
+
+# Must match llcurl_test.cpp
+TEXTURE_SIZE = 20000
+
+class Stats(object):
+    """Connections accepted and texture requests answered since the last
+    /reset, plus the order textures were asked for."""
+    def __init__(self):
+        self.lock = Lock()
+        self.reset()
+
+    def reset(self):
+        self.connections = 0
+        self.requests = 0
+        self.order = []
+
+stats = Stats()
+
+def texture_data(texture):
+    # Every texture gets its own recognizable byte pattern, see
+    # texture_byte() in llcurl_test.cpp
+    return ''.join(chr((texture * 31 + i) % 251) for i in xrange(TEXTURE_SIZE))
+
+class TestHTTPRequestHandler(BaseHTTPRequestHandler):
+    """Answers GET /texture/<n> with (a range of) a generated texture, and
+    /stats and /reset to let the C++ test see how it was asked."""
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        BaseHTTPRequestHandler.setup(self)
+        with stats.lock:
+            stats.connections += 1
+
+    def do_GET(self):
+        if self.path == "/stats":
+            with stats.lock:
+                self.answer(200, "connections=%d requests=%d order=%s" %
+                            (stats.connections, stats.requests,
+                             ",".join(stats.order)))
+            return
+        if self.path == "/reset":
+            with stats.lock:
+                stats.reset()
+            self.answer(200, "")
+            return
+        match = re.match(r"^/texture/(\d+)$", self.path)
+        if not match:
+            self.answer(404, "")
+            return
+        with stats.lock:
+            stats.requests += 1
+            stats.order.append(match.group(1))
+        data = texture_data(int(match.group(1)))
+        match = re.match(r"^bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        if not match:
+            self.answer(200, data)
+            return
+        first = int(match.group(1))
+        last = int(match.group(2)) if match.group(2) else len(data) - 1
+        last = min(last, len(data) - 1)
+        if first > last:
+            self.answer(416, "")
+            return
+        self.answer(206, data[first:last + 1],
+                    ("Content-Range", "bytes %d-%d/%d" % (first, last, len(data))))
+
+    def answer(self, status, body, *headers):
+        self.send_response(status)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(len(body)))
+        for header in headers:
+            self.send_header(*header)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_request(self, code, size=None):
+        # For present purposes, we don't want the request splattered onto
+        # stderr, as it would upset devs watching the test run
+        pass
+
+    def log_error(self, format, *args):
+        # Suppress error output as well
+        pass
+
+class ThreadingHTTPServer(ThreadingMixIn, HTTPServer):
+    # Keep-alive connections hold on to their handler, so every connection
+    # needs its own thread
+    daemon_threads = True
+
+class TestHTTPServer(Thread):
+    def run(self):
+        httpd = ThreadingHTTPServer(('127.0.0.1', 8000), TestHTTPRequestHandler)
+        debug("Starting HTTP server...\n")
+        httpd.serve_forever()
+
+if __name__ == "__main__":
+    sys.exit(run(server=TestHTTPServer(name="httpd"), *sys.argv[1:]))
@@ -85,6 +85,9 @@ public:
 	
 	// ARB Extensions
 	BOOL mHasVertexBufferObject;
+	BOOL mHasMapBufferRange;
+	BOOL mHasSync;
+	BOOL mHasPixelBufferObject;
 	BOOL mHasPBuffer;
 	BOOL mHasShaderObjects;
 	BOOL mHasVertexShader;
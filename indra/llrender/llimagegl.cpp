@@ -45,6 +45,10 @@ LLGLuint LLImageGL::sCurrentBoundTextures[MAX_GL_TEXTURE_UNITS] = { 0 };
 
 U32 LLImageGL::sUniqueCount				= 0;
 U32 LLImageGL::sBindCount				= 0;
+U32 LLImageGL::sUploadBytes				= 0;
+U32 LLImageGL::sStagedUploadBytes		= 0;
+U32 LLImageGL::sCurUploadBytes			= 0;
+U32 LLImageGL::sCurStagedUploadBytes	= 0;
 S32 LLImageGL::sGlobalTextureMemoryInBytes		= 0;
 S32 LLImageGL::sBoundTextureMemoryInBytes		= 0;
 S32 LLImageGL::sCurBoundTextureMemory	= 0;
@@ -178,6 +182,8 @@ void LLImageGL::initClass(S32 num_catagories)
 	sTextureMemByCategory.resize(sMaxCatagories);
 	sTextureMemByCategoryBound.resize(sMaxCatagories) ;
 	sTextureCurMemByCategoryBound.resize(sMaxCatagories) ;
+
+	LLImageGLUpload::initClass();
 }
 
 //static 
@@ -186,6 +192,9 @@ void LLImageGL::cleanupClass()
 	sTextureMemByCategory.clear() ;
 	sTextureMemByCategoryBound.clear() ;
 	sTextureCurMemByCategoryBound.clear() ;
+
+	// LLImageGLUpload::cleanupClass() waits for the decode threads to be gone
+	LLImageGLUpload::destroyGL();
 }
 
 //static 
@@ -283,6 +292,10 @@ void LLImageGL::updateStats(F32 current_time)
 	sLastFrameTime = current_time;
 	sBoundTextureMemoryInBytes = sCurBoundTextureMemory;
 	sCurBoundTextureMemory = 0;
+	sUploadBytes = sCurUploadBytes;
+	sCurUploadBytes = 0;
+	sStagedUploadBytes = sCurStagedUploadBytes;
+	sCurStagedUploadBytes = 0;
 
 	if(gAuditTexture)
 	{
@@ -343,11 +356,15 @@ void LLImageGL::destroyGL(BOOL save_state)
 		}
 	}
 	sAllowReadBackRaw = false ;
+
+	LLImageGLUpload::destroyGL();
 }
 
 //static 
 void LLImageGL::restoreGL()
 {
+	LLImageGLUpload::restoreGL();
+
 	for (std::set<LLImageGL*>::iterator iter = sImageList.begin();
 		 iter != sImageList.end(); iter++)
 	{
@@ -739,10 +756,7 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 					S32 w = getWidth(mCurrentDiscardLevel);
 					S32 h = getHeight(mCurrentDiscardLevel);
 
-					LLImageGL::setManualImage(mTarget, 0, mFormatInternal,
-								 w, h, 
-								 mFormatPrimary, mFormatType,
-								 data_in);
+					setLevelZeroImage(w, h, data_in);
 					analyzeAlpha(data_in, w, h);
 					stop_glerror();
 
@@ -795,11 +809,15 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 							stop_glerror();
 						}
 
-						LLImageGL::setManualImage(mTarget, m, mFormatInternal, w, h, mFormatPrimary, mFormatType, cur_mip_data);
 						if (m == 0)
 						{
+							setLevelZeroImage(w, h, cur_mip_data);
 							analyzeAlpha(data_in, w, h);
 						}
+						else
+						{
+							LLImageGL::setManualImage(mTarget, m, mFormatInternal, w, h, mFormatPrimary, mFormatType, cur_mip_data);
+						}
 						stop_glerror();
 						if (m == 0)
 						{
@@ -852,8 +870,7 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 				stop_glerror();
 			}
 
-			LLImageGL::setManualImage(mTarget, 0, mFormatInternal, w, h,
-						 mFormatPrimary, mFormatType, (GLvoid *)data_in);
+			setLevelZeroImage(w, h, data_in);
 			analyzeAlpha(data_in, w, h);
 			
 			updatePickMask(w, h, data_in);
@@ -870,9 +887,32 @@ void LLImageGL::setImage(const U8* data_in, BOOL data_hasmips)
 		mHasMipMaps = false;
 	}
 	stop_glerror();
+	mStagedUpload = NULL;
 	mGLTextureCreated = true;
 }
 
+void LLImageGL::setLevelZeroImage(S32 width, S32 height, const U8* data_in)
+{
+	LLPointer<LLImageGLUpload> upload = mStagedUpload;
+	mStagedUpload = NULL;
+
+	U32 bytes = width * height * mComponents;
+	sCurUploadBytes += bytes;
+
+	if (upload.notNull() && mFormatType == GL_UNSIGNED_BYTE &&
+		upload->matches(data_in, width, height, mComponents) && upload->bind())
+	{
+		// pixels is an offset into the bound buffer
+		LLImageGL::setManualImage(mTarget, 0, mFormatInternal, width, height, mFormatPrimary, mFormatType, NULL);
+		upload->unbind();
+		sCurStagedUploadBytes += bytes;
+	}
+	else
+	{
+		LLImageGL::setManualImage(mTarget, 0, mFormatInternal, width, height, mFormatPrimary, mFormatType, data_in);
+	}
+}
+
 BOOL LLImageGL::preAddToAtlas(S32 discard_level, const LLImageRaw* raw_image)
 {
 	if (gGLManager.mIsDisabled)
@@ -1141,6 +1181,7 @@ BOOL LLImageGL::createGLTexture(S32 discard_level, const LLImageRaw* imageraw, S
 	if (gGLManager.mIsDisabled)
 	{
 		llwarns << "Trying to create a texture while GL is disabled!" << llendl;
+		mStagedUpload = NULL;
 		return FALSE;
 	}
 
@@ -1199,6 +1240,7 @@ BOOL LLImageGL::createGLTexture(S32 discard_level, const LLImageRaw* imageraw, S
 
 	if(!to_create) //not create a gl texture
 	{
+		mStagedUpload = NULL;
 		destroyGLTexture();
 		mCurrentDiscardLevel = discard_level;	
 		mLastBindTime = sLastFrameTime;
@@ -1207,7 +1249,9 @@ BOOL LLImageGL::createGLTexture(S32 discard_level, const LLImageRaw* imageraw, S
 
 	setCategory(category) ;
  	const U8* rawdata = imageraw->getData();
-	return createGLTexture(discard_level, rawdata, FALSE, usename);
+	BOOL res = createGLTexture(discard_level, rawdata, FALSE, usename);
+	mStagedUpload = NULL; // unused if creation failed early
+	return res;
 }
 
 BOOL LLImageGL::createGLTexture(S32 discard_level, const U8* data_in, BOOL data_hasmips, S32 usename)
@@ -31,6 +31,7 @@
 #include "llimage.h"
 
 #include "llgltypes.h"
+#include "llimageglupload.h"
 #include "llpointer.h"
 #include "llrefcount.h"
 #include "v2math.h"
@@ -88,6 +89,7 @@ protected:
 
 	void analyzeAlpha(const void* data_in, U32 w, U32 h);
 	void calcAlphaChannelOffsetAndStride();
+	void setLevelZeroImage(S32 width, S32 height, const U8* data_in);
 
 public:
 	virtual void dump();	// debugging info to llinfos
@@ -107,6 +109,8 @@ public:
 	BOOL createGLTexture(S32 discard_level, const U8* data, BOOL data_hasmips = FALSE, S32 usename = 0);
 	void setImage(const LLImageRaw* imageraw);
 	void setImage(const U8* data_in, BOOL data_hasmips = FALSE);
+	// The next setImage() uploads level 0 from upload if it holds a copy of the pixels passed
+	void setStagedUpload(LLImageGLUpload* upload) { mStagedUpload = upload; }
 	BOOL setSubImage(const LLImageRaw* imageraw, S32 x_pos, S32 y_pos, S32 width, S32 height, BOOL force_fast_update = FALSE);
 	BOOL setSubImage(const U8* datap, S32 data_width, S32 data_height, S32 x_pos, S32 y_pos, S32 width, S32 height, BOOL force_fast_update = FALSE);
 	BOOL setSubImageFromFrameBuffer(S32 fb_x, S32 fb_y, S32 x_pos, S32 y_pos, S32 width, S32 height);
@@ -187,6 +191,7 @@ public:
 	
 private:
 	LLPointer<LLImageRaw> mSaveData; // used for destroyGL/restoreGL
+	LLPointer<LLImageGLUpload> mStagedUpload; // see setStagedUpload()
 	U8* mPickMask;  //downsampled bitmap approximation of alpha channel.  NULL if no alpha channel
 	U16 mPickMaskWidth;
 	U16 mPickMaskHeight;
@@ -243,6 +248,10 @@ public:
 	static S32 sCurBoundTextureMemory;		// Tracks bound texmem for current frame
 	static U32 sBindCount;					// Tracks number of texture binds for current frame
 	static U32 sUniqueCount;				// Tracks number of unique texture binds for current frame
+	static U32 sUploadBytes;				// Tracks level 0 bytes uploaded by setImage for last completed frame
+	static U32 sStagedUploadBytes;			// Tracks the part of sUploadBytes uploaded from a pixel buffer
+	static U32 sCurUploadBytes;				// Tracks level 0 bytes uploaded by setImage for current frame
+	static U32 sCurStagedUploadBytes;		// Tracks the part of sCurUploadBytes uploaded from a pixel buffer
 	static BOOL sGlobalUseAnisotropic;
 	static LLImageGL* sDefaultGLTexture ;	
 	static BOOL sAutomatedTest;
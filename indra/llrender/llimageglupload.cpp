@@ -0,0 +1,364 @@
+/**
+ * @file llimageglupload.cpp
+ * @brief Pixel buffer objects that decode threads fill for LLImageGL uploads
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "linden_common.h"
+
+#include "llimageglupload.h"
+
+#include "llgl.h"
+#include "llglheaders.h"
+#include "llimage.h"
+#include "lltimer.h"
+
+//statics
+BOOL LLImageGLUpload::sEnabled = FALSE;
+U32 LLImageGLUpload::sMaxPoolBytes = 32 << 20;
+U32 LLImageGLUpload::sMisses = 0;
+F32 LLImageGLUpload::sMapTime = 0.f;
+U32 LLImageGLUpload::sPoolBytes = 0;
+
+LLMutex* LLImageGLUpload::sMutex = NULL;
+BOOL LLImageGLUpload::sLive = FALSE;
+U32 LLImageGLUpload::sGeneration = 0;
+LLAtomicS32 LLImageGLUpload::sCopying;
+LLImageGLUpload::buffer_list_t LLImageGLUpload::sFree[NUM_SIZE_CLASSES];
+LLImageGLUpload::buffer_list_t LLImageGLUpload::sUploaded[NUM_SIZE_CLASSES];
+U32 LLImageGLUpload::sWanted[NUM_SIZE_CLASSES];
+U32 LLImageGLUpload::sCurMisses = 0;
+
+//static
+void LLImageGLUpload::initClass()
+{
+	if (!sMutex)
+	{
+		sMutex = new LLMutex(NULL);
+	}
+	restoreGL();
+}
+
+//static
+void LLImageGLUpload::cleanupClass()
+{
+	// GL is gone by now, destroyGL() already dropped the buffers
+	delete sMutex;
+	sMutex = NULL;
+}
+
+//static
+void LLImageGLUpload::restoreGL()
+{
+	if (sMutex)
+	{
+		LLMutexLock lock(sMutex);
+		sLive = gGLManager.mHasPixelBufferObject;
+	}
+}
+
+//static
+void LLImageGLUpload::destroyGL()
+{
+	if (!sMutex)
+	{
+		return;
+	}
+
+	sMutex->lock();
+	sLive = FALSE;
+	sGeneration++;
+	sMutex->unlock();
+
+	// stage() checks sLive before it counts itself in sCopying, wait out the
+	// copies started before
+	while (sCopying > 0)
+	{
+		ms_sleep(1);
+	}
+
+	// Buffers claimed now belong to the old generation and are abandoned by
+	// their owners, the free and uploaded ones can still be deleted
+	for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+	{
+		if (gGLManager.mInited)
+		{
+			deleteBuffers(sFree[i]);
+			deleteBuffers(sUploaded[i]);
+		}
+		sFree[i].clear();
+		sUploaded[i].clear();
+		sWanted[i] = 0;
+	}
+	sPoolBytes = 0;
+}
+
+//static
+void LLImageGLUpload::deleteBuffers(buffer_list_t& buffers)
+{
+	if (buffers.empty())
+	{
+		return;
+	}
+	for (buffer_list_t::iterator iter = buffers.begin(); iter != buffers.end(); ++iter)
+	{
+		if (iter->mMapped)
+		{
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, iter->mName);
+			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		}
+		glDeleteBuffersARB(1, (GLuint*) &iter->mName);
+	}
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	buffers.clear();
+}
+
+//static
+U8* LLImageGLUpload::mapBuffer(U32 name, U32 bytes)
+{
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, name);
+	// Orphan the old storage first so mapping does not wait for a transfer
+	// that may still be reading it
+	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bytes, NULL, GL_STREAM_DRAW_ARB);
+	U8* mapped = (U8*) glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	return mapped;
+}
+
+//static
+S32 LLImageGLUpload::getSizeClass(U32 bytes)
+{
+	if (bytes < (1U << MIN_SIZE_LOG2) || bytes > (1U << MAX_SIZE_LOG2))
+	{
+		return -1;
+	}
+	S32 size_class = 0;
+	while (getClassBytes(size_class) < bytes)
+	{
+		size_class++;
+	}
+	return size_class;
+}
+
+//static
+void LLImageGLUpload::updateClass()
+{
+	if (!sMutex)
+	{
+		return;
+	}
+
+	buffer_list_t uploaded[NUM_SIZE_CLASSES];
+	U32 wanted[NUM_SIZE_CLASSES];
+
+	sMutex->lock();
+	BOOL live = sLive;
+	for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+	{
+		uploaded[i].swap(sUploaded[i]);
+		wanted[i] = sWanted[i];
+		sWanted[i] = 0;
+	}
+	sMisses = sCurMisses;
+	sCurMisses = 0;
+	sMutex->unlock();
+
+	sMapTime = 0.f;
+	if (!live)
+	{
+		return;
+	}
+
+	if (!sEnabled)
+	{
+		// Turned off, drop the pool. Buffers claimed now come back through
+		// sUploaded or sFree and get deleted on a later frame.
+		sMutex->lock();
+		for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+		{
+			uploaded[i].insert(uploaded[i].end(), sFree[i].begin(), sFree[i].end());
+			sFree[i].clear();
+		}
+		sMutex->unlock();
+
+		for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+		{
+			sPoolBytes -= uploaded[i].size() * getClassBytes(i);
+			deleteBuffers(uploaded[i]);
+		}
+		return;
+	}
+
+	LLTimer map_timer;
+	for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+	{
+		U32 bytes = getClassBytes(i);
+
+		for (buffer_list_t::iterator iter = uploaded[i].begin(); iter != uploaded[i].end(); ++iter)
+		{
+			iter->mMapped = mapBuffer(iter->mName, bytes);
+		}
+
+		// Grow the size classes that missed, within the cap
+		for (U32 j = 0; j < llmin(wanted[i], (U32) MAX_NEW_PER_FRAME); ++j)
+		{
+			if (sPoolBytes + bytes > sMaxPoolBytes)
+			{
+				break;
+			}
+			U32 name = 0;
+			glGenBuffersARB(1, (GLuint*) &name);
+			uploaded[i].push_back(Buffer(name, mapBuffer(name, bytes)));
+			sPoolBytes += bytes;
+		}
+
+		// Mapping can fail when the driver is short on memory, give those up
+		for (buffer_list_t::iterator iter = uploaded[i].begin(); iter != uploaded[i].end(); )
+		{
+			if (iter->mMapped)
+			{
+				++iter;
+			}
+			else
+			{
+				glDeleteBuffersARB(1, (GLuint*) &iter->mName);
+				sPoolBytes -= bytes;
+				iter = uploaded[i].erase(iter);
+			}
+		}
+	}
+	sMapTime = map_timer.getElapsedTimeF32();
+
+	sMutex->lock();
+	for (S32 i = 0; i < NUM_SIZE_CLASSES; ++i)
+	{
+		sFree[i].insert(sFree[i].end(), uploaded[i].begin(), uploaded[i].end());
+	}
+	sMutex->unlock();
+}
+
+//static
+LLPointer<LLImageGLUpload> LLImageGLUpload::stage(const LLImageRaw* raw)
+{
+	if (!sEnabled || !sMutex || !raw || !raw->getData())
+	{
+		return NULL;
+	}
+
+	U32 bytes = raw->getWidth() * raw->getHeight() * raw->getComponents();
+	S32 size_class = getSizeClass(bytes);
+	if (size_class < 0)
+	{
+		return NULL;
+	}
+
+	sMutex->lock();
+	if (!sLive)
+	{
+		sMutex->unlock();
+		return NULL;
+	}
+	if (sFree[size_class].empty())
+	{
+		sWanted[size_class]++;
+		sCurMisses++;
+		sMutex->unlock();
+		return NULL;
+	}
+	Buffer buffer = sFree[size_class].back();
+	sFree[size_class].pop_back();
+	U32 generation = sGeneration;
+	sCopying++;
+	sMutex->unlock();
+
+	memcpy(buffer.mMapped, raw->getData(), bytes);
+	sCopying--;
+
+	LLImageGLUpload* upload = new LLImageGLUpload(size_class, buffer.mName, buffer.mMapped, generation);
+	upload->mSource = raw->getData();
+	upload->mWidth = raw->getWidth();
+	upload->mHeight = raw->getHeight();
+	upload->mComponents = raw->getComponents();
+	return upload;
+}
+
+LLImageGLUpload::LLImageGLUpload(S32 size_class, U32 name, U8* mapped, U32 generation)
+	: mSizeClass(size_class),
+	  mBuffer(name, mapped),
+	  mGeneration(generation),
+	  mSource(NULL),
+	  mWidth(0),
+	  mHeight(0),
+	  mComponents(0)
+{
+}
+
+LLImageGLUpload::~LLImageGLUpload()
+{
+	// Any thread, so no GL here. A buffer never uploaded from is still
+	// mapped and can go straight back on the free list.
+	if (sMutex)
+	{
+		LLMutexLock lock(sMutex);
+		if (mGeneration == sGeneration)
+		{
+			if (mBuffer.mMapped)
+			{
+				sFree[mSizeClass].push_back(mBuffer);
+			}
+			else
+			{
+				sUploaded[mSizeClass].push_back(mBuffer);
+			}
+		}
+	}
+}
+
+BOOL LLImageGLUpload::matches(const void* data, S32 width, S32 height, S32 components) const
+{
+	return data == mSource && width == mWidth && height == mHeight && components == mComponents;
+}
+
+BOOL LLImageGLUpload::bind()
+{
+	if (!sLive || mGeneration != sGeneration || !mBuffer.mMapped)
+	{
+		return FALSE;
+	}
+
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, mBuffer.mName);
+	BOOL intact = glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+	mBuffer.mMapped = NULL;
+	if (!intact)
+	{
+		// The contents were lost (mode switch and the like)
+		unbind();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void LLImageGLUpload::unbind()
+{
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+}
@@ -0,0 +1,128 @@
+/**
+ * @file llimageglupload.h
+ * @brief Pixel buffer objects that decode threads fill for LLImageGL uploads
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLIMAGEGLUPLOAD_H
+#define LL_LLIMAGEGLUPLOAD_H
+
+#include <vector>
+
+#include "llpointer.h"
+#include "llthread.h"
+
+class LLImageRaw;
+
+// A copy of a decoded image in a pixel buffer object, written while the
+// buffer is mapped by whichever thread decoded the image.  glTexImage2D from
+// a bound pixel buffer only queues a transfer the driver can do on its own
+// time, where uploading from client memory has to copy every byte before the
+// call returns.
+//
+// The main thread keeps buffers mapped ahead of time in a few size classes,
+// adding buffers for the classes stage() runs out of, and decode threads
+// claim them with stage().  LLImageGL::setImage() uploads from the buffer
+// when it is given one holding a copy of the pixels it was asked to upload.
+class LLImageGLUpload : public LLThreadSafeRefCount
+{
+public:
+	static void initClass();
+	// After destroyGL() and after every thread that calls stage() is gone
+	static void cleanupClass();
+
+	// MAIN thread, once a frame. Maps the buffers uploaded from since the
+	// last call again and adds buffers for the sizes stage() ran out of.
+	static void updateClass();
+
+	// MAIN thread. The buffers do not survive the GL context, drop them all.
+	static void destroyGL();
+	static void restoreGL();
+
+	// Any thread. Copies the pixels of raw into a free mapped buffer, NULL if
+	// the pool is off or has no buffer free of the size needed.
+	static LLPointer<LLImageGLUpload> stage(const LLImageRaw* raw);
+
+	// True if this holds a copy of data, an image of the given size
+	BOOL matches(const void* data, S32 width, S32 height, S32 components) const;
+
+	// MAIN thread. Unmaps the buffer and binds it as GL_PIXEL_UNPACK_BUFFER,
+	// the pixels argument of glTexImage2D is then an offset into it. FALSE
+	// if the buffer can not be used, nothing is left bound then.
+	BOOL bind();
+	void unbind();
+
+	static BOOL sEnabled;			// RenderTextureUploadPBO
+	static U32 sMaxPoolBytes;		// cap on the bytes in buffers, claimed or not
+
+	// Stats for the last completed frame
+	static U32 sMisses;				// stage() calls that found no buffer free
+	static F32 sMapTime;			// seconds updateClass() spent mapping buffers
+	static U32 sPoolBytes;			// bytes in buffers, claimed or not
+
+protected:
+	/*virtual*/ ~LLImageGLUpload(); // use unref(), returns the buffer to the pool
+
+private:
+	LLImageGLUpload(S32 size_class, U32 name, U8* mapped, U32 generation);
+
+	struct Buffer
+	{
+		Buffer(U32 name, U8* mapped) : mName(name), mMapped(mapped) {}
+		U32 mName;
+		U8* mMapped;	// NULL once uploaded from
+	};
+	typedef std::vector<Buffer> buffer_list_t;
+
+	enum
+	{
+		MIN_SIZE_LOG2 = 14,		// 64x64 RGBA, smaller images are not worth staging
+		MAX_SIZE_LOG2 = 22,		// 1024x1024 RGBA
+		NUM_SIZE_CLASSES = MAX_SIZE_LOG2 - MIN_SIZE_LOG2 + 1,
+		MAX_NEW_PER_FRAME = 4	// buffers added to a size class in one frame
+	};
+
+	static S32 getSizeClass(U32 bytes);
+	static U32 getClassBytes(S32 size_class) { return 1 << (size_class + MIN_SIZE_LOG2); }
+	static U8* mapBuffer(U32 name, U32 bytes);
+	static void deleteBuffers(buffer_list_t& buffers);
+
+	S32 mSizeClass;
+	Buffer mBuffer;
+	U32 mGeneration;
+	const void* mSource;	// the pixels copied, only compared against
+	S32 mWidth;
+	S32 mHeight;
+	S32 mComponents;
+
+	static LLMutex* sMutex;
+	static BOOL sLive;	// FALSE between destroyGL() and restoreGL()
+	static U32 sGeneration;	// bumped by destroyGL(), buffers from before are abandoned
+	static LLAtomicS32 sCopying;	// stage() calls copying into a buffer
+	static buffer_list_t sFree[NUM_SIZE_CLASSES];		// guarded by sMutex, mapped and unclaimed
+	static buffer_list_t sUploaded[NUM_SIZE_CLASSES];	// guarded by sMutex, to be mapped again
+	static U32 sWanted[NUM_SIZE_CLASSES];	// guarded by sMutex, misses since the last update
+	static U32 sCurMisses;	// guarded by sMutex
+};
+
+#endif // LL_LLIMAGEGLUPLOAD_H
@@ -45,6 +45,8 @@ S32	gGLViewport[4];
 
 U32 LLRender::sUICalls = 0;
 U32 LLRender::sUIVerts = 0;
+U32 LLRender::sBatchCount = 0;
+U32 LLRender::sDrawCount = 0;
 
 static const U32 LL_NUM_TEXTURE_LAYERS = 16; 
 
@@ -189,8 +191,6 @@ bool LLTexUnit::bind(LLTexture* texture, bool for_rendering, bool forceBind)
 	stop_glerror();
 	if (mIndex < 0) return false;
 
-	gGL.flush();
-
 	LLImageGL* gl_tex = NULL ;
 	if (texture == NULL || !(gl_tex = texture->getGLTexture()))
 	{
@@ -218,6 +218,7 @@ bool LLTexUnit::bind(LLTexture* texture, bool for_rendering, bool forceBind)
 	}
 	if ((mCurrTexture != gl_tex->getTexName()) || forceBind)
 	{
+		gGL.flush();
 		activate();
 		enable(gl_tex->getTarget());
 		mCurrTexture = gl_tex->getTexName();
@@ -282,8 +283,6 @@ bool LLTexUnit::bind(LLCubeMap* cubeMap)
 {
 	if (mIndex < 0) return false;
 
-	gGL.flush();
-
 	if (cubeMap == NULL)
 	{
 		llwarns << "NULL LLTexUnit::bind cubemap" << llendl;
@@ -294,6 +293,7 @@ bool LLTexUnit::bind(LLCubeMap* cubeMap)
 	{
 		if (gGLManager.mHasCubeMap && LLCubeMap::sUseCubeMaps)
 		{
+			gGL.flush();
 			activate();
 			enable(LLTexUnit::TT_CUBE_MAP);
 			mCurrTexture = cubeMap->mImages[0]->getTexName();
@@ -323,8 +323,6 @@ bool LLTexUnit::bind(LLRenderTarget* renderTarget, bool bindDepth)
 {
 	if (mIndex < 0) return false;
 
-	gGL.flush();
-
 	if (bindDepth)
 	{
 		if (renderTarget->hasStencil())
@@ -751,6 +749,7 @@ void LLTexUnit::debugTextureUnit(void)
 LLRender::LLRender()
   : mDirty(false),
     mCount(0),
+    mBatchEnd(0),
     mMode(LLRender::TRIANGLES),
     mCurrTextureUnitIndex(0),
     mMaxAnisotropy(0.f) 
@@ -930,6 +929,12 @@ void LLRender::setColorMask(bool writeColor, bool writeAlpha)
 
 void LLRender::setColorMask(bool writeColorR, bool writeColorG, bool writeColorB, bool writeAlpha)
 {
+	if (mCurrColorMask[0] == writeColorR && mCurrColorMask[1] == writeColorG &&
+		mCurrColorMask[2] == writeColorB && mCurrColorMask[3] == writeAlpha && !mDirty)
+	{
+		return;
+	}
+
 	flush();
 
 	mCurrColorMask[0] = writeColorR;
@@ -1094,6 +1099,12 @@ void LLRender::end()
 		//IMM_ERRS << "GL begin and end called with no vertices specified." << llendl;
 	}
 
+	if (mCount > mBatchEnd)
+	{
+		sBatchCount++;
+	}
+	mBatchEnd = mCount;
+
 	if ((mMode != LLRender::QUADS && 
 		mMode != LLRender::LINES &&
 		mMode != LLRender::TRIANGLES &&
@@ -1182,13 +1193,33 @@ void LLRender::flush()
 			}
 		}
 
-		mBuffer->setBuffer(immediate_mask);
-		mBuffer->drawArrays(mMode, 0, mCount);
+		sDrawCount++;
+
+		LLVBORing* ring = LLVertexBuffer::getStreamRing();
+		S32 stride = mBuffer->getStride();
+		S32 offset = ring ? ring->write(mBuffer->getMappedData(), mCount * stride) : -1;
+		if (offset >= 0)
+		{
+			// ring->write() left the ring bound, point the arrays at this copy
+			LLVertexBuffer::setupClientArrays(immediate_mask);
+			U8* base = (U8*) NULL + offset;
+			glVertexPointer(3, GL_FLOAT, stride, (void*)(base + mBuffer->getOffset(LLVertexBuffer::TYPE_VERTEX)));
+			glTexCoordPointer(2, GL_FLOAT, stride, (void*)(base + mBuffer->getOffset(LLVertexBuffer::TYPE_TEXCOORD0)));
+			glColorPointer(4, GL_UNSIGNED_BYTE, stride, (void*)(base + mBuffer->getOffset(LLVertexBuffer::TYPE_COLOR)));
+			glDrawArrays(LLVertexBuffer::sGLMode[mMode], 0, mCount);
+			stop_glerror();
+		}
+		else
+		{
+			mBuffer->setBuffer(immediate_mask);
+			mBuffer->drawArrays(mMode, 0, mCount);
+		}
 		
 		mVerticesp[0] = mVerticesp[mCount];
 		mTexcoordsp[0] = mTexcoordsp[mCount];
 		mColorsp[0] = mColorsp[mCount];
 		mCount = 0;
+		mBatchEnd = 0;
 	}
 }
 
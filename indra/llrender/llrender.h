@@ -347,10 +347,13 @@ public:
 public:
 	static U32 sUICalls;
 	static U32 sUIVerts;
+	static U32 sBatchCount;	// begin()/end() batches submitted
+	static U32 sDrawCount;	// draw calls those batches were merged into
 	
 private:
 	bool				mDirty;
 	U32				mCount;
+	U32				mBatchEnd;	// mCount at the last end()
 	U32				mMode;
 	U32				mCurrTextureUnitIndex;
 	bool				mCurrColorMask[4];
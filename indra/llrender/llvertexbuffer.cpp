@@ -34,6 +34,9 @@
 #include "llmemtype.h"
 #include "llrender.h"
 
+// GL_ARB_sync and GL_ARB_map_buffer_range are only loaded here (see llgl.cpp)
+#define LL_VBO_RING_EXTENSIONS ((LL_WINDOWS || LL_LINUX || LL_SOLARIS) && !LL_MESA_HEADLESS)
+
 //============================================================================
 
 //static
@@ -58,6 +61,7 @@ BOOL LLVertexBuffer::sMapped = FALSE;
 BOOL LLVertexBuffer::sUseStreamDraw = TRUE;
 
 std::vector<U32> LLVertexBuffer::sDeleteList;
+LLVBORing* LLVertexBuffer::sStreamRing = NULL;
 
 S32 LLVertexBuffer::sTypeOffsets[LLVertexBuffer::TYPE_MAX] =
 {
@@ -338,6 +342,8 @@ void LLVertexBuffer::unbind()
 void LLVertexBuffer::cleanupClass()
 {
 	LLMemType mt2(LLMemType::MTYPE_VERTEX_CLEANUP_CLASS);
+	delete sStreamRing;
+	sStreamRing = NULL;
 	unbind();
 	clientCopy(); // deletes GL buffers
 }
@@ -351,6 +357,160 @@ void LLVertexBuffer::clientCopy(F64 max_time)
 	}
 }
 
+//static
+LLVBORing* LLVertexBuffer::getStreamRing()
+{
+#if LL_DARWIN
+	//streaming through a VBO is slower than client arrays on apple (see useVBOs)
+	return NULL;
+#else
+	if (!sEnableVBOs || !sUseStreamDraw || !gGLManager.mHasVertexBufferObject)
+	{
+		return NULL;
+	}
+	if (!sStreamRing)
+	{
+		sStreamRing = new LLVBORing();
+	}
+	return sStreamRing;
+#endif
+}
+
+//----------------------------------------------------------------------------
+
+LLVBORing::LLVBORing()
+:	mGLBuffer(0),
+	mOffset(0),
+	mSegment(0)
+{
+	for (U32 i = 0; i < NUM_SEGMENTS; i++)
+	{
+		mFences[i] = NULL;
+	}
+
+	stop_glerror();
+	glGenBuffersARB(1, (GLuint*) &mGLBuffer);
+	bind();
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, RING_SIZE, NULL, GL_STREAM_DRAW_ARB);
+	stop_glerror();
+
+	LLVertexBuffer::sGLCount++;
+	LLVertexBuffer::sAllocatedBytes += RING_SIZE;
+}
+
+LLVBORing::~LLVBORing()
+{
+#if LL_VBO_RING_EXTENSIONS
+	for (U32 i = 0; i < NUM_SEGMENTS; i++)
+	{
+		if (mFences[i])
+		{
+			glDeleteSync((GLsync) mFences[i]);
+		}
+	}
+#endif
+
+	if (LLVertexBuffer::sGLRenderBuffer == mGLBuffer && LLVertexBuffer::sVBOActive)
+	{
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		LLVertexBuffer::sVBOActive = FALSE;
+		LLVertexBuffer::sGLRenderBuffer = 0;
+	}
+	glDeleteBuffersARB(1, (GLuint*) &mGLBuffer);
+
+	LLVertexBuffer::sGLCount--;
+	LLVertexBuffer::sAllocatedBytes -= RING_SIZE;
+}
+
+void LLVBORing::bind()
+{
+	// keep LLVertexBuffer's binding cache honest so the next setBuffer() rebinds
+	if (LLVertexBuffer::sGLRenderBuffer != mGLBuffer || !LLVertexBuffer::sVBOActive)
+	{
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, mGLBuffer);
+		LLVertexBuffer::sGLRenderBuffer = mGLBuffer;
+		LLVertexBuffer::sVBOActive = TRUE;
+		LLVertexBuffer::sBindCount++;
+	}
+}
+
+S32 LLVBORing::write(const U8* data, U32 size)
+{
+	if (size == 0 || size > SEGMENT_SIZE)
+	{
+		return -1;
+	}
+
+	bind();
+
+	// A copy never straddles two segments, so the fence placed when leaving a
+	// segment covers every draw that sourced from it
+	if (mOffset + size > (mSegment + 1) * SEGMENT_SIZE)
+	{
+		nextSegment();
+	}
+
+	U32 offset = mOffset;
+	U8* dst = NULL;
+	stop_glerror();
+#if LL_VBO_RING_EXTENSIONS
+	if (gGLManager.mHasMapBufferRange)
+	{
+		// The range is known to be idle (fenced or orphaned), so don't let the
+		// driver synchronize on the rest of the buffer
+		dst = (U8*) glMapBufferRange(GL_ARRAY_BUFFER_ARB, offset, size,
+									 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+#endif
+	if (dst)
+	{
+		memcpy(dst, data, size);
+		glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
+	}
+	else
+	{
+		glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, offset, size, data);
+	}
+	stop_glerror();
+
+	// keep every copy 64 byte aligned
+	mOffset = (offset + size + 63) & ~63;
+	return (S32) offset;
+}
+
+void LLVBORing::nextSegment()
+{
+#if LL_VBO_RING_EXTENSIONS
+	if (gGLManager.mHasSync)
+	{
+		mFences[mSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+#endif
+
+	mSegment = (mSegment + 1) % NUM_SEGMENTS;
+	mOffset = mSegment * SEGMENT_SIZE;
+
+#if LL_VBO_RING_EXTENSIONS
+	if (mFences[mSegment])
+	{
+		// Normally long signalled by now, the ring holds a few frames of UI
+		while (glClientWaitSync((GLsync) mFences[mSegment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+		glDeleteSync((GLsync) mFences[mSegment]);
+		mFences[mSegment] = NULL;
+		return;
+	}
+#endif
+
+	if (mSegment == 0)
+	{
+		// Wrapped without a fence, so there's no way to tell when the GPU is
+		// done with the old contents: orphan them and start over in fresh storage
+		glBufferDataARB(GL_ARRAY_BUFFER_ARB, RING_SIZE, NULL, GL_STREAM_DRAW_ARB);
+	}
+}
+
 //----------------------------------------------------------------------------
 
 LLVertexBuffer::LLVertexBuffer(U32 typemask, S32 usage) :
@@ -66,6 +66,42 @@ protected:
 	}
 };
 
+//============================================================================
+// Streaming ring for vertex data that is drawn once and thrown away
+// (LLRender's immediate mode).  Data is appended to a single VBO; the ring
+// is split into segments and a segment is only written again once the GPU
+// is done with it (fenced with GL_ARB_sync, or the whole buffer is orphaned
+// on wrap when sync objects aren't available).
+
+class LLVBORing
+{
+public:
+	enum
+	{
+		RING_SIZE = 2*1024*1024,
+		NUM_SEGMENTS = 4,
+		SEGMENT_SIZE = RING_SIZE/NUM_SEGMENTS
+	};
+
+	LLVBORing();
+	~LLVBORing();
+
+	// Copy size bytes into the ring and leave it bound to GL_ARRAY_BUFFER_ARB.
+	// Returns the byte offset of the copy, or -1 if it doesn't fit in a segment.
+	S32 write(const U8* data, U32 size);
+
+	U32 getGLBuffer() const					{ return mGLBuffer; }
+
+private:
+	void bind();
+	void nextSegment();
+
+	U32		mGLBuffer;
+	U32		mOffset;
+	U32		mSegment;
+	void*	mFences[NUM_SEGMENTS];	// GLsync of the last draw from each segment
+};
+
 
 //============================================================================
 // base class
@@ -85,6 +121,7 @@ public:
 	static void setupClientArrays(U32 data_mask);
  	static void clientCopy(F64 max_time = 0.005); //copy data from client to GL
 	static void unbind(); //unbind any bound vertex buffer
+	static LLVBORing* getStreamRing(); //NULL if immediate mode should use client arrays
 
 	//get the size of a vertex with the given typemask
 	//if offsets is not NULL, its contents will be filled
@@ -251,6 +288,9 @@ public:
 	static U32 sAllocatedBytes;
 	static U32 sBindCount;
 	static U32 sSetCount;
+
+protected:
+	static LLVBORing* sStreamRing;
 };
 
 
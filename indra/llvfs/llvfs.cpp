@@ -31,25 +31,38 @@
 #include <map>
 #if LL_WINDOWS
 #include <share.h>
+#include <io.h>
+#include <windows.h>
 #elif LL_SOLARIS
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fcntl.h>
 #else
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
     
 #include "llvfs.h"
 
+#include "bitpack.h"
 #include "llstl.h"
 #include "lltimer.h"
     
 const S32 FILE_BLOCK_MASK = 0x000003FF;	 // 1024-byte blocks
 const S32 VFS_CLEANUP_SIZE = 5242880;  // how much space we free up in a single stroke
 const S32 BLOCK_LENGTH_INVALID = -1;	// mLength for invalid LLVFSFileBlocks
+// A 32 bit viewer can't spare the address space for a large cache
+const U32 VFS_MAX_MAPPED_SIZE_32BIT = 256 * 1024 * 1024;
+// How far findFreeBlock() looks through the free blocks of the requested
+// size class before settling for a block from a larger class
+const S32 VFS_MAX_CLASS_SCAN = 8;
 
 LLVFS *gVFS = NULL;
 
+BOOL LLVFS::sUseMemoryMap = TRUE;
+
 // internal class definitions
 class LLVFSBlock
 {
@@ -58,12 +71,21 @@ public:
 	{
 		mLocation = 0;
 		mLength = 0;
+		initFreeList();
 	}
     
 	LLVFSBlock(U32 loc, S32 size)
 	{
 		mLocation = loc;
 		mLength = size;
+		initFreeList();
+	}
+
+	void initFreeList()
+	{
+		mFreeNext = NULL;
+		mFreePrev = NULL;
+		mFreeClass = -1;
 	}
     
 	static bool locationSortPredicate(
@@ -76,6 +98,11 @@ public:
 public:
 	U32 mLocation;
 	S32	mLength;		// allocated block size
+
+	// LLVFSFreeList links, mLength must not change while listed
+	LLVFSBlock *mFreeNext;
+	LLVFSBlock *mFreePrev;
+	S32 mFreeClass;
 };
     
 LLVFSFileSpecifier::LLVFSFileSpecifier()
@@ -199,14 +226,6 @@ public:
 		swizzleCopy(&mSize, buffer, 4);
 	}
     
-	static BOOL insertLRU(LLVFSFileBlock* const& first,
-						  LLVFSFileBlock* const& second)
-	{
-		return (first->mAccessTime == second->mAccessTime)
-			? *first < *second
-			: first->mAccessTime < second->mAccessTime;
-	}
-    
 public:
 	S32  mSize;
 	S32  mIndexLocation; // location of index entry
@@ -216,25 +235,169 @@ public:
 	static const S32 SERIAL_SIZE;
 };
 
-// Helper structure for doing lru w/ stl... is there a simpler way?
-struct LLVFSFileBlock_less
+const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
+
+//============================================================================
+// LLVFSFreeList
+//============================================================================
+
+LLVFSFreeList::LLVFSFreeList()
+{
+	clear();
+}
+
+void LLVFSFreeList::clear()
+{
+	memset(mHeads, 0, sizeof(mHeads));
+	memset(mCounts, 0, sizeof(mCounts));
+	memset(mBits, 0, sizeof(mBits));
+	mSize = 0;
+}
+
+// static
+S32 LLVFSFreeList::getSizeClass(S32 length)
+{
+	U32 value = (U32)llmax(length, 1);
+	S32 top = ll_highest_bit(value);
+	if (top < SUB_CLASS_BITS)
+	{
+		return (S32)value;
+	}
+	return ((top - SUB_CLASS_BITS + 1) << SUB_CLASS_BITS) + ((value >> (top - SUB_CLASS_BITS)) & (SUB_CLASS_COUNT - 1));
+}
+
+// static
+S32 LLVFSFreeList::getClassMinLength(S32 size_class)
 {
-	bool operator()(LLVFSFileBlock* const& lhs, LLVFSFileBlock* const& rhs) const
+	if (size_class < SUB_CLASS_COUNT)
 	{
-		return (LLVFSFileBlock::insertLRU(lhs, rhs)) ? true : false;
+		return size_class;
 	}
-};
+	S32 top = (size_class >> SUB_CLASS_BITS) + SUB_CLASS_BITS - 1;
+	return (1 << top) + ((size_class & (SUB_CLASS_COUNT - 1)) << (top - SUB_CLASS_BITS));
+}
 
+void LLVFSFreeList::insert(LLVFSBlock *block)
+{
+	llassert(block->mFreeClass < 0);
+	S32 size_class = getSizeClass(block->mLength);
+	block->mFreeClass = size_class;
+	block->mFreePrev = NULL;
+	block->mFreeNext = mHeads[size_class];
+	if (block->mFreeNext)
+	{
+		block->mFreeNext->mFreePrev = block;
+	}
+	mHeads[size_class] = block;
+	mBits[size_class >> 5] |= 1U << (size_class & 31);
+	mCounts[size_class]++;
+	mSize++;
+}
 
-const S32 LLVFSFileBlock::SERIAL_SIZE = 34;
+void LLVFSFreeList::erase(LLVFSBlock *block)
+{
+	S32 size_class = block->mFreeClass;
+	if (size_class < 0)
+	{
+		llerrs << "eraseBlock could not find block" << llendl;
+		return;
+	}
+	if (block->mFreePrev)
+	{
+		block->mFreePrev->mFreeNext = block->mFreeNext;
+	}
+	else
+	{
+		mHeads[size_class] = block->mFreeNext;
+	}
+	if (block->mFreeNext)
+	{
+		block->mFreeNext->mFreePrev = block->mFreePrev;
+	}
+	if (!mHeads[size_class])
+	{
+		mBits[size_class >> 5] &= ~(1U << (size_class & 31));
+	}
+	block->initFreeList();
+	mCounts[size_class]--;
+	mSize--;
+}
+
+S32 LLVFSFreeList::findClass(S32 size_class) const
+{
+	for (S32 word = size_class >> 5; word < CLASS_WORDS; ++word)
+	{
+		U32 bits = mBits[word];
+		if (word == (size_class >> 5))
+		{
+			bits &= ~0U << (size_class & 31);
+		}
+		if (bits)
+		{
+			return (word << 5) + ll_lowest_bit(bits);
+		}
+	}
+	return -1;
+}
+
+LLVFSBlock *LLVFSFreeList::find(S32 length) const
+{
+	// Blocks in the requested class may still be a little short, look at a few
+	S32 size_class = getSizeClass(length);
+	LLVFSBlock *block = mHeads[size_class];
+	for (S32 i = 0; block && i < VFS_MAX_CLASS_SCAN; ++i, block = block->mFreeNext)
+	{
+		if (block->mLength >= length)
+		{
+			return block;
+		}
+	}
+
+	// Any block in a larger class is long enough
+	S32 larger_class = size_class + 1 < CLASS_COUNT ? findClass(size_class + 1) : -1;
+	if (larger_class >= 0)
+	{
+		return mHeads[larger_class];
+	}
+
+	// Last resort, the rest of the requested class
+	for ( ; block; block = block->mFreeNext)
+	{
+		if (block->mLength >= length)
+		{
+			return block;
+		}
+	}
+	return NULL;
+}
+
+//============================================================================
+// LLVFS
+//============================================================================
      
 
 LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename, const BOOL read_only, const U32 presize, const BOOL remove_after_crash)
 :	mRemoveAfterCrash(remove_after_crash),
+	mActiveReads(0),
 	mDataFP(NULL),
-	mIndexFP(NULL)
+	mIndexFP(NULL),
+	mDataFPPos(-1),
+	mDataDirty(FALSE),
+	mDataMap(NULL),
+	mDataMapSize(0),
+	mDataMapHandle(NULL),
+	mReadHits(0),
+	mReadMisses(0),
+	mMappedReads(0),
+	mAllocations(0),
+	mEvictions(0)
 {
 	mDataMutex = new LLMutex(0);
+	mReadCondition = new LLCondition(0);
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	{
+		mShardMutex[shard] = new LLMutex(0);
+	}
 
 	S32 i;
 	for (i = 0; i < VFSLOCK_COUNT; i++)
@@ -317,6 +480,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	// determine the real file size
 	fseek(mDataFP, 0, SEEK_END);
 	U32 data_size = ftell(mDataFP);
+	mDataFPPos = -1;
 
 	// read the index file
 	// make sure there's at least one file in it too
@@ -350,7 +514,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 				block->mFileType >= LLAssetType::AT_NONE &&
 				block->mFileType < LLAssetType::AT_COUNT)
 			{
-				mFileBlocks.insert(fileblock_map::value_type(*block, block));
+				mFileBlocks[getShard(*block)].insert(fileblock_map::value_type(*block, block));
 				files_by_loc.push_back(block);
 			}
 			else
@@ -436,7 +600,7 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 						<< LL_ENDL;
 
 					// Duplicate entries.  Nuke them both for safety.
-					mFileBlocks.erase(*cur_file_block);	// remove ID/type entry
+					mFileBlocks[getShard(*cur_file_block)].erase(*cur_file_block);	// remove ID/type entry
 					if (cur_file_block->mLength > 0)
 					{
 						// convert to hole
@@ -555,6 +719,8 @@ LLVFS::LLVFS(const std::string& index_filename, const std::string& data_filename
 	LL_INFOS("VFS") << "Using VFS index file " << mIndexFilename << LL_ENDL;
 	LL_INFOS("VFS") << "Using VFS data file " << mDataFilename << LL_ENDL;
 
+	mapDataFile();
+
 	mValid = VFSVALID_OK;
 }
     
@@ -568,17 +734,21 @@ LLVFS::~LLVFS()
 	unlockAndClose(mIndexFP);
 	mIndexFP = NULL;
 
-	fileblock_map::const_iterator it;
-	for (it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
 	{
-		delete (*it).second;
+		fileblock_map::const_iterator it;
+		for (it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
+		{
+			delete (*it).second;
+		}
+		mFileBlocks[shard].clear();
 	}
-	mFileBlocks.clear();
 	
-	mFreeBlocksByLength.clear();
+	mFreeBlocksBySize.clear();
 
 	for_each(mFreeBlocksByLocation.begin(), mFreeBlocksByLocation.end(), DeletePairedPointer());
     
+	unmapDataFile();
 	unlockAndClose(mDataFP);
 	mDataFP = NULL;
     
@@ -590,6 +760,11 @@ LLVFS::~LLVFS()
 	}
 
 	delete mDataMutex;
+	delete mReadCondition;
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	{
+		delete mShardMutex[shard];
+	}
 }
 
 
@@ -669,19 +844,18 @@ BOOL LLVFS::getExists(const LLUUID &file_id, const LLAssetType::EType file_type)
 		llerrs << "Attempting to use invalid VFS!" << llendl;
 	}
 
-	lockData();
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	lockShard(spec);
+	
+	block = findFileBlock(spec);
+	if (block)
 	{
-		block = (*it).second;
 		block->mAccessTime = (U32)time(NULL);
 	}
 
 	BOOL res = (block && block->mLength > 0) ? TRUE : FALSE;
 	
-	unlockData();
+	unlockShard(spec);
 	
 	return res;
 }
@@ -696,19 +870,17 @@ S32	 LLVFS::getSize(const LLUUID &file_id, const LLAssetType::EType file_type)
 
 	}
 
-	lockData();
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	lockShard(spec);
+	
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
-
 		block->mAccessTime = (U32)time(NULL);
 		size = block->mSize;
 	}
 
-	unlockData();
+	unlockShard(spec);
 	
 	return size;
 }
@@ -722,19 +894,17 @@ S32  LLVFS::getMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 		llerrs << "Attempting to use invalid VFS!" << llendl;
 	}
 
-	lockData();
-	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	lockShard(spec);
+	
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
-
 		block->mAccessTime = (U32)time(NULL);
 		size = block->mLength;
 	}
 
-	unlockData();
+	unlockShard(spec);
 
 	return size;
 }
@@ -743,8 +913,7 @@ BOOL LLVFS::checkAvailable(S32 max_size)
 {
 	lockData();
 	
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(max_size); // first entry >= size
-	const BOOL res(iter == mFreeBlocksByLength.end() ? FALSE : TRUE);
+	const BOOL res(mFreeBlocksBySize.find(max_size) ? TRUE : FALSE);
 
 	unlockData();
 	
@@ -770,12 +939,8 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 	lockData();
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	LLVFSFileBlock *block = NULL;
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		block = (*it).second;
-	}
+	lockShard(spec);
+	LLVFSFileBlock *block = findFileBlock(spec);
     
 	// round all sizes upward to KB increments
 	// SJB: Need to not round for the new texture-pipeline code so we know the correct
@@ -795,6 +960,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
     
 		if (max_size == block->mLength)
 		{
+			unlockShard(spec);
 			unlockData();
 			return TRUE;
 		}
@@ -817,6 +983,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			sync(block);
 			//mergeFreeBlocks();
 
+			unlockShard(spec);
 			unlockData();
 			return TRUE;
 		}
@@ -844,13 +1011,18 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					block->mLength += size_increase;
 					sync(block);
 
+					unlockShard(spec);
 					unlockData();
 					return TRUE;
 				}
 			}
 			
 			// no adjecent free block, find one in the list
+			// findFreeBlock() locks shards to evict files. block stays valid,
+			// only mDataMutex holders remove file blocks.
+			unlockShard(spec);
 			free_block = findFreeBlock(max_size, block);
+			lockShard(spec);
     
 			if (free_block)
 			{
@@ -871,6 +1043,8 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 					if (block->mSize > 0)
 					{
 						// move the file into the new block
+						waitForReads();
+						mDataFPPos = -1;
 						std::vector<U8> buffer(block->mSize);
 						fseek(mDataFP, block->mLocation, SEEK_SET);
 						if (fread(&buffer[0], block->mSize, 1, mDataFP) == 1)
@@ -880,6 +1054,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 							{
 								llwarns << "Short write" << llendl;
 							}
+							mDataDirty = TRUE;
 						} else {
 							llwarns << "Short read" << llendl;
 						}
@@ -893,6 +1068,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 
 				sync(block);
 
+				unlockShard(spec);
 				unlockData();
 				return TRUE;
 			}
@@ -900,6 +1076,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			{
 				llwarns << "VFS: No space (" << max_size << ") to resize existing vfile " << file_id << llendl;
 				//dumpMap();
+				unlockShard(spec);
 				unlockData();
 				dumpStatistics();
 				return FALSE;
@@ -909,10 +1086,14 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 	else
 	{
 		// find a free block in the list
+		unlockShard(spec);
 		LLVFSBlock *free_block = findFreeBlock(max_size);
+		lockShard(spec);
     
 		if (free_block)
 		{        
+			// incLock() may have added a dummy block in the meantime
+			block = findFileBlock(spec);
 			if (block)
 			{
 				block->mLocation = free_block->mLocation;
@@ -922,7 +1103,7 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 			{
 				// this file doesn't exist, create it
 				block = new LLVFSFileBlock(file_id, file_type, free_block->mLocation, max_size);
-				mFileBlocks.insert(fileblock_map::value_type(spec, block));
+				mFileBlocks[getShard(spec)].insert(fileblock_map::value_type(spec, block));
 			}
 
 			// Must call useFreeSpace before sync(), as sync()
@@ -936,11 +1117,13 @@ BOOL LLVFS::setMaxSize(const LLUUID &file_id, const LLAssetType::EType file_type
 		{
 			llwarns << "VFS: No space (" << max_size << ") for new virtual file " << file_id << llendl;
 			//dumpMap();
+			unlockShard(spec);
 			unlockData();
 			dumpStatistics();
 			return FALSE;
 		}
 	}
+	unlockShard(spec);
 	unlockData();
 	return TRUE;
 }
@@ -964,24 +1147,33 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 	
 	LLVFSFileSpecifier new_spec(new_id, new_type);
 	LLVFSFileSpecifier old_spec(file_id, file_type);
+	S32 old_shard = getShard(old_spec);
+	S32 new_shard = getShard(new_spec);
+
+	// Only mDataMutex holders take two shards, so the order doesn't matter
+	mShardMutex[old_shard]->lock();
+	if (new_shard != old_shard)
+	{
+		mShardMutex[new_shard]->lock();
+	}
 	
-	fileblock_map::iterator it = mFileBlocks.find(old_spec);
-	if (it != mFileBlocks.end())
+	fileblock_map::iterator it = mFileBlocks[old_shard].find(old_spec);
+	if (it != mFileBlocks[old_shard].end())
 	{
 		LLVFSFileBlock *src_block = (*it).second;
 
 		// this will purge the data but leave the file block in place, w/ locks, if any
 		// WAS: removeFile(new_id, new_type); NOW uses removeFileBlock() to avoid mutex lock recursion
-		fileblock_map::iterator new_it = mFileBlocks.find(new_spec);
-		if (new_it != mFileBlocks.end())
+		fileblock_map::iterator new_it = mFileBlocks[new_shard].find(new_spec);
+		if (new_it != mFileBlocks[new_shard].end())
 		{
 			LLVFSFileBlock *new_block = (*new_it).second;
 			removeFileBlock(new_block);
 		}
 		
 		// if there's something in the target location, remove it but inherit its locks
-		it = mFileBlocks.find(new_spec);
-		if (it != mFileBlocks.end())
+		it = mFileBlocks[new_shard].find(new_spec);
+		if (it != mFileBlocks[new_shard].end())
 		{
 			LLVFSFileBlock *dest_block = (*it).second;
 
@@ -994,7 +1186,7 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 				dest_block->mLocks[i] = src_block->mLocks[i];
 			}
 			
-			mFileBlocks.erase(new_spec);
+			mFileBlocks[new_shard].erase(new_spec);
 			delete dest_block;
 		}
 
@@ -1002,8 +1194,8 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 		src_block->mFileType = new_type;
 		src_block->mAccessTime = (U32)time(NULL);
    
-		mFileBlocks.erase(old_spec);
-		mFileBlocks.insert(fileblock_map::value_type(new_spec, src_block));
+		mFileBlocks[old_shard].erase(old_spec);
+		mFileBlocks[new_shard].insert(fileblock_map::value_type(new_spec, src_block));
 
 		sync(src_block);
 	}
@@ -1011,10 +1203,16 @@ void LLVFS::renameFile(const LLUUID &file_id, const LLAssetType::EType file_type
 	{
 		llwarns << "VFS: Attempt to rename nonexistent vfile " << file_id << ":" << file_type << llendl;
 	}
+
+	if (new_shard != old_shard)
+	{
+		mShardMutex[new_shard]->unlock();
+	}
+	mShardMutex[old_shard]->unlock();
 	unlockData();
 }
 
-// mDataMutex must be LOCKED before calling this
+// mDataMutex and the block's shard must be LOCKED before calling this
 void LLVFS::removeFileBlock(LLVFSFileBlock *fileblock)
 {
 	// convert this into an unsaved, dummy fileblock to preserve locks
@@ -1051,10 +1249,10 @@ void LLVFS::removeFile(const LLUUID &file_id, const LLAssetType::EType file_type
     lockData();
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	lockShard(spec);
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
 		removeFileBlock(block);
 	}
 	else
@@ -1062,14 +1260,13 @@ void LLVFS::removeFile(const LLUUID &file_id, const LLAssetType::EType file_type
 		llwarns << "VFS: attempting to remove nonexistent file " << file_id << " type " << file_type << llendl;
 	}
 
+	unlockShard(spec);
 	unlockData();
 }
     
     
 S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8 *buffer, S32 location, S32 length)
 {
-	S32 bytesread = 0;
-	
 	if (!isValid())
 	{
 		llerrs << "Attempting to use invalid VFS!" << llendl;
@@ -1077,42 +1274,318 @@ S32 LLVFS::getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8
 	llassert(location >= 0);
 	llassert(length >= 0);
 
-	BOOL do_read = FALSE;
-	
-    lockData();
-	
-	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	S32 data_location = 0;
+	const U8 *mapped = NULL;
+	S32 bytesread = pinData(LLVFSFileSpecifier(file_id, file_type), location, length, data_location, mapped);
+	if (bytesread > 0)
 	{
-		LLVFSFileBlock *block = (*it).second;
+		if (mapped)
+		{
+			memcpy(buffer, mapped, bytesread);		/* Flawfinder: ignore */
+		}
+		else
+		{
+			bytesread = readDataAt(buffer, data_location, bytesread);
+		}
+		unpinData();
+	}
+
+	return bytesread;
+}
+
+const U8 *LLVFS::getDataView(const LLUUID &file_id, const LLAssetType::EType file_type, S32 location, S32 &length)
+{
+	if (!isValid())
+	{
+		llerrs << "Attempting to use invalid VFS!" << llendl;
+	}
+	llassert(location >= 0);
+	llassert(length >= 0);
+
+	S32 data_location = 0;
+	const U8 *mapped = NULL;
+	length = pinData(LLVFSFileSpecifier(file_id, file_type), location, length, data_location, mapped);
+	if (length > 0 && !mapped)
+	{
+		// Not in the mapping, caller has to copy with getData()
+		unpinData();
+	}
+	if (!mapped)
+	{
+		length = 0;
+	}
+	return mapped;
+}
+
+void LLVFS::releaseDataView()
+{
+	unpinData();
+}
+
+LLVFSDataView::LLVFSDataView(LLVFS *vfs, const LLUUID &file_id, const LLAssetType::EType file_type, S32 location, S32 length)
+	: mVFS(vfs),
+	  mData(NULL),
+	  mLength(length)
+{
+	mData = mVFS->getDataView(file_id, file_type, location, mLength);
+}
+
+void LLVFSDataView::release()
+{
+	if (mData)
+	{
+		mVFS->releaseDataView();
+		mData = NULL;
+		mLength = 0;
+	}
+}
+
+// protected
+// Looks up a file and pins the requested range against writes. Returns the
+// number of bytes pinned, 0 if nothing was (and unpinData() must not be
+// called). The data is at data_location in the data file, and at mapped if
+// that range of the file is mapped.
+S32 LLVFS::pinData(const LLVFSFileSpecifier &spec, S32 location, S32 length, S32 &data_location, const U8* &mapped)
+{
+	mapped = NULL;
 
+	// Writers wait for the pins to drop and then write under mDataMutex, so
+	// pinning under it too means a read never starts on top of unflushed
+	// stdio writes, or reads the mapping while a write is in progress.
+	lockData();
+	if (mDataDirty)
+	{
+		// Make buffered writes visible to the file reads
+		flushData();
+	}
+
+	S32 pinned = 0;
+	lockShard(spec);
+	
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
+	{
 		block->mAccessTime = (U32)time(NULL);
     
 		if (location > block->mSize)
 		{
-			llwarns << "VFS: Attempt to read location " << location << " in file " << file_id << " of length " << block->mSize << llendl;
+			llwarns << "VFS: Attempt to read location " << location << " in file " << spec.mFileID << " of length " << block->mSize << llendl;
 		}
 		else
 		{
-			if (length > block->mSize - location)
-			{
-				length = block->mSize - location;
-			}
-			location += block->mLocation;
-			do_read = TRUE;
+			pinned = llmin(length, block->mSize - location);
+			data_location = location + block->mLocation;
 		}
+		mReadHits++;
+	}
+	else
+	{
+		mReadMisses++;
 	}
 
-	if (do_read)
+	if (pinned > 0)
 	{
-		fseek(mDataFP, location, SEEK_SET);
-		bytesread = (S32)fread(buffer, 1, length, mDataFP);
+		// The block can't be removed until the shard is unlocked, and then
+		// anything that could overwrite it waits for mActiveReads to drop
+		mReadCondition->lock();
+		mActiveReads++;
+		if (mDataMap && (U32)(data_location + pinned) <= mDataMapSize)
+		{
+			mapped = mDataMap + data_location;
+			mMappedReads++;
+		}
+		mReadCondition->unlock();
 	}
-	
+
+	unlockShard(spec);
 	unlockData();
 
+	return pinned;
+}
+
+// protected
+void LLVFS::unpinData()
+{
+	mReadCondition->lock();
+	if (--mActiveReads == 0)
+	{
+		mReadCondition->broadcast();
+	}
+	mReadCondition->unlock();
+}
+
+// protected
+// Positional read from the data file. Doesn't touch the stdio stream or
+// its position, so it is safe to call without mDataMutex.
+S32 LLVFS::readDataAt(U8 *buffer, S32 location, S32 length)
+{
+#if LL_WINDOWS
+	// Reads on a synchronous handle are serialized by Windows, but they no
+	// longer wait on mDataMutex. ReadFile() moves the file pointer, so the
+	// next stdio write has to seek.
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(mDataFP));
+	OVERLAPPED overlapped;
+	memset(&overlapped, 0, sizeof(overlapped));
+	overlapped.Offset = (DWORD)location;
+	DWORD bytesread = 0;
+	BOOL res = ReadFile(handle, buffer, (DWORD)length, &bytesread, &overlapped);
+	mDataFPPos = -1;
+	return res ? (S32)bytesread : 0;
+#else
+	S32 bytesread = 0;
+	while (bytesread < length)
+	{
+		ssize_t res = pread(fileno(mDataFP), buffer + bytesread, length - bytesread, (off_t)location + bytesread);
+		if (res < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (res <= 0)
+		{
+			break;
+		}
+		bytesread += (S32)res;
+	}
 	return bytesread;
+#endif
+}
+
+// protected
+// mDataMutex must be locked
+void LLVFS::waitForReads()
+{
+	mReadCondition->lock();
+	while (mActiveReads > 0)
+	{
+		mReadCondition->wait();
+	}
+	mReadCondition->unlock();
+}
+
+// protected
+// mDataMutex must be locked
+void LLVFS::flushData()
+{
+	waitForReads();
+	fflush(mDataFP);
+	mDataDirty = FALSE;
+	// Pick up writes that grew the file
+	mapDataFile();
+}
+
+// protected
+// Maps the whole data file for reading, replacing any previous mapping.
+// mDataMutex must be locked, or the VFS not shared yet.
+void LLVFS::mapDataFile()
+{
+	if (!sUseMemoryMap || !mDataFP)
+	{
+		return;
+	}
+
+#if LL_WINDOWS
+	struct _stat file_stat;
+	if (_fstat(_fileno(mDataFP), &file_stat) != 0 || file_stat.st_size <= 0)
+#else
+	struct stat file_stat;
+	if (fstat(fileno(mDataFP), &file_stat) != 0 || file_stat.st_size <= 0)
+#endif
+	{
+		return;
+	}
+	U32 size = (U32)file_stat.st_size;
+	if (size == mDataMapSize)
+	{
+		return;
+	}
+	if (sizeof(void*) < 8 && size > VFS_MAX_MAPPED_SIZE_32BIT)
+	{
+		return;
+	}
+
+	// No reader can be using the old mapping while we hold mReadCondition
+	// with mActiveReads at 0
+	mReadCondition->lock();
+	while (mActiveReads > 0)
+	{
+		mReadCondition->wait();
+	}
+	unmapDataFile();
+#if LL_WINDOWS
+	HANDLE file_handle = (HANDLE)_get_osfhandle(_fileno(mDataFP));
+	HANDLE map_handle = CreateFileMapping(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map_handle)
+	{
+		void *map = MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+		if (map)
+		{
+			mDataMap = (U8*)map;
+			mDataMapSize = size;
+			mDataMapHandle = map_handle;
+		}
+		else
+		{
+			CloseHandle(map_handle);
+		}
+	}
+#else
+	void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(mDataFP), 0);
+	if (map != MAP_FAILED)
+	{
+		mDataMap = (U8*)map;
+		mDataMapSize = size;
+	}
+#endif
+	if (!mDataMap)
+	{
+		LL_WARNS("VFS") << "Could not map VFS data file " << mDataFilename << ", using file reads" << LL_ENDL;
+	}
+	mReadCondition->unlock();
+}
+
+// protected
+// No reads may be in progress
+void LLVFS::unmapDataFile()
+{
+	if (!mDataMap)
+	{
+		return;
+	}
+#if LL_WINDOWS
+	UnmapViewOfFile(mDataMap);
+	CloseHandle((HANDLE)mDataMapHandle);
+	mDataMapHandle = NULL;
+#else
+	munmap(mDataMap, mDataMapSize);
+#endif
+	mDataMap = NULL;
+	mDataMapSize = 0;
+}
+
+// protected
+void LLVFS::lockAllShards()
+{
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	{
+		mShardMutex[shard]->lock();
+	}
+}
+
+// protected
+void LLVFS::unlockAllShards()
+{
+	for (S32 shard = FILE_SHARD_COUNT - 1; shard >= 0; shard--)
+	{
+		mShardMutex[shard]->unlock();
+	}
+}
+
+// protected
+LLVFSFileBlock *LLVFS::findFileBlock(const LLVFSFileSpecifier &spec)
+{
+	fileblock_map &file_blocks = mFileBlocks[getShard(spec)];
+	fileblock_map::iterator it = file_blocks.find(spec);
+	return it != file_blocks.end() ? it->second : NULL;
 }
     
 S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type, const U8 *buffer, S32 location, S32 length)
@@ -1131,11 +1604,10 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
     lockData();
     
 	LLVFSFileSpecifier spec(file_id, file_type);
-	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	lockShard(spec);
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
-
 		S32 in_loc = location;
 		if (location == -1)
 		{
@@ -1153,6 +1625,7 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 					<< " location: " << in_loc
 					<< " bytes: " << length
 					<< llendl;
+			unlockShard(spec);
 			unlockData();
 			return length;
 		}
@@ -1164,6 +1637,7 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 					<< " of size " << block->mSize
 					<< " block length " << block->mLength
 					<< llendl;
+			unlockShard(spec);
 			unlockData();
 			return length;
 		}
@@ -1176,19 +1650,32 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 			}
 			U32 file_location = location + block->mLocation;
 			
-			fseek(mDataFP, file_location, SEEK_SET);
+			waitForReads();
+			// Sequential writes (appends, chunked stores) skip the seek, which
+			// would flush the stdio buffer, and get batched into fewer writes.
+			// Buffered data is flushed before the next read.
+			if (mDataFPPos != (S32)file_location)
+			{
+				fseek(mDataFP, file_location, SEEK_SET);
+			}
 			S32 write_len = (S32)fwrite(buffer, 1, length, mDataFP);
 			if (write_len != length)
 			{
 				llwarns << llformat("VFS Write Error: %d != %d",write_len,length) << llendl;
+				mDataFPPos = -1;
+			}
+			else
+			{
+				mDataFPPos = file_location + write_len;
 			}
-			// fflush(mDataFP);
+			mDataDirty = TRUE;
 			
 			if (location + length > block->mSize)
 			{
 				block->mSize = location + write_len;
 				sync(block);
 			}
+			unlockShard(spec);
 			unlockData();
 			
 			return write_len;
@@ -1196,6 +1683,7 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
 	}
 	else
 	{
+		unlockShard(spec);
 		unlockData();
 		return 0;
 	}
@@ -1203,40 +1691,32 @@ S32 LLVFS::storeData(const LLUUID &file_id, const LLAssetType::EType file_type,
  
 void LLVFS::incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
 {
-	lockData();
-
 	LLVFSFileSpecifier spec(file_id, file_type);
-	LLVFSFileBlock *block;
-	
- 	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		block = (*it).second;
-	}
-	else
+	lockShard(spec);
+
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (!block)
 	{
 		// Create a dummy block which isn't saved
 		block = new LLVFSFileBlock(file_id, file_type, 0, BLOCK_LENGTH_INVALID);
     	block->mAccessTime = (U32)time(NULL);
-		mFileBlocks.insert(fileblock_map::value_type(spec, block));
+		mFileBlocks[getShard(spec)].insert(fileblock_map::value_type(spec, block));
 	}
 
 	block->mLocks[lock]++;
 	mLockCounts[lock]++;
 	
-	unlockData();
+	unlockShard(spec);
 }
 
 void LLVFS::decLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
 {
-	lockData();
-
 	LLVFSFileSpecifier spec(file_id, file_type);
- 	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
-	{
-		LLVFSFileBlock *block = (*it).second;
+	lockShard(spec);
 
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
+	{
 		if (block->mLocks[lock] > 0)
 		{
 			block->mLocks[lock]--;
@@ -1248,24 +1728,23 @@ void LLVFS::decLock(const LLUUID &file_id, const LLAssetType::EType file_type, E
 		mLockCounts[lock]--;
 	}
 
-	unlockData();
+	unlockShard(spec);
 }
 
 BOOL LLVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock)
 {
-	lockData();
-	
 	BOOL res = FALSE;
 	
 	LLVFSFileSpecifier spec(file_id, file_type);
- 	fileblock_map::iterator it = mFileBlocks.find(spec);
-	if (it != mFileBlocks.end())
+	lockShard(spec);
+
+	LLVFSFileBlock *block = findFileBlock(spec);
+	if (block)
 	{
-		LLVFSFileBlock *block = (*it).second;
 		res = (block->mLocks[lock] > 0);
 	}
 
-	unlockData();
+	unlockShard(spec);
 
 	return res;
 }
@@ -1276,27 +1755,8 @@ BOOL LLVFS::isLocked(const LLUUID &file_id, const LLAssetType::EType file_type,
 
 void LLVFS::eraseBlockLength(LLVFSBlock *block)
 {
-	// find the corresponding map entry in the length map and erase it
-	S32 length = block->mLength;
-	blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(length);
-	blocks_length_map_t::iterator end = mFreeBlocksByLength.end();
-	bool found_block = false;
-	while(iter != end)
-	{
-		LLVFSBlock *tblock = iter->second;
-		llassert(tblock->mLength == length); // there had -better- be an entry with our length!
-		if (tblock == block)
-		{
-			mFreeBlocksByLength.erase(iter);
-			found_block = true;
-			break;
-		}
-		++iter;
-	}
-	if(!found_block)
-	{
-		llerrs << "eraseBlock could not find block" << llendl;
-	}
+	// unlink it from its size class
+	mFreeBlocksBySize.erase(block);
 }
 
 
@@ -1353,7 +1813,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		eraseBlockLength(prev_block);
 		eraseBlock(next_block);
 		prev_block->mLength += block->mLength + next_block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block));
+		mFreeBlocksBySize.insert(prev_block);
 		delete block;
 		block = NULL;
 		delete next_block;
@@ -1366,7 +1826,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		// therefore only need to update the length map. JC
 		eraseBlockLength(prev_block);
 		prev_block->mLength += block->mLength;
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(prev_block->mLength, prev_block)); // multimap insert
+		mFreeBlocksBySize.insert(prev_block);
 		delete block;
 		block = NULL;
 	}
@@ -1380,7 +1840,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		next_block->mLength += block->mLength;
 		// Don't hint here, next_free_it iterator may be invalid.
 		mFreeBlocksByLocation.insert(blocks_location_map_t::value_type(next_block->mLocation, next_block)); // multimap insert
-		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(next_block->mLength, next_block)); // multimap insert			
+		mFreeBlocksBySize.insert(next_block);
 		delete block;
 		block = NULL;
 	}
@@ -1389,7 +1849,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 		// Can't merge with other free blocks.
 		// Hint that insert should go near next_free_it.
  		mFreeBlocksByLocation.insert(next_free_it, blocks_location_map_t::value_type(block->mLocation, block)); // multimap insert
- 		mFreeBlocksByLength.insert(blocks_length_map_t::value_type(block->mLength, block)); // multimap insert
+ 		mFreeBlocksBySize.insert(block);
 	}
 }
 
@@ -1418,7 +1878,7 @@ void LLVFS::addFreeBlock(LLVFSBlock *block)
 // 			// merge first_block with second_block, since they're adjacent
 // 			first_block->mLength += second_block->mLength;
 // 			// add the first block to the length map (with the new size)
-// 			mFreeBlocksByLength.insert(blocks_length_map_t::value_type(first_block->mLength, first_block)); // multimap insert
+// 			mFreeBlocksBySize.insert(first_block);
 //
 // 			// erase and delete the second block
 // 			eraseBlock(second_block);
@@ -1533,7 +1993,7 @@ void LLVFS::sync(LLVFSFileBlock *block, BOOL remove)
 	return;
 }
 
-// mDataMutex must be LOCKED before calling this
+// mDataMutex must be LOCKED before calling this, and no shard.
 // Can initiate LRU-based file removal to make space.
 // The immune file block will not be removed.
 LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
@@ -1546,17 +2006,18 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	LLVFSBlock *block = NULL;
 	BOOL have_lru_list = FALSE;
 	
-	typedef std::set<LLVFSFileBlock*, LLVFSFileBlock_less> lru_set;
-	lru_set lru_list;
+	// Sorted by access time when the list was built. Blocks can't go away
+	// while we hold mDataMutex, but their locks can change.
+	typedef std::multimap<U32, LLVFSFileBlock*> lru_map;
+	lru_map lru_list;
     
 	LLTimer timer;
 
+	mAllocations++;
 	while (! block)
 	{
 		// look for a suitable free block
-		blocks_length_map_t::iterator iter = mFreeBlocksByLength.lower_bound(size); // first entry >= size
-		if (iter != mFreeBlocksByLength.end())
-			block = iter->second;
+		block = mFreeBlocksBySize.find(size);
     	
 		// no large enough free blocks, time to clean out some junk
 		if (! block)
@@ -1565,17 +2026,21 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 			// this is far faster than sorting a linked list
 			if (! have_lru_list)
 			{
-				for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+				for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
 				{
-					LLVFSFileBlock *tmp = (*it).second;
-
-					if (tmp != immune &&
-						tmp->mLength > 0 &&
-						! tmp->mLocks[VFSLOCK_READ] &&
-						! tmp->mLocks[VFSLOCK_APPEND] &&
-						! tmp->mLocks[VFSLOCK_OPEN])
+					LLMutexLock lock(mShardMutex[shard]);
+					for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
 					{
-						lru_list.insert(tmp);
+						LLVFSFileBlock *tmp = (*it).second;
+
+						if (tmp != immune &&
+							tmp->mLength > 0 &&
+							! tmp->mLocks[VFSLOCK_READ] &&
+							! tmp->mLocks[VFSLOCK_APPEND] &&
+							! tmp->mLocks[VFSLOCK_OPEN])
+						{
+							lru_list.insert(lru_map::value_type(tmp->mAccessTime, tmp));
+						}
 					}
 				}
 				
@@ -1590,15 +2055,17 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 			}
 
 			// is the oldest file big enough?  (Should be about half the time)
-			lru_set::iterator it = lru_list.begin();
-			LLVFSFileBlock *file_block = *it;
+			lru_map::iterator it = lru_list.begin();
+			LLVFSFileBlock *file_block = it->second;
 			if (file_block->mLength >= size && file_block != immune)
 			{
 				// ditch this file and look again for a free block - should find it
 				// TODO: it'll be faster just to assign the free block and break
-				llinfos << "LRU: Removing " << file_block->mFileID << ":" << file_block->mFileType << llendl;
 				lru_list.erase(it);
-				removeFileBlock(file_block);
+				if (evictFileBlock(file_block))
+				{
+					llinfos << "LRU: Removing " << file_block->mFileID << ":" << file_block->mFileType << llendl;
+				}
 				file_block = NULL;
 				continue;
 			}
@@ -1616,14 +2083,17 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 				 it != lru_list.end() && cleaned_up < cleanup_target;
 				 )
 			{
-				file_block = *it;
+				file_block = it->second;
 				
 				// TODO: it would be great to be able to batch all these sync() calls
 				// llinfos << "LRU2: Removing " << file_block->mFileID << ":" << file_block->mFileType << " last accessed" << file_block->mAccessTime << llendl;
 
-				cleaned_up += file_block->mLength;
+				S32 length = file_block->mLength;
 				lru_list.erase(it++);
-				removeFileBlock(file_block);
+				if (evictFileBlock(file_block))
+				{
+					cleaned_up += length;
+				}
 				file_block = NULL;
 			}
 			//mergeFreeBlocks();
@@ -1639,6 +2109,25 @@ LLVFSBlock *LLVFS::findFreeBlock(S32 size, LLVFSFileBlock *immune)
 	return block;
 }
 
+// mDataMutex must be LOCKED before calling this, and not the block's shard.
+// Removes an LRU victim unless it was locked since the LRU list was built.
+BOOL LLVFS::evictFileBlock(LLVFSFileBlock *file_block)
+{
+	LLVFSFileSpecifier spec(file_block->mFileID, file_block->mFileType);
+	lockShard(spec);
+	BOOL evict = file_block->mLength > 0 &&
+				 ! file_block->mLocks[VFSLOCK_READ] &&
+				 ! file_block->mLocks[VFSLOCK_APPEND] &&
+				 ! file_block->mLocks[VFSLOCK_OPEN];
+	if (evict)
+	{
+		removeFileBlock(file_block);
+		mEvictions++;
+	}
+	unlockShard(spec);
+	return evict;
+}
+
 //============================================================================
 // public
 //============================================================================
@@ -1651,6 +2140,11 @@ void LLVFS::pokeFiles()
 	}
 	U32 word;
 	
+	lockData();
+	waitForReads();
+	mDataFPPos = -1;
+	mDataDirty = FALSE;
+
 	// only write data if we actually read 4 bytes
 	// otherwise we're writing garbage and screwing up the file
 	fseek(mDataFP, 0, SEEK_SET);
@@ -1674,16 +2168,21 @@ void LLVFS::pokeFiles()
 		}
 		fflush(mIndexFP);
 	}
+
+	unlockData();
 }
 
     
 void LLVFS::dumpMap()
 {
 	llinfos << "Files:" << llendl;
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
 	{
-		LLVFSFileBlock *file_block = (*it).second;
-		llinfos << "Location: " << file_block->mLocation << "\tLength: " << file_block->mLength << "\t" << file_block->mFileID << "\t" << file_block->mFileType << llendl;
+		for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
+		{
+			LLVFSFileBlock *file_block = (*it).second;
+			llinfos << "Location: " << file_block->mLocation << "\tLength: " << file_block->mLength << "\t" << file_block->mFileID << "\t" << file_block->mFileType << llendl;
+		}
 	}
     
 	llinfos << "Free Blocks:" << llendl;
@@ -1702,6 +2201,7 @@ void LLVFS::audit()
 {
 	// Lock the mutex through this whole function.
 	LLMutexLock lock_data(mDataMutex);
+	lockAllShards();
 	
 	fflush(mIndexFP);
 
@@ -1742,7 +2242,7 @@ void LLVFS::audit()
 			block->mAccessTime <= cur_time &&
 			block->mFileID != LLUUID::null)
 		{
-			if (mFileBlocks.find(*block) == mFileBlocks.end())
+			if (!findFileBlock(*block))
 			{
 				llwarns << "VFile " << block->mFileID << ":" << block->mFileType << " on disk, not in memory, loc " << block->mIndexLocation << llendl;
 			}
@@ -1792,7 +2292,8 @@ void LLVFS::audit()
     
 	if (!vfs_corrupt)
 	{
-		for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+		for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+		for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
 		{
 			LLVFSFileBlock* block = (*it).second;
 
@@ -1833,6 +2334,7 @@ void LLVFS::audit()
 		// mutex released by LLMutexLock() destructor.
 	}
 
+	unlockAllShards();
 	for_each(audit_blocks.begin(), audit_blocks.end(), DeletePointer());
 }
     
@@ -1842,8 +2344,10 @@ void LLVFS::audit()
 void LLVFS::checkMem()
 {
 	lockData();
+	lockAllShards();
 	
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
 	{
 		LLVFSFileBlock *block = (*it).second;
 		llassert(block->mFileType >= LLAssetType::AT_NONE &&
@@ -1863,6 +2367,7 @@ void LLVFS::checkMem()
     
 	llinfos << "VFS: mem check OK" << llendl;
 
+	unlockAllShards();
 	unlockData();
 }
 
@@ -1871,13 +2376,14 @@ void LLVFS::dumpLockCounts()
 	S32 i;
 	for (i = 0; i < VFSLOCK_COUNT; i++)
 	{
-		llinfos << "LockType: " << i << ": " << mLockCounts[i] << llendl;
+		llinfos << "LockType: " << i << ": " << (S32)mLockCounts[i] << llendl;
 	}
 }
 
 void LLVFS::dumpStatistics()
 {
 	lockData();
+	lockAllShards();
 	
 	// Investigate file blocks.
 	std::map<S32, S32> size_counts;
@@ -1887,8 +2393,11 @@ void LLVFS::dumpStatistics()
 	S32 max_file_size = 0;
 	S32 total_file_size = 0;
 	S32 invalid_file_count = 0;
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	S32 file_block_count = 0;
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
 	{
+		file_block_count++;
 		LLVFSFileBlock *file_block = (*it).second;
 		if (file_block->mLength == BLOCK_LENGTH_INVALID)
 		{
@@ -1964,9 +2473,9 @@ void LLVFS::dumpStatistics()
 	}
 
 	llinfos << "Invalid blocks: " << invalid_file_count << llendl;
-	llinfos << "File blocks:    " << mFileBlocks.size() << llendl;
+	llinfos << "File blocks:    " << file_block_count << llendl;
 
-	S32 length_list_count = (S32)mFreeBlocksByLength.size();
+	S32 length_list_count = (S32)mFreeBlocksBySize.size();
 	S32 location_list_count = (S32)mFreeBlocksByLocation.size();
 	if (length_list_count == location_list_count)
 	{
@@ -1984,6 +2493,28 @@ void LLVFS::dumpStatistics()
 	llinfos << "Total free size: " << total_free_size/1024 << "K" << llendl;
 	llinfos << "Sum: " << (total_file_size + total_free_size) << " bytes" << llendl;
 	llinfos << llformat("%.0f%% full",((F32)(total_file_size)/(F32)(total_file_size+total_free_size))*100.f) << llendl;
+	// Share of the free space that can't be handed out in one piece
+	llinfos << llformat("Fragmentation: %.1f%%", total_free_size > 0 ? (1.f - (F32)max_free_size/(F32)total_free_size)*100.f : 0.f) << llendl;
+
+	// Free blocks per allocator size class
+	for (S32 size_class = 0; size_class < LLVFSFreeList::CLASS_COUNT; size_class++)
+	{
+		S32 count = mFreeBlocksBySize.getClassCount(size_class);
+		if (count)
+		{
+			llinfos << "Free class >= " << LLVFSFreeList::getClassMinLength(size_class) << " count " << count << llendl;
+		}
+	}
+
+	U32 hits = mReadHits;
+	U32 misses = mReadMisses;
+	U32 mapped_reads = mMappedReads;
+	llinfos << "Reads: " << hits << " hits, " << misses << " misses"
+			<< llformat(", %.1f%% hit rate", hits + misses ? (F32)hits/(F32)(hits + misses)*100.f : 0.f) << llendl;
+	llinfos << "Mapped reads: " << mapped_reads
+			<< llformat(" (%.1f%%)", hits ? (F32)mapped_reads/(F32)hits*100.f : 0.f)
+			<< ", mapped " << mDataMapSize/1024 << "K" << llendl;
+	llinfos << "Allocations: " << mAllocations << " LRU evictions: " << mEvictions << llendl;
 
 	llinfos << " " << llendl;
 	for (std::map<LLAssetType::EType, std::pair<S32,S32> >::iterator iter = filetype_counts.begin();
@@ -2011,6 +2542,7 @@ void LLVFS::dumpStatistics()
  			first_block = second_block;
  		}
 	}
+	unlockAllShards();
 	unlockData();
 }
 
@@ -2047,8 +2579,10 @@ std::string get_extension(LLAssetType::EType type)
 void LLVFS::listFiles()
 {
 	lockData();
+	lockAllShards();
 	
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
 	{
 		LLVFSFileSpecifier file_spec = it->first;
 		LLVFSFileBlock *file_block = it->second;
@@ -2065,47 +2599,63 @@ void LLVFS::listFiles()
 		}
 	}
 	
+	unlockAllShards();
 	unlockData();
 }
 
 #include "llapr.h"
 void LLVFS::dumpFiles()
 {
+	// Collect the files first, getData() takes the shard locks itself
+	std::vector<std::pair<LLVFSFileSpecifier, S32> > files;
+	S32 file_block_count = 0;
 	lockData();
+	lockAllShards();
 	
-	S32 files_extracted = 0;
-	for (fileblock_map::iterator it = mFileBlocks.begin(); it != mFileBlocks.end(); ++it)
+	for (S32 shard = 0; shard < FILE_SHARD_COUNT; shard++)
+	for (fileblock_map::iterator it = mFileBlocks[shard].begin(); it != mFileBlocks[shard].end(); ++it)
 	{
-		LLVFSFileSpecifier file_spec = it->first;
+		file_block_count++;
 		LLVFSFileBlock *file_block = it->second;
 		S32 length = file_block->mLength;
 		S32 size = file_block->mSize;
 		if (length != BLOCK_LENGTH_INVALID && size > 0)
 		{
-			LLUUID id = file_spec.mFileID;
-			LLAssetType::EType type = file_spec.mFileType;
-			std::vector<U8> buffer(size);
-
-			unlockData();
-			getData(id, type, &buffer[0], 0, size);
-			lockData();
-			
-			std::string extension = get_extension(type);
-			std::string filename = id.asString() + extension;
-			llinfos << " Writing " << filename << llendl;
-			
-			LLAPRFile outfile;
-			outfile.open(filename, LL_APR_WB);
-			outfile.write(&buffer[0], size);
-			outfile.close();
-
-			files_extracted++;
+			files.push_back(std::make_pair(it->first, size));
 		}
 	}
 	
+	unlockAllShards();
 	unlockData();
 
-	llinfos << "Extracted " << files_extracted << " files out of " << mFileBlocks.size() << llendl;
+	S32 files_extracted = 0;
+	for (std::vector<std::pair<LLVFSFileSpecifier, S32> >::iterator iter = files.begin();
+		 iter != files.end(); ++iter)
+	{
+		LLUUID id = iter->first.mFileID;
+		LLAssetType::EType type = iter->first.mFileType;
+		S32 size = iter->second;
+		std::vector<U8> buffer(size);
+
+		size = getData(id, type, &buffer[0], 0, size);
+		if (size <= 0)
+		{
+			continue;
+		}
+		
+		std::string extension = get_extension(type);
+		std::string filename = id.asString() + extension;
+		llinfos << " Writing " << filename << llendl;
+		
+		LLAPRFile outfile;
+		outfile.open(filename, LL_APR_WB);
+		outfile.write(&buffer[0], size);
+		outfile.close();
+
+		files_extracted++;
+	}
+
+	llinfos << "Extracted " << files_extracted << " files out of " << file_block_count << llendl;
 }
 
 //============================================================================
@@ -69,6 +69,48 @@ public:
 	LLAssetType::EType mFileType;
 };
 
+// Free space index for LLVFS. Free blocks are kept in segregated lists by
+// size class, each power of two split into SUB_CLASS_COUNT classes, and a
+// bitmap of the non-empty classes finds the first class that can satisfy a
+// request. Insert and erase are O(1), find is O(1) in the common case and
+// never depends on how many free blocks the VFS has.
+class LLVFSFreeList
+{
+public:
+	enum
+	{
+		SUB_CLASS_BITS = 2,
+		SUB_CLASS_COUNT = 1 << SUB_CLASS_BITS,
+		CLASS_COUNT = 32 * SUB_CLASS_COUNT,
+		CLASS_WORDS = CLASS_COUNT / 32
+	};
+
+	LLVFSFreeList();
+
+	void insert(LLVFSBlock *block);
+	void erase(LLVFSBlock *block);
+	void clear(); // forgets every block, doesn't delete them
+
+	// A free block of at least length bytes, NULL if there is none
+	LLVFSBlock *find(S32 length) const;
+
+	size_t size() const { return mSize; }
+	S32 getClassCount(S32 size_class) const { return mCounts[size_class]; }
+
+	static S32 getSizeClass(S32 length);
+	static S32 getClassMinLength(S32 size_class);
+
+private:
+	// First non-empty class >= size_class, -1 if none
+	S32 findClass(S32 size_class) const;
+
+private:
+	LLVFSBlock *mHeads[CLASS_COUNT];
+	S32 mCounts[CLASS_COUNT];
+	U32 mBits[CLASS_WORDS];
+	size_t mSize;
+};
+
 class LLVFS
 {
 private:
@@ -107,6 +149,7 @@ public:
 	void removeFile(const LLUUID &file_id, const LLAssetType::EType file_type);
 
 	S32 getData(const LLUUID &file_id, const LLAssetType::EType file_type, U8 *buffer, S32 location, S32 length);
+
 	S32 storeData(const LLUUID &file_id, const LLAssetType::EType file_type, const U8 *buffer, S32 location, S32 length);
 
 	void incLock(const LLUUID &file_id, const LLAssetType::EType file_type, EVFSLock lock);
@@ -117,6 +160,10 @@ public:
 	// Used to trigger evil WinXP behavior of "preloading" entire file into memory.
 	void pokeFiles();
 
+	// Map VFS data files created from now on into memory for reads.
+	// Files too large for the address space are always read with pread().
+	static void setUseMemoryMap(BOOL use_map) { sUseMemoryMap = use_map; }
+
 	// Verify that the index file contents match the in-memory file structure
 	// Very slow, do not call routinely. JC
 	void audit();
@@ -146,24 +193,71 @@ protected:
 	// Can initiate LRU-based file removal to make space.
 	// The immune file block will not be removed.
 	LLVFSBlock *findFreeBlock(S32 size, LLVFSFileBlock *immune = NULL);
+	BOOL evictFileBlock(LLVFSFileBlock *file_block);
 
 	// lock/unlock data mutex (mDataMutex)
 	void lockData() { mDataMutex->lock(); }
 	void unlockData() { mDataMutex->unlock(); }	
+
+	// File blocks are split into shards by file ID, each with its own lock,
+	// so lookups, lock counts and reads of different files don't contend.
+	// Moving, resizing or removing a block takes mDataMutex, then the shard.
+	enum { FILE_SHARD_COUNT = 16 };
+	static S32 getShard(const LLVFSFileSpecifier &spec) { return (spec.mFileID.mData[0] ^ (U8)spec.mFileType) & (FILE_SHARD_COUNT - 1); }
+	void lockShard(const LLVFSFileSpecifier &spec) { mShardMutex[getShard(spec)]->lock(); }
+	void unlockShard(const LLVFSFileSpecifier &spec) { mShardMutex[getShard(spec)]->unlock(); }
+	void lockAllShards();
+	void unlockAllShards();
+	// The spec's shard must be locked
+	LLVFSFileBlock *findFileBlock(const LLVFSFileSpecifier &spec);
+
+	// Zero-copy reads for LLVFSDataView, see there
+	friend class LLVFSDataView;
+	const U8 *getDataView(const LLUUID &file_id, const LLAssetType::EType file_type, S32 location, S32 &length);
+	void releaseDataView();
+
+	// getData() does its file read outside any lock. Anything that writes
+	// to mDataFP must hold mDataMutex and call waitForReads() first, pins
+	// are only taken under mDataMutex once buffered writes are flushed.
+	S32 pinData(const LLVFSFileSpecifier &spec, S32 location, S32 length, S32 &data_location, const U8* &mapped);
+	void unpinData();
+	S32 readDataAt(U8 *buffer, S32 location, S32 length);
+	void waitForReads();
+	void flushData();
+
+	void mapDataFile();
+	void unmapDataFile();
 	
 protected:
 	LLMutex* mDataMutex;
+	LLCondition* mReadCondition;	// signaled when mActiveReads drops to 0, guards the mapping
+	S32 mActiveReads;				// reads and views running outside the locks
 	
 	typedef std::map<LLVFSFileSpecifier, LLVFSFileBlock*> fileblock_map;
-	fileblock_map mFileBlocks;
+	fileblock_map mFileBlocks[FILE_SHARD_COUNT];
+	LLMutex* mShardMutex[FILE_SHARD_COUNT];
 
-	typedef std::multimap<S32, LLVFSBlock*>	blocks_length_map_t;
-	blocks_length_map_t 	mFreeBlocksByLength;
+	LLVFSFreeList			mFreeBlocksBySize;
 	typedef std::multimap<U32, LLVFSBlock*>	blocks_location_map_t;
 	blocks_location_map_t 	mFreeBlocksByLocation;
 
 	LLFILE *mDataFP;
 	LLFILE *mIndexFP;
+	S32 mDataFPPos;		// stdio position of mDataFP, -1 if unknown
+	BOOL mDataDirty;	// mDataFP has buffered writes
+
+	// Read-only mapping of the start of the data file, NULL if not mapped
+	U8 *mDataMap;
+	U32 mDataMapSize;
+	void *mDataMapHandle;	// file mapping object on Windows
+	static BOOL sUseMemoryMap;
+
+	// Statistics for dumpStatistics()
+	LLAtomicU32 mReadHits;
+	LLAtomicU32 mReadMisses;
+	LLAtomicU32 mMappedReads;
+	U32 mAllocations;	// guarded by mDataMutex
+	U32 mEvictions;		// guarded by mDataMutex
 
 	std::deque<S32> mIndexHoles;
 
@@ -173,10 +267,35 @@ protected:
 
 	EVFSValid mValid;
 
-	S32 mLockCounts[VFSLOCK_COUNT];
+	LLAtomicS32 mLockCounts[VFSLOCK_COUNT];
 	BOOL mRemoveAfterCrash;
 };
 
+// Zero-copy read of a file's data straight out of the mapped data file,
+// released when the view goes out of scope. getData() is NULL if the file
+// doesn't exist or isn't mapped, use LLVFS::getData() then. Writes to the
+// VFS wait while a view is held, so keep it on the stack and short-lived.
+class LLVFSDataView
+{
+public:
+	LLVFSDataView(LLVFS *vfs, const LLUUID &file_id, const LLAssetType::EType file_type, S32 location, S32 length);
+	~LLVFSDataView() { release(); }
+
+	const U8 *getData() const	{ return mData; }
+	S32 getLength() const		{ return mLength; }
+
+	// Lets writers through before the view goes out of scope
+	void release();
+
+private:
+	LLVFSDataView(const LLVFSDataView&);
+	LLVFSDataView& operator=(const LLVFSDataView&);
+
+	LLVFS *mVFS;
+	const U8 *mData;
+	S32 mLength;
+};
+
 extern LLVFS *gVFS;
 
 #endif
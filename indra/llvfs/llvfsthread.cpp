@@ -64,13 +64,31 @@ void LLVFSThread::cleanupClass()
 
 //----------------------------------------------------------------------------
 
+// Reads only hold the LLVFS lock to look up the block, so a few of them
+// can be in flight at once when running on the shared pool
+const S32 VFS_POOLED_CONCURRENCY = 4;
+
 LLVFSThread::LLVFSThread(bool threaded) :
-	LLQueuedThread("VFS", threaded)
+	LLQueuedThread("VFS", threaded),
+	mNextWriteTicket(0),
+	mNextWriteToStore(1)
 {
+	mWriteTicketMutex = new LLMutex(NULL);
+	mWriteOrderMutex = new LLMutex(NULL);
+	if (isPooled())
+	{
+		setMaxConcurrency(VFS_POOLED_CONCURRENCY);
+	}
 }
 
 LLVFSThread::~LLVFSThread()
 {
+	// Stop servicing before the write ordering goes away
+	shutdown();
+	delete mWriteTicketMutex;
+	mWriteTicketMutex = NULL;
+	delete mWriteOrderMutex;
+	mWriteOrderMutex = NULL;
 	// ~LLQueuedThread() will be called here
 }
 
@@ -122,15 +140,22 @@ S32 LLVFSThread::readImmediate(LLVFS* vfs, const LLUUID &file_id, const LLAssetT
 LLVFSThread::handle_t LLVFSThread::write(LLVFS* vfs, const LLUUID &file_id, const LLAssetType::EType file_type,
 										 U8* buffer, S32 offset, S32 numbytes, U32 flags)
 {
+	// Tickets must be handed out in queue order. Queued writes all have the
+	// same priority, so the queue takes them in handle order, which has to
+	// follow the tickets.
+	LLMutexLock lock(mWriteTicketMutex);
 	handle_t handle = generateHandle();
 
 	Request* req = new Request(handle, 0, flags, FILE_WRITE, vfs, file_id, file_type,
 							   buffer, offset, numbytes);
 
+	U32 ticket = ++mNextWriteTicket;
+	req->setWriteTicket(this, ticket);
 	bool res = addRequest(req);
 	if (!res)
 	{
 		llerrs << "LLVFSThread::read called after LLVFSThread::cleanupClass()" << llendl;
+		retireWrite(ticket);
 		req->deleteRequest();
 		handle = nullHandle();
 	}
@@ -183,6 +208,27 @@ S32 LLVFSThread::writeImmediate(LLVFS* vfs, const LLUUID &file_id, const LLAsset
 // 	return handle;
 // }
 
+//----------------------------------------------------------------------------
+
+// Any thread
+bool LLVFSThread::isWriteTurn(U32 ticket)
+{
+	LLMutexLock lock(mWriteOrderMutex);
+	return ticket == mNextWriteToStore;
+}
+
+// Any thread. Called once per ticket, whether the write was stored or aborted.
+void LLVFSThread::retireWrite(U32 ticket)
+{
+	LLMutexLock lock(mWriteOrderMutex);
+	mRetiredWrites.insert(ticket);
+	while (!mRetiredWrites.empty() && *mRetiredWrites.begin() == mNextWriteToStore)
+	{
+		mRetiredWrites.erase(mRetiredWrites.begin());
+		mNextWriteToStore++;
+	}
+}
+
 //============================================================================
 
 LLVFSThread::Request::Request(handle_t handle, U32 priority, U32 flags,
@@ -191,6 +237,8 @@ LLVFSThread::Request::Request(handle_t handle, U32 priority, U32 flags,
 							  U8* buffer, S32 offset, S32 numbytes) :
 	QueuedRequest(handle, priority, flags),
 	mOperation(op),
+	mThread(NULL),
+	mWriteTicket(0),
 	mVFS(vfs),
 	mFileID(file_id),
 	mFileType(file_type),
@@ -233,6 +281,11 @@ void LLVFSThread::Request::finishRequest(bool completed)
 	if (mOperation == FILE_WRITE)
 	{
 		mVFS->decLock(mFileID, mFileType, VFSLOCK_APPEND);
+		if (mWriteTicket)
+		{
+			mThread->retireWrite(mWriteTicket);
+			mWriteTicket = 0;
+		}
 	}
 	else if (mOperation == FILE_RENAME)
 	{
@@ -277,6 +330,12 @@ bool LLVFSThread::Request::processRequest()
 	}
 	else if (mOperation ==  FILE_WRITE)
 	{
+		if (mWriteTicket && !mThread->isWriteTurn(mWriteTicket))
+		{
+			// An earlier queued write is still in progress on another
+			// worker. Go back in the queue rather than hold this one.
+			return false;
+		}
 		mBytesRead = mVFS->storeData(mFileID, mFileType, mBuffer, mOffset, mBytes);
 		complete = true;
 		//llinfos << llformat("LLVFSThread::WRITE '%s': %d bytes arg:%d",getFilename(),mBytesRead) << llendl;
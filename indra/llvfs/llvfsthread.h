@@ -90,9 +90,14 @@ public:
 		/*virtual*/ bool processRequest();
 		/*virtual*/ void finishRequest(bool completed);
 		/*virtual*/ void deleteRequest();
+
+		// Queued writes are stored in the order they were issued
+		void setWriteTicket(LLVFSThread* thread, U32 ticket) { mThread = thread; mWriteTicket = ticket; }
 		
 	private:
 		operation_t mOperation;
+		LLVFSThread* mThread;
+		U32 mWriteTicket;	// 0 = unordered
 		
 		LLVFS* mVFS;
 		LLUUID mFileID;
@@ -129,6 +134,19 @@ public:
 
 	/*virtual*/ bool processRequest(QueuedRequest* req);
 
+protected:
+	// Reads may run concurrently on the shared pool, queued writes are
+	// put back in the queue until every earlier queued write is stored
+	bool isWriteTurn(U32 ticket);
+	void retireWrite(U32 ticket);
+
+private:
+	LLMutex* mWriteTicketMutex;
+	U32 mNextWriteTicket;
+	LLMutex* mWriteOrderMutex; // guards mNextWriteToStore, mRetiredWrites
+	U32 mNextWriteToStore;
+	std::set<U32> mRetiredWrites;
+
 public:
 	static void initClass(bool local_is_threaded = TRUE); // Setup sLocal
 	static S32 updateClass(U32 ms_elapsed);
@@ -86,6 +86,8 @@
 
 // Linden library includes
 #include "llavatarnamecache.h"
+#include "llbakeuploadqueue.h"
+#include "llimageglupload.h"
 #include "llimagej2c.h"
 #include "llmemory.h"
 #include "llprimitive.h"
@@ -119,6 +121,7 @@
 #include "lltexturecache.h"
 #include "lltexturefetch.h"
 #include "llimageworker.h"
+#include "llthreadpool.h"
 #include "llevents.h"
 
 // The files below handle dependencies from cleanup.
@@ -579,6 +582,7 @@ LLAppViewer::LLAppViewer() :
 	mRandomizeFramerate(LLCachedControl<bool>(gSavedSettings,"Randomize Framerate", FALSE)),
 	mPeriodicSlowFrame(LLCachedControl<bool>(gSavedSettings,"Periodic Slow Frame", FALSE)),
 	mFastTimerLogThread(NULL),
+	mThreadPool(NULL),
 	mUpdater(new LLUpdaterService())
 {
 	if(NULL != sInstance)
@@ -1160,9 +1164,6 @@ bool LLAppViewer::mainLoop()
 					if (milliseconds_to_sleep > 0)
 					{
 						ms_sleep(milliseconds_to_sleep);
-						// also pause worker threads during this wait period
-						LLAppViewer::getTextureCache()->pause();
-						LLAppViewer::getImageDecodeThread()->pause();
 					}
 				}
 				
@@ -1182,25 +1183,27 @@ bool LLAppViewer::mainLoop()
 				const F64 max_idle_time = llmin(.005*10.0*gFrameTimeSeconds, 0.005); // 5 ms a second
 				idleTimer.reset();
 				bool is_slow = (frameTimer.getElapsedTimeF64() > FRAME_SLOW_THRESHOLD) ;
-				S32 total_work_pending = 0;
-				S32 total_io_pending = 0;				
-				while(!is_slow)//do not unpause threads if the frame rates are very low.
+				if (!is_slow) // do not feed the workers if the frame rates are very low.
 				{
-					S32 work_pending = 0;
-					S32 io_pending = 0;
+					// The texture queues run on the shared thread pool, whose
+					// workers sleep on their own when there is nothing to do.
+					// update() only hands over main thread work and reschedules.
 					{
 						LLFastTimer ftm(FTM_TEXTURE_CACHE);
- 						work_pending += LLAppViewer::getTextureCache()->update(1); // unpauses the texture cache thread
+ 						LLAppViewer::getTextureCache()->update(1);
 					}
 					{
 						LLFastTimer ftm(FTM_DECODE);
-	 					work_pending += LLAppViewer::getImageDecodeThread()->update(1); // unpauses the image thread
+	 					LLAppViewer::getImageDecodeThread()->update(1);
 					}
 					{
 						LLFastTimer ftm(FTM_DECODE);
-	 					work_pending += LLAppViewer::getTextureFetch()->update(1); // unpauses the texture fetch thread
+	 					LLAppViewer::getTextureFetch()->update(1);
 					}
-
+				}
+				while(!is_slow)
+				{
+					S32 io_pending = 0;
 					{
 						LLFastTimer ftm(FTM_VFS);
 	 					io_pending += LLVFSThread::updateClass(1);
@@ -1210,32 +1213,23 @@ bool LLAppViewer::mainLoop()
 	 					io_pending += LLLFSThread::updateClass(1);
 					}
 
+					if (LLVFSThread::sLocal->getThreaded() && LLLFSThread::sLocal->getThreaded())
+					{
+						// The I/O runs on the thread pool, update() just kicked it
+						break;
+					}
+
 					if (io_pending > 1000)
 					{
 						ms_sleep(llmin(io_pending/100,100)); // give the vfs some time to catch up
 					}
 
-					total_work_pending += work_pending ;
-					total_io_pending += io_pending ;
-					
-					if (!work_pending || idleTimer.getElapsedTimeF64() >= max_idle_time)
+					if (!io_pending || idleTimer.getElapsedTimeF64() >= max_idle_time)
 					{
 						break;
 					}
 				}
 
-				if(!total_work_pending) //pause texture fetching threads if nothing to process.
-				{
-					LLAppViewer::getTextureCache()->pause();
-					LLAppViewer::getImageDecodeThread()->pause();
-					LLAppViewer::getTextureFetch()->pause(); 
-				}
-				if(!total_io_pending) //pause file threads if nothing to process.
-				{
-					LLVFSThread::sLocal->pause(); 
-					LLLFSThread::sLocal->pause(); 
-				}									
-
 				if ((LLStartUp::getStartupState() >= STATE_CLEANUP) &&
 					(frameTimer.getElapsedTimeF64() > FRAME_STALL_THRESHOLD))
 				{
@@ -1645,6 +1639,7 @@ bool LLAppViewer::cleanup()
     sTextureFetch = NULL;
 	delete sImageDecodeThread;
     sImageDecodeThread = NULL;
+	LLImageGLUpload::cleanupClass(); // after the threads that stage uploads
 	delete mFastTimerLogThread;
 	mFastTimerLogThread = NULL;
 	
@@ -1677,6 +1672,12 @@ bool LLAppViewer::cleanup()
 	LLImage::cleanupClass();
 	LLVFSThread::cleanupClass();
 	LLLFSThread::cleanupClass();
+	LLBakeUploadQueue::cleanupClass();
+
+	// Every queued thread is gone, stop the workers they shared
+	LLQueuedThread::setSharedPool(NULL);
+	delete mThreadPool;
+	mThreadPool = NULL;
 
 #ifndef LL_RELEASE_FOR_DOWNLOAD
 	llinfos << "Auditing VFS" << llendl;
@@ -1761,11 +1762,33 @@ bool LLAppViewer::initThreads()
 	static const bool enable_threads = true;
 #endif
 
-	LLVFSThread::initClass(enable_threads && false);
-	LLLFSThread::initClass(enable_threads && false);
+	if (enable_threads)
+	{
+		// Texture cache, fetch and decode share these workers instead of
+		// running a dedicated thread each
+		mThreadPool = new LLThreadPool("pool", gSavedSettings.getU32("ThreadPoolSize"));
+		LLQueuedThread::setSharedPool(mThreadPool);
+	}
+
+	// LLVFS reads run outside its lock and queued writes are stored in
+	// order, so VFS and local file I/O can leave the main loop
+	LLVFSThread::initClass(enable_threads);
+	LLLFSThread::initClass(enable_threads);
+
+	// Prim LODs are generated by the pool as well, objects keep showing
+	// the LOD they have until the new one is built
+	LLPrimitive::getVolumeManager()->useBuildThread(enable_threads);
+
+	// Baked avatar textures are encoded off the main thread
+	LLBakeUploadQueue::initClass(enable_threads);
 
 	// Image decoding
-	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true);
+	U32 decode_threads = gSavedSettings.getU32("ImageDecodeThreads");
+	if (decode_threads == 0)
+	{
+		decode_threads = LLImageDecodeThread::getDefaultPoolSize();
+	}
+	LLAppViewer::sImageDecodeThread = new LLImageDecodeThread(enable_threads && true, decode_threads);
 	LLAppViewer::sTextureCache = new LLTextureCache(enable_threads && true);
 	LLAppViewer::sTextureFetch = new LLTextureFetch(LLAppViewer::getTextureCache(), sImageDecodeThread, enable_threads && true);
 	LLImage::initClass();
@@ -3183,7 +3206,7 @@ void dumpVFSCaches()
 U32 LLAppViewer::getTextureCacheVersion() 
 {
 	//viewer texture cache version, change if the texture cache format changes.
-	const U32 TEXTURE_CACHE_VERSION = 7;
+	const U32 TEXTURE_CACHE_VERSION = 8;
 
 	return TEXTURE_CACHE_VERSION ;
 }
@@ -3392,6 +3415,8 @@ bool LLAppViewer::initCache()
 	// Startup the VFS...
 	gSavedSettings.setU32("VFSSalt", new_salt);
 
+	LLVFS::setUseMemoryMap(gSavedSettings.getBOOL("VFSMemoryMapped"));
+
 	// Don't remove VFS after viewer crashes.  If user has corrupt data, they can reinstall. JC
 	gVFS = LLVFS::createLLVFS(new_vfs_index_file, new_vfs_data_file, false, vfs_size_u32, false);
 	if( !gVFS )
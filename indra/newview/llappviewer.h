@@ -38,6 +38,7 @@ class LLPumpIO;
 class LLTextureCache;
 class LLImageDecodeThread;
 class LLTextureFetch;
+class LLThreadPool;
 class LLWatchdogTimeout;
 class LLUpdaterService;
 
@@ -254,6 +255,9 @@ private:
 	// For performance and metric gathering
 	LLThread*	mFastTimerLogThread;
 
+	// Workers shared by the texture cache, fetch and decode queues
+	LLThreadPool* mThreadPool;
+
 	// for tracking viewer<->region circuit death
 	bool mAgentRegionLastAlive;
 	LLUUID mAgentRegionLastID;
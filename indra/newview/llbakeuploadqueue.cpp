@@ -0,0 +1,269 @@
+/**
+ * @file llbakeuploadqueue.cpp
+ * @brief Reads back, encodes and uploads the baked textures of the agent avatar
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llbakeuploadqueue.h"
+
+#include "llappviewer.h"
+#include "llglheaders.h"
+#include "lltexlayer.h"
+#include "llviewercontrol.h"
+
+//static
+LLBakeUploadQueue* LLBakeUploadQueue::sInstance = NULL;
+
+//static
+void LLBakeUploadQueue::initClass(bool threaded)
+{
+	llassert(sInstance == NULL);
+	sInstance = new LLBakeUploadQueue(threaded);
+}
+
+//static
+void LLBakeUploadQueue::cleanupClass()
+{
+	if (sInstance)
+	{
+		sInstance->shutdown();
+		delete sInstance;
+		sInstance = NULL;
+	}
+}
+
+//static
+void LLBakeUploadQueue::updateClass()
+{
+	if (sInstance)
+	{
+		sInstance->updateBakes();
+	}
+}
+
+LLBakeUploadQueue::LLBakeUploadQueue(bool threaded)
+	: LLQueuedThread("bake upload", threaded)
+{
+}
+
+LLBakeUploadQueue::~LLBakeUploadQueue()
+{
+	for (bake_list_t::iterator iter = mBakes.begin(); iter != mBakes.end(); ++iter)
+	{
+		// the requests themselves go with the queue
+		deletePackBuffer(*iter);
+	}
+}
+
+void LLBakeUploadQueue::addBake(LLTexLayerSetBuffer* buffer, S32 x, S32 y, S32 width, S32 height, LLImageRaw* mask)
+{
+	mBakes.push_back(Bake());
+	Bake& bake = mBakes.back();
+	bake.mBuffer = buffer;
+	bake.mPackBuffer = 0;
+	bake.mReadFrame = gFrameCount;
+	bake.mWidth = width;
+	bake.mHeight = height;
+	bake.mMask = mask;
+	bake.mHandle = nullHandle();
+	bake.mStartTime = LLFrameTimer::getTotalTime();
+	bake.mReadbackTime = 0.f;
+
+	if (gGLManager.mHasPixelBufferObject && gSavedSettings.getBOOL("AvatarBakeAsyncReadback"))
+	{
+		glGenBuffersARB(1, (GLuint*) &bake.mPackBuffer);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, bake.mPackBuffer);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, width * height * 4, NULL, GL_STREAM_READ_ARB);
+		// Returns right away, the last argument is an offset into the buffer
+		glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		stop_glerror();
+	}
+	else
+	{
+		bake.mColor = new LLImageRaw(width, height, 4);
+		glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, bake.mColor->getData());
+		stop_glerror();
+		startEncode(bake);
+	}
+}
+
+void LLBakeUploadQueue::removeBuffer(LLTexLayerSetBuffer* buffer)
+{
+	for (bake_list_t::iterator iter = mBakes.begin(); iter != mBakes.end(); ++iter)
+	{
+		if (iter->mBuffer == buffer)
+		{
+			iter->mBuffer = NULL;
+			deletePackBuffer(*iter);
+		}
+	}
+}
+
+void LLBakeUploadQueue::deletePackBuffer(Bake& bake)
+{
+	if (bake.mPackBuffer)
+	{
+		glDeleteBuffersARB(1, (GLuint*) &bake.mPackBuffer);
+		bake.mPackBuffer = 0;
+	}
+}
+
+BOOL LLBakeUploadQueue::finishReadback(Bake& bake)
+{
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, bake.mPackBuffer);
+	U8* pixels = (U8*) glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+	BOOL success = pixels != NULL;
+	if (success)
+	{
+		bake.mColor = new LLImageRaw(bake.mWidth, bake.mHeight, 4);
+		memcpy(bake.mColor->getData(), pixels, bake.mWidth * bake.mHeight * 4);		/* Flawfinder: ignore */
+		glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	deletePackBuffer(bake);
+	return success;
+}
+
+void LLBakeUploadQueue::startEncode(Bake& bake)
+{
+	bake.mReadbackTime = (F32) ((LLFrameTimer::getTotalTime() - bake.mStartTime) / 1000000.0);
+	bake.mHandle = generateHandle();
+	addRequest(new EncodeRequest(bake.mHandle, bake.mColor, bake.mMask));
+	// the request holds on to the pixels now
+	bake.mColor = NULL;
+	bake.mMask = NULL;
+}
+
+void LLBakeUploadQueue::updateBakes()
+{
+	if (mBakes.empty())
+	{
+		return;
+	}
+
+	for (bake_list_t::iterator iter = mBakes.begin(); iter != mBakes.end(); )
+	{
+		Bake& bake = *iter;
+		if (bake.mHandle == nullHandle())
+		{
+			if (!bake.mBuffer)
+			{
+				iter = mBakes.erase(iter);
+				continue;
+			}
+			// Give the GL a frame to finish the read back before mapping
+			if (gFrameCount != bake.mReadFrame)
+			{
+				if (finishReadback(bake))
+				{
+					startEncode(bake);
+				}
+				else
+				{
+					llwarns << "Lost the read back of a baked texture, baking again" << llendl;
+					LLTexLayerSetBuffer* buffer = bake.mBuffer;
+					iter = mBakes.erase(iter);
+					buffer->finishUpload(NULL, 0, 0.f, 0.f);
+					continue;
+				}
+			}
+			++iter;
+			continue;
+		}
+
+		status_t status = getRequestStatus(bake.mHandle);
+		if (status != STATUS_COMPLETE && status != STATUS_ABORTED)
+		{
+			++iter;
+			continue;
+		}
+
+		EncodeRequest* req = (EncodeRequest*) getRequest(bake.mHandle);
+		LLPointer<LLImageJ2C> encoded = req->getEncoded();
+		F32 encode_time = req->getEncodeTime();
+		completeRequest(bake.mHandle);
+
+		LLTexLayerSetBuffer* buffer = bake.mBuffer;
+		U64 start_time = bake.mStartTime;
+		F32 readback_time = bake.mReadbackTime;
+		iter = mBakes.erase(iter);
+		if (buffer)
+		{
+			buffer->finishUpload(encoded, start_time, readback_time, encode_time);
+		}
+	}
+
+	// Runs the requests when not threaded, otherwise only reschedules
+	LLQueuedThread::update(1);
+}
+
+//============================================================================
+
+LLBakeUploadQueue::EncodeRequest::EncodeRequest(handle_t handle, LLImageRaw* color, LLImageRaw* mask)
+	: LLQueuedThread::QueuedRequest(handle, LLQueuedThread::PRIORITY_NORMAL),
+	  mColor(color),
+	  mMask(mask),
+	  mSucceeded(FALSE),
+	  mEncodeTime(0.f)
+{
+}
+
+LLBakeUploadQueue::EncodeRequest::~EncodeRequest()
+{
+}
+
+// virtual, called from own thread
+bool LLBakeUploadQueue::EncodeRequest::processRequest()
+{
+	LLTimer encode_timer;
+
+	// Create the baked image from our color and mask information
+	S32 width = mColor->getWidth();
+	S32 height = mColor->getHeight();
+	const S32 baked_image_components = 5; // red green blue [bump] clothing
+	LLPointer<LLImageRaw> baked_image = new LLImageRaw(width, height, baked_image_components);
+	U8* baked_image_data = baked_image->getData();
+	const U8* baked_color_data = mColor->getData();
+	const U8* baked_mask_data = mMask->getData();
+	for (S32 i = 0; i < width * height; i++)
+	{
+		baked_image_data[5*i + 0] = baked_color_data[4*i + 0];
+		baked_image_data[5*i + 1] = baked_color_data[4*i + 1];
+		baked_image_data[5*i + 2] = baked_color_data[4*i + 2];
+		baked_image_data[5*i + 3] = baked_color_data[4*i + 3]; // alpha should be correct for eyelashes.
+		baked_image_data[5*i + 4] = baked_mask_data[i];
+	}
+	mColor = NULL;
+	mMask = NULL;
+
+	mEncoded = new LLImageJ2C;
+	mEncoded->setRate(0.f);
+	const char* comment_text = LINDEN_J2C_COMMENT_PREFIX "RGBHM"; // 5 channels (rgb, heightfield/alpha, mask)
+	mSucceeded = mEncoded->encode(baked_image, comment_text);
+
+	mEncodeTime = encode_timer.getElapsedTimeF32();
+	return true;
+}
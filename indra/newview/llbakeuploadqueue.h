@@ -0,0 +1,113 @@
+/**
+ * @file llbakeuploadqueue.h
+ * @brief Reads back, encodes and uploads the baked textures of the agent avatar
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLBAKEUPLOADQUEUE_H
+#define LL_LLBAKEUPLOADQUEUE_H
+
+#include <list>
+
+#include "llimage.h"
+#include "llimagej2c.h"
+#include "llqueuedthread.h"
+
+class LLTexLayerSetBuffer;
+
+// Takes a baked composite from the frame it was rendered in to the upload.
+// The pixels are read back into a pixel pack buffer, which the GL fills
+// while the frame goes on, and are copied out a frame later when mapping the
+// buffer no longer waits on the GPU.  The J2C encode runs as a request on
+// this queue, off the main thread, after which the LLTexLayerSetBuffer that
+// asked for the bake writes and uploads the asset.
+class LLBakeUploadQueue : public LLQueuedThread
+{
+public:
+	class EncodeRequest : public LLQueuedThread::QueuedRequest
+	{
+	protected:
+		virtual ~EncodeRequest(); // use deleteRequest()
+
+	public:
+		EncodeRequest(handle_t handle, LLImageRaw* color, LLImageRaw* mask);
+
+		/*virtual*/ bool processRequest();
+
+		// NULL if the encode failed
+		LLImageJ2C* getEncoded() const { return mSucceeded ? mEncoded.get() : NULL; }
+		F32 getEncodeTime() const { return mEncodeTime; }
+
+	private:
+		LLPointer<LLImageRaw> mColor;
+		LLPointer<LLImageRaw> mMask;
+		LLPointer<LLImageJ2C> mEncoded;
+		BOOL mSucceeded;
+		F32 mEncodeTime;
+	};
+
+	static void initClass(bool threaded);
+	// Before the shared thread pool goes
+	static void cleanupClass();
+	static LLBakeUploadQueue* getInstance() { return sInstance; }
+
+	// MAIN thread, once a frame. Collects read backs and finished encodes.
+	static void updateClass();
+
+	// MAIN thread, right after the composite of buffer was rendered, with the
+	// morph mask already gathered. Hands the result to buffer->finishUpload().
+	void addBake(LLTexLayerSetBuffer* buffer, S32 x, S32 y, S32 width, S32 height, LLImageRaw* mask);
+
+	// MAIN thread. buffer no longer wants the result of its bake.
+	void removeBuffer(LLTexLayerSetBuffer* buffer);
+
+private:
+	LLBakeUploadQueue(bool threaded);
+	~LLBakeUploadQueue();
+
+	struct Bake
+	{
+		LLTexLayerSetBuffer* mBuffer; // NULL once removed, the result is dropped
+		U32 mPackBuffer;	// pixel pack buffer being read into, 0 when done
+		U32 mReadFrame;		// frame the read back was started in
+		S32 mWidth;
+		S32 mHeight;
+		LLPointer<LLImageRaw> mColor;
+		LLPointer<LLImageRaw> mMask;
+		handle_t mHandle;	// encode request, 0 until the pixels are in
+		U64 mStartTime;		// when the composite was rendered
+		F32 mReadbackTime;	// seconds until the pixels were in
+	};
+	typedef std::list<Bake> bake_list_t;
+
+	void updateBakes();
+	BOOL finishReadback(Bake& bake);
+	void startEncode(Bake& bake);
+	void deletePackBuffer(Bake& bake);
+
+	bake_list_t mBakes;
+
+	static LLBakeUploadQueue* sInstance;
+};
+
+#endif // LL_LLBAKEUPLOADQUEUE_H
@@ -0,0 +1,51 @@
+/**
+ * @file llcullthread.cpp
+ * @brief Culls spatial partitions on the shared thread pool
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llcullthread.h"
+
+#include "llspatialpartition.h"
+
+LLCullThread::LLCullThread()
+	: LLParallelForThread("cull"),
+	  mShards(NULL)
+{
+}
+
+void LLCullThread::cull(std::vector<LLCullShard*>& shards)
+{
+	mShards = &shards;
+	runBatch((S32) shards.size());
+	mShards = NULL;
+}
+
+// virtual, any thread
+void LLCullThread::processItem(S32 index)
+{
+	LLCullShard* shard = (*mShards)[index];
+	shard->mPartition->cull(*shard);
+}
@@ -493,6 +493,7 @@ void LLRenderPass::pushBatch(LLDrawInfo& params, U32 mask, BOOL texture)
 		params.mVertexBuffer->setBuffer(mask);
 		params.mVertexBuffer->drawRange(params.mDrawMode, params.mStart, params.mEnd, params.mCount, params.mOffset);
 		gPipeline.addTrianglesDrawn(params.mCount, params.mDrawMode);
+		gPipeline.mAtlasMergedBatchCount += params.mAtlasMerges;
 	}
 
 	if (params.mTextureMatrix && texture && params.mTexture.notNull())
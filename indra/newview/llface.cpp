@@ -755,8 +755,8 @@ void LLFace::getPlanarProjectedParams(LLQuaternion* face_rot, LLVector3* face_po
 {
 	const LLMatrix4& vol_mat = getWorldMatrix();
 	const LLVolumeFace& vf = getViewerObject()->getVolume()->getVolumeFace(mTEOffset);
-	LLVector3 normal = vf.mVertices[0].mNormal;
-	LLVector3 binormal = vf.mVertices[0].mBinormal;
+	LLVector3 normal = vf.getNormal(0);
+	LLVector3 binormal = vf.getBinormal(0);
 	LLVector2 projected_binormal;
 	planarProjection(projected_binormal, normal, vf.mCenter, binormal);
 	projected_binormal -= LLVector2(0.5f, 0.5f); // this normally happens in xform()
@@ -874,7 +874,7 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 {
 	LLFastTimer t(FTM_FACE_GET_GEOM);
 	const LLVolumeFace &vf = volume.getVolumeFace(f);
-	S32 num_vertices = (S32)vf.mVertices.size();
+	S32 num_vertices = vf.getNumVertices();
 	S32 num_indices = LLPipeline::sUseTriStrips ? (S32)vf.mTriStrip.size() : (S32) vf.mIndices.size();
 	
 	if (mVertexBuffer.notNull())
@@ -1150,28 +1150,28 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		mVObjp->getVolume()->genBinormals(f);
 	}
 
-	for (S32 i = 0; i < num_vertices; i++)
+	if (rebuild_tcoord)
 	{
-		if (rebuild_tcoord)
+		for (S32 i = 0; i < num_vertices; i++)
 		{
-			LLVector2 tc = vf.mVertices[i].mTexCoord;
+			LLVector2 tc = vf.getTexCoord(i);
 		
 			if (texgen != LLTextureEntry::TEX_GEN_DEFAULT)
 			{
-				LLVector3 vec = vf.mVertices[i].mPosition; 
+				LLVector3 vec = vf.getPosition(i); 
 			
 				vec.scaleVec(scale);
 
 				switch (texgen)
 				{
 					case LLTextureEntry::TEX_GEN_PLANAR:
-						planarProjection(tc, vf.mVertices[i].mNormal, vf.mCenter, vec);
+						planarProjection(tc, vf.getNormal(i), vf.mCenter, vec);
 						break;
 					case LLTextureEntry::TEX_GEN_SPHERICAL:
-						sphericalProjection(tc, vf.mVertices[i].mNormal, vf.mCenter, vec);
+						sphericalProjection(tc, vf.getNormal(i), vf.mCenter, vec);
 						break;
 					case LLTextureEntry::TEX_GEN_CYLINDRICAL:
-						cylindricalProjection(tc, vf.mVertices[i].mNormal, vf.mCenter, vec);
+						cylindricalProjection(tc, vf.getNormal(i), vf.mCenter, vec);
 						break;
 					default:
 						break;
@@ -1281,10 +1281,12 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 		
 			if (bump_code && mVertexBuffer->hasDataType(LLVertexBuffer::TYPE_TEXCOORD1))
 			{
-				LLVector3 tangent = vf.mVertices[i].mBinormal % vf.mVertices[i].mNormal;
+				LLVector3 vf_binormal = vf.getBinormal(i);
+				LLVector3 vf_normal = vf.getNormal(i);
+				LLVector3 tangent = vf_binormal % vf_normal;
 
 				LLMatrix3 tangent_to_object;
-				tangent_to_object.setRows(tangent, vf.mVertices[i].mBinormal, vf.mVertices[i].mNormal);
+				tangent_to_object.setRows(tangent, vf_binormal, vf_normal);
 				LLVector3 binormal = binormal_dir * tangent_to_object;
 				binormal = binormal * mat_normal;
 				
@@ -1299,28 +1301,27 @@ BOOL LLFace::getGeometryVolume(const LLVolume& volume,
 				*tex_coords2++ = tc;
 			}	
 		}
-			
-		if (rebuild_pos)
-		{
-			*vertices++ = vf.mVertices[i].mPosition * mat_vert;
-		}
-		
-		if (rebuild_normal)
-		{
-			LLVector3 normal = vf.mVertices[i].mNormal * mat_normal;
-			normal.normVec();
-			
-			*normals++ = normal;
-		}
-		
-		if (rebuild_binormal)
-		{
-			LLVector3 binormal = vf.mVertices[i].mBinormal * mat_normal;
-			binormal.normVec();
-			*binormals++ = binormal;
-		}
-		
-		if (rebuild_color)
+	}
+
+	// The rest is straight transforms of the volume face's streams
+	if (rebuild_pos)
+	{
+		vf.getTransformedPositions(mat_vert, vertices);
+	}
+	
+	if (rebuild_normal)
+	{
+		vf.getTransformedNormals(mat_normal, normals);
+	}
+	
+	if (rebuild_binormal)
+	{
+		vf.getTransformedNormals(mat_normal, binormals, TRUE);
+	}
+	
+	if (rebuild_color)
+	{
+		for (S32 i = 0; i < num_vertices; i++)
 		{
 			*colors++ = color;		
 		}
@@ -1804,6 +1805,26 @@ BOOL LLFace::canUseAtlas()const
 		return FALSE ;
 	}
 
+	//only LLVOVolume::getGeometryVolume remaps tex coords into atlas slots
+	if(!mVObjp || mVObjp->getPCode() != LL_PCODE_VOLUME)
+	{
+		return FALSE ;
+	}
+
+	//a slot can not repeat, so the tex coords have to stay in [0, 1]:
+	//no planar mapping, no rotation, and scale and offset inside the face.
+	const LLTextureEntry* tep = getTextureEntry() ;
+	if(!tep || tep->getTexGen() != LLTextureEntry::TEX_GEN_DEFAULT || tep->getRotation() != 0.f)
+	{
+		return FALSE ;
+	}
+	const F32 TEXCOORD_EPSILON = 0.001f ;
+	if(llabs(tep->mScaleS) * 0.5f + llabs(tep->mOffsetS) > 0.5f + TEXCOORD_EPSILON ||
+		llabs(tep->mScaleT) * 0.5f + llabs(tep->mOffsetT) > 0.5f + TEXCOORD_EPSILON)
+	{
+		return FALSE ;
+	}
+
 	return TRUE ;
 }
 
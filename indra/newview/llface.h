@@ -123,6 +123,7 @@ public:
 	void			setPoolType(U32 type)		{ mPoolType = type; }
 	S32				getTEOffset()				{ return mTEOffset; }
 	LLViewerTexture*	getTexture() const;
+	LLViewerTexture*	getOriginalTexture() const { return mTexture; } // the texture itself even when an atlas slot stands in for it
 
 	void			setViewerObject(LLViewerObject* object);
 	void			setPool(LLFacePool *pool, LLViewerTexture *texturep);
@@ -303,10 +304,15 @@ public:
 			{
 				return lte->getBumpShinyFullbright() < rte->getBumpShinyFullbright();
 			}
-			else 
+			else if (lte->getGlow() != rte->getGlow())
 			{
 				return lte->getGlow() < rte->getGlow();
 			}
+			else 
+			{
+				//keeps the faces of one texture together inside an atlas batch
+				return lhs->getOriginalTexture() < rhs->getOriginalTexture();
+			}
 		}
 	};
 
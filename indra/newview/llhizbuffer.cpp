@@ -0,0 +1,391 @@
+/**
+ * @file llhizbuffer.cpp
+ * @brief Hierarchical depth buffer for CPU side occlusion culling
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#include "llviewerprecompiledheaders.h"
+
+#include "llhizbuffer.h"
+
+#include "llfasttimer.h"
+#include "llgl.h"
+#include "llglheaders.h"
+#include "llv4math.h"
+#include "v3math.h"
+
+// Corners with a clip w below this are too close to (or behind) the eye
+// to project sensibly
+const F32 HIZ_MIN_W = 0.01f;
+
+U32 LLHiZBuffer::sOccludedCount = 0;
+U32 LLHiZBuffer::sVisibleCount = 0;
+U32 LLHiZBuffer::sUnknownCount = 0;
+
+static LLFastTimer::DeclareTimer FTM_HIZ_CAPTURE("HiZ Readback");
+static LLFastTimer::DeclareTimer FTM_HIZ_BUILD("HiZ Build");
+
+LLHiZBuffer::LLHiZBuffer()
+:	mNextCapture(0),
+	mWidth(0),
+	mHeight(0),
+	mValid(false)
+{
+	for (U32 i = 0; i < NUM_CAPTURES; i++)
+	{
+		mCaptures[i].mPBO = 0;
+		mCaptures[i].mWidth = 0;
+		mCaptures[i].mHeight = 0;
+		mCaptures[i].mSize = 0;
+		mCaptures[i].mPending = false;
+	}
+}
+
+LLHiZBuffer::~LLHiZBuffer()
+{
+	// GL resources are freed by release(), the GL context is gone by now
+}
+
+void LLHiZBuffer::release()
+{
+	for (U32 i = 0; i < NUM_CAPTURES; i++)
+	{
+		if (mCaptures[i].mPBO)
+		{
+			glDeleteBuffersARB(1, (GLuint*) &mCaptures[i].mPBO);
+			mCaptures[i].mPBO = 0;
+		}
+		mCaptures[i].mSize = 0;
+		mCaptures[i].mPending = false;
+	}
+	mLevels.clear();
+	mValid = false;
+}
+
+void LLHiZBuffer::capture(const F64* modelview, const F64* projection)
+{
+	if (!gGLManager.mHasPixelBufferObject)
+	{
+		return;
+	}
+
+	LLFastTimer t(FTM_HIZ_CAPTURE);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if (viewport[2] <= 0 || viewport[3] <= 0)
+	{
+		return;
+	}
+
+	Capture& cap = mCaptures[mNextCapture];
+	mNextCapture = (mNextCapture + 1) % NUM_CAPTURES;
+
+	if (!cap.mPBO)
+	{
+		glGenBuffersARB(1, (GLuint*) &cap.mPBO);
+	}
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, cap.mPBO);
+	U32 size = viewport[2] * viewport[3] * sizeof(F32);
+	if (size != cap.mSize)
+	{
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ_ARB);
+		cap.mSize = size;
+	}
+	// Returns immediately, the copy happens once the GPU gets there
+	glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3], GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	stop_glerror();
+
+	cap.mWidth = viewport[2];
+	cap.mHeight = viewport[3];
+	cap.mPending = true;
+
+	for (U32 col = 0; col < 4; col++)
+	{
+		for (U32 row = 0; row < 4; row++)
+		{
+			F64 sum = 0.0;
+			for (U32 k = 0; k < 4; k++)
+			{
+				sum += projection[k*4+row] * modelview[col*4+k];
+			}
+			cap.mMatrix[col*4+row] = (F32) sum;
+		}
+	}
+}
+
+void LLHiZBuffer::update()
+{
+	// The oldest capture is the next one to be overwritten
+	Capture& cap = mCaptures[mNextCapture];
+	if (!cap.mPending)
+	{
+		mValid = false;
+		return;
+	}
+
+	LLFastTimer t(FTM_HIZ_BUILD);
+
+	cap.mPending = false;
+	mValid = false;
+
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, cap.mPBO);
+	const F32* depth = (const F32*) glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+	if (depth)
+	{
+		build(depth, cap.mWidth, cap.mHeight);
+		memcpy(mMatrix, cap.mMatrix, sizeof(mMatrix));
+		mValid = true;
+		glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+	}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	stop_glerror();
+}
+
+void LLHiZBuffer::build(const F32* depth, S32 width, S32 height)
+{
+	mWidth = width;
+	mHeight = height;
+
+	S32 levels = 1;
+	S32 w = (width + TILE_SIZE - 1) / TILE_SIZE;
+	S32 h = (height + TILE_SIZE - 1) / TILE_SIZE;
+	while (w > 1 || h > 1)
+	{
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+		levels++;
+	}
+	mLevels.resize(levels);
+
+	// Base level, each texel is the min and max of a TILE_SIZE square of pixels
+	Level& base = mLevels[0];
+	base.mWidth = (width + TILE_SIZE - 1) / TILE_SIZE;
+	base.mHeight = (height + TILE_SIZE - 1) / TILE_SIZE;
+	base.mMin.resize(base.mWidth * base.mHeight);
+	base.mMax.resize(base.mWidth * base.mHeight);
+
+	for (S32 ty = 0; ty < base.mHeight; ty++)
+	{
+		S32 y0 = ty * TILE_SIZE;
+		S32 y1 = llmin(y0 + TILE_SIZE, height);
+		for (S32 tx = 0; tx < base.mWidth; tx++)
+		{
+			S32 x0 = tx * TILE_SIZE;
+			S32 x1 = llmin(x0 + TILE_SIZE, width);
+			F32 min_z = 1.f;
+			F32 max_z = 0.f;
+#if LL_VECTORIZE
+			if (x1 - x0 == TILE_SIZE)
+			{
+				__m128 vmin = _mm_set1_ps(1.f);
+				__m128 vmax = _mm_setzero_ps();
+				for (S32 y = y0; y < y1; y++)
+				{
+					const F32* row = depth + y * width + x0;
+					__m128 a = _mm_loadu_ps(row);
+					__m128 b = _mm_loadu_ps(row + 4);
+					vmin = _mm_min_ps(vmin, _mm_min_ps(a, b));
+					vmax = _mm_max_ps(vmax, _mm_max_ps(a, b));
+				}
+				F32 mins[4];
+				F32 maxs[4];
+				_mm_storeu_ps(mins, vmin);
+				_mm_storeu_ps(maxs, vmax);
+				min_z = llmin(llmin(mins[0], mins[1]), llmin(mins[2], mins[3]));
+				max_z = llmax(llmax(maxs[0], maxs[1]), llmax(maxs[2], maxs[3]));
+			}
+			else
+#endif
+			{
+				for (S32 y = y0; y < y1; y++)
+				{
+					const F32* row = depth + y * width;
+					for (S32 x = x0; x < x1; x++)
+					{
+						min_z = llmin(min_z, row[x]);
+						max_z = llmax(max_z, row[x]);
+					}
+				}
+			}
+			base.mMin[ty * base.mWidth + tx] = min_z;
+			base.mMax[ty * base.mWidth + tx] = max_z;
+		}
+	}
+
+	// Each level above folds 2x2 texels of the one below
+	for (S32 l = 1; l < levels; l++)
+	{
+		const Level& src = mLevels[l-1];
+		Level& dst = mLevels[l];
+		dst.mWidth = (src.mWidth + 1) / 2;
+		dst.mHeight = (src.mHeight + 1) / 2;
+		dst.mMin.resize(dst.mWidth * dst.mHeight);
+		dst.mMax.resize(dst.mWidth * dst.mHeight);
+
+		for (S32 y = 0; y < dst.mHeight; y++)
+		{
+			S32 sy0 = y * 2;
+			S32 sy1 = llmin(sy0 + 1, src.mHeight - 1);
+			for (S32 x = 0; x < dst.mWidth; x++)
+			{
+				S32 sx0 = x * 2;
+				S32 sx1 = llmin(sx0 + 1, src.mWidth - 1);
+				S32 a = sy0 * src.mWidth;
+				S32 b = sy1 * src.mWidth;
+				dst.mMin[y * dst.mWidth + x] = llmin(llmin(src.mMin[a + sx0], src.mMin[a + sx1]),
+													 llmin(src.mMin[b + sx0], src.mMin[b + sx1]));
+				dst.mMax[y * dst.mWidth + x] = llmax(llmax(src.mMax[a + sx0], src.mMax[a + sx1]),
+													 llmax(src.mMax[b + sx0], src.mMax[b + sx1]));
+			}
+		}
+	}
+}
+
+LLHiZBuffer::eResult LLHiZBuffer::test(const LLVector3& center, const LLVector3& size) const
+{
+	if (!mValid)
+	{
+		return UNKNOWN;
+	}
+
+	const F32* m = mMatrix;
+	const LLVector3 lo = center - size;
+	const LLVector3 hi = center + size;
+
+	// Clip space coordinates of the 8 corners, corner i uses hi for axis n
+	// when bit n of i is set
+	F32 cx[8];
+	F32 cy[8];
+	F32 cz[8];
+	F32 cw[8];
+
+#if LL_VECTORIZE
+	const __m128 x = _mm_setr_ps(lo.mV[0], hi.mV[0], lo.mV[0], hi.mV[0]);
+	const __m128 y = _mm_setr_ps(lo.mV[1], lo.mV[1], hi.mV[1], hi.mV[1]);
+	for (U32 half = 0; half < 2; half++)
+	{
+		const __m128 z = _mm_set1_ps(half ? hi.mV[2] : lo.mV[2]);
+		F32* out[4] = { cx + half*4, cy + half*4, cz + half*4, cw + half*4 };
+		for (U32 row = 0; row < 4; row++)
+		{
+			__m128 r = _mm_mul_ps(x, _mm_set1_ps(m[row]));
+			r = _mm_add_ps(r, _mm_mul_ps(y, _mm_set1_ps(m[4+row])));
+			r = _mm_add_ps(r, _mm_mul_ps(z, _mm_set1_ps(m[8+row])));
+			r = _mm_add_ps(r, _mm_set1_ps(m[12+row]));
+			_mm_storeu_ps(out[row], r);
+		}
+	}
+#else
+	for (U32 i = 0; i < 8; i++)
+	{
+		const F32 px = (i & 1) ? hi.mV[0] : lo.mV[0];
+		const F32 py = (i & 2) ? hi.mV[1] : lo.mV[1];
+		const F32 pz = (i & 4) ? hi.mV[2] : lo.mV[2];
+		cx[i] = m[0]*px + m[4]*py + m[8]*pz + m[12];
+		cy[i] = m[1]*px + m[5]*py + m[9]*pz + m[13];
+		cz[i] = m[2]*px + m[6]*py + m[10]*pz + m[14];
+		cw[i] = m[3]*px + m[7]*py + m[11]*pz + m[15];
+	}
+#endif
+
+	// Project to pixels of the captured depth buffer
+	F32 min_x = F32_MAX;
+	F32 min_y = F32_MAX;
+	F32 max_x = -F32_MAX;
+	F32 max_y = -F32_MAX;
+	F32 near_z = F32_MAX;
+	F32 near_x = 0.f;
+	F32 near_y = 0.f;
+	for (U32 i = 0; i < 8; i++)
+	{
+		if (cw[i] < HIZ_MIN_W)
+		{ //box reaches behind the eye
+			return UNKNOWN;
+		}
+		const F32 inv_w = 1.f / cw[i];
+		const F32 px = (cx[i] * inv_w * 0.5f + 0.5f) * mWidth;
+		const F32 py = (cy[i] * inv_w * 0.5f + 0.5f) * mHeight;
+		const F32 pz = cz[i] * inv_w * 0.5f + 0.5f;
+		min_x = llmin(min_x, px);
+		max_x = llmax(max_x, px);
+		min_y = llmin(min_y, py);
+		max_y = llmax(max_y, py);
+		if (pz < near_z)
+		{
+			near_z = pz;
+			near_x = px;
+			near_y = py;
+		}
+	}
+
+	if (max_x < 0.f || max_y < 0.f || min_x >= mWidth || min_y >= mHeight || near_z <= 0.f)
+	{ //off the captured screen or crossing the near plane, nothing to go on
+		return UNKNOWN;
+	}
+
+	const Level& base = mLevels[0];
+	if (near_x >= 0.f && near_y >= 0.f && near_x < mWidth && near_y < mHeight)
+	{ //nearest corner is on screen and in front of everything around it
+		S32 tile = (S32) near_y / TILE_SIZE * base.mWidth + (S32) near_x / TILE_SIZE;
+		if (near_z < base.mMin[tile])
+		{
+			return VISIBLE;
+		}
+	}
+
+	if (min_x < 0.f || min_y < 0.f || max_x >= mWidth || max_y >= mHeight)
+	{ //partly off the captured screen, whatever is out there could show through
+		return UNKNOWN;
+	}
+
+	S32 x0 = (S32) min_x / TILE_SIZE;
+	S32 y0 = (S32) min_y / TILE_SIZE;
+	S32 x1 = (S32) max_x / TILE_SIZE;
+	S32 y1 = (S32) max_y / TILE_SIZE;
+
+	// Coarsest level where the footprint is at most 2x2 texels
+	U32 l = 0;
+	while (l + 1 < mLevels.size() && (x1 - x0 > 1 || y1 - y0 > 1))
+	{
+		x0 >>= 1;
+		y0 >>= 1;
+		x1 >>= 1;
+		y1 >>= 1;
+		l++;
+	}
+
+	const Level& level = mLevels[l];
+	F32 max_z = 0.f;
+	for (S32 y = y0; y <= y1; y++)
+	{
+		for (S32 x = x0; x <= x1; x++)
+		{
+			max_z = llmax(max_z, level.mMax[y * level.mWidth + x]);
+		}
+	}
+
+	return near_z > max_z ? OCCLUDED : UNKNOWN;
+}
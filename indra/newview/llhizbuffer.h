@@ -0,0 +1,115 @@
+/**
+ * @file llhizbuffer.h
+ * @brief Hierarchical depth buffer for CPU side occlusion culling
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLHIZBUFFER_H
+#define LL_LLHIZBUFFER_H
+
+#include <vector>
+
+class LLVector3;
+
+// Min/max depth pyramid built from the depth buffer of a recent frame.
+// Octree nodes are tested against it on the CPU during culling; only the
+// ones it can't decide about need a GL occlusion query.
+//
+// The depth buffer is read back through a pair of pixel buffer objects, so
+// the pyramid lags the screen by two frames.  Boxes are tested with the
+// matrices of the frame the depth came from, which keeps the test
+// consistent with the depth it's reading.
+class LLHiZBuffer
+{
+public:
+	typedef enum
+	{
+		UNKNOWN = 0,	// can't tell, fall back to a GL query
+		OCCLUDED,		// box is behind the captured depth everywhere it covers
+		VISIBLE			// nearest corner of the box is in front of the captured depth
+	} eResult;
+
+	enum
+	{
+		TILE_SIZE = 8,	// pixels folded into each texel of the base level
+		NUM_CAPTURES = 2
+	};
+
+	LLHiZBuffer();
+	~LLHiZBuffer();
+
+	// Queue a read of the depth buffer of the frame just rendered with the
+	// given (column major) matrices.  Call once per frame after the opaque
+	// world has been drawn, before anything that writes depth without
+	// occluding (water, alpha), with the target it was drawn to still bound.
+	void capture(const F64* modelview, const F64* projection);
+
+	// Build the pyramid from the oldest capture.  Call once per frame
+	// before culling the world camera; the pyramid is invalid for the
+	// frame if there's nothing to build from.
+	void update();
+
+	// Free GL resources and invalidate the pyramid
+	void release();
+
+	bool isValid() const						{ return mValid; }
+
+	// center and size (half extents) of an axis aligned box in agent space
+	eResult test(const LLVector3& center, const LLVector3& size) const;
+
+	static U32 sOccludedCount;
+	static U32 sVisibleCount;
+	static U32 sUnknownCount;
+
+private:
+	void build(const F32* depth, S32 width, S32 height);
+
+	struct Capture
+	{
+		U32		mPBO;
+		S32		mWidth;
+		S32		mHeight;
+		U32		mSize;
+		F32		mMatrix[16];	// projection * modelview, column major
+		bool	mPending;
+	};
+
+	struct Level
+	{
+		S32					mWidth;
+		S32					mHeight;
+		std::vector<F32>	mMin;
+		std::vector<F32>	mMax;
+	};
+
+	Capture				mCaptures[NUM_CAPTURES];
+	U32					mNextCapture;
+
+	std::vector<Level>	mLevels;
+	F32					mMatrix[16];
+	S32					mWidth;		// size in pixels of the depth buffer the pyramid was built from
+	S32					mHeight;
+	bool				mValid;
+};
+
+#endif // LL_LLHIZBUFFER_H
@@ -51,6 +51,27 @@ extern LLControlGroup gSavedSettings;				// read only
 //-----------------------------------------------------------------------------
 LLPolyMesh::LLPolyMeshSharedDataTable LLPolyMesh::sGlobalSharedMeshList;
 
+//-----------------------------------------------------------------------------
+// Morphed vertex data kept for meshes that other avatars may have the same
+// shape of, keyed on the mesh and the exact weights of all its morphs
+//-----------------------------------------------------------------------------
+namespace
+{
+	const U32 MORPH_CACHE_MAX_BYTES = 16 << 20;
+
+	typedef std::pair<const LLPolyMeshSharedData*, std::vector<F32> > morph_cache_key_t;
+	struct MorphCacheEntry
+	{
+		std::vector<F32> mVertexData;
+		U32 mLastUsed;
+	};
+	typedef std::map<morph_cache_key_t, MorphCacheEntry> morph_cache_t;
+
+	morph_cache_t sMorphCache;
+	U32 sMorphCacheBytes = 0;
+	U32 sMorphCacheClock = 0;
+}
+
 //-----------------------------------------------------------------------------
 // LLPolyMeshSharedData()
 //-----------------------------------------------------------------------------
@@ -803,10 +824,20 @@ LLPolyMesh *LLPolyMesh::getMesh(const std::string &name, LLPolyMesh* reference_m
 void LLPolyMesh::freeAllMeshes()
 {
 	// delete each item in the global lists
+	clearMorphCache();
 	for_each(sGlobalSharedMeshList.begin(), sGlobalSharedMeshList.end(), DeletePairedPointer());
 	sGlobalSharedMeshList.clear();
 }
 
+//-----------------------------------------------------------------------------
+// LLPolyMesh::clearMorphCache()
+//-----------------------------------------------------------------------------
+void LLPolyMesh::clearMorphCache()
+{
+	sMorphCache.clear();
+	sMorphCacheBytes = 0;
+}
+
 LLPolyMeshSharedData *LLPolyMesh::getSharedData() const
 {
 	return mSharedData;
@@ -930,6 +961,136 @@ void LLPolyMesh::initializeForMorph()
 	memset(mClothingWeights, 0, sizeof(LLVector4) * mSharedData->mNumVertices);
 }
 
+//-----------------------------------------------------------------------------
+// updateNormals()
+//-----------------------------------------------------------------------------
+void LLPolyMesh::updateNormals(const U32* vert_indices, U32 num_indices)
+{
+	for (U32 i = 0; i < num_indices; i++)
+	{
+		U32 vert = vert_indices[i];
+
+		// calculate new normals based on half angles
+		LLVector3 normalized_normal = mScaledNormals[vert];
+		normalized_normal.normVec();
+		mNormals[vert] = normalized_normal;
+
+		// calculate new binormals
+		LLVector3 tangent = mScaledBinormals[vert] % normalized_normal;
+		LLVector3 normalized_binormal = normalized_normal % tangent;
+		normalized_binormal.normVec();
+		mBinormals[vert] = normalized_binormal;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// applyPendingMorphs()
+//-----------------------------------------------------------------------------
+void LLPolyMesh::applyPendingMorphs(BOOL share_shapes)
+{
+	BOOL pending = FALSE;
+	BOOL masked = FALSE;
+	for (std::vector<LLPolyMorphTarget*>::iterator iter = mMorphTargets.begin(); iter != mMorphTargets.end(); ++iter)
+	{
+		pending = pending || (*iter)->getPendingWeight() != 0.f;
+		masked = masked || (*iter)->isMasked();
+	}
+	if (!pending)
+	{
+		return;
+	}
+
+	// A masked morph's offsets depend on a baked texture, not just its weight
+	share_shapes = share_shapes && !masked && mVertexData;
+	U32 num_floats = mSharedData->mNumVertices * (3*5 + 2 + 4);
+
+	morph_cache_key_t key;
+	if (share_shapes)
+	{
+		key.first = mSharedData;
+		key.second.reserve(mMorphTargets.size() + 1);
+		for (std::vector<LLPolyMorphTarget*>::iterator iter = mMorphTargets.begin(); iter != mMorphTargets.end(); ++iter)
+		{
+			LLPolyMorphTarget* morph_target = *iter;
+			key.second.push_back(morph_target->getLastWeight());
+			if (morph_target->isClothingMorph())
+			{
+				key.second.push_back(morph_target->getMovesClothing() ? 1.f : 0.f);
+			}
+		}
+
+		morph_cache_t::iterator found = sMorphCache.find(key);
+		if (found != sMorphCache.end())
+		{
+			memcpy(mVertexData, &found->second.mVertexData[0], num_floats * sizeof(F32));	/*Flawfinder: ignore*/
+			found->second.mLastUsed = ++sMorphCacheClock;
+			for (std::vector<LLPolyMorphTarget*>::iterator iter = mMorphTargets.begin(); iter != mMorphTargets.end(); ++iter)
+			{
+				(*iter)->skipPendingWeight();
+			}
+			return;
+		}
+	}
+
+	// Accumulate every morph first, then renormalize each vertex moved once
+	std::vector<U8> moved(mSharedData->mNumVertices, 0);
+	std::vector<U32> moved_indices;
+	for (std::vector<LLPolyMorphTarget*>::iterator iter = mMorphTargets.begin(); iter != mMorphTargets.end(); ++iter)
+	{
+		LLPolyMorphTarget* morph_target = *iter;
+		F32 delta_weight = morph_target->getPendingWeight();
+		if (delta_weight == 0.f)
+		{
+			continue;
+		}
+		morph_target->skipPendingWeight();
+		morph_target->applyVertexDeltas(delta_weight);
+
+		LLPolyMorphData* morph_data = morph_target->getMorphData();
+		for (U32 i = 0; i < morph_data->mNumIndices; i++)
+		{
+			U32 vert = morph_data->mVertexIndices[i];
+			if (!moved[vert])
+			{
+				moved[vert] = 1;
+				moved_indices.push_back(vert);
+			}
+		}
+	}
+	if (!moved_indices.empty())
+	{
+		updateNormals(&moved_indices[0], moved_indices.size());
+	}
+
+	if (share_shapes)
+	{
+		U32 bytes = num_floats * sizeof(F32);
+		if (bytes > MORPH_CACHE_MAX_BYTES)
+		{
+			return;
+		}
+		// Evict the least recently used shapes to make room
+		while (sMorphCacheBytes + bytes > MORPH_CACHE_MAX_BYTES && !sMorphCache.empty())
+		{
+			morph_cache_t::iterator oldest = sMorphCache.begin();
+			for (morph_cache_t::iterator iter = sMorphCache.begin(); iter != sMorphCache.end(); ++iter)
+			{
+				if (iter->second.mLastUsed < oldest->second.mLastUsed)
+				{
+					oldest = iter;
+				}
+			}
+			sMorphCacheBytes -= oldest->second.mVertexData.size() * sizeof(F32);
+			sMorphCache.erase(oldest);
+		}
+
+		MorphCacheEntry& entry = sMorphCache[key];
+		entry.mVertexData.assign(mVertexData, mVertexData + num_floats);
+		entry.mLastUsed = ++sMorphCacheClock;
+		sMorphCacheBytes += bytes;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // getMorphData()
 //-----------------------------------------------------------------------------
@@ -308,6 +308,19 @@ public:
 	}
 
 	LLPolyMorphData*	getMorphData(const std::string& morph_name);
+	void	addMorphTarget(LLPolyMorphTarget* morph_target) { mMorphTargets.push_back(morph_target); }
+
+	// Brings the mesh up to date with the weights its morph targets took in
+	// an LLPolyMorphBatch. With share_shapes the result may be copied from,
+	// and is remembered for, other meshes of the same shape.
+	void	applyPendingMorphs(BOOL share_shapes);
+
+	// Recomputes the output normals and binormals of the given vertices from
+	// the scaled ones the morph targets accumulate into
+	void	updateNormals(const U32* vert_indices, U32 num_indices);
+
+	// Drops the morphed meshes remembered by applyPendingMorphs()
+	static void clearMorphCache();
 // 	void	removeMorphData(LLPolyMorphData *morph_target);
 // 	void	deleteAllMorphData();
 
@@ -357,6 +370,9 @@ protected:
 	
 	LLPolyMesh				*mReferenceMesh;
 
+	// morph targets moving this mesh, not owned
+	std::vector<LLPolyMorphTarget*> mMorphTargets;
+
 	// global mesh list
 	typedef std::map<std::string, LLPolyMeshSharedData*> LLPolyMeshSharedDataTable; 
 	static LLPolyMeshSharedDataTable sGlobalSharedMeshList;
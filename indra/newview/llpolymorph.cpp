@@ -30,6 +30,7 @@
 #include "llviewerprecompiledheaders.h"
 
 #include "llpolymorph.h"
+#include "llpolymesh.h"
 #include "llvoavatar.h"
 #include "llwearable.h"
 #include "llxmltree.h"
@@ -243,7 +244,9 @@ LLPolyMorphTarget::LLPolyMorphTarget(LLPolyMesh *poly_mesh)
 	: mMorphData(NULL), mMesh(poly_mesh),
 	  mVertMask(NULL),
 	  mLastSex(SEX_FEMALE),
-	  mNumMorphMasksPending(0)
+	  mNumMorphMasksPending(0),
+	  mPendingWeight(0.f),
+	  mMovedClothing(FALSE)
 {
 }
 
@@ -293,6 +296,7 @@ BOOL LLPolyMorphTarget::setInfo(LLPolyMorphTargetInfo* info)
 		llwarns << "No morph target named " << getInfo()->mMorphName << " found in mesh." << llendl;
 		return FALSE;  // Continue, ignoring this tag
 	}
+	mMesh->addMorphTarget(this);
 	return TRUE;
 }
 
@@ -455,54 +459,16 @@ void LLPolyMorphTarget::apply( ESex avatar_sex )
 	if (delta_weight != 0.f)
 	{
 		llassert(!mMesh->isLOD());
-		LLVector3 *coords = mMesh->getWritableCoords();
-
-		LLVector3 *scaled_normals = mMesh->getScaledNormals();
-		LLVector3 *normals = mMesh->getWritableNormals();
-
-		LLVector3 *scaled_binormals = mMesh->getScaledBinormals();
-		LLVector3 *binormals = mMesh->getWritableBinormals();
-
-		LLVector4 *clothing_weights = mMesh->getWritableClothingWeights();
-		LLVector2 *tex_coords = mMesh->getWritableTexCoords();
-
-		F32 *maskWeightArray = (mVertMask) ? mVertMask->getMorphMaskWeights() : NULL;
-
-		for(U32 vert_index_morph = 0; vert_index_morph < mMorphData->mNumIndices; vert_index_morph++)
+		if (LLPolyMorphBatch::isActive())
 		{
-			S32 vert_index_mesh = mMorphData->mVertexIndices[vert_index_morph];
-
-			F32 maskWeight = 1.f;
-			if (maskWeightArray)
-			{
-				maskWeight = maskWeightArray[vert_index_morph];
-			}
-
-			coords[vert_index_mesh] += mMorphData->mCoords[vert_index_morph] * delta_weight * maskWeight;
-			if (getInfo()->mIsClothingMorph && clothing_weights)
-			{
-				LLVector3 clothing_offset = mMorphData->mCoords[vert_index_morph] * delta_weight * maskWeight;
-				LLVector4* clothing_weight = &clothing_weights[vert_index_mesh];
-				clothing_weight->mV[VX] += clothing_offset.mV[VX];
-				clothing_weight->mV[VY] += clothing_offset.mV[VY];
-				clothing_weight->mV[VZ] += clothing_offset.mV[VZ];
-				clothing_weight->mV[VW] = maskWeight;
-			}
-
-			// calculate new normals based on half angles
-			scaled_normals[vert_index_mesh] += mMorphData->mNormals[vert_index_morph] * delta_weight * maskWeight * NORMAL_SOFTEN_FACTOR;
-			LLVector3 normalized_normal = scaled_normals[vert_index_mesh];
-			normalized_normal.normVec();
-			normals[vert_index_mesh] = normalized_normal;
-
-			// calculate new binormals
-			scaled_binormals[vert_index_mesh] += mMorphData->mBinormals[vert_index_morph] * delta_weight * maskWeight * NORMAL_SOFTEN_FACTOR;
-			LLVector3 tangent = scaled_binormals[vert_index_mesh] % normalized_normal;
-			LLVector3 normalized_binormal = normalized_normal % tangent; 
-			normalized_binormal.normVec();
-			binormals[vert_index_mesh] = normalized_binormal;
-
-			tex_coords[vert_index_mesh] += mMorphData->mTexCoords[vert_index_morph] * delta_weight * maskWeight;
+			// the mesh catches up when the batch ends
+			mPendingWeight += delta_weight;
+			LLPolyMorphBatch::addMesh(mMesh);
+		}
+		else
+		{
+			applyVertexDeltas(delta_weight);
+			mMesh->updateNormals(mMorphData->mVertexIndices, mMorphData->mNumIndices);
 		}
 
 		// now apply volume changes
@@ -523,11 +489,63 @@ void LLPolyMorphTarget::apply( ESex avatar_sex )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// applyVertexDeltas()
+//-----------------------------------------------------------------------------
+void LLPolyMorphTarget::applyVertexDeltas(F32 delta_weight)
+{
+	LLVector3 *coords = mMesh->getWritableCoords();
+	LLVector3 *scaled_normals = mMesh->getScaledNormals();
+	LLVector3 *scaled_binormals = mMesh->getScaledBinormals();
+	LLVector2 *tex_coords = mMesh->getWritableTexCoords();
+	LLVector4 *clothing_weights = getInfo()->mIsClothingMorph ? mMesh->getWritableClothingWeights() : NULL;
+
+	F32 *maskWeightArray = (mVertMask) ? mVertMask->getMorphMaskWeights() : NULL;
+
+	for(U32 vert_index_morph = 0; vert_index_morph < mMorphData->mNumIndices; vert_index_morph++)
+	{
+		S32 vert_index_mesh = mMorphData->mVertexIndices[vert_index_morph];
+
+		F32 maskWeight = 1.f;
+		if (maskWeightArray)
+		{
+			maskWeight = maskWeightArray[vert_index_morph];
+		}
+		F32 weight = delta_weight * maskWeight;
+
+		LLVector3 offset = mMorphData->mCoords[vert_index_morph] * weight;
+		coords[vert_index_mesh] += offset;
+		if (clothing_weights)
+		{
+			LLVector4* clothing_weight = &clothing_weights[vert_index_mesh];
+			clothing_weight->mV[VX] += offset.mV[VX];
+			clothing_weight->mV[VY] += offset.mV[VY];
+			clothing_weight->mV[VZ] += offset.mV[VZ];
+			clothing_weight->mV[VW] = maskWeight;
+		}
+
+		// normals are renormalized from these based on half angles
+		F32 normal_weight = weight * NORMAL_SOFTEN_FACTOR;
+		scaled_normals[vert_index_mesh] += mMorphData->mNormals[vert_index_morph] * normal_weight;
+		scaled_binormals[vert_index_mesh] += mMorphData->mBinormals[vert_index_morph] * normal_weight;
+
+		tex_coords[vert_index_mesh] += mMorphData->mTexCoords[vert_index_morph] * weight;
+	}
+
+	if (clothing_weights)
+	{
+		mMovedClothing = TRUE;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // applyMask()
 //-----------------------------------------------------------------------------
 void	LLPolyMorphTarget::applyMask(U8 *maskTextureData, S32 width, S32 height, S32 num_components, BOOL invert)
 {
+	// the code below undoes what the mesh has of this morph
+	mMesh->applyPendingMorphs(FALSE);
+
 	LLVector4 *clothing_weights = getInfo()->mIsClothingMorph ? mMesh->getWritableClothingWeights() : NULL;
 
 	if (!mVertMask)
@@ -662,3 +680,39 @@ F32* LLPolyVertexMask::getMorphMaskWeights()
 	
 	return mWeights;
 }
+
+//-----------------------------------------------------------------------------
+// LLPolyMorphBatch
+//-----------------------------------------------------------------------------
+S32 LLPolyMorphBatch::sDepth = 0;
+BOOL LLPolyMorphBatch::sShareShapes = FALSE;
+std::vector<LLPolyMesh*> LLPolyMorphBatch::sMeshes;
+
+LLPolyMorphBatch::LLPolyMorphBatch(BOOL share_shapes)
+{
+	if (sDepth++ == 0)
+	{
+		sShareShapes = share_shapes;
+	}
+}
+
+LLPolyMorphBatch::~LLPolyMorphBatch()
+{
+	if (--sDepth == 0)
+	{
+		for (std::vector<LLPolyMesh*>::iterator iter = sMeshes.begin(); iter != sMeshes.end(); ++iter)
+		{
+			(*iter)->applyPendingMorphs(sShareShapes);
+		}
+		sMeshes.clear();
+	}
+}
+
+//static
+void LLPolyMorphBatch::addMesh(LLPolyMesh* mesh)
+{
+	if (std::find(sMeshes.begin(), sMeshes.end(), mesh) == sMeshes.end())
+	{
+		sMeshes.push_back(mesh);
+	}
+}
@@ -32,6 +32,7 @@
 
 #include "llviewervisualparam.h"
 
+class LLPolyMesh;
 class LLPolyMeshSharedData;
 class LLVOAvatar;
 class LLVector2;
@@ -165,6 +166,23 @@ public:
 	void	applyMask(U8 *maskData, S32 width, S32 height, S32 num_components, BOOL invert);
 	void	addPendingMorphMask() { mNumMorphMasksPending++; }
 
+	// Moves the vertices of the mesh by delta_weight of the morph, leaving
+	// the output normals to LLPolyMesh::updateNormals()
+	void	applyVertexDeltas(F32 delta_weight);
+
+	// Weight applied in an LLPolyMorphBatch that the mesh has not caught up with
+	F32		getPendingWeight() const { return mPendingWeight; }
+	// The mesh got the pending weight some other way, by copying a mesh of the same shape
+	void	skipPendingWeight() { mMovedClothing = getMovesClothing(); mPendingWeight = 0.f; }
+
+	LLPolyMorphData* getMorphData() const { return mMorphData; }
+	BOOL	isClothingMorph() const { return getInfo()->mIsClothingMorph; }
+	// Masked morphs move the mesh by an amount that depends on a texture
+	BOOL	isMasked() const { return mVertMask || mNumMorphMasksPending > 0; }
+	// A clothing morph marks the vertices it moved even after going back to 0,
+	// TRUE once it has or will when the pending weight is applied
+	BOOL	getMovesClothing() const { return mMovedClothing || (isClothingMorph() && mPendingWeight != 0.f); }
+
 protected:
 	LLPolyMorphData*				mMorphData;
 	LLPolyMesh*						mMesh;
@@ -172,10 +190,35 @@ protected:
 	ESex							mLastSex;
 	// number of morph masks that haven't been generated, must be 0 before this morph is applied
 	BOOL							mNumMorphMasksPending;	
+	F32								mPendingWeight;
+	BOOL							mMovedClothing;
 
 	typedef std::vector<LLPolyVolumeMorph> volume_list_t;
 	volume_list_t 					mVolumeMorphs;
 
 };
 
+//-----------------------------------------------------------------------------
+// LLPolyMorphBatch
+// While one exists LLPolyMorphTarget::apply() only records the weights.  When
+// the outermost one goes away each mesh moved takes all of its morphs in one
+// go and renormalizes every vertex once, instead of once per morph moving it.
+// With share_shapes, a mesh morphed to the same shape as another avatar's
+// copies that result instead, see LLPolyMesh::applyPendingMorphs().
+//-----------------------------------------------------------------------------
+class LLPolyMorphBatch
+{
+public:
+	LLPolyMorphBatch(BOOL share_shapes);
+	~LLPolyMorphBatch();
+
+	static BOOL isActive() { return sDepth > 0; }
+	static void addMesh(LLPolyMesh* mesh);
+
+private:
+	static S32 sDepth;
+	static BOOL sShareShapes;
+	static std::vector<LLPolyMesh*> sMeshes;
+};
+
 #endif // LL_LLPOLYMORPH_H
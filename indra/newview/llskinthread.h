@@ -0,0 +1,54 @@
+/**
+ * @file llskinthread.h
+ * @brief Skins avatar meshes on the shared thread pool
+ *
+ * $LicenseInfo:firstyear=2010&license=viewerlgpl$
+ * Second Life Viewer Source Code
+ * Copyright (C) 2010, Linden Research, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation;
+ * version 2.1 of the License only.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+ * $/LicenseInfo$
+ */
+
+#ifndef LL_LLSKINTHREAD_H
+#define LL_LLSKINTHREAD_H
+
+#include <vector>
+
+#include "llparallelforthread.h"
+
+struct LLSkinJob;
+
+// Runs LLViewerJointMesh::skin() for the meshes of every avatar skinned in a
+// frame on the workers of the shared LLThreadPool, with the main thread
+// taking jobs too.
+class LLSkinThread : public LLParallelForThread
+{
+public:
+	LLSkinThread();
+
+	// MAIN thread. Runs every job and returns once all of them are done.
+	void skin(std::vector<LLSkinJob>& jobs);
+
+protected:
+	/*virtual*/ void processItem(S32 index);
+
+private:
+	std::vector<LLSkinJob>* mJobs; // NULL between batches
+};
+
+#endif // LL_LLSKINTHREAD_H
@@ -45,6 +45,7 @@
 
 static LLFastTimer::DeclareTimer FTM_FRUSTUM_CULL("Frustum Culling");
 static LLFastTimer::DeclareTimer FTM_CULL_REBOUND("Cull Rebound");
+static LLFastTimer::DeclareTimer FTM_HIZ_TEST("HiZ Occlusion");
 
 const F32 SG_OCCLUSION_FUDGE = 0.25f;
 #define SG_DISCARD_TOLERANCE 0.01f
@@ -83,6 +84,9 @@ protected:
 
 static LLOcclusionQueryPool sQueryPool;
 
+//groups with a query pending, per camera, see LLSpatialGroup::fetchQueryResults
+static std::vector<LLSpatialGroup*> sPendingQueries[LLViewerCamera::NUM_CAMERAS];
+
 //static counter for frame to switch LOD on
 
 void sg_assert(BOOL expr)
@@ -293,6 +297,19 @@ LLSpatialGroup::~LLSpatialGroup()
 		sQueryPool.release(mOcclusionQuery[LLViewerCamera::sCurCameraID]);
 	}
 
+	for (U32 i = 0; i < LLViewerCamera::NUM_CAMERAS; i++)
+	{
+		if (mOcclusionState[i] & QUERY_LISTED)
+		{
+			std::vector<LLSpatialGroup*>& pending = sPendingQueries[i];
+			std::vector<LLSpatialGroup*>::iterator iter = std::find(pending.begin(), pending.end(), this);
+			if (iter != pending.end())
+			{
+				pending.erase(iter);
+			}
+		}
+	}
+
 	delete [] mOcclusionVerts;
 	mOcclusionVerts = NULL;
 
@@ -1504,21 +1521,25 @@ BOOL LLSpatialGroup::rebound()
 }
 
 static LLFastTimer::DeclareTimer FTM_OCCLUSION_READBACK("Readback Occlusion");
-void LLSpatialGroup::checkOcclusion()
+void LLSpatialGroup::checkOcclusion(BOOL use_gl)
 {
 	if (LLPipeline::sUseOcclusion > 1)
 	{
-		LLFastTimer t(FTM_OCCLUSION_READBACK);
 		LLSpatialGroup* parent = getParent();
 		if (parent && parent->isOcclusionState(LLSpatialGroup::OCCLUDED))
 		{	//if the parent has been marked as occluded, the child is implicitly occluded
-			clearOcclusionState(QUERY_PENDING | DISCARD_QUERY);
+			clearOcclusionState(QUERY_PENDING | DISCARD_QUERY | QUERY_FETCHED | QUERY_PASSED);
 		}
 		else if (isOcclusionState(QUERY_PENDING))
 		{	//otherwise, if a query is pending, read it back
 			GLuint res = 1;
-			if (!isOcclusionState(DISCARD_QUERY) && mOcclusionQuery[LLViewerCamera::sCurCameraID])
+			if (isOcclusionState(QUERY_FETCHED))
+			{
+				res = isOcclusionState(QUERY_PASSED) ? 1 : 0;
+			}
+			else if (use_gl && !isOcclusionState(DISCARD_QUERY) && mOcclusionQuery[LLViewerCamera::sCurCameraID])
 			{
+				LLFastTimer t(FTM_OCCLUSION_READBACK);
 				glGetQueryObjectuivARB(mOcclusionQuery[LLViewerCamera::sCurCameraID], GL_QUERY_RESULT_ARB, &res);	
 			}
 
@@ -1540,7 +1561,7 @@ void LLSpatialGroup::checkOcclusion()
 				assert_states_valid(this);
 			}
 
-			clearOcclusionState(QUERY_PENDING | DISCARD_QUERY);
+			clearOcclusionState(QUERY_PENDING | DISCARD_QUERY | QUERY_FETCHED | QUERY_PASSED);
 		}
 		else if (mSpatialPartition->isOcclusionEnabled() && isOcclusionState(LLSpatialGroup::OCCLUDED))
 		{	//check occlusion has been issued for occluded node that has not had a query issued
@@ -1613,9 +1634,49 @@ void LLSpatialGroup::doOcclusion(LLCamera* camera)
 			}
 
 			setOcclusionState(LLSpatialGroup::QUERY_PENDING);
-			clearOcclusionState(LLSpatialGroup::DISCARD_QUERY);
+			clearOcclusionState(LLSpatialGroup::DISCARD_QUERY | LLSpatialGroup::QUERY_FETCHED | LLSpatialGroup::QUERY_PASSED);
+
+			if (!isOcclusionState(LLSpatialGroup::QUERY_LISTED))
+			{
+				sPendingQueries[LLViewerCamera::sCurCameraID].push_back(this);
+				setOcclusionState(LLSpatialGroup::QUERY_LISTED);
+			}
+		}
+	}
+}
+
+//static
+void LLSpatialGroup::fetchQueryResults()
+{
+	LLFastTimer t(FTM_OCCLUSION_READBACK);
+	std::vector<LLSpatialGroup*>& pending = sPendingQueries[LLViewerCamera::sCurCameraID];
+	for (std::vector<LLSpatialGroup*>::iterator iter = pending.begin(); iter != pending.end(); ++iter)
+	{
+		LLSpatialGroup* group = *iter;
+		group->clearOcclusionState(QUERY_LISTED);
+
+		GLuint query = group->mOcclusionQuery[LLViewerCamera::sCurCameraID];
+		if (group->isOcclusionState(QUERY_PENDING) && 
+			!group->isOcclusionState(DISCARD_QUERY | QUERY_FETCHED) && 
+			query)
+		{
+			GLuint res = 1;
+			glGetQueryObjectuivARB(query, GL_QUERY_RESULT_ARB, &res);
+			group->setOcclusionState(res > 0 ? QUERY_FETCHED | QUERY_PASSED : QUERY_FETCHED);
 		}
 	}
+	pending.clear();
+}
+
+//static
+void LLSpatialGroup::clearQueryResults()
+{
+	std::vector<LLSpatialGroup*>& pending = sPendingQueries[LLViewerCamera::sCurCameraID];
+	for (std::vector<LLSpatialGroup*>::iterator iter = pending.begin(); iter != pending.end(); ++iter)
+	{
+		(*iter)->clearOcclusionState(QUERY_LISTED);
+	}
+	pending.clear();
 }
 
 //==============================================
@@ -1758,21 +1819,86 @@ void LLSpatialPartition::shift(const LLVector3 &offset)
 	shifter.traverse(mOctree);
 }
 
+//test a group against the depth pyramid of a recent frame
+static LLHiZBuffer::eResult hiz_test(LLSpatialGroup* group)
+{
+	LLSpatialPartition* part = group->mSpatialPartition;
+	if (LLPipeline::sUseOcclusion < 2 ||
+		LLViewerCamera::sCurCameraID != LLViewerCamera::CAMERA_WORLD ||
+		LLPipeline::sShadowRender ||
+		LLPipeline::sReflectionRender ||
+		!gPipeline.mHiZBuffer.isValid() ||
+		!group->mOctreeNode->getParent() ||	//never occlusion cull the root node
+		!part->isOcclusionEnabled() ||
+		part->isBridge() ||						//bridged groups are in the bridge's frame, not the agent's
+		part->mDrawableType == LLDrawPool::POOL_WATER ||
+		part->mDrawableType == LLDrawPool::POOL_VOIDWATER)
+	{
+		return LLHiZBuffer::UNKNOWN;
+	}
+
+	LLVector3 size = group->mBounds[1] + LLVector3(SG_OCCLUSION_FUDGE, SG_OCCLUSION_FUDGE, SG_OCCLUSION_FUDGE);
+	return gPipeline.mHiZBuffer.test(group->mBounds[0], size);
+}
+
+static void count_hiz_result(U32 result)
+{
+	switch (result)
+	{
+		case LLHiZBuffer::OCCLUDED:
+			LLHiZBuffer::sOccludedCount++;
+			break;
+		case LLHiZBuffer::VISIBLE:
+			LLHiZBuffer::sVisibleCount++;
+			break;
+		default:
+			LLHiZBuffer::sUnknownCount++;
+			break;
+	}
+}
+
 class LLOctreeCull : public LLSpatialGroup::OctreeTraveler
 {
 public:
-	LLOctreeCull(LLCamera* camera)
-		: mCamera(camera), mRes(0) { }
+	//with a shard, this runs on a cull worker and records what the main thread must do
+	LLOctreeCull(LLCamera* camera, LLCullShard* shard = NULL)
+		: mCamera(camera), mShard(shard), mRes(0), mHiZResult(LLHiZBuffer::UNKNOWN) { }
 
 	virtual bool earlyFail(LLSpatialGroup* group)
 	{
-		group->checkOcclusion();
+		group->checkOcclusion(mShard == NULL);
 
 		if (group->mOctreeNode->getParent() &&	//never occlusion cull the root node
 		  	LLPipeline::sUseOcclusion &&			//ignore occlusion if disabled
 			group->isOcclusionState(LLSpatialGroup::OCCLUDED))
 		{
-			gPipeline.markOccluder(group);
+			if (mShard)
+			{
+				mShard->push(LLCullShard::MARK_OCCLUDER, group);
+			}
+			else
+			{
+				gPipeline.markOccluder(group);
+			}
+			return true;
+		}
+
+		//the pyramid decides most groups without a GL query, an occluded
+		//group is tested again next frame against fresher depth
+		if (mShard)
+		{
+			mHiZResult = hiz_test(group);
+			mShard->countHiZ(mHiZResult);
+		}
+		else
+		{
+			LLFastTimer t(FTM_HIZ_TEST);
+			mHiZResult = hiz_test(group);
+			count_hiz_result(mHiZResult);
+		}
+
+		if (mHiZResult == LLHiZBuffer::OCCLUDED)
+		{
 			return true;
 		}
 		
@@ -1851,12 +1977,29 @@ public:
 	
 	virtual void processGroup(LLSpatialGroup* group)
 	{
-		if (group->needsUpdate() ||
-			group->mVisible[LLViewerCamera::sCurCameraID] < LLDrawable::getCurrentFrame() - 1)
+		//visit() follows earlyFail() for the same group, so mHiZResult is this group's
+		if (mHiZResult != LLHiZBuffer::VISIBLE &&
+			(group->needsUpdate() ||
+			 group->mVisible[LLViewerCamera::sCurCameraID] < LLDrawable::getCurrentFrame() - 1))
 		{
-			group->doOcclusion(mCamera);
+			if (mShard)
+			{
+				mShard->push(LLCullShard::DO_OCCLUSION, group);
+			}
+			else
+			{
+				group->doOcclusion(mCamera);
+			}
+		}
+
+		if (mShard)
+		{
+			mShard->push(LLCullShard::MARK_NOT_CULLED, group);
+		}
+		else
+		{
+			gPipeline.markNotCulled(group, *mCamera);
 		}
-		gPipeline.markNotCulled(group, *mCamera);
 	}
 	
 	virtual void visit(const LLSpatialGroup::OctreeNode* branch) 
@@ -1872,14 +2015,16 @@ public:
 	}
 
 	LLCamera *mCamera;
+	LLCullShard* mShard;
 	S32 mRes;
+	LLHiZBuffer::eResult mHiZResult;
 };
 
 class LLOctreeCullNoFarClip : public LLOctreeCull
 {
 public: 
-	LLOctreeCullNoFarClip(LLCamera* camera) 
-		: LLOctreeCull(camera) { }
+	LLOctreeCullNoFarClip(LLCamera* camera, LLCullShard* shard = NULL) 
+		: LLOctreeCull(camera, shard) { }
 
 	virtual S32 frustumCheck(const LLSpatialGroup* group)
 	{
@@ -1896,8 +2041,8 @@ public:
 class LLOctreeCullShadow : public LLOctreeCull
 {
 public:
-	LLOctreeCullShadow(LLCamera* camera)
-		: LLOctreeCull(camera) { }
+	LLOctreeCullShadow(LLCamera* camera, LLCullShard* shard = NULL)
+		: LLOctreeCull(camera, shard) { }
 
 	virtual S32 frustumCheck(const LLSpatialGroup* group)
 	{
@@ -2192,6 +2337,25 @@ BOOL LLSpatialPartition::visibleObjectsInFrustum(LLCamera& camera)
 	return vis.mResult;
 }
 
+static void cull_octree(LLSpatialPartition* part, LLCamera& camera, LLCullShard* shard)
+{
+	if (LLPipeline::sShadowRender)
+	{
+		LLOctreeCullShadow culler(&camera, shard);
+		culler.traverse(part->mOctree);
+	}
+	else if (part->mInfiniteFarClip || !LLPipeline::sUseFarClip)
+	{
+		LLOctreeCullNoFarClip culler(&camera, shard);
+		culler.traverse(part->mOctree);
+	}
+	else
+	{
+		LLOctreeCull culler(&camera, shard);
+		culler.traverse(part->mOctree);
+	}
+}
+
 S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* results, BOOL for_select)
 {
 	LLMemType mt(LLMemType::MTYPE_SPACE_PARTITION);
@@ -2214,28 +2378,61 @@ S32 LLSpatialPartition::cull(LLCamera &camera, std::vector<LLDrawable *>* result
 		LLOctreeSelect selecter(&camera, results);
 		selecter.traverse(mOctree);
 	}
-	else if (LLPipeline::sShadowRender)
-	{
-		LLFastTimer ftm(FTM_FRUSTUM_CULL);
-		LLOctreeCullShadow culler(&camera);
-		culler.traverse(mOctree);
-	}
-	else if (mInfiniteFarClip || !LLPipeline::sUseFarClip)
-	{
-		LLFastTimer ftm(FTM_FRUSTUM_CULL);		
-		LLOctreeCullNoFarClip culler(&camera);
-		culler.traverse(mOctree);
-	}
 	else
 	{
-		LLFastTimer ftm(FTM_FRUSTUM_CULL);		
-		LLOctreeCull culler(&camera);
-		culler.traverse(mOctree);
+		LLFastTimer ftm(FTM_FRUSTUM_CULL);
+		cull_octree(this, camera, NULL);
 	}
 	
 	return 0;
 }
 
+// CULL WORKER. No fast timers or memory types here, they aren't thread safe.
+void LLSpatialPartition::cull(LLCullShard& shard)
+{
+	LLSpatialGroup* group = (LLSpatialGroup*) mOctree->getListener(0);
+	group->rebound();
+	cull_octree(this, *shard.mCamera, &shard);
+}
+
+void LLCullShard::set(LLSpatialPartition* part, LLCamera* camera)
+{
+	clear();
+	mPartition = part;
+	mCamera = camera;
+}
+
+void LLCullShard::clear()
+{
+	mOps.clear();
+	mHiZCount[0] = mHiZCount[1] = mHiZCount[2] = 0;
+}
+
+void LLCullShard::replay()
+{
+	for (std::vector<Op>::iterator iter = mOps.begin(); iter != mOps.end(); ++iter)
+	{
+		LLSpatialGroup* group = iter->mGroup;
+		switch (iter->mOp)
+		{
+			case MARK_OCCLUDER:
+				gPipeline.markOccluder(group);
+				break;
+			case DO_OCCLUSION:
+				group->doOcclusion(mCamera);
+				break;
+			default:
+				gPipeline.markNotCulled(group, *mCamera);
+				break;
+		}
+	}
+
+	LLHiZBuffer::sUnknownCount += mHiZCount[LLHiZBuffer::UNKNOWN];
+	LLHiZBuffer::sOccludedCount += mHiZCount[LLHiZBuffer::OCCLUDED];
+	LLHiZBuffer::sVisibleCount += mHiZCount[LLHiZBuffer::VISIBLE];
+	clear();
+}
+
 BOOL earlyFail(LLCamera* camera, LLSpatialGroup* group)
 {
 	if (camera->getOrigin().isExactlyZero())
@@ -3392,7 +3589,9 @@ LLDrawInfo::LLDrawInfo(U16 start, U16 end, U32 count, U32 offset,
 	mGroup(NULL),
 	mFace(NULL),
 	mDistance(0.f),
-	mDrawMode(LLRender::TRIANGLES)
+	mDrawMode(LLRender::TRIANGLES),
+	mAtlasMerges(0),
+	mAtlasSource(NULL)
 {
 	mDebugColor = (rand() << 16) + rand();
 	if (mStart >= mVertexBuffer->getRequestedVerts() ||
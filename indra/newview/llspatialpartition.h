@@ -47,6 +47,7 @@
 
 class LLSpatialPartition;
 class LLSpatialBridge;
+class LLCullShard;
 class LLSpatialGroup;
 class LLTextureAtlas;
 class LLTextureAtlasSlot;
@@ -88,6 +89,8 @@ public:
 	F32 mDistance;
 	LLVector3 mExtents[2];
 	U32 mDrawMode;
+	U32 mAtlasMerges; //draw calls saved by merging faces of different textures that share an atlas
+	const LLViewerTexture* mAtlasSource; //texture of the last face merged in, while building
 
 	struct CompareTexture
 	{
@@ -205,6 +208,9 @@ public:
 		ACTIVE_OCCLUSION		= 0x00040000,
 		DISCARD_QUERY			= 0x00080000,
 		EARLY_FAIL				= 0x00100000,
+		QUERY_LISTED			= 0x00200000,	//in the list fetchQueryResults() reads back
+		QUERY_FETCHED			= 0x00400000,	//result of the pending query was read back ahead of culling
+		QUERY_PASSED			= 0x00800000,	//fetched result had samples pass
 	} eOcclusionState;
 
 	typedef enum
@@ -267,8 +273,13 @@ public:
 	void unbound();
 	BOOL rebound();
 	void buildOcclusion(); //rebuild mOcclusionVerts
-	void checkOcclusion(); //read back last occlusion query (if any)
+	void checkOcclusion(BOOL use_gl = TRUE); //read back last occlusion query (if any), without use_gl only fetched results are used
 	void doOcclusion(LLCamera* camera); //issue occlusion query
+
+	//read back every query pending for the current camera, so culling can check occlusion off the main thread
+	static void fetchQueryResults();
+	//forget about the queries pending for the current camera, checkOcclusion() reads them back as it goes
+	static void clearQueryResults();
 	void destroyGL();
 	
 	void updateDistance(LLCamera& camera);
@@ -408,6 +419,7 @@ public:
 
 	BOOL visibleObjectsInFrustum(LLCamera& camera);
 	S32 cull(LLCamera &camera, std::vector<LLDrawable *>* results = NULL, BOOL for_select = FALSE); // Cull on arbitrary frustum
+	void cull(LLCullShard& shard); // Cull on a worker thread, see LLCullShard
 	
 	BOOL isVisible(const LLVector3& v);
 	
@@ -542,6 +554,46 @@ private:
 };
 
 
+// The cull of one partition done on a worker thread.  Traversing the octree,
+// testing the frustum and checking fetched occlusion results are safe off the
+// main thread, but marking groups visible or occluders and issuing GL queries
+// are not.  The worker records those in traversal order instead, and the main
+// thread replays them partition by partition, so the cull result comes out
+// exactly as if the partitions had been culled one after another.
+class LLCullShard
+{
+public:
+	typedef enum
+	{
+		MARK_OCCLUDER = 0,	// LLPipeline::markOccluder
+		DO_OCCLUSION,		// LLSpatialGroup::doOcclusion
+		MARK_NOT_CULLED		// LLPipeline::markNotCulled
+	} eOp;
+
+	LLCullShard() : mPartition(NULL), mCamera(NULL) { clear(); }
+
+	void set(LLSpatialPartition* part, LLCamera* camera);
+	void clear();
+	void push(eOp op, LLSpatialGroup* group)	{ mOps.push_back(Op(op, group)); }
+	void countHiZ(U32 result)					{ mHiZCount[result]++; }
+
+	// MAIN thread, after the cull finished
+	void replay();
+
+	LLSpatialPartition* mPartition;
+	LLCamera* mCamera; // copy of the culling camera with the clip plane of the partition's region
+
+private:
+	struct Op
+	{
+		Op(eOp op, LLSpatialGroup* group) : mOp(op), mGroup(group) { }
+		eOp mOp;
+		LLSpatialGroup* mGroup;
+	};
+	std::vector<Op> mOps;
+	U32 mHiZCount[3];
+};
+
 //spatial partition for water (implemented in LLVOWater.cpp)
 class LLWaterPartition : public LLSpatialPartition
 {
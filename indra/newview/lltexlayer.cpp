@@ -29,6 +29,7 @@
 #include "lltexlayer.h"
 
 #include "llagent.h"
+#include "llbakeuploadqueue.h"
 #include "llimagej2c.h"
 #include "llimagetga.h"
 #include "llnotificationsutil.h"
@@ -97,7 +98,8 @@ LLBakedUploadData::LLBakedUploadData(const LLVOAvatarSelf* avatar,
 	mAvatar(avatar),
 	mTexLayerSet(layerset),
 	mID(id),
-	mStartTime(LLFrameTimer::getTotalTime())		// Record starting time
+	mStartTime(LLFrameTimer::getTotalTime()),		// Record starting time
+	mBakeStartTime(mStartTime)
 { 
 }
 
@@ -115,6 +117,8 @@ LLTexLayerSetBuffer::LLTexLayerSetBuffer(LLTexLayerSet* const owner,
 	LLViewerDynamicTexture( width, height, 4, LLViewerDynamicTexture::ORDER_LAST, TRUE ), 
 	mUploadPending(FALSE), // Not used for any logic here, just to sync sending of updates
 	mNeedsUpload(FALSE),
+	mBakeInFlight(FALSE),
+	mBakeStale(FALSE),
 	mNumLowresUploads(0),
 	mNeedsUpdate(TRUE),
 	mNumLowresUpdates(0),
@@ -128,6 +132,7 @@ LLTexLayerSetBuffer::LLTexLayerSetBuffer(LLTexLayerSet* const owner,
 LLTexLayerSetBuffer::~LLTexLayerSetBuffer()
 {
 	LLTexLayerSetBuffer::sGLByteCount -= getSize();
+	abandonBake();
 	destroyGLTexture();
 	for( S32 order = 0; order < ORDER_COUNT; order++ )
 	{
@@ -150,6 +155,13 @@ void LLTexLayerSetBuffer::restoreGLTexture()
 //virtual 
 void LLTexLayerSetBuffer::destroyGLTexture() 
 {
+	// The read back goes with the GL context, bake again once it is back
+	if (mBakeInFlight && LLBakeUploadQueue::getInstance())
+	{
+		LLBakeUploadQueue::getInstance()->removeBuffer(this);
+		mBakeInFlight = FALSE;
+		mBakeStale = FALSE;
+	}
 	LLViewerDynamicTexture::destroyGLTexture() ;
 }
 
@@ -167,6 +179,7 @@ void LLTexLayerSetBuffer::requestUpdate()
 	// If we're in the middle of uploading a baked texture, we don't care about it any more.
 	// When it's downloaded, ignore it.
 	mUploadID.setNull();
+	mBakeStale = mBakeInFlight;
 }
 
 void LLTexLayerSetBuffer::requestUpload()
@@ -175,6 +188,7 @@ void LLTexLayerSetBuffer::requestUpload()
 	mNeedsUpload = TRUE;
 	mNumLowresUploads = 0;
 	mUploadPending = TRUE;
+	mBakeStale = mBakeInFlight;
 }
 
 void LLTexLayerSetBuffer::conditionalRestartUploadTimer()
@@ -204,6 +218,17 @@ void LLTexLayerSetBuffer::cancelUpload()
 	mNeedsUpload = FALSE;
 	mUploadPending = FALSE;
 	mNeedsUploadTimer.pause();
+	mBakeStale = mBakeInFlight;
+}
+
+void LLTexLayerSetBuffer::abandonBake()
+{
+	if (mBakeInFlight && LLBakeUploadQueue::getInstance())
+	{
+		LLBakeUploadQueue::getInstance()->removeBuffer(this);
+	}
+	mBakeInFlight = FALSE;
+	mBakeStale = FALSE;
 }
 
 void LLTexLayerSetBuffer::pushProjection() const
@@ -354,6 +379,7 @@ BOOL LLTexLayerSetBuffer::uploadInProgress() const
 BOOL LLTexLayerSetBuffer::isReadyToUpload() const
 {
 	if (!gAgentQueryManager.hasNoPendingQueries()) return FALSE; // Can't upload if there are pending queries.
+	if (mBakeInFlight) return FALSE; // Wait for the bake we already started.
 	if (isAgentAvatarValid() && !gAgentAvatarp->isUsingBakedTextures()) return FALSE; // Don't upload if avatar is using composites.
 
 	// If we requested an upload and have the final LOD ready, then upload.
@@ -425,41 +451,44 @@ void LLTexLayerSetBuffer::doUpload()
 	// until this image is sent to the server and the Avatar Appearance message is received.)
 	mTexLayerSet->deleteCaches();
 
-	// Get the COLOR information from our texture
-	U8* baked_color_data = new U8[ mFullWidth * mFullHeight * 4 ];
-	glReadPixels(mOrigin.mX, mOrigin.mY, mFullWidth, mFullHeight, GL_RGBA, GL_UNSIGNED_BYTE, baked_color_data );
-	stop_glerror();
+	LLBakeUploadQueue* queue = LLBakeUploadQueue::getInstance();
+	if (!queue)
+	{
+		return;
+	}
 
-	// Get the MASK information from our texture
-	LLGLSUIDefault gls_ui;
+	// Start reading back the COLOR information from our texture.  The queue
+	// hands the encoded bake to finishUpload() a few frames from now.
 	LLPointer<LLImageRaw> baked_mask_image = new LLImageRaw(mFullWidth, mFullHeight, 1 );
+	queue->addBake(this, mOrigin.mX, mOrigin.mY, mFullWidth, mFullHeight, baked_mask_image);
+	mBakeInFlight = TRUE;
+	mBakeStale = FALSE;
+
+	// Get the MASK information from our texture.  This renders over the
+	// composite, the read back started before it still gets the colors.
+	LLGLSUIDefault gls_ui;
 	U8* baked_mask_data = baked_mask_image->getData(); 
 	mTexLayerSet->gatherMorphMaskAlpha(baked_mask_data, mFullWidth, mFullHeight);
+}
 
-
-	// Create the baked image from our color and mask information
-	const S32 baked_image_components = 5; // red green blue [bump] clothing
-	LLPointer<LLImageRaw> baked_image = new LLImageRaw( mFullWidth, mFullHeight, baked_image_components );
-	U8* baked_image_data = baked_image->getData();
-	S32 i = 0;
-	for (S32 u=0; u < mFullWidth; u++)
+void LLTexLayerSetBuffer::finishUpload(LLImageJ2C* encoded, U64 bake_start_time, F32 readback_time, F32 encode_time)
+{
+	mBakeInFlight = FALSE;
+	if (mBakeStale)
 	{
-		for (S32 v=0; v < mFullHeight; v++)
-		{
-			baked_image_data[5*i + 0] = baked_color_data[4*i + 0];
-			baked_image_data[5*i + 1] = baked_color_data[4*i + 1];
-			baked_image_data[5*i + 2] = baked_color_data[4*i + 2];
-			baked_image_data[5*i + 3] = baked_color_data[4*i + 3]; // alpha should be correct for eyelashes.
-			baked_image_data[5*i + 4] = baked_mask_data[i];
-			i++;
-		}
+		// Appearance changed while this was baking, render it again
+		mBakeStale = FALSE;
+		llinfos << "Dropped out of date bake of " << mTexLayerSet->getBodyRegionName() << llendl;
+		return;
 	}
-	
-	LLPointer<LLImageJ2C> compressedImage = new LLImageJ2C;
-	compressedImage->setRate(0.f);
-	const char* comment_text = LINDEN_J2C_COMMENT_PREFIX "RGBHM"; // writes into baked_color_data. 5 channels (rgb, heightfield/alpha, mask)
-	if (compressedImage->encode(baked_image, comment_text))
+
+	LLPointer<LLImageJ2C> compressedImage = encoded;
+	if (compressedImage.notNull())
 	{
+		llinfos << "Baked " << mTexLayerSet->getBodyRegionName() << " read back in " << (S32)(readback_time * 1000.f)
+				<< " ms, encoded in " << (S32)(encode_time * 1000.f) << " ms, "
+				<< (S32)((LLFrameTimer::getTotalTime() - bake_start_time) / 1000) << " ms after rendering" << llendl;
+
 		LLTransactionID tid;
 		tid.generate();
 		const LLAssetID asset_id = tid.makeAssetID(gAgent.getSecureSessionID());
@@ -486,6 +515,7 @@ void LLTexLayerSetBuffer::doUpload()
 				LLBakedUploadData* baked_upload_data = new LLBakedUploadData(gAgentAvatarp, 
 																			 this->mTexLayerSet, 
 																			 asset_id);
+				baked_upload_data->mBakeStartTime = bake_start_time;
 				// upload ID is used to avoid overlaps, e.g. when the user rapidly makes two changes outside of Face Edit.
 				mUploadID = asset_id;
 
@@ -552,12 +582,9 @@ void LLTexLayerSetBuffer::doUpload()
 	}
 	else
 	{
-		// The VFS write file operation failed.
-		mUploadPending = FALSE;
-		llinfos << "Unable to create baked upload file (reason: failed to write file)" << llendl;
+		// The read back or the encode failed, try again on a later frame.
+		llinfos << "Unable to create baked upload file (reason: failed to encode)" << llendl;
 	}
-
-	delete [] baked_color_data;
 }
 
 // Mostly bookkeeping; don't need to actually "do" anything since
@@ -632,7 +659,8 @@ void LLTexLayerSetBuffer::onTextureUploadComplete(const LLUUID& uuid,
 				LLVOAvatarDefines::ETextureIndex baked_te = gAgentAvatarp->getBakedTE(layerset_buffer->mTexLayerSet);
 				// Update baked texture info with the new UUID
 				U64 now = LLFrameTimer::getTotalTime();		// Record starting time
-				llinfos << "Baked texture upload took " << (S32)((now - baked_upload_data->mStartTime) / 1000) << " ms" << llendl;
+				llinfos << "Baked texture upload took " << (S32)((now - baked_upload_data->mStartTime) / 1000) << " ms, "
+						<< (S32)((now - baked_upload_data->mBakeStartTime) / 1000) << " ms since the bake was rendered" << llendl;
 				gAgentAvatarp->setNewBakedTexture(baked_te, uuid);
 			}
 			else
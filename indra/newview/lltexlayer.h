@@ -36,6 +36,7 @@ class LLVOAvatar;
 class LLVOAvatarSelf;
 class LLImageTGA;
 class LLImageRaw;
+class LLImageJ2C;
 class LLXmlTreeNode;
 class LLTexLayerSet;
 class LLTexLayerSetInfo;
@@ -304,10 +305,18 @@ public:
 													S32 result, LLExtStat ext_status);
 protected:
 	BOOL					isReadyToUpload() const;
-	void					doUpload(); 					// Does a read back and upload.
+	void					doUpload(); 					// Starts the read back, the upload follows in finishUpload().
 	void					conditionalRestartUploadTimer();
+	void					abandonBake();
 private:
+	friend class LLBakeUploadQueue;
+	// Called by LLBakeUploadQueue with the bake doUpload() started, encoded
+	// is NULL if that failed.  Times are from when the composite was rendered.
+	void					finishUpload(LLImageJ2C* encoded, U64 bake_start_time, F32 readback_time, F32 encode_time);
+
 	BOOL					mNeedsUpload; 					// Whether we need to send our baked textures to the server
+	BOOL					mBakeInFlight;					// Whether a bake is being read back or encoded
+	BOOL					mBakeStale;						// Whether the bake in flight is out of date
 	U32						mNumLowresUploads; 				// Number of times we've sent a lowres version of our baked textures to the server
 	BOOL					mUploadPending; 				// Whether we have received back the new baked textures
 	LLUUID					mUploadID; 						// The current upload process (null if none).
@@ -369,6 +378,7 @@ struct LLBakedUploadData
 	const LLVOAvatarSelf*		mAvatar; // note: backlink only; don't LLPointer 
 	LLTexLayerSet*				mTexLayerSet;
    	const U64					mStartTime;	// for measuring baked texture upload time
+	U64							mBakeStartTime;	// when the composite was rendered
 };
 
 #endif  // LL_LLTEXLAYER_H
@@ -33,7 +33,7 @@
 #include "lltextureatlas.h"
 
 //-------------------
-S16 LLTextureAtlas::sMaxSubTextureSize = 64 ;
+S16 LLTextureAtlas::sMaxSubTextureSize = 128 ;
 S16 LLTextureAtlas::sSlotSize = 32 ;
 
 #ifndef DEBUG_ATLAS
@@ -57,6 +57,19 @@ LLTextureAtlas::LLTextureAtlas(U8 ncomponents, S16 atlas_dim) :
 	LLPointer<LLImageRaw> image_raw = new LLImageRaw(mFullWidth, mFullHeight, mComponents);
 	createGLTexture(0, image_raw, 0);
 	image_raw = NULL;
+
+	//stop the mip chain while a slot still covers a few texels, below that
+	//every sub-texture would bleed into its neighbours.
+	if(getTexName() && gGL.getTexUnit(0)->bindManual(LLTexUnit::TT_TEXTURE, getTexName()))
+	{
+		S32 max_level = 0 ;
+		for(S32 size = sSlotSize ; size > 4 ; size >>= 1)
+		{
+			max_level++ ;
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max_level);
+		gGL.getTexUnit(0)->unbind(LLTexUnit::TT_TEXTURE) ;
+	}
 }
 
 LLTextureAtlas::~LLTextureAtlas() 
@@ -74,16 +87,18 @@ S8 LLTextureAtlas::getType() const
 	return LLViewerTexture::ATLAS_TEXTURE ;
 }
 
+//tex coords [0, 1] map to the centers of the first and the last texels of the sub-texture,
+//so bilinear filtering at the edges does not pick up the neighbouring slots.
 void LLTextureAtlas::getTexCoordOffset(S16 col, S16 row, F32& xoffset, F32& yoffset)
 {
-	xoffset = (F32)col / mAtlasDim ;
-	yoffset = (F32)row / mAtlasDim ;	
+	xoffset = ((F32)col * sSlotSize + 0.5f) / (mAtlasDim * sSlotSize) ;
+	yoffset = ((F32)row * sSlotSize + 0.5f) / (mAtlasDim * sSlotSize) ;	
 }
 
 void LLTextureAtlas::getTexCoordScale(S32 w, S32 h, F32& xscale, F32& yscale)
 {
-	xscale = (F32)w / (mAtlasDim * sSlotSize) ;
-	yscale = (F32)h / (mAtlasDim * sSlotSize) ;	
+	xscale = (F32)(w - 1) / (mAtlasDim * sSlotSize) ;
+	yscale = (F32)(h - 1) / (mAtlasDim * sSlotSize) ;	
 }
 
 //insert a texture piece into the atlas
@@ -28,27 +28,25 @@
 
 #include "lltexturecache.h"
 
+#include "apr_mmap.h"
+
 #include "llapr.h"
 #include "lldir.h"
 #include "llimage.h"
 #include "lllfsthread.h"
-#include "llviewercontrol.h"
-
-// Included to allow LLTextureCache::purgeTextures() to pause watchdog timeout
-#include "llappviewer.h" 
 
 // Cache organization:
-// cache/texture.entries
-//  Unordered array of Entry structs
-// cache/texture.cache
-//  First TEXTURE_CACHE_ENTRY_SIZE bytes of each texture in texture.entries in same order
-// cache/textures/[0-F]/UUID.texture
-//  Actual texture body files
+// cache/texturecache/texture.index
+//  IndexHeader followed by a hash table of Entry structs, memory mapped
+// cache/texturecache/texture.[0-63].slab
+//  Texture data packed back to back, each texture stored whole
 
 //note: there is no good to define 1024 for TEXTURE_CACHE_ENTRY_SIZE while FIRST_PACKET_SIZE is 600 on sim side.
 const S32 TEXTURE_CACHE_ENTRY_SIZE = FIRST_PACKET_SIZE;//1024;
-const F32 TEXTURE_CACHE_PURGE_AMOUNT = .20f; // % amount to reduce the cache by when it exceeds its limit
-const F32 TEXTURE_CACHE_LRU_SIZE = .10f; // % amount for LRU list (low overhead to regenerate)
+const U32 TEXTURE_CACHE_SLAB_SIZE = 32*1024*1024; // preferred slab size, smaller slabs recycle less at once
+const U32 TEXTURE_CACHE_MIN_SLABS = 4;
+const U32 TEXTURE_CACHE_MIN_CAPACITY = 1024;
+const U32 TEXTURE_CACHE_INDEX_VERSION = 1;
 
 class LLTextureCacheWorker : public LLWorkerClass
 {
@@ -297,8 +295,7 @@ private:
 		INIT = 0,
 		LOCAL = 1,
 		CACHE = 2,
-		HEADER = 3,
-		BODY = 4
+		BODY = 3
 	};
 
 	e_state mState;
@@ -310,15 +307,15 @@ void LLTextureCacheWorker::startWork(S32 param)
 {
 }
 
-// This is where a texture is read from the cache system (header and body)
+// This is where a texture is read from the cache system (index and slab)
 // Current assumption are:
 // - the whole data are in a raw form, will be stored at mReadData
-// - the size of this raw data is mDataSize and can be smaller than TEXTURE_CACHE_ENTRY_SIZE (the size of a record in the header cache)
+// - the size of this raw data is mDataSize, 0 means everything cached
 // - the code supports offset reading but this is actually never exercised in the viewer
 bool LLTextureCacheRemoteWorker::doRead()
 {
 	bool done = false;
-	S32 idx = -1;
+	LLTextureCache::Entry entry;
 
 	S32 local_size = 0;
 	std::string local_filename;
@@ -393,12 +390,10 @@ bool LLTextureCacheRemoteWorker::doRead()
 		done = true;
 	}
 
-	// Second state / stage : identify the cache or not...
+	// Third state / stage : look the texture up in the index
 	if (!done && (mState == CACHE))
 	{
-		LLTextureCache::Entry entry ;
-		idx = mCache->getHeaderCacheEntry(mID, entry);
-		if (idx < 0)
+		if (!mCache->lookupEntry(mID, entry))
 		{
 			// The texture is *not* cached. We're done here...
 			mDataSize = 0; // no data 
@@ -406,112 +401,48 @@ bool LLTextureCacheRemoteWorker::doRead()
 		}
 		else
 		{
-			mImageSize = entry.mImageSize ;
-			// If the read offset is bigger than the header cache, we read directly from the body
-			// Note that currently, we *never* read with offset from the cache, so the result is *always* HEADER
-			mState = mOffset < TEXTURE_CACHE_ENTRY_SIZE ? HEADER : BODY;
-		}
-	}
-
-	// Third state / stage : read data from the header cache (texture.entries) file
-	if (!done && (mState == HEADER))
-	{
-		llassert_always(idx >= 0);	// we need an entry here or reading the header makes no sense
-		llassert_always(mOffset < TEXTURE_CACHE_ENTRY_SIZE);
-		S32 offset = idx * TEXTURE_CACHE_ENTRY_SIZE + mOffset;
-		// Compute the size we need to read (in bytes)
-		S32 size = TEXTURE_CACHE_ENTRY_SIZE - mOffset;
-		size = llmin(size, mDataSize);
-		// Allocate the read buffer
-		mReadData = new U8[size];
-		S32 bytes_read = LLAPRFile::readEx(mCache->mHeaderDataFileName, 
-											 mReadData, offset, size, mCache->getLocalAPRFilePool());
-		if (bytes_read != size)
-		{
-			llwarns << "LLTextureCacheWorker: "  << mID
-					<< " incorrect number of bytes read from header: " << bytes_read
-					<< " / " << size << llendl;
-			delete[] mReadData;
-			mReadData = NULL;
-			mDataSize = -1; // failed
-			done = true;
-		}
-		// If we already read all we expected, we're actually done
-		if (mDataSize <= bytes_read)
-		{
-			done = true;
-		}
-		else
-		{
+			mImageSize = entry.mImageSize;
 			mState = BODY;
 		}
 	}
 
-	// Fourth state / stage : read the rest of the data from the UUID based cached file
+	// Fourth state / stage : read the data from its slab
 	if (!done && (mState == BODY))
 	{
-		std::string filename = mCache->getTextureFileName(mID);
-		S32 filesize = LLAPRFile::size(filename, mCache->getLocalAPRFilePool());
-
-		if (filesize && (filesize + TEXTURE_CACHE_ENTRY_SIZE) > mOffset)
+		S32 available = entry.mDataSize - mOffset;
+		if (available <= 0)
 		{
-			S32 max_datasize = TEXTURE_CACHE_ENTRY_SIZE + filesize - mOffset;
-			mDataSize = llmin(max_datasize, mDataSize);
-
-			S32 data_offset, file_size, file_offset;
-			
-			// Reserve the whole data buffer first
-			U8* data = new U8[mDataSize];
-
-			// Set the data file pointers taking the read offset into account. 2 cases:
-			if (mOffset < TEXTURE_CACHE_ENTRY_SIZE)
-			{
-				// Offset within the header record. That means we read something from the header cache.
-				// Note: most common case is (mOffset = 0), so this is the "normal" code path.
-				data_offset = TEXTURE_CACHE_ENTRY_SIZE - mOffset;	// i.e. TEXTURE_CACHE_ENTRY_SIZE if mOffset nul (common case)
-				file_offset = 0;
-				file_size = mDataSize - data_offset;
-				// Copy the raw data we've been holding from the header cache into the new sized buffer
-				llassert_always(mReadData);
-				memcpy(data, mReadData, data_offset);
-				delete[] mReadData;
-				mReadData = NULL;
-			}
-			else
+			// Nothing cached past the offset
+			mDataSize = 0;
+		}
+		else
+		{
+			if (!mDataSize || mDataSize > available)
 			{
-				// Offset bigger than the header record. That means we haven't read anything yet.
-				data_offset = 0;
-				file_offset = mOffset - TEXTURE_CACHE_ENTRY_SIZE;
-				file_size = mDataSize;
-				// No data from header cache to copy in that case, we skipped it all
+				mDataSize = available;
 			}
-
-			// Now use that buffer as the object read buffer
-			llassert_always(mReadData == NULL);
-			mReadData = data;
-
-			// Read the data at last
+			mReadData = new U8[mDataSize];
+			std::string filename = mCache->getSlabFileName(entry.mSlab);
 			S32 bytes_read = LLAPRFile::readEx(filename, 
-											 mReadData + data_offset,
-											 file_offset, file_size,
+											 mReadData, entry.mOffset + mOffset, mDataSize,
 											 mCache->getLocalAPRFilePool());
-			if (bytes_read != file_size)
+			if (bytes_read != mDataSize)
 			{
 				llwarns << "LLTextureCacheWorker: "  << mID
-						<< " incorrect number of bytes read from body: " << bytes_read
-						<< " / " << file_size << llendl;
+						<< " incorrect number of bytes read from slab: " << bytes_read
+						<< " / " << mDataSize << llendl;
 				delete[] mReadData;
 				mReadData = NULL;
 				mDataSize = -1; // failed
-				done = true;
+			}
+			else if (!mCache->isEntryCurrent(entry))
+			{
+				// The slab was recycled while we were reading it
+				delete[] mReadData;
+				mReadData = NULL;
+				mDataSize = 0;
 			}
 		}
-		else
-		{
-			// No body, we're done.
-			mDataSize = llmax(TEXTURE_CACHE_ENTRY_SIZE - mOffset, 0);
-			lldebugs << "No body file for: " << filename << llendl;
-		}	
 		// Nothing else to do at that point...
 		done = true;
 	}
@@ -520,15 +451,14 @@ bool LLTextureCacheRemoteWorker::doRead()
 	return done;
 }
 
-// This is where *everything* about a texture is written down in the cache system (entry map, header and body)
+// This is where *everything* about a texture is written down in the cache system (index entry and data)
 // Current assumption are:
 // - the whole data are in a raw form, starting at mWriteData
-// - the size of this raw data is mDataSize and can be smaller than TEXTURE_CACHE_ENTRY_SIZE (the size of a record in the header cache)
 // - the code *does not* support offset writing so there are no difference between buffer addresses and start of data
 bool LLTextureCacheRemoteWorker::doWrite()
 {
 	bool done = false;
-	S32 idx = -1;	
+	LLTextureCache::Entry entry;
 
 	// First state / stage : check that what we're trying to cache is in an OK shape
 	if (mState == INIT)
@@ -541,112 +471,37 @@ bool LLTextureCacheRemoteWorker::doWrite()
 	
 	// No LOCAL state for write(): because it doesn't make much sense to cache a local file...
 
-	// Second state / stage : set an entry in the headers entry (texture.entries) file
+	// Second state / stage : reserve room for the data in a slab
 	if (!done && (mState == CACHE))
 	{
-		bool alreadyCached = false;
-		LLTextureCache::Entry entry ;
-
-		// Checks if this image is already in the entry list
-		idx = mCache->getHeaderCacheEntry(mID, entry);
-		if(idx < 0)
-		{
-			idx = mCache->setHeaderCacheEntry(mID, entry, mImageSize, mDataSize); // create the new entry.
-		}
-		else
-		{
-			alreadyCached = mCache->updateEntry(idx, entry, mImageSize, mDataSize); // update the existing entry.
-		}
-
-		if (idx < 0)
+		if (!mCache->reserveEntry(mID, mImageSize, mDataSize, entry))
 		{
-			llwarns << "LLTextureCacheWorker: "  << mID
-					<< " Unable to create header entry for writing!" << llendl;
-			mDataSize = -1; // failed
+			// Already cached with at least this much data, or the cache is
+			// full of writes in flight. Either way there is nothing to write.
 			done = true;
 		}
 		else
 		{
-			if (alreadyCached && (mDataSize <= TEXTURE_CACHE_ENTRY_SIZE))
-			{
-				// Small texture already cached case: we're done with writing
-				done = true;
-			}
-			else
-			{
-				// If the texture has already been cached, we don't resave the header and go directly to the body part
-				mState = alreadyCached ? BODY : HEADER;
-			}
+			mState = BODY;
 		}
 	}
 
-	// Third stage / state : write the header record in the header file (texture.cache)
-	if (!done && (mState == HEADER))
+	// Third stage / state : write the data and publish the index entry
+	if (!done && (mState == BODY))
 	{
-		llassert_always(idx >= 0);	// we need an entry here or storing the header makes no sense
-		S32 offset = idx * TEXTURE_CACHE_ENTRY_SIZE;	// skip to the correct spot in the header file
-		S32 size = TEXTURE_CACHE_ENTRY_SIZE;			// record size is fixed for the header
-		S32 bytes_written;
-
-		if (mDataSize < TEXTURE_CACHE_ENTRY_SIZE)
-		{
-			// We need to write a full record in the header cache so, if the amount of data is smaller
-			// than a record, we need to transfer the data to a buffer padded with 0 and write that
-			U8* padBuffer = new U8[TEXTURE_CACHE_ENTRY_SIZE];
-			memset(padBuffer, 0, TEXTURE_CACHE_ENTRY_SIZE);		// Init with zeros
-			memcpy(padBuffer, mWriteData, mDataSize);			// Copy the write buffer
-			bytes_written = LLAPRFile::writeEx(mCache->mHeaderDataFileName, padBuffer, offset, size, mCache->getLocalAPRFilePool());
-			delete [] padBuffer;
-		}
-		else
-		{
-			// Write the header record (== first TEXTURE_CACHE_ENTRY_SIZE bytes of the raw file) in the header file
-			bytes_written = LLAPRFile::writeEx(mCache->mHeaderDataFileName, mWriteData, offset, size, mCache->getLocalAPRFilePool());
-		}
-
-		if (bytes_written <= 0)
+		std::string filename = mCache->getSlabFileName(entry.mSlab);
+		S32 bytes_written = LLAPRFile::writeEx(filename, mWriteData,
+											   entry.mOffset, mDataSize,
+											   mCache->getLocalAPRFilePool());
+		bool success = (bytes_written == mDataSize);
+		if (!success)
 		{
 			llwarns << "LLTextureCacheWorker: "  << mID
-					<< " Unable to write header entry!" << llendl;
+					<< " incorrect number of bytes written to slab: " << bytes_written
+					<< " / " << mDataSize << llendl;
 			mDataSize = -1; // failed
-			done = true;
-		}
-
-		// If we wrote everything (may be more with padding) in the header cache, 
-		// we're done so we don't have a body to store
-		if (mDataSize <= bytes_written)
-		{
-			done = true;
-		}
-		else
-		{
-			mState = BODY;
-		}
-	}
-	
-	// Fourth stage / state : write the body file, i.e. the rest of the texture in a "UUID" file name
-	if (!done && (mState == BODY))
-	{
-		llassert(mDataSize > TEXTURE_CACHE_ENTRY_SIZE);	// wouldn't make sense to be here otherwise...
-		S32 file_size = mDataSize - TEXTURE_CACHE_ENTRY_SIZE;
-		
-		{
-			// build the cache file name from the UUID
-			std::string filename = mCache->getTextureFileName(mID);			
-// 			llinfos << "Writing Body: " << filename << " Bytes: " << file_offset+file_size << llendl;
-			S32 bytes_written = LLAPRFile::writeEx(	filename, 
-													mWriteData + TEXTURE_CACHE_ENTRY_SIZE,
-													0, file_size,
-													mCache->getLocalAPRFilePool());
-			if (bytes_written <= 0)
-			{
-				llwarns << "LLTextureCacheWorker: "  << mID
-						<< " incorrect number of bytes written to body: " << bytes_written
-						<< " / " << file_size << llendl;
-				mDataSize = -1; // failed
-				done = true;
-			}
 		}
+		mCache->commitEntry(entry, success);
 		
 		// Nothing else to do at that point...
 		done = true;
@@ -737,17 +592,22 @@ LLTextureCache::LLTextureCache(bool threaded)
 	  mWorkersMutex(NULL),
 	  mHeaderMutex(NULL),
 	  mListMutex(NULL),
-	  mHeaderAPRFile(NULL),
 	  mReadOnly(TRUE), //do not allow to change the texture cache until setReadOnly() is called.
-	  mTexturesSizeTotal(0),
-	  mDoPurge(FALSE)
+	  mIndexPool(NULL),
+	  mIndexFile(NULL),
+	  mIndexMap(NULL),
+	  mIndexHeader(NULL),
+	  mEntries(NULL),
+	  mTexturesSizeTotal(0)
 {
+	memset(mSlabWrites, 0, sizeof(mSlabWrites));
 }
 
 LLTextureCache::~LLTextureCache()
 {
 	clearDeleteList() ;
-	writeUpdatedEntries() ;
+	LLMutexLock lock(&mHeaderMutex);
+	closeIndex();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -755,9 +615,6 @@ LLTextureCache::~LLTextureCache()
 //virtual
 S32 LLTextureCache::update(U32 max_time_ms)
 {
-	static LLFrameTimer timer ;
-	static const F32 MAX_TIME_INTERVAL = 300.f ; //seconds.
-
 	S32 res;
 	res = LLWorkerThread::update(max_time_ms);
 
@@ -793,12 +650,6 @@ S32 LLTextureCache::update(U32 max_time_ms)
 		responder->completed(success);
 	}
 	
-	if(!res && timer.getElapsedTimeF32() > MAX_TIME_INTERVAL)
-	{
-		timer.reset() ;
-		writeUpdatedEntries() ;
-	}
-
 	return res;
 }
 
@@ -813,21 +664,16 @@ std::string LLTextureCache::getLocalFileName(const LLUUID& id)
 	return filename;
 }
 
-std::string LLTextureCache::getTextureFileName(const LLUUID& id)
+std::string LLTextureCache::getSlabFileName(S32 slab)
 {
-	std::string idstr = id.asString();
-	std::string delem = gDirUtilp->getDirDelimiter();
-	std::string filename = mTexturesDirName + delem + idstr[0] + delem + idstr + ".texture";
-	return filename;
+	return mTexturesDirName + gDirUtilp->getDirDelimiter() + llformat("texture.%d.slab", slab);
 }
 
 //debug
 BOOL LLTextureCache::isInCache(const LLUUID& id) 
 {
 	LLMutexLock lock(&mHeaderMutex);
-	id_map_t::const_iterator iter = mHeaderIDMap.find(id);
-	
-	return (iter != mHeaderIDMap.end()) ;
+	return (mIndexHeader && findSlot(id) >= 0) ;
 }
 
 //debug
@@ -873,9 +719,9 @@ BOOL LLTextureCache::isInLocal(const LLUUID& id)
 
 //static
 const S32 MAX_REASONABLE_FILE_SIZE = 512*1024*1024; // 512 MB
-F32 LLTextureCache::sHeaderCacheVersion = 1.4f;
 U32 LLTextureCache::sCacheMaxEntries = MAX_REASONABLE_FILE_SIZE / TEXTURE_CACHE_ENTRY_SIZE;
 S64 LLTextureCache::sCacheMaxTexturesSize = 0; // no limit
+const char* index_filename = "texture.index";
 const char* entries_filename = "texture.entries";
 const char* cache_filename = "texture.cache";
 const char* old_textures_dirname = "textures";
@@ -884,10 +730,7 @@ const char* textures_dirname = "texturecache";
 
 void LLTextureCache::setDirNames(ELLPath location)
 {
-	std::string delem = gDirUtilp->getDirDelimiter();
-
-	mHeaderEntriesFileName = gDirUtilp->getExpandedFilename(location, textures_dirname, entries_filename);
-	mHeaderDataFileName = gDirUtilp->getExpandedFilename(location, textures_dirname, cache_filename);
+	mIndexFileName = gDirUtilp->getExpandedFilename(location, textures_dirname, index_filename);
 	mTexturesDirName = gDirUtilp->getExpandedFilename(location, textures_dirname);
 }
 
@@ -898,7 +741,6 @@ void LLTextureCache::purgeCache(ELLPath location)
 	if (!mReadOnly)
 	{
 		setDirNames(location);
-		llassert_always(mHeaderAPRFile == NULL);
 
 		//remove the legacy cache if exists
 		std::string texture_dir = mTexturesDirName ;
@@ -931,19 +773,31 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 {
 	llassert_always(getPending() == 0) ; //should not start accessing the texture cache before initialized.
 
+	// Index: keep the hash table at most half full
 	S64 header_size = (max_size * 2) / 10;
 	S64 max_entries = header_size / TEXTURE_CACHE_ENTRY_SIZE;
 	sCacheMaxEntries = (S32)(llmin((S64)sCacheMaxEntries, max_entries));
-	header_size = sCacheMaxEntries * TEXTURE_CACHE_ENTRY_SIZE;
+	U32 capacity = TEXTURE_CACHE_MIN_CAPACITY;
+	while (capacity < sCacheMaxEntries * 2)
+	{
+		capacity <<= 1;
+	}
+	header_size = (S64)sizeof(IndexHeader) + (S64)capacity * sizeof(Entry);
 	max_size -= header_size;
 	if (sCacheMaxTexturesSize > 0)
 		sCacheMaxTexturesSize = llmin(sCacheMaxTexturesSize, max_size);
 	else
 		sCacheMaxTexturesSize = max_size;
 	max_size -= sCacheMaxTexturesSize;
+
+	// Slabs
+	U32 slab_count = llclamp((U32)(sCacheMaxTexturesSize / TEXTURE_CACHE_SLAB_SIZE), TEXTURE_CACHE_MIN_SLABS, (U32)MAX_SLABS);
+	U32 slab_size = (U32)(sCacheMaxTexturesSize / slab_count);
 	
 	LL_INFOS("TextureCache") << "Headers: " << sCacheMaxEntries
-			<< " Textures size: " << sCacheMaxTexturesSize/(1024*1024) << " MB" << LL_ENDL;
+			<< " Index: " << header_size/1024 << " KB"
+			<< " Textures size: " << sCacheMaxTexturesSize/(1024*1024) << " MB"
+			<< " in " << slab_count << " slabs" << LL_ENDL;
 
 	setDirNames(location);
 	
@@ -962,16 +816,17 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 	if (!mReadOnly)
 	{
 		LLFile::mkdir(mTexturesDirName);
-		
-		const char* subdirs = "0123456789abcdef";
-		for (S32 i=0; i<16; i++)
-		{
-			std::string dirname = mTexturesDirName + gDirUtilp->getDirDelimiter() + subdirs[i];
-			LLFile::mkdir(dirname);
-		}
 	}
-	readHeaderCache();
-	purgeTextures(true); // calc mTexturesSize and make some room in the texture cache if we need it
+
+	// Only the index header is looked at here, so this doesn't depend on
+	// the number of textures cached.
+	LLMutexLock lock(&mHeaderMutex);
+	if (!openIndex(capacity, slab_count, slab_size) && !mReadOnly)
+	{
+		// Missing, damaged, or sized for a different cache size
+		purgeAllTextures(false);
+		resetIndex(capacity, slab_count, slab_size);
+	}
 
 	llassert_always(getPending() == 0) ; //should not start accessing the texture cache before initialized.
 
@@ -981,679 +836,321 @@ S64 LLTextureCache::initCache(ELLPath location, S64 max_size, BOOL texture_cache
 //----------------------------------------------------------------------------
 // mHeaderMutex must be locked for the following functions!
 
-LLAPRFile* LLTextureCache::openHeaderEntriesFile(bool readonly, S32 offset)
+// Opens the existing index, false if it doesn't match the given layout
+bool LLTextureCache::openIndex(U32 capacity, U32 slab_count, U32 slab_size)
 {
-	llassert_always(mHeaderAPRFile == NULL);
-	apr_int32_t flags = readonly ? APR_READ|APR_BINARY : APR_READ|APR_WRITE|APR_BINARY;
-	mHeaderAPRFile = new LLAPRFile(mHeaderEntriesFileName, flags, getLocalAPRFilePool());
-	if(offset > 0)
-	{
-		mHeaderAPRFile->seek(APR_SET, offset);
-	}
-	return mHeaderAPRFile;
-}
+	closeIndex();
 
-void LLTextureCache::closeHeaderEntriesFile()
-{
-	if(!mHeaderAPRFile)
+	S32 size = (S32)sizeof(IndexHeader) + (S32)(capacity * sizeof(Entry));
+	if (LLAPRFile::size(mIndexFileName, getLocalAPRFilePool()) != size)
 	{
-		return ;
+		return false;
 	}
-
-	delete mHeaderAPRFile;
-	mHeaderAPRFile = NULL;
-}
-
-void LLTextureCache::readEntriesHeader()
-{
-	// mHeaderEntriesInfo initializes to default values so safe not to read it
-	llassert_always(mHeaderAPRFile == NULL);
-	if (LLAPRFile::isExist(mHeaderEntriesFileName, getLocalAPRFilePool()))
+	if (!mapIndexFile(size, false))
 	{
-		LLAPRFile::readEx(mHeaderEntriesFileName, (U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
-						  getLocalAPRFilePool());
+		return false;
 	}
-	else //create an empty entries header.
+	if (mIndexHeader->mMagic != INDEX_MAGIC ||
+		mIndexHeader->mVersion != TEXTURE_CACHE_INDEX_VERSION ||
+		mIndexHeader->mCapacity != capacity ||
+		mIndexHeader->mSlabCount != slab_count ||
+		mIndexHeader->mSlabSize != slab_size ||
+		mIndexHeader->mCurrentSlab >= slab_count)
 	{
-		mHeaderEntriesInfo.mVersion = sHeaderCacheVersion ;
-		mHeaderEntriesInfo.mEntries = 0 ;
-		writeEntriesHeader() ;
+		closeIndex();
+		return false;
 	}
-}
 
-void LLTextureCache::writeEntriesHeader()
-{
-	llassert_always(mHeaderAPRFile == NULL);
-	if (!mReadOnly)
+	mTexturesSizeTotal = 0;
+	for (U32 slab = 0; slab < slab_count; slab++)
 	{
-		LLAPRFile::writeEx(mHeaderEntriesFileName, (U8*)&mHeaderEntriesInfo, 0, sizeof(EntriesInfo),
-						   getLocalAPRFilePool());
+		mTexturesSizeTotal += mIndexHeader->mSlabs[slab].mLive;
 	}
+	LL_INFOS("TextureCache") << "TEXTURE CACHE: " << mIndexHeader->mEntries << " entries, "
+			<< mTexturesSizeTotal / (1024*1024) << " MB" << LL_ENDL;
+	return true;
 }
 
-//mHeaderMutex is locked before calling this.
-S32 LLTextureCache::openAndReadEntry(const LLUUID& id, Entry& entry, bool create)
+// Creates an empty index
+void LLTextureCache::resetIndex(U32 capacity, U32 slab_count, U32 slab_size)
 {
-	S32 idx = -1;
-	
-	id_map_t::iterator iter1 = mHeaderIDMap.find(id);
-	if (iter1 != mHeaderIDMap.end())
+	closeIndex();
+	mTexturesSizeTotal = 0;
+	if (mReadOnly)
 	{
-		idx = iter1->second;
+		return;
 	}
 
-	if (idx < 0)
-	{
-		if (create && !mReadOnly)
-		{
-			if (mHeaderEntriesInfo.mEntries < sCacheMaxEntries)
-			{
-				// Add an entry to the end of the list
-				idx = mHeaderEntriesInfo.mEntries++;
-
-			}
-			else if (!mFreeList.empty())
-			{
-				idx = *(mFreeList.begin());
-				mFreeList.erase(mFreeList.begin());
-			}
-			else
-			{
-				// Look for a still valid entry in the LRU
-				for (std::set<LLUUID>::iterator iter2 = mLRU.begin(); iter2 != mLRU.end();)
-				{
-					std::set<LLUUID>::iterator curiter2 = iter2++;
-					LLUUID oldid = *curiter2;
-					// Erase entry from LRU regardless
-					mLRU.erase(curiter2);
-					// Look up entry and use it if it is valid
-					id_map_t::iterator iter3 = mHeaderIDMap.find(oldid);
-					if (iter3 != mHeaderIDMap.end() && iter3->second >= 0)
-					{
-						idx = iter3->second;
-						removeCachedTexture(oldid) ;//remove the existing cached texture to release the entry index.
-						break;
-					}
-				}
-				// if (idx < 0) at this point, we will rebuild the LRU 
-				//  and retry if called from setHeaderCacheEntry(),
-				//  otherwise this shouldn't happen and will trigger an error
-			}
-			if (idx >= 0)
-			{
-				entry.mID = id ;
-				entry.mImageSize = -1 ; //mark it is a brand-new entry.					
-				entry.mBodySize = 0 ;
-			}
-		}
-	}
-	else
+	S32 size = (S32)sizeof(IndexHeader) + (S32)(capacity * sizeof(Entry));
+	if (!mapIndexFile(size, true))
 	{
-		// Remove this entry from the LRU if it exists
-		mLRU.erase(id);
-		// Read the entry
-		idx_entry_map_t::iterator iter = mUpdatedEntryMap.find(idx) ;
-		if(iter != mUpdatedEntryMap.end())
-		{
-			entry = iter->second ;
-		}
-		else
-		{
-			readEntryFromHeaderImmediately(idx, entry) ;
-		}
-		if(entry.mImageSize <= entry.mBodySize)//it happens on 64-bit systems, do not know why
-		{
-			llwarns << "corrupted entry: " << id << " entry image size: " << entry.mImageSize << " entry body size: " << entry.mBodySize << llendl ;
-
-			//erase this entry and the cached texture from the cache.
-			std::string tex_filename = getTextureFileName(id);
-			removeEntry(idx, entry, tex_filename) ;
-			mUpdatedEntryMap.erase(idx) ;
-			idx = -1 ;
-		}
+		llwarns << "Unable to create texture cache index " << mIndexFileName << llendl;
+		return;
 	}
-	return idx;
+	// The file was truncated and extended, so the table is all SLOT_EMPTY
+	memset(mIndexHeader, 0, sizeof(IndexHeader));
+	mIndexHeader->mVersion = TEXTURE_CACHE_INDEX_VERSION;
+	mIndexHeader->mCapacity = capacity;
+	mIndexHeader->mSlabCount = slab_count;
+	mIndexHeader->mSlabSize = slab_size;
+	mIndexHeader->mMagic = INDEX_MAGIC;
 }
 
-//mHeaderMutex is locked before calling this.
-void LLTextureCache::writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool write_header)
-{	
-	LLAPRFile* aprfile ;
-	S32 bytes_written ;
-	S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-	if(write_header)
-	{
-		aprfile = openHeaderEntriesFile(false, 0);		
-		bytes_written = aprfile->write((U8*)&mHeaderEntriesInfo, sizeof(EntriesInfo)) ;
-		if(bytes_written != sizeof(EntriesInfo))
-		{
-			clearCorruptedCache() ; //clear the cache.
-			idx = -1 ;//mark the idx invalid.
-			return ;
-		}
+bool LLTextureCache::mapIndexFile(S32 size, bool create)
+{
+	mIndexPool = new LLAPRPool();
+	apr_pool_t* pool = mIndexPool->getAPRPool();
 
-		mHeaderAPRFile->seek(APR_SET, offset);
+	apr_int32_t flags = mReadOnly ? APR_READ|APR_BINARY : APR_READ|APR_WRITE|APR_BINARY;
+	if (create)
+	{
+		flags |= APR_CREATE|APR_TRUNCATE;
 	}
-	else
+	apr_status_t s = apr_file_open(&mIndexFile, mIndexFileName.c_str(), flags, APR_OS_DEFAULT, pool);
+	if (s == APR_SUCCESS && create)
 	{
-		aprfile = openHeaderEntriesFile(false, offset);
+		s = apr_file_trunc(mIndexFile, size);
 	}
-	bytes_written = aprfile->write((void*)&entry, (S32)sizeof(Entry));
-	if(bytes_written != sizeof(Entry))
+	if (s == APR_SUCCESS)
 	{
-		clearCorruptedCache() ; //clear the cache.
-		idx = -1 ;//mark the idx invalid.
-
-		return ;
+		apr_int32_t map_flags = mReadOnly ? APR_MMAP_READ : APR_MMAP_READ|APR_MMAP_WRITE;
+		s = apr_mmap_create(&mIndexMap, mIndexFile, 0, size, map_flags, pool);
 	}
-
-	closeHeaderEntriesFile();
-	mUpdatedEntryMap.erase(idx) ;
-}
-
-//mHeaderMutex is locked before calling this.
-void LLTextureCache::readEntryFromHeaderImmediately(S32& idx, Entry& entry)
-{
-	S32 offset = sizeof(EntriesInfo) + idx * sizeof(Entry);
-	LLAPRFile* aprfile = openHeaderEntriesFile(true, offset);
-	S32 bytes_read = aprfile->read((void*)&entry, (S32)sizeof(Entry));
-	closeHeaderEntriesFile();
-
-	if(bytes_read != sizeof(Entry))
+	if (s != APR_SUCCESS)
 	{
-		clearCorruptedCache() ; //clear the cache.
-		idx = -1 ;//mark the idx invalid.
+		ll_apr_warn_status(s);
+		mIndexMap = NULL;
+		closeIndex();
+		return false;
 	}
+
+	mIndexHeader = (IndexHeader*)mIndexMap->mm;
+	mEntries = (Entry*)(mIndexHeader + 1);
+	return true;
 }
 
-//mHeaderMutex is locked before calling this.
-//update an existing entry time stamp, delay writing.
-void LLTextureCache::updateEntryTimeStamp(S32 idx, Entry& entry)
+void LLTextureCache::closeIndex()
 {
-	static const U32 MAX_ENTRIES_WITHOUT_TIME_STAMP = (U32)(LLTextureCache::sCacheMaxEntries * 0.75f) ;
-
-	if(mHeaderEntriesInfo.mEntries < MAX_ENTRIES_WITHOUT_TIME_STAMP)
+	if (mIndexMap)
 	{
-		return ; //there are enough empty entry index space, no need to stamp time.
+		apr_mmap_delete(mIndexMap);
+		mIndexMap = NULL;
 	}
-
-	if (idx >= 0)
+	if (mIndexFile)
 	{
-		if (!mReadOnly)
-		{
-			entry.mTime = time(NULL);			
-			mUpdatedEntryMap[idx] = entry ;
-		}
+		apr_file_close(mIndexFile);
+		mIndexFile = NULL;
 	}
+	delete mIndexPool;
+	mIndexPool = NULL;
+	mIndexHeader = NULL;
+	mEntries = NULL;
 }
 
-//update an existing entry, write to header file immediately.
-bool LLTextureCache::updateEntry(S32& idx, Entry& entry, S32 new_image_size, S32 new_data_size)
+// Returns the slot holding id, -1 if it isn't cached
+S32 LLTextureCache::findSlot(const LLUUID& id)
 {
-	S32 new_body_size = llmax(0, new_data_size - TEXTURE_CACHE_ENTRY_SIZE) ;
-	
-	if(new_image_size == entry.mImageSize && new_body_size == entry.mBodySize)
+	U32 mask = mIndexHeader->mCapacity - 1;
+	U32 idx = id.getCRC32() & mask;
+	for (U32 probe = 0; probe < mIndexHeader->mCapacity; probe++, idx = (idx + 1) & mask)
 	{
-		return true ; //nothing changed.
-	}
-	else 
-	{
-		bool purge = false ;
-
-		lockHeaders() ;
-
-		bool update_header = false ;
-		if(entry.mImageSize < 0) //is a brand-new entry
-		{
-			mHeaderIDMap[entry.mID] = idx;
-			mTexturesSizeMap[entry.mID] = new_body_size ;
-			mTexturesSizeTotal += new_body_size ;
-			
-			// Update Header
-			update_header = true ;
-		}				
-		else if (entry.mBodySize != new_body_size)
-		{
-			//already in mHeaderIDMap.
-			mTexturesSizeMap[entry.mID] = new_body_size ;
-			mTexturesSizeTotal -= entry.mBodySize ;
-			mTexturesSizeTotal += new_body_size ;
-		}
-		entry.mTime = time(NULL);
-		entry.mImageSize = new_image_size ; 
-		entry.mBodySize = new_body_size ;
-		
-		writeEntryToHeaderImmediately(idx, entry, update_header) ;
-	
-		if (mTexturesSizeTotal > sCacheMaxTexturesSize)
+		Entry& entry = mEntries[idx];
+		if (entry.mState == SLOT_EMPTY)
 		{
-			purge = true;
+			break;
 		}
-		
-		unlockHeaders() ;
-
-		if (purge)
+		if (entry.mState == SLOT_USED && entry.mID == id)
 		{
-			mDoPurge = TRUE;
+			if (isStale(entry))
+			{
+				// Its slab was recycled, and it is already counted as a tombstone
+				if (!mReadOnly)
+				{
+					entry.mState = SLOT_DELETED;
+				}
+				break;
+			}
+			return (S32)idx;
 		}
 	}
-
-	return false ;
+	return -1;
 }
 
-U32 LLTextureCache::openAndReadEntries(std::vector<Entry>& entries)
+// Returns a free slot for id, which must not be cached. -1 if the table is full.
+S32 LLTextureCache::insertSlot(const LLUUID& id)
 {
-	U32 num_entries = mHeaderEntriesInfo.mEntries;
-
-	mHeaderIDMap.clear();
-	mTexturesSizeMap.clear();
-	mFreeList.clear();
-	mTexturesSizeTotal = 0;
-
-	LLAPRFile* aprfile = NULL; 
-	if(mUpdatedEntryMap.empty())
-	{
-		aprfile = openHeaderEntriesFile(true, (S32)sizeof(EntriesInfo));
-	}
-	else //update the header file first.
+	U32 mask = mIndexHeader->mCapacity - 1;
+	U32 idx = id.getCRC32() & mask;
+	S32 free_idx = -1;
+	for (U32 probe = 0; probe < mIndexHeader->mCapacity; probe++, idx = (idx + 1) & mask)
 	{
-		aprfile = openHeaderEntriesFile(false, 0);
-		updatedHeaderEntriesFile() ;
-		if(!aprfile)
+		Entry& entry = mEntries[idx];
+		if (entry.mState == SLOT_EMPTY)
 		{
-			return 0;
-		}
-		aprfile->seek(APR_SET, (S32)sizeof(EntriesInfo));
-	}
-	for (U32 idx=0; idx<num_entries; idx++)
-	{
-		Entry entry;
-		S32 bytes_read = aprfile->read((void*)(&entry), (S32)sizeof(Entry));
-		if (bytes_read < sizeof(Entry))
-		{
-			llwarns << "Corrupted header entries, failed at " << idx << " / " << num_entries << llendl;
-			closeHeaderEntriesFile();
-			purgeAllTextures(false);
-			return 0;
+			if (free_idx < 0)
+			{
+				free_idx = idx;
+			}
+			break;
 		}
-		entries.push_back(entry);
-// 		llinfos << "ENTRY: " << entry.mTime << " TEX: " << entry.mID << " IDX: " << idx << " Size: " << entry.mImageSize << llendl;
-		if(entry.mImageSize > entry.mBodySize)
+		if ((entry.mState == SLOT_DELETED || isStale(entry)) && free_idx < 0)
 		{
-			mHeaderIDMap[entry.mID] = idx;
-			mTexturesSizeMap[entry.mID] = entry.mBodySize;
-			mTexturesSizeTotal += entry.mBodySize;
-		}
-		else
-		{
-			mFreeList.insert(idx);
+			free_idx = idx;
 		}
 	}
-	closeHeaderEntriesFile();
-	return num_entries;
-}
-
-void LLTextureCache::writeEntriesAndClose(const std::vector<Entry>& entries)
-{
-	S32 num_entries = entries.size();
-	llassert_always(num_entries == mHeaderEntriesInfo.mEntries);
-	
-	if (!mReadOnly)
+	if (free_idx >= 0)
 	{
-		LLAPRFile* aprfile = openHeaderEntriesFile(false, (S32)sizeof(EntriesInfo));
-		for (S32 idx=0; idx<num_entries; idx++)
+		Entry& entry = mEntries[free_idx];
+		if (entry.mState != SLOT_EMPTY)
 		{
-			S32 bytes_written = aprfile->write((void*)(&entries[idx]), (S32)sizeof(Entry));
-			if(bytes_written != sizeof(Entry))
-			{
-				clearCorruptedCache() ; //clear the cache.
-				return ;
-			}
+			mIndexHeader->mTombstones--;
 		}
-		closeHeaderEntriesFile();
+		entry.mID = id;
+		entry.mState = SLOT_USED;
 	}
+	return free_idx;
 }
 
-void LLTextureCache::writeUpdatedEntries()
+void LLTextureCache::removeSlot(S32 idx)
 {
-	lockHeaders() ;
-	if (!mReadOnly && !mUpdatedEntryMap.empty())
-	{
-		openHeaderEntriesFile(false, 0);
-		updatedHeaderEntriesFile() ;
-		closeHeaderEntriesFile();
-	}
-	unlockHeaders() ;
+	Entry& entry = mEntries[idx];
+	SlabInfo& slab = mIndexHeader->mSlabs[entry.mSlab];
+	slab.mLive -= entry.mDataSize;
+	slab.mEntries--;
+	mIndexHeader->mEntries--;
+	mIndexHeader->mTombstones++;
+	mTexturesSizeTotal -= entry.mDataSize;
+	entry.mState = SLOT_DELETED;
 }
 
-//mHeaderMutex is locked and mHeaderAPRFile is created before calling this.
-void LLTextureCache::updatedHeaderEntriesFile()
+// Rebuilds the table without tombstones and stale entries
+void LLTextureCache::rehash()
 {
-	if (!mReadOnly && !mUpdatedEntryMap.empty() && mHeaderAPRFile)
+	LL_DEBUGS("TextureCache") << "Rehashing index, entries: " << mIndexHeader->mEntries
+			<< " tombstones: " << mIndexHeader->mTombstones << LL_ENDL;
+
+	std::vector<Entry> live;
+	live.reserve(mIndexHeader->mEntries);
+	for (U32 idx = 0; idx < mIndexHeader->mCapacity; idx++)
 	{
-		//entriesInfo
-		mHeaderAPRFile->seek(APR_SET, 0);
-		S32 bytes_written = mHeaderAPRFile->write((U8*)&mHeaderEntriesInfo, sizeof(EntriesInfo)) ;
-		if(bytes_written != sizeof(EntriesInfo))
-		{
-			clearCorruptedCache() ; //clear the cache.
-			return ;
-		}
-		
-		//write each updated entry
-		S32 entry_size = (S32)sizeof(Entry) ;
-		S32 prev_idx = -1 ;
-		S32 delta_idx ;
-		for (idx_entry_map_t::iterator iter = mUpdatedEntryMap.begin(); iter != mUpdatedEntryMap.end(); ++iter)
+		const Entry& entry = mEntries[idx];
+		if (entry.mState == SLOT_USED && !isStale(entry))
 		{
-			delta_idx = iter->first - prev_idx - 1;
-			prev_idx = iter->first ;
-			if(delta_idx)
-			{
-				mHeaderAPRFile->seek(APR_CUR, delta_idx * entry_size);
-			}
-			
-			bytes_written = mHeaderAPRFile->write((void*)(&iter->second), entry_size);
-			if(bytes_written != entry_size)
-			{
-				clearCorruptedCache() ; //clear the cache.
-				return ;
-			}
+			live.push_back(entry);
 		}
-		mUpdatedEntryMap.clear() ;
+	}
+	memset(mEntries, 0, mIndexHeader->mCapacity * sizeof(Entry));
+	mIndexHeader->mTombstones = 0;
+	for (std::vector<Entry>::iterator iter = live.begin(); iter != live.end(); ++iter)
+	{
+		mEntries[insertSlot(iter->mID)] = *iter;
 	}
 }
-//----------------------------------------------------------------------------
 
-// Called from either the main thread or the worker thread
-void LLTextureCache::readHeaderCache()
+// Takes size bytes from the current slab, moving on to a recycled one when
+// it is full or the index has as many entries as it may hold.
+bool LLTextureCache::allocateSpace(S32 size, U32& slab, U32& offset)
 {
-	mHeaderMutex.lock();
-
-	mLRU.clear(); // always clear the LRU
-
-	readEntriesHeader();
-	
-	if (mHeaderEntriesInfo.mVersion != sHeaderCacheVersion)
+	if (size <= 0 || (U32)size > mIndexHeader->mSlabSize)
 	{
-		if (!mReadOnly)
-		{
-			purgeAllTextures(false);
-		}
+		return false;
 	}
-	else
+	SlabInfo* info = &mIndexHeader->mSlabs[mIndexHeader->mCurrentSlab];
+	if (info->mUsed + (U32)size > mIndexHeader->mSlabSize ||
+		mIndexHeader->mEntries >= sCacheMaxEntries)
 	{
-		std::vector<Entry> entries;
-		U32 num_entries = openAndReadEntries(entries);
-		if (num_entries)
+		S32 next = pickSlabToRecycle();
+		if (next < 0)
 		{
-			U32 empty_entries = 0;
-			typedef std::pair<U32, S32> lru_data_t;
-			std::set<lru_data_t> lru;
-			std::set<U32> purge_list;
-			for (U32 i=0; i<num_entries; i++)
-			{
-				Entry& entry = entries[i];
-				if (entry.mImageSize <= 0)
-				{
-					// This will be in the Free List, don't put it in the LRU
-					++empty_entries;
-				}
-				else
-				{
-					lru.insert(std::make_pair(entry.mTime, i));
-					if (entry.mBodySize > 0)
-					{
-						if (entry.mBodySize > entry.mImageSize)
-						{
-							// Shouldn't happen, failsafe only
-							llwarns << "Bad entry: " << i << ": " << entry.mID << ": BodySize: " << entry.mBodySize << llendl;
-							purge_list.insert(i);
-						}
-					}
-				}
-			}
-			if (num_entries > sCacheMaxEntries)
-			{
-				// Special case: cache size was reduced, need to remove entries
-				// Note: After we prune entries, we will call this again and create the LRU
-				U32 entries_to_purge = (num_entries-empty_entries) - sCacheMaxEntries;
-				llinfos << "Texture Cache Entries: " << num_entries << " Max: " << sCacheMaxEntries << " Empty: " << empty_entries << " Purging: " << entries_to_purge << llendl;
-				if (entries_to_purge > 0)
-				{
-					for (std::set<lru_data_t>::iterator iter = lru.begin(); iter != lru.end(); ++iter)
-					{
-						purge_list.insert(iter->second);
-						if (purge_list.size() >= entries_to_purge)
-							break;
-					}
-				}
-				llassert_always(purge_list.size() >= entries_to_purge);
-			}
-			else
-			{
-				S32 lru_entries = (S32)((F32)sCacheMaxEntries * TEXTURE_CACHE_LRU_SIZE);
-				for (std::set<lru_data_t>::iterator iter = lru.begin(); iter != lru.end(); ++iter)
-				{
-					mLRU.insert(entries[iter->second].mID);
-// 					llinfos << "LRU: " << iter->first << " : " << iter->second << llendl;
-					if (--lru_entries <= 0)
-						break;
-				}
-			}
-			
-			if (purge_list.size() > 0)
-			{
-				for (std::set<U32>::iterator iter = purge_list.begin(); iter != purge_list.end(); ++iter)
-				{
-					std::string tex_filename = getTextureFileName(entries[*iter].mID);
-					removeEntry((S32)*iter, entries[*iter], tex_filename);
-				}
-				// If we removed any entries, we need to rebuild the entries list,
-				// write the header, and call this again
-				std::vector<Entry> new_entries;
-				for (U32 i=0; i<num_entries; i++)
-				{
-					const Entry& entry = entries[i];
-					if (entry.mImageSize > 0)
-					{
-						new_entries.push_back(entry);
-					}
-				}
-				llassert_always(new_entries.size() <= sCacheMaxEntries);
-				mHeaderEntriesInfo.mEntries = new_entries.size();
-				writeEntriesHeader();
-				writeEntriesAndClose(new_entries);
-				mHeaderMutex.unlock(); // unlock the mutex before calling again
-				readHeaderCache(); // repeat with new entries file
-				mHeaderMutex.lock();
-			}
-			else
-			{
-				//entries are not changed, nothing here.
-			}
+			return false;
 		}
+		recycleSlab(next);
+		mIndexHeader->mCurrentSlab = next;
+		info = &mIndexHeader->mSlabs[next];
 	}
-	mHeaderMutex.unlock();
+	slab = mIndexHeader->mCurrentSlab;
+	offset = info->mUsed;
+	info->mUsed += size;
+	info->mTime = time(NULL);
+	return true;
 }
 
-//////////////////////////////////////////////////////////////////////////////
-
-//the header mutex is locked before calling this.
-void LLTextureCache::clearCorruptedCache()
+// Never used slabs first, then the least recently used one without writes in flight
+S32 LLTextureCache::pickSlabToRecycle()
 {
-	llwarns << "the texture cache is corrupted, need to be cleared." << llendl ;
-
-	closeHeaderEntriesFile();//close possible file handler
-	purgeAllTextures(false) ; //clear the cache.
-	
-	if (!mReadOnly) //regenerate the directory tree if not exists.
+	S32 best = -1;
+	for (S32 slab = 0; slab < (S32)mIndexHeader->mSlabCount; slab++)
 	{
-		LLFile::mkdir(mTexturesDirName);
-		
-		const char* subdirs = "0123456789abcdef";
-		for (S32 i=0; i<16; i++)
+		if (slab == (S32)mIndexHeader->mCurrentSlab || mSlabWrites[slab] > 0)
+		{
+			continue;
+		}
+		const SlabInfo& info = mIndexHeader->mSlabs[slab];
+		if (info.mUsed == 0)
+		{
+			return slab;
+		}
+		if (best < 0 || info.mTime < mIndexHeader->mSlabs[best].mTime)
 		{
-			std::string dirname = mTexturesDirName + gDirUtilp->getDirDelimiter() + subdirs[i];
-			LLFile::mkdir(dirname);
+			best = slab;
 		}
 	}
+	return best;
+}
 
-	return ;
+// Drops every entry in the slab by moving its generation on, without
+// touching the table or the slab file.
+void LLTextureCache::recycleSlab(S32 slab)
+{
+	SlabInfo& info = mIndexHeader->mSlabs[slab];
+	if (info.mUsed > 0)
+	{
+		LL_DEBUGS("TextureCache") << "Recycling slab " << slab << " entries: " << info.mEntries
+				<< " live: " << info.mLive / 1024 << " KB" << LL_ENDL;
+	}
+	mIndexHeader->mEntries -= info.mEntries;
+	mIndexHeader->mTombstones += info.mEntries;
+	mTexturesSizeTotal -= info.mLive;
+	info.mGeneration++;
+	info.mUsed = 0;
+	info.mLive = 0;
+	info.mEntries = 0;
+	info.mTime = time(NULL);
 }
 
+//----------------------------------------------------------------------------
+
 void LLTextureCache::purgeAllTextures(bool purge_directories)
 {
+	closeIndex();
 	if (!mReadOnly)
 	{
+		// Body files of the old one file per texture layout
 		const char* subdirs = "0123456789abcdef";
 		std::string delem = gDirUtilp->getDirDelimiter();
 		std::string mask = delem + "*";
 		for (S32 i=0; i<16; i++)
 		{
 			std::string dirname = mTexturesDirName + delem + subdirs[i];
-			llinfos << "Deleting files in directory: " << dirname << llendl;
-			gDirUtilp->deleteFilesInDir(dirname,mask);
-			if (purge_directories)
+			if (LLFile::isdir(dirname))
 			{
+				llinfos << "Deleting files in directory: " << dirname << llendl;
+				gDirUtilp->deleteFilesInDir(dirname,mask);
 				LLFile::rmdir(dirname);
 			}
 		}
+		// Index and slabs
+		gDirUtilp->deleteFilesInDir(mTexturesDirName, mask);
 		if (purge_directories)
 		{
-			gDirUtilp->deleteFilesInDir(mTexturesDirName, mask);
 			LLFile::rmdir(mTexturesDirName);
 		}		
 	}
-	mHeaderIDMap.clear();
-	mTexturesSizeMap.clear();
-	mTexturesSizeTotal = 0;
-	mFreeList.clear();
 	mTexturesSizeTotal = 0;
-	mUpdatedEntryMap.clear();
-
-	// Info with 0 entries
-	mHeaderEntriesInfo.mVersion = sHeaderCacheVersion;
-	mHeaderEntriesInfo.mEntries = 0;
-	writeEntriesHeader();
 
 	llinfos << "The entire texture cache is cleared." << llendl ;
 }
 
-void LLTextureCache::purgeTextures(bool validate)
-{
-	if (mReadOnly)
-	{
-		return;
-	}
-
-	if (!mThreaded)
-	{
-		// *FIX:Mani - watchdog off.
-		LLAppViewer::instance()->pauseMainloopTimeout();
-	}
-	
-	LLMutexLock lock(&mHeaderMutex);
-
-	llinfos << "TEXTURE CACHE: Purging." << llendl;
-
-	// Read the entries list
-	std::vector<Entry> entries;
-	U32 num_entries = openAndReadEntries(entries);
-	if (!num_entries)
-	{
-		return; // nothing to purge
-	}
-	
-	// Use mTexturesSizeMap to collect UUIDs of textures with bodies
-	typedef std::set<std::pair<U32,S32> > time_idx_set_t;
-	std::set<std::pair<U32,S32> > time_idx_set;
-	for (size_map_t::iterator iter1 = mTexturesSizeMap.begin();
-		 iter1 != mTexturesSizeMap.end(); ++iter1)
-	{
-		if (iter1->second > 0)
-		{
-			id_map_t::iterator iter2 = mHeaderIDMap.find(iter1->first);
-			if (iter2 != mHeaderIDMap.end())
-			{
-				S32 idx = iter2->second;
-				time_idx_set.insert(std::make_pair(entries[idx].mTime, idx));
-// 				llinfos << "TIME: " << entries[idx].mTime << " TEX: " << entries[idx].mID << " IDX: " << idx << " Size: " << entries[idx].mImageSize << llendl;
-			}
-			else
-			{
-				llerrs << "mTexturesSizeMap / mHeaderIDMap corrupted." << llendl ;
-			}
-		}
-	}
-	
-	// Validate 1/256th of the files on startup
-	U32 validate_idx = 0;
-	if (validate)
-	{
-		validate_idx = gSavedSettings.getU32("CacheValidateCounter");
-		U32 next_idx = (++validate_idx) % 256;
-		gSavedSettings.setU32("CacheValidateCounter", next_idx);
-		LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Validating: " << validate_idx << LL_ENDL;
-	}
-
-	S64 cache_size = mTexturesSizeTotal;
-	S64 purged_cache_size = (sCacheMaxTexturesSize * (S64)((1.f-TEXTURE_CACHE_PURGE_AMOUNT)*100)) / 100;
-	S32 purge_count = 0;
-	for (time_idx_set_t::iterator iter = time_idx_set.begin();
-		 iter != time_idx_set.end(); ++iter)
-	{
-		S32 idx = iter->second;
-		bool purge_entry = false;
-		std::string filename = getTextureFileName(entries[idx].mID);
-		if (cache_size >= purged_cache_size)
-		{
-			purge_entry = true;
-		}
-		else if (validate)
-		{
-			// make sure file exists and is the correct size
-			U32 uuididx = entries[idx].mID.mData[0];
-			if (uuididx == validate_idx)
-			{
- 				LL_DEBUGS("TextureCache") << "Validating: " << filename << "Size: " << entries[idx].mBodySize << LL_ENDL;
-				S32 bodysize = LLAPRFile::size(filename, getLocalAPRFilePool());
-				if (bodysize != entries[idx].mBodySize)
-				{
-					LL_WARNS("TextureCache") << "TEXTURE CACHE BODY HAS BAD SIZE: " << bodysize << " != " << entries[idx].mBodySize
-							<< filename << LL_ENDL;
-					purge_entry = true;
-				}
-			}
-		}
-		else
-		{
-			break;
-		}
-		
-		if (purge_entry)
-		{
-			purge_count++;
-	 		LL_DEBUGS("TextureCache") << "PURGING: " << filename << LL_ENDL;
-			removeEntry(idx, entries[idx], filename) ;
-			cache_size -= entries[idx].mBodySize;
-		}
-	}
-
-	LL_DEBUGS("TextureCache") << "TEXTURE CACHE: Writing Entries: " << num_entries << LL_ENDL;
-
-	writeEntriesAndClose(entries);
-	
-	// *FIX:Mani - watchdog back on.
-	LLAppViewer::instance()->resumeMainloopTimeout();
-	
-	LL_INFOS("TextureCache") << "TEXTURE CACHE:"
-			<< " PURGED: " << purge_count
-			<< " ENTRIES: " << num_entries
-			<< " CACHE SIZE: " << mTexturesSizeTotal / 1024*1024 << " MB"
-			<< llendl;
-}
-
 //////////////////////////////////////////////////////////////////////////////
 
 // call lockWorkers() first!
@@ -1682,41 +1179,119 @@ LLTextureCacheWorker* LLTextureCache::getWriter(handle_t handle)
 //////////////////////////////////////////////////////////////////////////////
 // Called from work thread
 
-// Reads imagesize from the header, updates timestamp
-S32 LLTextureCache::getHeaderCacheEntry(const LLUUID& id, Entry& entry)
+// Copies out the entry for id and updates its time stamp
+bool LLTextureCache::lookupEntry(const LLUUID& id, Entry& entry)
 {
-	LLMutexLock lock(&mHeaderMutex);	
-	S32 idx = openAndReadEntry(id, entry, false);
-	if (idx >= 0)
-	{		
-		updateEntryTimeStamp(idx, entry); // updates time
+	LLMutexLock lock(&mHeaderMutex);
+	if (!mIndexHeader)
+	{
+		return false;
+	}
+	S32 idx = findSlot(id);
+	if (idx < 0)
+	{
+		return false;
+	}
+	Entry& cached = mEntries[idx];
+	if (cached.mDataSize <= 0 || cached.mImageSize < cached.mDataSize ||
+		cached.mOffset + cached.mDataSize > mIndexHeader->mSlabSize)
+	{
+		llwarns << "corrupted entry: " << id << " entry image size: " << cached.mImageSize << " entry data size: " << cached.mDataSize << llendl ;
+		if (!mReadOnly)
+		{
+			removeSlot(idx);
+		}
+		return false;
+	}
+	if (!mReadOnly)
+	{
+		U32 now = time(NULL);
+		cached.mTime = now;
+		mIndexHeader->mSlabs[cached.mSlab].mTime = now;
 	}
-	return idx;
+	entry = cached;
+	return true;
 }
 
-// Writes imagesize to the header, updates timestamp
-S32 LLTextureCache::setHeaderCacheEntry(const LLUUID& id, Entry& entry, S32 imagesize, S32 datasize)
+// False if the entry's slab was recycled since entry was looked up
+bool LLTextureCache::isEntryCurrent(const Entry& entry)
 {
-	mHeaderMutex.lock();
-	S32 idx = openAndReadEntry(id, entry, true);
-	mHeaderMutex.unlock();
+	LLMutexLock lock(&mHeaderMutex);
+	return mIndexHeader && !isStale(entry);
+}
 
+// Finds room for datasize bytes of id. False if there is nothing to write,
+// either because the texture is already cached with at least that much
+// data or because there is no room. Must be followed by commitEntry().
+bool LLTextureCache::reserveEntry(const LLUUID& id, S32 imagesize, S32 datasize, Entry& entry)
+{
+	LLMutexLock lock(&mHeaderMutex);
+	if (!mIndexHeader || mReadOnly)
+	{
+		return false;
+	}
+	U32 now = time(NULL);
+	S32 idx = findSlot(id);
 	if (idx >= 0)
 	{
-		updateEntry(idx, entry, imagesize, datasize);				
+		Entry& cached = mEntries[idx];
+		if (cached.mImageSize == imagesize && cached.mDataSize >= datasize)
+		{
+			cached.mTime = now;
+			return false;
+		}
+	}
+	U32 slab, offset;
+	if (!allocateSpace(datasize, slab, offset))
+	{
+		return false;
 	}
+	mSlabWrites[slab]++;
+
+	entry.mID = id;
+	entry.mImageSize = imagesize;
+	entry.mDataSize = datasize;
+	entry.mTime = now;
+	entry.mOffset = offset;
+	entry.mGeneration = mIndexHeader->mSlabs[slab].mGeneration;
+	entry.mSlab = slab;
+	entry.mState = SLOT_USED;
+	return true;
+}
 
-	if(idx < 0) // retry
+// Publishes a reserved entry once its data is written, replacing any
+// older copy of the texture.
+bool LLTextureCache::commitEntry(const Entry& entry, bool success)
+{
+	LLMutexLock lock(&mHeaderMutex);
+	mSlabWrites[entry.mSlab]--;
+	if (!success || !mIndexHeader || isStale(entry))
 	{
-		readHeaderCache(); // We couldn't write an entry, so refresh the LRU
-	
-		mHeaderMutex.lock();
-		llassert_always(!mLRU.empty() || mHeaderEntriesInfo.mEntries < sCacheMaxEntries);
-		mHeaderMutex.unlock();
+		return false;
+	}
 
-		idx = setHeaderCacheEntry(id, entry, imagesize, datasize); // assert above ensures no inf. recursion
+	if (mIndexHeader->mEntries + mIndexHeader->mTombstones >= mIndexHeader->mCapacity / 4 * 3)
+	{
+		rehash();
+	}
+	S32 idx = findSlot(entry.mID);
+	if (idx >= 0)
+	{
+		removeSlot(idx);
+	}
+	idx = insertSlot(entry.mID);
+	if (idx < 0)
+	{
+		return false;
 	}
-	return idx;
+	mEntries[idx] = entry;
+
+	SlabInfo& slab = mIndexHeader->mSlabs[entry.mSlab];
+	slab.mLive += entry.mDataSize;
+	slab.mEntries++;
+	mIndexHeader->mEntries++;
+	mTexturesSizeTotal += entry.mDataSize;
+	return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1790,14 +1365,6 @@ LLTextureCache::handle_t LLTextureCache::writeToCache(const LLUUID& id, U32 prio
 		delete responder;
 		return LLWorkerThread::nullHandle();
 	}
-	if (mDoPurge)
-	{
-		// NOTE: This may cause an occasional hiccup,
-		//  but it really needs to be done on the control thread
-		//  (i.e. here)		
-		purgeTextures(false);
-		mDoPurge = FALSE;
-	}
 	LLMutexLock lock(&mWorkersMutex);
 	LLTextureCacheWorker* worker = new LLTextureCacheRemoteWorker(this, priority, id,
 																  data, datasize, 0,
@@ -1843,54 +1410,20 @@ void LLTextureCache::addCompleted(Responder* responder, bool success)
 
 //////////////////////////////////////////////////////////////////////////////
 
-//called after mHeaderMutex is locked.
-void LLTextureCache::removeCachedTexture(const LLUUID& id)
-{
-	if(mTexturesSizeMap.find(id) != mTexturesSizeMap.end())
-	{
-		mTexturesSizeTotal -= mTexturesSizeMap[id] ;
-		mTexturesSizeMap.erase(id);
-	}
-	mHeaderIDMap.erase(id);
-	LLAPRFile::remove(getTextureFileName(id), getLocalAPRFilePool());		
-}
-
-//called after mHeaderMutex is locked.
-void LLTextureCache::removeEntry(S32 idx, Entry& entry, std::string& filename)
-{
-	if(idx >= 0) //valid entry
-	{
-		entry.mImageSize = -1;
-		entry.mBodySize = 0;
-		mHeaderIDMap.erase(entry.mID);
-		mTexturesSizeMap.erase(entry.mID);
-
-		mTexturesSizeTotal -= entry.mBodySize;
-		mFreeList.insert(idx);	
-	}
-
-	LLAPRFile::remove(filename, getLocalAPRFilePool());		
-}
-
 bool LLTextureCache::removeFromCache(const LLUUID& id)
 {
 	//llwarns << "Removing texture from cache: " << id << llendl;
 	bool ret = false ;
 	if (!mReadOnly)
 	{
-		lockHeaders() ;
-
-		Entry entry;
-		S32 idx = openAndReadEntry(id, entry, false);
-		std::string tex_filename = getTextureFileName(id);
-		removeEntry(idx, entry, tex_filename) ;
+		LLMutexLock lock(&mHeaderMutex);
+		S32 idx = mIndexHeader ? findSlot(id) : -1;
 		if (idx >= 0)
-		{			
-			writeEntryToHeaderImmediately(idx, entry);					
+		{
+			// The data stays in its slab until the slab is recycled
+			removeSlot(idx);
 			ret = true;
 		}
-
-		unlockHeaders() ;
 	}
 	return ret ;
 }
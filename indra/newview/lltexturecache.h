@@ -34,6 +34,8 @@
 
 #include "llworkerthread.h"
 
+struct apr_mmap_t;
+
 class LLImageFormatted;
 class LLTextureCacheWorker;
 
@@ -44,29 +46,53 @@ class LLTextureCache : public LLWorkerThread
 	friend class LLTextureCacheLocalFileWorker;
 
 private:
-	// Entries
-	struct EntriesInfo
+	// Index file: a fixed size open addressing hash table on texture UUID,
+	// mapped into memory so opening the cache doesn't read any entries.
+	// Texture data lives in packed slab files, written sequentially into the
+	// current slab. When the cache is full the least recently used slab is
+	// recycled whole, which drops all of its entries at once: each entry
+	// records the generation of its slab and is stale once that moves on.
+	enum
+	{
+		INDEX_MAGIC = 0x4354534c,	// "LSTC"
+		MAX_SLABS = 64
+	};
+	enum e_slot_state
+	{
+		SLOT_EMPTY = 0,
+		SLOT_USED = 1,
+		SLOT_DELETED = 2
+	};
+	struct SlabInfo
+	{
+		U32 mUsed;			// bytes allocated so far
+		U32 mLive;			// bytes held by current entries
+		U32 mEntries;		// current entries
+		U32 mTime;			// last access, seconds since 1/1/1970
+		U32 mGeneration;	// bumped every time the slab is recycled
+	};
+	struct IndexHeader
 	{
-		EntriesInfo() : mVersion(0.f), mEntries(0) {}
-		F32 mVersion;
-		U32 mEntries;
+		U32 mMagic;
+		U32 mVersion;
+		U32 mCapacity;		// slots, a power of 2
+		U32 mEntries;		// live entries
+		U32 mTombstones;	// deleted or stale slots
+		U32 mSlabCount;
+		U32 mSlabSize;
+		U32 mCurrentSlab;
+		SlabInfo mSlabs[MAX_SLABS];
 	};
 	struct Entry
 	{
-        	Entry() :
-		        mBodySize(0),
-			mImageSize(0),
-			mTime(0)
-		{
-		}
-		Entry(const LLUUID& id, S32 imagesize, S32 bodysize, U32 time) :
-			mID(id), mImageSize(imagesize), mBodySize(bodysize), mTime(time) {}
-		void init(const LLUUID& id, U32 time) { mID = id, mImageSize = 0; mBodySize = 0; mTime = time; }
-		Entry& operator=(const Entry& entry) {mID = entry.mID, mImageSize = entry.mImageSize; mBodySize = entry.mBodySize; mTime = entry.mTime; return *this;}
 		LLUUID mID; // 16 bytes
 		S32 mImageSize; // total size of image if known
-		S32 mBodySize; // size of body file in body cache
+		S32 mDataSize; // bytes of the image stored in the slab
 		U32 mTime; // seconds since 1/1/1970
+		U32 mOffset; // location in the slab file
+		U32 mGeneration; // slab generation the data was written in
+		U16 mSlab;
+		U16 mState; // e_slot_state
 	};
 
 	
@@ -131,7 +157,7 @@ public:
 	S32 getNumWrites() { return mWriters.size(); }
 	S64 getUsage() { return mTexturesSizeTotal; }
 	S64 getMaxUsage() { return sCacheMaxTexturesSize; }
-	U32 getEntries() { return mHeaderEntriesInfo.mEntries; }
+	U32 getEntries() { return mIndexHeader ? mIndexHeader->mEntries : 0; }
 	U32 getMaxEntries() { return sCacheMaxEntries; };
 	BOOL isInCache(const LLUUID& id) ;
 	BOOL isInLocal(const LLUUID& id) ;
@@ -139,35 +165,36 @@ public:
 protected:
 	// Accessed by LLTextureCacheWorker
 	std::string getLocalFileName(const LLUUID& id);
-	std::string getTextureFileName(const LLUUID& id);
+	std::string getSlabFileName(S32 slab);
 	void addCompleted(Responder* responder, bool success);
 	
+	// Index access, each takes mHeaderMutex
+	bool lookupEntry(const LLUUID& id, Entry& entry);
+	bool isEntryCurrent(const Entry& entry);
+	bool reserveEntry(const LLUUID& id, S32 imagesize, S32 datasize, Entry& entry);
+	bool commitEntry(const Entry& entry, bool success);
+	
 protected:
 	//void setFileAPRPool(apr_pool_t* pool) { mFileAPRPool = pool ; }
 
 private:
 	void setDirNames(ELLPath location);
-	void readHeaderCache();
-	void clearCorruptedCache();
+	bool openIndex(U32 capacity, U32 slab_count, U32 slab_size);
+	bool mapIndexFile(S32 size, bool create);
+	void closeIndex();
+	void resetIndex(U32 capacity, U32 slab_count, U32 slab_size);
 	void purgeAllTextures(bool purge_directories);
-	void purgeTextures(bool validate);
-	LLAPRFile* openHeaderEntriesFile(bool readonly, S32 offset);
-	void closeHeaderEntriesFile();
-	void readEntriesHeader();
-	void writeEntriesHeader();
-	S32 openAndReadEntry(const LLUUID& id, Entry& entry, bool create);
-	bool updateEntry(S32& idx, Entry& entry, S32 new_image_size, S32 new_body_size);
-	void updateEntryTimeStamp(S32 idx, Entry& entry) ;
-	U32 openAndReadEntries(std::vector<Entry>& entries);
-	void writeEntriesAndClose(const std::vector<Entry>& entries);
-	void readEntryFromHeaderImmediately(S32& idx, Entry& entry) ;
-	void writeEntryToHeaderImmediately(S32& idx, Entry& entry, bool write_header = false) ;
-	void removeEntry(S32 idx, Entry& entry, std::string& filename);
-	void removeCachedTexture(const LLUUID& id) ;
-	S32 getHeaderCacheEntry(const LLUUID& id, Entry& entry);
-	S32 setHeaderCacheEntry(const LLUUID& id, Entry& entry, S32 imagesize, S32 datasize);
-	void writeUpdatedEntries() ;
-	void updatedHeaderEntriesFile() ;
+
+	// mHeaderMutex must be locked for the following
+	S32 findSlot(const LLUUID& id);
+	S32 insertSlot(const LLUUID& id);
+	void removeSlot(S32 idx);
+	bool isStale(const Entry& entry) const { return entry.mSlab >= mIndexHeader->mSlabCount || entry.mGeneration != mIndexHeader->mSlabs[entry.mSlab].mGeneration; }
+	void rehash();
+	bool allocateSpace(S32 size, U32& slab, U32& offset);
+	S32 pickSlabToRecycle();
+	void recycleSlab(S32 slab);
+	
 	void lockHeaders() { mHeaderMutex.lock(); }
 	void unlockHeaders() { mHeaderMutex.unlock(); }
 	
@@ -176,7 +203,6 @@ private:
 	LLMutex mWorkersMutex;
 	LLMutex mHeaderMutex;
 	LLMutex mListMutex;
-	LLAPRFile* mHeaderAPRFile;
 	
 	typedef std::map<handle_t, LLTextureCacheWorker*> handle_map_t;
 	handle_map_t mReaders;
@@ -190,27 +216,20 @@ private:
 	
 	BOOL mReadOnly;
 	
-	// HEADERS (Include first mip)
-	std::string mHeaderEntriesFileName;
-	std::string mHeaderDataFileName;
-	EntriesInfo mHeaderEntriesInfo;
-	std::set<S32> mFreeList; // deleted entries
-	std::set<LLUUID> mLRU;
-	typedef std::map<LLUUID,S32> id_map_t;
-	id_map_t mHeaderIDMap;
-
-	// BODIES (TEXTURES minus headers)
+	// INDEX
+	std::string mIndexFileName;
+	LLAPRPool* mIndexPool;
+	apr_file_t* mIndexFile;
+	apr_mmap_t* mIndexMap;
+	IndexHeader* mIndexHeader; // NULL if the cache isn't open
+	Entry* mEntries;
+
+	// SLABS (texture data)
 	std::string mTexturesDirName;
-	typedef std::map<LLUUID,S32> size_map_t;
-	size_map_t mTexturesSizeMap;
 	S64 mTexturesSizeTotal;
-	LLAtomic32<BOOL> mDoPurge;
-
-	typedef std::map<S32, Entry> idx_entry_map_t;
-	idx_entry_map_t mUpdatedEntryMap;
+	S32 mSlabWrites[MAX_SLABS]; // writes in flight, the slab can't be recycled
 
 	// Statics
-	static F32 sHeaderCacheVersion;
 	static U32 sCacheMaxEntries;
 	static S64 sCacheMaxTexturesSize;
 };
@@ -38,6 +38,7 @@
 #include "llhttpstatuscodes.h"
 #include "llimage.h"
 #include "llimagej2c.h"
+#include "llimageglupload.h"
 #include "llimageworker.h"
 #include "llworkerthread.h"
 #include "message.h"
@@ -143,7 +144,7 @@ public:
 	/*virtual*/ bool deleteOK(); // called from update() (WORK THREAD)
 
 	~LLTextureFetchWorker();
-	void relese() { --mActiveCount; }
+	void relese() { LLMutexLock lock(&mWorkMutex); --mActiveCount; }
 
 	S32 callbackHttpGet(const LLChannelDescriptors& channels,
 						 const LLIOPipe::buffer_ptr_t& buffer,
@@ -224,6 +225,7 @@ private:
 	LLPointer<LLImageFormatted> mFormattedImage;
 	LLPointer<LLImageRaw> mRawImage;
 	LLPointer<LLImageRaw> mAuxImage;
+	LLPointer<LLImageGLUpload> mRawUpload; // copy of mRawImage staged for upload, may be NULL
 	LLUUID mID;
 	LLHost mHost;
 	std::string mUrl;
@@ -258,7 +260,7 @@ private:
 	bool mCanUseNET ; //can get from asset server.
 	S32 mHTTPFailCount;
 	S32 mRetryAttempt;
-	S32 mActiveCount;
+	S32 mActiveCount; // guarded by mWorkMutex
 	U32 mGetStatus;
 	std::string mGetReason;
 	
@@ -549,6 +551,18 @@ void LLTextureFetchWorker::setDesiredDiscard(S32 discard, S32 size)
 		prioritize = true;
 	}
 	mDesiredSize = llmax(mDesiredSize, TEXTURE_CACHE_ENTRY_SIZE);
+	if (mState == WAIT_HTTP_REQ && !mLoaded && mRequestedSize > 0 &&
+		mDesiredSize > mBufferSize + mRequestedSize)
+	{
+		// If the request for the header is still queued, let it fetch the
+		// body too instead of sending a second request once it's back.
+		S32 length = mDesiredSize - mBufferSize;
+		if (mFetcher->mCurlGetRequest->extendByteRange(mID, length))
+		{
+			mRequestedSize = length;
+			mRequestedDiscard = llmin(mRequestedDiscard, mDesiredDiscard);
+		}
+	}
 	if ((prioritize && mState == INIT) || mState == DONE)
 	{
 		mState = INIT;
@@ -567,6 +581,10 @@ void LLTextureFetchWorker::setImagePriority(F32 priority)
 		calcWorkPriority();
 		U32 work_priority = mWorkPriority | (getPriority() & LLWorkerThread::PRIORITY_HIGHBITS);
 		setPriority(work_priority);
+		if (mState == WAIT_HTTP_REQ && !mLoaded)
+		{
+			mFetcher->mCurlGetRequest->setPriority(mID, mWorkPriority);
+		}
 	}
 }
 
@@ -632,6 +650,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 	if (mState == INIT)
 	{		
 		mRawImage = NULL ;
+		mRawUpload = NULL;
 		mRequestedDiscard = -1;
 		mLoadedDiscard = -1;
 		mDecodedDiscard = -1;
@@ -858,12 +877,10 @@ bool LLTextureFetchWorker::doWork(S32 param)
 		if(mCanUseHTTP)
 		{
 			//NOTE:
-			//control the number of the http requests issued for:
-			//1, not openning too many file descriptors at the same time;
-			//2, control the traffic of http so udp gets bandwidth.
-			//
-			static const S32 MAX_NUM_OF_HTTP_REQUESTS_IN_QUEUE = 32 ;
-			if(mFetcher->getNumHTTPRequests() > MAX_NUM_OF_HTTP_REQUESTS_IN_QUEUE)
+			//mCurlGetRequest limits the requests on the wire itself, based on
+			//the throughput it measures. Only hand it a window's worth more so
+			//the rest wait here, where their priority still changes.
+			if(mFetcher->mCurlGetRequest->isSaturated())
 			{
 				return false ; //wait.
 			}
@@ -912,7 +929,7 @@ bool LLTextureFetchWorker::doWork(S32 param)
 				// Will call callbackHttpGet when curl request completes
 				std::vector<std::string> headers;
 				headers.push_back("Accept: image/x-j2c");
-				res = mFetcher->mCurlGetRequest->getByteRange(mUrl, headers, offset, mRequestedSize,
+				res = mFetcher->mCurlGetRequest->getByteRange(mID, mUrl, headers, offset, mRequestedSize, mWorkPriority,
 															  new HTTPGetResponder(mFetcher, mID, LLTimer::getTotalTime(), mRequestedSize, offset, true));
 			}
 			if (!res)
@@ -1090,9 +1107,17 @@ bool LLTextureFetchWorker::doWork(S32 param)
 			setPriority(LLWorkerThread::PRIORITY_LOW | mWorkPriority);
 			return true;
 		}
+		if (mFetcher->mImageDecodeThread->isSaturated())
+		{
+			// Every decode thread already has a backlog, hold on to the data
+			// and try again later rather than piling more work on the pool.
+			setPriority(LLWorkerThread::PRIORITY_LOW | mWorkPriority);
+			return false;
+		}
 		setPriority(LLWorkerThread::PRIORITY_LOW | mWorkPriority); // Set priority first since Responder may change it
 		mRawImage = NULL;
 		mAuxImage = NULL;
+		mRawUpload = NULL;
 		llassert_always(mFormattedImage.notNull());
 		S32 discard = mHaveAllData ? 0 : mLoadedDiscard;
 		U32 image_priority = LLWorkerThread::PRIORITY_NORMAL | mWorkPriority;
@@ -1461,6 +1486,15 @@ void LLTextureFetchWorker::callbackCacheWrite(bool success)
 
 void LLTextureFetchWorker::callbackDecoded(bool success, LLImageRaw* raw, LLImageRaw* aux)
 {
+	// Still on the decode thread: copy the pixels into a pixel buffer now so
+	// the main thread only has to start the transfer. Done before taking the
+	// lock, the copy can take a while for big images.
+	LLPointer<LLImageGLUpload> upload;
+	if (success && raw)
+	{
+		upload = LLImageGLUpload::stage(raw);
+	}
+
 	LLMutexLock lock(&mWorkMutex);
 	if (mDecodeHandle == 0)
 	{
@@ -1480,6 +1514,7 @@ void LLTextureFetchWorker::callbackDecoded(bool success, LLImageRaw* raw, LLImag
 		llassert_always(raw);
 		mRawImage = raw;
 		mAuxImage = aux;
+		mRawUpload = upload;
 		mDecodedDiscard = mFormattedImage->getDiscardLevel();
  		LL_DEBUGS("Texture") << mID << ": Decode Finished. Discard: " << mDecodedDiscard
 							 << " Raw Image: " << llformat("%dx%d",mRawImage->getWidth(),mRawImage->getHeight()) << LL_ENDL;
@@ -1538,6 +1573,9 @@ LLTextureFetch::LLTextureFetch(LLTextureCache* cache, LLImageDecodeThread* image
 	  mCurlGetRequest(NULL)
 {
 	mMaxBandwidth = gSavedSettings.getF32("ThrottleBandwidthKBPS");
+	// Not tied to a thread: workers queue requests, the fetch thread runs them
+	mCurlGetRequest = new LLCurlTextureRequest(gSavedSettings.getU32("ImagePipelineHTTPMaxRequests"));
+	mCurlGetRequest->setPipelining(gSavedSettings.getBOOL("ImagePipelineHTTPPipelining"));
 	mTextureInfo.setUpLogging(gSavedSettings.getBOOL("LogTextureDownloadsToViewerLog"), gSavedSettings.getBOOL("LogTextureDownloadsToSimulator"), gSavedSettings.getU32("TextureLoggingThreshold"));
 }
 
@@ -1545,6 +1583,9 @@ LLTextureFetch::~LLTextureFetch()
 {
 	clearDeleteList() ;
 
+	delete mCurlGetRequest;
+	mCurlGetRequest = NULL;
+
 	// ~LLQueuedThread() called here
 }
 
@@ -1664,6 +1705,12 @@ void LLTextureFetch::addToNetworkQueue(LLTextureFetchWorker* worker)
 
 void LLTextureFetch::removeFromNetworkQueue(LLTextureFetchWorker* worker, bool cancel)
 {
+	if (cancel)
+	{
+		// An HTTP GET still waiting for a slot goes too, nobody is left to
+		// take the data
+		mCurlGetRequest->cancel(worker->mID);
+	}
 	LLMutexLock lock(&mNetworkQueueMutex);
 	size_t erased = mNetworkQueue.erase(worker->mID);
 	if (cancel && erased > 0)
@@ -1760,7 +1807,8 @@ LLTextureFetchWorker* LLTextureFetch::getWorker(const LLUUID& id)
 
 
 bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
-										LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux)
+										LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux,
+										LLPointer<LLImageGLUpload>& upload)
 {
 	bool res = false;
 	LLTextureFetchWorker* worker = getWorker(id);
@@ -1785,6 +1833,8 @@ bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
 			discard_level = worker->mDecodedDiscard;
 			raw = worker->mRawImage;
 			aux = worker->mAuxImage;
+			upload = worker->mRawUpload;
+			worker->mRawUpload = NULL; // handed over, the buffer goes back to the pool once the texture is done with it
 			res = true;
 			LL_DEBUGS("Texture") << id << ": Request Finished. State: " << worker->mState << " Discard: " << discard_level << LL_ENDL;
 			worker->unlockWorkMutex();
@@ -1800,6 +1850,8 @@ bool LLTextureFetch::getRequestFinished(const LLUUID& id, S32& discard_level,
 				discard_level = worker->mDecodedDiscard;
 				raw = worker->mRawImage;
 				aux = worker->mAuxImage;
+				upload = worker->mRawUpload;
+				worker->mRawUpload = NULL;
 			}
 			worker->unlockWorkMutex();
 		}
@@ -1852,7 +1904,7 @@ S32 LLTextureFetch::update(U32 max_time_ms)
 
 	if (!mThreaded)
 	{
-		// Update Curl on same thread as mCurlGetRequest was constructed
+		// Unthreaded, update Curl from the main thread
 		S32 processed = mCurlGetRequest->process();
 		if (processed > 0)
 		{
@@ -1883,21 +1935,6 @@ void LLTextureFetch::shutDownImageDecodeThread()
 	}
 }
 
-// WORKER THREAD
-void LLTextureFetch::startThread()
-{
-	// Construct mCurlGetRequest from Worker Thread
-	mCurlGetRequest = new LLCurlRequest();
-}
-
-// WORKER THREAD
-void LLTextureFetch::endThread()
-{
-	// Destroy mCurlGetRequest from Worker Thread
-	delete mCurlGetRequest;
-	mCurlGetRequest = NULL;
-}
-
 // WORKER THREAD
 void LLTextureFetch::threadedUpdate()
 {
@@ -1912,7 +1949,7 @@ void LLTextureFetch::threadedUpdate()
 	}
 	process_timer.reset();
 	
-	// Update Curl on same thread as mCurlGetRequest was constructed
+	// Send queued requests and handle the finished ones
 	S32 processed = mCurlGetRequest->process();
 	if (processed > 0)
 	{
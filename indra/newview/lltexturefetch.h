@@ -39,6 +39,7 @@ class LLTextureFetchWorker;
 class HTTPGetResponder;
 class LLTextureCache;
 class LLImageDecodeThread;
+class LLImageGLUpload;
 class LLHost;
 
 // Interface class
@@ -58,8 +59,10 @@ public:
 	bool createRequest(const std::string& url, const LLUUID& id, const LLHost& host, F32 priority,
 					   S32 w, S32 h, S32 c, S32 discard, bool needs_aux, bool can_use_http);
 	void deleteRequest(const LLUUID& id, bool cancel);
+	// upload is a copy of raw already in a pixel buffer, NULL if none was free
 	bool getRequestFinished(const LLUUID& id, S32& discard_level,
-							LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux);
+							LLPointer<LLImageRaw>& raw, LLPointer<LLImageRaw>& aux,
+							LLPointer<LLImageGLUpload>& upload);
 	bool updateRequestPriority(const LLUUID& id, F32 priority);
 
 	bool receiveImageHeader(const LLHost& host, const LLUUID& id, U8 codec, U16 packets, U32 totalbytes, U16 data_size, U8* data);
@@ -95,8 +98,6 @@ protected:
 
 private:
 	void sendRequestListToSimulators();
-	/*virtual*/ void startThread(void);
-	/*virtual*/ void endThread(void);
 	/*virtual*/ void threadedUpdate(void);
 
 public:
@@ -112,7 +113,7 @@ private:
 
 	LLTextureCache* mTextureCache;
 	LLImageDecodeThread* mImageDecodeThread;
-	LLCurlRequest* mCurlGetRequest;
+	LLCurlTextureRequest* mCurlGetRequest;
 	
 	// Map of all requests by UUID
 	typedef std::map<LLUUID,LLTextureFetchWorker*> map_t;
@@ -333,6 +333,18 @@ static bool handleRenderDynamicLODChanged(const LLSD& newvalue)
 	return true;
 }
 
+static bool handleRenderParallelCullChanged(const LLSD& newvalue)
+{
+	LLPipeline::sParallelCull = newvalue.asBoolean();
+	return true;
+}
+
+static bool handleRenderParallelSkinningChanged(const LLSD& newvalue)
+{
+	LLPipeline::sParallelSkinning = newvalue.asBoolean();
+	return true;
+}
+
 static bool handleRenderUseFBOChanged(const LLSD& newvalue)
 {
 	LLRenderTarget::sUseFBO = newvalue.asBoolean();
@@ -550,6 +562,8 @@ void settings_setup_listeners()
 	gSavedSettings.getControl("RenderFogRatio")->getSignal()->connect(boost::bind(&handleFogRatioChanged, _2));
 	gSavedSettings.getControl("RenderMaxPartCount")->getSignal()->connect(boost::bind(&handleMaxPartCountChanged, _2));
 	gSavedSettings.getControl("RenderDynamicLOD")->getSignal()->connect(boost::bind(&handleRenderDynamicLODChanged, _2));
+	gSavedSettings.getControl("RenderParallelCull")->getSignal()->connect(boost::bind(&handleRenderParallelCullChanged, _2));
+	gSavedSettings.getControl("RenderParallelSkinning")->getSignal()->connect(boost::bind(&handleRenderParallelSkinningChanged, _2));
 	gSavedSettings.getControl("RenderDebugTextureBind")->getSignal()->connect(boost::bind(&handleResetVertexBuffersChanged, _2));
 	gSavedSettings.getControl("RenderAutoMaskAlphaDeferred")->getSignal()->connect(boost::bind(&handleResetVertexBuffersChanged, _2));
 	gSavedSettings.getControl("RenderAutoMaskAlphaNonDeferred")->getSignal()->connect(boost::bind(&handleResetVertexBuffersChanged, _2));
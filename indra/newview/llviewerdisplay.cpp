@@ -33,6 +33,7 @@
 #include "llglheaders.h"
 #include "llagent.h"
 #include "llagentcamera.h"
+#include "llbakeuploadqueue.h"
 #include "llviewercontrol.h"
 #include "llcoord.h"
 #include "llcriticaldamp.h"
@@ -533,6 +534,9 @@ void display(BOOL rebuild, F32 zoom_factor, int subfield, BOOL for_snapshot)
 	// Actually push all of our triangles to the screen.
 	//
 
+	// picks up the avatar bakes read back last frame before starting new ones
+	LLBakeUploadQueue::updateClass();
+
 	// do render-to-texture stuff here
 	if (gPipeline.hasRenderDebugFeatureMask(LLPipeline::RENDER_DEBUG_FEATURE_DYNAMIC_TEXTURES))
 	{
@@ -640,6 +644,7 @@ void display(BOOL rebuild, F32 zoom_factor, int subfield, BOOL for_snapshot)
 
 		static LLCullResult result;
 		LLViewerCamera::sCurCameraID = LLViewerCamera::CAMERA_WORLD;
+		gPipeline.mHiZBuffer.update();
 		gPipeline.updateCull(*LLViewerCamera::getInstance(), result, water_clip);
 		stop_glerror();
 
@@ -868,6 +873,12 @@ void display(BOOL rebuild, F32 zoom_factor, int subfield, BOOL for_snapshot)
 			
 			gGL.setColorMask(true, true);
 
+			if (LLPipeline::sUseOcclusion > 1 && LLPipeline::sRenderDeferred && !LLPipeline::sUnderWaterRender)
+			{ //read back depth while the target the world was drawn to is still bound,
+			  //renderGeom() captures its own before water and alpha
+				gPipeline.mHiZBuffer.capture(gGLModelView, gGLProjection);
+			}
+
 			//store this frame's modelview matrix for use
 			//when rendering next frame's occlusion queries
 			for (U32 i = 0; i < 16; i++)
@@ -454,6 +454,16 @@ void LLViewerJoint::updateJointGeometry()
 	}
 }
 
+void LLViewerJoint::addSkinJobs(std::vector<LLSkinJob>& jobs)
+{
+	for (child_list_t::iterator iter = mChildren.begin();
+		 iter != mChildren.end(); ++iter)
+	{
+		LLViewerJoint* joint = (LLViewerJoint*)(*iter);
+		joint->addSkinJobs(jobs);
+	}
+}
+
 
 BOOL LLViewerJoint::updateLOD(F32 pixel_area, BOOL activate)
 {
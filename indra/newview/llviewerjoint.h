@@ -34,6 +34,7 @@
 
 class LLFace;
 class LLViewerJointMesh;
+struct LLSkinJob;
 
 //-----------------------------------------------------------------------------
 // class LLViewerJoint
@@ -123,6 +124,8 @@ public:
 	virtual void updateFaceData(LLFace *face, F32 pixel_area, BOOL damp_wind = FALSE, bool terse_update = false);
 	virtual BOOL updateLOD(F32 pixel_area, BOOL activate);
 	virtual void updateJointGeometry();
+	// Same meshes updateJointGeometry() skins, as jobs to run later
+	virtual void addSkinJobs(std::vector<LLSkinJob>& jobs);
 	virtual void dump();
 
 	void setVisible( BOOL visible, BOOL recursive );
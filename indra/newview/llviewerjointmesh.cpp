@@ -43,6 +43,7 @@
 #include "llgldbg.h"
 #include "llglheaders.h"
 #include "lltexlayer.h"
+#include "llskinthread.h"
 #include "llviewercamera.h"
 #include "llviewercontrol.h"
 #include "llviewertexturelist.h"
@@ -783,27 +784,17 @@ BOOL LLViewerJointMesh::updateLOD(F32 pixel_area, BOOL activate)
 }
 
 // static
-void LLViewerJointMesh::updateGeometryOriginal(LLFace *mFace, LLPolyMesh *mMesh)
+void LLViewerJointMesh::updateGeometryOriginal(LLSkinJob& job)
 {
-	LLStrider<LLVector3> o_vertices;
-	LLStrider<LLVector3> o_normals;
-
-	//get vertex and normal striders
-	LLVertexBuffer *buffer = mFace->mVertexBuffer;
-	buffer->getVertexStrider(o_vertices,  0);
-	buffer->getNormalStrider(o_normals,   0);
-
 	F32 last_weight = F32_MAX;
 	LLMatrix4 gBlendMat;
 	LLMatrix3 gBlendRotMat;
 
-	const F32* weights = mMesh->getWeights();
-	const LLVector3* coords = mMesh->getCoords();
-	const LLVector3* normals = mMesh->getNormals();
-	for (U32 index = 0; index < mMesh->getNumVertices(); index++)
+	const F32* weights = job.mWeights;
+	const LLVector3* coords = job.mCoords;
+	const LLVector3* normals = job.mNormals;
+	for (U32 index = 0; index < job.mNumVertices; index++)
 	{
-		U32 bidx = index + mMesh->mFaceVertexOffset;
-		
 		// blend by first matrix
 		F32 w = weights[index]; 
 		
@@ -812,8 +803,8 @@ void LLViewerJointMesh::updateGeometryOriginal(LLFace *mFace, LLPolyMesh *mMesh)
 		// common case.  JC
 		if (w == last_weight)
 		{
-			o_vertices[bidx] = coords[index] * gBlendMat;
-			o_normals[bidx] = normals[index] * gBlendRotMat;
+			job.mOutVertices[index] = coords[index] * gBlendMat;
+			job.mOutNormals[index] = normals[index] * gBlendRotMat;
 			continue;
 		}
 		
@@ -825,18 +816,18 @@ void LLViewerJointMesh::updateGeometryOriginal(LLFace *mFace, LLPolyMesh *mMesh)
 		// No lerp required in this case.
 		if (w == 1.0f)
 		{
-			gBlendMat = gJointMatUnaligned[joint+1];
-			o_vertices[bidx] = coords[index] * gBlendMat;
-			gBlendRotMat = gJointRotUnaligned[joint+1];
-			o_normals[bidx] = normals[index] * gBlendRotMat;
+			gBlendMat = job.mJointMat[joint+1];
+			job.mOutVertices[index] = coords[index] * gBlendMat;
+			gBlendRotMat = gBlendMat.getMat3();
+			job.mOutNormals[index] = normals[index] * gBlendRotMat;
 			continue;
 		}
 		
 		// Try to keep all the accesses to the matrix data as close
 		// together as possible.  This function is a hot spot on the
 		// Mac. JC
-		LLMatrix4 &m0 = gJointMatUnaligned[joint+1];
-		LLMatrix4 &m1 = gJointMatUnaligned[joint+0];
+		const LLMatrix4 &m0 = job.mJointMat[joint+1];
+		const LLMatrix4 &m1 = job.mJointMat[joint+0];
 		
 		gBlendMat.mMatrix[VX][VX] = lerp(m1.mMatrix[VX][VX], m0.mMatrix[VX][VX], w);
 		gBlendMat.mMatrix[VX][VY] = lerp(m1.mMatrix[VX][VY], m0.mMatrix[VX][VY], w);
@@ -854,27 +845,68 @@ void LLViewerJointMesh::updateGeometryOriginal(LLFace *mFace, LLPolyMesh *mMesh)
 		gBlendMat.mMatrix[VW][VY] = lerp(m1.mMatrix[VW][VY], m0.mMatrix[VW][VY], w);
 		gBlendMat.mMatrix[VW][VZ] = lerp(m1.mMatrix[VW][VZ], m0.mMatrix[VW][VZ], w);
 
-		o_vertices[bidx] = coords[index] * gBlendMat;
+		job.mOutVertices[index] = coords[index] * gBlendMat;
 		
-		LLMatrix3 &n0 = gJointRotUnaligned[joint+1];
-		LLMatrix3 &n1 = gJointRotUnaligned[joint+0];
+		// The skin offsets only moved the translation row, the rotation is
+		// the blend of the joint rotations
+		gBlendRotMat = gBlendMat.getMat3();
 		
-		gBlendRotMat.mMatrix[VX][VX] = lerp(n1.mMatrix[VX][VX], n0.mMatrix[VX][VX], w);
-		gBlendRotMat.mMatrix[VX][VY] = lerp(n1.mMatrix[VX][VY], n0.mMatrix[VX][VY], w);
-		gBlendRotMat.mMatrix[VX][VZ] = lerp(n1.mMatrix[VX][VZ], n0.mMatrix[VX][VZ], w);
+		job.mOutNormals[index] = normals[index] * gBlendRotMat;
+	}
+}
+
+BOOL LLViewerJointMesh::setupSkinJob(LLSkinJob& job)
+{
+	if (!(mValid
+		  && mMesh
+		  && mFace
+		  && mMesh->hasWeights()
+		  && mFace->mVertexBuffer.notNull()
+		  && LLViewerShaderMgr::instance()->getVertexShaderLevel(LLViewerShaderMgr::SHADER_AVATAR) == 0))
+	{
+		return FALSE;
+	}
 
-		gBlendRotMat.mMatrix[VY][VX] = lerp(n1.mMatrix[VY][VX], n0.mMatrix[VY][VX], w);
-		gBlendRotMat.mMatrix[VY][VY] = lerp(n1.mMatrix[VY][VY], n0.mMatrix[VY][VY], w);
-		gBlendRotMat.mMatrix[VY][VZ] = lerp(n1.mMatrix[VY][VZ], n0.mMatrix[VY][VZ], w);
+	LLDynamicArray<LLJointRenderData*>& joint_data = mMesh->getReferenceMesh()->mJointRenderData;
+	if (joint_data.count() > LLSkinJob::MAX_JOINTS)
+	{
+		llwarns << "Too many joints to skin " << getName() << llendl;
+		return FALSE;
+	}
 
-		gBlendRotMat.mMatrix[VZ][VX] = lerp(n1.mMatrix[VZ][VX], n0.mMatrix[VZ][VX], w);
-		gBlendRotMat.mMatrix[VZ][VY] = lerp(n1.mMatrix[VZ][VY], n0.mMatrix[VZ][VY], w);
-		gBlendRotMat.mMatrix[VZ][VZ] = lerp(n1.mMatrix[VZ][VZ], n0.mMatrix[VZ][VZ], w);
-		
-		o_normals[bidx] = normals[index] * gBlendRotMat;
+	// Add the skin offsets to the world matrices, a joint without a skin
+	// joint is the parent end of the next one
+	job.mNumJoints = joint_data.count();
+	for (U32 j = 0; j < job.mNumJoints; ++j)
+	{
+		const LLVector3& offset = joint_data[j]->mSkinJoint ?
+			joint_data[j]->mSkinJoint->mRootToJointSkinOffset
+			: joint_data[j+1]->mSkinJoint->mRootToParentJointSkinOffset;
+		job.mJointMat[j] = *joint_data[j]->mWorldMatrix;
+		job.mJointMat[j].translate(offset * job.mJointMat[j].getMat3());
+	}
+
+	LLVertexBuffer *buffer = mFace->mVertexBuffer;
+	if (!buffer->getVertexStrider(job.mOutVertices, mMesh->mFaceVertexOffset)
+		|| !buffer->getNormalStrider(job.mOutNormals, mMesh->mFaceVertexOffset))
+	{
+		return FALSE;
 	}
 
-	buffer->setBuffer(0);
+	job.mWeights = mMesh->getWeights();
+	job.mCoords = mMesh->getCoords();
+	job.mNormals = mMesh->getNormals();
+	job.mNumVertices = mMesh->getNumVertices();
+	return TRUE;
+}
+
+void LLViewerJointMesh::addSkinJobs(std::vector<LLSkinJob>& jobs)
+{
+	jobs.resize(jobs.size() + 1);
+	if (!setupSkinJob(jobs.back()))
+	{
+		jobs.pop_back();
+	}
 }
 
 const U32 UPDATE_GEOMETRY_CALL_MASK			= 0x1FFF; // 8K samples before overflow
@@ -893,7 +925,14 @@ static BOOL sVectorizePerfTest 				= FALSE;
 static U32 sVectorizeProcessor 				= 0;
 
 //static
-void (*LLViewerJointMesh::sUpdateGeometryFunc)(LLFace* face, LLPolyMesh* mesh);
+void (*LLViewerJointMesh::sUpdateGeometryFunc)(LLSkinJob& job);
+
+//static
+BOOL LLViewerJointMesh::canSkinInBatches()
+{
+	// The timing compares one updateJointGeometry() call at a time
+	return !sVectorizePerfTest;
+}
 
 //static
 void LLViewerJointMesh::updateVectorize()
@@ -936,12 +975,8 @@ void LLViewerJointMesh::updateVectorize()
 
 void LLViewerJointMesh::updateJointGeometry()
 {
-	if (!(mValid
-		  && mMesh
-		  && mFace
-		  && mMesh->hasWeights()
-		  && mFace->mVertexBuffer.notNull()
-		  && LLViewerShaderMgr::instance()->getVertexShaderLevel(LLViewerShaderMgr::SHADER_AVATAR) == 0))
+	LLSkinJob job;
+	if (!setupSkinJob(job))
 	{
 		return;
 	}
@@ -950,9 +985,7 @@ void LLViewerJointMesh::updateJointGeometry()
 	{
 		// Once we've measured performance, just run the specified
 		// code version.
-		if(sUpdateGeometryFunc == updateGeometryOriginal)
-			uploadJointMatrices();
-		sUpdateGeometryFunc(mFace, mMesh);
+		sUpdateGeometryFunc(job);
 	}
 	else
 	{
@@ -962,15 +995,12 @@ void LLViewerJointMesh::updateJointGeometry()
 		
 		if (sUpdateGeometryCallPointer)
 		{
-			if(sUpdateGeometryFunc == updateGeometryOriginal)
-				uploadJointMatrices();
 			// call accelerated version for this processor
-			sUpdateGeometryFunc(mFace, mMesh);
+			sUpdateGeometryFunc(job);
 		}
 		else
 		{
-			uploadJointMatrices();
-			updateGeometryOriginal(mFace, mMesh);
+			updateGeometryOriginal(job);
 		}
 	
 		sUpdateGeometryElapsedTime += ug_timer.getElapsedTimeF64();
@@ -1071,6 +1101,118 @@ void LLViewerJointMesh::updateJointGeometry()
 	}
 }
 
+//static
+void LLViewerJointMesh::benchmarkSkinning(const std::vector<LLPolyMesh*>& meshes, LLSkinThread* thread)
+{
+	const S32 ROUNDS = 100;
+
+	// Skin every mesh into scratch arrays against a made up pose, the joints
+	// turned and raised a little more each
+	U32 num_vertices = 0;
+	for (std::vector<LLPolyMesh*>::const_iterator iter = meshes.begin(); iter != meshes.end(); ++iter)
+	{
+		num_vertices += (*iter)->hasWeights() ? (*iter)->getNumVertices() : 0;
+	}
+	if (!num_vertices)
+	{
+		return;
+	}
+	std::vector<LLVector3> out_vertices(num_vertices);
+	std::vector<LLVector3> out_normals(num_vertices);
+
+	std::vector<LLSkinJob> jobs;
+	U32 first_vertex = 0;
+	for (std::vector<LLPolyMesh*>::const_iterator iter = meshes.begin(); iter != meshes.end(); ++iter)
+	{
+		LLPolyMesh* mesh = *iter;
+		if (!mesh->hasWeights())
+		{
+			continue;
+		}
+
+		jobs.resize(jobs.size() + 1);
+		LLSkinJob& job = jobs.back();
+		job.mWeights = mesh->getWeights();
+		job.mCoords = mesh->getCoords();
+		job.mNormals = mesh->getNormals();
+		job.mNumVertices = mesh->getNumVertices();
+		job.mNumJoints = LLSkinJob::MAX_JOINTS;
+		for (U32 j = 0; j < job.mNumJoints; ++j)
+		{
+			job.mJointMat[j] = LLMatrix4(LLQuaternion((F32) j * 0.1f, LLVector3::z_axis), LLVector4(0.f, 0.f, (F32) j * 0.1f));
+		}
+		job.mOutVertices = &out_vertices[first_vertex];
+		job.mOutNormals = &out_normals[first_vertex];
+		first_vertex += job.mNumVertices;
+
+		for (U32 i = 0; i < job.mNumVertices; ++i)
+		{
+			if (llfloor(job.mWeights[i]) + 1 >= LLSkinJob::MAX_JOINTS)
+			{
+				llwarns << "Skinning benchmark mesh has too many joints" << llendl;
+				return;
+			}
+		}
+	}
+
+	struct SkinFunc
+	{
+		const char* mName;
+		void (*mFunc)(LLSkinJob& job);
+		BOOL mSupported;
+	};
+	SkinFunc funcs[] =
+	{
+		{ "compiler default", &updateGeometryOriginal, TRUE },
+		{ "vectorized", &updateGeometryVectorized, TRUE },
+		{ "SSE", &updateGeometrySSE, gSysCPU.hasSSE() },
+		{ "SSE2", &updateGeometrySSE2, gSysCPU.hasSSE2() }
+	};
+
+	void (*saved_func)(LLSkinJob& job) = sUpdateGeometryFunc;
+	for (U32 f = 0; f < LL_ARRAY_SIZE(funcs); ++f)
+	{
+		if (!funcs[f].mSupported)
+		{
+			continue;
+		}
+
+		// LLSkinThread runs jobs through skin()
+		sUpdateGeometryFunc = funcs[f].mFunc;
+
+		LLTimer timer;
+		for (S32 round = 0; round < ROUNDS; ++round)
+		{
+			for (std::vector<LLSkinJob>::iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+			{
+				skin(*iter);
+			}
+		}
+		F64 serial_time = timer.getElapsedTimeF64();
+
+		F64 threaded_time = 0.0;
+		if (thread)
+		{
+			timer.reset();
+			for (S32 round = 0; round < ROUNDS; ++round)
+			{
+				thread->skin(jobs);
+			}
+			threaded_time = timer.getElapsedTimeF64();
+		}
+
+		llinfos << "Skinning " << jobs.size() << " meshes (" << num_vertices << " vertices) "
+			<< funcs[f].mName << ": " << serial_time * 1000.0 / ROUNDS << " ms";
+		if (thread)
+		{
+			llcont << ", " << threaded_time * 1000.0 / ROUNDS << " ms on "
+				<< thread->getWorkerCount() + 1 << " threads";
+		}
+		llcont << llendl;
+	}
+	sUpdateGeometryFunc = saved_func;
+}
+
 void LLViewerJointMesh::dump()
 {
 	if (mValid)
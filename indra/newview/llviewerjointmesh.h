@@ -30,11 +30,14 @@
 #include "llviewerjoint.h"
 #include "llviewertexture.h"
 #include "llpolymesh.h"
+#include "llstrider.h"
+#include "m4math.h"
 #include "v4color.h"
 
 class LLDrawable;
 class LLFace;
 class LLCharacter;
+class LLSkinThread;
 class LLTexLayerSet;
 
 typedef enum e_avatar_render_pass
@@ -56,6 +59,26 @@ public:
 	LLVector3		mRootToParentJointSkinOffset;
 };
 
+//-----------------------------------------------------------------------------
+// struct LLSkinJob
+// Software skinning of one mesh.  LLViewerJointMesh::setupSkinJob() fills it
+// in on the main thread, the skinning functions only go through it and can
+// run on any thread.
+//-----------------------------------------------------------------------------
+struct LLSkinJob
+{
+	enum { MAX_JOINTS = 32 };
+
+	const F32*				mWeights;
+	const LLVector3*		mCoords;
+	const LLVector3*		mNormals;
+	U32						mNumVertices;
+	U32						mNumJoints;
+	LLMatrix4				mJointMat[MAX_JOINTS];	// world matrices with the skin offsets added
+	LLStrider<LLVector3>	mOutVertices;	// the mesh's first vertex in the face's buffer
+	LLStrider<LLVector3>	mOutNormals;
+};
+
 //-----------------------------------------------------------------------------
 // class LLViewerJointMesh
 //-----------------------------------------------------------------------------
@@ -137,8 +160,24 @@ public:
 	/*virtual*/ void updateFaceData(LLFace *face, F32 pixel_area, BOOL damp_wind = FALSE, bool terse_update = false);
 	/*virtual*/ BOOL updateLOD(F32 pixel_area, BOOL activate);
 	/*virtual*/ void updateJointGeometry();
+	/*virtual*/ void addSkinJobs(std::vector<LLSkinJob>& jobs);
 	/*virtual*/ void dump();
 
+	// MAIN thread. Sets up job to skin this mesh into its face, mapping the
+	// face's vertex buffer. FALSE if there is nothing to skin.
+	BOOL setupSkinJob(LLSkinJob& job);
+
+	// Any thread. Skins with the code picked for this processor.
+	static void skin(LLSkinJob& job) { sUpdateGeometryFunc(job); }
+
+	// FALSE while VectorizePerfTest times updateJointGeometry() calls
+	static BOOL canSkinInBatches();
+
+	// Logs how long skinning meshes takes with each version of the skinning
+	// code this processor can run, on the main thread alone and together
+	// with thread when it is not NULL
+	static void benchmarkSkinning(const std::vector<LLPolyMesh*>& meshes, LLSkinThread* thread);
+
 	void setIsTransparent(BOOL is_transparent) { mIsTransparent = is_transparent; }
 
 	/*virtual*/ BOOL isAnimatable() const { return FALSE; }
@@ -152,14 +191,14 @@ private:
 	//
 	// These functions require compiler options for SSE2, SSE, or neither, and
 	// hence are contained in separate individual .cpp files.  JC
-	static void updateGeometryOriginal(LLFace* face, LLPolyMesh* mesh);
+	static void updateGeometryOriginal(LLSkinJob& job);
 	// generic vector code, used for Altivec
-	static void updateGeometryVectorized(LLFace* face, LLPolyMesh* mesh);
-	static void updateGeometrySSE(LLFace* face, LLPolyMesh* mesh);
-	static void updateGeometrySSE2(LLFace* face, LLPolyMesh* mesh);
+	static void updateGeometryVectorized(LLSkinJob& job);
+	static void updateGeometrySSE(LLSkinJob& job);
+	static void updateGeometrySSE2(LLSkinJob& job);
 
 	// Use a fuction pointer to indicate which version we are running.
-	static void (*sUpdateGeometryFunc)(LLFace* face, LLPolyMesh* mesh);
+	static void (*sUpdateGeometryFunc)(LLSkinJob& job);
 
 private:
 	// Allocate skin data
@@ -56,56 +56,33 @@
 #if LL_VECTORIZE
 
 
-inline void matrix_translate(LLV4Matrix4& m, const LLMatrix4* w, const LLVector3& j)
-{
-	m.mV[VX] = _mm_loadu_ps(w->mMatrix[VX]);
-	m.mV[VY] = _mm_loadu_ps(w->mMatrix[VY]);
-	m.mV[VZ] = _mm_loadu_ps(w->mMatrix[VZ]);
-	m.mV[VW] = _mm_loadu_ps(w->mMatrix[VW]);
-	m.mV[VW] = _mm_add_ps(m.mV[VW], _mm_mul_ps(_mm_set1_ps(j.mV[VX]), m.mV[VX])); // ( ax * vx ) + vw
-	m.mV[VW] = _mm_add_ps(m.mV[VW], _mm_mul_ps(_mm_set1_ps(j.mV[VY]), m.mV[VY]));
-	m.mV[VW] = _mm_add_ps(m.mV[VW], _mm_mul_ps(_mm_set1_ps(j.mV[VZ]), m.mV[VZ]));
-}
-
 // static
-void LLViewerJointMesh::updateGeometrySSE2(LLFace *face, LLPolyMesh *mesh)
+void LLViewerJointMesh::updateGeometrySSE2(LLSkinJob& job)
 {
 	// This cannot be a file-level static because it will be initialized
 	// before main() using SSE code, which will crash on non-SSE processors.
-	static LLV4Matrix4	sJointMat[32];
-	LLDynamicArray<LLJointRenderData*>& joint_data = mesh->getReferenceMesh()->mJointRenderData;
-
-	//upload joint pivots/matrices
-	for(S32 j = 0, jend = joint_data.count(); j < jend ; ++j )
+	// It is not a function-level static either so workers can skin at once.
+	LLV4Matrix4			joint_mat[LLSkinJob::MAX_JOINTS];
+	for (U32 j = 0; j < job.mNumJoints; ++j)
 	{
-		matrix_translate(sJointMat[j], joint_data[j]->mWorldMatrix,
-			joint_data[j]->mSkinJoint ?
-				joint_data[j]->mSkinJoint->mRootToJointSkinOffset
-				: joint_data[j+1]->mSkinJoint->mRootToParentJointSkinOffset);
+		joint_mat[j] = job.mJointMat[j];
 	}
 
 	F32					weight		= F32_MAX;
 	LLV4Matrix4			blend_mat;
 
-	LLStrider<LLVector3> o_vertices;
-	LLStrider<LLVector3> o_normals;
-
-	LLVertexBuffer *buffer = face->mVertexBuffer;
-	buffer->getVertexStrider(o_vertices,  mesh->mFaceVertexOffset);
-	buffer->getNormalStrider(o_normals,   mesh->mFaceVertexOffset);
-
-	const F32*			weights			= mesh->getWeights();
-	const LLVector3*	coords			= mesh->getCoords();
-	const LLVector3*	normals			= mesh->getNormals();
-	for (U32 index = 0, index_end = mesh->getNumVertices(); index < index_end; ++index)
+	const F32*			weights			= job.mWeights;
+	const LLVector3*	coords			= job.mCoords;
+	const LLVector3*	normals			= job.mNormals;
+	for (U32 index = 0, index_end = job.mNumVertices; index < index_end; ++index)
 	{
 		if( weight != weights[index])
 		{
 			S32 joint = llfloor(weight = weights[index]);
-			blend_mat.lerp(sJointMat[joint], sJointMat[joint+1], weight - joint);
+			blend_mat.lerp(joint_mat[joint], joint_mat[joint+1], weight - joint);
 		}
-		blend_mat.multiply(coords[index], o_vertices[index]);
-		((LLV4Matrix3)blend_mat).multiply(normals[index], o_normals[index]);
+		blend_mat.multiply(coords[index], job.mOutVertices[index]);
+		((LLV4Matrix3)blend_mat).multiply(normals[index], job.mOutNormals[index]);
 	}
 	
 	//setBuffer(0) called in LLVOAvatar::renderSkinned
@@ -113,9 +90,9 @@ void LLViewerJointMesh::updateGeometrySSE2(LLFace *face, LLPolyMesh *mesh)
 
 #else
 
-void LLViewerJointMesh::updateGeometrySSE2(LLFace *face, LLPolyMesh *mesh)
+void LLViewerJointMesh::updateGeometrySSE2(LLSkinJob& job)
 {
-	LLViewerJointMesh::updateGeometryVectorized(face, mesh);
+	LLViewerJointMesh::updateGeometryVectorized(job);
 }
 
 #endif
@@ -44,52 +44,28 @@
 // on PowerPC.
 
 // static
-void LLViewerJointMesh::updateGeometryVectorized(LLFace *face, LLPolyMesh *mesh)
+void LLViewerJointMesh::updateGeometryVectorized(LLSkinJob& job)
 {
-	static LLV4Matrix4	sJointMat[32];
-	LLDynamicArray<LLJointRenderData*>& joint_data = mesh->getReferenceMesh()->mJointRenderData;
-	S32 j, joint_num, joint_end = joint_data.count();
-	LLV4Vector3 pivot;
-
-	//upload joint pivots/matrices
-	for(j = joint_num = 0; joint_num < joint_end ; ++joint_num )
+	LLV4Matrix4			joint_mat[LLSkinJob::MAX_JOINTS];
+	for (U32 j = 0; j < job.mNumJoints; ++j)
 	{
-		LLSkinJoint *sj;
-		const LLMatrix4 *	wm = joint_data[joint_num]->mWorldMatrix;
-		if (NULL == (sj = joint_data[joint_num]->mSkinJoint))
-		{
-				sj = joint_data[++joint_num]->mSkinJoint;
-				((LLV4Matrix3)(sJointMat[j] = *wm)).multiply(sj->mRootToParentJointSkinOffset, pivot);
-				sJointMat[j++].translate(pivot);
-				wm = joint_data[joint_num]->mWorldMatrix;
-		}
-		((LLV4Matrix3)(sJointMat[j] = *wm)).multiply(sj->mRootToJointSkinOffset, pivot);
-		sJointMat[j++].translate(pivot);
+		joint_mat[j] = job.mJointMat[j];
 	}
 
 	F32					weight		= F32_MAX;
 	LLV4Matrix4			blend_mat;
 
-	LLStrider<LLVector3> o_vertices;
-	LLStrider<LLVector3> o_normals;
-
-	LLVertexBuffer *buffer = face->mVertexBuffer;
-	buffer->getVertexStrider(o_vertices,  mesh->mFaceVertexOffset);
-	buffer->getNormalStrider(o_normals,   mesh->mFaceVertexOffset);
-
-	const F32*			weights			= mesh->getWeights();
-	const LLVector3*	coords			= mesh->getCoords();
-	const LLVector3*	normals			= mesh->getNormals();
-	for (U32 index = 0, index_end = mesh->getNumVertices(); index < index_end; ++index)
+	const F32*			weights			= job.mWeights;
+	const LLVector3*	coords			= job.mCoords;
+	const LLVector3*	normals			= job.mNormals;
+	for (U32 index = 0, index_end = job.mNumVertices; index < index_end; ++index)
 	{
 		if( weight != weights[index])
 		{
 			S32 joint = llfloor(weight = weights[index]);
-			blend_mat.lerp(sJointMat[joint], sJointMat[joint+1], weight - joint);
+			blend_mat.lerp(joint_mat[joint], joint_mat[joint+1], weight - joint);
 		}
-		blend_mat.multiply(coords[index], o_vertices[index]);
-		((LLV4Matrix3)blend_mat).multiply(normals[index], o_normals[index]);
+		blend_mat.multiply(coords[index], job.mOutVertices[index]);
+		((LLV4Matrix3)blend_mat).multiply(normals[index], job.mOutNormals[index]);
 	}
-
-	buffer->setBuffer(0);
 }
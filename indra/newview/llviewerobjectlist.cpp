@@ -29,6 +29,7 @@
 #include "llviewerobjectlist.h"
 
 #include "message.h"
+#include "llmessageviews.h"
 #include "timing.h"
 #include "llfasttimer.h"
 #include "llrender.h"
@@ -353,10 +354,11 @@ void LLViewerObjectList::processObjectUpdate(LLMessageSystem *mesgsys,
 
 		if (cached)
 		{
-			U32 id;
-			U32 crc;
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_ID, id, i);
-			mesgsys->getU32Fast(_PREHASH_ObjectData, _PREHASH_CRC, crc, i);
+			// Only ObjectUpdateCached is handled with cached set
+			LLMessageViews::ObjectUpdateCached cached_update(mesgsys);
+			LLMessageViews::ObjectUpdateCached::ObjectDataBlock object_data = cached_update.getObjectData(i);
+			U32 id = object_data.getID();
+			U32 crc = object_data.getCRC();
 		
 			// Lookup data packer and add this id to cache miss lists if necessary.
 			cached_dpp = regionp->getDP(id, crc);
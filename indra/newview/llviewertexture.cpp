@@ -1462,9 +1462,13 @@ BOOL LLViewerFetchedTexture::createTexture(S32 usename/*= 0*/)
 		
 		if(!(res = insertToAtlas()))
 		{
+			mGLTexturep->setStagedUpload(mRawUpload);
 			res = mGLTexturep->createGLTexture(mRawDiscardLevel, mRawImage, usename, TRUE, mBoostLevel);
 			resetFaceAtlas() ;
 		}
+		// The atlas copies out of mRawImage, either way the staged buffer
+		// goes back to its pool now, even if the raw image is kept
+		mRawUpload = NULL;
 		setActive() ;
 	}
 
@@ -1836,12 +1840,12 @@ bool LLViewerFetchedTexture::updateFetch()
 
 	if (mIsFetching)
 	{
-		// Sets mRawDiscardLevel, mRawImage, mAuxRawImage
+		// Sets mRawDiscardLevel, mRawImage, mAuxRawImage, mRawUpload
 		S32 fetch_discard = current_discard;
 		
 		if (mRawImage.notNull()) sRawCount--;
 		if (mAuxRawImage.notNull()) sAuxCount--;
-		bool finished = LLAppViewer::getTextureFetch()->getRequestFinished(getID(), fetch_discard, mRawImage, mAuxRawImage);
+		bool finished = LLAppViewer::getTextureFetch()->getRequestFinished(getID(), fetch_discard, mRawImage, mAuxRawImage, mRawUpload);
 		if (mRawImage.notNull()) sRawCount++;
 		if (mAuxRawImage.notNull()) sAuxCount++;
 		if (finished)
@@ -2559,6 +2563,7 @@ void LLViewerFetchedTexture::destroyRawImage()
 
 	mRawImage = NULL;
 	mAuxRawImage = NULL;
+	mRawUpload = NULL;
 	mIsRawImageValid = FALSE;
 	mRawDiscardLevel = INVALID_DISCARD_LEVEL;
 }
@@ -2742,9 +2747,18 @@ F32 LLViewerFetchedTexture::getElapsedLastReferencedSavedRawImageTime() const
 //----------------------------------------------------------------------------------------------
 //atlasing
 //----------------------------------------------------------------------------------------------
+//called once the image has a GL texture of its own: faces still sampling an
+//atlas slot would keep the lower resolution copy, move them back.
 void LLViewerFetchedTexture::resetFaceAtlas()
 {
-	//Nothing should be done here.
+	for(U32 i = 0 ; i < mNumFaces ; i++)
+	{
+		if(mFaceList[i]->getAtlasInfo())
+		{
+			invalidateAtlas(TRUE) ;
+			break ;
+		}
+	}
 }
 
 //invalidate all atlas slots for this image.
@@ -2779,6 +2793,15 @@ BOOL LLViewerFetchedTexture::insertToAtlas()
 	{
 		return FALSE ;
 	}
+	//the image needs a GL texture anyway if any of its faces can not sample an atlas,
+	//then none of them use one.
+	for(U32 i = 0 ; i < mNumFaces ; i++)
+	{
+		if(!mFaceList[i]->canUseAtlas())
+		{
+			return FALSE ;
+		}
+	}
 
 	BOOL ret = TRUE ;//if ret is set to false, will generate a gl texture for this image.
 	S32 raw_w = mRawImage->getWidth() ;
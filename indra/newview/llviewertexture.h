@@ -43,6 +43,7 @@
 
 class LLFace;
 class LLImageGL ;
+class LLImageGLUpload;
 class LLImageRaw;
 class LLViewerObject;
 class LLViewerTexture;
@@ -537,6 +538,7 @@ protected:
 
 	LLPointer<LLImageRaw> mRawImage;
 	S32 mRawDiscardLevel;
+	LLPointer<LLImageGLUpload> mRawUpload; // copy of mRawImage a decode thread staged for upload, may be NULL
 
 	// Used ONLY for cloth meshes right now.  Make SURE you know what you're 
 	// doing if you use it for anything else! - djs
@@ -33,6 +33,7 @@
 #include "imageids.h"
 #include "llgl.h" // fot gathering stats from GL
 #include "llimagegl.h"
+#include "llimageglupload.h"
 #include "llimagebmp.h"
 #include "llimagej2c.h"
 #include "llimagetga.h"
@@ -748,8 +749,21 @@ F32 LLViewerTextureList::updateImagesCreateTextures(F32 max_time)
 	// decoded, but haven't been pushed into GL).
 	//
 	LLFastTimer t(FTM_IMAGE_CREATE);
+
+	static LLCachedControl<bool> upload_pbo(gSavedSettings, "RenderTextureUploadPBO");
+	static LLCachedControl<U32> staging_mb(gSavedSettings, "TextureUploadStagingMB");
+	static LLCachedControl<U32> budget_kb(gSavedSettings, "TextureUploadBudgetKB");
 	
 	LLTimer create_timer;
+
+	// Hand the decode threads back the pixel buffers uploaded from last frame
+	LLImageGLUpload::sEnabled = upload_pbo && gGLManager.mHasPixelBufferObject;
+	LLImageGLUpload::sMaxPoolBytes = (U32) staging_mb << 20;
+	LLImageGLUpload::updateClass();
+
+	// Anything uploaded this frame counts against the budget, 0 means no budget
+	U32 budget_bytes = (U32) budget_kb << 10;
+
 	image_list_t::iterator enditer = mCreateTextureList.begin();
 	for (image_list_t::iterator iter = mCreateTextureList.begin();
 		 iter != mCreateTextureList.end();)
@@ -762,6 +776,10 @@ F32 LLViewerTextureList::updateImagesCreateTextures(F32 max_time)
 		{
 			break;
 		}
+		if (budget_bytes && LLImageGL::sCurUploadBytes >= budget_bytes)
+		{
+			break;
+		}
 	}
 	mCreateTextureList.erase(mCreateTextureList.begin(), enditer);
 	return create_timer.getElapsedTimeF32();
@@ -30,8 +30,9 @@
 #include "llviewercontrol.h"
 #include "message.h"
 #include "llagent.h"
+#include "llcircuit.h"
 #include "llframetimer.h"
-#include "llviewerstats.h"
+#include "llviewerregion.h"
 #include "lldatapacker.h"
 
 using namespace LLOldEvents;
@@ -47,10 +48,6 @@ const F32 MIN_FRACTIONAL = 0.2f;
 
 const F32 MIN_BANDWIDTH = 50.f;
 const F32 MAX_BANDWIDTH = 3000.f;
-const F32 STEP_FRACTIONAL = 0.1f;
-const F32 TIGHTEN_THROTTLE_THRESHOLD = 3.0f; // packet loss % per s
-const F32 EASE_THROTTLE_THRESHOLD = 0.5f; // packet loss % per s
-const F32 DYNAMIC_UPDATE_DURATION = 5.0f; // seconds
 
 LLViewerThrottle gViewerThrottle;
 
@@ -294,40 +291,52 @@ void LLViewerThrottle::resetDynamicThrottle()
 
 	mCurrentBandwidth = mMaxBandwidth*MAX_FRACTIONAL;
 	mCurrent = getThrottleGroup(mCurrentBandwidth / 1024.0f);
+
+	// Have the circuit start over from here
+	mCongestionHost.invalidate();
 }
 
 void LLViewerThrottle::updateDynamicThrottle()
 {
-	if (mUpdateTimer.getElapsedTimeF32() < DYNAMIC_UPDATE_DURATION)
+	LLViewerRegion* regionp = gAgent.getRegion();
+	if (!regionp || mMaxBandwidth <= 0.f)
+	{
+		return;
+	}
+	LLCircuitData* cdp = gMessageSystem->mCircuitInfo.findCircuit(regionp->getHost());
+	if (!cdp)
 	{
 		return;
 	}
-	mUpdateTimer.reset();
 
-	if (LLViewerStats::getInstance()->mPacketsLostPercentStat.getMean() > TIGHTEN_THROTTLE_THRESHOLD)
+	// The region's circuit says how much of the user's bandwidth the path
+	// to it will take, between MIN_FRACTIONAL and MAX_FRACTIONAL of it
+	LLCongestionController& congestion = cdp->getCongestionController();
+	congestion.setRange(llmax(mMaxBandwidth * MIN_FRACTIONAL, MIN_BANDWIDTH * 1024.f),
+						llmin(mMaxBandwidth * MAX_FRACTIONAL, MAX_BANDWIDTH * 1024.f));
+
+	BOOL changed = congestion.update(LLMessageSystem::getMessageTimeSeconds(),
+									 cdp->getPacketsIn(), cdp->getPacketsLost());
+	if (regionp->getHost() != mCongestionHost)
 	{
-		if (mThrottleFrac <= MIN_FRACTIONAL || mCurrentBandwidth / 1024.0f <= MIN_BANDWIDTH)
-		{
-			return;
-		}
-		mThrottleFrac -= STEP_FRACTIONAL;
-		mThrottleFrac = llmax(MIN_FRACTIONAL, mThrottleFrac);
-		mCurrentBandwidth = mMaxBandwidth * mThrottleFrac;
-		mCurrent = getThrottleGroup(mCurrentBandwidth / 1024.0f);
-		mCurrent.sendToSim();
-		llinfos << "Tightening network throttle to " << mCurrentBandwidth << llendl;
+		// New region, same access link: start from what we had
+		mCongestionHost = regionp->getHost();
+		congestion.setRate(mCurrentBandwidth);
+		changed = FALSE;
 	}
-	else if (LLViewerStats::getInstance()->mPacketsLostPercentStat.getMean() <= EASE_THROTTLE_THRESHOLD)
+	if (!changed)
 	{
-		if (mThrottleFrac >= MAX_FRACTIONAL || mCurrentBandwidth / 1024.0f >= MAX_BANDWIDTH)
-		{
-			return;
-		}
-		mThrottleFrac += STEP_FRACTIONAL;
-		mThrottleFrac = llmin(MAX_FRACTIONAL, mThrottleFrac);
-		mCurrentBandwidth = mMaxBandwidth * mThrottleFrac;
-		mCurrent = getThrottleGroup(mCurrentBandwidth/1024.0f);
-		mCurrent.sendToSim();
-		llinfos << "Easing network throttle to " << mCurrentBandwidth << llendl;
+		return;
 	}
+
+	F32 old_bandwidth = mCurrentBandwidth;
+	mCurrentBandwidth = congestion.getRate();
+	mThrottleFrac = mCurrentBandwidth / mMaxBandwidth;
+	mCurrent = getThrottleGroup(mCurrentBandwidth / 1024.0f);
+	mCurrent.sendToSim();
+	llinfos << (mCurrentBandwidth < old_bandwidth ? "Tightening" : "Easing")
+			<< " network throttle to " << mCurrentBandwidth
+			<< " loss " << congestion.getLossRate()
+			<< " ping " << congestion.getSmoothedRTT()
+			<< " min ping " << congestion.getMinRTT() << llendl;
 }
@@ -31,6 +31,7 @@
 
 #include "llstring.h"
 #include "llframetimer.h"
+#include "llhost.h"
 #include "llthrottle.h"
 
 class LLViewerThrottleGroup
@@ -81,8 +82,8 @@ protected:
 
 	std::vector<LLViewerThrottleGroup> mPresets;
 	
-	LLFrameTimer mUpdateTimer;
 	F32 mThrottleFrac;
+	LLHost mCongestionHost;		// region whose circuit sets mCurrentBandwidth
 };
 
 extern LLViewerThrottle gViewerThrottle;
@@ -118,6 +118,7 @@
 #include "llhudobject.h"
 #include "llhudview.h"
 #include "llimagebmp.h"
+#include "llimageglupload.h"
 #include "llimagej2c.h"
 #include "llimageworker.h"
 #include "llkeyboard.h"
@@ -464,7 +465,16 @@ public:
 			addText(xpos, ypos, llformat("%d Unique Textures", LLImageGL::sUniqueCount));
 			ypos += y_inc;
 
-			addText(xpos, ypos, llformat("%d Render Calls", gPipeline.mBatchCount));
+			F32 upload_kb = LLImageGL::sUploadBytes / 1024.f;
+			addText(xpos, ypos, llformat("Texture Upload: %.0f KB/s (%.0f%% staged), %d staging misses, %.2f ms mapping",
+				gFrameIntervalSeconds > 0.f ? upload_kb / gFrameIntervalSeconds : 0.f,
+				LLImageGL::sUploadBytes > 0 ? 100.f * LLImageGL::sStagedUploadBytes / LLImageGL::sUploadBytes : 0.f,
+				LLImageGLUpload::sMisses, LLImageGLUpload::sMapTime * 1000.f));
+			ypos += y_inc;
+
+			addText(xpos, ypos, llformat("%d Render Calls (%d without texture atlases)", gPipeline.mBatchCount,
+				gPipeline.mBatchCount + gPipeline.mAtlasMergedBatchCount));
+			gPipeline.mAtlasMergedBatchCount = 0;
             ypos += y_inc;
 
 			addText(xpos, ypos, llformat("%d Matrix Ops", gPipeline.mMatrixOpCount));
@@ -491,6 +501,16 @@ public:
 			LLRender::sUICalls = LLRender::sUIVerts = 0;
 			ypos += y_inc;
 
+			addText(xpos, ypos, llformat("Immediate Batches/Draws: %d/%d (%d saved)", LLRender::sBatchCount, LLRender::sDrawCount,
+				LLRender::sBatchCount - LLRender::sDrawCount));
+			LLRender::sBatchCount = LLRender::sDrawCount = 0;
+			ypos += y_inc;
+
+			addText(xpos, ypos, llformat("HiZ Occluded/Visible/Undecided: %d/%d/%d", LLHiZBuffer::sOccludedCount,
+				LLHiZBuffer::sVisibleCount, LLHiZBuffer::sUnknownCount));
+			LLHiZBuffer::sOccludedCount = LLHiZBuffer::sVisibleCount = LLHiZBuffer::sUnknownCount = 0;
+			ypos += y_inc;
+
 			addText(xpos,ypos, llformat("%d/%d Nodes visible", gPipeline.mNumVisibleNodes, LLSpatialGroup::sNodeCount));
 			
 			ypos += y_inc;
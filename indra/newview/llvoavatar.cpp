@@ -87,6 +87,7 @@
 #include "pipeline.h"
 #include "llviewershadermgr.h"
 #include "llsky.h"
+#include "llskinthread.h"
 #include "llanimstatelabels.h"
 #include "lltrans.h"
 #include "llappearancemgr.h"
@@ -1152,6 +1153,35 @@ void LLVOAvatar::initClass()
 	gAnimLibrary.animStateSetString(ANIM_AGENT_PELVIS_FIX,"pelvis_fix");
 	gAnimLibrary.animStateSetString(ANIM_AGENT_TARGET,"target");
 	gAnimLibrary.animStateSetString(ANIM_AGENT_WALK_ADJUST,"walk_adjust");
+
+	if (gSavedSettings.getBOOL("AvatarSkinningBenchmark"))
+	{
+		benchmarkSkinning();
+	}
+}
+
+// static
+void LLVOAvatar::benchmarkSkinning()
+{
+	// The base meshes, the LODs of each are skinned the same way
+	std::vector<LLPolyMesh*> meshes;
+	for (LLVOAvatarXmlInfo::mesh_info_list_t::const_iterator iter = sAvatarXmlInfo->mMeshInfoList.begin();
+		 iter != sAvatarXmlInfo->mMeshInfoList.end(); ++iter)
+	{
+		const LLVOAvatarXmlInfo::LLVOAvatarMeshInfo* info = *iter;
+		if (!info->mReferenceMeshName.empty())
+		{
+			continue;
+		}
+		LLPolyMesh* mesh = LLPolyMesh::getMesh(info->mMeshFileName);
+		if (mesh)
+		{
+			meshes.push_back(mesh);
+		}
+	}
+
+	LLViewerJointMesh::benchmarkSkinning(meshes, gPipeline.getSkinThread());
+	std::for_each(meshes.begin(), meshes.end(), DeletePointer());
 }
 
 
@@ -2571,7 +2601,8 @@ void LLVOAvatar::idleUpdateAppearanceAnimation()
 				}
 			}
 
-			// apply all params
+			// apply all params, the shape is in between two so not worth sharing
+			LLPolyMorphBatch morph_batch(FALSE);
 			for (param = getFirstVisualParam();
 				 param;
 				 param = getNextVisualParam())
@@ -3893,6 +3924,95 @@ bool LLVOAvatar::shouldAlphaMask()
 
 }
 
+// private
+void LLVOAvatar::getSkinnedMeshLODs(std::vector<LLViewerJoint*>& lods)
+{
+	lods.push_back(mMeshLOD[MESH_ID_LOWER_BODY]);
+	lods.push_back(mMeshLOD[MESH_ID_UPPER_BODY]);
+
+	if( isWearingWearableType( LLWearableType::WT_SKIRT ) )
+	{
+		lods.push_back(mMeshLOD[MESH_ID_SKIRT]);
+	}
+
+	if (!isSelf() || gAgent.needsRenderHead() || LLPipeline::sShadowRender)
+	{
+		lods.push_back(mMeshLOD[MESH_ID_EYELASH]);
+		lods.push_back(mMeshLOD[MESH_ID_HEAD]);
+		lods.push_back(mMeshLOD[MESH_ID_HAIR]);
+	}
+}
+
+static LLFastTimer::DeclareTimer FTM_SKIN_AVATARS("Skin Avatars");
+
+//static
+void LLVOAvatar::skinVisibleAvatars(LLSkinThread* thread)
+{
+	if (LLViewerShaderMgr::instance()->getVertexShaderLevel(LLViewerShaderMgr::SHADER_AVATAR) > 0
+		|| !LLViewerJointMesh::canSkinInBatches())
+	{
+		return;
+	}
+
+	LLFastTimer t(FTM_SKIN_AVATARS);
+
+	std::vector<LLVOAvatar*> avatars;
+	std::vector<LLSkinJob> jobs;
+	for (std::vector<LLCharacter*>::iterator iter = LLCharacter::sInstances.begin();
+		 iter != LLCharacter::sInstances.end(); ++iter)
+	{
+		LLVOAvatar* avatarp = (LLVOAvatar*) *iter;
+
+		// Avatars renderSkinned() rebuilds first, impostors and the ones
+		// still loading are left to it
+		if (avatarp->isDead()
+			|| !avatarp->mIsBuilt
+			|| !avatarp->mNeedsSkin
+			|| avatarp->mDirtyMesh
+			|| avatarp->mDrawable.isNull()
+			|| !avatarp->mDrawable->isVisible()
+			|| avatarp->mDrawable->isState(LLDrawable::REBUILD_GEOMETRY)
+			|| avatarp->isImpostor()
+			|| !avatarp->isFullyLoaded())
+		{
+			continue;
+		}
+
+		LLFace* face = avatarp->mDrawable->getFace(0);
+		if (!face || face->mVertexBuffer.isNull())
+		{
+			continue;
+		}
+
+		std::vector<LLViewerJoint*> lods;
+		avatarp->getSkinnedMeshLODs(lods);
+		for (std::vector<LLViewerJoint*>::iterator lod_iter = lods.begin(); lod_iter != lods.end(); ++lod_iter)
+		{
+			(*lod_iter)->addSkinJobs(jobs);
+		}
+		avatars.push_back(avatarp);
+	}
+
+	if (thread)
+	{
+		thread->skin(jobs);
+	}
+	else
+	{
+		for (std::vector<LLSkinJob>::iterator iter = jobs.begin(); iter != jobs.end(); ++iter)
+		{
+			LLViewerJointMesh::skin(*iter);
+		}
+	}
+
+	for (std::vector<LLVOAvatar*>::iterator iter = avatars.begin(); iter != avatars.end(); ++iter)
+	{
+		LLVOAvatar* avatarp = *iter;
+		avatarp->mNeedsSkin = FALSE;
+		avatarp->mDrawable->getFace(0)->mVertexBuffer->setBuffer(0);
+	}
+}
+
 //-----------------------------------------------------------------------------
 // renderSkinned()
 //-----------------------------------------------------------------------------
@@ -3925,19 +4045,11 @@ U32 LLVOAvatar::renderSkinned(EAvatarRenderPass pass)
 		if (mNeedsSkin)
 		{
 			//generate animated mesh
-			mMeshLOD[MESH_ID_LOWER_BODY]->updateJointGeometry();
-			mMeshLOD[MESH_ID_UPPER_BODY]->updateJointGeometry();
-
-			if( isWearingWearableType( LLWearableType::WT_SKIRT ) )
-			{
-				mMeshLOD[MESH_ID_SKIRT]->updateJointGeometry();
-			}
-
-			if (!isSelf() || gAgent.needsRenderHead() || LLPipeline::sShadowRender)
+			std::vector<LLViewerJoint*> lods;
+			getSkinnedMeshLODs(lods);
+			for (std::vector<LLViewerJoint*>::iterator iter = lods.begin(); iter != lods.end(); ++iter)
 			{
-				mMeshLOD[MESH_ID_EYELASH]->updateJointGeometry();
-				mMeshLOD[MESH_ID_HEAD]->updateJointGeometry();
-				mMeshLOD[MESH_ID_HAIR]->updateJointGeometry();
+				(*iter)->updateJointGeometry();
 			}
 			mNeedsSkin = FALSE;
 			
@@ -5460,7 +5572,11 @@ void LLVOAvatar::updateVisualParams()
 
 	setSex( (getVisualParamWeight( "male" ) > 0.5f) ? SEX_MALE : SEX_FEMALE );
 
-	LLCharacter::updateVisualParams();
+	{
+		// meshes catch up with all their morphs at once when this goes away
+		LLPolyMorphBatch morph_batch(TRUE);
+		LLCharacter::updateVisualParams();
+	}
 
 	if (mLastSkeletonSerialNum != mSkeletonSerialNum)
 	{
@@ -63,6 +63,7 @@ class LLTexLayerSet;
 class LLVoiceVisualizer;
 class LLHUDNameTag;
 class LLHUDEffectSpiral;
+class LLSkinThread;
 class LLTexGlobalColor;
 class LLVOAvatarBoneInfo;
 class LLVOAvatarSkeletonInfo;
@@ -95,6 +96,7 @@ public:
 	virtual void 		initInstance(); // Called after construction to initialize the class.
 protected:
 	virtual				~LLVOAvatar();
+	static void			benchmarkSkinning(); // AvatarSkinningBenchmark
 	BOOL				loadSkeletonNode();
 	BOOL				loadMeshNodes();
 	virtual BOOL		loadLayersets();
@@ -355,10 +357,14 @@ public:
 	static void	deleteCachedImages(bool clearAll=true);
 	static void	destroyGL();
 	static void	restoreGL();
+	// Skins every avatar renderSkinned() would skin this frame at once, on
+	// the workers of thread as well when it is not NULL
+	static void	skinVisibleAvatars(LLSkinThread* thread);
 	BOOL 		mIsDummy; // for special views
 	S32			mSpecialRenderMode; // special lighting
 private:
 	bool		shouldAlphaMask();
+	void		getSkinnedMeshLODs(std::vector<LLViewerJoint*>& lods);
 
 	BOOL 		mNeedsSkin; // avatar has been animated and verts have not been updated
 	S32	 		mUpdatePeriod;
@@ -211,7 +211,7 @@ void LLVOTextBubble::updateFaceSize(S32 idx)
 	else
 	{
 		const LLVolumeFace& vol_face = getVolume()->getVolumeFace(idx);
-		face->setSize(vol_face.mVertices.size(), vol_face.mIndices.size());
+		face->setSize(vol_face.getNumVertices(), vol_face.mIndices.size());
 	}
 }
 
@@ -233,11 +233,11 @@ void LLVOTextBubble::getGeometry(S32 idx,
 	LLColor4U color = LLColor4U(getTE(idx)->getColor());
 	U32 offset = mDrawable->getFace(idx)->getGeomIndex();
 	
-	for (U32 i = 0; i < face.mVertices.size(); i++)
+	for (S32 i = 0; i < face.getNumVertices(); i++)
 	{
-		*verticesp++ = face.mVertices[i].mPosition.scaledVec(getScale()) + pos;
-		*normalsp++ = face.mVertices[i].mNormal;
-		*texcoordsp++ = face.mVertices[i].mTexCoord;
+		*verticesp++ = face.getPosition(i).scaledVec(getScale()) + pos;
+		*normalsp++ = face.getNormal(i);
+		*texcoordsp++ = face.getTexCoord(i);
 		*colorsp++ = color;
 	}
 	
@@ -210,6 +210,7 @@ LLVOVolume::LLVOVolume(const LLUUID &id, const LLPCode pcode, LLViewerRegion *re
 
 LLVOVolume::~LLVOVolume()
 {
+	releasePendingVolume();
 	delete mTextureAnimp;
 	mTextureAnimp = NULL;
 	delete mVolumeImpl;
@@ -248,6 +249,8 @@ void LLVOVolume::markDead()
 		{
 			mSculptTexture->removeVolume(this);
 		}
+
+		releasePendingVolume();
 	}
 	
 	LLViewerObject::markDead();
@@ -945,7 +948,38 @@ BOOL LLVOVolume::setVolume(const LLVolumeParams &volume_params, const S32 detail
 		}
 	}
 	
-	if ((LLPrimitive::setVolume(volume_params, mLOD, (mVolumeImpl && mVolumeImpl->isVolumeUnique()))) || mSculptChanged)
+	// Flexies are unique and sculpts are shaped in place by sculpt(), the
+	// rest are built by the volume manager's build thread
+	S32 lod = mLOD;
+	if (is_flexible || !volume_params.getSculptID().isNull() || volume_params.getSculptType() != LL_SCULPT_TYPE_NONE)
+	{
+		releasePendingVolume();
+	}
+	else if (!requestVolume(volume_params))
+	{
+		// Poll until it's done, see updateGeometry()
+		mLODChanged = TRUE;
+		if (mDrawable.notNull())
+		{
+			gPipeline.markRebuild(mDrawable, LLDrawable::REBUILD_VOLUME, FALSE);
+		}
+		if (getVolume())
+		{
+			// The previous volume keeps rendering until then
+			return FALSE;
+		}
+		// Nothing to show meanwhile, start out with the cheapest LOD
+		lod = 0;
+	}
+
+	BOOL changed = LLPrimitive::setVolume(volume_params, lod, (mVolumeImpl && mVolumeImpl->isVolumeUnique()));
+	if (mPendingVolume.notNull() && mPendingVolume->isBuilt())
+	{
+		// LLPrimitive::setVolume() has its own reference now
+		releasePendingVolume();
+	}
+
+	if (changed || mSculptChanged)
 	{
 		mFaceMappingChanged = TRUE;
 		
@@ -971,6 +1005,47 @@ BOOL LLVOVolume::setVolume(const LLVolumeParams &volume_params, const S32 detail
 	return FALSE;
 }
 
+// Returns TRUE when the volume for volume_params at mLOD is ready to be set,
+// otherwise it is held in mPendingVolume while the volume manager builds it.
+BOOL LLVOVolume::requestVolume(const LLVolumeParams &volume_params)
+{
+	F32 detail = LLVolumeLODGroup::getVolumeScaleFromDetail(mLOD);
+	LLVolume* volumep = getVolume();
+	if (volumep && volume_params == volumep->getParams() && detail == volumep->getDetail())
+	{
+		// Back to what we have, no need for the pending one
+		releasePendingVolume();
+		return TRUE;
+	}
+
+	if (mPendingVolume.notNull() &&
+		(!(volume_params == mPendingVolume->getParams()) || detail != mPendingVolume->getDetail()))
+	{
+		releasePendingVolume();
+	}
+	if (mPendingVolume.isNull())
+	{
+		mPendingVolume = getVolumeManager()->requestVolume(volume_params, mLOD);
+	}
+	return mPendingVolume->isBuilt();
+}
+
+// The params being built when there's a pending volume, so polling for it
+// doesn't look like a request for the current shape.
+const LLVolumeParams& LLVOVolume::getTargetVolumeParams() const
+{
+	return mPendingVolume.notNull() ? mPendingVolume->getParams() : getVolume()->getParams();
+}
+
+void LLVOVolume::releasePendingVolume()
+{
+	if (mPendingVolume.notNull())
+	{
+		getVolumeManager()->unrefVolume(mPendingVolume);
+		mPendingVolume = NULL;
+	}
+}
+
 void LLVOVolume::updateSculptTexture()
 {
 	LLPointer<LLViewerFetchedTexture> old_sculpt = mSculptTexture;
@@ -1449,7 +1524,7 @@ BOOL LLVOVolume::updateGeometry(LLDrawable *drawable)
 		if (mVolumeChanged)
 		{
 			LLFastTimer ftm(FTM_GEN_VOLUME);
-			LLVolumeParams volume_params = getVolume()->getParams();
+			LLVolumeParams volume_params = getTargetVolumeParams();
 			setVolume(volume_params, 0);
 			drawable->setState(LLDrawable::REBUILD_VOLUME);
 		}
@@ -1473,7 +1548,7 @@ BOOL LLVOVolume::updateGeometry(LLDrawable *drawable)
 
 		{
 			LLFastTimer ftm(FTM_GEN_VOLUME);
-			LLVolumeParams volume_params = getVolume()->getParams();
+			LLVolumeParams volume_params = getTargetVolumeParams();
 			setVolume(volume_params, 0);
 		}
 
@@ -1521,6 +1596,14 @@ BOOL LLVOVolume::updateGeometry(LLDrawable *drawable)
 	mSculptChanged = FALSE;
 	mFaceMappingChanged = FALSE;
 
+	if (mPendingVolume.notNull())
+	{
+		// Stay in the build queue until the new volume is built, then
+		// setVolume() swaps it in
+		mLODChanged = TRUE;
+		return FALSE;
+	}
+
 	return LLViewerObject::updateGeometry(drawable);
 }
 
@@ -1536,11 +1619,11 @@ void LLVOVolume::updateFaceSize(S32 idx)
 		const LLVolumeFace& vol_face = getVolume()->getVolumeFace(idx);
 		if (LLPipeline::sUseTriStrips)
 		{
-			facep->setSize(vol_face.mVertices.size(), vol_face.mTriStrip.size());
+			facep->setSize(vol_face.getNumVertices(), vol_face.mTriStrip.size());
 		}
 		else
 		{
-			facep->setSize(vol_face.mVertices.size(), vol_face.mIndices.size());
+			facep->setSize(vol_face.getNumVertices(), vol_face.mIndices.size());
 		}
 	}
 }
@@ -1801,9 +1884,9 @@ LLVector3 LLVOVolume::getApproximateFaceNormal(U8 face_id)
 	if (volume && face_id < volume->getNumVolumeFaces())
 	{
 		const LLVolumeFace& face = volume->getVolumeFace(face_id);
-		for (S32 i = 0; i < (S32)face.mVertices.size(); ++i)
+		for (S32 i = 0; i < face.getNumVertices(); ++i)
 		{
-			result += face.mVertices[i].mNormal;
+			result += face.getNormal(i);
 		}
 
 		result = volumeDirectionToAgent(result);
@@ -2904,6 +2987,8 @@ U32 LLVOVolume::getRenderCost(std::set<LLUUID> &textures) const
 void LLVOVolume::preUpdateGeom()
 {
 	sNumLODChanges = 0;
+	// Lets go of the volumes the build thread finished since last frame
+	getVolumeManager()->update(1);
 }
 
 void LLVOVolume::parameterChanged(U16 param_type, bool local_origin)
@@ -3286,6 +3371,11 @@ void LLVolumeGeometryManager::registerFace(LLSpatialGroup* group, LLFace* facep,
 		draw_vec[idx]->mTextureMatrix == tex_mat &&
 		draw_vec[idx]->mModelMatrix == model_mat)
 	{
+		if (facep->isAtlasInUse() && draw_vec[idx]->mAtlasSource != facep->getOriginalTexture())
+		{ //would have been a draw call of its own without the atlas
+			draw_vec[idx]->mAtlasMerges++;
+		}
+		draw_vec[idx]->mAtlasSource = facep->getOriginalTexture();
 		draw_vec[idx]->mCount += facep->getIndicesCount();
 		draw_vec[idx]->mEnd += facep->getGeomCount();
 		draw_vec[idx]->mVSize = llmax(draw_vec[idx]->mVSize, facep->getVirtualSize());
@@ -3307,6 +3397,7 @@ void LLVolumeGeometryManager::registerFace(LLSpatialGroup* group, LLFace* facep,
 		draw_info->mTextureMatrix = tex_mat;
 		draw_info->mModelMatrix = model_mat;
 		draw_info->mGlowColor.setVec(0,0,0,glow);
+		draw_info->mAtlasSource = facep->getOriginalTexture();
 		if (type == LLRenderPass::PASS_ALPHA)
 		{ //for alpha sorting
 			facep->setDrawInfo(draw_info);
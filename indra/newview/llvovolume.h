@@ -276,6 +276,9 @@ public:
 protected:
 	S32	computeLODDetail(F32	distance, F32 radius);
 	BOOL calcLOD();
+	BOOL requestVolume(const LLVolumeParams &volume_params);
+	void releasePendingVolume();
+	const LLVolumeParams& getTargetVolumeParams() const;
 	LLFace* addFace(S32 face_index);
 	void updateTEData();
 
@@ -300,6 +303,7 @@ private:
 	BOOL		mVolumeChanged;
 	F32			mVObjRadius;
 	LLVolumeInterface *mVolumeImpl;
+	LLPointer<LLVolume> mPendingVolume;	// next volume, while the volume manager builds it
 	LLPointer<LLViewerFetchedTexture> mSculptTexture;
 	LLPointer<LLViewerFetchedTexture> mLightTexture;
 	media_list_t mMediaImplList;
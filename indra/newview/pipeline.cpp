@@ -51,6 +51,8 @@
 // newview includes
 #include "llagent.h"
 #include "llagentcamera.h"
+#include "llcullthread.h"
+#include "llskinthread.h"
 #include "lldrawable.h"
 #include "lldrawpoolalpha.h"
 #include "lldrawpoolavatar.h"
@@ -269,6 +271,8 @@ BOOL	LLPipeline::sDisableShaders = FALSE;
 BOOL	LLPipeline::sRenderBump = TRUE;
 BOOL	LLPipeline::sUseTriStrips = TRUE;
 BOOL	LLPipeline::sUseFarClip = TRUE;
+BOOL	LLPipeline::sParallelCull = TRUE;
+BOOL	LLPipeline::sParallelSkinning = TRUE;
 BOOL	LLPipeline::sShadowRender = FALSE;
 BOOL	LLPipeline::sWaterReflections = FALSE;
 BOOL	LLPipeline::sRenderGlow = FALSE;
@@ -309,6 +313,7 @@ void addDeferredAttachments(LLRenderTarget& target)
 LLPipeline::LLPipeline() :
 	mBackfaceCull(FALSE),
 	mBatchCount(0),
+	mAtlasMergedBatchCount(0),
 	mMatrixOpCount(0),
 	mTextureMatrixOps(0),
 	mMaxBatchSize(0),
@@ -343,7 +348,9 @@ LLPipeline::LLPipeline() :
 	mLightMovingMask(0),
 	mLightingDetail(0),
 	mScreenWidth(0),
-	mScreenHeight(0)
+	mScreenHeight(0),
+	mCullThread(NULL),
+	mSkinThread(NULL)
 {
 	mNoiseMap = 0;
 	mTrueNoiseMap = 0;
@@ -360,6 +367,14 @@ void LLPipeline::init()
 	LLVertexBuffer::sUseStreamDraw = gSavedSettings.getBOOL("RenderUseStreamVBO");
 	sRenderAttachedLights = gSavedSettings.getBOOL("RenderAttachedLights");
 	sRenderAttachedParticles = gSavedSettings.getBOOL("RenderAttachedParticles");
+	sParallelCull = gSavedSettings.getBOOL("RenderParallelCull");
+	sParallelSkinning = gSavedSettings.getBOOL("RenderParallelSkinning");
+
+	if (LLQueuedThread::getSharedPool())
+	{ //partitions are culled and avatars skinned on the workers texture decoding uses
+		mCullThread = new LLCullThread();
+		mSkinThread = new LLSkinThread();
+	}
 
 	mInitialized = TRUE;
 	
@@ -424,6 +439,22 @@ void LLPipeline::cleanup()
 	mGroupQ1.clear() ;
 	mGroupQ2.clear() ;
 
+	if (mCullThread)
+	{
+		mCullThread->shutdown();
+		delete mCullThread;
+		mCullThread = NULL;
+	}
+	if (mSkinThread)
+	{
+		mSkinThread->shutdown();
+		delete mSkinThread;
+		mSkinThread = NULL;
+	}
+	mCullShards.clear();
+	mCullShardList.clear();
+	mCullCameras.clear();
+
 	for(pool_set_t::iterator iter = mPools.begin();
 		iter != mPools.end(); )
 	{
@@ -667,6 +698,7 @@ void LLPipeline::releaseGLBuffers()
 	mSampleBuffer.releaseSampleBuffer();
 	mDeferredScreen.release();
 	mDeferredDepth.release();
+	mHiZBuffer.release();
 	for (U32 i = 0; i < 3; i++)
 	{
 		mDeferredLight[i].release();
@@ -1607,28 +1639,38 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 
 	LLGLDepthTest depth(GL_TRUE, GL_FALSE);
 
-	for (LLWorld::region_list_t::const_iterator iter = LLWorld::getInstance()->getRegionList().begin(); 
-			iter != LLWorld::getInstance()->getRegionList().end(); ++iter)
+	if (mCullThread && sParallelCull)
 	{
-		LLViewerRegion* region = *iter;
-		if (water_clip != 0)
-		{
-			LLPlane plane(LLVector3(0,0, (F32) -water_clip), (F32) water_clip*region->getWaterHeight());
-			camera.setUserClipPlane(plane);
-		}
-		else
-		{
-			camera.disableUserClipPlane();
-		}
+		cullParallel(camera, water_clip);
+	}
+	else
+	{
+		//queries are read back by the cull as it reaches them
+		LLSpatialGroup::clearQueryResults();
 
-		for (U32 i = 0; i < LLViewerRegion::NUM_PARTITIONS; i++)
+		for (LLWorld::region_list_t::const_iterator iter = LLWorld::getInstance()->getRegionList().begin(); 
+				iter != LLWorld::getInstance()->getRegionList().end(); ++iter)
 		{
-			LLSpatialPartition* part = region->getSpatialPartition(i);
-			if (part)
+			LLViewerRegion* region = *iter;
+			if (water_clip != 0)
 			{
-				if (hasRenderType(part->mDrawableType))
+				LLPlane plane(LLVector3(0,0, (F32) -water_clip), (F32) water_clip*region->getWaterHeight());
+				camera.setUserClipPlane(plane);
+			}
+			else
+			{
+				camera.disableUserClipPlane();
+			}
+
+			for (U32 i = 0; i < LLViewerRegion::NUM_PARTITIONS; i++)
+			{
+				LLSpatialPartition* part = region->getSpatialPartition(i);
+				if (part)
 				{
-					part->cull(camera);
+					if (hasRenderType(part->mDrawableType))
+					{
+						part->cull(camera);
+					}
 				}
 			}
 		}
@@ -1673,6 +1715,67 @@ void LLPipeline::updateCull(LLCamera& camera, LLCullResult& result, S32 water_cl
 	}
 }
 
+static LLFastTimer::DeclareTimer FTM_CULL_PARALLEL("Parallel Cull");
+static LLFastTimer::DeclareTimer FTM_CULL_REPLAY("Cull Replay");
+
+void LLPipeline::cullParallel(LLCamera& camera, S32 water_clip)
+{
+	const LLWorld::region_list_t& regions = LLWorld::getInstance()->getRegionList();
+
+	//each region gets its own copy of the camera for its water clip plane,
+	//reserved up front so the shards' pointers into it stay put
+	mCullCameras.clear();
+	mCullCameras.reserve(regions.size());
+	if (mCullShards.size() < regions.size() * LLViewerRegion::NUM_PARTITIONS)
+	{
+		mCullShards.resize(regions.size() * LLViewerRegion::NUM_PARTITIONS);
+	}
+	mCullShardList.clear();
+
+	for (LLWorld::region_list_t::const_iterator iter = regions.begin(); iter != regions.end(); ++iter)
+	{
+		LLViewerRegion* region = *iter;
+		mCullCameras.push_back(camera);
+		LLCamera& region_camera = mCullCameras.back();
+		if (water_clip != 0)
+		{
+			LLPlane plane(LLVector3(0,0, (F32) -water_clip), (F32) water_clip*region->getWaterHeight());
+			region_camera.setUserClipPlane(plane);
+		}
+		else
+		{
+			region_camera.disableUserClipPlane();
+		}
+
+		for (U32 i = 0; i < LLViewerRegion::NUM_PARTITIONS; i++)
+		{
+			LLSpatialPartition* part = region->getSpatialPartition(i);
+			if (part && hasRenderType(part->mDrawableType))
+			{
+				LLCullShard* shard = &mCullShards[mCullShardList.size()];
+				shard->set(part, &region_camera);
+				mCullShardList.push_back(shard);
+			}
+		}
+	}
+
+	//workers can't touch GL, so read back every pending query for them
+	LLSpatialGroup::fetchQueryResults();
+
+	{
+		LLFastTimer t(FTM_CULL_PARALLEL);
+		mCullThread->cull(mCullShardList);
+	}
+
+	//in partition order, so the cull result is the same as culling serially
+	LLFastTimer t(FTM_CULL_REPLAY);
+	for (std::vector<LLCullShard*>::iterator iter = mCullShardList.begin(); iter != mCullShardList.end(); ++iter)
+	{
+		(*iter)->replay();
+	}
+	mCullShardList.clear();
+}
+
 void LLPipeline::markNotCulled(LLSpatialGroup* group, LLCamera& camera)
 {
 	if (group->getData().empty())
@@ -1737,6 +1840,18 @@ void LLPipeline::markOccluder(LLSpatialGroup* group)
 	}
 }
 
+// Forward rendering takes the depth for mHiZBuffer where the occlusion
+// queries go in.  Grass, water and alpha come after and write depth that
+// doesn't hide anything.
+void LLPipeline::captureHiZ()
+{
+	if (LLViewerCamera::sCurCameraID == LLViewerCamera::CAMERA_WORLD &&
+		!sReflectionRender && !sShadowRender)
+	{
+		mHiZBuffer.capture(gGLModelView, gGLProjection);
+	}
+}
+
 void LLPipeline::doOcclusion(LLCamera& camera)
 {
 	LLVertexBuffer::unbind();
@@ -3062,6 +3177,11 @@ void LLPipeline::renderGeom(LLCamera& camera, BOOL forceVBOUpdate)
 	//	
 	stop_glerror();
 	
+	if (hasRenderType(LLPipeline::RENDER_TYPE_AVATAR))
+	{ //skin all avatars at once instead of one at a time as their pools render
+		LLVOAvatar::skinVisibleAvatars(sParallelSkinning ? mSkinThread : NULL);
+	}
+
 	LLAppViewer::instance()->pingMainloopTimeout("Pipeline:RenderDrawPools");
 
 	for (pool_set_t::iterator iter = mPools.begin(); iter != mPools.end(); ++iter)
@@ -3103,6 +3223,7 @@ void LLPipeline::renderGeom(LLCamera& camera, BOOL forceVBOUpdate)
 				occlude = FALSE;
 				gGLLastMatrix = NULL;
 				glLoadMatrixd(gGLModelView);
+				captureHiZ();
 				doOcclusion(camera);
 			}
 
@@ -3177,6 +3298,7 @@ void LLPipeline::renderGeom(LLCamera& camera, BOOL forceVBOUpdate)
 			occlude = FALSE;
 			gGLLastMatrix = NULL;
 			glLoadMatrixd(gGLModelView);
+			captureHiZ();
 			doOcclusion(camera);
 		}
 	}
@@ -39,6 +39,7 @@
 #include "llgl.h"
 #include "lldrawable.h"
 #include "llrendertarget.h"
+#include "llhizbuffer.h"
 
 #include <stack>
 
@@ -52,6 +53,8 @@ class LLTextureEntry;
 class LLRenderFunc;
 class LLCubeMap;
 class LLCullResult;
+class LLCullThread;
+class LLSkinThread;
 class LLVOAvatar;
 class LLGLSLShader;
 
@@ -142,6 +145,7 @@ public:
 	void        markVisible(LLDrawable *drawablep, LLCamera& camera);
 	void		markOccluder(LLSpatialGroup* group);
 	void		doOcclusion(LLCamera& camera);
+	void		captureHiZ();
 	void		markNotCulled(LLSpatialGroup* group, LLCamera &camera);
 	void        markMoved(LLDrawable *drawablep, BOOL damped_motion = FALSE);
 	void        markShift(LLDrawable *drawablep);
@@ -201,6 +205,8 @@ public:
 	BOOL getVisibleExtents(LLCamera& camera, LLVector3 &min, LLVector3& max);
 	BOOL getVisiblePointCloud(LLCamera& camera, LLVector3 &min, LLVector3& max, std::vector<LLVector3>& fp, LLVector3 light_dir = LLVector3(0,0,0));
 	void updateCull(LLCamera& camera, LLCullResult& result, S32 water_clip = 0);  //if water_clip is 0, ignore water plane, 1, cull to above plane, -1, cull to below plane
+	void cullParallel(LLCamera& camera, S32 water_clip); //partition culls of updateCull on the thread pool
+	LLSkinThread* getSkinThread() { return mSkinThread; }
 	void createObjects(F32 max_dtime);
 	void createObject(LLViewerObject* vobj);
 	void updateGeom(F32 max_dtime);
@@ -437,6 +443,7 @@ public:
 
 	BOOL					 mBackfaceCull;
 	S32						 mBatchCount;
+	S32						 mAtlasMergedBatchCount; // batches that texture atlases folded into others
 	S32						 mMatrixOpCount;
 	S32						 mTextureMatrixOps;
 	S32						 mMaxBatchSize;
@@ -463,6 +470,8 @@ public:
 	static BOOL				sRenderBump;
 	static BOOL				sUseTriStrips;
 	static BOOL				sUseFarClip;
+	static BOOL				sParallelCull;
+	static BOOL				sParallelSkinning;
 	static BOOL				sShadowRender;
 	static BOOL				sWaterReflections;
 	static BOOL				sDynamicLOD;
@@ -496,6 +505,9 @@ public:
 	LLRenderTarget			mLuminanceMap;
 	LLRenderTarget			mHighlight;
 
+	//depth pyramid of a recent frame for CPU occlusion culling
+	LLHiZBuffer				mHiZBuffer;
+
 	//sun shadow map
 	LLRenderTarget			mShadow[6];
 	std::vector<LLVector3>	mShadowFrustPoints[4];
@@ -554,6 +566,17 @@ protected:
 	U32						mRenderDebugMask;
 
 	U32						mOldRenderDebugMask;
+
+	/////////////////////////////////////////////
+	//
+	// Parallel culling, see cullParallel
+	LLCullThread*				mCullThread; //NULL without a shared thread pool
+	std::vector<LLCamera>		mCullCameras;
+	std::vector<LLCullShard>	mCullShards;
+	std::vector<LLCullShard*>	mCullShardList;
+
+	// Software avatar skinning on the thread pool, see LLVOAvatar::skinVisibleAvatars
+	LLSkinThread*				mSkinThread; //NULL without a shared thread pool
 	
 	/////////////////////////////////////////////
 	//
@@ -29,8 +29,11 @@
 #include "linden_common.h"
 #include "lltut.h"
 
+#include "llallocator.h"
+#include "llformat.h"
 #include "llsdtraits.h"
 #include "llstring.h"
+#include "lltimer.h"
 
 namespace tut
 {
@@ -753,6 +756,294 @@ namespace tut
 		ensure("type is a string", v.isString());
 	}
 
+	template<> template<>
+	void SDTestObject::test<15>()
+		// map storage
+	{
+		SDCleanupCheck check;
+
+		LLSD v;
+		const char* keys[] = { "mango", "apple", "kiwi", "banana", "fig", "cherry", "date", "lime", "pear" };
+		const S32 count = LL_ARRAY_SIZE(keys);
+		for (S32 i = 0; i < count; ++i)
+		{
+			v[keys[i]] = i;
+		}
+		ensure_equals("map size", v.size(), count);
+
+		// iteration is in key order, whatever order keys went in
+		std::string last;
+		S32 visited = 0;
+		for (LLSD::map_const_iterator i = v.beginMap(); i != v.endMap(); ++i)
+		{
+			ensure("key order", last < i->first);
+			last = (*i).first;
+			++visited;
+		}
+		ensure_equals("visited all", visited, count);
+		ensure_equals("distance", (S32)std::distance(v.beginMap(), v.endMap()), count);
+
+		// values stay put while other keys come and go
+		LLSD& fig = v["fig"];
+		for (S32 i = 0; i < 100; ++i)
+		{
+			v[llformat("extra%d", i)] = i;
+		}
+		v.erase("apple");
+		v.erase("no such key");
+		ensureTypeAndValue("reference survives growth", fig, 4);
+		fig = "changed";
+		ensureTypeAndValue("reference writes through", v["fig"], "changed");
+
+		// erased slots are reused
+		v["apple"] = "again";
+		ensureTypeAndValue("reinserted", v["apple"], "again");
+		ensure_equals("grown size", v.size(), count + 100);
+
+		// insert doesn't replace
+		v.insert("kiwi", 99);
+		ensureTypeAndValue("insert keeps", v["kiwi"], 2);
+
+		// mutable iterators write through and compare with const ones
+		LLSD::map_iterator mi = v.beginMap();
+		mi->second = 42;
+		ensureTypeAndValue("iterator writes", v["apple"], 42);
+		const LLSD& cv = v;
+		ensure("mixed compare", LLSD::map_const_iterator(cv.beginMap()) == mi);
+		LLSD::map_iterator last_entry = v.endMap();
+		--last_entry;
+		ensure_equals("last key", last_entry->first, std::string("pear"));
+
+		// iterators stay good while other keys come and go, like std::map
+		LLSD::map_iterator kiwi = v.beginMap();
+		while (kiwi->first != "kiwi")
+		{
+			++kiwi;
+		}
+		LLSD::map_const_iterator end = v.endMap();
+		v["aardvark"] = 1;
+		v["zebra"] = 2;
+		v.erase("lime");
+		v.erase("fig");
+		for (S32 i = 0; i < 100; ++i)
+		{
+			v.erase(llformat("extra%d", i));
+		}
+		ensure_equals("iterator survives", kiwi->first, std::string("kiwi"));
+		ensureTypeAndValue("iterator value", kiwi->second, 2);
+		++kiwi;
+		ensure_equals("iterator steps past erased keys", kiwi->first, std::string("mango"));
+		ensure("end survives", LLSD::map_const_iterator(v.endMap()) == end);
+		--kiwi;
+		--kiwi;
+		ensure_equals("iterator steps back", kiwi->first, std::string("date"));
+
+		// erasing while walking, one key at a time
+		for (LLSD::map_iterator i = v.beginMap(); i != v.endMap(); )
+		{
+			std::string key = (i++)->first;
+			if (key[0] < 'm')
+			{
+				v.erase(key);
+			}
+		}
+		ensure_equals("erased while walking", v.size(), 3);
+		ensure_equals("first left", v.beginMap()->first, std::string("mango"));
+
+		LLSD e = LLSD::emptyMap();
+		ensure("empty map iteration", e.beginMap() == e.endMap());
+		LLSD u;
+		ensure("undefined iteration", u.beginMap() == u.endMap());
+	}
+
+	template<> template<>
+	void SDTestObject::test<16>()
+		// copy on write maps
+	{
+		SDCleanupCheck check;
+
+		LLSD a;
+		a["name"] = "subtree";
+		a["child"]["x"] = 1.5;
+		a["child"]["y"] = 2.5;
+
+		{
+			SDAllocationCheck check("copying a map shares it", 0);
+			LLSD b = a;
+		}
+
+		{
+			// cloning the top map shares the child until it is written
+			SDAllocationCheck check("clone shares subtrees", 1);
+			LLSD b = a;
+			b["name"] = true;
+		}
+
+		LLSD b = a;
+		b["child"]["x"] = 9.5;
+		ensureTypeAndValue("original subtree unaltered", a["child"]["x"], 1.5);
+		ensureTypeAndValue("copy subtree changed", b["child"]["x"], 9.5);
+		ensureTypeAndValue("sibling still shared value", b["child"]["y"], 2.5);
+	}
+
+	template<> template<>
+	void SDTestObject::test<17>()
+		// allocation profile of a message sized map tree, reported rather
+		// than enforced since timings on a build machine are noisy
+	{
+		SDCleanupCheck check;
+
+		LLAllocator allocator;
+		allocator.setProfilingEnabled(true);
+
+		U32 start_allocations = LLSD::allocationCount();
+		LLTimer timer;
+		const S32 BLOCKS = 2000;
+		LLSD message;
+		for (S32 i = 0; i < BLOCKS; ++i)
+		{
+			LLSD block;
+			block["AgentID"] = LLUUID::null;
+			block["ItemID"] = LLUUID::null;
+			block["CallbackID"] = i;
+			block["Flags"] = (S32)0x40;
+			block["OwnerMask"] = (S32)0x7fffffff;
+			block["GroupOwned"] = false;
+			block["SalePrice"] = 10;
+			block["CreationDate"] = 1300000000 + i;
+			block["Name"] = "Item";
+			message["InventoryData"].append(block);
+		}
+		F64 build_time = timer.getElapsedTimeF64();
+		U32 allocations = LLSD::allocationCount() - start_allocations;
+
+		U64 live_bytes = 0;
+		if (LLAllocator::isProfiling())
+		{
+			const LLAllocatorHeapProfile& profile = allocator.getProfile();
+			for (LLAllocatorHeapProfile::lines_t::const_iterator i = profile.mLines.begin();
+				 i != profile.mLines.end(); ++i)
+			{
+				live_bytes += i->mLiveSize;
+			}
+		}
+		allocator.setProfilingEnabled(false);
+
+		llinfos << "Built " << BLOCKS << " message blocks in " << build_time * 1000.0
+				<< " ms with " << allocations << " LLSD Impls, "
+				<< live_bytes << " bytes live in the heap profile" << llendl;
+
+		// a map, two UUIDs, five integers and a string per block, the
+		// boolean is inline
+		ensure_equals("allocations", allocations, (U32)(BLOCKS * 9 + 2));
+	}
+
+	template<> template<>
+	void SDTestObject::test<18>()
+		// inline booleans
+	{
+		SDCleanupCheck check;
+
+		{
+			SDAllocationCheck check("booleans are inline", 0);
+			LLSD v = true;
+			LLSD w = v;
+			v = false;
+			w = true;
+			v = w;
+		}
+
+		{
+			SDAllocationCheck check("boolean replaces shared", 1);
+			LLSD v = 45;
+			LLSD w = v;
+			w = true;
+			ensureTypeAndValue("original kept", v, 45);
+			ensureTypeAndValue("copy changed", w, true);
+		}
+
+		{
+			SDAllocationCheck check("scalar replaces boolean", 1);
+			LLSD v = false;
+			v = 4.5;
+			ensureTypeAndValue("now real", v, 4.5);
+		}
+
+		LLSD t = true;
+		LLSD f = false;
+		ensure("true type", t.isBoolean());
+		ensure_equals("true as integer", t.asInteger(), 1);
+		ensure_equals("false as real", f.asReal(), 0.0);
+		ensure_equals("true as string", t.asString(), std::string("true"));
+		ensure_equals("false as string", f.asString(), std::string(""));
+		ensure("not a map", t.beginMap() == t.endMap());
+		ensure_equals("no size", t.size(), 0);
+		ensure("no member", !t.has("x"));
+	}
+
+	template<> template<>
+	void SDTestObject::test<19>()
+		// maps large enough to be indexed by a tree
+	{
+		SDCleanupCheck check;
+
+		const S32 KEYS = 5000;
+		LLSD m;
+		U32 seed = 13579;
+		std::map<std::string, S32> expected;
+		for (S32 i = 0; i < KEYS; ++i)
+		{
+			seed = seed * 1103515245 + 12345;
+			std::string key = llformat("key%d", (seed >> 8) % 20000);
+			m[key] = i;
+			expected[key] = i;
+		}
+		LLSD::map_iterator first = m.beginMap();
+		LLSD& first_value = first->second;
+		std::string first_key = first->first;
+
+		// erase every other key, and then some that were never there
+		S32 n = 0;
+		for (std::map<std::string, S32>::iterator i = expected.begin(); i != expected.end(); ++n)
+		{
+			if (n % 2 && i->first != first_key)
+			{
+				m.erase(i->first);
+				expected.erase(i++);
+			}
+			else
+			{
+				++i;
+			}
+		}
+		m.erase("not a key");
+		m.insert("key1", -1);
+		if (expected.find("key1") == expected.end())
+		{
+			expected["key1"] = -1;
+		}
+
+		ensure_equals("size", m.size(), (S32)expected.size());
+		ensure("first iterator still valid", first->first == first_key && &first->second == &first_value);
+		std::map<std::string, S32>::iterator e = expected.begin();
+		for (LLSD::map_const_iterator i = m.beginMap(); i != m.endMap(); ++i, ++e)
+		{
+			ensure("not past the end", e != expected.end());
+			ensure_equals("key order", i->first, e->first);
+			ensure_equals("value", i->second.asInteger(), e->second);
+			ensure("has", m.has(e->first));
+		}
+		ensure("all keys visited", e == expected.end());
+
+		// a clone of a large map is as large, and keeps its order
+		LLSD c = m;
+		c["zzz"] = true;
+		ensure_equals("clone size", c.size(), m.size() + 1);
+		ensure("original unaltered", !m.has("zzz"));
+		ensure_equals("clone last key", (--c.endMap())->first, std::string("zzz"));
+		ensure_equals("clone value", c[first_key].asInteger(), first_value.asInteger());
+	}
+
 	/* TO DO:
 		conversion of undefined to UUID, Date, URI and Binary
 		conversion of undefined to map and array
@@ -760,8 +1051,7 @@ namespace tut
 		test array operations
 		test array extension
 		
-		test copying and assign maps and arrays (clone)
-		test iteration over map
+		test copying and assign arrays (clone)
 		test iteration over array
 		test iteration over scalar
 
@@ -34,6 +34,7 @@
 #include "llquaternion.h"
 #include "lltemplatemessagebuilder.h"
 #include "lltemplatemessagereader.h"
+#include "lltimer.h"
 #include "llversionserver.h"
 #include "message_prehash.h"
 #include "u64.h"
@@ -46,6 +47,30 @@ namespace tut
 	static LLTemplateMessageBuilder::message_template_name_map_t nameMap;
 	static LLTemplateMessageReader::message_template_number_map_t numberMap;
 
+	// Handler for the replay benchmark, reads every variable like a real
+	// handler would
+	static LLTemplateMessageReader* replayReader = NULL;
+	static U32 replayMessages = 0;
+	static U32 replayChecksum = 0;
+	static void handle_replay_message(LLMessageSystem*, void**)
+	{
+		S32 count = replayReader->getNumberOfBlocks(_PREHASH_Test0);
+		for (S32 i = 0; i < count; ++i)
+		{
+			LLUUID id;
+			U32 value;
+			LLVector3 pos;
+			replayReader->getUUID(_PREHASH_Test0, _PREHASH_Test0, id, i);
+			replayReader->getU32(_PREHASH_Test0, _PREHASH_Test1, value, i);
+			replayReader->getVector3(_PREHASH_Test0, _PREHASH_Test2, pos, i);
+			replayChecksum += id.mData[0] + value + (U32)pos.mV[VZ];
+		}
+		std::string name;
+		replayReader->getString(_PREHASH_Test1, _PREHASH_Test0, name);
+		replayChecksum += name.size();
+		++replayMessages;
+	}
+
 	struct LLTemplateMessageBuilderTestData 
 	{
 		static LLMessageTemplate defaultTemplate()
@@ -105,7 +130,8 @@ namespace tut
 		{
 			numberMap[1] = &messageTemplate;
 			const U32 bufferSize = 1024;
-			U8 buffer[bufferSize];
+			// The reader decodes in place, the buffer has to outlive it
+			static U8 buffer[bufferSize];
 			// zero out the packet ID field
 			memset(buffer, 0, LL_PACKET_ID_SIZE);
 			U32 builtSize = builder->buildMessage(buffer, bufferSize, offset);
@@ -966,5 +992,115 @@ namespace tut
 		ensure_equals("Ensure unchanged buffer ", strlen(outBuffer), 0);
 		delete reader;
 	}
-}
 
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<46>()
+		// replay benchmark: messages/sec decoding a packet stream
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		LLMessageBlock* objects = new LLMessageBlock(_PREHASH_Test0, MBT_VARIABLE);
+		objects->addVariable(_PREHASH_Test0, MVT_LLUUID, 16);
+		objects->addVariable(_PREHASH_Test1, MVT_U32, 4);
+		objects->addVariable(_PREHASH_Test2, MVT_LLVector3, 12);
+		messageTemplate.addBlock(objects);
+		messageTemplate.addBlock(createBlock(_PREHASH_Test1, MVT_VARIABLE, 1, MBT_SINGLE));
+		messageTemplate.setHandlerFunc(handle_replay_message, NULL);
+
+		// Stand-in for a capture: object update sized packets with
+		// 1 to 8 blocks, zero coded when that makes them smaller, as
+		// they'd arrive off the wire
+		const S32 NUM_PACKETS = 256;
+		std::vector<std::vector<U8> > packets;
+		U32 expected_checksum = 0;
+		for (S32 p = 0; p < NUM_PACKETS; ++p)
+		{
+			LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate);
+			S32 count = 1 + p % 8;
+			for (S32 i = 0; i < count; ++i)
+			{
+				if (i)
+				{
+					builder->nextBlock(_PREHASH_Test0);
+				}
+				LLUUID id;
+				id.mData[0] = (U8)(p + i);
+				builder->addUUID(_PREHASH_Test0, id);
+				builder->addU32(_PREHASH_Test1, p * 8 + i);
+				builder->addVector3(_PREHASH_Test2, LLVector3(0.f, 0.f, (F32)i));
+				expected_checksum += id.mData[0] + p * 8 + i + i;
+			}
+			builder->nextBlock(_PREHASH_Test1);
+			std::string name(p % 16, 'x');
+			builder->addString(_PREHASH_Test0, name);
+			expected_checksum += name.size();
+
+			U8 buffer[MAX_BUFFER_SIZE];
+			memset(buffer, 0, LL_PACKET_ID_SIZE);
+			U32 size = builder->buildMessage(buffer, MAX_BUFFER_SIZE, 0);
+			U8* packet = buffer;
+			builder->compressMessage(packet, size);
+			packets.push_back(std::vector<U8>(packet, packet + size));
+			delete builder;
+		}
+
+		numberMap[1] = &messageTemplate;
+		replayReader = new LLTemplateMessageReader(numberMap);
+		replayMessages = 0;
+		replayChecksum = 0;
+
+		const S32 ROUNDS = 200;
+		U8 receive_buffer[MAX_BUFFER_SIZE];
+		LLTimer timer;
+		for (S32 round = 0; round < ROUNDS; ++round)
+		{
+			for (S32 p = 0; p < NUM_PACKETS; ++p)
+			{
+				// Same steps as LLMessageSystem::checkMessages()
+				S32 size = (S32)packets[p].size();
+				memcpy(receive_buffer, &packets[p][0], size);
+				U8* buffer = receive_buffer;
+				gMessageSystem->zeroCodeExpand(&buffer, &size);
+				if (replayReader->validateMessage(buffer, size, LLHost()))
+				{
+					replayReader->readMessage(buffer, LLHost());
+				}
+				replayReader->clearMessage();
+			}
+		}
+		F64 elapsed = timer.getElapsedTimeF64();
+		delete replayReader;
+		replayReader = NULL;
+
+		llinfos << "Replayed " << ROUNDS * NUM_PACKETS << " messages in "
+				<< elapsed * 1000.0 << " ms, "
+				<< (elapsed > 0.0 ? (ROUNDS * NUM_PACKETS) / elapsed : 0.0)
+				<< " messages/sec" << llendl;
+		ensure_equals("every message handled", replayMessages, (U32)(ROUNDS * NUM_PACKETS));
+		ensure_equals("every variable read back", replayChecksum, expected_checksum * ROUNDS);
+	}
+
+	template<> template<>
+	void LLTemplateMessageBuilderTestObject::test<47>()
+		// access by template position, as used by the generated views
+	{
+		LLMessageTemplate messageTemplate = defaultTemplate();
+		messageTemplate.addBlock(defaultBlock(MVT_U32, 4));
+		messageTemplate.addBlock(createBlock(_PREHASH_Test1, MVT_U32, 4, MBT_SINGLE));
+		U32 outValue, inValue = 0xbbbbbbbb;
+		// leave out the variable block in front
+		LLTemplateMessageBuilder* builder = defaultBuilder(messageTemplate, _PREHASH_Test1);
+		builder->addU32(_PREHASH_Test0, inValue);
+		LLTemplateMessageReader* reader = setReader(messageTemplate, builder);
+		ensure_equals("Ensure template", reader->getMessageTemplate(), &messageTemplate);
+		ensure_equals("Ensure absent block counts 0", reader->getNumberOfBlocksAt(0), 0);
+		ensure_equals("Ensure present block count", reader->getNumberOfBlocksAt(1), 1);
+		ensure_equals("Ensure size", reader->getSizeAt(1, 0, 0), 4);
+		reader->getDataAt(1, 0, &outValue, sizeof(outValue));
+		ensure_equals("Ensure U32 by position", outValue, inValue);
+		// by name the absent block is still not in the message
+		ensure_equals("Ensure absent block by name", reader->getNumberOfBlocks(_PREHASH_Test0), 0);
+		ensure_equals("Ensure absent block size", reader->getSize(_PREHASH_Test0, _PREHASH_Test0),
+					  LL_BLOCK_NOT_IN_MESSAGE);
+		delete reader;
+	}
+}
@@ -0,0 +1,270 @@
+#!/usr/bin/python
+"""\
+@file gen_message_views.py
+@brief Writes llmessageviews.h, typed views and builders for every template message.
+
+$LicenseInfo:firstyear=2010&license=viewerlgpl$
+Second Life Viewer Source Code
+Copyright (C) 2010, Linden Research, Inc.
+
+This library is free software; you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation;
+version 2.1 of the License only.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+
+Linden Research, Inc., 945 Battery Street, San Francisco, CA  94111  USA
+$/LicenseInfo$
+"""
+
+"""gen_message_views reads message_template.msg and writes a C++ header with,
+for every message, a subclass of LLMessageView (llmessage/llmessageview.h)
+with a getter per block and variable, and a builder with an add method per
+variable. Run by the llmessage build:
+
+  gen_message_views.py message_template.msg llmessageviews.h
+"""
+
+import sys
+import os.path
+
+def add_indra_lib_path():
+    root = os.path.realpath(__file__)
+    # always insert the directory of the script in the search path
+    dir = os.path.dirname(root)
+    if dir not in sys.path:
+        sys.path.insert(0, dir)
+
+    # Now go look for indra/lib/python in the parent dies
+    while root != os.path.sep:
+        root = os.path.dirname(root)
+        dir = os.path.join(root, 'indra', 'lib', 'python')
+        if os.path.isdir(dir):
+            if dir not in sys.path:
+                sys.path.insert(0, dir)
+            break
+    else:
+        print >>sys.stderr, "This script is not inside a valid installation."
+        sys.exit(1)
+
+add_indra_lib_path()
+
+from indra.ipc import llmessage
+
+# template type: (EMsgVariableType, size, C++ type, LLMessageView read method,
+# LLMessageSystem add method)
+TYPES = {
+    'U8':           ('MVT_U8', 1, 'U8', 'readU8', 'addU8Fast'),
+    'U16':          ('MVT_U16', 2, 'U16', 'readU16', 'addU16Fast'),
+    'U32':          ('MVT_U32', 4, 'U32', 'readU32', 'addU32Fast'),
+    'U64':          ('MVT_U64', 8, 'U64', 'readU64', 'addU64Fast'),
+    'S8':           ('MVT_S8', 1, 'S8', 'readS8', 'addS8Fast'),
+    'S16':          ('MVT_S16', 2, 'S16', 'readS16', 'addS16Fast'),
+    'S32':          ('MVT_S32', 4, 'S32', 'readS32', 'addS32Fast'),
+    'F32':          ('MVT_F32', 4, 'F32', 'readF32', 'addF32Fast'),
+    'F64':          ('MVT_F64', 8, 'F64', 'readF64', 'addF64Fast'),
+    'LLVector3':    ('MVT_LLVector3', 12, 'LLVector3', 'readVector3', 'addVector3Fast'),
+    'LLVector3d':   ('MVT_LLVector3d', 24, 'LLVector3d', 'readVector3d', 'addVector3dFast'),
+    'LLVector4':    ('MVT_LLVector4', 16, 'LLVector4', 'readVector4', 'addVector4Fast'),
+    'LLQuaternion': ('MVT_LLQuaternion', 12, 'LLQuaternion', 'readQuat', 'addQuatFast'),
+    'LLUUID':       ('MVT_LLUUID', 16, 'LLUUID', 'readUUID', 'addUUIDFast'),
+    'BOOL':         ('MVT_BOOL', 1, 'BOOL', 'readBOOL', 'addBOOLFast'),
+    'IPADDR':       ('MVT_IP_ADDR', 4, 'U32', 'readIPAddr', 'addIPAddrFast'),
+    'IPPORT':       ('MVT_IP_PORT', 2, 'U16', 'readIPPort', 'addIPPortFast'),
+    }
+
+# Types passed to the builders by reference
+BY_REFERENCE = ('LLVector3', 'LLVector3d', 'LLVector4', 'LLQuaternion', 'LLUUID')
+
+# Methods every view inherits from LLMessageView, generated names must not
+# hide them
+RESERVED = ('getMessageName', 'getBlockCount', 'getVarSize', 'getLayout')
+
+class GenerateError(Exception):
+    pass
+
+def var_layout(var):
+    if var.type == 'Fixed':
+        return ('MVT_FIXED', int(var.size))
+    if var.type == 'Variable':
+        return ('MVT_VARIABLE', int(var.size))
+    if var.type not in TYPES:
+        raise GenerateError("unknown type %s of variable %s" % (var.type, var.name))
+    return TYPES[var.type][:2]
+
+def check_unique(names, where):
+    seen = set()
+    for name in names:
+        if name in seen or name in RESERVED:
+            raise GenerateError("generated name %s clashes in %s" % (name, where))
+        seen.add(name)
+
+def write_layout(out, message):
+    out.append("\tstatic Layout& getLayout()")
+    out.append("\t{")
+    for block in message.blocks:
+        if not block.variables:
+            continue
+        out.append("\t\tstatic VarLayout s%sVars[] = {" % block.name)
+        for var in block.variables:
+            type_enum, size = var_layout(var)
+            out.append("\t\t\t{ \"%s\", %s, %d }," % (var.name, type_enum, size))
+        out.append("\t\t};")
+    if message.blocks:
+        out.append("\t\tstatic BlockLayout sBlocks[] = {")
+        for block in message.blocks:
+            vars = block.variables and "s%sVars" % block.name or "NULL"
+            out.append("\t\t\t{ \"%s\", %d, %s }," % (block.name, len(block.variables), vars))
+        out.append("\t\t};")
+    blocks = message.blocks and "sBlocks" or "NULL"
+    out.append("\t\tstatic Layout sLayout = { \"%s\", %d, %s, FALSE, NULL, FALSE };"
+               % (message.name, len(message.blocks), blocks))
+    out.append("\t\treturn sLayout;")
+    out.append("\t}")
+
+def write_view(out, message):
+    out.append("class %s : public LLMessageView" % message.name)
+    out.append("{")
+    out.append("public:")
+    write_layout(out, message)
+    out.append("")
+    out.append("\texplicit %s(LLMessageSystem* msg) : LLMessageView(msg, getLayout()) {}" % message.name)
+
+    names = []
+    for b, block in enumerate(message.blocks):
+        out.append("")
+        out.append("\tclass %sBlock" % block.name)
+        out.append("\t{")
+        out.append("\tpublic:")
+        out.append("\t\t%sBlock(const LLMessageView& view, S32 blocknum) : mView(view), mBlockNum(blocknum) {}"
+                   % block.name)
+        var_names = []
+        for v, var in enumerate(block.variables):
+            args = "%d, %d, mBlockNum" % (b, v)
+            if var.type == 'Fixed':
+                out.append("\t\tvoid get%s(void* data) const { mView.readBinary(%s, data, %s); }"
+                           % (var.name, args, var.size))
+                var_names.append('get' + var.name)
+            elif var.type == 'Variable':
+                out.append("\t\tS32 get%sSize() const { return mView.getVarSize(%s); }" % (var.name, args))
+                out.append("\t\tvoid get%s(void* data, S32 max_size) const { mView.readBinary(%s, data, 0, max_size); }"
+                           % (var.name, args))
+                out.append("\t\tvoid get%s(std::string& str) const { mView.readString(%s, str); }"
+                           % (var.name, args))
+                var_names.extend(['get%sSize' % var.name, 'get' + var.name])
+            else:
+                type_enum, size, ctype, read, add = TYPES[var.type]
+                out.append("\t\t%s get%s() const { return mView.%s(%s); }" % (ctype, var.name, read, args))
+                var_names.append('get' + var.name)
+        check_unique(var_names, "%s.%s" % (message.name, block.name))
+        out.append("")
+        out.append("\tprivate:")
+        out.append("\t\tconst LLMessageView& mView;")
+        out.append("\t\tS32 mBlockNum;")
+        out.append("\t};")
+        out.append("")
+        out.append("\t%sBlock get%s(S32 blocknum = 0) const { return %sBlock(*this, blocknum); }"
+                   % (block.name, block.name, block.name))
+        out.append("\tS32 get%sCount() const { return getBlockCount(%d); }" % (block.name, b))
+        names.extend(['get' + block.name, 'get%sCount' % block.name])
+    check_unique(names, message.name)
+    out.append("};")
+    out.append("")
+
+def write_builder(out, message):
+    out.append("class %s : public LLMessageViewBuilder" % message.name)
+    out.append("{")
+    out.append("public:")
+    out.append("\texplicit %s(LLMessageSystem* msg) : LLMessageViewBuilder(msg, LLMessageViews::%s::getLayout()) {}"
+               % (message.name, message.name))
+    for b, block in enumerate(message.blocks):
+        out.append("")
+        out.append("\tclass %sBlock : public BlockBuilder" % block.name)
+        out.append("\t{")
+        out.append("\tpublic:")
+        out.append("\t\t%sBlock(LLMessageSystem* msg, const LLMessageView::BlockLayout& block) : BlockBuilder(msg, block) {}"
+                   % block.name)
+        for v, var in enumerate(block.variables):
+            head = "\t\t%sBlock& add%s" % (block.name, var.name)
+            if var.type == 'Fixed':
+                out.append("%s(const void* data) { mMsg->addBinaryDataFast(varName(%d), data, %s); return *this; }"
+                           % (head, v, var.size))
+            elif var.type == 'Variable':
+                out.append("%s(const void* data, S32 size) { mMsg->addBinaryDataFast(varName(%d), data, size); return *this; }"
+                           % (head, v))
+                out.append("%s(const std::string& str) { mMsg->addStringFast(varName(%d), str); return *this; }"
+                           % (head, v))
+            else:
+                type_enum, size, ctype, read, add = TYPES[var.type]
+                if var.type in BY_REFERENCE:
+                    ctype = "const %s&" % ctype
+                out.append("%s(%s value) { mMsg->%s(varName(%d), value); return *this; }"
+                           % (head, ctype, add, v))
+        out.append("\t};")
+        out.append("")
+        out.append("\t%sBlock next%s() { return %sBlock(mMsg, nextBlock(%d)); }"
+                   % (block.name, block.name, block.name, b))
+    out.append("};")
+    out.append("")
+
+def generate(template):
+    messages = sorted(template.messages.values(), key=lambda m: m.name)
+    out = []
+    out.append("// Generated by scripts/gen_message_views.py from message_template.msg,")
+    out.append("// do not edit. See llmessageview.h.")
+    out.append("")
+    out.append("#ifndef LL_LLMESSAGEVIEWS_H")
+    out.append("#define LL_LLMESSAGEVIEWS_H")
+    out.append("")
+    out.append("#include \"llmessageview.h\"")
+    out.append("#include \"llquaternion.h\"")
+    out.append("#include \"lluuid.h\"")
+    out.append("#include \"v3dmath.h\"")
+    out.append("#include \"v3math.h\"")
+    out.append("#include \"v4math.h\"")
+    out.append("")
+    out.append("namespace LLMessageViews")
+    out.append("{")
+    out.append("")
+    for message in messages:
+        write_view(out, message)
+    out.append("} // namespace LLMessageViews")
+    out.append("")
+    out.append("namespace LLMessageBuilders")
+    out.append("{")
+    out.append("")
+    for message in messages:
+        write_builder(out, message)
+    out.append("} // namespace LLMessageBuilders")
+    out.append("")
+    out.append("#endif // LL_LLMESSAGEVIEWS_H")
+    return "\n".join(out) + "\n"
+
+def main():
+    if len(sys.argv) != 3:
+        print >>sys.stderr, "usage: %s message_template.msg llmessageviews.h" % sys.argv[0]
+        return 1
+    template = llmessage.parseTemplateFile(open(sys.argv[1]))
+    try:
+        text = generate(template)
+    except GenerateError, e:
+        print >>sys.stderr, "%s: %s" % (sys.argv[1], e)
+        return 1
+
+    # Only touch the header when it changes, everything including it would
+    # rebuild otherwise
+    if os.path.exists(sys.argv[2]) and open(sys.argv[2]).read() == text:
+        return 0
+    open(sys.argv[2], 'w').write(text)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())